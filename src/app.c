@@ -16,6 +16,7 @@
 #include "chan_quectel.h" /* struct pvt */
 #include "error.h"
 #include "helpers.h" /* send_sms() ITEMS_OF() */
+#include "smsbulk.h" /* smsbulk_submit() */
 
 struct ast_channel;
 
@@ -69,6 +70,36 @@ struct ast_channel;
         </syntax>
         <see-also>
             <ref type="application">QUECTEL_SEND_USSD</ref>
+            <ref type="application">QUECTEL_SEND_SMS_BULK</ref>
+        </see-also>
+    </application>
+    <application name="QUECTEL_SEND_SMS_BULK" language="en_US">
+        <synopsis>
+            Sends a SMS to many recipients by devices of group.
+        </synopsis>
+        <syntax>
+            <parameter name="group" required="true">
+                <para>Group of devices from configuration file.</para>
+            </parameter>
+            <parameter name="destinations" required="true">
+                <para>Recipients separated by <literal>&amp;</literal>.</para>
+            </parameter>
+            <parameter name="message" required="true">
+                <para>Text of the message.</para>
+            </parameter>
+            <parameter name="validity" required="false">
+                <para>Validity period in minutes.</para>
+            </parameter>
+            <parameter name="report" required="false">
+                <para>Boolean flag for report request.</para>
+            </parameter>
+        </syntax>
+        <description>
+            <para>Messages are spread over available devices of group respecting sms_bulk_rate and sms_bulk_depth settings.
+            Number of submitted job is stored in <variable>QUECTEL_SMS_BULK_JOB</variable> variable.</para>
+        </description>
+        <see-also>
+            <ref type="application">QUECTEL_SEND_SMS</ref>
         </see-also>
     </application>
     <application name="QUECTEL_SEND_USSD" language="en_US">
@@ -157,6 +188,12 @@ static int app_status_ex_read(struct ast_channel* channel, const char* cmd, char
     if (pvt) {
         ast_json_object_set(status, "resource", ast_json_string_create(args.resource));
         pvt_get_status(pvt, status);
+
+        pvt_stat_t stat;
+        pvt_get_stat(pvt, &stat);
+        struct ast_json* const jstat = ast_json_object_create();
+        pvt_get_stat_json(&stat, jstat);
+        ast_json_object_set(status, "stat", jstat);
     } else {
         ast_json_object_set(status, "resource", ast_json_string_create(args.resource));
         ast_json_object_set(status, "exists", ast_json_integer_create(0));
@@ -239,6 +276,46 @@ static int app_send_sms_exec(attribute_unused struct ast_channel* channel, const
     return 0;
 }
 
+static int app_send_sms_bulk_exec(struct ast_channel* channel, const char* data)
+{
+    /* clang-format off */
+
+    AST_DECLARE_APP_ARGS(args,
+        AST_APP_ARG(group);
+        AST_APP_ARG(destinations);
+        AST_APP_ARG(message);
+        AST_APP_ARG(validity);
+        AST_APP_ARG(report);
+    );
+
+    /* clang-format on */
+
+    if (ast_strlen_zero(data)) {
+        return -1;
+    }
+
+    char* const parse = ast_strdupa(data);
+
+    AST_STANDARD_APP_ARGS(args, parse);
+
+    int group;
+    if (ast_strlen_zero(args.group) || sscanf(args.group, "%d", &group) != 1 || group < 0) {
+        ast_log(LOG_ERROR, "Invalid group for message -- SMS will not be sent\n");
+        return -1;
+    }
+
+    const int job = smsbulk_submit(group, args.destinations, args.message, parse_validity(args.validity), parse_report_flag(args.report));
+    if (job < 0) {
+        ast_log(LOG_ERROR, "[g%d] %s\n", group, error2str(chan_quectel_err));
+        return -1;
+    }
+
+    char buf[16];
+    snprintf(buf, sizeof(buf), "%d", job);
+    pbx_builtin_setvar_helper(channel, "QUECTEL_SMS_BULK_JOB", buf);
+    return 0;
+}
+
 static int app_send_ussd_exec(attribute_unused struct ast_channel* channel, const char* data)
 {
     /* clang-format off */
@@ -291,8 +368,9 @@ static struct ast_custom_function status_ex_function = {
 
 /* clang-format on */
 
-static const char APP_SEND_SMS[]  = "QUECTEL_SEND_SMS";
-static const char APP_SEND_USSD[] = "QUECTEL_SEND_USSD";
+static const char APP_SEND_SMS[]      = "QUECTEL_SEND_SMS";
+static const char APP_SEND_SMS_BULK[] = "QUECTEL_SEND_SMS_BULK";
+static const char APP_SEND_USSD[]     = "QUECTEL_SEND_USSD";
 
 int app_register()
 {
@@ -304,6 +382,7 @@ int app_register()
     res  = ast_custom_function_register(&status_function);
     res |= ast_custom_function_register(&status_ex_function);
     res |= ast_register_application2(APP_SEND_SMS, app_send_sms_exec, NULL, NULL, self_module());
+    res |= ast_register_application2(APP_SEND_SMS_BULK, app_send_sms_bulk_exec, NULL, NULL, self_module());
     res |= ast_register_application2(APP_SEND_USSD, app_send_ussd_exec, NULL, NULL, self_module());
 
     return res;
@@ -312,6 +391,7 @@ int app_register()
 void app_unregister()
 {
     ast_unregister_application(APP_SEND_USSD);
+    ast_unregister_application(APP_SEND_SMS_BULK);
     ast_unregister_application(APP_SEND_SMS);
     ast_custom_function_unregister(&status_ex_function);
     ast_custom_function_unregister(&status_function);
@@ -0,0 +1,109 @@
+/*
+   arena.c
+*/
+#include <string.h> /* memset() */
+
+#include "ast_config.h"
+
+#include <asterisk/strings.h>
+#include <asterisk/utils.h>
+
+#include "arena.h"
+
+#define ARENA_ALIGN 16u
+
+struct arena_chunk {
+    struct arena_chunk* next;
+    size_t pad; /*!< keep data aligned */
+    char data[0];
+};
+
+static size_t arena_align(size_t len) { return (len + ARENA_ALIGN - 1u) & ~(size_t)(ARENA_ALIGN - 1u); }
+
+void arena_init(struct arena* arena, size_t size)
+{
+    memset(arena, 0, sizeof(*arena));
+    arena->size = arena_align(size);
+}
+
+static void arena_free_chunks(struct arena* arena)
+{
+    struct arena_chunk* chunk = arena->chunks;
+
+    while (chunk) {
+        struct arena_chunk* const next = chunk->next;
+        ast_free(chunk);
+        chunk = next;
+    }
+
+    arena->chunks  = NULL;
+    arena->spilled = 0;
+    arena->spills  = 0;
+}
+
+void arena_destroy(struct arena* arena)
+{
+    arena_free_chunks(arena);
+    ast_free(arena->block);
+    arena->block = NULL;
+    arena->used  = 0;
+}
+
+void* arena_alloc(struct arena* arena, size_t len)
+{
+    len = arena_align(len ? len : 1u);
+
+    if (!arena->block && arena->size) {
+        arena->block = ast_malloc(arena->size);
+    }
+
+    if (arena->block && len <= arena->size - arena->used) {
+        void* const res = arena->block + arena->used;
+        arena->used += len;
+        return res;
+    }
+
+    struct arena_chunk* const chunk = ast_malloc(sizeof(struct arena_chunk) + len);
+    if (!chunk) {
+        return NULL;
+    }
+
+    chunk->next   = arena->chunks;
+    arena->chunks = chunk;
+    arena->spilled += len;
+    arena->spills++;
+    return chunk->data;
+}
+
+void* arena_calloc(struct arena* arena, size_t nmemb, size_t size)
+{
+    if (size && nmemb > ((size_t)-1) / size) {
+        return NULL;
+    }
+
+    void* const res = arena_alloc(arena, nmemb * size);
+    if (res) {
+        memset(res, 0, nmemb * size);
+    }
+    return res;
+}
+
+struct ast_str* arena_str(struct arena* arena, size_t len)
+{
+    struct ast_str* const res = arena_alloc(arena, sizeof(struct ast_str) + len);
+    if (!res) {
+        return NULL;
+    }
+
+    res->__AST_STR_LEN   = len;
+    res->__AST_STR_USED  = 0u;
+    res->__AST_STR_TS    = DS_STATIC;
+    *ast_str_buffer(res) = '\000';
+    return res;
+}
+
+void arena_reset(struct arena* arena)
+{
+    arena_free_chunks(arena);
+    arena->used = 0;
+}
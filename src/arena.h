@@ -0,0 +1,50 @@
+/*
+   arena.h
+*/
+#ifndef CHAN_QUECTEL_ARENA_H_INCLUDED
+#define CHAN_QUECTEL_ARENA_H_INCLUDED
+
+#include <sys/types.h>
+
+struct ast_str;
+struct arena_chunk;
+
+/*
+    Scratch arena
+
+    Bump allocator for short living buffers of one response handler.
+    Memory is taken from a block allocated on first use, requests which do not fit
+    the block get separate heap chunks. Nothing is freed individually,
+    arena_reset() releases all allocations at once and keeps the block.
+*/
+
+struct arena {
+    char* block;                /*!< main block, allocated on first use */
+    size_t size;                /*!< size of main block */
+    size_t used;                /*!< bytes used in main block */
+    size_t spilled;             /*!< bytes allocated in chunks since reset */
+    unsigned int spills;        /*!< number of chunks allocated since reset */
+    struct arena_chunk* chunks; /*!< allocations which do not fit main block */
+};
+
+void arena_init(struct arena* arena, size_t size);
+void arena_destroy(struct arena* arena);
+
+/*!< return uninitialized memory aligned for any type, valid until reset */
+void* arena_alloc(struct arena* arena, size_t len);
+
+/*!< return zero filled memory, valid until reset */
+void* arena_calloc(struct arena* arena, size_t nmemb, size_t size);
+
+/*!< return empty static string of given capacity, it is never reallocated */
+struct ast_str* arena_str(struct arena* arena, size_t len);
+
+/*!< number of bytes allocated since reset */
+static inline size_t arena_used(const struct arena* arena) { return arena->used + arena->spilled; }
+
+/*!< number of heap bytes held by arena */
+static inline size_t arena_memory(const struct arena* arena) { return (arena->block ? arena->size : 0u) + arena->spilled; }
+
+void arena_reset(struct arena* arena);
+
+#endif /* CHAN_QUECTEL_ARENA_H_INCLUDED */
@@ -16,8 +16,11 @@
    Copyright (C) 2020 Max von Buelow <max@m9x.de>
 */
 
+#include <inttypes.h> /* PRIi64 */
+
 #include "ast_config.h"
 
+#include <asterisk/astobj2.h> /* ao2_cleanup() */
 #include <asterisk/causes.h>
 #include <asterisk/utils.h>
 
@@ -28,8 +31,11 @@
 #include "channel.h"
 #include "char_conv.h" /* char_to_hexstr_7bit() */
 #include "error.h"
-#include "pdu.h" /* build_pdu() */
+#include "pdu.h"       /* build_pdu() */
+#include "pdu_cache.h" /* pdu_cache_get() */
+#include "poller.h"    /* poller_covers() */
 #include "smsdb.h"
+#include "smsexpiry.h" /* smsexpiry_notify() */
 
 DECLARE_AT_CMD(at, "");
 DECLARE_AT_CMD(chld2, "+CHLD=2");
@@ -57,18 +63,30 @@ const char* attribute_const at_cmd2str(at_cmd_t cmd)
 
 static int __attribute__((format(printf, 2, 0))) at_fill_generic_cmd_va(at_queue_cmd_t* cmd, const char* format, va_list ap)
 {
-    static const ssize_t AT_CMD_DEF_LEN = 32;
-
-    RAII_VAR(struct ast_str*, cmdstr, ast_str_create(AT_CMD_DEF_LEN), ast_free);
+    va_list aq;
 
-    ast_str_set_va(&cmdstr, 0, format, ap);
-    const size_t cmdlen = ast_str_strlen(cmdstr);
+    va_copy(aq, ap);
+    const int cmdlen = vsnprintf(cmd->inline_data, sizeof(cmd->inline_data), format, aq);
+    va_end(aq);
 
-    if (!cmdlen) {
+    if (cmdlen <= 0) {
         return -1;
     }
 
-    cmd->data    = ast_strndup(ast_str_buffer(cmdstr), cmdlen);
+    if ((size_t)cmdlen < sizeof(cmd->inline_data)) {
+        /* short command is kept in command itself */
+        cmd->data   = cmd->inline_data;
+        cmd->flags |= ATQ_CMD_FLAG_INLINE;
+    } else {
+        char* const data = ast_malloc(cmdlen + 1);
+        if (!data) {
+            return -1;
+        }
+        vsnprintf(data, cmdlen + 1, format, ap);
+        cmd->data   = data;
+        cmd->flags &= ~ATQ_CMD_FLAG_INLINE;
+    }
+
     cmd->length  = (unsigned int)cmdlen;
     cmd->flags  &= ~ATQ_CMD_FLAG_STATIC;
 
@@ -285,6 +303,9 @@ int at_enqueue_initialization(struct cpvt* cpvt)
         out++;
     }
 
+    /* ATZ and module restart reset CLIR */
+    pvt->clir = -1;
+
     if (out > 0) {
         return at_queue_insert(cpvt, cmds, out, 0);
     }
@@ -341,7 +362,7 @@ int at_enqueue_initialization_quectel(struct cpvt* cpvt, unsigned int dsci)
         ATQ_CMD_DECLARE_ST(CMD_AT_FINAL, at),
     };
 
-    return at_queue_insert_const(cpvt, cmds, ARRAY_LEN(cmds), 0);
+    return at_queue_insert_const_pipeline(cpvt, cmds, ARRAY_LEN(cmds), 0);
 }
 
 int at_enqueue_initialization_simcom(struct cpvt* cpvt)
@@ -382,7 +403,7 @@ int at_enqueue_initialization_simcom(struct cpvt* cpvt)
         ATQ_CMD_DECLARE_ST(CMD_AT_FINAL, at),
     };
 
-    return at_queue_insert_const(cpvt, cmds, ARRAY_LEN(cmds), 0);
+    return at_queue_insert_const_pipeline(cpvt, cmds, ARRAY_LEN(cmds), 0);
 }
 
 int at_enqueue_initialization_other(struct cpvt* cpvt)
@@ -405,7 +426,7 @@ int at_enqueue_cspn_cops(struct cpvt* cpvt)
 
     static at_queue_cmd_t cmds[] = {ATQ_CMD_DECLARE_STI(CMD_AT_CSPN, cspn), ATQ_CMD_DECLARE_STI(CMD_AT_COPS, cops)};
 
-    if (at_queue_insert_const(cpvt, cmds, ARRAY_LEN(cmds), 0)) {
+    if (at_queue_insert_const_pipeline(cpvt, cmds, ARRAY_LEN(cmds), 0)) {
         chan_quectel_err = E_QUEUE;
         return -1;
     }
@@ -432,7 +453,7 @@ int at_enqueue_qspn_qnwinfo(struct cpvt* cpvt)
 }
 
 /* SMS sending */
-static int at_enqueue_pdu(const char* pdu, size_t length, size_t tpdulen, at_queue_cmd_t* const cmds)
+static int at_enqueue_pdu(const pdu_template_part_t* part, const char* destination, int csmsref, at_queue_cmd_t* const cmds)
 {
     DECLARE_AT_CMDNT(cmgs, "+CMGS=%d");
 
@@ -443,13 +464,20 @@ static int at_enqueue_pdu(const char* pdu, size_t length, size_t tpdulen, at_que
 
     // DATA
     cmds[1]           = st_cmds[1];
-    char* const cdata = cmds[1].data = ast_malloc(length + 2);
+    char* const cdata = cmds[1].data = ast_malloc(PDU_LENGTH * 2 + 2);
     if (!cdata) {
-        return -ENOMEM;
+        chan_quectel_err = E_MALLOC;
+        return -1;
+    }
+
+    size_t tpdulen;
+    const ssize_t length = pdu_template_fill(part, destination, (uint8_t)csmsref, cdata, &tpdulen);
+    if (length < 0) {
+        at_queue_free_data(&cmds[1]);
+        return -1;
     }
 
-    cmds[1].length = length + 1;
-    memcpy(cdata, pdu, length);
+    cmds[1].length    = length + 1;
     cdata[length]     = 0x1A;
     cdata[length + 1] = 0x0;
 
@@ -457,7 +485,8 @@ static int at_enqueue_pdu(const char* pdu, size_t length, size_t tpdulen, at_que
     cmds[0] = st_cmds[0];
     if (at_fill_generic_cmd(&cmds[0], AT_CMD(cmgs), (int)tpdulen)) {
         at_queue_free_data(&cmds[1]);
-        return E_CMD_FORMAT;
+        chan_quectel_err = E_CMD_FORMAT;
+        return -1;
     }
 
     return 0;
@@ -471,55 +500,24 @@ static void pdus_clear(at_queue_cmd_t* cmds, ssize_t idx)
 
     const ssize_t u = idx * 2;
     for (ssize_t i = 0; i < u; ++i) {
-        ast_free(cmds[i].data);
+        at_queue_free_data(&cmds[i]);
     }
 }
 
-static int pdus_build(pdu_part_t* const pdus, const char* msg, int csmsref, const char* destination, unsigned validity, int report_req)
+static int pdus_enqueue(struct cpvt* const cpvt, const struct pdu_template* tmpl, const char* destination, int csmsref, const int64_t uid)
 {
-    if (!pdus) {
-        chan_quectel_err = E_BUILD_PDU;
-        return -1;
-    }
-
-    const int msg_len             = strlen(msg);
-    const size_t msg_ucs2_buf_len = sizeof(uint16_t) * msg_len * 2;
-    RAII_VAR(uint16_t*, msg_ucs2, ast_calloc(sizeof(uint16_t), msg_len * 2), ast_free);
-
-    if (!msg_ucs2) {
-        chan_quectel_err = E_MALLOC;
-        return -1;
-    }
-
-    const ssize_t msg_ucs2_len = utf8_to_ucs2(msg, msg_len, msg_ucs2, msg_ucs2_buf_len);
-    if (msg_ucs2_len <= 0) {
-        chan_quectel_err = E_PARSE_UTF8;
-        return msg_ucs2_len;
-    }
-
-    const int res = pdu_build_mult(pdus, "", destination, msg_ucs2, msg_ucs2_len, validity, report_req, csmsref);
-    return res;
-}
+    const ssize_t len = tmpl->count;
 
-static int pdus_enqueue(struct cpvt* const cpvt, const pdu_part_t* const pdus, ssize_t len, const int uid)
-{
     RAII_VAR(at_queue_cmd_t*, cmds, ast_calloc(sizeof(at_queue_cmd_t), len * 2), ast_free);
     if (!cmds) {
         chan_quectel_err = E_MALLOC;
         return -1;
     }
 
-    RAII_VAR(char*, hexbuf, ast_malloc(PDU_LENGTH * 2 + 1), ast_free);
-    if (!hexbuf) {
-        chan_quectel_err = E_MALLOC;
-        return -1;
-    }
-
     at_queue_cmd_t* pcmds = cmds;
 
     for (ssize_t i = 0; i < len; ++i, pcmds += 2) {
-        hexify(pdus[i].buffer, pdus[i].length, hexbuf);
-        if (at_enqueue_pdu(hexbuf, pdus[i].length * 2, pdus[i].tpdu_length, pcmds) < 0) {
+        if (at_enqueue_pdu(&tmpl->parts[i], destination, csmsref, pcmds) < 0) {
             pdus_clear(cmds, i);
             return -1;
         }
@@ -554,26 +552,27 @@ int at_enqueue_sms(struct cpvt* cpvt, const char* destination, const char* msg,
         return -1;
     }
 
-    RAII_VAR(pdu_part_t*, pdus, ast_calloc(sizeof(pdu_part_t), 255), ast_free);
-    const int pdus_len = pdus_build(pdus, msg, csmsref, destination, validity_minutes, !!report_req);
-    if (pdus_len <= 0) {
-        return pdus_len;
+    RAII_VAR(struct pdu_template*, tmpl, pdu_cache_get(msg, validity_minutes, !!report_req), ao2_cleanup);
+    if (!tmpl) {
+        return -1;
     }
 
-    const int uid = smsdb_outgoing_add(pvt->imsi, destination, msg, pdus_len, validity_minutes * 60, report_req);
+    const int pdus_len = tmpl->count;
+    const int64_t uid = smsdb_outgoing_add(pvt->imsi, destination, msg, pdus_len, validity_minutes * 60, report_req);
     if (uid <= 0) {
         chan_quectel_err = E_SMSDB;
         return -1;
     }
+    smsexpiry_notify(validity_minutes * 60);
 
-    if (pdus_enqueue(cpvt, pdus, pdus_len, uid)) {
+    if (pdus_enqueue(cpvt, tmpl, destination, csmsref, uid)) {
         return -1;
     }
 
     if (pdus_len <= 1) {
-        ast_verb(1, "[%s][SMS:%d] Message enqueued\n", PVT_ID(pvt), uid);
+        ast_verb(1, "[%s][SMS:%" PRIi64 "] Message enqueued\n", PVT_ID(pvt), uid);
     } else {
-        ast_verb(1, "[%s][SMS:%d] Message enqueued in %d parts\n", PVT_ID(pvt), uid, pdus_len);
+        ast_verb(1, "[%s][SMS:%" PRIi64 "] Message enqueued in %d parts\n", PVT_ID(pvt), uid, pdus_len);
     }
 
     RAII_VAR(struct ast_json*, report, ast_json_object_create(), ast_json_unref);
@@ -773,6 +772,9 @@ int at_enqueue_reset(struct cpvt* cpvt)
     DECLARE_AT_CMD(cmd, "+CFUN=1,1");
     static const at_queue_cmd_t cmd = ATQ_CMD_DECLARE_ST(CMD_AT_CFUN, cmd);
 
+    /* restart of module resets CLIR */
+    cpvt->pvt->clir = -1;
+
     if (at_queue_insert_const(cpvt, &cmd, 1u, 0)) {
         chan_quectel_err = E_QUEUE;
         return -1;
@@ -795,7 +797,6 @@ int at_enqueue_dial(struct cpvt* cpvt, const char* number, int clir)
 
     struct pvt* const pvt = cpvt->pvt;
     unsigned int cnt      = 0;
-    char* tmp             = NULL;
 
     at_queue_cmd_t cmds[6];
 
@@ -807,18 +808,21 @@ int at_enqueue_dial(struct cpvt* cpvt, const char* number, int clir)
         cnt++;
     }
 
-    if (clir != -1) {
+    /* CLIR is kept by device, sent only when changed */
+    const int send_clir = clir != -1 && clir != pvt->clir;
+    if (send_clir) {
         if (at_fill_generic_cmd(&cmds[cnt], AT_CMD(clir), clir)) {
             chan_quectel_err = E_CMD_FORMAT;
             return -1;
         }
-        tmp = cmds[cnt].data;
         ATQ_CMD_INIT_DYNI(cmds[cnt], CMD_AT_CLIR);
         cnt++;
     }
 
     if (at_fill_generic_cmd(&cmds[cnt], AT_CMD(atd), number)) {
-        ast_free(tmp);
+        if (send_clir) {
+            at_queue_free_data(&cmds[cnt - 1]);
+        }
         chan_quectel_err = E_CMD_FORMAT;
         return -1;
     }
@@ -831,8 +835,14 @@ int at_enqueue_dial(struct cpvt* cpvt, const char* number, int clir)
         return -1;
     }
 
+    /* reset to unknown if AT+CLIR fails or task is dropped, see at_queue_remove() */
+    if (send_clir) {
+        pvt->clir = clir;
+    }
+
     /* set CALL_FLAG_NEED_HANGUP early because ATD may be still in queue while local hangup called */
     CPVT_SET_FLAG(cpvt, CALL_FLAG_NEED_HANGUP);
+    cpvt_trace(cpvt, CALL_TRACE_ENQUEUE);
     return 0;
 }
 
@@ -958,10 +968,70 @@ int at_enqueue_ping(struct cpvt* cpvt)
     return -1;
 }
 
-static void at_enqueue_ping_sys_chan(struct pvt* pvt) { at_enqueue_ping(&pvt->sys_chan); }
+static void at_enqueue_ping_sys_chan(struct pvt* pvt)
+{
+    if (poller_covers(pvt)) {
+        /* periodic poll checks device */
+        return;
+    }
+    at_enqueue_ping(&pvt->sys_chan);
+}
 
 int at_enqueue_ping_taskproc(void* tpdata) { return PVT_TASKPROC_TRYLOCK_AND_EXECUTE(tpdata, at_enqueue_ping_sys_chan); }
 
+/*!
+ * \brief Enqueue periodic queries of device as one command line
+ * \param cpvt -- cpvt structure
+ * \param what -- AT_POLL_* flags
+ * \return 0 on success
+ */
+int at_enqueue_poll(struct cpvt* cpvt, unsigned int what)
+{
+    DECLARE_NAKED_AT_CMD(csq, "+CSQ");
+    DECLARE_NAKED_AT_CMD(cspn, "+CSPN?");
+    DECLARE_NAKED_AT_CMD(cops, "+COPS?");
+    DECLARE_NAKED_AT_CMD(qspn, "+QSPN");
+    DECLARE_NAKED_AT_CMD(qnwinfo, "+QNWINFO");
+    DECLARE_NAKED_AT_CMD(cclk, "+CCLK?");
+    DECLARE_NAKED_AT_CMD(qlts, "+QLTS=1");
+
+    static const at_queue_cmd_t cmd_csq     = ATQ_CMD_DECLARE_STI(CMD_AT_CSQ, csq);
+    static const at_queue_cmd_t cmd_cspn    = ATQ_CMD_DECLARE_STI(CMD_AT_CSPN, cspn);
+    static const at_queue_cmd_t cmd_cops    = ATQ_CMD_DECLARE_STI(CMD_AT_COPS, cops);
+    static const at_queue_cmd_t cmd_qspn    = ATQ_CMD_DECLARE_STI(CMD_AT_QSPN, qspn);
+    static const at_queue_cmd_t cmd_qnwinfo = ATQ_CMD_DECLARE_STI(CMD_AT, qnwinfo);
+    static const at_queue_cmd_t cmd_cclk    = ATQ_CMD_DECLARE_STI(CMD_AT_CCLK, cclk);
+    static const at_queue_cmd_t cmd_qlts    = ATQ_CMD_DECLARE_STI(CMD_AT_QLTS_1, qlts);
+
+    const struct pvt* const pvt = cpvt->pvt;
+    at_queue_cmd_t cmds[4];
+    unsigned int cnt            = 0;
+
+    if (what & AT_POLL_SIGNAL) {
+        cmds[cnt++] = cmd_csq;
+    }
+
+    if (what & AT_POLL_PROVIDER) {
+        cmds[cnt++] = pvt->is_simcom ? cmd_cspn : cmd_qspn;
+        cmds[cnt++] = pvt->is_simcom ? cmd_cops : cmd_qnwinfo;
+    }
+
+    if (what & AT_POLL_TIME) {
+        cmds[cnt++] = pvt->is_simcom ? cmd_cclk : cmd_qlts;
+    }
+
+    if (!cnt) {
+        return 0;
+    }
+
+    if (at_queue_insert_const_at_once(cpvt, cmds, cnt, 0)) {
+        chan_quectel_err = E_QUEUE;
+        return -1;
+    }
+
+    return 0;
+}
+
 /*!
  * \brief Enqueue user-specified command
  * \param cpvt -- cpvt structure
@@ -970,6 +1040,9 @@ int at_enqueue_ping_taskproc(void* tpdata) { return PVT_TASKPROC_TRYLOCK_AND_EXE
  */
 int at_enqueue_user_cmd(struct cpvt* cpvt, const char* input)
 {
+    /* any user command may change CLIR behind cache, ATZ AT&F AT+CFUN reset it */
+    cpvt->pvt->clir = -1;
+
     if (at_enqueue_generic(cpvt, CMD_USER, 1, "%s\r", input)) {
         chan_quectel_err = E_QUEUE;
         return -1;
@@ -998,6 +1071,55 @@ void at_sms_retrieved(struct cpvt* cpvt, int confirm)
     pvt->incoming_sms_index = -1;
 }
 
+/*!
+ * \brief Account entry of message listing
+ * \param cpvt -- cpvt structure
+ * \param idx -- index of message in store
+ * \param persisted -- message was delivered or its part committed to database
+ */
+void at_sms_listed_entry(struct cpvt* cpvt, int idx, int persisted)
+{
+    struct pvt* const pvt = cpvt->pvt;
+
+    pvt->sms_batch.listed++;
+    if (!persisted || idx < 0) {
+        return;
+    }
+
+    const unsigned int bits = sizeof(pvt->sms_batch.persisted[0]) * 8u;
+    if ((unsigned int)idx < ARRAY_LEN(pvt->sms_batch.persisted) * bits) {
+        pvt->sms_batch.persisted[idx / bits] |= 1u << (idx % bits);
+    } else if (CONF_SHARED(pvt, autodeletesms)) {
+        at_enqueue_delete_sms(cpvt, idx, TRIBOOL_NONE);
+    }
+}
+
+/*!
+ * \brief Delete messages of finished listing
+ * \param cpvt -- cpvt structure
+ *
+ * Only listed messages which are delivered or persisted are deleted by index,
+ * other messages in store are left untouched.
+ */
+void at_sms_listed(struct cpvt* cpvt)
+{
+    struct pvt* const pvt = cpvt->pvt;
+
+    if (CONF_SHARED(pvt, autodeletesms) && pvt->sms_batch.listed) {
+        const unsigned int bits = sizeof(pvt->sms_batch.persisted[0]) * 8u;
+        unsigned int deleted    = 0;
+        for (unsigned int i = 0; i < ARRAY_LEN(pvt->sms_batch.persisted) * bits; ++i) {
+            if (pvt->sms_batch.persisted[i / bits] & (1u << (i % bits))) {
+                at_enqueue_delete_sms(cpvt, (int)i, TRIBOOL_NONE);
+                deleted++;
+            }
+        }
+        ast_debug(1, "[%s] Deleting %u of %u listed messages\n", PVT_ID(pvt), deleted, pvt->sms_batch.listed);
+    }
+
+    memset(&pvt->sms_batch, 0, sizeof(pvt->sms_batch));
+}
+
 int at_enqueue_list_messages(struct cpvt* cpvt, enum msg_status_t stat)
 {
     DECLARE_AT_CMDNT(cmgl, "+CMGL=%d");
@@ -1466,6 +1588,9 @@ int at_enqueue_uac_apply(struct cpvt* cpvt)
         ATQ_CMD_DECLARE_ST(CMD_AT_QRXGAIN, cfun),
     };
 
+    /* restart of module resets CLIR */
+    cpvt->pvt->clir = -1;
+
     if (at_queue_insert_const_at_once(cpvt, cmds, ARRAY_LEN(cmds), 0)) {
         chan_quectel_err = E_QUEUE;
         return -1;
@@ -1635,6 +1760,26 @@ int at_enqueue_cgains(struct cpvt* cpvt, int txgain, int rxgain)
     return 0;
 }
 
+int at_enqueue_tonedet(struct cpvt* cpvt, int enable)
+{
+    DECLARE_AT_CMD(qtonedet_0, "+QTONEDET=0");
+    DECLARE_AT_CMD(qtonedet_1, "+QTONEDET=1");
+    DECLARE_AT_CMD(ddet_0, "+DDET=0");
+    DECLARE_AT_CMD(ddet_1, "+DDET=1");
+
+    static const at_queue_cmd_t cmds[2][2] = {
+        {ATQ_CMD_DECLARE_ST(CMD_AT_QTONEDET_0, qtonedet_0), ATQ_CMD_DECLARE_ST(CMD_AT_QTONEDET_1, qtonedet_1)},
+        {ATQ_CMD_DECLARE_ST(CMD_AT_DDET_0, ddet_0), ATQ_CMD_DECLARE_ST(CMD_AT_DDET_1, ddet_1)},
+    };
+
+    if (at_queue_insert_const(cpvt, &cmds[cpvt->pvt->is_simcom ? 1 : 0][enable ? 1 : 0], 1u, 0)) {
+        chan_quectel_err = E_QUEUE;
+        return -1;
+    }
+
+    return 0;
+}
+
 int at_enqueue_query_qaudloop(struct cpvt* cpvt)
 {
     DECLARE_AT_CMD(qaudloop, "+QAUDLOOP?");
@@ -1888,7 +2033,7 @@ int at_enqueue_csq(struct cpvt* cpvt)
     return 0;
 }
 
-int at_enqueue_escape(struct cpvt* cpvt, int uid)
+int at_enqueue_escape(struct cpvt* cpvt, int64_t uid)
 {
     DECLARE_NAKED_AT_CMD(esc, "\x1B");
     static const at_queue_cmd_t cmd = ATQ_CMD_DECLARE_ST(CMD_ESC, esc);
@@ -15,6 +15,7 @@
 /* AT_COMMANDS_TABLE */
 #define AT_CMD_AS_ENUM(cmd, str) CMD_##cmd,
 #define AT_CMD_AS_STRING(cmd, str) str,
+#define AT_CMD_AS_ONE(cmd, str) +1
 
 #define AT_COMMANDS_TABLE(_)                        \
     _(USER, "USER")                                 \
@@ -126,6 +127,8 @@
 
 typedef enum { AT_COMMANDS_TABLE(AT_CMD_AS_ENUM) } at_cmd_t;
 
+enum { AT_CMDS_NUMBER = 0 AT_COMMANDS_TABLE(AT_CMD_AS_ONE) };
+
 enum msg_status_t { MSG_STAT_REC_UNREAD, MSG_STAT_REC_READ, MSG_STAT_STO_UNSENT, MSG_STAT_STO_SENT, MSG_STAT_ALL };
 
 struct pvt;
@@ -139,6 +142,11 @@ int at_enqueue_initialization_simcom(struct cpvt*);
 int at_enqueue_initialization_other(struct cpvt*);
 int at_enqueue_ping(struct cpvt* cpvt);
 int at_enqueue_ping_taskproc(void*);
+
+#define AT_POLL_SIGNAL 0x01   /*!< signal strength */
+#define AT_POLL_PROVIDER 0x02 /*!< provider name and network information */
+#define AT_POLL_TIME 0x04     /*!< network time */
+int at_enqueue_poll(struct cpvt* cpvt, unsigned int what);
 int at_enqueue_cspn_cops(struct cpvt* cpvt);
 int at_enqueue_qspn_qnwinfo(struct cpvt* cpvt);
 int at_enqueue_sms(struct cpvt* cpvt, const char* number, const char* msg, unsigned validity_min, int report_req);
@@ -152,6 +160,8 @@ int at_enqueue_user_cmd(struct cpvt* cpvt, const char* input);
 int at_enqueue_list_messages(struct cpvt* cpvt, enum msg_status_t stat);
 int at_enqueue_retrieve_sms(struct cpvt* cpvt, int idx);
 void at_sms_retrieved(struct cpvt* cpvt, int confirm);
+void at_sms_listed_entry(struct cpvt* cpvt, int idx, int persisted);
+void at_sms_listed(struct cpvt* cpvt);
 int at_enqueue_cmgd(struct cpvt* cpvt, unsigned int index, int delflag);
 int at_enqueue_delete_sms(struct cpvt* cpvt, int idx, tristate_bool_t ack);
 int at_enqueue_delete_sms_n(struct cpvt* cpvt, int idx, tristate_bool_t ack);
@@ -174,6 +184,7 @@ int at_enqueue_query_qgains(struct cpvt* cpvt);
 int at_enqueue_qgains(struct cpvt* cpvt, int txgain, int rxdgain);
 int at_enqueue_query_cgains(struct cpvt* cpvt);
 int at_enqueue_cgains(struct cpvt* cpvt, int txgain, int rxgain);
+int at_enqueue_tonedet(struct cpvt* cpvt, int enable);
 int at_enqueue_msg_direct(struct cpvt* cpvt, int directflag);
 int at_enqueue_msg_ack(struct cpvt* cpvt);
 int at_enqueue_msg_ack_n(struct cpvt* cpvt, int n, int uid);
@@ -193,6 +204,6 @@ int at_enqueue_cpcmreg(struct cpvt*, int);
 int at_cpcmreg_immediately(struct pvt*, int);
 int at_enqueue_cpcmfrm(struct cpvt*, int);
 int at_enqueue_csq(struct cpvt*);
-int at_enqueue_escape(struct cpvt*, int);
+int at_enqueue_escape(struct cpvt*, int64_t);
 
 #endif /* CHAN_QUECTEL_AT_SEND_H_INCLUDED */
@@ -16,6 +16,7 @@
 
 #include "at_parse.h"
 
+#include "at_tok.h" /* at_fields_next() at_tok_uint() */
 #include "chan_quectel.h"
 #include "error.h"
 #include "memmem.h"
@@ -199,7 +200,7 @@ int at_parse_cspn(char* str, char** spn)
     return -1;
 }
 
-static int attribute_const act2int(const char* act)
+static int act_tok2int(const struct at_tok* act)
 {
     static const struct {
         const char* act;
@@ -231,7 +232,7 @@ static int attribute_const act2int(const char* act)
     };
 
     for (size_t idx = 0; idx < ARRAY_LEN(ACTS); ++idx) {
-        if (!strcmp(ACTS[idx].act, act)) {
+        if (at_tok_eq(act, ACTS[idx].act)) {
             return ACTS[idx].val;
         }
     }
@@ -239,6 +240,12 @@ static int attribute_const act2int(const char* act)
     return -1;
 }
 
+static int act2int(const char* act)
+{
+    const struct at_tok tok = {act, strlen(act)};
+    return act_tok2int(&tok);
+}
+
 int at_parse_qnwinfo(char* str, int* act, int* oper, char** band, int* channel)
 {
     /*
@@ -297,27 +304,23 @@ int at_parse_qnwinfo(char* str, int* act, int* oper, char** band, int* channel)
 
 /*!
  * \brief Parse a C(E)REG response
- * \param str -- string to parse (null terminated)
+ * \param str -- string to parse
  * \param len -- string lenght
  * \param gsm_reg -- a pointer to a int
  * \param gsm_reg_status -- a pointer to a int
- * \param lac -- a pointer to a char pointer which will store the location area code in hex format
- * \param ci  -- a pointer to a char pointer which will store the cell id in hex format
+ * \param lac -- buffer of lac_len bytes which will store the location area code in hex format, empty if not reported
+ * \param ci  -- buffer of ci_len bytes which will store the cell id in hex format, empty if not reported
  * \param act -- a pointer to an integer which will store access technology
- * @note str will be modified when the C(E)REG message is parsed
  * \retval  0 success
  * \retval -1 parse error
  */
-int at_parse_creg(char* str, int* gsm_reg, int* gsm_reg_status, char** lac, char** ci, int* act)
+int at_parse_creg(const char* str, size_t len, int* gsm_reg, int* gsm_reg_status, char* lac, size_t lac_len, char* ci, size_t ci_len, int* act)
 {
-    char* gsm_reg_str = NULL;
-
-    *gsm_reg            = 0;
-    *gsm_reg_status     = -1;
-    *lac                = NULL;
-    *ci                 = NULL;
-    *act                = -1;
-    const char* act_str = NULL;
+    *gsm_reg        = 0;
+    *gsm_reg_status = -1;
+    *act            = -1;
+    lac[0]          = '\000';
+    ci[0]           = '\000';
 
     /*
      * parse C(E)REG response in the following formats:
@@ -328,61 +331,61 @@ int at_parse_creg(char* str, int* gsm_reg, int* gsm_reg_status, char** lac, char
      *   +CEREG: <stat>[,<tac>,<ci>[,<AcT>]]
      */
 
-    static const char delimiters[] = ":,,,,";
+    struct at_fields f;
+    struct at_tok t[5];
 
-    char* marks[STRLEN(delimiters)];
-    const unsigned int n = mark_line(str, delimiters, marks);
-    switch (n) {
+    at_fields_init(&f, str, len);
+    if (at_fields_skip_prefix(&f)) {
+        return 0;
+    }
+
+    const struct at_tok* stat  = NULL;
+    const struct at_tok* lac_t = NULL;
+    const struct at_tok* act_t = NULL;
+
+    switch (at_fields_take(&f, t, ARRAY_LEN(t))) {
         case 5:
-            marks[1][0] = '\000';
-            marks[2][0] = '\000';
-            marks[3][0] = '\000';
-            marks[4][0] = '\000';
-            act_str     = marks[4] + 1;
-            *ci         = strip_quoted(marks[3] + 1);
-            *lac        = strip_quoted(marks[2] + 1);
-            gsm_reg_str = strip_quoted(marks[1] + 1);
+            stat  = &t[1];
+            lac_t = &t[2];
+            act_t = &t[4];
             break;
 
         case 4:
-            marks[1][0] = '\000';
-            marks[2][0] = '\000';
-            marks[3][0] = '\000';
-            if (marks[1][1] == '"') {
-                *ci         = strip_quoted(marks[2] + 1);
-                *lac        = strip_quoted(marks[1] + 1);
-                gsm_reg_str = strip_quoted(marks[0] + 1);
+            /* LAC is quoted, <n> is not */
+            if (t[1].len && t[1].ptr[0] == '"') {
+                stat  = &t[0];
+                lac_t = &t[1];
+                act_t = &t[3];
             } else {
-                act_str     = marks[3] + 1;
-                *ci         = strip_quoted(marks[3] + 1);
-                *lac        = strip_quoted(marks[2] + 1);
-                gsm_reg_str = strip_quoted(marks[1] + 1);
+                stat  = &t[1];
+                lac_t = &t[2];
             }
             break;
 
         case 3:
-            marks[1][0] = '\000';
-            marks[2][0] = '\000';
-            *ci         = strip_quoted(marks[2] + 1);
-            *lac        = strip_quoted(marks[1] + 1);
-            gsm_reg_str = strip_quoted(marks[0] + 1);
+            stat  = &t[0];
+            lac_t = &t[1];
             break;
 
         case 2:
-            marks[1][0] = '\000';
-            gsm_reg_str = strip_quoted(marks[1] + 1);
+            stat = &t[1];
             break;
 
         case 1:
-            gsm_reg_str = strip_quoted(marks[0] + 1);
+            stat = &t[0];
             break;
     }
 
-    if (gsm_reg_str) {
-        errno            = 0;
-        const int status = (int)strtol(gsm_reg_str, (char**)NULL, 10);
-        if (status == 0 && errno == EINVAL) {
-            *gsm_reg_status = -1;
+    if (lac_t) {
+        const struct at_tok lac_v = at_tok_unquote(lac_t[0]);
+        const struct at_tok ci_v  = at_tok_unquote(lac_t[1]);
+        at_tok_copy(&lac_v, lac, lac_len);
+        at_tok_copy(&ci_v, ci, ci_len);
+    }
+
+    if (stat) {
+        int status;
+        if (at_tok_int(*stat, &status)) {
             return -1;
         }
 
@@ -394,14 +397,8 @@ int at_parse_creg(char* str, int* gsm_reg, int* gsm_reg_status, char** lac, char
         }
     }
 
-    if (act_str) {
-        errno          = 0;
-        const int lact = (int)strtol(act_str, (char**)NULL, 10);
-        if (errno == EINVAL) {
-            *act = -1;
-        } else {
-            *act = lact;
-        }
+    if (act_t && at_tok_int(*act_t, act)) {
+        *act = -1;
     }
 
     return 0;
@@ -451,8 +448,7 @@ int at_parse_cdsi(const char* str, int* idx)
 static int parse_pdu(const char* str, size_t len, int* tpdu_type, char* sca, size_t sca_len, char* oa, size_t oa_len, char* scts, int* mr, int* st, char* dt,
                      char* msg, size_t* msg_len, pdu_udh_t* udh)
 {
-    uint16_t msg16_tmp[256];
-
+    /* hex is converted in place, header and user data are decoded from it once */
     int pdu_length = (unhex(str, (uint8_t*)str) + 1) / 2;
     if (pdu_length < 0) {
         chan_quectel_err = E_MALFORMED_HEXSTR;
@@ -486,18 +482,12 @@ static int parse_pdu(const char* str, size_t len, int* tpdu_type, char* sca, siz
             break;
 
         case PDUTYPE_MTI_SMS_DELIVER:
-            res = tpdu_parse_deliver((uint8_t*)(str + i), pdu_length - i, *tpdu_type, oa, oa_len, scts, msg16_tmp, udh);
+            res = tpdu_parse_deliver((uint8_t*)(str + i), pdu_length - i, *tpdu_type, oa, oa_len, scts, msg, *msg_len, udh);
             if (res < 0) {
                 /* tpdu_parse_deliver sets chan_quectel_err */
                 return -1;
             }
-            res = ucs2_to_utf8(msg16_tmp, res, msg, *msg_len);
-            if (res < 0) {
-                chan_quectel_err = E_PARSE_UCS2;
-                return -1;
-            }
             *msg_len = res;
-            msg[res] = '\0';
             break;
 
         default:
@@ -891,7 +881,7 @@ int at_parse_csq(const char* str, int* rssi)
     return sscanf(str, "+CSQ:%2d,", rssi) == 1 ? 0 : -1;
 }
 
-int at_parse_csqn(char* str, int* rssi, int* ber)
+int at_parse_csqn(const char* str, size_t len, int* rssi, int* ber)
 {
     /*
         Example:
@@ -899,17 +889,15 @@ int at_parse_csqn(char* str, int* rssi, int* ber)
         +CSQN: 25,0
     */
 
-    char* t = ast_strsep(&str, ':', 0);
-    if (!t) {
-        return -1;
-    }
-    t = ast_strsep(&str, ':', 0);
-    if (!t) {
+    struct at_fields f;
+    struct at_tok t[2];
+
+    at_fields_init(&f, str, len);
+    if (at_fields_skip_prefix(&f) || at_fields_take(&f, t, ARRAY_LEN(t)) != ARRAY_LEN(t)) {
         return -1;
     }
-    t             = ast_skip_blanks(t);
-    const int res = sscanf(t, "%d,%d", rssi, ber);
-    return (res == 2) ? 0 : -1;
+
+    return (at_tok_int(t[0], rssi) || at_tok_int(t[1], ber)) ? -1 : 0;
 }
 
 /*!
@@ -932,54 +920,63 @@ int at_parse_rssi(const char* str)
     return rssi;
 }
 
-int at_parse_qind(char* str, qind_t* qind, char** params)
+int at_parse_qind(const char* str, size_t len, qind_t* qind, struct at_fields* params)
 {
-    static const char delimiters[] = "\"\",";
-    char* marks[STRLEN(delimiters)];
+    /*
+     * +QIND: "<name>",<params>
+     */
 
-    if (mark_line(str, delimiters, marks) == ARRAY_LEN(marks)) {
-        const char* qind_str = marks[0] + 1;
-        marks[1][0]          = '\000';
-
-        if (!strcmp(qind_str, "csq")) {
-            *qind = QIND_CSQ;
-        } else if (!strcmp(qind_str, "act")) {
-            *qind = QIND_ACT;
-        } else if (!strcmp(qind_str, "ccinfo")) {
-            *qind = QIND_CCINFO;
-        } else {
-            *qind = QIND_NONE;
-        }
+    struct at_tok name;
 
-        *params = marks[2] + 1;
-        return 0;
+    at_fields_init(params, str, len);
+    if (at_fields_skip_prefix(params) || at_fields_next(params, &name) || !params->pos || name.len < 2u || name.ptr[0] != '"') {
+        return -1;
     }
 
-    return -1;
+    name = at_tok_unquote(name);
+    if (at_tok_eq(&name, "csq")) {
+        *qind = QIND_CSQ;
+    } else if (at_tok_eq(&name, "act")) {
+        *qind = QIND_ACT;
+    } else if (at_tok_eq(&name, "ccinfo")) {
+        *qind = QIND_CCINFO;
+    } else {
+        *qind = QIND_NONE;
+    }
+
+    return 0;
 }
 
-int at_parse_qind_csq(const char* params, int* rssi)
+int at_parse_qind_csq(struct at_fields* params, int* rssi)
 {
     /*
      * parse notification in the following format:
      * +QIND: "csq",<RSSI>,<BER>
      */
 
-    return sscanf(params, "%d", rssi) == 1 ? 0 : -1;
+    struct at_tok t;
+    return (at_fields_next(params, &t) || at_tok_int(t, rssi)) ? -1 : 0;
 }
 
-int at_parse_qind_act(char* params, int* act)
+int at_parse_qind_act(struct at_fields* params, int* act)
 {
     /*
      * parse notification in the following format:
      * +QIND: "act","<val>"
      */
 
-    *act = act2int(strip_quoted(params));
+    struct at_tok t;
+    if (at_fields_next(params, &t)) {
+        return -1;
+    }
+
+    t    = at_tok_unquote(t);
+    *act = act_tok2int(&t);
     return 0;
 }
 
-int at_parse_qind_cc(char* params, unsigned* call_idx, unsigned* dir, unsigned* state, unsigned* mode, unsigned* mpty, char** number, unsigned* toa)
+int at_parse_qind_cc(struct at_fields* params, unsigned* call_idx, unsigned* dir, unsigned* state, unsigned* mode, unsigned* mpty, char* number, size_t number_len,
+                     unsigned* toa)
 {
     /*
      * +QIND: "ccinfo",<idx>,<dir>,<state>,<mode>,<mpty>,<number>,<type>[,<alpha>]
@@ -988,33 +985,23 @@ int at_parse_qind_cc(char* params, unsigned* call_idx, unsigned* dir, unsigned*
      *  +QIND: "ccinfo",2,0,3,0,0,"XXXXXXXXX",129
      *  +QIND: "ccinfo",2,0,-1,0,0,"XXXXXXXXX",129 [-1 => 7]
      */
-    static const char delimiters[] = ",,,,,,,";
-    static const size_t nmarks     = STRLEN(delimiters) - 1u;
-
-    char* marks[STRLEN(delimiters)];
+    struct at_tok t[7];
 
-    if (mark_line(params, delimiters, marks) < nmarks) {
+    if (at_fields_take(params, t, ARRAY_LEN(t)) != ARRAY_LEN(t)) {
         return -1;
     }
 
     int cc_state;
-    if (sscanf(params, "%u", call_idx) == 1 && sscanf(marks[0] + 1, "%u", dir) == 1 && sscanf(marks[1] + 1, "%d", &cc_state) == 1 &&
-        sscanf(marks[2] + 1, "%u", mode) == 1 && sscanf(marks[3] + 1, "%u", mpty) == 1 && sscanf(marks[5] + 1, "%u", toa) == 1) {
-        marks[4]++;
-        if (marks[4][0] == '"') {
-            marks[4]++;
-        }
-        if (marks[5][-1] == '"') {
-            marks[5]--;
-        }
-        *number     = marks[4];
-        marks[5][0] = '\000';
-
-        *state = (cc_state < 0) ? CALL_STATE_RELEASED : (unsigned)cc_state;
-        return 0;
+    if (at_tok_uint(t[0], call_idx) || at_tok_uint(t[1], dir) || at_tok_int(t[2], &cc_state) || at_tok_uint(t[3], mode) || at_tok_uint(t[4], mpty) ||
+        at_tok_uint(t[6], toa)) {
+        return -1;
     }
 
-    return -1;
+    const struct at_tok num = at_tok_unquote(t[5]);
+    at_tok_copy(&num, number, number_len);
+
+    *state = (cc_state < 0) ? CALL_STATE_RELEASED : (unsigned)cc_state;
+    return 0;
 }
 
 #/* */
@@ -1046,7 +1033,8 @@ int at_parse_csca(char* str, char** csca)
 
 #/* */
 
-int at_parse_dsci(char* str, unsigned* call_idx, unsigned* dir, unsigned* state, unsigned* call_type, char** number, unsigned* toa)
+int at_parse_dsci(const char* str, size_t len, unsigned* call_idx, unsigned* dir, unsigned* state, unsigned* call_type, char* number, size_t number_len,
+                  unsigned* toa)
 {
     /*
      * ^DSCI: <id>,<dir>,<stat>,<type>,<number>,<num_type>[,<tone_info>]\r\n
@@ -1057,27 +1045,27 @@ int at_parse_dsci(char* str, unsigned* call_idx, unsigned* dir, unsigned* state,
      * ^DSCI: 2,1,6,0,+48XXXXXXXXX,145
      */
 
-    static const char delimiters[] = ":,,,,,,";
-    static const size_t nmarks     = STRLEN(delimiters) - 1u;
-
-    char* marks[STRLEN(delimiters)];
+    struct at_fields f;
+    struct at_tok t[6];
 
-    if (mark_line(str, delimiters, marks) >= nmarks) {
-        if (sscanf(marks[0] + 1, "%u", call_idx) == 1 && sscanf(marks[1] + 1, "%u", dir) == 1 && sscanf(marks[2] + 1, "%u", state) == 1 &&
-            sscanf(marks[3] + 1, "%u", call_type) == 1 && sscanf(marks[5] + 1, "%u", toa) == 1) {
-            *number     = marks[4] + 1;
-            marks[5][0] = '\000';
+    at_fields_init(&f, str, len);
+    if (at_fields_skip_prefix(&f) || at_fields_take(&f, t, ARRAY_LEN(t)) != ARRAY_LEN(t)) {
+        return -1;
+    }
 
-            return 0;
-        }
+    if (at_tok_uint(t[0], call_idx) || at_tok_uint(t[1], dir) || at_tok_uint(t[2], state) || at_tok_uint(t[3], call_type) || at_tok_uint(t[5], toa)) {
+        return -1;
     }
 
-    return -1;
+    const struct at_tok num = at_tok_unquote(t[4]);
+    at_tok_copy(&num, number, number_len);
+    return 0;
 }
 
 #/* */
 
-int at_parse_clcc(char* str, unsigned* call_idx, unsigned* dir, unsigned* state, unsigned* mode, unsigned* mpty, char** number, unsigned* toa)
+int at_parse_clcc(const char* str, size_t len, unsigned* call_idx, unsigned* dir, unsigned* state, unsigned* mode, unsigned* mpty, char* number,
+                  size_t number_len, unsigned* toa)
 {
     /*
      * +CLCC:<id1>,<dir>,<stat>,<mode>,<mpty>[,<number>,<type>[,<alpha>[,<priority>]]]\r\n
@@ -1089,27 +1077,22 @@ int at_parse_clcc(char* str, unsigned* call_idx, unsigned* dir, unsigned* state,
      *   +CLCC: 1,1,4,0,0,"0079139131234",145
      *   +CLCC: 1,1,4,0,0,"+7913913ABCA",145
      */
-    static const char delimiters[] = ":,,,,,,";
-    char* marks[STRLEN(delimiters)];
+    struct at_fields f;
+    struct at_tok t[7];
 
-    if (mark_line(str, delimiters, marks) == ARRAY_LEN(marks)) {
-        if (sscanf(marks[0] + 1, "%u", call_idx) == 1 && sscanf(marks[1] + 1, "%u", dir) == 1 && sscanf(marks[2] + 1, "%u", state) == 1 &&
-            sscanf(marks[3] + 1, "%u", mode) == 1 && sscanf(marks[4] + 1, "%u", mpty) == 1 && sscanf(marks[6] + 1, "%u", toa) == 1) {
-            marks[5]++;
-            if (marks[5][0] == '"') {
-                marks[5]++;
-            }
-            if (marks[6][-1] == '"') {
-                marks[6]--;
-            }
-            *number     = marks[5];
-            marks[6][0] = '\000';
+    at_fields_init(&f, str, len);
+    if (at_fields_skip_prefix(&f) || at_fields_take(&f, t, ARRAY_LEN(t)) != ARRAY_LEN(t)) {
+        return -1;
+    }
 
-            return 0;
-        }
+    if (at_tok_uint(t[0], call_idx) || at_tok_uint(t[1], dir) || at_tok_uint(t[2], state) || at_tok_uint(t[3], mode) || at_tok_uint(t[4], mpty) ||
+        at_tok_uint(t[6], toa)) {
+        return -1;
     }
 
-    return -1;
+    const struct at_tok num = at_tok_unquote(t[5]);
+    at_tok_copy(&num, number, number_len);
+    return 0;
 }
 
 #/* */
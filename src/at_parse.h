@@ -11,6 +11,7 @@
 #include "pdu.h"
 
 struct pvt;
+struct at_fields;
 
 typedef enum { QIND_NONE = 0, QIND_CSQ, QIND_ACT, QIND_CCINFO } qind_t;
 
@@ -23,7 +24,7 @@ char* at_parse_cops(char* str);
 int at_parse_qspn(char* str, char** fnn, char** snn, char** spn);
 int at_parse_cspn(char*, char**);
 int at_parse_qnwinfo(char* str, int* act, int* oper, char** band, int* channel);
-int at_parse_creg(char* str, int* gsm_reg, int* gsm_reg_status, char** lac, char** ci, int* act);
+int at_parse_creg(const char* str, size_t len, int* gsm_reg, int* gsm_reg_status, char* lac, size_t lac_len, char* ci, size_t ci_len, int* act);
 int at_parse_cmti(const char* str, int* idx);
 int at_parse_cdsi(const char* str, int* idx);
 int at_parse_cmgr(char* str, size_t len, int* tpdu_type, char* sca, size_t sca_len, char* oa, size_t oa_len, char* scts, int* mr, int* st, char* dt, char* msg,
@@ -40,15 +41,19 @@ int at_parse_cmgs(const char* str);
 int at_parse_cusd(char* str, int* type, char** cusd, int* dcs);
 int at_parse_cpin(const char* str, const size_t len);
 int at_parse_csq(const char* str, int* rssi);
-int at_parse_csqn(char*, int*, int*);
+int at_parse_csqn(const char* str, size_t len, int* rssi, int* ber);
 int at_parse_rssi(const char* str);
-int at_parse_qind(char* str, qind_t* qind, char** params);
-int at_parse_qind_csq(const char* params, int* rssi);
-int at_parse_qind_act(char* params, int* act);
-int at_parse_qind_cc(char* params, unsigned* call_idx, unsigned* dir, unsigned* state, unsigned* mode, unsigned* mpty, char** number, unsigned* toa);
+/* params is cursor of fields following notification name, see at_tok.h */
+int at_parse_qind(const char* str, size_t len, qind_t* qind, struct at_fields* params);
+int at_parse_qind_csq(struct at_fields* params, int* rssi);
+int at_parse_qind_act(struct at_fields* params, int* act);
+int at_parse_qind_cc(struct at_fields* params, unsigned* call_idx, unsigned* dir, unsigned* state, unsigned* mode, unsigned* mpty, char* number, size_t number_len,
+                     unsigned* toa);
 int at_parse_csca(char* str, char** csca);
-int at_parse_dsci(char* str, unsigned* call_idx, unsigned* dir, unsigned* state, unsigned* call_type, char** number, unsigned* toa);
-int at_parse_clcc(char* str, unsigned* call_idx, unsigned* dir, unsigned* state, unsigned* mode, unsigned* mpty, char** number, unsigned* toa);
+int at_parse_dsci(const char* str, size_t len, unsigned* call_idx, unsigned* dir, unsigned* state, unsigned* call_type, char* number, size_t number_len,
+                  unsigned* toa);
+int at_parse_clcc(const char* str, size_t len, unsigned* call_idx, unsigned* dir, unsigned* state, unsigned* mode, unsigned* mpty, char* number,
+                  size_t number_len, unsigned* toa);
 int at_parse_ccwa(char* str, ccwa_variant_t* variant, unsigned int*, unsigned int* class);
 int at_parse_qtonedet(const char* str, int* dtmf);
 int at_parse_dtmf(char* str, char* dtmf);
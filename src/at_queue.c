@@ -17,11 +17,20 @@
 
 #include "chan_quectel.h" /* struct pvt */
 #include "helpers.h"
+#include "histogram.h" /* hist_add() */
+#include "mutils.h" /* MIN() */
+
+static const unsigned int AT_QUEUE_POOL_DEPTH         = 16; /* free tasks kept in every size class */
+static const unsigned int AT_QUEUE_POOL_DEPTH_COMPACT = 2;  /* free tasks kept in every size class, compact memory profile */
+static const uint64_t AT_TIMEOUT_SAMPLES              = 32; /* responses to command before its timeout is learned */
 
 void at_queue_free_data(at_queue_cmd_t* const cmd)
 {
     if (cmd->data) {
-        if (!(cmd->flags & ATQ_CMD_FLAG_STATIC)) {
+        if (cmd->flags & ATQ_CMD_FLAG_INLINE) {
+            cmd->flags &= ~ATQ_CMD_FLAG_INLINE;
+            cmd->data   = NULL;
+        } else if (!(cmd->flags & ATQ_CMD_FLAG_STATIC)) {
             ast_free(cmd->data);
             cmd->data = NULL;
         }
@@ -30,14 +39,100 @@ void at_queue_free_data(at_queue_cmd_t* const cmd)
     cmd->length = 0;
 }
 
-static void at_queue_free(at_queue_task_t* const task)
+/* size class of task, AT_QUEUE_POOL_CLASSES if task is too large for pool */
+static unsigned int at_queue_pool_class(unsigned cmdsno)
+{
+    unsigned int cls = 0;
+
+    while (cls < AT_QUEUE_POOL_CLASSES && (1u << cls) < cmdsno) {
+        ++cls;
+    }
+
+    return cls;
+}
+
+static at_queue_task_t* at_queue_task_alloc(struct pvt* const pvt, unsigned cmdsno)
+{
+    const unsigned int cls = at_queue_pool_class(cmdsno);
+    at_queue_task_t* task;
+
+    if (cls >= AT_QUEUE_POOL_CLASSES) {
+        task = ast_malloc(sizeof(*task) + cmdsno * sizeof(task->cmds[0]));
+    } else if ((task = AST_LIST_REMOVE_HEAD(&pvt->at_pool.tasks[cls], entry))) {
+        pvt->at_pool.count[cls]--;
+        PVT_STAT_INC(pvt, at_taskpool_hits);
+    } else {
+        task = ast_malloc(sizeof(*task) + (1u << cls) * sizeof(task->cmds[0]));
+        PVT_STAT_INC(pvt, at_taskpool_misses);
+    }
+
+    if (!task) {
+        return NULL;
+    }
+
+    memset(task, 0, sizeof(*task));
+    task->pool = cls;
+    return task;
+}
+
+static void at_queue_free(struct pvt* const pvt, at_queue_task_t* const task)
 {
     for (unsigned i = 0; i < task->cmdsno; ++i) {
         at_queue_free_data(&task->cmds[i]);
     }
+
+    const unsigned int cls   = task->pool;
+    const unsigned int depth = CONF_GLOBAL(memory_profile) == MEMORY_PROFILE_COMPACT ? AT_QUEUE_POOL_DEPTH_COMPACT : AT_QUEUE_POOL_DEPTH;
+    if (cls < AT_QUEUE_POOL_CLASSES && pvt->at_pool.count[cls] < depth) {
+        AST_LIST_INSERT_HEAD(&pvt->at_pool.tasks[cls], task, entry);
+        pvt->at_pool.count[cls]++;
+        return;
+    }
+
     ast_free(task);
 }
 
+void at_queue_pool_fini(struct pvt* pvt)
+{
+    for (unsigned int cls = 0; cls < AT_QUEUE_POOL_CLASSES; ++cls) {
+        at_queue_task_t* task;
+
+        while ((task = AST_LIST_REMOVE_HEAD(&pvt->at_pool.tasks[cls], entry))) {
+            ast_free(task);
+        }
+        pvt->at_pool.count[cls] = 0;
+    }
+}
+
+static size_t at_queue_task_memory(const at_queue_task_t* const task)
+{
+    const unsigned int capacity = task->pool < AT_QUEUE_POOL_CLASSES ? (1u << task->pool) : task->cmdsno;
+    return sizeof(*task) + capacity * sizeof(task->cmds[0]);
+}
+
+size_t at_queue_memory(const struct pvt* pvt)
+{
+    const at_queue_task_t* task;
+    size_t res = 0;
+
+    AST_LIST_TRAVERSE(&pvt->at_queue, task, entry) {
+        res += at_queue_task_memory(task);
+        for (unsigned i = 0; i < task->cmdsno; ++i) {
+            if (task->cmds[i].data && !(task->cmds[i].flags & (ATQ_CMD_FLAG_STATIC | ATQ_CMD_FLAG_INLINE))) {
+                res += task->cmds[i].length + 1u;
+            }
+        }
+    }
+
+    for (unsigned int cls = 0; cls < AT_QUEUE_POOL_CLASSES; ++cls) {
+        AST_LIST_TRAVERSE(&pvt->at_pool.tasks[cls], task, entry) {
+            res += at_queue_task_memory(task);
+        }
+    }
+
+    return res;
+}
+
 static void at_queue_remove(struct pvt* const pvt)
 {
     // U+21B3 : Downwards Arrow with Tip Rightwards : 0xE2 0x86 0xB3
@@ -49,6 +144,14 @@ static void at_queue_remove(struct pvt* const pvt)
 
     PVT_STATE(pvt, at_tasks)--;
     PVT_STATE(pvt, at_cmds) -= task->cmdsno - task->cindex;
+    pvt_load_update(pvt);
+
+    /* CLIR cached by dial is unknown if its AT+CLIR is dropped before OK */
+    for (unsigned i = task->cindex; i < task->cmdsno; ++i) {
+        if (task->cmds[i].cmd == CMD_AT_CLIR) {
+            pvt->clir = -1;
+        }
+    }
 
     if (task->cmdsno == 1u) {
         ast_debug(4, "[%s][%s] \xE2\x86\xB3 [%s] tasks:%lu \n", PVT_ID(pvt), at_cmd2str(task->cmds[0].cmd), at_res2str(task->cmds[0].res),
@@ -61,7 +164,79 @@ static void at_queue_remove(struct pvt* const pvt)
                   task->cindex, task->cmdsno, (unsigned long)PVT_STATE(pvt, at_tasks));
     }
 
-    at_queue_free(task);
+    at_queue_free(pvt, task);
+}
+
+static at_queue_prio_t at_queue_cmd_prio(at_cmd_t cmd)
+{
+    switch (cmd) {
+        case CMD_AT_A:
+        case CMD_AT_D:
+        case CMD_AT_CHUP:
+        case CMD_AT_QHUP:
+        case CMD_AT_DTMF:
+        case CMD_AT_CHLD_1x:
+        case CMD_AT_CHLD_2x:
+        case CMD_AT_CHLD_2:
+        case CMD_AT_CHLD_3:
+            return ATQ_PRIO_CALL;
+
+        case CMD_USER:
+        case CMD_AT_CUSD:
+        case CMD_AT_CNMA:
+            return ATQ_PRIO_INTERACTIVE;
+
+        default:
+            return ATQ_PRIO_BACKGROUND;
+    }
+}
+
+/* class of task is class of most urgent command */
+static at_queue_prio_t at_queue_task_prio(const at_queue_task_t* const task)
+{
+    at_queue_prio_t prio = ATQ_PRIO_BACKGROUND;
+
+    for (unsigned i = 0; i < task->cmdsno && prio != ATQ_PRIO_CALL; ++i) {
+        prio = MIN(prio, at_queue_cmd_prio(task->cmds[i].cmd));
+    }
+
+    return prio;
+}
+
+/* nothing of task is written to device yet */
+static int at_queue_task_pending(const at_queue_task_t* const task)
+{
+    return !task->cindex && !task->windex && task->cmds[0].length && ast_tvzero(task->cmds[0].written);
+}
+
+/*
+    Tasks are ordered by class and by arrival inside class, athead puts task in front of its class.
+    Head task in progress is never overtaken here, see at_queue_yield().
+    Head task not written yet is overtaken by task of more urgent class, so dial does not wait for it.
+*/
+static void at_queue_insert_task(struct pvt* const pvt, at_queue_task_t* const e, int athead)
+{
+    at_queue_task_t* after = AST_LIST_FIRST(&pvt->at_queue);
+
+    if (!after) {
+        AST_LIST_INSERT_HEAD(&pvt->at_queue, e, entry);
+        return;
+    }
+
+    if (e->prio < after->prio && at_queue_task_pending(after)) {
+        AST_LIST_INSERT_HEAD(&pvt->at_queue, e, entry);
+        PVT_STAT_INC(pvt, at_preempted);
+        return;
+    }
+
+    for (at_queue_task_t* t = AST_LIST_NEXT(after, entry); t; t = AST_LIST_NEXT(t, entry)) {
+        if (athead ? t->prio >= e->prio : t->prio > e->prio) {
+            break;
+        }
+        after = t;
+    }
+
+    AST_LIST_INSERT_AFTER(&pvt->at_queue, after, e, entry);
 }
 
 at_queue_task_t* at_queue_add(struct cpvt* cpvt, const at_queue_cmd_t* cmds, unsigned cmdsno, int prio, unsigned at_once)
@@ -72,7 +247,8 @@ at_queue_task_t* at_queue_add(struct cpvt* cpvt, const at_queue_cmd_t* cmds, uns
         return NULL;
     }
 
-    at_queue_task_t* const e = ast_calloc(1, sizeof(*e) + cmdsno * sizeof(*cmds));
+    struct pvt* const pvt    = cpvt->pvt;
+    at_queue_task_t* const e = at_queue_task_alloc(pvt, cmdsno);
     if (!e) {
         return NULL;
     }
@@ -82,33 +258,137 @@ at_queue_task_t* at_queue_add(struct cpvt* cpvt, const at_queue_cmd_t* cmds, uns
     e->at_once = at_once;
 
     memcpy(&e->cmds[0], cmds, cmdsno * sizeof(*cmds));
-
-    struct pvt* const pvt        = cpvt->pvt;
-    at_queue_task_t* const first = AST_LIST_FIRST(&pvt->at_queue);
-
-    if (prio && first) {
-        AST_LIST_INSERT_AFTER(&pvt->at_queue, first, e, entry);
-    } else {
-        AST_LIST_INSERT_TAIL(&pvt->at_queue, e, entry);
+    for (unsigned i = 0; i < cmdsno; ++i) {
+        e->cmds[i].written = ast_tv(0, 0);
+        if (e->cmds[i].flags & ATQ_CMD_FLAG_INLINE) {
+            /* inline data is moved with command */
+            e->cmds[i].data = e->cmds[i].inline_data;
+        }
     }
 
+    e->prio = at_queue_task_prio(e);
+    at_queue_insert_task(pvt, e, prio);
+
     PVT_STATE(pvt, at_tasks)++;
     PVT_STATE(pvt, at_cmds) += cmdsno;
+    pvt_load_update(pvt);
 
-    PVT_STAT(pvt, at_tasks)++;
-    PVT_STAT(pvt, at_cmds) += cmdsno;
+    PVT_STAT_INC(pvt, at_tasks);
+    PVT_STAT_ADD(pvt, at_cmds, cmdsno);
 
     if (e->cmdsno == 1u) {
-        ast_debug(4, "[%s][%s] \xE2\x86\xB5 [%s][%s] %s%s\n", PVT_ID(pvt), at_cmd2str(e->cmds[0].cmd), at_res2str(e->cmds[0].res),
-                  tmp_esc_nstr(e->cmds[0].data, e->cmds[0].length), prio ? "after head" : "at tail", at_once ? " at once" : "");
+        ast_debug(4, "[%s][%s] \xE2\x86\xB5 [%s][%s] class:%u %s%s\n", PVT_ID(pvt), at_cmd2str(e->cmds[0].cmd), at_res2str(e->cmds[0].res),
+                  tmp_esc_nstr(e->cmds[0].data, e->cmds[0].length), e->prio, prio ? "first" : "last", at_once ? " at once" : "");
     } else {
-        ast_debug(4, "[%s][%s] \xE2\x86\xB5 [%s] cmds:%u %s%s\n", PVT_ID(pvt), at_cmd2str(e->cmds[0].cmd), at_res2str(e->cmds[0].res), e->cmdsno,
-                  prio ? "after head" : "at tail", at_once ? " at once" : "");
+        ast_debug(4, "[%s][%s] \xE2\x86\xB5 [%s] cmds:%u class:%u %s%s\n", PVT_ID(pvt), at_cmd2str(e->cmds[0].cmd), at_res2str(e->cmds[0].res),
+                  e->cmdsno, e->prio, prio ? "first" : "last", at_once ? " at once" : "");
     }
 
     return e;
 }
 
+#/* pvt locked */
+
+/*
+    Round trip estimator of RFC 6298 with gains 1/8 and 1/4.
+    Learned timeout is twice the larger of srtt + 4 * rttvar and 99th percentile,
+    so one slow response does not make timeout expire on next one.
+*/
+static void at_queue_learn_timeout(struct pvt* pvt, at_cmd_t cmd, const struct histogram* rtt, uint64_t us)
+{
+    const uint32_t sample = (uint32_t)MIN(us, (uint64_t)UINT32_MAX);
+    uint32_t srtt         = pvt->latency.at_srtt[cmd];
+    uint32_t rttvar       = pvt->latency.at_rttvar[cmd];
+
+    if (rtt->count == 1u) {
+        srtt   = sample;
+        rttvar = sample / 2u;
+    } else {
+        const uint32_t delta = srtt > sample ? srtt - sample : sample - srtt;
+
+        rttvar = rttvar - rttvar / 4u + delta / 4u;
+        srtt   = srtt - srtt / 8u + sample / 8u;
+    }
+
+    __atomic_store_n(&pvt->latency.at_srtt[cmd], srtt, __ATOMIC_RELAXED);
+    __atomic_store_n(&pvt->latency.at_rttvar[cmd], rttvar, __ATOMIC_RELAXED);
+
+    if (rtt->count < AT_TIMEOUT_SAMPLES) {
+        return;
+    }
+
+    const uint64_t bound = MAX((uint64_t)srtt + 4u * (uint64_t)rttvar, hist_percentile(rtt, 99));
+    __atomic_store_n(&pvt->latency.at_timeout[cmd], (uint32_t)MIN(bound * 2u / 1000u + 1u, (uint64_t)UINT32_MAX), __ATOMIC_RELAXED);
+}
+
+static void at_queue_latency(struct pvt* pvt, at_queue_cmd_t* cmd, at_res_t res)
+{
+    if (ast_tvzero(cmd->written) || res == RES_TIMEOUT || (unsigned int)cmd->cmd >= AT_CMDS_NUMBER) {
+        return;
+    }
+
+    struct histogram** const rtt = &pvt->latency.at_rtt[cmd->cmd];
+    if (!*rtt) {
+        struct histogram* const hist = ast_calloc(1, sizeof(*hist));
+        if (!hist) {
+            return;
+        }
+        /* readers load pointer without pvt lock */
+        __atomic_store_n(rtt, hist, __ATOMIC_RELEASE);
+    }
+
+    const uint64_t us = (uint64_t)ast_tvdiff_us(ast_tvnow(), cmd->written);
+    hist_add(*rtt, us);
+    at_queue_learn_timeout(pvt, cmd->cmd, *rtt, us);
+    /* count only first response */
+    cmd->written = ast_tv(0, 0);
+}
+
+/* learned timeout within configured bounds, fixed timeout of command otherwise */
+static struct timeval at_queue_cmd_timeout(const struct pvt* const pvt, const at_queue_cmd_t* const cmd)
+{
+    if (!CONF_SHARED(pvt, at_timeout_adaptive) || (unsigned int)cmd->cmd >= AT_CMDS_NUMBER || !pvt->latency.at_timeout[cmd->cmd]) {
+        return cmd->timeout;
+    }
+
+    const unsigned int ms = MIN(MAX(pvt->latency.at_timeout[cmd->cmd], CONF_SHARED(pvt, at_timeout_min)), CONF_SHARED(pvt, at_timeout_max));
+    return ast_tv(ms / 1000u, (ms % 1000u) * 1000u);
+}
+
+/* set expire time and mark as written */
+static void at_queue_cmd_written(const struct pvt* const pvt, at_queue_cmd_t* const cmd, struct timeval now)
+{
+    cmd->written = now;
+    cmd->timeout = ast_tvadd(now, at_queue_cmd_timeout(pvt, cmd));
+}
+
+/*
+    Let tasks of more urgent class run between commands of head task.
+    Commands written ahead and PDU expected after prompt are never split.
+*/
+static void at_queue_yield(struct pvt* const pvt, at_queue_task_t* const task, unsigned index)
+{
+    if (task->pipeline || task->cmds[index].res == RES_SMS_PROMPT) {
+        return;
+    }
+
+    at_queue_task_t* after = AST_LIST_NEXT(task, entry);
+    if (!after || after->prio >= task->prio) {
+        return;
+    }
+
+    for (at_queue_task_t* t = AST_LIST_NEXT(after, entry); t && t->prio < task->prio; t = AST_LIST_NEXT(t, entry)) {
+        after = t;
+    }
+
+    AST_LIST_REMOVE_HEAD(&pvt->at_queue, entry);
+    AST_LIST_INSERT_AFTER(&pvt->at_queue, after, task, entry);
+    PVT_STAT_INC(pvt, at_preempted);
+
+    ast_debug(3, "[%s][%s] yield to [%s] cmd:%u/%u\n", PVT_ID(pvt), at_cmd2str(task->cmds[0].cmd), at_cmd2str(AST_LIST_FIRST(&pvt->at_queue)->cmds[0].cmd),
+              task->cindex, task->cmdsno);
+}
+
 static void at_queue_remove_cmd(struct pvt* pvt, at_res_t res)
 {
     at_queue_task_t* const task = AST_LIST_FIRST(&pvt->at_queue);
@@ -116,9 +396,14 @@ static void at_queue_remove_cmd(struct pvt* pvt, at_res_t res)
         return;
     }
 
+    if (task->at_once || task->cindex < task->cmdsno) {
+        at_queue_latency(pvt, &task->cmds[task->at_once ? 0 : task->cindex], res);
+    }
+
     if (task->at_once) {
         task->cindex             = task->cmdsno;
         PVT_STATE(pvt, at_cmds) -= task->cmdsno;
+        pvt_load_update(pvt);
 
         if (task->cmds[0].res == res || (task->cmds[0].flags & ATQ_CMD_FLAG_IGNORE) || res == RES_TIMEOUT) {
             at_queue_remove(pvt);
@@ -129,6 +414,7 @@ static void at_queue_remove_cmd(struct pvt* pvt, at_res_t res)
 
         task->cindex++;
         PVT_STATE(pvt, at_cmds)--;
+        pvt_load_update(pvt);
         if (task->cmds[index].res == res) {
             ast_debug(6, "[%s][%s] \xE2\x8A\x9F result:[%s] cmd:%u/%u flags:%02x\n", PVT_ID(pvt), at_cmd2str(task->cmds[index].cmd), at_res2str(res),
                       task->cindex, task->cmdsno, task->cmds[index].flags);
@@ -137,8 +423,16 @@ static void at_queue_remove_cmd(struct pvt* pvt, at_res_t res)
                       at_res2str(task->cmds[index].res), at_res2str(res), task->cindex, task->cmdsno, task->cmds[index].flags);
         }
 
-        if ((task->cindex >= task->cmdsno) || (task->cmds[index].res != res && !(task->cmds[index].flags & ATQ_CMD_FLAG_IGNORE)) || res == RES_TIMEOUT) {
-            at_queue_remove(pvt);
+        if ((task->cindex >= task->cmdsno) || task->failed || (task->cmds[index].res != res && !(task->cmds[index].flags & ATQ_CMD_FLAG_IGNORE)) ||
+            res == RES_TIMEOUT) {
+            if (task->windex > task->cindex) {
+                /* responses to pipelined commands are still expected */
+                task->failed = 1;
+            } else {
+                at_queue_remove(pvt);
+            }
+        } else {
+            at_queue_yield(pvt, task, index);
         }
     }
 }
@@ -150,6 +444,7 @@ static void at_queue_remove_task_at_once(struct pvt* const pvt)
     if (task && task->at_once) {
         task->cindex             = task->cmdsno;
         PVT_STATE(pvt, at_cmds) -= task->cmdsno;
+        pvt_load_update(pvt);
 
         if (!(task->cmds[0].flags & ATQ_CMD_FLAG_IGNORE)) {
             at_queue_remove(pvt);
@@ -168,6 +463,78 @@ static size_t at_queue_get_total_cmd_len(const at_queue_task_t* const task)
     return res;
 }
 
+static int at_queue_run_pipeline(struct pvt* pvt, at_queue_task_t* const t)
+{
+    const unsigned depth = CONF_SHARED(pvt, at_pipeline) ? CONF_SHARED(pvt, at_pipeline) : 1u;
+    const unsigned limit = MIN(t->cmdsno, t->cindex + depth);
+
+    if (t->failed) {
+        return 0;
+    }
+
+    /* only commands completed by plain OK may be written ahead */
+    size_t buflen = 0;
+    unsigned last = t->windex;
+    for (; last < limit; ++last) {
+        if (last > t->cindex && (t->cmds[last].res != RES_OK || t->cmds[last - 1u].res != RES_OK)) {
+            break;
+        }
+        buflen += t->cmds[last].length;
+    }
+
+    if (last == t->windex) {
+        return 0;
+    }
+
+    at_queue_cmd_t* const cmd = &(t->cmds[t->windex]);
+    int fail;
+
+    if (last - t->windex == 1u) {
+        ast_debug(2, "[%s][%s] \xE2\x86\x92 [%s]\n", PVT_ID(pvt), at_cmd2str(cmd->cmd), tmp_esc_nstr(cmd->data, cmd->length));
+
+        fail = pvt_direct_write(pvt, cmd->data, cmd->length);
+        if (fail) {
+            ast_log(LOG_ERROR, "[%s][%s] \xE2\xA5\x87 [%s]\n", PVT_ID(pvt), at_cmd2str(cmd->cmd), tmp_esc_nstr(cmd->data, cmd->length));
+        }
+    } else {
+        struct ast_str* buf = ast_str_create(buflen + 1u);
+        if (!buf) {
+            return -1;
+        }
+
+        for (unsigned i = t->windex; i < last; ++i) {
+            ast_str_append_substr(&buf, buflen + 1u, t->cmds[i].data, t->cmds[i].length);
+        }
+
+        ast_debug(2, "[%s][%s] \xE2\x86\x92 [%s] cmds:%u\n", PVT_ID(pvt), at_cmd2str(cmd->cmd), tmp_esc_str(buf), last - t->windex);
+
+        fail = pvt_direct_write_str(pvt, buf);
+        if (fail) {
+            ast_log(LOG_ERROR, "[%s][%s] \xE2\xA5\x87 [%s]\n", PVT_ID(pvt), at_cmd2str(cmd->cmd), tmp_esc_str(buf));
+        }
+        ast_free(buf);
+    }
+
+    if (fail) {
+        if (t->windex == t->cindex) {
+            at_queue_remove_cmd(pvt, cmd->res + 1);
+        }
+        return fail;
+    }
+
+    /* commands written ahead of outstanding response */
+    PVT_STAT_ADD(pvt, at_pipelined, last - t->windex - (t->windex == t->cindex));
+
+    const struct timeval now = ast_tvnow();
+    for (; t->windex < last; ++t->windex) {
+        /* set expire time, free data and mark as written */
+        at_queue_cmd_written(pvt, &t->cmds[t->windex], now);
+        at_queue_free_data(&t->cmds[t->windex]);
+    }
+
+    return fail;
+}
+
 int at_queue_run(struct pvt* pvt)
 {
     int fail                 = 0;
@@ -204,10 +571,14 @@ int at_queue_run(struct pvt* pvt)
             for (unsigned i = 0; i < t->cmdsno; ++i) {
                 at_queue_free_data(&t->cmds[i]);
             }
+            /* one response to all commands, fixed timeout */
             at_queue_cmd_t* const cmd = &(t->cmds[0]);
-            cmd->timeout              = ast_tvadd(ast_tvnow(), cmd->timeout);
+            cmd->written              = ast_tvnow();
+            cmd->timeout              = ast_tvadd(cmd->written, cmd->timeout);
         }
         ast_free(buf);
+    } else if (t->pipeline) {
+        fail = at_queue_run_pipeline(pvt, t);
     } else {
         at_queue_cmd_t* const cmd = &(t->cmds[t->cindex]);
         if (!cmd->length) {
@@ -221,8 +592,12 @@ int at_queue_run(struct pvt* pvt)
             ast_log(LOG_ERROR, "[%s][%s] \xE2\xA5\x87 [%s]\n", PVT_ID(pvt), at_cmd2str(cmd->cmd), tmp_esc_nstr(cmd->data, cmd->length));
             at_queue_remove_cmd(pvt, cmd->res + 1);
         } else {
+            if (cmd->cmd == CMD_AT_D) {
+                cpvt_trace(t->cpvt, CALL_TRACE_WRITTEN);
+            }
+
             /* set expire time */
-            cmd->timeout = ast_tvadd(ast_tvnow(), cmd->timeout);
+            at_queue_cmd_written(pvt, cmd, ast_tvnow());
 
             /* free data and mark as written */
             at_queue_free_data(cmd);
@@ -294,7 +669,19 @@ int at_queue_insert_const_at_once(struct cpvt* cpvt, const at_queue_cmd_t* cmds,
     return at_queue_add(cpvt, cmds, cmdsno, athead, 1u) == NULL || at_queue_run(cpvt->pvt);
 }
 
-int at_queue_insert_uid(struct cpvt* cpvt, at_queue_cmd_t* cmds, unsigned cmdsno, int athead, int uid)
+int at_queue_insert_const_pipeline(struct cpvt* cpvt, const at_queue_cmd_t* cmds, unsigned cmdsno, int athead)
+{
+    at_queue_task_t* const task = at_queue_add(cpvt, cmds, cmdsno, athead, 0u);
+
+    if (!task) {
+        return -1;
+    }
+
+    task->pipeline = 1;
+    return at_queue_run(cpvt->pvt);
+}
+
+int at_queue_insert_uid(struct cpvt* cpvt, at_queue_cmd_t* cmds, unsigned cmdsno, int athead, int64_t uid)
 {
     at_queue_task_t* const task = at_queue_add(cpvt, cmds, cmdsno, athead, 0u);
 
@@ -34,6 +34,7 @@ typedef struct at_queue_cmd {
 #define ATQ_CMD_FLAG_STATIC 0x01         /*!< data is static no try deallocate */
 #define ATQ_CMD_FLAG_IGNORE 0x02         /*!< ignore response non match condition */
 #define ATQ_CMD_FLAG_SUPPRESS_ERROR 0x04 /*!< don't print error message if command fails */
+#define ATQ_CMD_FLAG_INLINE 0x08         /*!< data is stored in inline_data, no try deallocate */
 
     struct timeval timeout;      /*!< timeout value, started at time when command actually written on device */
 #define ATQ_CMD_TIMEOUT_SHORT 1  /*!< timeout value  1 sec */
@@ -42,6 +43,11 @@ typedef struct at_queue_cmd {
 
     void* data;      /*!< command and data to send in device */
     unsigned length; /*!< data length */
+
+    struct timeval written; /*!< time when command actually written on device, for latency */
+
+#define ATQ_CMD_INLINE_SIZE 32
+    char inline_data[ATQ_CMD_INLINE_SIZE]; /*!< storage of short formatted command, moved with command */
 } at_queue_cmd_t;
 
 /* initializers */
@@ -61,9 +67,9 @@ typedef struct at_queue_cmd {
     do {                                                     \
         (e).cmd             = (icmd);                        \
         (e).res             = RES_OK;                        \
-        (e).flags           = iflags & ~ATQ_CMD_FLAG_STATIC; \
-        (e).timeout.tv_sec  = ATQ_CMD_TIMEOUT_MEDIUM;        \
-        (e).timeout.tv_usec = 0;                             \
+        (e).flags           = (iflags & ~ATQ_CMD_FLAG_STATIC) | ((e).flags & ATQ_CMD_FLAG_INLINE); \
+        (e).timeout.tv_sec  = ATQ_CMD_TIMEOUT_MEDIUM;                                      \
+        (e).timeout.tv_usec = 0;                                                           \
     } while (0)
 #define ATQ_CMD_INIT_DYN(e, icmd) ATQ_CMD_INIT_DYNF(e, icmd, ATQ_CMD_FLAG_DEFAULT)
 #define ATQ_CMD_INIT_DYNI(e, icmd) ATQ_CMD_INIT_DYNF(e, icmd, ATQ_CMD_FLAG_IGNORE)
@@ -91,23 +97,40 @@ typedef struct at_queue_cmd {
 #define ATQ_CMD_DECLARE_DYNI(cmd) ATQ_CMD_DECLARE_DYNF(cmd, RES_OK, ATQ_CMD_FLAG_IGNORE)
 #define ATQ_CMD_DECLARE_DYNIT(cmd, s, u) ATQ_CMD_DECLARE_DYNFT(cmd, RES_OK, ATQ_CMD_FLAG_IGNORE, s, u)
 
+/* priority classes of tasks, lower value is served first */
+typedef enum {
+    ATQ_PRIO_CALL = 0,    /*!< call control: dial, answer, hangup, hold, DTMF */
+    ATQ_PRIO_INTERACTIVE, /*!< user requests and time critical acknowledges: USSD, raw commands, CNMA */
+    ATQ_PRIO_BACKGROUND,  /*!< SMS, message storage, initialization and polling */
+} at_queue_prio_t;
+
 typedef struct at_queue_task {
     AST_LIST_ENTRY(at_queue_task) entry;
 
     unsigned cmdsno;
     unsigned cindex;
     struct cpvt* cpvt;
-    int uid;
-    unsigned at_once:1;
+    int64_t uid;            /*!< UID of outgoing message or reference of acknowledged one */
+    unsigned windex;        /*!< index of first not yet written command, pipelined tasks only */
+    unsigned at_once :1;
+    unsigned pipeline:1;    /*!< commands may be written before responses to previous ones arrive */
+    unsigned failed  :1;    /*!< task failed, waiting responses to already written commands */
+    unsigned pool    :3;    /*!< size class in at_pool, AT_QUEUE_POOL_CLASSES if not pooled */
+    unsigned prio    :2;    /*!< priority class, at_queue_prio_t */
     at_queue_cmd_t cmds[0]; /* this field must be last */
 } at_queue_task_t;
 
 void at_queue_free_data(at_queue_cmd_t* const cmd);
+void at_queue_pool_fini(struct pvt* pvt);
+
+/* number of heap bytes of queued and free tasks, pvt locked */
+size_t at_queue_memory(const struct pvt* pvt);
 at_queue_task_t* at_queue_add(struct cpvt* cpvt, const at_queue_cmd_t* cmds, unsigned cmdsno, int prio, unsigned at_once);
 int at_queue_insert_const(struct cpvt* cpvt, const at_queue_cmd_t* cmds, unsigned cmdsno, int athead);
 int at_queue_insert_const_at_once(struct cpvt* cpvt, const at_queue_cmd_t* cmds, unsigned cmdsno, int athead);
+int at_queue_insert_const_pipeline(struct cpvt* cpvt, const at_queue_cmd_t* cmds, unsigned cmdsno, int athead);
 int at_queue_insert(struct cpvt* cpvt, at_queue_cmd_t* cmds, unsigned cmdsno, int athead);
-int at_queue_insert_uid(struct cpvt* cpvt, at_queue_cmd_t* cmds, unsigned cmdsno, int athead, int uid);
+int at_queue_insert_uid(struct cpvt* cpvt, at_queue_cmd_t* cmds, unsigned cmdsno, int athead, int64_t uid);
 void at_queue_handle_result(struct pvt* pvt, at_res_t res);
 void at_queue_flush(struct pvt* pvt);
 const at_queue_task_t* at_queue_head_task(const struct pvt* pvt);
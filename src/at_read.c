@@ -134,33 +134,92 @@ size_t at_combine_iov(struct ast_str* const result, const struct iovec* const io
     return len;
 }
 
-static size_t get_2ndeol_pos(const struct ringbuffer* const rb, struct iovec* iov, struct ast_str* buf)
+#/* resumable search of response terminator, read data is never copied and searched again */
+
+static void read_state_reset(struct at_read_state* const state)
 {
-    static const char EOL[2] = {'\r', '\n'};
+    state->term = NULL;
+    state->scan = 0u;
+    state->eol  = 0u;
+}
 
-    const int iovcnt = rb_read_all_iov(rb, iov);
-    if (!iovcnt) {
-        return 0u;
+static void read_state_upd(struct at_read_state* const state, struct ringbuffer* rb, size_t len)
+{
+    rb_read_upd(rb, len);
+    read_state_reset(state);
+}
+
+/* start or continue search of terminator, return offset to search from */
+static size_t read_state_scan(struct at_read_state* const state, const void* term)
+{
+    if (state->term != term) {
+        read_state_reset(state);
+        state->term = term;
+    }
+    return state->scan;
+}
+
+/* nothing found, skip searched data on next read */
+static void read_state_scanned(struct at_read_state* const state, const struct ringbuffer* rb, size_t len)
+{
+    const size_t used = rb_used(rb);
+    if (used >= len && used - len + 1u > state->scan) {
+        state->scan = used - len + 1u;
     }
+}
 
-    const size_t len    = at_combine_iov(buf, iov, iovcnt);
-    const char* const b = ast_str_buffer(buf);
+static int read_n_iov(const struct ringbuffer* rb, struct iovec* iov, size_t len)
+{
+    if (!len) {
+        iov[0].iov_base = (char*)rb->buffer + rb->read;
+        iov[0].iov_len  = 0u;
+        iov[1].iov_len  = 0u;
+        return 1;
+    }
 
-    const char* pos = (const char*)memmem(b, len, EOL, ARRAY_LEN(EOL));
-    if (!pos) {
-        return 0u;
+    return rb_read_n_iov(rb, iov, len);
+}
+
+static int read_until_mem_iov(struct at_read_state* const state, const struct ringbuffer* rb, struct iovec* iov, const char* term, size_t len)
+{
+    const ssize_t pos = rb_find_mem(rb, read_state_scan(state, term), term, len);
+    if (pos < 0) {
+        read_state_scanned(state, rb, len);
+        return 0;
     }
 
-    const size_t shift = (pos - b) + ARRAY_LEN(EOL);
-    pos                = (const char*)memmem(b + shift, len - shift, EOL, ARRAY_LEN(EOL));
-    if (!pos) {
+    return read_n_iov(rb, iov, (size_t)pos);
+}
+
+static size_t get_2ndeol_pos(struct at_read_state* const state, const struct ringbuffer* rb)
+{
+    static const char EOL[2] = {'\r', '\n'};
+
+    ssize_t pos;
+    size_t from = read_state_scan(state, EOL);
+
+    if (!state->eol) {
+        pos = rb_find_mem(rb, from, EOL, ARRAY_LEN(EOL));
+        if (pos < 0) {
+            read_state_scanned(state, rb, ARRAY_LEN(EOL));
+            return 0u;
+        }
+
+        state->eol  = (size_t)pos + ARRAY_LEN(EOL);
+        state->scan = state->eol;
+        from        = state->eol;
+    }
+
+    pos = rb_find_mem(rb, from, EOL, ARRAY_LEN(EOL));
+    if (pos < 0) {
+        read_state_scanned(state, rb, ARRAY_LEN(EOL));
         return 0u;
     }
 
-    return pos - b;
+    return (size_t)pos;
 }
 
-int at_read_result_iov(const char* dev, int* read_result, size_t* skip, struct ringbuffer* rb, struct iovec* iov, struct ast_str* buf)
+static int read_result_iov(const char* dev, struct at_read_state* const state, size_t* skip, struct ringbuffer* rb, struct iovec* iov)
 {
     static const char M_CSSI[]       = "+CSSI:";
     static const char M_CSSU[]       = "\r\n+CSSU:";
@@ -183,35 +242,35 @@ int at_read_result_iov(const char* dev, int* read_result, size_t* skip, struct r
     size_t s = rb_used(rb);
 
     if (s > 0) {
-        /*		ast_debug (5, "[%s] d_read_result %d len %d input [%.*s]\n", dev, *read_result, s, MIN(s, rb->size -
+        /*		ast_debug (5, "[%s] d_read_result %d len %d input [%.*s]\n", dev, state->read_result, s, MIN(s, rb->size -
          * rb->read), (char*)rb->buffer + rb->read); */
 
-        if (*read_result == 0) {
+        if (state->read_result == 0) {
             const int res = rb_memcmp(rb, M_EOL, STRLEN(M_EOL));
             if (!res) {
-                rb_read_upd(rb, STRLEN(M_EOL));
-                *read_result = 1;
+                read_state_upd(state, rb, STRLEN(M_EOL));
+                state->read_result = 1;
 
-                return at_read_result_iov(dev, read_result, skip, rb, iov, buf);
+                return read_result_iov(dev, state, skip, rb, iov);
             } else if (res > 0) {
                 if (rb_read_is_printable(rb)) {
-                    *read_result = 1;
-                    return at_read_result_iov(dev, read_result, skip, rb, iov, buf);
+                    state->read_result = 1;
+                    return read_result_iov(dev, state, skip, rb, iov);
                 }
 
                 if (!rb_memcmp(rb, "\n", 1)) {
-                    rb_read_upd(rb, 1);
-                    return at_read_result_iov(dev, read_result, skip, rb, iov, buf);
+                    read_state_upd(state, rb, 1);
+                    return read_result_iov(dev, state, skip, rb, iov);
                 }
 
                 if (rb_read_until_char_iov(rb, iov, '\r')) {
                     s = at_get_iov_size(iov);
-                    rb_read_upd(rb, s + 1u);
-                    return at_read_result_iov(dev, read_result, skip, rb, iov, buf);
+                    read_state_upd(state, rb, s + 1u);
+                    return read_result_iov(dev, state, skip, rb, iov);
                 }
 
-                rb_read_upd(rb, s);
-                return at_read_result_iov(dev, read_result, skip, rb, iov, buf);
+                read_state_upd(state, rb, s);
+                return read_result_iov(dev, state, skip, rb, iov);
             }
 
             return 0;
@@ -219,47 +278,54 @@ int at_read_result_iov(const char* dev, int* read_result, size_t* skip, struct r
             if (!rb_memcmp(rb, M_CSSI, STRLEN(M_CSSI))) {
                 const int iovcnt = rb_read_n_iov(rb, iov, STRLEN(M_CSSI));
                 if (iovcnt) {
-                    *read_result = 0;
+                    state->read_result = 0;
                 }
 
                 return iovcnt;
             } else if (!(rb_memcmp(rb, M_CSSU, STRLEN(M_CSSU)) && rb_memcmp(rb, M_CMS_ERROR, STRLEN(M_CMS_ERROR)) && rb_memcmp(rb, M_CMGS, STRLEN(M_CMGS)))) {
-                rb_read_upd(rb, 2);
-                return at_read_result_iov(dev, read_result, skip, rb, iov, buf);
+                read_state_upd(state, rb, 2);
+                return read_result_iov(dev, state, skip, rb, iov);
             } else if (!rb_memcmp(rb, M_SMS_PROMPT, STRLEN(M_SMS_PROMPT))) {
-                *read_result = 0;
+                state->read_result = 0;
                 return rb_read_n_iov(rb, iov, STRLEN(M_SMS_PROMPT));
             } else if (!(rb_memcmp(rb, M_CMGR, STRLEN(M_CMGR)) && rb_memcmp(rb, M_CNUM, STRLEN(M_CNUM)) && rb_memcmp(rb, M_ERROR_CNUM, STRLEN(M_ERROR_CNUM)))) {
-                const int iovcnt = rb_read_until_mem_iov(rb, iov, T_OK, STRLEN(T_OK));
+                const int iovcnt = read_until_mem_iov(state, rb, iov, T_OK, STRLEN(T_OK));
                 if (iovcnt) {
                     *skip += 4;
                 }
 
                 return iovcnt;
             } else if (!rb_memcmp(rb, M_CMGL, STRLEN(M_CMGL))) {
-                int iovcnt = rb_read_until_mem_iov(rb, iov, T_CMGL, STRLEN(T_CMGL));
-                if (iovcnt) {
+                /* both terminators are searched from same offset */
+                const size_t from = read_state_scan(state, T_CMGL);
+
+                ssize_t pos = rb_find_mem(rb, from, T_CMGL, STRLEN(T_CMGL));
+                if (pos >= 0) {
                     *skip += 2;
-                } else {
-                    iovcnt = rb_read_until_mem_iov(rb, iov, T_OK, STRLEN(T_OK));
-                    if (iovcnt) {
-                        *skip += 4;
-                    }
+                    return read_n_iov(rb, iov, (size_t)pos);
                 }
-                return iovcnt;
+
+                pos = rb_find_mem(rb, from, T_OK, STRLEN(T_OK));
+                if (pos >= 0) {
+                    *skip += 4;
+                    return read_n_iov(rb, iov, (size_t)pos);
+                }
+
+                read_state_scanned(state, rb, STRLEN(T_CMGL));
+                return 0;
             } else if (!(rb_memcmp(rb, M_CMT, STRLEN(M_CMT)) && rb_memcmp(rb, M_CBM, STRLEN(M_CBM)) && rb_memcmp(rb, M_CDS, STRLEN(M_CDS)) &&
                          rb_memcmp(rb, M_CLASS0, STRLEN(M_CLASS0)))) {
-                s = get_2ndeol_pos(rb, iov, buf);
+                s = get_2ndeol_pos(state, rb);
                 if (s) {
-                    *read_result  = 0;
-                    *skip        += 1;
+                    state->read_result  = 0;
+                    *skip              += 1;
                     return rb_read_n_iov(rb, iov, s);
                 }
             } else {
-                const int iovcnt = rb_read_until_mem_iov(rb, iov, M_EOL, STRLEN(M_EOL));
+                const int iovcnt = read_until_mem_iov(state, rb, iov, M_EOL, STRLEN(M_EOL));
                 if (iovcnt) {
-                    *read_result  = 0;
-                    *skip        += 1;
+                    state->read_result  = 0;
+                    *skip              += 1;
                     return iovcnt;
                 }
             }
@@ -268,3 +334,13 @@ int at_read_result_iov(const char* dev, int* read_result, size_t* skip, struct r
 
     return 0;
 }
+
+int at_read_result_iov(const char* dev, struct at_read_state* state, size_t* skip, struct ringbuffer* rb, struct iovec* iov)
+{
+    const int iovcnt = read_result_iov(dev, state, skip, rb, iov);
+    if (iovcnt > 0) {
+        /* response is consumed by caller */
+        read_state_reset(state);
+    }
+    return iovcnt;
+}
@@ -17,6 +17,14 @@ size_t attribute_const at_get_iov_size_n(const struct iovec* iov, int iovcnt);
 
 size_t at_combine_iov(struct ast_str* const, const struct iovec* const, int);
 
-int at_read_result_iov(const char* dev, int* read_result, size_t* skip, struct ringbuffer* rb, struct iovec* iov, struct ast_str* buf);
+/* state of response framer kept between reads */
+struct at_read_state {
+    int read_result;  /*!< 0 - skip to start of response, 1 - read response */
+    const void* term; /*!< terminator searched for current response */
+    size_t scan;      /*!< bytes of current response already searched for terminator */
+    size_t eol;       /*!< end of first line of two-line response, 0 - not found yet */
+};
+
+int at_read_result_iov(const char* dev, struct at_read_state* state, size_t* skip, struct ringbuffer* rb, struct iovec* iov);
 
 #endif /* CHAN_QUECTEL_AT_READ_H_INCLUDED */
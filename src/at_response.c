@@ -10,6 +10,7 @@
 
    Copyright (C) 2020 Max von Buelow <max@m9x.de>
 */
+#include <inttypes.h> /* PRIi64 */
 #include <sys/sysinfo.h>
 
 #include "ast_config.h"
@@ -25,12 +26,18 @@
 #include "at_parse.h"
 #include "at_queue.h"
 #include "at_read.h"
+#include "at_respool.h"
+#include "at_restrie.h"
+#include "at_tok.h" /* struct at_fields */
 #include "chan_quectel.h"
 #include "channel.h" /* channel_queue_hangup() channel_queue_control() */
 #include "char_conv.h"
+#include "devindex.h" /* devindex_set_imei() devindex_set_imsi() */
 #include "error.h"
 #include "helpers.h"
+#include "histogram.h" /* hist_add() */
 #include "mutils.h" /* STRLEN() */
+#include "pvt_status.h" /* pvt_status_publish() */
 #include "smsdb.h"
 
 // ================================================================
@@ -49,6 +56,9 @@ static const char MANUFACTURER_SIMCOM[]  = "SimCom";
 
 static const int DST_DEF_LEN = 32;
 
+#define CALL_NUMBER_LEN 64 /* buffer of number parsed from call notification */
+#define CELL_ID_LEN 16     /* buffer of LAC or cell ID in hex */
+
 // ================================================================
 
 static const at_response_t at_responses_list[] = {
@@ -79,41 +89,25 @@ const char* at_res2str(at_res_t res)
     return "UNDEFINED";
 }
 
-at_res_t at_str2res(const struct ast_str* const result)
-{
-    at_res_t at_res  = RES_UNKNOWN;
-    const size_t len = ast_str_strlen(result);
-    if (!len) {
-        return at_res;
-    }
-    const char* const buf = ast_str_buffer(result);
-
-    for (unsigned i = at_responses.ids_first; i < at_responses.ids; ++i) {
-        if (at_responses.responses[i].idlen) {
-            const at_response_t* const resp = &at_responses.responses[i];
-            const size_t idlen1             = resp->idlen - 1;
-            const char lc                   = buf[len - 1];
-            if (resp->id[idlen1] == '\r' && lc != '\r') {
-                if (idlen1 != len || memcmp(buf, resp->id, idlen1)) {
-                    continue;
-                }
-                at_res = resp->res;
-                break;
-            }
-        }
+static struct at_restrie at_responses_trie;
 
-        if (len < at_responses.responses[i].idlen || memcmp(buf, at_responses.responses[i].id, at_responses.responses[i].idlen)) {
-            continue;
-        }
-
-        at_res = at_responses.responses[i].res;
-        break;
+int at_responses_init()
+{
+    if (at_restrie_init(&at_responses_trie, &at_responses)) {
+        ast_log(LOG_ERROR, "Unable to build AT responses prefix tree\n");
+        return -1;
     }
 
-    return at_res;
+    ast_debug(4, "AT responses prefix tree: %u nodes\n", at_responses_trie.nodesno);
+    return 0;
+}
+
+at_res_t at_str2res(const struct ast_str* const result)
+{
+    return at_restrie_lookup(&at_responses_trie, ast_str_buffer(result), ast_str_strlen(result));
 }
 
-static int safe_task_uid(const at_queue_task_t* const task) { return task ? task->uid : -1; }
+static int64_t safe_task_uid(const at_queue_task_t* const task) { return task ? task->uid : -1; }
 
 static struct cpvt* safe_get_cpvt(const at_queue_task_t* const task, struct pvt* const pvt)
 {
@@ -161,7 +155,8 @@ static int at_response_rcend(struct pvt* pvt)
         ast_debug(1, "[%s] CEND: call_index %d duration %d end_status %d cc_cause %d Line disconnected\n", PVT_ID(pvt), call_index, duration, end_status,
                   cc_cause);
         CPVT_RESET_FLAG(cpvt, CALL_FLAG_NEED_HANGUP);
-        PVT_STAT(pvt, calls_duration[cpvt->dir]) += duration;
+        PVT_STAT_ADD(pvt, calls_duration[cpvt->dir], duration);
+        pvt_load_update(pvt);
         change_channel_state(cpvt, CALL_STATE_RELEASED, cc_cause);
     }
 
@@ -200,7 +195,8 @@ static int at_response_cend(struct pvt* const pvt, const char* str)
         ast_debug(1, "[%s] CEND: call_index %d duration %d end_status %d cc_cause %d Line disconnected\n", PVT_ID(pvt), call_index, duration, end_status,
                   cc_cause);
         CPVT_RESET_FLAG(cpvt, CALL_FLAG_NEED_HANGUP);
-        PVT_STAT(pvt, calls_duration[cpvt->dir]) += duration;
+        PVT_STAT_ADD(pvt, calls_duration[cpvt->dir], duration);
+        pvt_load_update(pvt);
         change_channel_state(cpvt, CALL_STATE_RELEASED, cc_cause);
     } else {
         ast_log(LOG_ERROR, "[%s] CEND event for unknown call idx '%d'\n", PVT_ID(pvt), call_index);
@@ -391,6 +387,7 @@ static int at_response_ok(struct pvt* const pvt, const at_res_t at_res, const at
 
         case CMD_AT_D:
             pvt->dialing = 1;
+            cpvt_trace(task->cpvt, CALL_TRACE_ACCEPTED);
             cpvt_change_state(task->cpvt, CALL_STATE_DIALING, 0);
         /* fall through */
         case CMD_AT_A:
@@ -438,7 +435,7 @@ static int at_response_ok(struct pvt* const pvt, const at_res_t at_res, const at
             if (cmd == CMD_AT_CMGS) {
                 at_ok_response_dbg(3, pvt, ecmd, "Sending SMS message in progress");
             } else if (cmd == CMD_AT_CNMA) {
-                at_ok_response_dbg(1, pvt, ecmd, "[SMS:%d] Message confirmed\n", safe_task_uid(task));
+                at_ok_response_dbg(1, pvt, ecmd, "[SMS:%" PRIi64 "] Message confirmed\n", safe_task_uid(task));
             } else {
                 at_ok_response_err(pvt, ecmd, "Unexpected message text response");
             }
@@ -522,10 +519,11 @@ static int at_response_ok(struct pvt* const pvt, const at_res_t at_res, const at
 
         case CMD_AT_CMGL:
             at_ok_response_dbg(1, pvt, ecmd, "Messages listed");
+            at_sms_listed(task->cpvt);
             break;
 
         case CMD_AT_CNMA:
-            at_ok_response_dbg(1, pvt, ecmd, "[SMS:%d] Message confirmed", safe_task_uid(task));
+            at_ok_response_dbg(1, pvt, ecmd, "[SMS:%" PRIi64 "] Message confirmed", safe_task_uid(task));
             break;
 
         case CMD_AT_CSMS:
@@ -570,7 +568,7 @@ static int at_response_ok(struct pvt* const pvt, const at_res_t at_res, const at
             break;
 
         case CMD_ESC:
-            at_ok_response_dbg(1, pvt, ecmd, "[SMS:%d] Message confirmed", safe_task_uid(task));
+            at_ok_response_dbg(1, pvt, ecmd, "[SMS:%" PRIi64 "] Message confirmed", safe_task_uid(task));
             break;
 
         case CMD_USER:
@@ -772,6 +770,7 @@ static int at_response_error(struct pvt* const pvt, const at_res_t at_res, const
             break;
 
         case CMD_AT_CLIR:
+            pvt->clir = -1;
             at_err_response_err(pvt, ecmd, "Setting CLIR failed");
             break;
 
@@ -815,7 +814,7 @@ static int at_response_error(struct pvt* const pvt, const at_res_t at_res, const
             break;
 
         case CMD_AT_CMGS:
-            at_err_response_err(pvt, ecmd, "[SMS:%d] Error sending message", task->uid);
+            at_err_response_err(pvt, ecmd, "[SMS:%" PRIi64 "] Error sending message", task->uid);
             at_response_cmgs_error(pvt, task);
             pvt_try_restate(pvt);
             break;
@@ -823,11 +822,11 @@ static int at_response_error(struct pvt* const pvt, const at_res_t at_res, const
         case CMD_AT_SMSTEXT: {
             const at_cmd_t cmd = task->cmds[0].cmd;
             if (cmd == CMD_AT_CMGS) {
-                at_err_response_err(pvt, ecmd, "[SMS:%d] Error sending message", task->uid);
+                at_err_response_err(pvt, ecmd, "[SMS:%" PRIi64 "] Error sending message", task->uid);
                 at_response_cmgs_error(pvt, task);
                 pvt_try_restate(pvt);
             } else if (cmd == CMD_AT_CNMA) {
-                at_err_response_err(pvt, ecmd, "[SMS:%d] Cannot acknowledge message", task->uid);
+                at_err_response_err(pvt, ecmd, "[SMS:%" PRIi64 "] Cannot acknowledge message", task->uid);
             } else {
                 at_err_response_err(pvt, ecmd, "Unexpected SMS text prompt");
             }
@@ -908,6 +907,7 @@ static int at_response_error(struct pvt* const pvt, const at_res_t at_res, const
 
         case CMD_AT_CMGL:
             at_err_response_dbg(1, pvt, ecmd, "Cannot list messages");
+            at_sms_listed(task->cpvt);
             break;
 
         case CMD_AT_CNMA:
@@ -968,7 +968,15 @@ e_return:
     return -1;
 }
 
-static int start_pbx(struct pvt* const pvt, const char* const number, const int call_idx, const call_state_t state)
+/* first indication of incoming call, consumed by handle_clcc() */
+static void call_indication(struct pvt* const pvt)
+{
+    if (!pvt->call_indication) {
+        pvt->call_indication = call_trace_now();
+    }
+}
+
+static int start_pbx(struct pvt* const pvt, const char* const number, const int call_idx, const call_state_t state, uint64_t indication, uint64_t clcc)
 {
     /* TODO: pass also Subscriber number or other DID info for exten  */
     struct ast_channel* channel = channel_new(pvt, AST_STATE_RING, number, call_idx, CALL_DIR_INCOMING, state,
@@ -988,6 +996,10 @@ static int start_pbx(struct pvt* const pvt, const char* const number, const int
     // FIXME: not execute if channel_new() failed
     CPVT_SET_FLAG(cpvt, CALL_FLAG_NEED_HANGUP);
 
+    cpvt_trace_at(cpvt, CALL_TRACE_INDICATION, indication);
+    cpvt_trace_at(cpvt, CALL_TRACE_CLCC, clcc);
+    cpvt_trace(cpvt, CALL_TRACE_CHANNEL);
+
     /* ast_pbx_start() usually failed if asterisk.conf minmemfree
      * set too low, try drop buffer cache
      * sync && echo 3 >/proc/sys/vm/drop_caches
@@ -1002,14 +1014,23 @@ static int start_pbx(struct pvt* const pvt, const char* const number, const int
         return -1;
     }
 
+    cpvt_trace(cpvt, CALL_TRACE_PBX);
     return 0;
 }
 
 static void handle_clcc(struct pvt* const pvt, const unsigned int call_idx, const unsigned int dir, const unsigned int state, const unsigned int mode,
                         const tristate_bool_t mpty, const char* const number, const unsigned int type)
 {
-    struct cpvt* cpvt = pvt_channel_find_by_call_idx(pvt, (int)call_idx);
-    int process_state = 1;
+    const uint64_t clcc = call_trace_now();
+    struct cpvt* cpvt   = pvt_channel_find_by_call_idx(pvt, (int)call_idx);
+    int process_state   = 1;
+    uint64_t indication = 0;
+
+    /* indication belongs to new incoming call, dropped when call ends */
+    if (state == CALL_STATE_INCOMING || state == CALL_STATE_WAITING || state == CALL_STATE_RELEASED) {
+        indication           = pvt->call_indication;
+        pvt->call_indication = 0;
+    }
 
     if (cpvt) {
         /* cpvt alive */
@@ -1054,8 +1075,8 @@ static void handle_clcc(struct pvt* const pvt, const unsigned int call_idx, cons
                 }
 
                 if (cpvt) {
-                    cpvt->call_idx = (short)call_idx;
-                    process_state  = cpvt_change_state(cpvt, state, 0);
+                    cpvt_set_call_idx(cpvt, (int)call_idx);
+                    process_state = cpvt_change_state(cpvt, state, 0);
                 } else {
                     at_enqueue_hangup(&pvt->sys_chan, call_idx, AST_CAUSE_CALL_REJECTED);
                     ast_log(LOG_ERROR, "[%s] Answered unexisting or multiparty incoming call - idx:%d, hanging up!\n", PVT_ID(pvt), call_idx);
@@ -1096,7 +1117,7 @@ static void handle_clcc(struct pvt* const pvt, const unsigned int call_idx, cons
             pvt->cwaiting = 0;
             pvt->ring     = 0;
 
-            PVT_STAT(pvt, calls_answered[CPVT_DIRECTION(cpvt)])++;
+            PVT_STAT_INC(pvt, calls_answered[CPVT_DIRECTION(cpvt)]);
             if (CPVT_TEST_FLAG(cpvt, CALL_FLAG_CONFERENCE)) {
                 at_enqueue_conference(cpvt);
             }
@@ -1108,14 +1129,14 @@ static void handle_clcc(struct pvt* const pvt, const unsigned int call_idx, cons
             pvt->dialing  = 0;
             pvt->cwaiting = 0;
 
-            PVT_STAT(pvt, in_calls)++;
+            PVT_STAT_INC(pvt, in_calls);
 
             if (pvt_enabled(pvt)) {
                 /* TODO: give dialplan level user tool for checking device is voice enabled or not  */
-                if (start_pbx(pvt, number, call_idx, state)) {
-                    PVT_STAT(pvt, in_pbx_fails)++;
+                if (start_pbx(pvt, number, call_idx, state, indication, clcc)) {
+                    PVT_STAT_INC(pvt, in_pbx_fails);
                 } else {
-                    PVT_STAT(pvt, in_calls_handled)++;
+                    PVT_STAT_INC(pvt, in_calls_handled);
                     if (!pvt->has_voice) {
                         ast_log(LOG_WARNING, "[%s] pbx started for device not voice capable\n", PVT_ID(pvt));
                     }
@@ -1129,18 +1150,18 @@ static void handle_clcc(struct pvt* const pvt, const unsigned int call_idx, cons
             pvt->ring     = 0;
             pvt->dialing  = 0;
 
-            PVT_STAT(pvt, cw_calls)++;
+            PVT_STAT_INC(pvt, cw_calls);
 
             if (dir == CALL_DIR_INCOMING) {
                 if (pvt_enabled(pvt)) {
                     /* TODO: give dialplan level user tool for checking device is voice enabled or not  */
-                    if (start_pbx(pvt, number, call_idx, state) == 0) {
-                        PVT_STAT(pvt, in_calls_handled)++;
+                    if (start_pbx(pvt, number, call_idx, state, indication, clcc) == 0) {
+                        PVT_STAT_INC(pvt, in_calls_handled);
                         if (!pvt->has_voice) {
                             ast_log(LOG_WARNING, "[%s] pbx started for device not voice capable\n", PVT_ID(pvt));
                         }
                     } else {
-                        PVT_STAT(pvt, in_pbx_fails)++;
+                        PVT_STAT_INC(pvt, in_pbx_fails);
                     }
                 }
             }
@@ -1165,27 +1186,51 @@ static void handle_clcc(struct pvt* const pvt, const unsigned int call_idx, cons
     }
 }
 
-static void current_line(const char* const str, struct ast_str** line)
+/* length of line at str, *next is set to following line or NULL, response buffer is not modified */
+static size_t split_line(const char* const str, const char** next)
 {
-    const char* const p = strchr(str, '\r');
-    if (p) {
-        ast_str_set_substr(line, 0, str, p - str);
-    } else {
-        ast_str_set(line, 0, "%s", str);
+    const char* p = strchr(str, '\r');
+    if (!p) {
+        *next = NULL;
+        return strlen(str);
     }
+
+    const size_t len = (size_t)(p - str);
+    if (*++p == '\n') {
+        ++p;
+    }
+    *next = *p ? p : NULL;
+    return len;
 }
 
-static const char* next_line(const char* const str)
+/* same as ast_str_hash() but of len characters */
+static unsigned int attribute_pure clcc_hash(const char* const line, size_t len)
 {
-    const char* p = strchr(str, '\r');
-    if (p) {
-        ++p;
-        if (p[0] == '\n') {
-            ++p;
-        }
-        if (p[0]) {
-            return p;
-        }
+    unsigned int hash = 5381u;
+    for (size_t i = 0; i < len; ++i) {
+        hash = hash * 33u ^ (unsigned char)line[i];
+    }
+    return hash | 1u;
+}
+
+/* call of CLCC line is known and its last handled line was same, only index of call is parsed */
+static struct cpvt* clcc_unchanged(struct pvt* const pvt, const char* const line, size_t len, unsigned int hash)
+{
+    const char* const p = memchr(line, ':', len);
+    char* end;
+
+    if (!p) {
+        return NULL;
+    }
+
+    const long call_idx = strtol(p + 1, &end, 10);
+    if (end == p + 1 || end >= line + len || *end != ',') {
+        return NULL;
+    }
+
+    struct cpvt* const cpvt = pvt_channel_find_by_call_idx(pvt, (int)call_idx);
+    if (cpvt && cpvt->clcc_hash == hash && cpvt->clcc_state == cpvt->state) {
+        return cpvt;
     }
     return NULL;
 }
@@ -1200,8 +1245,6 @@ static const char* next_line(const char* const str)
 
 static int at_response_clcc(struct pvt* const pvt, const struct ast_str* const response)
 {
-    static const ssize_t LINE_DEF_LEN = 128;
-
     if (!pvt->initialized) {
         return 0;
     }
@@ -1211,15 +1254,26 @@ static int at_response_clcc(struct pvt* const pvt, const struct ast_str* const r
         CPVT_RESET_FLAG(cpvt, CALL_FLAG_ALIVE);
     }
 
-    RAII_VAR(struct ast_str*, line, ast_str_create(LINE_DEF_LEN), ast_free);
-    for (const char* str = ast_str_buffer(response); str; str = next_line(str)) {
-        current_line(str, &line);
+    const char* next;
+    for (const char* str = ast_str_buffer(response); str; str = next) {
+        const size_t len = split_line(str, &next);
+        if (!len) {
+            continue;
+        }
+
+        /* calls listed as before are only marked alive */
+        const unsigned int hash = clcc_hash(str, len);
+        cpvt                    = clcc_unchanged(pvt, str, len, hash);
+        if (cpvt) {
+            CPVT_SET_FLAG(cpvt, CALL_FLAG_ALIVE);
+            continue;
+        }
 
         unsigned call_idx, dir, state, mode, mpty, type;
-        char* number;
+        char number[CALL_NUMBER_LEN];
 
-        if (at_parse_clcc(ast_str_buffer(line), &call_idx, &dir, &state, &mode, &mpty, &number, &type)) {
-            ast_log(LOG_ERROR, "[%s] CLCC - can't parse line '%s'\n", PVT_ID(pvt), ast_str_buffer(line));
+        if (at_parse_clcc(str, len, &call_idx, &dir, &state, &mode, &mpty, number, sizeof(number), &type)) {
+            ast_log(LOG_ERROR, "[%s] CLCC - can't parse line '%.*s'\n", PVT_ID(pvt), (int)len, str);
             continue;
         }
 
@@ -1234,6 +1288,12 @@ static int at_response_clcc(struct pvt* const pvt, const struct ast_str* const r
         }
 
         handle_clcc(pvt, call_idx, dir, state, mode, mpty ? TRIBOOL_TRUE : TRIBOOL_FALSE, number, type);
+
+        cpvt = pvt_channel_find_by_call_idx(pvt, (int)call_idx);
+        if (cpvt && cpvt->state == (call_state_t)state) {
+            cpvt->clcc_hash  = hash;
+            cpvt->clcc_state = cpvt->state;
+        }
     }
 
     return 0;
@@ -1263,9 +1323,9 @@ static attribute_const unsigned int map_dsci(const unsigned int dsci)
 static int at_response_dsci(struct pvt* const pvt, const struct ast_str* const response)
 {
     unsigned int call_index, call_dir, call_state, call_type, number_type;
-    char* number;
+    char number[CALL_NUMBER_LEN];
 
-    if (at_parse_dsci(ast_str_buffer(response), &call_index, &call_dir, &call_state, &call_type, &number, &number_type)) {
+    if (at_parse_dsci(ast_str_buffer(response), ast_str_strlen(response), &call_index, &call_dir, &call_state, &call_type, number, sizeof(number), &number_type)) {
         ast_log(LOG_ERROR, "[%s] Fail to parse DSCI '%s'\n", PVT_ID(pvt), ast_str_buffer(response));
         return 0;
     }
@@ -1276,6 +1336,9 @@ static int at_response_dsci(struct pvt* const pvt, const struct ast_str* const r
     }
 
     ast_debug(3, "[%s] DSCI - idx:%u dir:%u type:%u state:%u number:%s\n", PVT_ID(pvt), call_index, call_dir, call_type, call_state, number);
+    if (call_dir == CALL_DIR_INCOMING) {
+        call_indication(pvt);
+    }
 
     switch (call_state) {
         case CALL_STATE_RELEASED:  // released call will not be listed by AT+CLCC command, handle directly
@@ -1305,25 +1368,30 @@ static int at_response_dsci(struct pvt* const pvt, const struct ast_str* const r
 static int at_response_qind(struct pvt* const pvt, const struct ast_str* const response)
 {
     qind_t qind;
-    char* params;
+    struct at_fields params;
 
-    const int res = at_parse_qind(ast_str_buffer(response), &qind, &params);
+    const int res = at_parse_qind(ast_str_buffer(response), ast_str_strlen(response), &qind, &params);
     if (res < 0) {
         return -1;
     }
 
-    ast_debug(4, "[%s] QIND(%s) - %s\n", PVT_ID(pvt), at_qind2str(qind), params);
+    /* fields are parsed in place, log is taken before */
+    const int params_len         = at_fields_rest_len(&params);
+    const char* const params_str = params.pos;
+    ast_debug(4, "[%s] QIND(%s) - %.*s\n", PVT_ID(pvt), at_qind2str(qind), params_len, params_str);
 
     switch (qind) {
         case QIND_CSQ: {
             int rssi;
 
-            const int res = at_parse_qind_csq(params, &rssi);
+            const int res = at_parse_qind_csq(&params, &rssi);
             if (res < 0) {
-                ast_debug(3, "[%s] Failed to parse CSQ - %s\n", PVT_ID(pvt), params);
+                ast_debug(3, "[%s] Failed to parse CSQ - %.*s\n", PVT_ID(pvt), params_len, params_str);
                 break;
             }
-            pvt->rssi = rssi;
+            pvt->rssi         = rssi;
+            pvt->rssi_updated = ast_tvnow();
+            pvt_load_update(pvt);
             RAII_VAR(struct ast_str*, rssi_str, rssi2dBm(rssi), ast_free);
             ast_verb(3, "[%s] RSSI: %s\n", PVT_ID(pvt), ast_str_buffer(rssi_str));
             return 0;
@@ -1331,15 +1399,16 @@ static int at_response_qind(struct pvt* const pvt, const struct ast_str* const r
 
         case QIND_ACT: {
             int act;
-            const int res = at_parse_qind_act(params, &act);
+            const int res = at_parse_qind_act(&params, &act);
             if (res < 0) {
-                ast_debug(3, "[%s] Failed to parse ACT - %s\n", PVT_ID(pvt), params);
+                ast_debug(3, "[%s] Failed to parse ACT - %.*s\n", PVT_ID(pvt), params_len, params_str);
                 break;
             }
             ast_verb(1, "[%s] Access technology: %s\n", PVT_ID(pvt), sys_act2str(act));
             pvt_set_act(pvt, act);
 
             if (act) {
+                pvt->provider_updated = ast_tvnow();
                 if (pvt->is_simcom) {
                     if (at_enqueue_cspn_cops(&pvt->sys_chan)) {
                         ast_log(LOG_WARNING, "[%s] Error sending query for provider name\n", PVT_ID(pvt));
@@ -1355,13 +1424,16 @@ static int at_response_qind(struct pvt* const pvt, const struct ast_str* const r
 
         case QIND_CCINFO: {
             unsigned call_idx, dir, state, mode, mpty, toa;
-            char* number;
+            char number[CALL_NUMBER_LEN];
 
-            const int res = at_parse_qind_cc(params, &call_idx, &dir, &state, &mode, &mpty, &number, &toa);
+            const int res = at_parse_qind_cc(&params, &call_idx, &dir, &state, &mode, &mpty, number, sizeof(number), &toa);
             if (res < 0) {
-                ast_log(LOG_ERROR, "[%s] Fail to parse CCINFO - %s\n", PVT_ID(pvt), params);
+                ast_log(LOG_ERROR, "[%s] Fail to parse CCINFO - %.*s\n", PVT_ID(pvt), params_len, params_str);
                 break;
             }
+            if (dir == CALL_DIR_INCOMING) {
+                call_indication(pvt);
+            }
             handle_clcc(pvt, call_idx, dir, state, mode, mpty ? TRIBOOL_TRUE : TRIBOOL_FALSE, number, toa);
             return 0;
         }
@@ -1493,12 +1565,12 @@ static int at_response_cmgs(struct pvt* const pvt, const struct ast_str* const r
     const int partno  = 1 + (task->cindex / 2);
 
     if (partno < partcnt) {
-        ast_debug(3, "[%s][SMS:%d REF:%d] Successfully sent message part %d/%d\n", PVT_ID(pvt), task->uid, refid, partno, partcnt);
+        ast_debug(3, "[%s][SMS:%" PRIi64 " REF:%d] Successfully sent message part %d/%d\n", PVT_ID(pvt), task->uid, refid, partno, partcnt);
     } else {
         if (partcnt <= 1) {
-            ast_verb(1, "[%s][SMS:%d REF:%d] Successfully sent message\n", PVT_ID(pvt), task->uid, refid);
+            ast_verb(1, "[%s][SMS:%" PRIi64 " REF:%d] Successfully sent message\n", PVT_ID(pvt), task->uid, refid);
         } else {
-            ast_verb(1, "[%s][SMS:%d] Successfully sent message [%d parts]\n", PVT_ID(pvt), task->uid, partcnt);
+            ast_verb(1, "[%s][SMS:%" PRIi64 "] Successfully sent message [%d parts]\n", PVT_ID(pvt), task->uid, partcnt);
         }
 
         pvt->outgoing_sms = 0;
@@ -1509,7 +1581,7 @@ static int at_response_cmgs(struct pvt* const pvt, const struct ast_str* const r
     RAII_VAR(struct ast_str*, msg, (partno == partcnt) ? ast_str_create(DST_DEF_LEN) : NULL, ast_free);
     const ssize_t res = smsdb_outgoing_part_put(task->uid, refid, &dst, &msg);
     if (res >= 0) {
-        ast_verb(3, "[%s][SMS:%d %s] SMS: [%s]\n", PVT_ID(pvt), task->uid, ast_str_buffer(dst), ast_str_buffer(msg));
+        ast_verb(3, "[%s][SMS:%" PRIi64 " %s] SMS: [%s]\n", PVT_ID(pvt), task->uid, ast_str_buffer(dst), ast_str_buffer(msg));
         RAII_VAR(struct ast_json*, report, ast_json_object_create(), ast_json_unref);
         ast_json_object_set(report, "info", ast_json_string_create("Message send"));
         ast_json_object_set(report, "uid", ast_json_integer_create(task->uid));
@@ -1530,14 +1602,14 @@ static int at_response_cmgs_error(struct pvt* const pvt, const at_queue_task_t*
 
     const ssize_t dst_len = smsdb_outgoing_clear(task->uid, &dst, &msg);
     if (dst_len >= 0) {
-        ast_verb(1, "[%s][SMS:%d] Error sending message: [%s]\n", PVT_ID(pvt), task->uid, ast_str_buffer(dst));
+        ast_verb(1, "[%s][SMS:%" PRIi64 "] Error sending message: [%s]\n", PVT_ID(pvt), task->uid, ast_str_buffer(dst));
         RAII_VAR(struct ast_json*, report, ast_json_object_create(), ast_json_unref);
         ast_json_object_set(report, "info", ast_json_string_create("Error sending message"));
         ast_json_object_set(report, "uid", ast_json_integer_create(task->uid));
         AST_JSON_OBJECT_SET(report, msg);
         channel_start_local_report(pvt, "sms", LOCAL_REPORT_DIRECTION_OUTGOING, ast_str_buffer(dst), NULL, NULL, 0, report);
     } else {
-        ast_verb(1, "[%s][SMS:%d] Error sending message\n", PVT_ID(pvt), task->uid);
+        ast_verb(1, "[%s][SMS:%" PRIi64 "] Error sending message\n", PVT_ID(pvt), task->uid);
     }
     pvt->outgoing_sms = 0;
     return 0;
@@ -1636,9 +1708,14 @@ static int at_response_msg(struct pvt* const pvt, const struct ast_str* const re
     pdu_udh_init(&udh);
 
     scts[0] = dt[0] = '\000';
-    RAII_VAR(struct ast_str*, msg, ast_str_create(MSG_MAX_LEN), ast_free);
-    RAII_VAR(struct ast_str*, oa, ast_str_create(512), ast_free);
-    RAII_VAR(struct ast_str*, sca, ast_str_create(512), ast_free);
+    struct ast_str* const msg = arena_str(&pvt->scratch, MSG_MAX_LEN);
+    struct ast_str* const oa  = arena_str(&pvt->scratch, 512);
+    struct ast_str* const sca = arena_str(&pvt->scratch, 512);
+    if (!msg || !oa || !sca) {
+        ast_log(LOG_ERROR, "[%s] Error allocating incoming message buffers\n", PVT_ID(pvt));
+        msg_ack = TRIBOOL_FALSE;
+        goto msg_done_ack;
+    }
     size_t msg_len = ast_str_size(msg);
 
     switch (cmd) {
@@ -1684,7 +1761,10 @@ static int at_response_msg(struct pvt* const pvt, const struct ast_str* const re
         case PDUTYPE_MTI_SMS_STATUS_REPORT: {
             ast_verb(1, "[%s][SMS:%d] Got status report from %s and status code %d\n", PVT_ID(pvt), mr, ast_str_buffer(oa), st);
 
-            RAII_VAR(int*, status_report, ast_calloc(sizeof(int), 256), ast_free);
+            uint8_t* const status_report = arena_calloc(&pvt->scratch, SMSDB_PARTS_MAX, sizeof(uint8_t));
+            if (!status_report) {
+                break;
+            }
             const ssize_t pres = smsdb_outgoing_part_status(pvt->imsi, ast_str_buffer(oa), mr, st, status_report);
             if (pres >= 0) {
                 RAII_VAR(struct ast_json*, report, ast_json_object_create(), ast_json_unref);
@@ -1695,9 +1775,12 @@ static int at_response_msg(struct pvt* const pvt, const struct ast_str* const re
                 ast_json_object_set(report, "uid", ast_json_integer_create(mr));
                 struct ast_json* statuses = ast_json_array_create();
                 int success               = 1;
-                for (int i = 0; status_report[i] != -1; ++i) {
-                    success &= !(status_report[i] & 0x40);
-                    ast_json_array_append(statuses, ast_json_stringf("%03d,", status_report[i]));
+                for (ssize_t i = 0; i < pres; ++i) {
+                    /* same as "%03d," */
+                    const unsigned int status = status_report[i];
+                    const char status_str[]   = {'0' + status / 100u, '0' + status / 10u % 10u, '0' + status % 10u, ',', '\0'};
+                    success &= !(status & 0x40);
+                    ast_json_array_append(statuses, ast_json_string_create(status_str));
                 }
                 ast_json_object_set(report, "status", statuses);
 
@@ -1716,7 +1799,7 @@ static int at_response_msg(struct pvt* const pvt, const struct ast_str* const re
             if (udh.parts > 1) {
                 ast_verb(2, "[%s][SMS:%d PART:%d/%d TS:%s] Got message part from %s: [%s]\n", PVT_ID(pvt), (int)udh.ref, (int)udh.order, (int)udh.parts, scts,
                          ast_str_buffer(oa), tmp_esc_str(msg));
-                int csms_cnt = smsdb_put(pvt->imsi, ast_str_buffer(oa), udh.ref, udh.parts, udh.order, ast_str_buffer(msg), &fullmsg);
+                int csms_cnt = smsdb_put(pvt->imsi, ast_str_buffer(oa), udh.ref, udh.parts, udh.order, ast_str_buffer(msg), &fullmsg, cmd == RES_CMGL);
                 if (csms_cnt <= 0) {
                     ast_log(LOG_ERROR, "[%s][SMS:%d PART:%d/%d TS:%s] Error putting message part to database\n", PVT_ID(pvt), (int)udh.ref, (int)udh.order,
                             (int)udh.parts, scts);
@@ -1769,19 +1852,18 @@ receive_as_is:
 
 msg_done:
 
-    if (CONF_SHARED(pvt, autodeletesms) && msg_complete) {
-        switch (cmd) {
-            case RES_CMGL:
-                at_enqueue_delete_sms(&pvt->sys_chan, idx, TRIBOOL_NONE);
-                goto msg_ret;
-
-            default:
-                break;
-        }
+    if (cmd == RES_CMGL) {
+        /* stored messages are not acknowledged, they are deleted when listing is done */
+        at_sms_listed_entry(&pvt->sys_chan, idx, msg_ack == TRIBOOL_TRUE);
+        goto msg_ret;
     }
 
 msg_done_ack:
     switch (cmd) {
+        case RES_CMGL:
+            at_sms_listed_entry(&pvt->sys_chan, -1, 0);
+            break;
+
         case RES_CMGR:
             at_sms_retrieved(&pvt->sys_chan, 0);
             break;
@@ -1897,7 +1979,7 @@ static int at_response_cusd(struct pvt* const pvt, const struct ast_str* const r
     }
 
     const char* typedesc = enum2str(type, types, ARRAY_LEN(types));
-    RAII_VAR(struct ast_str*, cusd_str, NULL, ast_free);
+    struct ast_str* cusd_str = NULL;
 
     if (dcs >= 0) {
         // sanitize DCS
@@ -1918,13 +2000,21 @@ static int at_response_cusd(struct pvt* const pvt, const struct ast_str* const r
             case 0: {  // GSM-7
                 static const size_t OUT_UCS2_BUF_SIZE = sizeof(uint16_t) * USSD_DEF_LEN;
 
-                RAII_VAR(uint16_t*, out_ucs2, ast_calloc(sizeof(uint16_t), USSD_DEF_LEN), ast_free);
+                uint16_t* const out_ucs2 = arena_alloc(&pvt->scratch, OUT_UCS2_BUF_SIZE);
+                if (!out_ucs2) {
+                    res = -1;
+                    break;
+                }
                 const int cusd_nibbles = unhex(cusd, (uint8_t*)cusd);
                 res                    = gsm7_unpack_decode(cusd, cusd_nibbles, out_ucs2, OUT_UCS2_BUF_SIZE / sizeof(uint16_t), 0, 0, 0);
                 if (res > 0) {
                     const size_t res_buf_size = (res * 4) + 1u;
-                    cusd_str                  = ast_str_create(res_buf_size);
-                    res                       = ucs2_to_utf8(out_ucs2, res, ast_str_buffer(cusd_str), ast_str_size(cusd_str));
+                    cusd_str                  = arena_str(&pvt->scratch, res_buf_size);
+                    if (!cusd_str) {
+                        res = -1;
+                        break;
+                    }
+                    res = ucs2_to_utf8(out_ucs2, res, ast_str_buffer(cusd_str), ast_str_size(cusd_str));
                 }
                 break;
             };
@@ -1932,7 +2022,11 @@ static int at_response_cusd(struct pvt* const pvt, const struct ast_str* const r
             case 1: {  // ASCII
                 res                       = strlen(cusd);
                 const size_t res_buf_size = res + 1u;
-                cusd_str                  = ast_str_create(res_buf_size);
+                cusd_str                  = arena_str(&pvt->scratch, res_buf_size);
+                if (!cusd_str) {
+                    res = -1;
+                    break;
+                }
 
                 ast_str_set_substr(&cusd_str, 0, cusd, res);
                 break;
@@ -1941,8 +2035,12 @@ static int at_response_cusd(struct pvt* const pvt, const struct ast_str* const r
             case 2: {  // UCS-2
                 const int cusd_nibbles    = unhex(cusd, (uint8_t*)cusd);
                 const size_t res_buf_size = ((cusd_nibbles + 1) * 4) + 1u;
-                cusd_str                  = ast_str_create(res_buf_size);
-                res                       = ucs2_to_utf8((const uint16_t*)cusd, (cusd_nibbles + 1) / 4, ast_str_buffer(cusd_str), ast_str_size(cusd_str));
+                cusd_str                  = arena_str(&pvt->scratch, res_buf_size);
+                if (!cusd_str) {
+                    res = -1;
+                    break;
+                }
+                res = ucs2_to_utf8((const uint16_t*)cusd, (cusd_nibbles + 1) / 4, ast_str_buffer(cusd_str), ast_str_size(cusd_str));
                 break;
             }
 
@@ -1951,7 +2049,7 @@ static int at_response_cusd(struct pvt* const pvt, const struct ast_str* const r
                 break;
         }
 
-        if (res < 0) {
+        if (res < 0 || !cusd_str) {
             return -1;
         }
 
@@ -2021,6 +2119,7 @@ static int at_response_csq(struct pvt* const pvt, const struct ast_str* const re
     }
 
     pvt->rssi = rssi;
+    pvt_load_update(pvt);
 
     RAII_VAR(struct ast_str*, rssi_str, rssi2dBm(rssi), ast_free);
     ast_verb(3, "[%s] RSSI: %s\n", PVT_ID(pvt), ast_str_buffer(rssi_str));
@@ -2031,12 +2130,14 @@ static int at_response_csqn(struct pvt* const pvt, const struct ast_str* const r
 {
     int rssi, ber;
 
-    if (at_parse_csqn(ast_str_buffer(response), &rssi, &ber)) {
+    if (at_parse_csqn(ast_str_buffer(response), ast_str_strlen(response), &rssi, &ber)) {
         ast_log(LOG_ERROR, "[%s] Error parsing '%s'\n", PVT_ID(pvt), ast_str_buffer(response));
         return -1;
     }
 
-    pvt->rssi = rssi;
+    pvt->rssi         = rssi;
+    pvt->rssi_updated = ast_tvnow();
+    pvt_load_update(pvt);
 
     RAII_VAR(struct ast_str*, rssi_str, rssi2dBm(rssi), ast_free);
     ast_verb(3, "[%s] RSSI: %s\n", PVT_ID(pvt), ast_str_buffer(rssi_str));
@@ -2162,16 +2263,18 @@ static int at_response_qnwinfo(struct pvt* const pvt, const struct ast_str* cons
 static int at_response_creg(struct pvt* const pvt, const struct ast_str* const response)
 {
     int gsm_reg;
-    char* lac;
-    char* ci;
+    char lac[CELL_ID_LEN];
+    char ci[CELL_ID_LEN];
     int act;
 
-    if (at_parse_creg(ast_str_buffer(response), &gsm_reg, &pvt->gsm_reg_status, &lac, &ci, &act)) {
+    if (at_parse_creg(ast_str_buffer(response), ast_str_strlen(response), &gsm_reg, &pvt->gsm_reg_status, lac, sizeof(lac), ci, sizeof(ci), &act)) {
         ast_log(LOG_ERROR, "[%s] Error parsing CREG: '%s'\n", PVT_ID(pvt), ast_str_buffer(response));
         return 0;
     }
+    pvt_load_update(pvt);
 
     if (gsm_reg) {
+        pvt->provider_updated = ast_tvnow();
         if (pvt->is_simcom) {
             if (at_enqueue_cspn_cops(&pvt->sys_chan)) {
                 ast_log(LOG_WARNING, "[%s] Error sending query for provider name\n", PVT_ID(pvt));
@@ -2194,14 +2297,16 @@ static int at_response_creg(struct pvt* const pvt, const struct ast_str* const r
         ast_string_field_set(pvt, location_area_code, lac);
         ast_string_field_set(pvt, cell_id, ci);
 
-        ast_verb(1, "[%s] Location area code: %s\n", PVT_ID(pvt), S_OR(lac, ""));
-        ast_verb(1, "[%s] Cell ID: %s\n", PVT_ID(pvt), S_OR(ci, ""));
+        ast_verb(1, "[%s] Location area code: %s\n", PVT_ID(pvt), lac);
+        ast_verb(1, "[%s] Cell ID: %s\n", PVT_ID(pvt), ci);
     } else {
         pvt->gsm_registered = 0;
         ast_string_field_set(pvt, location_area_code, NULL);
         ast_string_field_set(pvt, cell_id, NULL);
     }
 
+    /* registration changes are unsolicited, publish them without waiting for next task */
+    pvt_status_publish(pvt);
     return 0;
 }
 
@@ -2289,7 +2394,7 @@ static int at_response_cgmr(struct pvt* const pvt, const struct ast_str* const r
 
 static int at_response_cgsn(struct pvt* const pvt, const struct ast_str* const response)
 {
-    ast_string_field_set(pvt, imei, ast_str_buffer(response));
+    devindex_set_imei(pvt, ast_str_buffer(response));
     ast_verb(2, "[%s] IMEI: %s\n", PVT_ID(pvt), pvt->imei);
     return 0;
 }
@@ -2304,7 +2409,7 @@ static int at_response_cgsn(struct pvt* const pvt, const struct ast_str* const r
 
 static int at_response_cimi(struct pvt* const pvt, const struct ast_str* const response)
 {
-    ast_string_field_set(pvt, imsi, ast_str_buffer(response));
+    devindex_set_imsi(pvt, ast_str_buffer(response));
     ast_verb(2, "[%s] IMSI: %s\n", PVT_ID(pvt), pvt->imsi);
     return 0;
 }
@@ -2657,6 +2762,7 @@ static int at_response_cring(struct pvt* const pvt, const struct ast_str* const
     }
 
     ast_debug(2, "[%s] Receive RING: %s\n", PVT_ID(pvt), ring_type);
+    call_indication(pvt);
     return 0;
 }
 
@@ -2912,6 +3018,7 @@ int at_response(struct pvt* const pvt, const struct ast_str* const response, con
 
         case RES_RING:
             ast_debug(2, "[%s] Receive RING\n", PVT_ID(pvt));
+            call_indication(pvt);
             break;
 
         case RES_BUSY:
@@ -3068,32 +3175,36 @@ int at_response(struct pvt* const pvt, const struct ast_str* const response, con
     return 0;
 }
 
-struct at_response_taskproc_data* at_response_taskproc_data_alloc(struct pvt* const pvt, const struct ast_str* const response)
+static void scratch_reset(struct pvt* const pvt)
 {
-    const size_t response_len = ast_str_strlen(response);
+    const size_t used = arena_used(&pvt->scratch);
 
-    struct at_response_taskproc_data* const res = ast_calloc(1, sizeof(struct at_response_taskproc_data) + response_len + 1u);
-    res->ptd.pvt                                = pvt;
-    res->response.__AST_STR_LEN                 = response_len + 1u;
-    res->response.__AST_STR_USED                = response_len;
-    res->response.__AST_STR_TS                  = DS_STATIC;
-    ast_copy_string(ast_str_buffer(&res->response), ast_str_buffer(response), response_len + 1u);
-    return res;
+    PVT_STAT_MAX(pvt, at_scratch_high_water, used);
+    PVT_STAT_ADD(pvt, at_scratch_spills, pvt->scratch.spills);
+    arena_reset(&pvt->scratch);
 }
 
 static void response_taskproc(struct pvt_taskproc_data* ptd)
 {
-    RAII_VAR(struct at_response_taskproc_data* const, rtd, (struct at_response_taskproc_data*)ptd, ast_free);
+    struct at_response_taskproc_data* const rtd = (struct at_response_taskproc_data*)ptd;
+
+    hist_add(&rtd->ptd.pvt->latency.tps_delay, (uint64_t)ast_tvdiff_us(ast_tvnow(), rtd->queued));
+    if (rtd->hit) {
+        PVT_STAT_INC(rtd->ptd.pvt, at_respool_hits);
+    } else {
+        PVT_STAT_INC(rtd->ptd.pvt, at_respool_misses);
+    }
 
     const at_res_t at_res = at_str2res(&rtd->response);
     if (at_res != RES_UNKNOWN) {
         ast_str_trim_blanks(&rtd->response);
     }
 
-    PVT_STAT(rtd->ptd.pvt, at_responses)++;
+    PVT_STAT_INC(rtd->ptd.pvt, at_responses);
     if (at_response(rtd->ptd.pvt, &rtd->response, at_res)) {
         ast_log(LOG_WARNING, "[%s] Fail to handle response\n", PVT_ID(rtd->ptd.pvt));
     }
+    scratch_reset(rtd->ptd.pvt);
 
     if (at_queue_run(rtd->ptd.pvt)) {
         ast_log(LOG_ERROR, "[%s] Fail to run command from queue\n", PVT_ID(rtd->ptd.pvt));
@@ -3101,4 +3212,9 @@ static void response_taskproc(struct pvt_taskproc_data* ptd)
     }
 }
 
-int at_response_taskproc(void* tpdata) { return PVT_TASKPROC_LOCK_AND_EXECUTE(tpdata, response_taskproc); }
+int at_response_taskproc(void* tpdata)
+{
+    const int res = PVT_TASKPROC_LOCK_AND_EXECUTE(tpdata, response_taskproc);
+    at_respool_put(tpdata);
+    return res;
+}
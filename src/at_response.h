@@ -6,6 +6,7 @@
 
 struct pvt;
 struct iovec;
+struct at_respool;
 
 #include "chan_quectel.h"
 
@@ -135,16 +136,20 @@ typedef struct at_responses_t {
 /*! responses description */
 extern const at_responses_t at_responses;
 const char* at_res2str(at_res_t res);
+int at_responses_init();
 at_res_t at_str2res(const struct ast_str* const);
 
 int at_response(struct pvt* const pvt, const struct ast_str* const response, const at_res_t at_res);
 
 typedef struct at_response_taskproc_data {
     struct pvt_taskproc_data ptd;
+    AST_LIST_ENTRY(at_response_taskproc_data) entry; /*!< free list entry */
+    struct at_respool* pool;                         /*!< owner pool */
+    unsigned int hit:1;                              /*!< buffer reused from pool */
+    struct timeval queued;                           /*!< time when pushed to taskprocessor */
     struct ast_str response;
 } at_response_taskproc_data_t;
 
-struct at_response_taskproc_data* at_response_taskproc_data_alloc(struct pvt* const pvt, const struct ast_str* const response);
 int at_response_taskproc(void* tpdata);
 
 #endif /* CHAN_QUECTEL_AT_RESPONSE_H_INCLUDED */
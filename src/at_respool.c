@@ -0,0 +1,117 @@
+/*
+   at_respool.c
+*/
+#include "ast_config.h"
+
+#include <asterisk/astobj2.h>
+#include <asterisk/linkedlists.h>
+#include <asterisk/strings.h>
+#include <asterisk/utils.h>
+
+#include "at_respool.h"
+
+#include "at_response.h"
+
+struct at_respool {
+    AST_LIST_HEAD_NOLOCK(, at_response_taskproc_data) items; /*!< free buffers */
+    size_t bufsize;                                          /*!< capacity of response string */
+    unsigned int free_count;                                 /*!< number of free buffers */
+    unsigned int max_free;                                   /*!< maximum number of kept free buffers */
+    size_t bytes;                                            /*!< heap of free and taken buffers */
+};
+
+static void respool_free(struct at_respool* pool, struct at_response_taskproc_data* rtd)
+{
+    __atomic_sub_fetch(&pool->bytes, sizeof(*rtd) + rtd->response.__AST_STR_LEN, __ATOMIC_RELAXED);
+    ast_free(rtd);
+}
+
+static void at_respool_destructor(void* obj)
+{
+    struct at_respool* const pool = obj;
+    struct at_response_taskproc_data* rtd;
+
+    while ((rtd = AST_LIST_REMOVE_HEAD(&pool->items, entry))) {
+        respool_free(pool, rtd);
+    }
+}
+
+struct at_respool* at_respool_create(size_t bufsize, unsigned int max_free)
+{
+    struct at_respool* const pool = ao2_alloc(sizeof(struct at_respool), at_respool_destructor);
+    if (!pool) {
+        return NULL;
+    }
+
+    AST_LIST_HEAD_INIT_NOLOCK(&pool->items);
+    pool->bufsize  = bufsize;
+    pool->max_free = max_free;
+    return pool;
+}
+
+struct at_response_taskproc_data* at_respool_get(struct at_respool* pool, struct pvt* pvt, size_t len)
+{
+    struct at_response_taskproc_data* rtd;
+    size_t bufsize = pool->bufsize;
+
+    if (len >= bufsize) {
+        /* response of grown receive buffer, not returned to pool */
+        bufsize = len + 1u;
+        rtd     = NULL;
+    } else {
+        ao2_lock(pool);
+        rtd = AST_LIST_REMOVE_HEAD(&pool->items, entry);
+        if (rtd) {
+            pool->free_count--;
+        }
+        ao2_unlock(pool);
+    }
+
+    if (rtd) {
+        rtd->hit = 1;
+    } else {
+        rtd = ast_calloc(1, sizeof(struct at_response_taskproc_data) + bufsize);
+        if (!rtd) {
+            return NULL;
+        }
+        rtd->hit = 0;
+        __atomic_add_fetch(&pool->bytes, sizeof(*rtd) + bufsize, __ATOMIC_RELAXED);
+    }
+
+    ao2_ref(pool, 1);
+    rtd->pool                       = pool;
+    rtd->ptd.pvt                    = pvt;
+    rtd->response.__AST_STR_LEN     = bufsize;
+    rtd->response.__AST_STR_USED    = 0u;
+    rtd->response.__AST_STR_TS      = DS_STATIC;
+    *ast_str_buffer(&rtd->response) = '\000';
+    return rtd;
+}
+
+void at_respool_put(struct at_response_taskproc_data* rtd)
+{
+    if (!rtd) {
+        return;
+    }
+
+    struct at_respool* const pool = rtd->pool;
+    if (!pool) {
+        ast_free(rtd);
+        return;
+    }
+
+    ao2_lock(pool);
+    if (pool->free_count < pool->max_free && rtd->response.__AST_STR_LEN == pool->bufsize) {
+        AST_LIST_INSERT_HEAD(&pool->items, rtd, entry);
+        pool->free_count++;
+        rtd = NULL;
+    }
+    ao2_unlock(pool);
+
+    if (rtd) {
+        respool_free(pool, rtd);
+    }
+    ao2_ref(pool, -1);
+}
+
+size_t at_respool_memory(const struct at_respool* pool) { return __atomic_load_n(&pool->bytes, __ATOMIC_RELAXED); }
@@ -0,0 +1,29 @@
+/*
+   at_respool.h
+*/
+#ifndef CHAN_QUECTEL_AT_RESPOOL_H_INCLUDED
+#define CHAN_QUECTEL_AT_RESPOOL_H_INCLUDED
+
+#include <sys/types.h>
+
+struct pvt;
+struct at_respool;
+struct at_response_taskproc_data;
+
+/*
+    Pool of AT response buffers
+
+    Pool is reference counted (ao2), every buffer taken from the pool holds a reference,
+    so the pool outlives monitor thread while queued responses are not handled yet.
+    Responses longer than pool buffers get own buffer which is freed on put.
+*/
+
+struct at_respool* at_respool_create(size_t bufsize, unsigned int max_free);
+
+struct at_response_taskproc_data* at_respool_get(struct at_respool* pool, struct pvt* pvt, size_t len);
+void at_respool_put(struct at_response_taskproc_data* rtd);
+
+/* number of heap bytes of free buffers and buffers taken from pool */
+size_t at_respool_memory(const struct at_respool* pool);
+
+#endif /* CHAN_QUECTEL_AT_RESPOOL_H_INCLUDED */
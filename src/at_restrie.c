@@ -0,0 +1,122 @@
+/*
+   at_restrie.c
+*/
+#include <string.h> /* memset() */
+
+#include "at_restrie.h"
+
+static const char CR = '\r';
+
+static unsigned short restrie_child(const struct at_restrie* const trie, unsigned short node, char c)
+{
+    if (!node) {
+        return trie->root[(unsigned char)c];
+    }
+
+    for (unsigned short n = trie->nodes[node].child; n; n = trie->nodes[n].next) {
+        if (trie->nodes[n].c == c) {
+            return n;
+        }
+    }
+    return 0;
+}
+
+static int restrie_add_child(struct at_restrie* const trie, unsigned short node, char c)
+{
+    if (trie->nodesno >= AT_RESTRIE_MAX_NODES) {
+        return 0;
+    }
+
+    const unsigned short n  = (unsigned short)trie->nodesno++;
+    trie->nodes[n].res_idx = AT_RESTRIE_NO_RES;
+    trie->nodes[n].child   = 0;
+    trie->nodes[n].c       = c;
+
+    if (node) {
+        trie->nodes[n].next    = trie->nodes[node].child;
+        trie->nodes[node].child = n;
+    } else {
+        trie->nodes[n].next           = 0;
+        trie->root[(unsigned char)c] = n;
+    }
+    return n;
+}
+
+int at_restrie_init(struct at_restrie* trie, const at_responses_t* responses)
+{
+    memset(trie, 0, sizeof(*trie));
+    trie->responses = responses;
+    trie->nodesno   = 1u;
+
+    for (unsigned i = responses->ids_first; i < responses->ids; ++i) {
+        const at_response_t* const resp = &responses->responses[i];
+        if (!resp->idlen) {
+            continue;
+        }
+
+        unsigned short node = 0;
+        for (unsigned j = 0; j < resp->idlen; ++j) {
+            unsigned short n = restrie_child(trie, node, resp->id[j]);
+            if (!n) {
+                n = restrie_add_child(trie, node, resp->id[j]);
+                if (!n) {
+                    return -1;
+                }
+            }
+            node = n;
+        }
+
+        /* keep first id in table order */
+        if (trie->nodes[node].res_idx == AT_RESTRIE_NO_RES) {
+            trie->nodes[node].res_idx = (short)i;
+        }
+    }
+
+    return 0;
+}
+
+static void restrie_match(const at_restrie_node_t* const node, int* best)
+{
+    if (node->res_idx != AT_RESTRIE_NO_RES && (*best == AT_RESTRIE_NO_RES || node->res_idx < *best)) {
+        *best = node->res_idx;
+    }
+}
+
+at_res_t at_restrie_lookup(const struct at_restrie* trie, const char* buf, size_t len)
+{
+    if (!len) {
+        return RES_UNKNOWN;
+    }
+
+    const int line_cr = (buf[len - 1] == CR);
+
+    int best            = AT_RESTRIE_NO_RES;
+    unsigned short node = 0;
+    size_t i            = 0;
+
+    for (; i < len; ++i) {
+        node = restrie_child(trie, node, buf[i]);
+        if (!node) {
+            break;
+        }
+
+        /* CR-terminated ids match by prefix only CR-terminated lines */
+        if (buf[i] != CR || line_cr) {
+            restrie_match(&trie->nodes[node], &best);
+        }
+    }
+
+    /* CR-terminated ids match exact line without CR */
+    if (i == len && !line_cr) {
+        node = restrie_child(trie, node, CR);
+        if (node) {
+            restrie_match(&trie->nodes[node], &best);
+        }
+    }
+
+    if (best == AT_RESTRIE_NO_RES) {
+        return RES_UNKNOWN;
+    }
+
+    return trie->responses->responses[best].res;
+}
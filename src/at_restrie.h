@@ -0,0 +1,40 @@
+/*
+   at_restrie.h
+*/
+#ifndef CHAN_QUECTEL_AT_RESTRIE_H_INCLUDED
+#define CHAN_QUECTEL_AT_RESTRIE_H_INCLUDED
+
+#include <sys/types.h> /* size_t */
+
+#include "at_response.h" /* at_responses_t */
+
+#define AT_RESTRIE_MAX_NODES 1024
+#define AT_RESTRIE_NO_RES -1
+
+/*
+    Prefix tree over ids of responses table
+
+    Lookup walks the tree once along the input line, so classification costs O(prefix length)
+    instead of memcmp() against every id. Matching rules are the same as in the linear scan:
+    the first (in table order) matched id wins, an id ending with CR matches either
+    the line with the same CR-terminated prefix or the exact line without CR.
+*/
+
+typedef struct at_restrie_node {
+    short res_idx;        /*!< index in responses table or AT_RESTRIE_NO_RES */
+    unsigned short child; /*!< index of first child, 0 - none */
+    unsigned short next;  /*!< index of next sibling, 0 - none */
+    char c;               /*!< character of transition to this node */
+} at_restrie_node_t;
+
+struct at_restrie {
+    const at_responses_t* responses;
+    unsigned short root[256];                     /*!< first level, indexed by character */
+    unsigned int nodesno;                         /*!< number of used nodes, node 0 is root */
+    at_restrie_node_t nodes[AT_RESTRIE_MAX_NODES];
+};
+
+int at_restrie_init(struct at_restrie* trie, const at_responses_t* responses);
+at_res_t at_restrie_lookup(const struct at_restrie* trie, const char* buf, size_t len);
+
+#endif /* CHAN_QUECTEL_AT_RESTRIE_H_INCLUDED */
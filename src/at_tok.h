@@ -0,0 +1,171 @@
+/*
+   at_tok.h
+*/
+#ifndef CHAN_QUECTEL_AT_TOK_H_INCLUDED
+#define CHAN_QUECTEL_AT_TOK_H_INCLUDED
+
+#include <limits.h> /* INT_MAX UINT_MAX */
+#include <string.h> /* memchr() memcmp() memcpy() strlen() */
+#include <sys/types.h>
+
+/*
+    Field tokenizer of AT responses
+
+    Response line is walked by cursor and split on commas into string views,
+    quoted fields may contain commas. Nothing is copied or terminated,
+    so response may be const and parsed again. Views are valid while response is.
+*/
+
+/* string view, not terminated */
+struct at_tok {
+    const char* ptr;
+    size_t len;
+};
+
+/* cursor over comma separated fields, pos is NULL after last field */
+struct at_fields {
+    const char* pos;
+    const char* end;
+};
+
+static inline int at_tok_blank(char c) { return c == ' ' || c == '\t' || c == '\r' || c == '\n'; }
+
+static inline void at_fields_init(struct at_fields* f, const char* str, size_t len)
+{
+    f->pos = str;
+    f->end = str + len;
+}
+
+/*!< skip "+NAME:" prefix of response, -1 if there is no prefix */
+static inline int at_fields_skip_prefix(struct at_fields* f)
+{
+    const char* const colon = f->pos ? memchr(f->pos, ':', (size_t)(f->end - f->pos)) : NULL;
+    if (!colon) {
+        return -1;
+    }
+
+    f->pos = colon + 1;
+    return 0;
+}
+
+/*!< take next field without surrounding blanks, -1 if there are no more fields */
+static inline int at_fields_next(struct at_fields* f, struct at_tok* tok)
+{
+    const char* start = f->pos;
+    if (!start) {
+        return -1;
+    }
+
+    while (start < f->end && at_tok_blank(*start)) {
+        ++start;
+    }
+
+    /* comma inside quoted field is not delimiter */
+    const char* search = start;
+    if (search < f->end && *search == '"') {
+        const char* const quote = memchr(search + 1, '"', (size_t)(f->end - search - 1));
+        if (quote) {
+            search = quote + 1;
+        }
+    }
+
+    const char* const comma = memchr(search, ',', (size_t)(f->end - search));
+    const char* stop        = comma ? comma : f->end;
+    f->pos                  = comma ? comma + 1 : NULL;
+
+    while (stop > start && at_tok_blank(stop[-1])) {
+        --stop;
+    }
+
+    tok->ptr = start;
+    tok->len = (size_t)(stop - start);
+    return 0;
+}
+
+/*!< take next fields, return number of fields taken */
+static inline size_t at_fields_take(struct at_fields* f, struct at_tok* toks, size_t count)
+{
+    size_t n = 0;
+
+    while (n < count && !at_fields_next(f, &toks[n])) {
+        ++n;
+    }
+    return n;
+}
+
+/*!< remaining part of line, for logs */
+static inline int at_fields_rest_len(const struct at_fields* f) { return f->pos ? (int)(f->end - f->pos) : 0; }
+
+/*!< view without enclosing quotes, unbalanced quote is removed too */
+static inline struct at_tok at_tok_unquote(struct at_tok tok)
+{
+    if (tok.len && tok.ptr[0] == '"') {
+        ++tok.ptr;
+        --tok.len;
+    }
+    if (tok.len && tok.ptr[tok.len - 1u] == '"') {
+        --tok.len;
+    }
+    return tok;
+}
+
+static inline int at_tok_eq(const struct at_tok* tok, const char* str)
+{
+    const size_t len = strlen(str);
+    return tok->len == len && !memcmp(tok->ptr, str, len);
+}
+
+/*!< decimal number of whole field, quotes allowed, -1 on error */
+static inline int at_tok_uint(struct at_tok tok, unsigned int* value)
+{
+    tok = at_tok_unquote(tok);
+    if (!tok.len) {
+        return -1;
+    }
+
+    unsigned int res = 0;
+    for (size_t i = 0; i < tok.len; ++i) {
+        const unsigned int digit = (unsigned char)tok.ptr[i] - (unsigned char)'0';
+        if (digit > 9u || res > (UINT_MAX - digit) / 10u) {
+            return -1;
+        }
+        res = res * 10u + digit;
+    }
+
+    *value = res;
+    return 0;
+}
+
+static inline int at_tok_int(struct at_tok tok, int* value)
+{
+    tok = at_tok_unquote(tok);
+
+    const int negative = tok.len && tok.ptr[0] == '-';
+    if (tok.len && (tok.ptr[0] == '-' || tok.ptr[0] == '+')) {
+        ++tok.ptr;
+        --tok.len;
+    }
+
+    unsigned int res;
+    if (at_tok_uint(tok, &res) || res > (unsigned int)INT_MAX + (negative ? 1u : 0u)) {
+        return -1;
+    }
+
+    *value = negative ? (int)(0u - res) : (int)res;
+    return 0;
+}
+
+/*!< copy field to terminated buffer, truncated to its size */
+static inline size_t at_tok_copy(const struct at_tok* tok, char* dst, size_t size)
+{
+    if (!size) {
+        return 0;
+    }
+
+    const size_t len = tok->len < size ? tok->len : size - 1u;
+    memcpy(dst, tok->ptr, len);
+    dst[len] = '\000';
+    return len;
+}
+
+#endif /* CHAN_QUECTEL_AT_TOK_H_INCLUDED */
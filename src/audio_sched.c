@@ -0,0 +1,336 @@
+/*
+   audio_sched.c
+*/
+#include <errno.h>       /* errno */
+#include <poll.h>        /* poll() */
+#include <sys/eventfd.h> /* eventfd() */
+#include <sys/timerfd.h> /* timerfd_create() timerfd_settime() */
+#include <sys/uio.h>     /* writev() */
+
+#include "ast_config.h"
+
+#include <asterisk/linkedlists.h>
+#include <asterisk/lock.h>
+#include <asterisk/logger.h>
+#include <asterisk/utils.h>
+
+#include "audio_sched.h"
+
+#include "audio_uring.h"
+#include "chan_quectel.h"
+#include "channel.h" /* channel_timing_write() channel_timing_prepare() channel_timing_complete() */
+#include "cpvt.h"    /* CPVT_IS_MASTER() CPVT_IS_SOUND_SOURCE() */
+#include "helpers.h" /* thread_set_cpus() */
+
+static const unsigned int AUDIO_SCHED_TICK_MS = 2u; /*!< resolution of wheel */
+
+/* one turn of wheel is audio frame period, 20 ms as rate of per-device timer, longer frames take several turns */
+#define AUDIO_SCHED_SLOTS 10u
+
+/* number of device writes submitted at once */
+#define AUDIO_SCHED_BATCH 32u
+
+struct audio_sched_entry {
+    AST_LIST_ENTRY(audio_sched_entry) entry;
+    struct pvt* pvt;
+    unsigned int slot;
+    unsigned int turns; /*!< turns of wheel per audio frame of device */
+    unsigned int wait;  /*!< turns passed since device was serviced */
+    int source;         /*!< master channel was sound source on last check */
+};
+
+AST_LIST_HEAD_NOLOCK(audio_sched_slot, audio_sched_entry);
+
+struct audio_sched {
+    ast_mutex_t lock;                                  /*!< protect slots, held while devices serviced */
+    struct audio_sched_slot slots[AUDIO_SCHED_SLOTS]; /*!< devices due on each tick */
+    unsigned int load[AUDIO_SCHED_SLOTS];             /*!< number of devices in slot */
+    unsigned int current;                             /*!< slot serviced on next tick */
+    int tfd;                                          /*!< timerfd ticking the wheel */
+    int wfd;                                          /*!< eventfd for thread wakeup on shutdown */
+    pthread_t thread;
+
+    struct audio_uring* uring;                            /*!< batch submission of writes, NULL - writev() per device */
+    struct pvt* pvts[AUDIO_SCHED_BATCH];                  /*!< devices of current batch */
+    struct channel_timing_frame frames[AUDIO_SCHED_BATCH]; /*!< frames of current batch */
+    struct audio_uring_req reqs[AUDIO_SCHED_BATCH];       /*!< writes of current batch */
+
+    unsigned int ticks;       /*!< ticks since last rate update */
+    unsigned int syscalls;    /*!< write system calls since last rate update */
+    unsigned int syscalls_ps; /*!< write system calls per second */
+};
+
+static struct audio_sched* sched = NULL;
+
+static void audio_sched_flush(struct audio_sched* const s, unsigned int n)
+{
+    if (!n) {
+        return;
+    }
+
+    const int syscalls = audio_uring_writev(s->uring, s->reqs, n);
+    if (syscalls < 0) {
+        /* fallback to write of every device */
+        for (unsigned int i = 0; i < n; ++i) {
+            const ssize_t w = writev(s->reqs[i].fd, s->reqs[i].iov, s->reqs[i].iovcnt);
+            s->reqs[i].res  = (w < 0) ? -errno : (int)w;
+            PVT_STAT_INC(s->pvts[i], write_syscalls);
+        }
+        s->syscalls += n;
+    } else {
+        for (unsigned int i = 0; i < n; ++i) {
+            PVT_STAT_INC(s->pvts[i], write_batched);
+        }
+        s->syscalls += (unsigned int)syscalls;
+    }
+
+    for (unsigned int i = 0; i < n; ++i) {
+        channel_timing_complete(s->pvts[i], &s->frames[i], s->reqs[i].res);
+    }
+}
+
+static int audio_sched_due(struct audio_sched_entry* const e)
+{
+    if (++e->wait < e->turns) {
+        return 0;
+    }
+
+    e->wait = 0;
+    return 1;
+}
+
+/* write only while master channel is sound source as channel_read() does, busy device keeps last state */
+static int audio_sched_source(struct audio_sched_entry* const e)
+{
+    struct pvt* const pvt = e->pvt;
+    const struct cpvt* cpvt;
+
+    if (ast_mutex_trylock(&pvt->lock)) {
+        return e->source;
+    }
+
+    e->source = 0;
+    AST_LIST_TRAVERSE(&pvt->chans, cpvt, entry) {
+        if (CPVT_IS_MASTER(cpvt)) {
+            e->source = CPVT_IS_SOUND_SOURCE(cpvt) ? 1 : 0;
+            break;
+        }
+    }
+    ast_mutex_unlock(&pvt->lock);
+
+    return e->source;
+}
+
+static void audio_sched_tick(struct audio_sched* const s)
+{
+    struct audio_sched_entry* e;
+
+    SCOPED_MUTEX(sched_lock, &s->lock);
+
+    if (s->uring) {
+        unsigned int n = 0;
+        AST_LIST_TRAVERSE(&s->slots[s->current], e, entry) {
+            if (!audio_sched_due(e) || !audio_sched_source(e) || channel_timing_prepare(e->pvt, &s->frames[n])) {
+                continue;
+            }
+
+            s->pvts[n]        = e->pvt;
+            s->reqs[n].fd     = s->frames[n].fd;
+            s->reqs[n].iov    = s->frames[n].iov;
+            s->reqs[n].iovcnt = s->frames[n].iovcnt;
+            if (++n == AUDIO_SCHED_BATCH) {
+                audio_sched_flush(s, n);
+                n = 0;
+            }
+        }
+        audio_sched_flush(s, n);
+    } else {
+        AST_LIST_TRAVERSE(&s->slots[s->current], e, entry) {
+            if (audio_sched_due(e) && audio_sched_source(e)) {
+                channel_timing_write(e->pvt);
+                s->syscalls++;
+            }
+        }
+    }
+
+    s->current = (s->current + 1u) % AUDIO_SCHED_SLOTS;
+
+    if (++s->ticks * AUDIO_SCHED_TICK_MS >= 1000u) {
+        __atomic_store_n(&s->syscalls_ps, s->syscalls, __ATOMIC_RELAXED);
+        s->syscalls    = 0;
+        s->ticks       = 0;
+    }
+}
+
+static void* audio_sched_threadproc(void* arg)
+{
+    struct audio_sched* const s = arg;
+    struct pollfd fds[2]        = {
+        {.fd = s->tfd, .events = POLLIN},
+        {.fd = s->wfd, .events = POLLIN},
+    };
+
+    thread_set_cpus("audio scheduler", CONF_GLOBAL(audio_cpus));
+
+    while (1) {
+        if (poll(fds, ARRAY_LEN(fds), -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            ast_log(LOG_ERROR, "Audio scheduler poll error: %s\n", strerror(errno));
+            break;
+        }
+
+        if (fds[1].revents) {
+            break;
+        }
+
+        uint64_t expirations = 0;
+        if (read(s->tfd, &expirations, sizeof(expirations)) != sizeof(expirations)) {
+            continue;
+        }
+
+        /* do not skip slots if thread was late, devices catch up on next ticks */
+        for (; expirations; --expirations) {
+            audio_sched_tick(s);
+        }
+    }
+
+    return NULL;
+}
+
+int audio_sched_init(int uring)
+{
+    struct audio_sched* const s = ast_calloc(1, sizeof(*s));
+    if (!s) {
+        return -1;
+    }
+
+    ast_mutex_init(&s->lock);
+    for (unsigned int i = 0; i < AUDIO_SCHED_SLOTS; ++i) {
+        AST_LIST_HEAD_INIT_NOLOCK(&s->slots[i]);
+    }
+
+    s->tfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    s->wfd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (s->tfd < 0 || s->wfd < 0) {
+        goto cleanup;
+    }
+
+    const struct itimerspec its = {
+        .it_interval = {.tv_sec = 0, .tv_nsec = AUDIO_SCHED_TICK_MS * 1000000l},
+        .it_value    = {.tv_sec = 0, .tv_nsec = AUDIO_SCHED_TICK_MS * 1000000l},
+    };
+    if (timerfd_settime(s->tfd, 0, &its, NULL)) {
+        goto cleanup;
+    }
+
+    if (ast_pthread_create_background(&s->thread, NULL, audio_sched_threadproc, s) < 0) {
+        goto cleanup;
+    }
+
+    if (uring) {
+        s->uring = audio_uring_create(AUDIO_SCHED_BATCH);
+        if (!s->uring) {
+            ast_log(LOG_WARNING, "io_uring not available, audio written with writev()\n");
+        }
+    }
+
+    sched = s;
+    ast_verb(3, "Audio scheduler started, tick %u ms%s\n", AUDIO_SCHED_TICK_MS, s->uring ? ", io_uring" : "");
+    return 0;
+
+cleanup:
+    ast_log(LOG_ERROR, "Unable to start audio scheduler: %s\n", strerror(errno));
+    if (s->wfd >= 0) {
+        close(s->wfd);
+    }
+    if (s->tfd >= 0) {
+        close(s->tfd);
+    }
+    ast_mutex_destroy(&s->lock);
+    ast_free(s);
+    return -1;
+}
+
+void audio_sched_fini()
+{
+    struct audio_sched* const s = sched;
+    if (!s) {
+        return;
+    }
+
+    const uint64_t one = 1;
+    if (write(s->wfd, &one, sizeof(one)) < 0) {
+        ast_log(LOG_WARNING, "Unable to wake up audio scheduler: %s\n", strerror(errno));
+    }
+    pthread_join(s->thread, NULL);
+
+    /* devices are already destroyed and detached */
+    sched = NULL;
+    audio_uring_destroy(s->uring);
+
+    close(s->wfd);
+    close(s->tfd);
+    ast_mutex_destroy(&s->lock);
+    ast_free(s);
+}
+
+int audio_sched_running() { return sched != NULL; }
+
+unsigned int audio_sched_syscalls_rate()
+{
+    struct audio_sched* const s = sched;
+    return s ? __atomic_load_n(&s->syscalls_ps, __ATOMIC_RELAXED) : 0u;
+}
+
+/* called with pvt lock held */
+int audio_sched_attach(struct pvt* pvt)
+{
+    struct audio_sched* const s = sched;
+    if (!s || pvt->a_sched) {
+        return -1;
+    }
+
+    struct audio_sched_entry* const e = ast_calloc(1, sizeof(*e));
+    if (!e) {
+        return -1;
+    }
+
+    e->pvt   = pvt;
+    e->turns = MAX(pvt_get_audio_ptime(pvt) / (AUDIO_SCHED_SLOTS * AUDIO_SCHED_TICK_MS), 1u);
+
+    SCOPED_MUTEX(sched_lock, &s->lock);
+
+    /* spread devices over slots to keep batches even */
+    e->slot = s->current;
+    for (unsigned int i = 1; i < AUDIO_SCHED_SLOTS; ++i) {
+        const unsigned int slot = (s->current + i) % AUDIO_SCHED_SLOTS;
+        if (s->load[slot] < s->load[e->slot]) {
+            e->slot = slot;
+        }
+    }
+
+    AST_LIST_INSERT_TAIL(&s->slots[e->slot], e, entry);
+    s->load[e->slot]++;
+    pvt->a_sched = e;
+
+    ast_debug(3, "[%s] Attached to audio scheduler, slot %u of %u\n", PVT_ID(pvt), e->slot, AUDIO_SCHED_SLOTS);
+    return 0;
+}
+
+/* called with pvt lock held, on return device is not serviced anymore */
+void audio_sched_detach(struct pvt* pvt)
+{
+    struct audio_sched* const s       = sched;
+    struct audio_sched_entry* const e = pvt->a_sched;
+    if (!s || !e) {
+        return;
+    }
+
+    SCOPED_MUTEX(sched_lock, &s->lock);
+    AST_LIST_REMOVE(&s->slots[e->slot], e, entry);
+    s->load[e->slot]--;
+    pvt->a_sched = NULL;
+    ast_free(e);
+}
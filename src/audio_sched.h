@@ -0,0 +1,25 @@
+/*
+   audio_sched.h
+*/
+#ifndef CHAN_QUECTEL_AUDIO_SCHED_H_INCLUDED
+#define CHAN_QUECTEL_AUDIO_SCHED_H_INCLUDED
+
+struct pvt;
+
+/*
+    Module-level pacing of audio writes
+
+    One timerfd ticks a wheel of slots, every device attached to the scheduler
+    lives in one slot and is serviced once per audio frame period.
+    Writes of all devices due on a tick can be submitted in one io_uring batch.
+*/
+
+int audio_sched_init(int uring);
+void audio_sched_fini();
+int audio_sched_running();
+unsigned int audio_sched_syscalls_rate();
+
+int audio_sched_attach(struct pvt* pvt);
+void audio_sched_detach(struct pvt* pvt);
+
+#endif /* CHAN_QUECTEL_AUDIO_SCHED_H_INCLUDED */
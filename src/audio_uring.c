@@ -0,0 +1,197 @@
+/*
+   audio_uring.c
+*/
+#include "ast_config.h"
+
+#include <asterisk/utils.h> /* ast_calloc() ast_free() */
+
+#include "audio_uring.h"
+
+#include "mutils.h" /* MIN() */
+
+#if HAVE_LINUX_IO_URING_H
+
+#include <linux/io_uring.h>
+#include <sys/mman.h>    /* mmap() munmap() */
+#include <sys/syscall.h> /* __NR_io_uring_setup __NR_io_uring_enter */
+
+/* raw io_uring, only batched IORING_OP_WRITEV is needed, so liburing dependency is not worth it */
+
+struct audio_uring {
+    int fd;
+    unsigned int entries;
+
+    unsigned int* sq_head;
+    unsigned int* sq_tail;
+    unsigned int* sq_mask;
+    unsigned int* sq_array;
+    struct io_uring_sqe* sqes;
+
+    unsigned int* cq_head;
+    unsigned int* cq_tail;
+    unsigned int* cq_mask;
+    struct io_uring_cqe* cqes;
+
+    void* sq_ptr;
+    size_t sq_len;
+    void* cq_ptr;
+    size_t cq_len;
+    size_t sqes_len;
+};
+
+struct audio_uring* audio_uring_create(unsigned int entries)
+{
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+
+    const int fd = (int)syscall(__NR_io_uring_setup, entries, &p);
+    if (fd < 0) {
+        ast_debug(1, "io_uring not available: %s\n", strerror(errno));
+        return NULL;
+    }
+
+    struct audio_uring* const ring = ast_calloc(1, sizeof(*ring));
+    if (!ring) {
+        close(fd);
+        return NULL;
+    }
+
+    ring->fd       = fd;
+    ring->entries  = p.sq_entries;
+    ring->sq_len   = p.sq_off.array + p.sq_entries * sizeof(unsigned int);
+    ring->cq_len   = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    ring->sqes_len = p.sq_entries * sizeof(struct io_uring_sqe);
+
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        ring->sq_len = ring->cq_len = (ring->sq_len > ring->cq_len) ? ring->sq_len : ring->cq_len;
+    }
+
+    ring->sq_ptr = mmap(NULL, ring->sq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    if (ring->sq_ptr == MAP_FAILED) {
+        goto cleanup;
+    }
+
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        ring->cq_ptr = ring->sq_ptr;
+    } else {
+        ring->cq_ptr = mmap(NULL, ring->cq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+        if (ring->cq_ptr == MAP_FAILED) {
+            goto cleanup;
+        }
+    }
+
+    ring->sqes = mmap(NULL, ring->sqes_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+    if (ring->sqes == MAP_FAILED) {
+        goto cleanup;
+    }
+
+    ring->sq_head  = (unsigned int*)((char*)ring->sq_ptr + p.sq_off.head);
+    ring->sq_tail  = (unsigned int*)((char*)ring->sq_ptr + p.sq_off.tail);
+    ring->sq_mask  = (unsigned int*)((char*)ring->sq_ptr + p.sq_off.ring_mask);
+    ring->sq_array = (unsigned int*)((char*)ring->sq_ptr + p.sq_off.array);
+    ring->cq_head  = (unsigned int*)((char*)ring->cq_ptr + p.cq_off.head);
+    ring->cq_tail  = (unsigned int*)((char*)ring->cq_ptr + p.cq_off.tail);
+    ring->cq_mask  = (unsigned int*)((char*)ring->cq_ptr + p.cq_off.ring_mask);
+    ring->cqes     = (struct io_uring_cqe*)((char*)ring->cq_ptr + p.cq_off.cqes);
+
+    return ring;
+
+cleanup:
+    ast_log(LOG_WARNING, "Unable to map io_uring: %s\n", strerror(errno));
+    if (ring->sqes && ring->sqes != MAP_FAILED) {
+        munmap(ring->sqes, ring->sqes_len);
+    }
+    if (ring->cq_ptr && ring->cq_ptr != MAP_FAILED && ring->cq_ptr != ring->sq_ptr) {
+        munmap(ring->cq_ptr, ring->cq_len);
+    }
+    if (ring->sq_ptr && ring->sq_ptr != MAP_FAILED) {
+        munmap(ring->sq_ptr, ring->sq_len);
+    }
+    close(fd);
+    ast_free(ring);
+    return NULL;
+}
+
+void audio_uring_destroy(struct audio_uring* ring)
+{
+    if (!ring) {
+        return;
+    }
+
+    munmap(ring->sqes, ring->sqes_len);
+    if (ring->cq_ptr != ring->sq_ptr) {
+        munmap(ring->cq_ptr, ring->cq_len);
+    }
+    munmap(ring->sq_ptr, ring->sq_len);
+    close(ring->fd);
+    ast_free(ring);
+}
+
+static int audio_uring_submit(struct audio_uring* ring, struct audio_uring_req* reqs, unsigned int n)
+{
+    unsigned int tail = *ring->sq_tail;
+    for (unsigned int i = 0; i < n; ++i, ++tail) {
+        const unsigned int idx         = tail & *ring->sq_mask;
+        struct io_uring_sqe* const sqe = &ring->sqes[idx];
+
+        memset(sqe, 0, sizeof(*sqe));
+        sqe->opcode    = IORING_OP_WRITEV;
+        sqe->fd        = reqs[i].fd;
+        sqe->addr      = (unsigned long)reqs[i].iov;
+        sqe->len       = (unsigned int)reqs[i].iovcnt;
+        sqe->off       = (__u64)-1; /* current position, tty is not seekable anyway */
+        sqe->user_data = i;
+
+        ring->sq_array[idx] = idx;
+        reqs[i].res         = -ECANCELED;
+    }
+    __atomic_store_n(ring->sq_tail, tail, __ATOMIC_RELEASE);
+
+    int rv;
+    do {
+        rv = (int)syscall(__NR_io_uring_enter, ring->fd, n, n, IORING_ENTER_GETEVENTS, NULL, 0);
+    } while (rv < 0 && errno == EINTR);
+
+    if (rv < 0) {
+        ast_log(LOG_WARNING, "io_uring submission failed: %s\n", strerror(errno));
+        return -1;
+    }
+
+    unsigned int head = *ring->cq_head;
+    for (unsigned int done = 0; done < n && head != __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE); ++done, ++head) {
+        const struct io_uring_cqe* const cqe = &ring->cqes[head & *ring->cq_mask];
+        if (cqe->user_data < n) {
+            reqs[cqe->user_data].res = cqe->res;
+        }
+    }
+    __atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+
+    return 0;
+}
+
+int audio_uring_writev(struct audio_uring* ring, struct audio_uring_req* reqs, unsigned int n)
+{
+    int syscalls = 0;
+
+    while (n) {
+        const unsigned int chunk = MIN(n, ring->entries);
+        if (audio_uring_submit(ring, reqs, chunk)) {
+            return -1;
+        }
+        reqs += chunk;
+        n    -= chunk;
+        syscalls++;
+    }
+
+    return syscalls;
+}
+
+#else /* HAVE_LINUX_IO_URING_H */
+
+struct audio_uring* audio_uring_create(attribute_unused unsigned int entries) { return NULL; }
+
+void audio_uring_destroy(attribute_unused struct audio_uring* ring) {}
+
+int audio_uring_writev(attribute_unused struct audio_uring* ring, attribute_unused struct audio_uring_req* reqs, attribute_unused unsigned int n) { return -1; }
+
+#endif /* HAVE_LINUX_IO_URING_H */
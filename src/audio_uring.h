@@ -0,0 +1,25 @@
+/*
+   audio_uring.h
+*/
+#ifndef CHAN_QUECTEL_AUDIO_URING_H_INCLUDED
+#define CHAN_QUECTEL_AUDIO_URING_H_INCLUDED
+
+#include <sys/uio.h> /* struct iovec */
+
+struct audio_uring;
+
+struct audio_uring_req {
+    int fd;                   /*!< descriptor to write */
+    const struct iovec* iov;  /*!< data to write */
+    int iovcnt;               /*!< number of io vectors */
+    int res;                  /*!< bytes written or -errno */
+};
+
+/* return NULL if io_uring not supported by build or kernel */
+struct audio_uring* audio_uring_create(unsigned int entries);
+void audio_uring_destroy(struct audio_uring* ring);
+
+/* submit all writes and wait completions with one system call per ring size, return number of system calls or -1 */
+int audio_uring_writev(struct audio_uring* ring, struct audio_uring_req* reqs, unsigned int n);
+
+#endif /* CHAN_QUECTEL_AUDIO_URING_H_INCLUDED */
@@ -33,6 +33,8 @@
  * \ingroup channel_drivers
  */
 
+#include <inttypes.h> /* PRIu64 PRIi64 */
+#include <poll.h>     /* poll() */
 #include <signal.h>
 
 #include "ast_config.h"
@@ -52,22 +54,42 @@
 #include "at_command.h" /* at_cmd2str() */
 #include "at_queue.h"   /* struct at_queue_task_cmd at_queue_head_cmd() */
 #include "at_read.h"
+#include "at_respool.h"  /* at_respool_memory() */
 #include "at_response.h" /* at_res_t */
+#include "audio_sched.h"
 #include "channel.h"     /* channel_queue_hangup() */
 #include "cli.h"
 #include "dc_config.h" /* dc_uconfig_fill() dc_gconfig_fill() dc_sconfig_fill()  */
+#include "devindex.h"  /* devindex_find_id() devindex_find_group() */
 #include "errno.h"
 #include "error.h"
 #include "helpers.h"
+#include "manager.h"
+#include "metrics.h"
 #include "monitor_thread.h"
 #include "mutils.h" /* ARRAY_LEN() */
+#include "notifyq.h"
 #include "pcm.h"
-#include "pdiscovery.h" /* pdiscovery_lookup() pdiscovery_init() pdiscovery_fini() */
+#include "pdiscovery.h" /* pdiscovery_lookup() pdiscovery_init() pdiscovery_fini() pdiscovery_cache_load() */
+#include "pdu_cache.h"  /* pdu_cache_fini() */
+#include "poller.h"
+#include "pvt_status.h" /* pvt_status_publish() */
+#include "smsbulk.h"
 #include "smsdb.h"
+#include "smsexpiry.h"
 #include "tty.h"
+#include "uac_engine.h"
 
 static const char* const dev_state_strs[4] = {"stop", "restart", "remove", "start"};
 
+static const size_t SCRATCH_ARENA_SIZE             = 16 * 1024;
+static const size_t SCRATCH_ARENA_SIZE_COMPACT     = 4 * 1024;
+static const int DISCOVERY_SETTLE_MS                = 500;
+static const unsigned int MIXB_FRAMES               = 5u; /* frames of audio mix buffer */
+static const unsigned int MIXB_FRAMES_COMPACT       = 3u;
+static const unsigned int WRITE_RING_FRAMES         = 4u; /* frames passed to timer-driven writer without playout buffer */
+static const unsigned int WRITE_RING_FRAMES_COMPACT = 3u;
+
 public_state_t* gpublic;
 
 const char* attribute_const dev_state2str(dev_state_t state) { return enum2str(state, dev_state_strs, ARRAY_LEN(dev_state_strs)); }
@@ -92,17 +114,54 @@ const char* attribute_const dev_state2str_msg(dev_state_t state)
     return enum2str(state, states, ARRAY_LEN(states));
 }
 
+#define UAC_AUTO_XRUNS 2u  /* XRUNs during calls of one activity period which widen buffers */
+#define UAC_AUTO_LEVELS 4u /* buffers are doubled at most that times */
+
+static void soundcard_tuning(const struct pvt* pvt, struct pcm_tuning* tuning)
+{
+    static const unsigned int LOW_BUFFER = 80u;
+    static const unsigned int LOW_START  = 40u;
+    static const unsigned int START      = 250u;
+
+    tuning->period_ms = pvt_get_audio_ptime(pvt);
+
+    switch (CONF_UNIQ(pvt, uac_latency)) {
+        case UAC_LATENCY_LOW:
+            tuning->buffer_ms = LOW_BUFFER;
+            tuning->start_ms  = LOW_START;
+            break;
+
+        case UAC_LATENCY_ROBUST:
+            tuning->buffer_ms = 2u * PTIME_BUFFER;
+            tuning->start_ms  = 2u * START;
+            break;
+
+        case UAC_LATENCY_AUTO:
+            tuning->buffer_ms = LOW_BUFFER << pvt->uac_level;
+            tuning->start_ms  = MIN(LOW_START << pvt->uac_level, START);
+            break;
+
+        default:
+            tuning->buffer_ms = PTIME_BUFFER;
+            tuning->start_ms  = START;
+            break;
+    }
+}
+
 static int soundcard_init(struct pvt* pvt)
 {
     const struct ast_format* const fmt = pvt_get_audio_format(pvt);
     unsigned int channels;
+    struct pcm_tuning tuning;
 
-    if (pcm_init(CONF_UNIQ(pvt, alsadev), SND_PCM_STREAM_CAPTURE, fmt, &pvt->icard, &channels, &pvt->audio_fd)) {
+    soundcard_tuning(pvt, &tuning);
+
+    if (pcm_init(CONF_UNIQ(pvt, alsadev), SND_PCM_STREAM_CAPTURE, fmt, &tuning, &pvt->icard, &channels, &pvt->audio_fd)) {
         ast_log(LOG_ERROR, "[%s][ALSA] Problem opening capture device '%s'\n", PVT_ID(pvt), CONF_UNIQ(pvt, alsadev));
         return -1;
     }
 
-    if (pcm_init(CONF_UNIQ(pvt, alsadev), SND_PCM_STREAM_PLAYBACK, fmt, &pvt->ocard, &pvt->ocard_channels, NULL)) {
+    if (pcm_init(CONF_UNIQ(pvt, alsadev), SND_PCM_STREAM_PLAYBACK, fmt, &tuning, &pvt->ocard, &pvt->ocard_channels, NULL)) {
         ast_log(LOG_ERROR, "[%s][ALSA] Problem opening playback device '%s'\n", PVT_ID(pvt), CONF_UNIQ(pvt, alsadev));
         return -1;
     }
@@ -118,10 +177,74 @@ static int soundcard_init(struct pvt* pvt)
         return -1;
     }
 
-    ast_verb(2, "[%s][ALSA] Sound card '%s' initialized\n", PVT_ID(pvt), CONF_UNIQ(pvt, alsadev));
+    if (CONF_UNIQ(pvt, uac_engine)) {
+        pvt->uac_engine = uac_engine_create(pvt, tuning.start_ms);
+        if (pvt->uac_engine) {
+            pvt->audio_fd = uac_engine_fd(pvt->uac_engine);
+        } else {
+            ast_log(LOG_WARNING, "[%s][ALSA] Sound card serviced from channel thread\n", PVT_ID(pvt));
+        }
+    }
+
+    pvt->uac_tuning      = tuning;
+    pvt->uac_tuned_xruns = PVT_STAT_GET(pvt, uac_xruns);
+
+    ast_verb(2, "[%s][ALSA] Sound card '%s' initialized - latency:%s buffer:%ums start:%ums\n", PVT_ID(pvt), CONF_UNIQ(pvt, alsadev),
+             dc_uac_latency2str(CONF_UNIQ(pvt, uac_latency)), tuning.buffer_ms, tuning.start_ms);
     return 0;
 }
 
+static void soundcard_fini(struct pvt* pvt)
+{
+    uac_engine_destroy(pvt->uac_engine);
+    pvt->uac_engine = NULL;
+
+    if (pvt->icard) {
+        const int err = snd_pcm_unlink(pvt->icard);
+        if (err < 0) {
+            ast_log(LOG_WARNING, "[%s][ALSA] Couldn't unlink devices: %s", PVT_ID(pvt), snd_strerror(err));
+        }
+        pcm_close(CONF_UNIQ(pvt, alsadev), &pvt->icard, SND_PCM_STREAM_CAPTURE);
+    }
+    if (pvt->ocard) {
+        pcm_close(CONF_UNIQ(pvt, alsadev), &pvt->ocard, SND_PCM_STREAM_PLAYBACK);
+        pvt->ocard_channels = 0;
+    }
+    memset(&pvt->uac_tuning, 0, sizeof(pvt->uac_tuning));
+}
+
+/*
+    Hardware parameters can not be changed while stream is running,
+    so sound card is reopened with new buffer sizes before first channel of activity period uses it.
+*/
+static void soundcard_retune(struct pvt* pvt)
+{
+    if (CONF_UNIQ(pvt, uac) == TRIBOOL_FALSE || !pvt->icard) {
+        return;
+    }
+
+    const uint64_t xruns = PVT_STAT_GET(pvt, uac_xruns) - pvt->uac_tuned_xruns;
+    pvt->uac_tuned_xruns = PVT_STAT_GET(pvt, uac_xruns);
+
+    if (CONF_UNIQ(pvt, uac_latency) == UAC_LATENCY_AUTO && xruns >= UAC_AUTO_XRUNS && pvt->uac_level < UAC_AUTO_LEVELS) {
+        pvt->uac_level++;
+        ast_log(LOG_NOTICE, "[%s][ALSA] %" PRIu64 " XRUNs during last calls, widening buffers - level:%u\n", PVT_ID(pvt), xruns, pvt->uac_level);
+    }
+
+    struct pcm_tuning tuning;
+    soundcard_tuning(pvt, &tuning);
+    if (tuning.buffer_ms == pvt->uac_tuning.buffer_ms && tuning.start_ms == pvt->uac_tuning.start_ms) {
+        return;
+    }
+
+    soundcard_fini(pvt);
+    if (soundcard_init(pvt) < 0) {
+        ast_log(LOG_ERROR, "[%s][ALSA] Unable to reopen sound card with new buffer sizes\n", PVT_ID(pvt));
+        soundcard_fini(pvt);
+        pvt->audio_fd = -1;
+    }
+}
+
 static int public_state_init(struct public_state* state);
 
 #/* phone monitor thread pvt cleanup */
@@ -152,17 +275,7 @@ void pvt_disconnect(struct pvt* pvt)
     at_queue_flush(pvt);
 
     if (CONF_UNIQ(pvt, uac) > TRIBOOL_FALSE) {
-        if (pvt->icard) {
-            const int err = snd_pcm_unlink(pvt->icard);
-            if (err < 0) {
-                ast_log(LOG_WARNING, "[%s][ALSA] Couldn't unlink devices: %s", PVT_ID(pvt), snd_strerror(err));
-            }
-            pcm_close(CONF_UNIQ(pvt, alsadev), &pvt->icard, SND_PCM_STREAM_CAPTURE);
-        }
-        if (pvt->ocard) {
-            pcm_close(CONF_UNIQ(pvt, alsadev), &pvt->ocard, SND_PCM_STREAM_PLAYBACK);
-            pvt->ocard_channels = 0;
-        }
+        soundcard_fini(pvt);
     } else {
         tty_close(PVT_STATE(pvt, audio_tty), pvt->audio_fd);
     }
@@ -172,6 +285,9 @@ void pvt_disconnect(struct pvt* pvt)
     pvt->data_fd  = -1;
     pvt->audio_fd = -1;
 
+    ao2_cleanup(pvt->respool);
+    pvt->respool = NULL;
+
     pvt_on_remove_last_channel(pvt);
 
     ast_debug(1, "[%s] Disconnecting - cleaning up\n", PVT_ID(pvt));
@@ -181,12 +297,13 @@ void pvt_disconnect(struct pvt* pvt)
     pvt->rssi           = 0;
     pvt->act            = 0;
     pvt->operator= 0;
+    pvt_load_update(pvt);
 
     ast_string_field_set(pvt, manufacturer, NULL);
     ast_string_field_set(pvt, model, NULL);
     ast_string_field_set(pvt, firmware, NULL);
-    ast_string_field_set(pvt, imei, NULL);
-    ast_string_field_set(pvt, imsi, NULL);
+    devindex_set_imei(pvt, NULL);
+    devindex_set_imsi(pvt, NULL);
     ast_string_field_set(pvt, iccid, NULL);
     ast_string_field_set(pvt, location_area_code, NULL);
     ast_string_field_set(pvt, network_name, NULL);
@@ -215,7 +332,10 @@ void pvt_disconnect(struct pvt* pvt)
     pvt->cwaiting           = 0;
     pvt->outgoing_sms       = 0;
     pvt->incoming_sms_index = -1;
+    pvt->clir               = -1;
+    pvt->call_indication    = 0;
     pvt->volume_sync_step   = VOLUME_SYNC_BEGIN;
+    memset(&pvt->sms_batch, 0, sizeof(pvt->sms_batch));
 
     pvt->current_state = DEV_STATE_STOPPED;
 
@@ -230,6 +350,7 @@ void pvt_disconnect(struct pvt* pvt)
         pvt->local_format_cap = NULL;
     }
 
+    pvt_status_publish(pvt);
     ast_verb(3, "[%s] Disconnected\n", PVT_ID(pvt));
 }
 
@@ -344,6 +465,7 @@ static void pvt_start(struct pvt* const pvt)
 
     pvt->connected     = 1;
     pvt->current_state = DEV_STATE_STARTED;
+    pvt_status_publish(pvt);
     ast_verb(3, "[%s] Connected, initializing...\n", PVT_ID(pvt));
     return;
 
@@ -360,10 +482,18 @@ cleanup_datafd:
 
 static void pvt_free(struct pvt* const pvt)
 {
+    devindex_remove(pvt);
+    for (unsigned int i = 0; i < ARRAY_LEN(pvt->latency.at_rtt); ++i) {
+        ast_free(pvt->latency.at_rtt[i]);
+    }
     at_queue_flush(pvt);
+    at_queue_pool_fini(pvt);
+    arena_destroy(&pvt->scratch);
     ast_string_field_free_memory(pvt);
+    pvt_status_release(pvt);
     ast_mutex_unlock(&pvt->lock);
     ast_mutex_destroy(&pvt->lock);
+    ast_mutex_destroy(&pvt->status_lock);
     ast_free(pvt);
 }
 
@@ -376,18 +506,194 @@ static void pvt_destroy(struct pvt* const pvt)
     pvt_free(pvt);
 }
 
+#/* return non-zero if some device waits for ports discovery by IMEI/IMSI */
+
+static int discovery_pending(public_state_t* state)
+{
+    struct pvt* pvt;
+    int pending = 0;
+
+    AST_RWLIST_RDLOCK(&state->devices);
+    AST_RWLIST_TRAVERSE(&state->devices, pvt, entry) {
+        SCOPED_MUTEX(pvt_lock, &pvt->lock);
+
+        if (pvt->connected || pvt->restart_time != RESTATE_TIME_NOW || pvt->desired_state == pvt->current_state) {
+            continue;
+        }
+        if (pvt->desired_state != DEV_STATE_STARTED && pvt->desired_state != DEV_STATE_RESTARTED) {
+            continue;
+        }
+        if (!CONF_UNIQ(pvt, data_tty)[0] && !CONF_UNIQ(pvt, audio_tty)[0]) {
+            pending = 1;
+            break;
+        }
+    }
+    AST_RWLIST_UNLOCK(&state->devices);
+
+    return pending;
+}
+
+#/* sleep discovery interval, with port events wake up earlier when ports appear or disappear */
+
+static void discovery_wait(public_state_t* state, int efd)
+{
+    const int interval = SCONF_GLOBAL(state, discovery_interval);
+
+    if (efd < 0) {
+        sleep(interval);
+        return;
+    }
+
+    struct pollfd pfd             = {.fd = efd, .events = POLLIN};
+    const struct timeval deadline = ast_tvadd(ast_tvnow(), ast_tv(interval, 0));
+    int ms;
+
+    while (!state->unloading_flag && (ms = ast_tvdiff_ms(deadline, ast_tvnow())) > 0) {
+        /* interrupted by discovery_restart() too */
+        if (poll(&pfd, 1, ms) <= 0) {
+            return;
+        }
+
+        if (pdiscovery_events_read(efd)) {
+            /* let udev create all ports of hotplugged device */
+            while (!state->unloading_flag && poll(&pfd, 1, DISCOVERY_SETTLE_MS) > 0) {
+                pdiscovery_events_read(efd);
+            }
+            ast_debug(3, "[discovery] Ports changed, rescanning\n");
+            return;
+        }
+    }
+}
+
+/* devices started concurrently by discovery_start_all() */
+struct discovery_batch {
+    ast_mutex_t lock;
+    ast_cond_t cond;
+    unsigned int running; /*!< number of starts not completed yet */
+};
+
+struct discovery_start {
+    struct discovery_batch* batch;
+    struct pvt* pvt;
+};
+
+static void discovery_start_pvt(struct pvt* pvt)
+{
+    char dev[DEVNAMELEN];
+    const struct timeval begin = ast_tvnow();
+
+    ast_mutex_lock(&pvt->lock);
+    ast_copy_string(dev, PVT_ID(pvt), sizeof(dev));
+    pvt_start(pvt);
+    const int connected = pvt->connected;
+    ast_mutex_unlock(&pvt->lock);
+
+    ast_verb(4, "[%s] %s in %" PRIi64 " ms\n", dev, connected ? "Started" : "Not started", ast_tvdiff_ms(ast_tvnow(), begin));
+}
+
+static int discovery_start_task(void* data)
+{
+    struct discovery_start* const start = data;
+    struct discovery_batch* const batch = start->batch;
+
+    discovery_start_pvt(start->pvt);
+    ast_free(start);
+
+    SCOPED_MUTEX(batch_lock, &batch->lock);
+    batch->running--;
+    ast_cond_signal(&batch->cond);
+    return 0;
+}
+
+#/* start devices on threadpool, no more than parallel at once, pvts are locked one by one */
+
+static void discovery_start_all(public_state_t* state, struct pvt** pvts, unsigned int count)
+{
+    const unsigned int parallel = SCONF_GLOBAL(state, discovery_parallel);
+    const struct timeval begin  = ast_tvnow();
+    struct discovery_batch batch;
+
+    /* concurrent lookups would probe same ports, losers fail to lock them */
+    if (parallel > 1 && count > 1) {
+        const unsigned int probes = pdiscovery_prefetch(state->threadpool);
+        if (probes) {
+            ast_debug(3, "[discovery] Probed %u devices before bring-up\n", probes);
+        }
+    }
+
+    ast_mutex_init(&batch.lock);
+    ast_cond_init(&batch.cond, NULL);
+    batch.running = 0;
+
+    for (unsigned int i = 0; i < count; ++i) {
+        struct discovery_start* const start = parallel > 1 ? ast_malloc(sizeof(*start)) : NULL;
+        if (!start) {
+            discovery_start_pvt(pvts[i]);
+            continue;
+        }
+        start->batch = &batch;
+        start->pvt   = pvts[i];
+
+        ast_mutex_lock(&batch.lock);
+        while (batch.running >= parallel) {
+            ast_cond_wait(&batch.cond, &batch.lock);
+        }
+        batch.running++;
+        ast_mutex_unlock(&batch.lock);
+
+        if (ast_threadpool_push(state->threadpool, discovery_start_task, start)) {
+            discovery_start_task(start);
+        }
+    }
+
+    ast_mutex_lock(&batch.lock);
+    while (batch.running) {
+        ast_cond_wait(&batch.cond, &batch.lock);
+    }
+    ast_mutex_unlock(&batch.lock);
+
+    ast_cond_destroy(&batch.cond);
+    ast_mutex_destroy(&batch.lock);
+
+    ast_verb(3, "[discovery] Bring-up of %u devices took %" PRIi64 " ms\n", count, ast_tvdiff_ms(ast_tvnow(), begin));
+}
+
 static void* do_discovery(void* arg)
 {
     struct public_state* state = (struct public_state*)arg;
+    const int efd              = SCONF_GLOBAL(state, discovery_events) ? pdiscovery_events_open() : -1;
+    const char* const cache    = SCONF_GLOBAL(state, discovery_cache);
+
+    /* ports of devices unchanged since last load are not probed again */
+    if (!ast_strlen_zero(cache)) {
+        pdiscovery_cache_load(cache);
+    }
 
     while (!state->unloading_flag) {
         struct pvt* pvt;
-        /* read lock for avoid deadlock when IMEI/IMSI discovery */
+        struct pvt** starts = NULL;
+        unsigned int count  = 0;
+
+        /* probe all new ports at once instead of one by one in pvt_discovery() */
+        if (efd >= 0 && discovery_pending(state)) {
+            const unsigned int probes = pdiscovery_prefetch(state->threadpool);
+            if (probes) {
+                ast_debug(3, "[discovery] Probed %u devices\n", probes);
+            }
+        }
+
         AST_RWLIST_RDLOCK(&state->devices);
+        AST_RWLIST_TRAVERSE(&state->devices, pvt, entry) {
+            count++;
+        }
+        starts = count ? ast_malloc(count * sizeof(*starts)) : NULL;
+        count  = 0;
+
         AST_RWLIST_TRAVERSE(&state->devices, pvt, entry) {
             SCOPED_MUTEX(pvt_lock, &pvt->lock);
 
             pvt->must_remove = 0;
+            pvt_status_publish(pvt);
 
             if (pvt->restart_time != RESTATE_TIME_NOW) {
                 continue;
@@ -403,7 +709,15 @@ static void* do_discovery(void* arg)
                     /* fall through */
 
                 case DEV_STATE_STARTED:
-                    pvt_start(pvt);
+                    /* devices are removed by this thread only, so pvt remains valid without list lock */
+                    if (pvt->connected) {
+                        break;
+                    }
+                    if (starts) {
+                        starts[count++] = pvt;
+                    } else {
+                        pvt_start(pvt);
+                    }
                     break;
 
                 case DEV_STATE_REMOVED:
@@ -418,6 +732,12 @@ static void* do_discovery(void* arg)
         }
         AST_RWLIST_UNLOCK(&state->devices);
 
+        /* slow opening of ports and sound cards without list lock */
+        if (count) {
+            discovery_start_all(state, starts, count);
+        }
+        ast_free(starts);
+
         /* actual device removal here for avoid long (discovery) time write lock on device list in loop above */
         AST_RWLIST_WRLOCK(&state->devices);
         AST_RWLIST_TRAVERSE_SAFE_BEGIN(&state->devices, pvt, entry)
@@ -433,12 +753,20 @@ static void* do_discovery(void* arg)
         AST_RWLIST_TRAVERSE_SAFE_END;
         AST_RWLIST_UNLOCK(&state->devices);
 
+        /* written only when devices were probed or removed */
+        if (!ast_strlen_zero(cache)) {
+            pdiscovery_cache_save(cache);
+        }
+
         /* Go to sleep (only if we are not unloading) */
         if (!state->unloading_flag) {
-            sleep(SCONF_GLOBAL(state, discovery_interval));
+            discovery_wait(state, efd);
         }
     }
 
+    if (efd >= 0) {
+        close(efd);
+    }
     return NULL;
 }
 
@@ -491,19 +819,49 @@ static void discovery_stop(public_state_t* state)
 
 void pvt_on_create_1st_channel(struct pvt* pvt)
 {
+    soundcard_retune(pvt);
+    if (pvt->uac_engine) {
+        uac_engine_flush(pvt->uac_engine);
+    }
+
     const struct ast_format* const fmt = pvt_get_audio_format(pvt);
-    const size_t silence_buf_size      = 2u * pvt_get_audio_frame_size(PTIME_PLAYBACK, fmt);
+    const unsigned int ptime           = pvt_get_audio_ptime(pvt);
+    const size_t silence_buf_size      = 2u * pvt_get_audio_frame_size(ptime, fmt);
     pvt->silence_buf                   = ast_calloc(1, silence_buf_size + AST_FRIENDLY_OFFSET);
+    pvt->audio_buf_size                = pvt->silence_buf ? silence_buf_size + AST_FRIENDLY_OFFSET : 0u;
 
     if (CONF_SHARED(pvt, multiparty)) {
         if (CONF_UNIQ(pvt, uac) > TRIBOOL_FALSE) {
             ast_log(LOG_ERROR, "[%s] Multiparty mode not supported in UAC mode\n", PVT_ID(pvt));
         } else {
-            const size_t write_buf_size = 5u * pvt_get_audio_frame_size(PTIME_PLAYBACK, fmt);
-            pvt->write_buf              = ast_calloc(1, write_buf_size);
+            const size_t frame_size = pvt_get_audio_frame_size(ptime, fmt);
+            const int compact       = CONF_GLOBAL(memory_profile) == MEMORY_PROFILE_COMPACT;
+
+            /* playout buffer needs room for its maximal depth and frames written meanwhile */
+            const unsigned int depth = CONF_SHARED(pvt, playout_depth) ? MAX(CONF_SHARED(pvt, playout_depth) / ptime, 1u) : 0u;
+            const unsigned int max   = MAX(CONF_SHARED(pvt, playout_max) / ptime, depth);
+            const unsigned int base  = compact ? WRITE_RING_FRAMES_COMPACT : WRITE_RING_FRAMES;
+            const unsigned int ring  = depth ? MAX(max + 2u, base) : base;
+
+            const size_t write_buf_size   = (compact ? MIXB_FRAMES_COMPACT : MIXB_FRAMES) * frame_size;
+            const size_t ring_size        = ring * frame_size;
+            const size_t conf_slot_size   = frame_size;
+            const size_t conf_size        = RB_FRAMES_SLOTS * conf_slot_size;
+            const size_t playout_buf_size = depth ? 2u * frame_size : 0u;
+            pvt->write_buf                = ast_calloc(1, write_buf_size + ring_size + conf_size + playout_buf_size);
+            if (pvt->write_buf) {
+                pvt->audio_buf_size += write_buf_size + ring_size + conf_size + playout_buf_size;
+            }
             mixb_init(&pvt->write_mixb, pvt->write_buf, write_buf_size);
+            rb_spsc_init(&pvt->write_ring, (char*)pvt->write_buf + write_buf_size, ring_size);
+            rb_frames_init(&pvt->conf_ring, (char*)pvt->write_buf + write_buf_size + ring_size, conf_slot_size);
 
-            pvt->a_timer = ast_timer_open();
+            playout_init(&pvt->playout, ptime, depth, max);
+            pvt->playout_buf = depth ? (char*)pvt->write_buf + write_buf_size + ring_size + conf_size : NULL;
+
+            if (!audio_sched_running() || audio_sched_attach(pvt)) {
+                pvt->a_timer = ast_timer_open();
+            }
         }
     }
 }
@@ -512,6 +870,8 @@ void pvt_on_create_1st_channel(struct pvt* pvt)
 
 void pvt_on_remove_last_channel(struct pvt* pvt)
 {
+    audio_sched_detach(pvt);
+
     if (pvt->a_timer) {
         ast_timer_close(pvt->a_timer);
         pvt->a_timer = NULL;
@@ -519,8 +879,28 @@ void pvt_on_remove_last_channel(struct pvt* pvt)
 
     ast_free(pvt->silence_buf);
     ast_free(pvt->write_buf);
-    pvt->silence_buf = NULL;
-    pvt->write_buf   = NULL;
+    pvt->silence_buf    = NULL;
+    pvt->write_buf      = NULL;
+    pvt->playout_buf    = NULL;
+    pvt->audio_buf_size = 0u;
+    rb_frames_init(&pvt->conf_ring, NULL, 0);
+}
+
+void pvt_get_memory(const struct pvt* pvt, struct pvt_memory* mem)
+{
+    const struct cpvt* cpvt;
+
+    mem->pvt      = sizeof(*pvt) + arena_memory(&pvt->scratch);
+    /* receive buffer and response pool live as long as monitor */
+    mem->at_rb    = pvt->respool ? (size_t)PVT_STAT_GET(pvt, at_rb_size) : 0u;
+    mem->respool  = pvt->respool ? at_respool_memory(pvt->respool) : 0u;
+    mem->at_queue = at_queue_memory(pvt);
+    mem->audio    = pvt->audio_buf_size + (pvt->uac_engine ? uac_engine_memory(pvt->uac_engine) : 0u);
+    mem->channels = 0u;
+
+    AST_LIST_TRAVERSE(&pvt->chans, cpvt, entry) {
+        mem->channels += cpvt_memory(cpvt);
+    }
 }
 
 #define SET_BIT(dw_array, bitno)                         \
@@ -672,6 +1052,7 @@ int pvt_taskproc_trylock_and_execute(struct pvt* pvt, void (*task_exe)(struct pv
 
     ast_debug(5, "[%s][%s] Task executing\n", PVT_ID(pvt), S_OR(task_name, "UNKNOWN"));
     task_exe(pvt);
+    pvt_status_publish(pvt);
     ast_debug(6, "[%s][%s] Task executed\n", PVT_ID(pvt), S_OR(task_name, "UNKNOWN"));
     ast_mutex_unlock(&pvt->lock);
     return 0;
@@ -692,6 +1073,7 @@ int pvt_taskproc_lock_and_execute(struct pvt_taskproc_data* ptd, void (*task_exe
 
     ast_debug(5, "[%s][%s] Task executing\n", PVT_ID(ptd->pvt), S_OR(task_name, "UNKNOWN"));
     task_exe(ptd);
+    pvt_status_publish(ptd->pvt);
     ast_debug(6, "[%s][%s] Task executed\n", PVT_ID(ptd->pvt), S_OR(task_name, "UNKNOWN"));
     return 0;
 }
@@ -700,15 +1082,10 @@ int pvt_taskproc_lock_and_execute(struct pvt_taskproc_data* ptd, void (*task_exe
 
 struct pvt* pvt_find_ex(struct public_state* state, const char* name)
 {
-    struct pvt* pvt;
-
     AST_RWLIST_RDLOCK(&state->devices);
-    AST_RWLIST_TRAVERSE(&state->devices, pvt, entry) {
+    struct pvt* const pvt = devindex_find_id(name);
+    if (pvt) {
         ast_mutex_lock(&pvt->lock);
-        if (!strcmp(PVT_ID(pvt), name)) {
-            break;
-        }
-        ast_mutex_unlock(&pvt->lock);
     }
     AST_RWLIST_UNLOCK(&state->devices);
 
@@ -733,6 +1110,80 @@ struct pvt* pvt_find_by_ext(const char* name)
     return pvt;
 }
 
+struct load_candidate {
+    uint64_t load;
+    unsigned int idx;
+};
+
+#/* */
+
+static int load_candidate_cmp(const void* a, const void* b)
+{
+    const struct load_candidate* const ca = a;
+    const struct load_candidate* const cb = b;
+
+    if (ca->load != cb->load) {
+        return (ca->load < cb->load) ? -1 : 1;
+    }
+    /* same load, keep configuration order */
+    return (ca->idx < cb->idx) ? -1 : (ca->idx > cb->idx);
+}
+
+#/* estimate device load from published counters without locking pvt */
+
+static uint64_t pvt_get_load(const struct pvt* pvt, load_metric_t metric, int by_rssi)
+{
+    const uint64_t calls = __atomic_load_n(&pvt->load.calls, __ATOMIC_RELAXED);
+    uint64_t load        = (metric == LOAD_METRIC_DURATION) ? __atomic_load_n(&pvt->load.duration, __ATOMIC_RELAXED)
+                                                            : __atomic_load_n(&pvt->load.out_calls, __ATOMIC_RELAXED);
+
+    if (by_rssi) {
+        /* rssi 0..31, 99 - unknown, weaker signal looks busier */
+        const int32_t rssi = __atomic_load_n(&pvt->load.rssi, __ATOMIC_RELAXED);
+        load               = (load + 1u) * 32u / ((rssi >= 0 && rssi <= 31) ? (unsigned int)rssi + 1u : 1u);
+    }
+
+    /* device with fewer calls in progress always wins */
+    return (calls << 40) | (load & ((UINT64_C(1) << 40) - 1u));
+}
+
+#/* pick device of group with lowest load, devices list locked; return locked! pvt or NULL */
+
+static struct pvt* find_least_loaded(const struct public_state* state, int group, unsigned int opts, const struct ast_channel* requestor, int* exists)
+{
+    struct load_candidate candidates[MAXQUECTELDEVICES];
+    const struct devindex_group* const members = devindex_find_group(group);
+    const load_metric_t metric                 = SCONF_GLOBAL(state, least_loaded);
+    const int by_rssi                          = SCONF_GLOBAL(state, least_loaded_rssi);
+
+    if (!members) {
+        return NULL;
+    }
+
+    const unsigned int count = MIN(members->count, ARRAY_LEN(candidates));
+    for (unsigned int i = 0; i < count; ++i) {
+        candidates[i].load = pvt_get_load(members->members[i], metric, by_rssi);
+        candidates[i].idx  = i;
+    }
+    qsort(candidates, count, sizeof(candidates[0]), load_candidate_cmp);
+
+    /* only devices tried in order of load are locked */
+    for (unsigned int i = 0; i < count; ++i) {
+        struct pvt* const pvt = members->members[candidates[i].idx];
+
+        ast_mutex_lock(&pvt->lock);
+        if (CONF_SHARED(pvt, group) == group) {
+            *exists = 1;
+            if (can_dial(pvt, opts, requestor)) {
+                return pvt;
+            }
+        }
+        ast_mutex_unlock(&pvt->lock);
+    }
+
+    return NULL;
+}
+
 #/* like find_device but for resource spec; return locked! pvt or NULL */
 
 struct pvt* pvt_find_by_resource_ex(struct public_state* state, const char* resource, unsigned int opts, const struct ast_channel* requestor, int* exists)
@@ -753,63 +1204,53 @@ struct pvt* pvt_find_by_resource_ex(struct public_state* state, const char* reso
     if (((resource[0] == 'g') || (resource[0] == 'G')) && ((resource[1] >= '0') && (resource[1] <= '9'))) {
         errno = 0;
         group = (int)strtol(&resource[1], (char**)NULL, 10);
-        if (errno != EINVAL) {
-            AST_RWLIST_TRAVERSE(&state->devices, pvt, entry) {
-                ast_mutex_lock(&pvt->lock);
+        const struct devindex_group* const members = (errno != EINVAL) ? devindex_find_group(group) : NULL;
+        for (i = 0; members && i < members->count; ++i) {
+            pvt = members->members[i];
+            ast_mutex_lock(&pvt->lock);
 
-                if (CONF_SHARED(pvt, group) == group) {
-                    *exists = 1;
-                    if (can_dial(pvt, opts, requestor)) {
-                        found = pvt;
-                        break;
-                    }
+            /* group may be changed by reload until index is updated */
+            if (CONF_SHARED(pvt, group) == group) {
+                *exists = 1;
+                if (can_dial(pvt, opts, requestor)) {
+                    found = pvt;
+                    break;
                 }
-                ast_mutex_unlock(&pvt->lock);
             }
+            ast_mutex_unlock(&pvt->lock);
         }
     } else if (((resource[0] == 'r') || (resource[0] == 'R')) && ((resource[1] >= '0') && (resource[1] <= '9'))) {
         errno = 0;
         group = (int)strtol(&resource[1], (char**)NULL, 10);
-        if (errno != EINVAL) {
-            /* Generate a list of all available devices */
-            j         = ARRAY_LEN(round_robin);
-            c         = 0;
-            last_used = 0;
-            AST_RWLIST_TRAVERSE(&state->devices, pvt, entry) {
-                SCOPED_MUTEX(pvt_lock, &pvt->lock);
-                if (CONF_SHARED(pvt, group) == group) {
-                    round_robin[c] = pvt;
-                    if (pvt->group_last_used == 1) {
-                        pvt->group_last_used = 0;
-                        last_used            = c;
-                    }
-
-                    ++c;
-
-                    if (c == j) {
-                        break;
-                    }
-                }
-            }
-
-            /* Search for a available device starting at the last used device */
+        struct devindex_group* const members = (errno != EINVAL) ? devindex_find_group(group) : NULL;
+        if (members) {
+            /* Search for a available device starting at the last used device, cursor is shared by concurrent dials */
+            c         = members->count;
+            last_used = __atomic_load_n(&members->last_used, __ATOMIC_RELAXED);
             for (i = 0, j = last_used + 1; i < c; i++, j++) {
-                if (j == c) {
+                if (j >= c) {
                     j = 0;
                 }
 
-                pvt     = round_robin[j];
-                *exists = 1;
-
+                pvt = members->members[j];
                 ast_mutex_lock(&pvt->lock);
-                if (can_dial(pvt, opts, requestor)) {
-                    pvt->group_last_used = 1;
-                    found                = pvt;
-                    break;
+                if (CONF_SHARED(pvt, group) == group) {
+                    *exists = 1;
+                    if (can_dial(pvt, opts, requestor)) {
+                        __atomic_store_n(&members->last_used, (unsigned int)j, __ATOMIC_RELAXED);
+                        found = pvt;
+                        break;
+                    }
                 }
                 ast_mutex_unlock(&pvt->lock);
             }
         }
+    } else if (((resource[0] == 'l') || (resource[0] == 'L')) && ((resource[1] >= '0') && (resource[1] <= '9'))) {
+        errno = 0;
+        group = (int)strtol(&resource[1], (char**)NULL, 10);
+        if (errno != EINVAL) {
+            found = find_least_loaded(state, group, opts, requestor, exists);
+        }
     } else if (((resource[0] == 'p') || (resource[0] == 'P')) && resource[1] == ':') {
         /* Generate a list of all available devices */
         j         = ARRAY_LEN(round_robin);
@@ -849,6 +1290,21 @@ struct pvt* pvt_find_by_resource_ex(struct public_state* state, const char* reso
             }
             ast_mutex_unlock(&pvt->lock);
         }
+    } else if (((resource[0] == 's') || (resource[0] == 'S')) && resource[1] == ':' && strlen(&resource[2]) == IMSI_SIZE) {
+        /* complete IMSI */
+        pvt = devindex_find_imsi(&resource[2]);
+        if (pvt) {
+            ast_mutex_lock(&pvt->lock);
+            if (!strcmp(pvt->imsi, &resource[2])) {
+                *exists = 1;
+                if (can_dial(pvt, opts, requestor)) {
+                    found = pvt;
+                }
+            }
+            if (!found) {
+                ast_mutex_unlock(&pvt->lock);
+            }
+        }
     } else if (((resource[0] == 's') || (resource[0] == 'S')) && resource[1] == ':') {
         /* Generate a list of all available devices */
         j         = ARRAY_LEN(round_robin);
@@ -891,16 +1347,18 @@ struct pvt* pvt_find_by_resource_ex(struct public_state* state, const char* reso
             ast_mutex_unlock(&pvt->lock);
         }
     } else if (((resource[0] == 'i') || (resource[0] == 'I')) && resource[1] == ':') {
-        AST_RWLIST_TRAVERSE(&state->devices, pvt, entry) {
+        pvt = devindex_find_imei(&resource[2]);
+        if (pvt) {
             ast_mutex_lock(&pvt->lock);
             if (!strcmp(pvt->imei, &resource[2])) {
                 *exists = 1;
                 if (can_dial(pvt, opts, requestor)) {
                     found = pvt;
-                    break;
                 }
             }
-            ast_mutex_unlock(&pvt->lock);
+            if (!found) {
+                ast_mutex_unlock(&pvt->lock);
+            }
         }
     } else if (((resource[0] == 'j') || (resource[0] == 'J')) && resource[1] == ':') {
         AST_RWLIST_TRAVERSE(&state->devices, pvt, entry) {
@@ -915,16 +1373,15 @@ struct pvt* pvt_find_by_resource_ex(struct public_state* state, const char* reso
             ast_mutex_unlock(&pvt->lock);
         }
     } else {
-        AST_RWLIST_TRAVERSE(&state->devices, pvt, entry) {
+        pvt = devindex_find_id(resource);
+        if (pvt) {
+            *exists = 1;
             ast_mutex_lock(&pvt->lock);
-            if (!strcmp(PVT_ID(pvt), resource)) {
-                *exists = 1;
-                if (can_dial(pvt, opts, requestor)) {
-                    found = pvt;
-                    break;
-                }
+            if (can_dial(pvt, opts, requestor)) {
+                found = pvt;
+            } else {
+                ast_mutex_unlock(&pvt->lock);
             }
-            ast_mutex_unlock(&pvt->lock);
         }
     }
 
@@ -936,6 +1393,10 @@ struct cpvt* pvt_channel_find_by_call_idx(struct pvt* pvt, int call_idx)
 {
     struct cpvt* cpvt;
 
+    if (call_idx >= MIN_CALL_IDX && call_idx <= MAX_CALL_IDX) {
+        return pvt->call_idx_map[call_idx];
+    }
+
     AST_LIST_TRAVERSE(&pvt->chans, cpvt, entry) {
         if (call_idx == cpvt->call_idx) {
             return cpvt;
@@ -945,6 +1406,24 @@ struct cpvt* pvt_channel_find_by_call_idx(struct pvt* pvt, int call_idx)
     return 0;
 }
 
+/* called when channel of call index is added, removed or renumbered */
+void pvt_channel_index_update(struct pvt* pvt, int call_idx)
+{
+    struct cpvt* cpvt;
+
+    if (call_idx < MIN_CALL_IDX || call_idx > MAX_CALL_IDX) {
+        return;
+    }
+
+    pvt->call_idx_map[call_idx] = NULL;
+    AST_LIST_TRAVERSE(&pvt->chans, cpvt, entry) {
+        if (call_idx == cpvt->call_idx) {
+            pvt->call_idx_map[call_idx] = cpvt;
+            break;
+        }
+    }
+}
+
 struct cpvt* pvt_channel_find_active(struct pvt* pvt)
 {
     struct cpvt* cpvt;
@@ -1026,51 +1505,55 @@ struct ast_str* pvt_str_state_ex(const struct pvt* pvt)
 {
     static const size_t DEF_STATE_LEN = 64;
 
-    struct ast_str* buf     = ast_str_create(DEF_STATE_LEN);
+    struct ast_str* buf = ast_str_create(DEF_STATE_LEN);
+    pvt_append_state_ex(pvt, &buf);
+    return buf;
+}
+
+void pvt_append_state_ex(const struct pvt* pvt, struct ast_str** buf)
+{
     const char* const state = pvt_state_base(pvt);
 
     if (state) {
-        ast_str_append(&buf, 0, "%s", state);
+        ast_str_append(buf, 0, "%s", state);
     } else {
         if (pvt->ring || PVT_STATE(pvt, chan_count[CALL_STATE_INCOMING])) {
-            ast_str_append(&buf, 0, "Ring");
+            ast_str_append(buf, 0, "Ring");
         }
 
         if (pvt->dialing || (PVT_STATE(pvt, chan_count[CALL_STATE_INIT]) + PVT_STATE(pvt, chan_count[CALL_STATE_DIALING]) +
                              PVT_STATE(pvt, chan_count[CALL_STATE_ALERTING])) > 0) {
-            ast_str_append(&buf, 0, "Dialing");
+            ast_str_append(buf, 0, "Dialing");
         }
 
         if (pvt->cwaiting || PVT_STATE(pvt, chan_count[CALL_STATE_WAITING])) {
-            ast_str_append(&buf, 0, "Waiting");
+            ast_str_append(buf, 0, "Waiting");
         }
 
         if (PVT_STATE(pvt, chan_count[CALL_STATE_ACTIVE]) > 0) {
-            ast_str_append(&buf, 0, "Active %u", PVT_STATE(pvt, chan_count[CALL_STATE_ACTIVE]));
+            ast_str_append(buf, 0, "Active %u", PVT_STATE(pvt, chan_count[CALL_STATE_ACTIVE]));
         }
 
         if (PVT_STATE(pvt, chan_count[CALL_STATE_ONHOLD]) > 0) {
-            ast_str_append(&buf, 0, "Held %u", PVT_STATE(pvt, chan_count[CALL_STATE_ONHOLD]));
+            ast_str_append(buf, 0, "Held %u", PVT_STATE(pvt, chan_count[CALL_STATE_ONHOLD]));
         }
 
         if (pvt->incoming_sms_index >= 0) {
-            ast_str_append(&buf, 0, "Incoming SMS");
+            ast_str_append(buf, 0, "Incoming SMS");
         }
 
         if (pvt->outgoing_sms) {
-            ast_str_append(&buf, 0, "Outgoing SMS");
+            ast_str_append(buf, 0, "Outgoing SMS");
         }
 
-        if (!ast_str_strlen(buf)) {
-            ast_str_append(&buf, 0, "Free");
+        if (!ast_str_strlen(*buf)) {
+            ast_str_append(buf, 0, "Free");
         }
     }
 
     if (pvt->desired_state != pvt->current_state) {
-        ast_str_append(&buf, 0, " %s", dev_state2str_msg(pvt->desired_state));
+        ast_str_append(buf, 0, " %s", dev_state2str_msg(pvt->desired_state));
     }
-
-    return buf;
 }
 
 const char* pvt_str_call_dir(const struct pvt* pvt)
@@ -1091,43 +1574,168 @@ const char* pvt_str_call_dir(const struct pvt* pvt)
     return dirs[index];
 }
 
-#define SET_PVT_STRING_FIELD(j, f) \
-    if (!ast_strlen_zero(pvt->f)) ast_json_object_set(j, #f, ast_json_string_create(pvt->f))
+void pvt_get_status(struct pvt* const pvt, struct ast_json* status)
+{
+    RAII_VAR(struct pvt_status*, snapshot, pvt_status_get(pvt), ao2_cleanup);
+
+    if (!snapshot) {
+        ast_json_object_set(status, "name", ast_json_string_create(PVT_ID(pvt)));
+        return;
+    }
+
+    pvt_status_json(PVT_ID(pvt), snapshot, status);
+}
+
+#/* copy statistics without pvt lock, every counter is read atomically */
 
-static void set_state_str(const struct pvt* const pvt, struct ast_json* status)
+void pvt_get_stat(const struct pvt* const pvt, pvt_stat_t* stat)
 {
-    RAII_VAR(struct ast_str*, state_str, pvt_str_state_ex(pvt), ast_free);
-    ast_json_object_set(status, "state", ast_json_string_create(ast_str_buffer(state_str)));
+    const uint64_t* const src = (const uint64_t*)&pvt->stat;
+    uint64_t* const dst       = (uint64_t*)stat;
+
+    for (size_t i = 0; i < sizeof(*stat) / sizeof(uint64_t); ++i) {
+        dst[i] = __atomic_load_n(&src[i], __ATOMIC_RELAXED);
+    }
 }
 
-void pvt_get_status(const struct pvt* const pvt, struct ast_json* status)
+#/* device may be locked by other thread, only devices list is locked */
+
+int pvt_get_stat_by_id(const char* name, pvt_stat_t* stat)
+{
+    AST_RWLIST_RDLOCK(&gpublic->devices);
+    const struct pvt* const pvt = devindex_find_id(name);
+    if (pvt) {
+        pvt_get_stat(pvt, stat);
+    }
+    AST_RWLIST_UNLOCK(&gpublic->devices);
+
+    return pvt ? 0 : -1;
+}
+
+#/* histograms are read without pvt lock, only devices list is locked */
+
+struct latency_snapshot* pvt_get_latency_by_id(const char* name)
 {
-    ast_json_object_set(status, "name", ast_json_string_create(PVT_ID(pvt)));
-    set_state_str(pvt, status);
-    ast_json_object_set(status, "gsm", ast_json_string_create(gsm_regstate2str_json(pvt->gsm_reg_status)));
+    struct latency_snapshot* const snapshot = ast_calloc(1, sizeof(*snapshot));
+    if (!snapshot) {
+        return NULL;
+    }
 
-    SET_PVT_STRING_FIELD(status, subscriber_number);
-    SET_PVT_STRING_FIELD(status, network_name);
-    SET_PVT_STRING_FIELD(status, short_network_name);
-    SET_PVT_STRING_FIELD(status, provider_name);
-    SET_PVT_STRING_FIELD(status, imei);
-    SET_PVT_STRING_FIELD(status, imsi);
-    SET_PVT_STRING_FIELD(status, iccid);
-    SET_PVT_STRING_FIELD(status, location_area_code);
-    SET_PVT_STRING_FIELD(status, cell_id);
-    SET_PVT_STRING_FIELD(status, band);
+    AST_RWLIST_RDLOCK(&gpublic->devices);
+    const struct pvt* const pvt = devindex_find_id(name);
+    if (pvt) {
+        snapshot->adaptive    = CONF_SHARED(pvt, at_timeout_adaptive);
+        snapshot->timeout_min = CONF_SHARED(pvt, at_timeout_min);
+        snapshot->timeout_max = CONF_SHARED(pvt, at_timeout_max);
+        hist_snapshot(&pvt->latency.tps_delay, &snapshot->tps_delay);
+        hist_snapshot(&pvt->latency.audio_interval, &snapshot->audio_interval);
+        for (unsigned int i = 0; i < ARRAY_LEN(pvt->latency.call_stage); ++i) {
+            hist_snapshot(&pvt->latency.call_stage[i], &snapshot->call_stage[i]);
+        }
+        for (unsigned int i = 0; i < ARRAY_LEN(pvt->latency.call_setup); ++i) {
+            hist_snapshot(&pvt->latency.call_setup[i], &snapshot->call_setup[i]);
+        }
+        for (unsigned int i = 0; i < ARRAY_LEN(pvt->latency.at_rtt); ++i) {
+            const struct histogram* const rtt = __atomic_load_n(&pvt->latency.at_rtt[i], __ATOMIC_ACQUIRE);
+            if (rtt) {
+                snapshot->at[snapshot->at_count].cmd     = (at_cmd_t)i;
+                snapshot->at[snapshot->at_count].srtt    = __atomic_load_n(&pvt->latency.at_srtt[i], __ATOMIC_RELAXED);
+                snapshot->at[snapshot->at_count].rttvar  = __atomic_load_n(&pvt->latency.at_rttvar[i], __ATOMIC_RELAXED);
+                snapshot->at[snapshot->at_count].timeout = __atomic_load_n(&pvt->latency.at_timeout[i], __ATOMIC_RELAXED);
+                hist_snapshot(rtt, &snapshot->at[snapshot->at_count].rtt);
+                snapshot->at_count++;
+            }
+        }
+    }
+    AST_RWLIST_UNLOCK(&gpublic->devices);
+
+    if (!pvt) {
+        ast_free(snapshot);
+        return NULL;
+    }
+    return snapshot;
+}
 
-    if (pvt->operator) {
-        struct ast_json* const plmn = ast_json_object_create();
-        ast_json_object_set(plmn, "value", ast_json_integer_create(pvt->operator));
-        ast_json_object_set(plmn, "mcc", ast_json_integer_create(pvt->operator/ 100));
-        ast_json_object_set(plmn, "mnc", ast_json_stringf("%02d", pvt->operator% 100));
-        ast_json_object_set(status, "plmn", plmn);
+#define STAT_COUNTER(name, field, help) {name, offsetof(pvt_stat_t, field), 0, help}
+#define STAT_GAUGE(name, field, help) {name, offsetof(pvt_stat_t, field), 1, help}
+
+const struct pvt_stat_field pvt_stat_fields[] = {
+    STAT_COUNTER("at_tasks", at_tasks, "Tasks added to AT queue"),
+    STAT_COUNTER("at_cmds", at_cmds, "Commands added to AT queue"),
+    STAT_COUNTER("at_pipelined", at_pipelined, "Commands written before response to previous one"),
+    STAT_COUNTER("at_responses", at_responses, "Responses handled"),
+    STAT_COUNTER("at_respool_hits", at_respool_hits, "Response buffers reused from pool"),
+    STAT_COUNTER("at_respool_misses", at_respool_misses, "Response buffers allocated"),
+    STAT_COUNTER("at_taskpool_hits", at_taskpool_hits, "AT queue tasks reused from pool"),
+    STAT_COUNTER("at_taskpool_misses", at_taskpool_misses, "AT queue tasks allocated"),
+    STAT_COUNTER("at_preempted", at_preempted, "AT queue tasks preempted by more urgent class"),
+    STAT_COUNTER("polls", polls, "Periodic polls sent"),
+    STAT_COUNTER("polls_skipped", polls_skipped, "Periodic polls made redundant by unsolicited updates"),
+    STAT_GAUGE("at_scratch_high_water", at_scratch_high_water, "Maximum bytes of scratch arena used by one response"),
+    STAT_COUNTER("at_scratch_spills", at_scratch_spills, "Scratch allocations not fitted in arena block"),
+    STAT_GAUGE("at_rb_size", at_rb_size, "Size of AT receive buffer"),
+    STAT_GAUGE("at_rb_high_water", at_rb_high_water, "Maximum bytes waiting in AT receive buffer"),
+    STAT_COUNTER("at_rb_grows", at_rb_grows, "AT receive buffer reallocations"),
+    STAT_COUNTER("at_rb_overflows", at_rb_overflows, "Unterminated responses dropped from full AT receive buffer"),
+    STAT_GAUGE("tps_depth", tps_depth, "Responses waiting in taskprocessor"),
+    STAT_GAUGE("tps_high_water", tps_high_water, "Maximum responses waiting in taskprocessor"),
+    STAT_COUNTER("read_pauses", read_pauses, "Reading paused by saturated taskprocessor"),
+    STAT_COUNTER("d_read_bytes", d_read_bytes, "Bytes of responses read from device"),
+    STAT_COUNTER("d_write_bytes", d_write_bytes, "Bytes of commands written to device"),
+    STAT_COUNTER("a_read_bytes", a_read_bytes, "Bytes of audio read from device"),
+    STAT_COUNTER("a_write_bytes", a_write_bytes, "Bytes of audio written to device"),
+    STAT_COUNTER("read_frames", read_frames, "Audio frames read from device"),
+    STAT_COUNTER("read_sframes", read_sframes, "Truncated audio frames read from device"),
+    STAT_COUNTER("write_frames", write_frames, "Audio frames written to device"),
+    STAT_COUNTER("write_tframes", write_tframes, "Truncated audio frames written"),
+    STAT_COUNTER("write_sframes", write_sframes, "Silence frames written"),
+    STAT_COUNTER("write_rb_overflow_bytes", write_rb_overflow_bytes, "Bytes of audio lost by write buffer overflow"),
+    STAT_COUNTER("write_rb_overflow", write_rb_overflow, "Write buffer overflows"),
+    STAT_COUNTER("write_ring_underrun", write_ring_underrun, "Audio timer ticks without complete mixed frame"),
+    STAT_COUNTER("write_ring_overrun", write_ring_overrun, "Mixed frames dropped because write ring was full"),
+    STAT_COUNTER("write_plc_frames", write_plc_frames, "Audio frames concealed by repetition of last frame"),
+    STAT_COUNTER("playout_drops", playout_drops, "Mixed frames dropped to shrink playout buffer"),
+    STAT_COUNTER("playout_grows", playout_grows, "Increases of playout buffer depth"),
+    STAT_COUNTER("playout_shrinks", playout_shrinks, "Decreases of playout buffer depth"),
+    STAT_COUNTER("write_syscalls", write_syscalls, "Audio write system calls"),
+    STAT_COUNTER("write_short", write_short, "Audio writes completed partially"),
+    STAT_COUNTER("write_batched", write_batched, "Audio writes submitted in batch with other devices"),
+    STAT_COUNTER("uac_xruns", uac_xruns, "ALSA overruns and underruns"),
+    STAT_COUNTER("uac_prepares", uac_prepares, "ALSA streams prepared after overrun, underrun or setup"),
+    STAT_COUNTER("uac_ring_drops", uac_ring_drops, "Audio frames dropped between channel and UAC audio thread"),
+    STAT_COUNTER("in_calls", in_calls, "Incoming calls not including waiting"),
+    STAT_COUNTER("cw_calls", cw_calls, "Waiting calls"),
+    STAT_COUNTER("out_calls", out_calls, "Outgoing calls attempts"),
+    STAT_COUNTER("in_calls_handled", in_calls_handled, "Incoming and waiting calls passed to dialplan"),
+    STAT_COUNTER("in_pbx_fails", in_pbx_fails, "Failures to start PBX for incoming calls"),
+    STAT_COUNTER("out_calls_answered", calls_answered[CALL_DIR_OUTGOING], "Answered outgoing calls"),
+    STAT_COUNTER("in_calls_answered", calls_answered[CALL_DIR_INCOMING], "Answered incoming and waiting calls"),
+    STAT_COUNTER("out_calls_duration", calls_duration[CALL_DIR_OUTGOING], "Seconds of outgoing calls"),
+    STAT_COUNTER("in_calls_duration", calls_duration[CALL_DIR_INCOMING], "Seconds of incoming and waiting calls"),
+};
+
+const size_t pvt_stat_fields_count = ARRAY_LEN(pvt_stat_fields);
+
+#undef STAT_GAUGE
+#undef STAT_COUNTER
+
+void pvt_get_stat_json(const pvt_stat_t* const stat, struct ast_json* json)
+{
+    for (size_t i = 0; i < pvt_stat_fields_count; ++i) {
+        ast_json_object_set(json, pvt_stat_fields[i].name, ast_json_integer_create((intmax_t)pvt_stat_value(stat, &pvt_stat_fields[i])));
     }
 }
 
 /* Module */
 
+#/* publish size limit of AT receive buffer for monitor */
+
+static void pvt_set_at_rb_max(struct pvt* pvt)
+{
+    const size_t rb_max = MAX(CONF_SHARED(pvt, at_buffer), CONF_SHARED(pvt, at_buffer_max));
+    __atomic_store_n(&pvt->at_rb_max, rb_max, __ATOMIC_RELAXED);
+}
+
 static struct pvt* pvt_create(const pvt_config_t* settings)
 {
     struct pvt* const pvt = ast_calloc(1, sizeof(*pvt) + 1u);
@@ -1138,18 +1746,22 @@ static struct pvt* pvt_create(const pvt_config_t* settings)
     }
 
     ast_mutex_init(&pvt->lock);
+    ast_mutex_init(&pvt->status_lock);
+    arena_init(&pvt->scratch, CONF_GLOBAL(memory_profile) == MEMORY_PROFILE_COMPACT ? SCRATCH_ARENA_SIZE_COMPACT : SCRATCH_ARENA_SIZE);
 
     AST_LIST_HEAD_INIT_NOLOCK(&pvt->at_queue);
     AST_LIST_HEAD_INIT_NOLOCK(&pvt->chans);
 
-    pvt->monitor_thread     = AST_PTHREADT_NULL;
-    pvt->sys_chan.pvt       = pvt;
-    pvt->sys_chan.state     = CALL_STATE_RELEASED;
-    pvt->audio_fd           = -1;
-    pvt->data_fd            = -1;
-    pvt->gsm_reg_status     = -1;
-    pvt->incoming_sms_index = -1;
-    pvt->desired_state      = SCONFIG(settings, initstate);
+    pvt->monitor_thread      = AST_PTHREADT_NULL;
+    pvt->sys_chan.pvt        = pvt;
+    pvt->sys_chan.state      = CALL_STATE_RELEASED;
+    pvt->audio_fd            = -1;
+    pvt->data_fd             = -1;
+    pvt->gsm_reg_status      = -1;
+    pvt->load.gsm_reg_status = -1;
+    pvt->incoming_sms_index  = -1;
+    pvt->clir                = -1;
+    pvt->desired_state       = SCONFIG(settings, initstate);
 
     ast_string_field_init(pvt, 15);
     ast_string_field_set(pvt, provider_name, "NONE");
@@ -1157,9 +1769,12 @@ static struct pvt* pvt_create(const pvt_config_t* settings)
 
     /* and copy settings */
     memcpy(&pvt->settings, settings, sizeof(pvt->settings));
+    pvt_set_at_rb_max(pvt);
 
     pvt->empty_str.__AST_STR_LEN = 1;
     pvt->empty_str.__AST_STR_TS  = DS_STATIC;
+
+    pvt_status_publish(pvt);
     return pvt;
 }
 
@@ -1185,6 +1800,47 @@ void pvt_try_restate(struct pvt* pvt)
     }
 }
 
+#/* send changed settings to running device, assume caller hold lock */
+
+static void pvt_config_apply(struct pvt* pvt, unsigned int changes)
+{
+    if (changes & CONFIG_CHANGE_AT_BUFFER) {
+        pvt_set_at_rb_max(pvt);
+    }
+
+    /* initialization sends current settings anyway */
+    if (!pvt->initialized) {
+        return;
+    }
+
+    if ((changes & CONFIG_CHANGE_GAINS) && pvt->has_voice) {
+        const int txgain = CONF_SHARED(pvt, txgain);
+        const int rxgain = CONF_SHARED(pvt, rxgain);
+        if (pvt->is_simcom ? at_enqueue_cgains(&pvt->sys_chan, txgain, rxgain) : at_enqueue_qgains(&pvt->sys_chan, txgain, rxgain)) {
+            ast_log(LOG_WARNING, "[%s] Unable to apply gains: %s\n", PVT_ID(pvt), error2str(chan_quectel_err));
+        }
+    }
+
+    /* otherwise it is sent on registration */
+    if ((changes & CONFIG_CHANGE_CALLWAITING) && pvt->gsm_registered) {
+        if (at_enqueue_set_ccwa(&pvt->sys_chan, CONF_SHARED(pvt, callwaiting))) {
+            ast_log(LOG_WARNING, "[%s] Unable to apply call waiting: %s\n", PVT_ID(pvt), error2str(chan_quectel_err));
+        }
+    }
+
+    if (changes & CONFIG_CHANGE_DTMF) {
+        if (at_enqueue_tonedet(&pvt->sys_chan, CONF_SHARED(pvt, dtmf))) {
+            ast_log(LOG_WARNING, "[%s] Unable to apply tone detection: %s\n", PVT_ID(pvt), error2str(chan_quectel_err));
+        }
+    }
+
+    if ((changes & CONFIG_CHANGE_MSG_DIRECT) && CONF_SHARED(pvt, msg_direct) && pvt->has_sms) {
+        if (at_enqueue_msg_direct(&pvt->sys_chan, CONF_SHARED(pvt, msg_direct) > 0)) {
+            ast_log(LOG_WARNING, "[%s] Unable to apply SMS indication mode: %s\n", PVT_ID(pvt), error2str(chan_quectel_err));
+        }
+    }
+}
+
 #/* assume caller hold lock */
 
 static int pvt_reconfigure(struct pvt* pvt, const pvt_config_t* settings, restate_time_t when)
@@ -1195,6 +1851,8 @@ static int pvt_reconfigure(struct pvt* pvt, const pvt_config_t* settings, restat
         /* handle later, in one place */
         pvt->must_remove = 1;
     } else {
+        const unsigned int changes = dc_config_diff(&pvt->settings, settings);
+
         /* check what changes require starting or stopping */
         if (pvt->desired_state != SCONFIG(settings, initstate)) {
             pvt->desired_state = SCONFIG(settings, initstate);
@@ -1204,10 +1862,7 @@ static int pvt_reconfigure(struct pvt* pvt, const pvt_config_t* settings, restat
         }
 
         /* check what config changes require restaring */
-        else if (strcmp(UCONFIG(settings, audio_tty), CONF_UNIQ(pvt, audio_tty)) || strcmp(UCONFIG(settings, data_tty), CONF_UNIQ(pvt, data_tty)) ||
-                 strcmp(UCONFIG(settings, imei), CONF_UNIQ(pvt, imei)) || strcmp(UCONFIG(settings, imsi), CONF_UNIQ(pvt, imsi)) ||
-                 SCONFIG(settings, resetquectel) != CONF_SHARED(pvt, resetquectel) || SCONFIG(settings, callwaiting) != CONF_SHARED(pvt, callwaiting)) {
-            /* TODO: schedule restart */
+        else if (changes & CONFIG_CHANGE_RESTART) {
             pvt->desired_state = DEV_STATE_RESTARTED;
 
             rv                = pvt_time4restate(pvt);
@@ -1216,7 +1871,14 @@ static int pvt_reconfigure(struct pvt* pvt, const pvt_config_t* settings, restat
 
         /* and copy settings */
         memcpy(&pvt->settings, settings, sizeof(pvt->settings));
+
+        /* device initialized again gets all settings anyway */
+        if (changes && !(changes & CONFIG_CHANGE_RESTART) && pvt->desired_state == pvt->current_state) {
+            ast_debug(1, "[%s] Apply changed settings: 0x%x\n", PVT_ID(pvt), changes);
+            pvt_config_apply(pvt, changes);
+        }
     }
+    pvt_status_publish(pvt);
     return rv;
 }
 
@@ -1228,6 +1890,7 @@ int pvt_set_act(struct pvt* pvt, int act)
 
     pvt->act  = act;
     pvt->rssi = 0;
+    pvt_load_update(pvt);
     ast_string_field_set(pvt, band, NULL);
     return act;
 }
@@ -1267,6 +1930,7 @@ static void mark_remove(public_state_t* const state, const restate_time_t when,
         } else {
             pvt->restart_time = when;
         }
+        pvt_status_publish(pvt);
     }
     AST_RWLIST_UNLOCK(&state->devices);
 }
@@ -1326,6 +1990,7 @@ static int reload_config(public_state_t* state, int recofigure, restate_time_t w
             /* FIXME: deadlock avoid ? */
             AST_RWLIST_WRLOCK(&state->devices);
             AST_RWLIST_INSERT_TAIL(&state->devices, new_pvt, entry);
+            devindex_add(new_pvt);
             AST_RWLIST_UNLOCK(&state->devices);
             reload_now++;
 
@@ -1335,6 +2000,13 @@ static int reload_config(public_state_t* state, int recofigure, restate_time_t w
 
     mark_remove(state, when, &reload_now);
 
+    /* group membership may be changed by new or updated devices */
+    AST_RWLIST_WRLOCK(&state->devices);
+    if (devindex_groups_update()) {
+        ast_log(LOG_ERROR, "Unable to update device groups index\n");
+    }
+    AST_RWLIST_UNLOCK(&state->devices);
+
     if (reload_immediality) {
         *reload_immediality = reload_now;
     }
@@ -1388,6 +2060,8 @@ static attribute_const size_t pvt_get_audio_frame_size_r(unsigned int ptime, con
 
 #if PTIME_USE_DEFAULT
 
+unsigned int pvt_get_audio_ptime(const struct pvt* const pvt) { return ast_format_get_default_ms(pvt_get_audio_format(pvt)); }
+
 size_t pvt_get_audio_frame_size(unsigned int attribute_unused(ptime), const struct ast_format* const fmt)
 {
     const unsigned int sr      = ast_format_get_sample_rate(fmt);
@@ -1397,6 +2071,8 @@ size_t pvt_get_audio_frame_size(unsigned int attribute_unused(ptime), const stru
 
 #else
 
+unsigned int pvt_get_audio_ptime(const struct pvt* const pvt) { return CONF_UNIQ(pvt, ptime); }
+
 size_t pvt_get_audio_frame_size(unsigned int ptime, const struct ast_format* const fmt)
 {
     const unsigned int sr = ast_format_get_sample_rate(fmt);
@@ -1412,7 +2088,7 @@ int pvt_direct_write(struct pvt* pvt, const char* buf, size_t count)
     ast_debug(5, "[%s] [%s]\n", PVT_ID(pvt), tmp_esc_nstr(buf, count));
 
     const size_t wrote            = fd_write_all(pvt->data_fd, buf, count);
-    PVT_STAT(pvt, d_write_bytes) += wrote;
+    PVT_STAT_ADD(pvt, d_write_bytes, wrote);
     if (wrote != count) {
         ast_debug(1, "[%s][DATA] Write: %s\n", PVT_ID(pvt), strerror(errno));
     }
@@ -1420,16 +2096,25 @@ int pvt_direct_write(struct pvt* pvt, const char* buf, size_t count)
     return wrote != count;
 }
 
-static struct ast_threadpool* threadpool_create()
+static struct ast_threadpool* threadpool_create(const struct public_state* state)
 {
-    static const struct ast_threadpool_options options = {
-        .version = AST_THREADPOOL_OPTIONS_VERSION, .idle_timeout = 300, .auto_increment = 1, .initial_size = 0, .max_size = 0};
+    const struct ast_threadpool_options options = {
+        .version        = AST_THREADPOOL_OPTIONS_VERSION,
+        .idle_timeout   = (int)SCONF_GLOBAL(state, threadpool_idle_timeout),
+        .auto_increment = 1,
+        .initial_size   = (int)SCONF_GLOBAL(state, threadpool_size),
+        .max_size       = (int)SCONF_GLOBAL(state, threadpool_max_size),
+    };
 
     return ast_threadpool_create("chan-quectel", NULL, &options);
 }
 
 static int load_module()
 {
+    if (at_responses_init()) {
+        return AST_MODULE_LOAD_DECLINE;
+    }
+
     gpublic = ast_calloc(1, sizeof(*gpublic));
 
     if (!gpublic) {
@@ -1437,13 +2122,16 @@ static int load_module()
         return AST_MODULE_LOAD_DECLINE;
     }
 
+    /* discovery thread started by public_state_init() uses cache */
+    pdiscovery_init();
+
     const int rv = public_state_init(gpublic);
     if (rv != AST_MODULE_LOAD_SUCCESS) {
+        pdiscovery_fini();
         ast_free(gpublic);
         gpublic = NULL;
     }
 
-    pdiscovery_init();
     return rv;
 }
 
@@ -1472,19 +2160,23 @@ static int public_state_init(struct public_state* state)
 {
     int rv = AST_MODULE_LOAD_DECLINE;
 
-    state->threadpool = threadpool_create();
-    if (!state->threadpool) {
-        return rv;
-    }
-
     AST_RWLIST_HEAD_INIT(&state->devices);
+    devindex_init();
     SCOPED_LOCK(state_discovery_lock, &state->discovery_lock, ast_mutex_init, ast_mutex_destroy);
 
     state->discovery_thread = AST_PTHREADT_NULL;
 
     if (!reload_config(state, 0, RESTATE_TIME_NOW, NULL)) {
         rv = AST_MODULE_LOAD_FAILURE;
-        if (!discovery_restart(state)) {
+        if (SCONF_GLOBAL(state, reactor) && monitor_reactor_init(SCONF_GLOBAL(state, reactor_threads))) {
+            ast_log(LOG_WARNING, "Reactor not available, using monitor thread per device\n");
+        }
+        if (SCONF_GLOBAL(state, audio_sched) && audio_sched_init(SCONF_GLOBAL(state, audio_uring))) {
+            ast_log(LOG_WARNING, "Audio scheduler not available, using audio timer per device\n");
+        }
+        /* sized by [general] section */
+        state->threadpool = threadpool_create(state);
+        if (state->threadpool && !discovery_restart(state)) {
             /* set preferred capabilities */
             if (!(channel_tech.capabilities = ast_format_cap_alloc(AST_FORMAT_CAP_FLAG_DEFAULT))) {
                 return AST_MODULE_LOAD_FAILURE;
@@ -1501,22 +2193,47 @@ static int public_state_init(struct public_state* state)
                 ast_log(LOG_ERROR, "Unable to register channel class %s\n", channel_tech.type);
             } else {
                 smsdb_init();
+                if (notifyq_init()) {
+                    ast_log(LOG_WARNING, "Unable to start notification thread\n");
+                }
+                if (smsexpiry_init()) {
+                    ast_log(LOG_WARNING, "Unable to start SMS expiry thread\n");
+                }
+                if (smsbulk_init()) {
+                    ast_log(LOG_WARNING, "Unable to start bulk SMS engine\n");
+                }
+                if (poller_init()) {
+                    ast_log(LOG_WARNING, "Unable to start poll scheduler\n");
+                }
 #ifdef BUILD_APPLICATIONS
                 app_register();
 #endif
                 cli_register();
+                if (manager_register()) {
+                    ast_log(LOG_WARNING, "Unable to register manager actions\n");
+                }
+                if (SCONF_GLOBAL(state, metrics) && metrics_register()) {
+                    ast_log(LOG_WARNING, "Unable to register metrics HTTP handler\n");
+                }
 
                 return AST_MODULE_LOAD_SUCCESS;
             }
             discovery_stop(state);
         } else {
-            ast_log(LOG_ERROR, "Unable to create discovery thread\n");
+            ast_log(LOG_ERROR, "Unable to create %s\n", state->threadpool ? "discovery thread" : "thread pool");
         }
         devices_destroy(state);
+        monitor_reactor_fini();
+        audio_sched_fini();
+        if (state->threadpool) {
+            ast_threadpool_shutdown(state->threadpool);
+            state->threadpool = NULL;
+        }
     } else {
         ast_log(LOG_ERROR, "Errors reading config file " CONFIG_FILE ", Not loading module\n");
     }
 
+    devindex_fini();
     AST_RWLIST_HEAD_DESTROY(&state->devices);
     return rv;
 }
@@ -1532,19 +2249,29 @@ static void public_state_fini(struct public_state* state)
 
     /* Unregister the CLI */
     cli_unregister();
+    manager_unregister();
+    metrics_unregister();
 
 #ifdef BUILD_APPLICATIONS
     app_unregister();
 #endif
 
+    poller_fini();
+    smsbulk_fini();
+    smsexpiry_fini();
+    notifyq_fini();
     discovery_stop(state);
     devices_destroy(state);
+    monitor_reactor_fini();
+    audio_sched_fini();
 
     ast_mutex_destroy(&state->discovery_lock);
+    devindex_fini();
     AST_RWLIST_HEAD_DESTROY(&state->devices);
 
     ast_threadpool_shutdown(gpublic->threadpool);
     smsdb_atexit();
+    pdu_cache_fini();
 }
 
 static int unload_module()
@@ -22,11 +22,14 @@
 #include <asterisk/strings.h>
 #include <asterisk/threadpool.h>
 
+#include "arena.h"      /* struct arena */
 #include "at_command.h"
 #include "cpvt.h"      /* struct cpvt */
 #include "dc_config.h" /* pvt_config_t */
+#include "histogram.h" /* struct histogram */
 #include "mixbuffer.h" /* struct mixbuffer */
 #include "pcm.h"
+#include "playout.h" /* struct playout */
 
 #define MAX_BUFFER_SIZE 100
 #define MODULE_DESCRIPTION "Channel Driver for Mobile Telephony"
@@ -55,65 +58,157 @@ typedef struct pvt_state {
 
 #define PVT_STATE_T(state, name) ((state)->name)
 
-/* statictics */
+/* statictics, 64-bit counters updated with relaxed atomics without pvt lock */
 typedef struct pvt_stat {
-    uint32_t at_tasks;     /*!< number of tasks added to queue */
-    uint32_t at_cmds;      /*!< number of commands added to queue */
-    uint32_t at_responses; /*!< number of responses handled */
+    uint64_t at_tasks;     /*!< number of tasks added to queue */
+    uint64_t at_cmds;      /*!< number of commands added to queue */
+    uint64_t at_pipelined; /*!< number of commands written before response to previous one */
+    uint64_t at_responses; /*!< number of responses handled */
 
-    uint32_t d_read_bytes;  /*!< number of bytes of commands actually read from device */
-    uint32_t d_write_bytes; /*!< number of bytes of commands actually written to device */
+    uint64_t at_respool_hits;   /*!< number of response buffers reused from pool */
+    uint64_t at_respool_misses; /*!< number of response buffers allocated */
+
+    uint64_t at_taskpool_hits;   /*!< number of AT queue tasks reused from pool */
+    uint64_t at_taskpool_misses; /*!< number of AT queue tasks allocated */
+    uint64_t at_preempted;       /*!< number of times task gave way to more urgent class */
+
+    uint64_t polls;         /*!< number of periodic polls sent */
+    uint64_t polls_skipped; /*!< number of periodic polls made redundant by unsolicited updates */
+
+    uint64_t at_scratch_high_water; /*!< maximum bytes of scratch arena used by one response */
+    uint64_t at_scratch_spills;     /*!< number of scratch allocations not fitted in arena block */
+
+    uint64_t at_rb_size;       /*!< current size of AT receive buffer */
+    uint64_t at_rb_high_water; /*!< maximum number of bytes waiting in AT receive buffer */
+    uint64_t at_rb_grows;      /*!< number of AT receive buffer reallocations */
+    uint64_t at_rb_overflows;  /*!< number of times unterminated data was dropped from full AT receive buffer */
+
+    uint64_t tps_depth;      /*!< responses waiting in taskprocessor of device */
+    uint64_t tps_high_water; /*!< maximum number of responses waiting in taskprocessor of device */
+    uint64_t read_pauses;    /*!< number of times reading was paused by saturated taskprocessor */
+
+    uint64_t d_read_bytes;  /*!< number of bytes of commands actually read from device */
+    uint64_t d_write_bytes; /*!< number of bytes of commands actually written to device */
 
     uint64_t a_read_bytes;  /*!< number of bytes of audio read from device */
     uint64_t a_write_bytes; /*!< number of bytes of audio written to device */
 
-    uint32_t read_frames;  /*!< number of frames read from device */
-    uint32_t read_sframes; /*!< number of truncated frames read from device */
+    uint64_t read_frames;  /*!< number of frames read from device */
+    uint64_t read_sframes; /*!< number of truncated frames read from device */
 
-    uint32_t write_frames;  /*!< number of tries to frame write */
-    uint32_t write_tframes; /*!< number of truncated frames to write */
-    uint32_t write_sframes; /*!< number of silence frames to write */
+    uint64_t write_frames;  /*!< number of tries to frame write */
+    uint64_t write_tframes; /*!< number of truncated frames to write */
+    uint64_t write_sframes; /*!< number of silence frames to write */
 
     uint64_t write_rb_overflow_bytes; /*!< number of overflow bytes */
-    uint32_t write_rb_overflow;       /*!< number of times when a_write_rb overflowed */
+    uint64_t write_rb_overflow;       /*!< number of times when a_write_rb overflowed */
+
+    uint64_t write_ring_underrun; /*!< number of timer ticks without complete mixed frame while streams attached */
+    uint64_t write_ring_overrun;  /*!< number of mixed frames not passed to writer because ring was full */
+
+    uint64_t write_plc_frames; /*!< number of frames concealed by repetition of last frame */
+    uint64_t playout_drops;    /*!< number of mixed frames dropped to shrink playout buffer */
+    uint64_t playout_grows;    /*!< number of times target depth of playout buffer was increased */
+    uint64_t playout_shrinks;  /*!< number of times target depth of playout buffer was decreased */
+
+    uint64_t write_syscalls; /*!< number of audio write system calls */
+    uint64_t write_short;    /*!< number of audio writes completed partially */
+    uint64_t write_batched;  /*!< number of audio writes submitted in batch with other devices */
 
-    uint32_t in_calls;         /*!< number of incoming calls not including waiting */
-    uint32_t cw_calls;         /*!< number of waiting calls */
-    uint32_t out_calls;        /*!< number of all outgoing calls attempts */
-    uint32_t in_calls_handled; /*!< number of ncoming/waiting calls passed to dialplan */
-    uint32_t in_pbx_fails;     /*!< number of start_pbx fails */
+    uint64_t uac_xruns;      /*!< number of ALSA overruns and underruns */
+    uint64_t uac_prepares;   /*!< number of ALSA streams prepared after overrun, underrun or setup */
+    uint64_t uac_ring_drops; /*!< number of frames dropped between channel and audio thread */
 
-    uint32_t calls_answered[2]; /*!< number of outgoing and incoming/waiting calls answered */
-    uint32_t calls_duration[2]; /*!< seconds of outgoing and incoming/waiting calls */
+    uint64_t in_calls;         /*!< number of incoming calls not including waiting */
+    uint64_t cw_calls;         /*!< number of waiting calls */
+    uint64_t out_calls;        /*!< number of all outgoing calls attempts */
+    uint64_t in_calls_handled; /*!< number of ncoming/waiting calls passed to dialplan */
+    uint64_t in_pbx_fails;     /*!< number of start_pbx fails */
+
+    uint64_t calls_answered[2]; /*!< number of outgoing and incoming/waiting calls answered */
+    uint64_t calls_duration[2]; /*!< seconds of outgoing and incoming/waiting calls */
 } pvt_stat_t;
 
 #define PVT_STAT_T(stat, name) ((stat)->name)
 
+/* latency histograms, microseconds */
+typedef struct pvt_latency {
+    struct histogram tps_delay;                     /*!< response wait in taskprocessor queue */
+    struct histogram audio_interval;                /*!< interval between audio frames written to device */
+    struct timeval audio_last;                      /*!< time of last audio frame, written by audio timer only */
+    struct histogram* at_rtt[AT_CMDS_NUMBER];       /*!< round trip by command, allocated on first response */
+    uint32_t at_srtt[AT_CMDS_NUMBER];               /*!< smoothed round trip by command */
+    uint32_t at_rttvar[AT_CMDS_NUMBER];             /*!< smoothed mean deviation of round trip by command */
+    uint32_t at_timeout[AT_CMDS_NUMBER];            /*!< learned timeout by command in ms, 0 - not enough responses */
+    struct histogram call_stage[CALL_TRACE_STAGES]; /*!< call setup from previous reached stage to this one */
+    struct histogram call_setup[2];                 /*!< whole call setup by direction */
+} pvt_latency_t;
+
+/* copy of device state for device selection and metrics, written with pvt locked and read without lock */
+typedef struct pvt_load {
+    uint32_t calls;         /*!< number of channels */
+    uint32_t out_calls;     /*!< number of all outgoing calls attempts */
+    uint32_t duration;      /*!< seconds of outgoing and incoming/waiting calls */
+    int32_t rssi;           /*!< signal strength */
+    int32_t gsm_reg_status; /*!< registration status */
+    uint32_t at_tasks;      /*!< number of active tasks in at_queue */
+    uint32_t at_cmds;       /*!< number of active commands in at_queue */
+} pvt_load_t;
+
 struct at_queue_task;
+struct monitor_ctx;
+struct audio_sched_entry;
+struct uac_engine;
+struct at_respool;
+
+/* free AT queue tasks for 1, 2, 4 and 8 commands, pvt locked */
+#define AT_QUEUE_POOL_CLASSES 4
+
+typedef struct at_queue_pool {
+    AST_LIST_HEAD_NOLOCK(, at_queue_task) tasks[AT_QUEUE_POOL_CLASSES];
+    unsigned int count[AT_QUEUE_POOL_CLASSES]; /*!< number of free tasks in class */
+} at_queue_pool_t;
 
 typedef struct pvt {
     AST_LIST_ENTRY(pvt) entry; /*!< linked list pointers */
 
     ast_mutex_t lock;                               /*!< pvt lock */
+    ast_mutex_t status_lock;                        /*!< protects replacement of status snapshot */
+    struct pvt_status* status;                      /*!< current status snapshot, see pvt_status.h */
     AST_LIST_HEAD_NOLOCK(, at_queue_task) at_queue; /*!< queue for commands to modem */
+    at_queue_pool_t at_pool;                        /*!< free tasks of at_queue */
 
-    AST_LIST_HEAD_NOLOCK(, cpvt) chans; /*!< list of channels */
-    struct cpvt sys_chan;               /*!< system channel */
+    AST_LIST_HEAD_NOLOCK(, cpvt) chans;          /*!< list of channels */
+    struct cpvt* call_idx_map[MAX_CALL_IDX + 1]; /*!< first channel of list for every call index */
+    struct cpvt sys_chan;                        /*!< system channel */
 
-    unsigned long channel_instance; /*!< number of channels created on this device */
-    pthread_t monitor_thread;       /*!< monitor (at commands reader) thread handle */
+    unsigned long channel_instance;  /*!< number of channels created on this device */
+    pthread_t monitor_thread;        /*!< monitor (at commands reader) thread handle */
+    struct monitor_ctx* monitor_ctx; /*!< monitor context in reactor mode */
 
     int audio_fd; /*!< audio descriptor */
     snd_pcm_t* icard;
     snd_pcm_t* ocard;
     unsigned int ocard_channels;
-
-    int data_fd; /*!< data descriptor */
-
-    struct ast_timer* a_timer;   /*!< audio write timer */
-    void* silence_buf;           //[FRAME_SIZE_PLAYBACK * 2];
-    void* write_buf;             //[FRAME_SIZE_PLAYBACK * 5]; /*!< audio write buffer */
-    struct mixbuffer write_mixb; /*!< audio mix buffer */
+    struct pcm_tuning uac_tuning;  /*!< ALSA buffer sizes of opened sound card */
+    unsigned int uac_level;        /*!< number of times buffers were widened by uac_latency=auto */
+    uint64_t uac_tuned_xruns;      /*!< value of uac_xruns counter when buffers were chosen */
+    struct uac_engine* uac_engine; /*!< audio thread of sound card, NULL - ALSA is called from channel */
+
+    int data_fd;                /*!< data descriptor */
+    size_t at_rb_max;           /*!< size limit of AT receive buffer, changed by reload, read by monitor without lock */
+    struct at_respool* respool; /*!< response buffers of monitor, reference held while device is connected */
+
+    struct ast_timer* a_timer;         /*!< audio write timer */
+    struct audio_sched_entry* a_sched; /*!< entry in shared audio scheduler, used instead of a_timer */
+    void* silence_buf;                 //[FRAME_SIZE_PLAYBACK * 2];
+    void* write_buf;                   //[FRAME_SIZE_PLAYBACK * 5]; /*!< audio write buffer */
+    struct mixbuffer write_mixb;       /*!< audio mix buffer */
+    struct rb_spsc write_ring;         /*!< mixed frames passed to timer-driven writer */
+    struct playout playout;            /*!< adaptive playout of write_ring */
+    void* playout_buf;                 //[FRAME_SIZE_PLAYBACK * 2]; /*!< last played and concealed frame, NULL - playout disabled */
+    struct rb_frames conf_ring;        /*!< frames read from device, shared by non-master conference legs */
+    size_t audio_buf_size;             /*!< size of silence_buf and write_buf */
 
     /* device state */
     int gsm_reg_status;
@@ -121,10 +216,22 @@ typedef struct pvt {
     int operator;
     int rssi;
 
+    struct timeval rssi_updated;     /*!< time of last unsolicited signal strength */
+    struct timeval provider_updated; /*!< time of last access technology or registration change, provider is queried then */
+    struct timeval polled;           /*!< time of last visit of poll scheduler */
+
     struct ast_format_cap* local_format_cap;
 
+    int clir; /*!< last AT+CLIR value sent to device, -1 if unknown */
+
+    uint64_t call_indication; /*!< monotonic time of first indication of incoming call not yet handled, 0 - none */
+
     /* SMS support */
     int incoming_sms_index;
+    struct {
+        unsigned int listed;       /*!< entries of +CMGL listing in progress */
+        unsigned int persisted[8]; /*!< bitmap of indexes of entries delivered or committed to database, deleted after listing */
+    } sms_batch;
 
     // clang-format off
 	/* string fields */
@@ -164,9 +271,8 @@ typedef struct pvt {
     unsigned int is_simcom       :1; /*!< device is a simcom module */
     unsigned int has_call_waiting:1; /*!< call waiting enabled on device */
 
-    unsigned int group_last_used:1; /*!< mark the last used device */
-    unsigned int prov_last_used :1; /*!< mark the last used device */
-    unsigned int sim_last_used  :1; /*!< mark the last used device */
+    unsigned int prov_last_used:1; /*!< mark the last used device */
+    unsigned int sim_last_used :1; /*!< mark the last used device */
 
     unsigned int terminate_monitor    :1; /*!< non-zero if we want terminate monitor thread i.e. restart, stop, remove */
     unsigned int has_subscriber_number:1; /*!< subscriber_number field is valid */
@@ -179,6 +285,9 @@ typedef struct pvt {
     pvt_config_t settings; /*!< all device settings from config file */
     pvt_state_t state;     /*!< state */
     pvt_stat_t stat;       /*!< various statistics */
+    pvt_load_t load;       /*!< counters for least loaded device selection */
+    pvt_latency_t latency; /*!< latency histograms */
+    struct arena scratch;  /*!< scratch memory of response handlers, reset after each response */
 
     struct ast_str empty_str; /*!< empty string */
 } pvt_t;
@@ -193,6 +302,44 @@ typedef struct pvt {
 #define PVT_STATE(pvt, name) PVT_STATE_T(&(pvt)->state, name)
 #define PVT_STAT(pvt, name) PVT_STAT_T(&(pvt)->stat, name)
 
+#define PVT_STAT_GET(pvt, name) __atomic_load_n(&PVT_STAT(pvt, name), __ATOMIC_RELAXED)
+#define PVT_STAT_SET(pvt, name, value) __atomic_store_n(&PVT_STAT(pvt, name), (uint64_t)(value), __ATOMIC_RELAXED)
+#define PVT_STAT_ADD(pvt, name, value) ((void)__atomic_fetch_add(&PVT_STAT(pvt, name), (uint64_t)(value), __ATOMIC_RELAXED))
+#define PVT_STAT_INC(pvt, name) PVT_STAT_ADD(pvt, name, 1u)
+#define PVT_STAT_MAX(pvt, name, value) stat_max(&PVT_STAT(pvt, name), (uint64_t)(value))
+
+static inline void stat_max(uint64_t* const counter, uint64_t value)
+{
+    uint64_t current = __atomic_load_n(counter, __ATOMIC_RELAXED);
+    while (value > current && !__atomic_compare_exchange_n(counter, &current, value, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+}
+
+/* publish state for lockless readers, pvt locked */
+static inline void pvt_load_update(struct pvt* const pvt)
+{
+    __atomic_store_n(&pvt->load.calls, PVT_STATE(pvt, chansno), __ATOMIC_RELAXED);
+    __atomic_store_n(&pvt->load.out_calls, (uint32_t)PVT_STAT_GET(pvt, out_calls), __ATOMIC_RELAXED);
+    __atomic_store_n(&pvt->load.duration, (uint32_t)(PVT_STAT_GET(pvt, calls_duration[CALL_DIR_OUTGOING]) + PVT_STAT_GET(pvt, calls_duration[CALL_DIR_INCOMING])),
+                     __ATOMIC_RELAXED);
+    __atomic_store_n(&pvt->load.rssi, pvt->rssi, __ATOMIC_RELAXED);
+    __atomic_store_n(&pvt->load.gsm_reg_status, pvt->gsm_reg_status, __ATOMIC_RELAXED);
+    __atomic_store_n(&pvt->load.at_tasks, PVT_STATE(pvt, at_tasks), __ATOMIC_RELAXED);
+    __atomic_store_n(&pvt->load.at_cmds, PVT_STATE(pvt, at_cmds), __ATOMIC_RELAXED);
+}
+
+/* read published state without pvt lock */
+static inline void pvt_load_get(const struct pvt* const pvt, pvt_load_t* load)
+{
+    load->calls          = __atomic_load_n(&pvt->load.calls, __ATOMIC_RELAXED);
+    load->out_calls      = __atomic_load_n(&pvt->load.out_calls, __ATOMIC_RELAXED);
+    load->duration       = __atomic_load_n(&pvt->load.duration, __ATOMIC_RELAXED);
+    load->rssi           = __atomic_load_n(&pvt->load.rssi, __ATOMIC_RELAXED);
+    load->gsm_reg_status = __atomic_load_n(&pvt->load.gsm_reg_status, __ATOMIC_RELAXED);
+    load->at_tasks       = __atomic_load_n(&pvt->load.at_tasks, __ATOMIC_RELAXED);
+    load->at_cmds        = __atomic_load_n(&pvt->load.at_cmds, __ATOMIC_RELAXED);
+}
+
 typedef struct public_state {
     AST_RWLIST_HEAD(devices, pvt) devices;
     struct ast_threadpool* threadpool;
@@ -211,9 +358,64 @@ int pvt_is_dial_possible(const struct pvt* pvt, unsigned int opts);
 
 const char* pvt_str_state(const struct pvt* pvt);
 struct ast_str* pvt_str_state_ex(const struct pvt* pvt);
+void pvt_append_state_ex(const struct pvt* pvt, struct ast_str** buf);
 const char* pvt_str_call_dir(const struct pvt* pvt);
 
-void pvt_get_status(const struct pvt* const pvt, struct ast_json* status);
+/* from status snapshot, pvt may be not locked */
+void pvt_get_status(struct pvt* const pvt, struct ast_json* status);
+void pvt_get_stat(const struct pvt* const pvt, pvt_stat_t* stat);
+int pvt_get_stat_by_id(const char* name, pvt_stat_t* stat);
+void pvt_get_stat_json(const pvt_stat_t* const stat, struct ast_json* json);
+
+/* description of statistics counters for exporters */
+struct pvt_stat_field {
+    const char* name;   /*!< field name */
+    size_t offset;      /*!< offset in pvt_stat_t */
+    unsigned int gauge; /*!< value may go down */
+    const char* help;   /*!< description */
+};
+
+extern const struct pvt_stat_field pvt_stat_fields[];
+extern const size_t pvt_stat_fields_count;
+
+static inline uint64_t pvt_stat_value(const pvt_stat_t* stat, const struct pvt_stat_field* field)
+{
+    return *(const uint64_t*)((const char*)stat + field->offset);
+}
+
+struct latency_snapshot {
+    struct histogram tps_delay;
+    struct histogram audio_interval;
+    unsigned int at_count; /*!< number of commands with responses */
+    unsigned int adaptive:1; /*!< learned timeouts are used */
+    unsigned int timeout_min;
+    unsigned int timeout_max;
+    struct {
+        at_cmd_t cmd;
+        struct histogram rtt;
+        uint32_t srtt;
+        uint32_t rttvar;
+        uint32_t timeout; /*!< learned timeout in ms, 0 - not learned yet */
+    } at[AT_CMDS_NUMBER];
+    struct histogram call_stage[CALL_TRACE_STAGES];
+    struct histogram call_setup[2];
+};
+
+/* return snapshot of latency histograms, must be freed by ast_free() */
+struct latency_snapshot* pvt_get_latency_by_id(const char* name);
+
+/* heap bytes held by device */
+struct pvt_memory {
+    size_t pvt;      /*!< device and scratch arena */
+    size_t at_rb;    /*!< AT receive buffer */
+    size_t respool;  /*!< response buffers */
+    size_t at_queue; /*!< queued and free AT tasks */
+    size_t audio;    /*!< silence, mixing and write buffers, UAC audio thread */
+    size_t channels; /*!< channels and their read buffers */
+};
+
+/* called with pvt lock held */
+void pvt_get_memory(const struct pvt* pvt, struct pvt_memory* mem);
 
 void pvt_on_create_1st_channel(struct pvt* pvt);
 void pvt_on_remove_last_channel(struct pvt* pvt);
@@ -223,6 +425,7 @@ void pvt_try_restate(struct pvt* pvt);
 int pvt_set_act(struct pvt* pvt, int act);
 
 const struct ast_format* pvt_get_audio_format(const struct pvt* const);
+unsigned int pvt_get_audio_ptime(const struct pvt* const);
 size_t pvt_get_audio_frame_size(unsigned int, const struct ast_format* const);
 void* pvt_get_silence_buffer(struct pvt* const);
 
@@ -246,6 +449,7 @@ static inline struct pvt* pvt_find_by_resource(const char* resource, unsigned in
 }
 
 struct cpvt* pvt_channel_find_by_call_idx(struct pvt* pvt, int call_idx);
+void pvt_channel_index_update(struct pvt* pvt, int call_idx);
 struct cpvt* pvt_channel_find_active(struct pvt* pvt);
 struct cpvt* pvt_channel_find_last_initialized(struct pvt* pvt);
 
@@ -12,6 +12,7 @@
 
    By Matthew Fredrickson <creslin@digium.com>
 */
+#include <sys/eventfd.h> /* eventfd_write() eventfd_read() */
 
 #include "ast_config.h"
 
@@ -32,11 +33,45 @@
 #include "at_queue.h" /* write_all() TODO: move out */
 #include "chan_quectel.h"
 #include "helpers.h" /* get_at_clir_value()  */
+#include "histogram.h" /* hist_add() */
+#include "mutils.h"  /* MIN() */
+#include "notifyq.h" /* notifyq_push() */
+#include "pvt_status.h" /* pvt_status_find() */
+#include "resample.h" /* resample_up2() resample_down2() */
+#include "uac_engine.h" /* uac_engine_read() uac_engine_write() */
 
 #ifndef ESTRPIPE
 #define ESTRPIPE EPIPE
 #endif
 
+/* 8 kHz <-> 16 kHz signed linear formats are converted by channel itself, 1 - up, -1 - down, 0 - none */
+static int channel_resample_dir(const struct ast_format* const from, const struct ast_format* const to)
+{
+    if (ast_format_cmp(from, ast_format_slin) == AST_FORMAT_CMP_EQUAL && ast_format_cmp(to, ast_format_slin16) == AST_FORMAT_CMP_EQUAL) {
+        return 1;
+    }
+    if (ast_format_cmp(from, ast_format_slin16) == AST_FORMAT_CMP_EQUAL && ast_format_cmp(to, ast_format_slin) == AST_FORMAT_CMP_EQUAL) {
+        return -1;
+    }
+    return 0;
+}
+
+static struct ast_format* channel_alt_format(const struct ast_format* const fmt)
+{
+    if (ast_format_cmp(fmt, ast_format_slin) == AST_FORMAT_CMP_EQUAL) {
+        return ast_format_slin16;
+    }
+    if (ast_format_cmp(fmt, ast_format_slin16) == AST_FORMAT_CMP_EQUAL) {
+        return ast_format_slin;
+    }
+    return NULL;
+}
+
+static size_t resample(struct resampler* rs, int dir, const int16_t* in, size_t samples, int16_t* out)
+{
+    return (dir > 0) ? resample_up2(rs, in, samples, out) : resample_down2(rs, in, samples, out);
+}
+
 static int setvar_helper(const struct pvt* const pvt, struct ast_channel* chan, const char* name, const char* value)
 {
     if (ast_strlen_zero(name) || ast_strlen_zero(value)) {
@@ -119,6 +154,7 @@ static struct ast_channel* channel_request(attribute_unused const char* type, st
 {
     /* TODO: simplify by moving common code to functions */
     /* TODO: add check when request 'holdother' what requestor is not on same device for 1.6 */
+    const uint64_t requested = call_trace_now();
     const char* dest_num;
     struct ast_channel* channel = NULL;
     int opts                    = CALL_FLAG_NONE;
@@ -145,7 +181,11 @@ static struct ast_channel* channel_request(attribute_unused const char* type, st
         local_channel = (unsigned)ast_format_cap_has_type(cap, AST_MEDIA_TYPE_TEXT);
         if (!local_channel) {
             const struct ast_format* const fmt = pvt_get_audio_format(pvt);
-            const enum ast_format_cmp_res res  = ast_format_cap_iscompatible_format(cap, fmt);
+            const struct ast_format* const alt = channel_alt_format(fmt);
+            enum ast_format_cmp_res res        = ast_format_cap_iscompatible_format(cap, fmt);
+            if (res != AST_FORMAT_CMP_EQUAL && res != AST_FORMAT_CMP_SUBSET && alt) {
+                res = ast_format_cap_iscompatible_format(cap, alt);
+            }
             if (res != AST_FORMAT_CMP_EQUAL && res != AST_FORMAT_CMP_SUBSET) {
                 struct ast_str* codec_buf = ast_str_alloca(64);
                 ast_log(LOG_WARNING, "Asked to get a channel of unsupported format '%s'\n", ast_format_cap_get_names(cap, &codec_buf));
@@ -171,7 +211,9 @@ static struct ast_channel* channel_request(attribute_unused const char* type, st
     if (pvt) {
         channel = channel_new(pvt, AST_STATE_DOWN, NULL, pvt_get_pseudo_call_idx(pvt), CALL_DIR_OUTGOING, CALL_STATE_INIT, NULL, assignedids, requestor,
                               local_channel);
-        if (!channel) {
+        if (channel) {
+            cpvt_trace_at(ast_channel_tech_pvt(channel), CALL_TRACE_REQUEST, requested);
+        } else {
             ast_log(LOG_WARNING, "Unable to allocate channel structure\n");
             *cause = AST_CAUSE_REQUESTED_CHAN_UNAVAIL;
         }
@@ -265,7 +307,8 @@ static int channel_call(struct ast_channel* channel, const char* dest, attribute
         clir = -1;
     }
 
-    PVT_STAT(pvt, out_calls)++;
+    PVT_STAT_INC(pvt, out_calls);
+    pvt_load_update(pvt);
     if (at_enqueue_dial(cpvt, dest_num, clir)) {
         ast_log(LOG_ERROR, "[%s] Error sending ATD command\n", PVT_ID(pvt));
         return -1;
@@ -381,100 +424,264 @@ static ssize_t attribute_const get_iov_total_len(const struct iovec* const iov,
 
 #/* ARCH: move to cpvt level */
 
-static ssize_t iov_write(struct pvt* pvt, int fd, const struct iovec* const iov, int iovcnt)
+static ssize_t iov_write_result(struct pvt* pvt, ssize_t len, ssize_t w)
 {
-    const ssize_t len = get_iov_total_len(iov, iovcnt);
-    const ssize_t w   = writev(fd, iov, iovcnt);
-
     if (w < 0) {
-        const int err = errno;
+        const int err = (int)-w;
         if (err == EINTR || err == EAGAIN) {
             ast_debug(3, "[%s][TTY] Write error: %s\n", PVT_ID(pvt), strerror(err));
         } else {
             ast_log(LOG_WARNING, "[%s][TTY] Write error: %s\n", PVT_ID(pvt), strerror(err));
         }
-        return -err;
     } else if (w && w != len) {
+        PVT_STAT_INC(pvt, write_short);
         ast_log(LOG_WARNING, "[%s][TTY] Incomplete frame written: %ld/%ld\n", PVT_ID(pvt), (long)w, (long)len);
     }
 
     return w;
 }
 
-#if __BYTE_ORDER == __LITTLE_ENDIAN
-static inline void change_audio_endianness_to_le(attribute_unused struct iovec* iov, attribute_unused int iovcnt) {}
-#else
-static void change_audio_endianness_to_le(struct iovec* iov, int iovcnt)
+static ssize_t iov_write(struct pvt* pvt, int fd, const struct iovec* const iov, int iovcnt)
 {
-    for (; iovcnt-- > 0; ++iov) {
-        ast_swapcopy_samples(iov->iov_base, iov->iov_base, iov->iov_len / 2);
-    }
+    const ssize_t len = get_iov_total_len(iov, iovcnt);
+    const ssize_t w   = writev(fd, iov, iovcnt);
+
+    PVT_STAT_INC(pvt, write_syscalls);
+    return iov_write_result(pvt, len, (w < 0) ? -errno : w);
 }
-#endif
 
 #/* */
 
-static void timing_write_tty(struct pvt* pvt, size_t frame_size)
+/* called with pvt lock held, the only producer of write_ring */
+static void pass_mixed_frames(struct pvt* pvt, size_t frame_size)
 {
-    int iovcnt;
-    struct iovec iov[3];
+    /* with several streams keep the newest frame for mixing with late ones */
+    const size_t keep = (mixb_streams(&pvt->write_mixb) > 1) ? frame_size : 0u;
 
-    const char* msg   = NULL;
-    const size_t used = mixb_used(&pvt->write_mixb);
+    unsigned int frames = 0;
 
-    if (used >= frame_size) {
-        iovcnt = mixb_read_n_iov(&pvt->write_mixb, iov, frame_size);
-        mixb_read_n_iov(&pvt->write_mixb, iov, frame_size);
+    while (mixb_used(&pvt->write_mixb) >= frame_size + keep) {
+        if (rb_spsc_free(&pvt->write_ring) < frame_size) {
+            PVT_STAT_INC(pvt, write_ring_overrun);
+            break;
+        }
+
+        struct iovec iov[2];
+        /* mix buffer holds samples in TTY order already */
+        const int iovcnt = mixb_read_n_iov(&pvt->write_mixb, iov, frame_size);
+        rb_spsc_write_iov(&pvt->write_ring, iov, iovcnt);
         mixb_read_upd(&pvt->write_mixb, frame_size);
-        change_audio_endianness_to_le(iov, iovcnt);
+        frames++;
+    }
+
+    if (frames && pvt->playout_buf) {
+        const struct timeval now = ast_tvnow();
+        playout_arrival(&pvt->playout, &now, frames);
+    }
+}
+
+/* write_ring consumer with adaptive depth, empty ticks are concealed by last frame */
+static int timing_prepare_playout(struct pvt* pvt, size_t frame_size, struct channel_timing_frame* frame, size_t used)
+{
+    struct playout* const po   = &pvt->playout;
+    struct iovec* const iov    = frame->iov;
+    char* const last           = pvt->playout_buf;
+    char* const conceal        = last + frame_size;
+    const unsigned int frames  = (unsigned int)(used / frame_size);
+    const unsigned int target  = po->target;
+    const int streams          = mixb_streams(&pvt->write_mixb);
+    size_t pos                 = 0;
+
+    frame->release = 0;
+
+    switch (playout_tick(po, frames, streams)) {
+        case PLAYOUT_DROP:
+            PVT_STAT_INC(pvt, playout_drops);
+            rb_spsc_read_upd(&pvt->write_ring, frame_size);
+            /* fall through */
+
+        case PLAYOUT_PLAY:
+            frame->iovcnt  = rb_spsc_read_n_iov(&pvt->write_ring, iov, frame_size);
+            frame->release = frame_size;
+
+            for (int i = 0; i < frame->iovcnt; ++i) {
+                memcpy(last + pos, iov[i].iov_base, iov[i].iov_len);
+                pos += iov[i].iov_len;
+            }
+            break;
+
+        case PLAYOUT_CONCEAL:
+            PVT_STAT_INC(pvt, write_plc_frames);
+            ast_debug(7, "[%s] write concealed frame\n", PVT_ID(pvt));
+
+            playout_conceal(conceal, last, frame_size, po->concealed);
+            iov[0].iov_base = conceal;
+            iov[0].iov_len  = frame_size;
+            frame->iovcnt   = 1;
+            break;
+
+        default:
+            PVT_STAT_INC(pvt, write_sframes);
+            ast_debug(7, "[%s] write silence\n", PVT_ID(pvt));
+
+            iov[0].iov_base = pvt_get_silence_buffer(pvt);
+            iov[0].iov_len  = frame_size;
+            frame->iovcnt   = 1;
+            break;
+    }
+
+    if (!frames && streams > 0) {
+        PVT_STAT_INC(pvt, write_ring_underrun);
+    }
+
+    if (po->target > target) {
+        PVT_STAT_INC(pvt, playout_grows);
+        ast_debug(4, "[%s] Playout depth increased to %u frames\n", PVT_ID(pvt), po->target);
+    } else if (po->target < target) {
+        PVT_STAT_INC(pvt, playout_shrinks);
+        ast_debug(4, "[%s] Playout depth decreased to %u frames\n", PVT_ID(pvt), po->target);
+    }
+
+    return 0;
+}
+
+/* called on audio timer tick without pvt lock, the only consumer of write_ring */
+static int timing_prepare_tty(struct pvt* pvt, size_t frame_size, struct channel_timing_frame* frame)
+{
+    struct iovec* const iov = frame->iov;
+    const char* msg         = NULL;
+    const size_t used       = rb_spsc_used(&pvt->write_ring);
+
+    frame->fd = pvt->audio_fd;
+    if (frame->fd < 0) {
+        return -1;
+    }
+
+    /* pause longer than second is start of new stream, not jitter */
+    const struct timeval now = ast_tvnow();
+    if (!ast_tvzero(pvt->latency.audio_last)) {
+        const int64_t interval = ast_tvdiff_us(now, pvt->latency.audio_last);
+        if (interval >= 0 && interval < 1000000) {
+            hist_add(&pvt->latency.audio_interval, (uint64_t)interval);
+        }
+    }
+    pvt->latency.audio_last = now;
+
+    if (pvt->playout_buf) {
+        return timing_prepare_playout(pvt, frame_size, frame, used);
+    }
+
+    if (used >= frame_size) {
+        frame->iovcnt = rb_spsc_read_n_iov(&pvt->write_ring, iov, frame_size);
     } else if (used > 0) {
-        PVT_STAT(pvt, write_tframes)++;
+        PVT_STAT_INC(pvt, write_tframes);
         msg = "[%s] write truncated frame\n";
 
-        iovcnt = mixb_read_all_iov(&pvt->write_mixb, iov);
-        mixb_read_all_iov(&pvt->write_mixb, iov);
-        mixb_read_upd(&pvt->write_mixb, used);
+        frame->iovcnt = rb_spsc_read_n_iov(&pvt->write_ring, iov, used);
 
-        iov[iovcnt].iov_base = pvt_get_silence_buffer(pvt);
-        iov[iovcnt].iov_len  = frame_size - used;
-        iovcnt++;
-        change_audio_endianness_to_le(iov, iovcnt);
+        iov[frame->iovcnt].iov_base = pvt_get_silence_buffer(pvt);
+        iov[frame->iovcnt].iov_len  = frame_size - used;
+        frame->iovcnt++;
     } else {
-        PVT_STAT(pvt, write_sframes)++;
+        PVT_STAT_INC(pvt, write_sframes);
         msg = "[%s] write silence\n";
 
         iov[0].iov_base = pvt_get_silence_buffer(pvt);
         iov[0].iov_len  = frame_size;
-        iovcnt          = 1;
+        frame->iovcnt   = 1;
     }
 
     if (msg) {
+        if (mixb_streams(&pvt->write_mixb) > 0) {
+            PVT_STAT_INC(pvt, write_ring_underrun);
+        }
         ast_debug(7, msg, PVT_ID(pvt));
     }
 
-    if (iov_write(pvt, pvt->audio_fd, iov, iovcnt) >= 0) {
-        PVT_STAT(pvt, write_frames)++;
+    frame->release = MIN(used, frame_size);
+    return 0;
+}
+
+void channel_timing_complete(struct pvt* pvt, const struct channel_timing_frame* frame, ssize_t written)
+{
+    if (iov_write_result(pvt, get_iov_total_len(frame->iov, frame->iovcnt), written) >= 0) {
+        PVT_STAT_INC(pvt, write_frames);
+    }
+
+    if (frame->release) {
+        rb_spsc_read_upd(&pvt->write_ring, frame->release);
     }
 }
 
-#/* copy voice data from device to each channel in conference */
+static void timing_write_tty(struct pvt* pvt, size_t frame_size)
+{
+    struct channel_timing_frame frame;
+
+    if (timing_prepare_tty(pvt, frame_size, &frame)) {
+        return;
+    }
+
+    const ssize_t w = writev(frame.fd, frame.iov, frame.iovcnt);
+    PVT_STAT_INC(pvt, write_syscalls);
+    channel_timing_complete(pvt, &frame, (w < 0) ? -errno : w);
+}
+
+int channel_timing_prepare(struct pvt* pvt, struct channel_timing_frame* frame)
+{
+    const struct ast_format* const fmt = pvt_get_audio_format(pvt);
+    return timing_prepare_tty(pvt, pvt_get_audio_frame_size(pvt_get_audio_ptime(pvt), fmt), frame);
+}
+
+void channel_timing_write(struct pvt* pvt)
+{
+    const struct ast_format* const fmt = pvt_get_audio_format(pvt);
+    timing_write_tty(pvt, pvt_get_audio_frame_size(pvt_get_audio_ptime(pvt), fmt));
+}
+
+#/* publish voice data from device once and wake up each channel in conference */
 
 static void write_conference(struct pvt* pvt, const char* const buffer, size_t length)
 {
     struct cpvt* cpvt;
 
+    if (!pvt->conf_ring.buffer) {
+        return;
+    }
+
+    rb_frames_write(&pvt->conf_ring, buffer, length);
+
     AST_LIST_TRAVERSE(&pvt->chans, cpvt, entry) {
-        if (CPVT_IS_ACTIVE(cpvt) && !CPVT_IS_MASTER(cpvt) && CPVT_TEST_FLAG(cpvt, CALL_FLAG_MULTIPARTY) && cpvt->rd_pipe[PIPE_WRITE] >= 0) {
-            const size_t wr = fd_write_all(cpvt->rd_pipe[PIPE_WRITE], buffer, length);
-            //			ast_debug (6, "[%s] write2 | call idx %d pipe fd %d wrote %d bytes\n", PVT_ID(pvt),
-            // cpvt->call_idx, cpvt->rd_pipe[PIPE_WRITE], wr);
-            if (wr != length) {
-                ast_debug(1, "[%s][PIPE] Write error: %s\n", PVT_ID(pvt), strerror(errno));
+        if (CPVT_IS_ACTIVE(cpvt) && !CPVT_IS_MASTER(cpvt) && CPVT_TEST_FLAG(cpvt, CALL_FLAG_MULTIPARTY) && cpvt->conf_fd >= 0) {
+            if (eventfd_write(cpvt->conf_fd, 1u)) {
+                ast_debug(1, "[%s][CONF] Wake up error: %s\n", PVT_ID(pvt), strerror(errno));
             }
         }
     }
 }
 
+/* frame of conference ring, eventfd is only reset, leg may be woken up for frames already read */
+static int read_conference(struct cpvt* cpvt, struct pvt* pvt, char* buf, size_t size)
+{
+    eventfd_t cnt;
+
+    if (eventfd_read(cpvt->conf_fd, &cnt) && errno != EAGAIN) {
+        ast_debug(1, "[%s][CONF] Read error: %s\n", PVT_ID(pvt), strerror(errno));
+    }
+
+    if (!pvt->conf_ring.buffer) {
+        return 0;
+    }
+
+    return (int)rb_frames_read(&pvt->conf_ring, &cpvt->conf_cursor, buf, size);
+}
+
+#if __BYTE_ORDER == __LITTLE_ENDIAN
+static inline void samples_le_to_host(attribute_unused void* buf, attribute_unused int samples) {}
+#else
+static void samples_le_to_host(void* buf, int samples) { ast_swapcopy_samples(buf, buf, samples); }
+#endif
+
+/* buf holds samples in host order, conference ring and UAC engine ring are converted while copied */
 static struct ast_frame* prepare_voice_frame(struct cpvt* const cpvt, void* const buf, int samples, const struct ast_format* const fmt)
 {
     struct ast_frame* const f = &cpvt->read_frame;
@@ -489,8 +696,6 @@ static struct ast_frame* prepare_voice_frame(struct cpvt* const cpvt, void* cons
     f->offset          = AST_FRIENDLY_OFFSET;
     f->src             = AST_MODULE;
 
-    ast_frame_byteswap_le(f);
-
     return f;
 }
 
@@ -502,34 +707,50 @@ static struct ast_frame* prepare_silence_voice_frame(struct cpvt* const cpvt, in
 static struct ast_frame* channel_read_tty(struct cpvt* cpvt, struct pvt* pvt, size_t frame_size, const struct ast_format* const fmt)
 {
     char* const buf = cpvt->read_buf + AST_FRIENDLY_OFFSET;
-    const int fd    = CPVT_IS_MASTER(cpvt) ? pvt->audio_fd : cpvt->rd_pipe[PIPE_READ];
+    const int fd    = CPVT_IS_MASTER(cpvt) ? pvt->audio_fd : cpvt->conf_fd;
 
     if (fd < 0) {
         return NULL;
     }
 
-    const int res = read(fd, buf, frame_size);
+    /* device writes PTIME_CAPTURE ms at once, longer frames are collected by several reads */
+    const size_t have = CPVT_IS_MASTER(cpvt) ? cpvt->read_used : 0u;
+
+    errno   = 0;
+    int res = CPVT_IS_MASTER(cpvt) ? read(fd, buf + have, frame_size - have) : read_conference(cpvt, pvt, buf, frame_size);
     if (res <= 0) {
         if (errno && errno != EAGAIN && errno != EINTR) {
             ast_debug(1, "[%s][TTY] Read error: %s\n", PVT_ID(pvt), strerror(errno));
         } else if (!res) {
             ast_debug(8, "[%s][TTY] Zero bytes returned\n", PVT_ID(pvt));
         }
-        return NULL;
+        return have ? &ast_null_frame : NULL;
+    }
+
+    if (CPVT_IS_MASTER(cpvt)) {
+        PVT_STAT_ADD(pvt, a_read_bytes, res);
+        if (pvt_get_audio_ptime(pvt) > PTIME_CAPTURE) {
+            if (have + res < frame_size) {
+                cpvt->read_used = have + res;
+                return &ast_null_frame;
+            }
+            cpvt->read_used = 0;
+            res             = (int)frame_size;
+        }
     }
 
     // ast_debug(7, "[%s] call idx %d read %u\n", PVT_ID(pvt), cpvt->call_idx, (unsigned)res);
     // ast_debug(6, "[%s] read | call idx %d fd %d read %d bytes\n", PVT_ID(pvt), cpvt->call_idx, pvt->audio_fd, res);
 
     if (CPVT_IS_MASTER(cpvt)) {
+        samples_le_to_host(buf, res / 2);
         if (CPVT_TEST_FLAG(cpvt, CALL_FLAG_MULTIPARTY)) {
             write_conference(pvt, buf, res);
         }
 
-        PVT_STAT(pvt, a_read_bytes) += res;
-        PVT_STAT(pvt, read_frames)++;
+        PVT_STAT_INC(pvt, read_frames);
         if (res < frame_size) {
-            PVT_STAT(pvt, read_sframes)++;
+            PVT_STAT_INC(pvt, read_sframes);
         }
     }
 
@@ -537,13 +758,36 @@ static struct ast_frame* channel_read_tty(struct cpvt* cpvt, struct pvt* pvt, si
     return f;
 }
 
+static struct ast_frame* channel_read_uac_engine(struct cpvt* cpvt, struct pvt* pvt, size_t frames, const struct ast_format* const fmt)
+{
+    char* const buf = cpvt->read_buf + AST_FRIENDLY_OFFSET;
+    const int res   = uac_engine_read(pvt->uac_engine, buf, frames);
+    if (res <= 0) {
+        return NULL;
+    }
+
+    if (CPVT_TEST_FLAG(cpvt, CALL_FLAG_MULTIPARTY)) {
+        write_conference(pvt, buf, res * sizeof(short));
+    }
+
+    PVT_STAT_ADD(pvt, a_read_bytes, res * sizeof(short));
+    PVT_STAT_INC(pvt, read_frames);
+    return prepare_voice_frame(cpvt, buf, res, fmt);
+}
+
 static struct ast_frame* channel_read_uac(struct cpvt* cpvt, struct pvt* pvt, size_t frames, const struct ast_format* const fmt)
 {
+    if (pvt->uac_engine) {
+        return channel_read_uac_engine(cpvt, pvt, frames, fmt);
+    }
+
     pcm_show_state(6, "CAPTURE", PVT_ID(pvt), pvt->icard);
 
     const snd_pcm_state_t state = snd_pcm_state(pvt->icard);
     switch (state) {
         case SND_PCM_STATE_XRUN: {
+            PVT_STAT_INC(pvt, uac_xruns);
+            PVT_STAT_INC(pvt, uac_prepares);
             const int res = snd_pcm_prepare(pvt->ocard);
             if (res) {
                 ast_log(LOG_ERROR, "[%s][ALSA][PLAYBACK] Prepare failed - err:'%s'\n", PVT_ID(pvt), snd_strerror(res));
@@ -551,6 +795,7 @@ static struct ast_frame* channel_read_uac(struct cpvt* cpvt, struct pvt* pvt, si
         }
 
         case SND_PCM_STATE_SETUP: {
+            PVT_STAT_INC(pvt, uac_prepares);
             const int res = snd_pcm_prepare(pvt->icard);
             if (res) {
                 ast_log(LOG_ERROR, "[%s][ALSA][CAPTURE] Prepare failed - state:%s err:'%s'\n", PVT_ID(pvt), snd_pcm_state_name(state), snd_strerror(res));
@@ -582,15 +827,16 @@ static struct ast_frame* channel_read_uac(struct cpvt* cpvt, struct pvt* pvt, si
 
         default:
             if (res > 0) {
+                samples_le_to_host(buf, res);
                 if (CPVT_IS_MASTER(cpvt)) {
                     if (CPVT_TEST_FLAG(cpvt, CALL_FLAG_MULTIPARTY)) {
-                        write_conference(pvt, buf, res);
+                        write_conference(pvt, buf, res * sizeof(short));
                     }
 
-                    PVT_STAT(pvt, a_read_bytes) += res * sizeof(short);
-                    PVT_STAT(pvt, read_frames)++;
+                    PVT_STAT_ADD(pvt, a_read_bytes, res * sizeof(short));
+                    PVT_STAT_INC(pvt, read_frames);
                     if (res < frames) {
-                        PVT_STAT(pvt, read_sframes)++;
+                        PVT_STAT_INC(pvt, read_sframes);
                     }
                 }
 
@@ -610,7 +856,31 @@ static struct ast_frame* channel_read_uac(struct cpvt* cpvt, struct pvt* pvt, si
 
 #define subclass_integer subclass.integer
 
-static struct ast_frame* channel_read(struct ast_channel* channel)
+static struct ast_frame* channel_read_resample(struct cpvt* cpvt, struct ast_frame* f, int dir, struct ast_format* fmt)
+{
+    if (!cpvt->resample_buf) {
+        cpvt->resample_buf = ast_calloc(1, RESAMPLE_MAX_SAMPLES * sizeof(int16_t) + AST_FRIENDLY_OFFSET);
+        if (!cpvt->resample_buf) {
+            return &ast_null_frame;
+        }
+    }
+
+    int16_t* const buf = (int16_t*)((char*)cpvt->resample_buf + AST_FRIENDLY_OFFSET);
+    const size_t res   = resample(&cpvt->read_rs, dir, f->data.ptr, f->samples, buf);
+    if (!res) {
+        return &ast_null_frame;
+    }
+
+    /* samples are already in host byte order */
+    f->subclass.format = fmt;
+    f->samples         = res;
+    f->datalen         = res * sizeof(int16_t);
+    f->data.ptr        = buf;
+    f->offset          = AST_FRIENDLY_OFFSET;
+    return f;
+}
+
+static struct ast_frame* channel_read_device(struct ast_channel* channel)
 {
     struct cpvt* const cpvt = ast_channel_tech_pvt(channel);
     struct ast_frame* f     = NULL;
@@ -619,31 +889,38 @@ static struct ast_frame* channel_read(struct ast_channel* channel)
         return &ast_null_frame;
     }
 
-    struct pvt* const pvt = cpvt->pvt;
-    SCOPED_CPVT_TL(cpvt_lock, cpvt);
-
-    ast_debug(8, "[%s] Read - idx:%d state:%s audio_fd:%d\n", PVT_ID(pvt), cpvt->call_idx, call_state2str(cpvt->state), pvt->audio_fd);
-
+    struct pvt* const pvt              = cpvt->pvt;
     const int fdno                     = ast_channel_fdno(channel);
     const struct ast_format* const fmt = pvt_get_audio_format(pvt);
-    const size_t frame_size            = pvt_get_audio_frame_size(PTIME_CAPTURE, fmt);
-
-    /* FIXME: move down for enable timing_write() to device ? */
-    if (CONF_UNIQ(pvt, uac) == TRIBOOL_FALSE && (!CPVT_IS_SOUND_SOURCE(cpvt) || pvt->audio_fd < 0)) {
-        goto f_ret;
-    }
+    const size_t frame_size            = pvt_get_audio_frame_size(pvt_get_audio_ptime(pvt), fmt);
 
+    /* audio timer does not need pvt lock, mixed frames are taken from write_ring */
     if (fdno == 1) {
         ast_timer_ack(pvt->a_timer, 1);
-        if (CPVT_IS_MASTER(cpvt)) {
-            if (CONF_UNIQ(pvt, uac) > TRIBOOL_FALSE) {
-                // TODO: implement timing_write_uac
-                ast_log(LOG_WARNING, "[%s] Multiparty calls not supported in UAC mode\n", PVT_ID(pvt));
-            } else {
+        /* timer ticks every PTIME_CAPTURE ms, longer frames are due on every n-th tick */
+        if (++cpvt->timer_ticks * PTIME_CAPTURE < pvt_get_audio_ptime(pvt)) {
+            return &ast_null_frame;
+        }
+        cpvt->timer_ticks = 0;
+
+        if (CPVT_IS_MASTER(cpvt) && CONF_UNIQ(pvt, uac) == TRIBOOL_FALSE) {
+            if (CPVT_IS_SOUND_SOURCE(cpvt)) {
                 timing_write_tty(pvt, frame_size);
             }
             ast_debug(7, "[%s] *** timing ***\n", PVT_ID(pvt));
+        } else if (CPVT_IS_MASTER(cpvt)) {
+            // TODO: implement timing_write_uac
+            ast_log(LOG_WARNING, "[%s] Multiparty calls not supported in UAC mode\n", PVT_ID(pvt));
         }
+        return prepare_silence_voice_frame(cpvt, frame_size / sizeof(short), fmt);
+    }
+
+    SCOPED_CPVT_TL(cpvt_lock, cpvt);
+
+    ast_debug(8, "[%s] Read - idx:%d state:%s audio_fd:%d\n", PVT_ID(pvt), cpvt->call_idx, call_state2str(cpvt->state), pvt->audio_fd);
+
+    /* FIXME: move down for enable timing_write() to device ? */
+    if (CONF_UNIQ(pvt, uac) == TRIBOOL_FALSE && (!CPVT_IS_SOUND_SOURCE(cpvt) || pvt->audio_fd < 0)) {
         goto f_ret;
     }
 
@@ -651,6 +928,10 @@ static struct ast_frame* channel_read(struct ast_channel* channel)
         f = channel_read_uac(cpvt, pvt, frame_size / sizeof(short), fmt);
     } else {
         f = channel_read_tty(cpvt, pvt, frame_size, fmt);
+        /* part of longer frame, nothing to pass yet */
+        if (f == &ast_null_frame) {
+            return f;
+        }
     }
 
 f_ret:
@@ -665,6 +946,22 @@ f_ret:
     }
 }
 
+static struct ast_frame* channel_read(struct ast_channel* channel)
+{
+    struct ast_frame* const f = channel_read_device(channel);
+    if (f->frametype != AST_FRAME_VOICE) {
+        return f;
+    }
+
+    struct ast_format* const fmt = ast_channel_rawreadformat(channel);
+    const int dir                = channel_resample_dir(f->subclass.format, fmt);
+    if (!dir) {
+        return f;
+    }
+
+    return channel_read_resample(ast_channel_tech_pvt(channel), f, dir, fmt);
+}
+
 static int channel_write_tty(struct ast_channel* channel, struct ast_frame* f, struct cpvt* cpvt, struct pvt* pvt)
 {
     if (CPVT_TEST_FLAG(cpvt, CALL_FLAG_MULTIPARTY) && !CPVT_TEST_FLAG(cpvt, CALL_FLAG_BRIDGE_CHECK)) {
@@ -691,7 +988,7 @@ static int channel_write_tty(struct ast_channel* channel, struct ast_frame* f, s
         int gains[2];
 
         gains[1] = mixb_streams(&pvt->write_mixb);
-        if (gains[1] < 1 || pvt->a_timer == NULL) {
+        if (gains[1] < 1 || (pvt->a_timer == NULL && pvt->a_sched == NULL)) {
             gains[1] = 1;
         }
 
@@ -712,11 +1009,12 @@ static int channel_write_tty(struct ast_channel* channel, struct ast_frame* f, s
         if (count < (size_t)f->datalen) {
             mixb_read_upd(&pvt->write_mixb, f->datalen - count);
 
-            PVT_STAT(pvt, write_rb_overflow_bytes) += f->datalen - count;
-            PVT_STAT(pvt, write_rb_overflow)++;
+            PVT_STAT_ADD(pvt, write_rb_overflow_bytes, f->datalen - count);
+            PVT_STAT_INC(pvt, write_rb_overflow);
         }
 
         mixb_write(&pvt->write_mixb, &cpvt->mixstream, f->data.ptr, f->datalen);
+        pass_mixed_frames(pvt, pvt_get_audio_frame_size(pvt_get_audio_ptime(pvt), pvt_get_audio_format(pvt)));
 
         /*
                 ast_debug (6, "[%s] write | call idx %d, %d bytes lwrite %d lused %d write %d used %d\n", PVT_ID(pvt),
@@ -733,7 +1031,7 @@ static int channel_write_tty(struct ast_channel* channel, struct ast_frame* f, s
         iov.iov_len  = f->datalen;
 
         if (iov_write(pvt, pvt->audio_fd, &iov, 1) >= 0) {
-            PVT_STAT(pvt, write_frames)++;
+            PVT_STAT_INC(pvt, write_frames);
         }
     }
 
@@ -746,11 +1044,19 @@ static int channel_write_uac(struct ast_channel* attribute_unused(channel), stru
     const int samples = f->samples;
     int res           = 0;
 
+    if (pvt->uac_engine) {
+        ast_frame_byteswap_le(f);
+        PVT_STAT_INC(pvt, write_frames);
+        return uac_engine_write(pvt->uac_engine, f->data.ptr, samples);
+    }
+
     pcm_show_state(6, "PLAYBACK", PVT_ID(pvt), pvt->ocard);
 
     const snd_pcm_state_t state = snd_pcm_state(pvt->ocard);
     switch (state) {
         case SND_PCM_STATE_XRUN: {
+            PVT_STAT_INC(pvt, uac_xruns);
+            PVT_STAT_INC(pvt, uac_prepares);
             res = snd_pcm_prepare(pvt->icard);
             if (res) {
                 ast_log(LOG_ERROR, "[%s][ALSA][CAPTURE] Prepare failed - err:'%s'\n", PVT_ID(pvt), snd_strerror(res));
@@ -758,6 +1064,7 @@ static int channel_write_uac(struct ast_channel* attribute_unused(channel), stru
             }
         }
         case SND_PCM_STATE_SETUP:
+            PVT_STAT_INC(pvt, uac_prepares);
             res = snd_pcm_prepare(pvt->ocard);
             if (res) {
                 ast_log(LOG_ERROR, "[%s][ALSA][PLAYBACK] Prepare failed - state:%s err:'%s'\n", PVT_ID(pvt), snd_pcm_state_name(state), snd_strerror(res));
@@ -800,11 +1107,11 @@ static int channel_write_uac(struct ast_channel* attribute_unused(channel), stru
         default:
             if (res >= 0) {
                 if (res != samples) {
-                    PVT_STAT(pvt, write_frames)++;
-                    PVT_STAT(pvt, write_sframes)++;
+                    PVT_STAT_INC(pvt, write_frames);
+                    PVT_STAT_INC(pvt, write_sframes);
                     ast_log(LOG_WARNING, "[%s][ALSA][PLAYBACK] Write: %d/%d\n", PVT_ID(pvt), res, samples);
                 } else {
-                    PVT_STAT(pvt, write_frames)++;
+                    PVT_STAT_INC(pvt, write_frames);
                 }
             }
             break;
@@ -837,9 +1144,32 @@ static int channel_write(struct ast_channel* channel, struct ast_frame* f)
     SCOPED_CPVT_TL(cpvt_lock, cpvt);
 
     const struct ast_format* const fmt = pvt_get_audio_format(pvt);
-    const size_t frame_size            = pvt_get_audio_frame_size(PTIME_PLAYBACK, fmt);
+    const size_t frame_size            = pvt_get_audio_frame_size(pvt_get_audio_ptime(pvt), fmt);
 
-    if (f->frametype != AST_FRAME_VOICE || ast_format_cmp(f->subclass.format, fmt) != AST_FORMAT_CMP_EQUAL) {
+    if (f->frametype != AST_FRAME_VOICE) {
+        ast_debug(1, "[%s] Unsupported audio codec: %s\n", PVT_ID(pvt), ast_format_get_name(f->subclass.format));
+        return 0;
+    }
+
+    struct ast_frame rf;
+    int16_t rbuf[RESAMPLE_MAX_SAMPLES];
+    const int dir = channel_resample_dir(f->subclass.format, fmt);
+    if (dir) {
+        const size_t samples = resample(&cpvt->write_rs, dir, f->data.ptr, f->samples, rbuf);
+        if (!samples) {
+            ast_debug(1, "[%s] Unable to convert voice frame of %d samples\n", PVT_ID(pvt), f->samples);
+            return 0;
+        }
+
+        rf                 = *f;
+        rf.subclass.format = (struct ast_format*)fmt;
+        rf.samples         = samples;
+        rf.datalen         = samples * sizeof(int16_t);
+        rf.data.ptr        = rbuf;
+        rf.offset          = 0;
+        rf.mallocd         = 0;
+        f                  = &rf;
+    } else if (ast_format_cmp(f->subclass.format, fmt) != AST_FORMAT_CMP_EQUAL) {
         ast_debug(1, "[%s] Unsupported audio codec: %s\n", PVT_ID(pvt), ast_format_get_name(f->subclass.format));
         return 0;
     }
@@ -848,7 +1178,7 @@ static int channel_write(struct ast_channel* channel, struct ast_frame* f)
 
     if (f->datalen < frame_size) {
         ast_debug(8, "[%s] Short voice frame: %d/%d, samples:%d\n", PVT_ID(pvt), f->datalen, (int)frame_size, f->samples);
-        PVT_STAT(pvt, write_tframes)++;
+        PVT_STAT_INC(pvt, write_tframes);
     } else if (f->datalen > frame_size) {
         ast_debug(8, "[%s] Large voice frame: %d/%d, samples: %d\n", PVT_ID(pvt), f->datalen, (int)frame_size, f->samples);
     }
@@ -895,21 +1225,12 @@ static int channel_devicestate(const char* data)
     const char* const device = ast_strdupa(S_OR(data, ""));
     ast_debug(1, "[%s] Checking device state\n", device);
 
+    /* changes are pushed by pvt_status_publish(), this is queried only when cache is empty */
+    /* answered from status snapshot, device is not locked */
+    RAII_VAR(struct pvt_status*, status, pvt_status_find(device), ao2_cleanup);
 
-    RAII_VAR(struct pvt* const, pvt, pvt_find_by_ext(device), pvt_unlock);
-
-    if (!pvt) {
-        return res;
-    }
-
-    if (pvt->connected) {
-        if (pvt_is_dial_possible(pvt, CALL_FLAG_NONE)) {
-            res = AST_DEVICE_NOT_INUSE;
-        } else {
-            res = AST_DEVICE_INUSE;
-        }
-    } else {
-        res = AST_DEVICE_UNAVAILABLE;
+    if (status) {
+        res = status->devicestate;
     }
     return res;
 }
@@ -1023,13 +1344,14 @@ struct ast_channel* channel_new(struct pvt* pvt, int ast_state, const char* cid_
         ast_channel_nativeformats_set(channel, cap);
     } else {
         struct ast_format* const fmt = (struct ast_format*)pvt_get_audio_format(pvt);
-#if PTIME_USE_DEFAULT
-        const unsigned int ms = ast_format_get_default_ms(fmt);
-#else
-        static const unsigned int ms = PTIME_CAPTURE;
-#endif
+        const unsigned int ms        = pvt_get_audio_ptime(pvt);
         struct ast_format_cap* const cap = ast_format_cap_alloc(AST_FORMAT_CAP_FLAG_DEFAULT);
         ast_format_cap_append(cap, fmt, ms);
+        /* other rate is converted here, peer of that rate is bridged without core translator */
+        struct ast_format* const alt = channel_alt_format(fmt);
+        if (alt) {
+            ast_format_cap_append(cap, alt, ms);
+        }
         ast_format_cap_set_framing(cap, ms);
         ast_channel_nativeformats_set(channel, cap);
 
@@ -1155,6 +1477,17 @@ void channel_start_local(struct pvt* pvt, const char* exten, const char* number,
 void channel_start_local_json(struct pvt* pvt, const char* exten, const char* number, const char* const jname, const struct ast_json* const jvar)
 {
     RAII_VAR(char* const, jstr, ast_json_dump_string((struct ast_json*)jvar), ast_json_free);
+    if (!jstr) {
+        return;
+    }
+
+    if (CONF_GLOBAL(notify) == NOTIFY_DELIVERY_EVENT) {
+        if (notifyq_push(PVT_ID(pvt), jname, number, jstr)) {
+            ast_log(LOG_WARNING, "[%s] Unable to queue %s notification\n", PVT_ID(pvt), jname);
+        }
+        return;
+    }
+
     const channel_var_t var = {jname, jstr};
     channel_start_local(pvt, exten, number, &var, 1);
 }
@@ -1175,6 +1508,12 @@ static int channel_func_read(struct ast_channel* channel, attribute_unused const
         SCOPED_CPVT_TL(cpvt_lock, cpvt);
         call_state_t state = cpvt->state;
         ast_copy_string(buf, call_state2str(state), len);
+    } else if (!strcasecmp(data, "callsetup")) {
+        SCOPED_CPVT_TL(cpvt_lock, cpvt);
+        ret = cpvt_trace_str(cpvt, buf, len);
+    } else if (!strncasecmp(data, "callsetup_", STRLEN("callsetup_"))) {
+        SCOPED_CPVT_TL(cpvt_lock, cpvt);
+        ret = cpvt_trace_stage_str(cpvt, data + STRLEN("callsetup_"), buf, len);
     } else {
         ret = -1;
     }
@@ -6,6 +6,8 @@
 
 #include "ast_config.h"
 
+#include <sys/uio.h> /* struct iovec */
+
 #include <asterisk/frame.h> /* enum ast_control_frame_type */
 
 typedef struct channel_var {
@@ -24,6 +26,18 @@ extern struct ast_channel_tech channel_tech;
 struct ast_channel* channel_new(struct pvt* pvt, int ast_state, const char* cid_num, int call_idx, unsigned dir, unsigned state, const char* exten,
                                 const struct ast_assigned_ids* assignedids, const struct ast_channel* requestor, unsigned local_channel);
 
+/* audio frame taken from write ring for timer-driven write */
+struct channel_timing_frame {
+    struct iovec iov[3]; /*!< mixed data and silence padding */
+    int iovcnt;          /*!< number of io vectors used */
+    int fd;              /*!< audio descriptor */
+    size_t release;      /*!< bytes to release from write ring when written */
+};
+
+void channel_timing_write(struct pvt* pvt);
+int channel_timing_prepare(struct pvt* pvt, struct channel_timing_frame* frame);
+void channel_timing_complete(struct pvt* pvt, const struct channel_timing_frame* frame, ssize_t written);
+
 int channel_self_request(struct pvt* pvt, const struct ast_channel* requestor);
 
 int channel_enqueue_hangup(struct ast_channel* channel, int hangupcause);
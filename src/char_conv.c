@@ -16,8 +16,17 @@
 #include <string.h> /* memcpy() */
 #include <sys/types.h>
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
 #include "ast_config.h"
 
+#include <asterisk/threadstorage.h>
+#include <asterisk/utils.h>
+
 #include "char_conv.h"
 
 #include "gsm7_luts.h"
@@ -33,55 +42,393 @@ static const char lut_hex2val[] = {
     -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1};
 static const char* lut_val2hex = "0123456789ABCDEF";
 
-static ssize_t convert_string(const char* in, size_t in_length, char* out, size_t out_size, char* from, char* to)
+#/* iconv descriptors opened once per thread, used when native codec refuses input */
+
+enum iconv_dir {
+    ICONV_UTF8_TO_UTF16BE = 0,
+    ICONV_UTF16BE_TO_UTF8,
+    ICONV_DIRS,
+};
+
+struct iconv_cache {
+    ICONV_T cd[ICONV_DIRS];
+};
+
+static int iconv_cache_init(void* data)
 {
+    struct iconv_cache* const cache = data;
+
+    for (unsigned i = 0; i < ICONV_DIRS; ++i) {
+        cache->cd[i] = (ICONV_T)-1;
+    }
+    return 0;
+}
+
+static void iconv_cache_cleanup(void* data)
+{
+    struct iconv_cache* const cache = data;
+
+    for (unsigned i = 0; i < ICONV_DIRS; ++i) {
+        if (cache->cd[i] != (ICONV_T)-1) {
+            iconv_close(cache->cd[i]);
+        }
+    }
+    ast_free(cache);
+}
+
+AST_THREADSTORAGE_CUSTOM(iconv_cache_buf, iconv_cache_init, iconv_cache_cleanup);
+
+static ssize_t convert_string(const char* in, size_t in_length, char* out, size_t out_size, enum iconv_dir dir)
+{
+    static const char* const names[ICONV_DIRS][2] = {
+        {"UTF-8", "UTF-16BE"},
+        {"UTF-16BE", "UTF-8"},
+    };
+
     ICONV_CONST char* in_ptr = (ICONV_CONST char*)in;
     size_t in_bytesleft      = in_length;
     char* out_ptr            = out;
     size_t out_bytesleft     = out_size - 1;
-    ICONV_T cd               = (ICONV_T)-1;
-    ssize_t res;
 
-    cd = iconv_open(to, from);
-    if (cd == (ICONV_T)-1) {
+    struct iconv_cache* const cache = ast_threadstorage_get(&iconv_cache_buf, sizeof(*cache));
+    if (!cache) {
         return -1;
     }
 
-    res = iconv(cd, &in_ptr, &in_bytesleft, &out_ptr, &out_bytesleft);
+    if (cache->cd[dir] == (ICONV_T)-1) {
+        cache->cd[dir] = iconv_open(names[dir][1], names[dir][0]);
+        if (cache->cd[dir] == (ICONV_T)-1) {
+            return -1;
+        }
+    } else {
+        /* reset shift state left by previous failed conversion */
+        iconv(cache->cd[dir], NULL, NULL, NULL, NULL);
+    }
+
+    const ssize_t res = iconv(cache->cd[dir], &in_ptr, &in_bytesleft, &out_ptr, &out_bytesleft);
     if (res < 0) {
-        iconv_close(cd);
         return -1;
     }
 
-    iconv_close(cd);
-
     return out_ptr - out;
 }
 
+#/* native codec, output limits are same as of convert_string() */
+
+static ssize_t utf8_to_utf16be(const uint8_t* in, size_t in_length, uint8_t* out, size_t out_size)
+{
+    static const uint32_t min_cp[] = {0, 0, 0x80, 0x800, 0x10000};
+
+    size_t i = 0, o = 0;
+
+    while (i < in_length) {
+#if defined(__SSE2__)
+        /* block of ASCII characters */
+        if (in_length - i >= 16u && out_size - o >= 32u) {
+            const __m128i v = _mm_loadu_si128((const __m128i*)(in + i));
+            if (!_mm_movemask_epi8(v)) {
+                const __m128i zero = _mm_setzero_si128();
+                _mm_storeu_si128((__m128i*)(out + o), _mm_unpacklo_epi8(zero, v));
+                _mm_storeu_si128((__m128i*)(out + o + 16u), _mm_unpackhi_epi8(zero, v));
+                i += 16u;
+                o += 32u;
+                continue;
+            }
+        }
+#endif
+        const uint8_t c = in[i];
+        uint32_t cp;
+        unsigned n;
+
+        if (c < 0x80u) {
+            cp = c;
+            n  = 1;
+        } else if ((c & 0xE0u) == 0xC0u) {
+            cp = c & 0x1Fu;
+            n  = 2;
+        } else if ((c & 0xF0u) == 0xE0u) {
+            cp = c & 0x0Fu;
+            n  = 3;
+        } else if ((c & 0xF8u) == 0xF0u) {
+            cp = c & 0x07u;
+            n  = 4;
+        } else {
+            return -1;
+        }
+
+        if (in_length - i < n) {
+            return -1;
+        }
+
+        for (unsigned k = 1; k < n; ++k) {
+            const uint8_t b = in[i + k];
+            if ((b & 0xC0u) != 0x80u) {
+                return -1;
+            }
+            cp = (cp << 6) | (b & 0x3Fu);
+        }
+
+        if (cp < min_cp[n] || cp > 0x10FFFFu || (cp >= 0xD800u && cp <= 0xDFFFu)) {
+            return -1;
+        }
+        i += n;
+
+        if (cp >= 0x10000u) {
+            if (out_size - o < 4u) {
+                return -1;
+            }
+            cp          -= 0x10000u;
+            out[o]       = (uint8_t)(0xD8u | (cp >> 18));
+            out[o + 1u]  = (uint8_t)(cp >> 10);
+            out[o + 2u]  = (uint8_t)(0xDCu | ((cp >> 8) & 0x03u));
+            out[o + 3u]  = (uint8_t)cp;
+            o           += 4u;
+        } else {
+            if (out_size - o < 2u) {
+                return -1;
+            }
+            out[o]      = (uint8_t)(cp >> 8);
+            out[o + 1u] = (uint8_t)cp;
+            o          += 2u;
+        }
+    }
+
+    return (ssize_t)o;
+}
+
+static ssize_t utf16be_to_utf8(const uint8_t* in, size_t in_length, uint8_t* out, size_t out_size)
+{
+    size_t i = 0, o = 0;
+
+    in_length &= ~(size_t)1;
+
+    while (i < in_length) {
+#if defined(__SSE2__)
+        /* block of ASCII characters */
+        if (in_length - i >= 32u && out_size - o >= 16u) {
+            const __m128i a    = _mm_loadu_si128((const __m128i*)(in + i));
+            const __m128i b    = _mm_loadu_si128((const __m128i*)(in + i + 16u));
+            const __m128i mask = _mm_set1_epi16((short)0x80FF);
+            const __m128i bits = _mm_and_si128(_mm_or_si128(a, b), mask);
+            if (_mm_movemask_epi8(_mm_cmpeq_epi8(bits, _mm_setzero_si128())) == 0xFFFF) {
+                _mm_storeu_si128((__m128i*)(out + o), _mm_packus_epi16(_mm_srli_epi16(a, 8), _mm_srli_epi16(b, 8)));
+                i += 32u;
+                o += 16u;
+                continue;
+            }
+        }
+#endif
+        uint32_t cp = ((uint32_t)in[i] << 8) | in[i + 1u];
+        i          += 2u;
+
+        if (cp >= 0xD800u && cp <= 0xDFFFu) {
+            if (cp >= 0xDC00u || in_length - i < 2u) {
+                return -1;
+            }
+
+            const uint32_t lo = ((uint32_t)in[i] << 8) | in[i + 1u];
+            if (lo < 0xDC00u || lo > 0xDFFFu) {
+                return -1;
+            }
+            i  += 2u;
+            cp  = 0x10000u + ((cp - 0xD800u) << 10) + (lo - 0xDC00u);
+        }
+
+        if (cp < 0x80u) {
+            if (out_size - o < 1u) {
+                return -1;
+            }
+            out[o++] = (uint8_t)cp;
+        } else if (cp < 0x800u) {
+            if (out_size - o < 2u) {
+                return -1;
+            }
+            out[o++] = (uint8_t)(0xC0u | (cp >> 6));
+            out[o++] = (uint8_t)(0x80u | (cp & 0x3Fu));
+        } else if (cp < 0x10000u) {
+            if (out_size - o < 3u) {
+                return -1;
+            }
+            out[o++] = (uint8_t)(0xE0u | (cp >> 12));
+            out[o++] = (uint8_t)(0x80u | ((cp >> 6) & 0x3Fu));
+            out[o++] = (uint8_t)(0x80u | (cp & 0x3Fu));
+        } else {
+            if (out_size - o < 4u) {
+                return -1;
+            }
+            out[o++] = (uint8_t)(0xF0u | (cp >> 18));
+            out[o++] = (uint8_t)(0x80u | ((cp >> 12) & 0x3Fu));
+            out[o++] = (uint8_t)(0x80u | ((cp >> 6) & 0x3Fu));
+            out[o++] = (uint8_t)(0x80u | (cp & 0x3Fu));
+        }
+    }
+
+    return (ssize_t)o;
+}
+
 ssize_t utf8_to_ucs2(const char* in, size_t in_length, uint16_t* out, size_t out_size)
 {
-    ssize_t res = convert_string(in, in_length, (char*)out, out_size * 2, "UTF-8", "UTF-16BE");
+    if (!out_size) {
+        return -1;
+    }
+
+    ssize_t res = utf8_to_utf16be((const uint8_t*)in, in_length, (uint8_t*)out, out_size * 2 - 1);
     if (res < 0) {
-        return res;
+        res = convert_string(in, in_length, (char*)out, out_size * 2, ICONV_UTF8_TO_UTF16BE);
+        if (res < 0) {
+            return res;
+        }
     }
     return res / 2;
 }
 
 ssize_t ucs2_to_utf8(const uint16_t* in, size_t in_length, char* out, size_t out_size)
 {
-    return convert_string((const char*)in, in_length * 2, out, out_size, "UTF-16BE", "UTF-8");
+    return ucs2_bytes_to_utf8((const uint8_t*)in, in_length * 2, out, out_size);
+}
+
+ssize_t ucs2_bytes_to_utf8(const uint8_t* in, size_t in_length, char* out, size_t out_size)
+{
+    if (!out_size) {
+        return -1;
+    }
+
+    const ssize_t res = utf16be_to_utf8(in, in_length, (uint8_t*)out, out_size - 1);
+    if (res < 0) {
+        return convert_string((const char*)in, in_length, out, out_size, ICONV_UTF16BE_TO_UTF8);
+    }
+    return res;
 }
 
 static char hexchar2val(unsigned char h) { return lut_hex2val[h]; }
 
 static char val2hexchar(unsigned char h) { return lut_val2hex[h]; }
 
+#/* hex kernels, blocks are loaded before stored, so in-place conversion is possible */
+
+#if defined(__SSE2__)
+
+/* 16 bytes to 32 characters */
+static void hexify_block(const uint8_t* in, char* out)
+{
+    const __m128i v    = _mm_loadu_si128((const __m128i*)in);
+    const __m128i mask = _mm_set1_epi8(0x0F);
+    const __m128i hi   = _mm_and_si128(_mm_srli_epi16(v, 4), mask);
+    const __m128i lo   = _mm_and_si128(v, mask);
+    const __m128i nine = _mm_set1_epi8(9);
+    const __m128i zero = _mm_set1_epi8('0');
+    const __m128i gap  = _mm_set1_epi8('A' - '0' - 10);
+    const __m128i a    = _mm_unpacklo_epi8(hi, lo);
+    const __m128i b    = _mm_unpackhi_epi8(hi, lo);
+
+    _mm_storeu_si128((__m128i*)out, _mm_add_epi8(_mm_add_epi8(a, zero), _mm_and_si128(_mm_cmpgt_epi8(a, nine), gap)));
+    _mm_storeu_si128((__m128i*)(out + 16), _mm_add_epi8(_mm_add_epi8(b, zero), _mm_and_si128(_mm_cmpgt_epi8(b, nine), gap)));
+}
+
+/* nibbles of 16 characters, -1 if any is not hex digit */
+static int unhex_nibbles(__m128i c, __m128i* val)
+{
+    const __m128i d     = _mm_sub_epi8(c, _mm_set1_epi8('0'));
+    const __m128i l     = _mm_sub_epi8(_mm_or_si128(c, _mm_set1_epi8(0x20)), _mm_set1_epi8('a'));
+    const __m128i digit = _mm_cmpeq_epi8(_mm_min_epu8(d, _mm_set1_epi8(9)), d);
+    const __m128i alpha = _mm_cmpeq_epi8(_mm_min_epu8(l, _mm_set1_epi8(5)), l);
+
+    if (_mm_movemask_epi8(_mm_or_si128(digit, alpha)) != 0xFFFF) {
+        return -1;
+    }
+
+    *val = _mm_or_si128(_mm_and_si128(digit, d), _mm_andnot_si128(digit, _mm_add_epi8(l, _mm_set1_epi8(10))));
+    return 0;
+}
+
+/* 32 characters to 16 bytes */
+static int unhex_block(const char* in, uint8_t* out)
+{
+    const __m128i mask = _mm_set1_epi16(0x00FF);
+    __m128i a, b;
+
+    if (unhex_nibbles(_mm_loadu_si128((const __m128i*)in), &a) || unhex_nibbles(_mm_loadu_si128((const __m128i*)(in + 16)), &b)) {
+        return -1;
+    }
+
+    /* even character is high nibble */
+    a = _mm_or_si128(_mm_slli_epi16(_mm_and_si128(a, mask), 4), _mm_srli_epi16(a, 8));
+    b = _mm_or_si128(_mm_slli_epi16(_mm_and_si128(b, mask), 4), _mm_srli_epi16(b, 8));
+    _mm_storeu_si128((__m128i*)out, _mm_packus_epi16(a, b));
+    return 0;
+}
+
+#define HEX_BLOCK 16u
+
+#elif defined(__ARM_NEON) || defined(__aarch64__)
+
+static int neon_all(uint8x16_t mask)
+{
+    const uint8x8_t m = vand_u8(vget_low_u8(mask), vget_high_u8(mask));
+    return vget_lane_u64(vreinterpret_u64_u8(m), 0) == ~(uint64_t)0;
+}
+
+static uint8x16_t hexify_nibbles(uint8x16_t n) { return vaddq_u8(vaddq_u8(n, vdupq_n_u8('0')), vandq_u8(vcgtq_u8(n, vdupq_n_u8(9)), vdupq_n_u8('A' - '0' - 10))); }
+
+/* 16 bytes to 32 characters */
+static void hexify_block(const uint8_t* in, char* out)
+{
+    const uint8x16_t v = vld1q_u8(in);
+    uint8x16x2_t hex;
+
+    hex.val[0] = hexify_nibbles(vshrq_n_u8(v, 4));
+    hex.val[1] = hexify_nibbles(vandq_u8(v, vdupq_n_u8(0x0F)));
+    vst2q_u8((uint8_t*)out, hex);
+}
+
+/* nibbles of 16 characters, -1 if any is not hex digit */
+static int unhex_nibbles(uint8x16_t c, uint8x16_t* val)
+{
+    const uint8x16_t d     = vsubq_u8(c, vdupq_n_u8('0'));
+    const uint8x16_t l     = vsubq_u8(vorrq_u8(c, vdupq_n_u8(0x20)), vdupq_n_u8('a'));
+    const uint8x16_t digit = vcltq_u8(d, vdupq_n_u8(10));
+    const uint8x16_t alpha = vcltq_u8(l, vdupq_n_u8(6));
+
+    if (!neon_all(vorrq_u8(digit, alpha))) {
+        return -1;
+    }
+
+    *val = vbslq_u8(digit, d, vaddq_u8(l, vdupq_n_u8(10)));
+    return 0;
+}
+
+/* 32 characters to 16 bytes */
+static int unhex_block(const char* in, uint8_t* out)
+{
+    const uint8x16x2_t c = vld2q_u8((const uint8_t*)in);
+    uint8x16_t hi, lo;
+
+    if (unhex_nibbles(c.val[0], &hi) || unhex_nibbles(c.val[1], &lo)) {
+        return -1;
+    }
+
+    vst1q_u8(out, vorrq_u8(vshlq_n_u8(hi, 4), lo));
+    return 0;
+}
+
+#define HEX_BLOCK 16u
+
+#endif
+
 int unhex(const char* in, uint8_t* out)
 {
-    int len = 0, nibbles = 0;
-    while (in[0]) {
-        nibbles += 1 + !!in[1];
+    const size_t nibbles = strlen(in);
+    size_t len           = 0;
+
+#if defined(HEX_BLOCK)
+    for (; nibbles - len * 2u >= HEX_BLOCK * 2u; len += HEX_BLOCK, in += HEX_BLOCK * 2u) {
+        if (unhex_block(in, out + len)) {
+            return -1;
+        }
+    }
+#endif
 
+    while (in[0]) {
         const char p0 = hexchar2val(*in++);
         const char p1 = *in ? hexchar2val(*in++) : 0;
 
@@ -90,18 +437,27 @@ int unhex(const char* in, uint8_t* out)
         }
         out[len++] = p0 << 4 | p1;
     }
-    return nibbles;
+    return (int)nibbles;
 }
 
 void hexify(const uint8_t* in, size_t in_length, char* out)
 {
+    size_t i = in_length;
+
+    out[in_length * 2] = '\0';
+
     // code from end of string to allow in-place encoding
-    for (int i = in_length - 1; i >= 0; --i) {
+#if defined(HEX_BLOCK)
+    for (; i >= HEX_BLOCK; i -= HEX_BLOCK) {
+        hexify_block(in + i - HEX_BLOCK, out + (i - HEX_BLOCK) * 2u);
+    }
+#endif
+
+    while (i--) {
         char c0 = val2hexchar(in[i] >> 4), c1 = val2hexchar(in[i] & 15);
         out[i * 2]     = c0;
         out[i * 2 + 1] = c1;
     }
-    out[in_length * 2] = '\0';
 }
 
 #/* */
@@ -121,9 +477,20 @@ ssize_t gsm7_encode(const uint16_t* in, size_t in_length, uint16_t* out)
     // TODO: Should we check for other tables or just use UCS-2?
     unsigned bytes        = 0;
     const uint8_t* escenc = get_char_gsm7_encoding(0x1B00);
+
+    /* characters of message mostly share the subtable, keep last one */
+    const uint8_t(*subtab)[sizeof(LUT_GSM7_REV2_INV)] = NULL;
+    int last_major                                    = -1;
+
     for (unsigned i = 0; i < in_length; ++i) {
-        const uint8_t* enc = get_char_gsm7_encoding(in[i]);
-        uint8_t c          = enc[0];
+        const int minor = in[i] >> 8, major = in[i] & 255;
+        if (major != last_major) {
+            const int idx = LUT_GSM7_REV1[major];
+            subtab        = idx == -1 ? NULL : LUT_GSM7_REV2[idx];
+            last_major    = major;
+        }
+
+        uint8_t c = subtab ? subtab[minor][0] : LUT_GSM7_REV2_INV[0];
         if (c == GSM7_INVALID) {
             return -1;
         }
@@ -138,10 +505,37 @@ ssize_t gsm7_encode(const uint16_t* in, size_t in_length, uint16_t* out)
     return bytes;
 }
 
+#/* septets are packed little-endian, eight septets fill seven bytes */
+
+/* eight septets in bytes of word to 56 bits */
+static uint64_t gsm7_pack8(uint64_t w)
+{
+    w = (w & UINT64_C(0x007F007F007F007F)) | ((w & UINT64_C(0x7F007F007F007F00)) >> 1);
+    w = (w & UINT64_C(0x00003FFF00003FFF)) | ((w & UINT64_C(0x3FFF00003FFF0000)) >> 2);
+    return (w & UINT64_C(0x000000000FFFFFFF)) | ((w & UINT64_C(0x0FFFFFFF00000000)) >> 4);
+}
+
+/* 56 bits to eight septets in bytes of word */
+static uint64_t gsm7_unpack8(uint64_t w)
+{
+    w = (w & UINT64_C(0x000000000FFFFFFF)) | ((w << 4) & UINT64_C(0x0FFFFFFF00000000));
+    w = (w & UINT64_C(0x00003FFF00003FFF)) | ((w << 2) & UINT64_C(0x3FFF00003FFF0000));
+    return (w & UINT64_C(0x007F007F007F007F)) | ((w << 1) & UINT64_C(0x7F007F007F007F00));
+}
+
+static uint64_t load_le64(const uint8_t* p)
+{
+    uint64_t w = 0;
+    for (unsigned i = 0; i < 8u; ++i) {
+        w |= (uint64_t)p[i] << (i * 8u);
+    }
+    return w;
+}
+
 ssize_t gsm7_pack(const uint16_t* in, size_t in_length, char* out, size_t out_size, unsigned out_padding)
 {
     size_t i, x;
-    unsigned value = 0;
+    uint64_t value = 0;
 
     /* compute number of bytes we need for the final string, rounded up */
     x = ((out_padding + (7 * in_length) + 7) / 8) + 1;
@@ -151,11 +545,30 @@ ssize_t gsm7_pack(const uint16_t* in, size_t in_length, char* out, size_t out_si
         return -1;
     }
 
-    for (x = i = 0; i != in_length; ++i) {
+    for (x = i = 0; i != in_length;) {
+        /* eight characters without escape */
+        if (in_length - i >= 8u) {
+            uint64_t w = 0, esc = 0;
+            for (unsigned k = 0; k < 8u; ++k) {
+                w   |= (uint64_t)(in[i + k] & 0x7F) << (k * 8u);
+                esc |= in[i + k] & 0xFF80;
+            }
+            if (!esc) {
+                value |= gsm7_pack8(w) << out_padding;
+                for (unsigned k = 0; k < 7u; ++k) {
+                    out[x++]   = value & 0xff;
+                    value    >>= 8;
+                }
+                i += 8u;
+                continue;
+            }
+        }
+
         char c[] = {in[i] >> 8, in[i] & 255};
+        ++i;
 
         for (int j = c[0] == 0; j < 2; ++j) {
-            value       |= (c[j] & 0x7F) << out_padding;
+            value       |= (uint64_t)(c[j] & 0x7F) << out_padding;
             out_padding += 7;
 
             if (out_padding < 8) {
@@ -175,7 +588,35 @@ ssize_t gsm7_pack(const uint16_t* in, size_t in_length, char* out, size_t out_si
     return x * 2 - (out_padding == 1 || out_padding == 2 || out_padding == 3 ? 1 : 0);
 }
 
-ssize_t gsm7_unpack_decode(const char* in, size_t in_nibbles, uint16_t* out, size_t out_size, unsigned in_padding, uint8_t ls, uint8_t ss)
+/* UTF-8 of character of basic plane, returns number of bytes or 0 if there is no room for it and terminating zero */
+static unsigned utf8_put(uint16_t cp, char* out, size_t out_size)
+{
+    if (cp < 0x80u) {
+        if (out_size < 2u) {
+            return 0;
+        }
+        out[0] = (char)cp;
+        return 1;
+    } else if (cp < 0x800u) {
+        if (out_size < 3u) {
+            return 0;
+        }
+        out[0] = (char)(0xC0u | (cp >> 6));
+        out[1] = (char)(0x80u | (cp & 0x3Fu));
+        return 2;
+    }
+
+    if (out_size < 4u) {
+        return 0;
+    }
+    out[0] = (char)(0xE0u | (cp >> 12));
+    out[1] = (char)(0x80u | ((cp >> 6) & 0x3Fu));
+    out[2] = (char)(0x80u | (cp & 0x3Fu));
+    return 3;
+}
+
+/* decode to UCS-2 into out16 or to UTF-8 into out8, out_size is in units of output */
+static inline ssize_t gsm7_unpack(const char* in, size_t in_nibbles, uint16_t* out16, char* out8, size_t out_size, unsigned in_padding, uint8_t ls, uint8_t ss)
 {
     if (ls > 13) {
         ls = 0;
@@ -183,10 +624,6 @@ ssize_t gsm7_unpack_decode(const char* in, size_t in_nibbles, uint16_t* out, siz
     if (ss > 13) {
         ss = 0;
     }
-    size_t i;
-    size_t x;
-    unsigned value = 0;
-    unsigned c;
 
     if (!out_size) {
         return -1;
@@ -194,41 +631,80 @@ ssize_t gsm7_unpack_decode(const char* in, size_t in_nibbles, uint16_t* out, siz
 
     /* check if string is empty */
     if (in_nibbles < 2) {
-        out[0] = '\0';
+        if (out8) {
+            out8[0] = '\0';
+        } else {
+            out16[0] = '\0';
+        }
         return 0;
     }
 
-    /* account for the bit padding */
-    in_padding = 7 - in_padding;
-
-    /* parse the hexstring */
-    int esc = 0;
-    for (x = i = 0; i < in_nibbles; ++i) {
-        if (x >= out_size) {
-            return -1;
+    /* septet i takes bits [in_padding + 7 * i, in_padding + 7 * i + 7) of input */
+    const uint8_t* const bytes = (const uint8_t*)in;
+    const size_t bytes_len     = (in_nibbles + 1) / 2;
+    const size_t bits          = in_nibbles * 4;
+    const size_t septets       = bits >= in_padding ? (bits - in_padding) / 7 : 0;
+
+    size_t x = 0;
+    int esc  = 0;
+    for (size_t i = 0; i < septets;) {
+        const size_t pos = in_padding + 7 * i;
+        uint64_t w;
+        unsigned n;
+
+        if (septets - i >= 8u && pos / 8 + 8u <= bytes_len) {
+            w = gsm7_unpack8(load_le64(bytes + pos / 8) >> (pos % 8));
+            n = 8u;
+        } else {
+            const unsigned shift = pos % 8;
+            w                    = bytes[pos / 8] >> shift;
+            if (shift > 1) {
+                w |= (unsigned)bytes[pos / 8 + 1] << (8 - shift);
+            }
+            n = 1u;
         }
-        c = in[i / 2];
-        if (i & 1) {
-            c >>= 4;
-        }
-        const uint8_t n  = c & 0xf;
-        value           |= n << in_padding;
-        in_padding      += 4;
-
-        while (in_padding >= 7 * 2) {
-            in_padding  -= 7;
-            value      >>= 7;
-            {
-                const uint16_t val = (esc ? LUT_GSM7_SS16 : LUT_GSM7_LS16)[esc ? ss : ls][value & 0x7f];
-                if (val == 0x1b) {
-                    esc = 1;
-                } else {
-                    esc      = 0;
-                    out[x++] = ((val & 0xff) << 8) | (val >> 8);
+
+        for (unsigned k = 0; k < n; ++k, ++i, w >>= 8) {
+            /* as decoder of every nibble did, it fails when output is full before septet */
+            if (x >= out_size) {
+                return -1;
+            }
+
+            const uint16_t val = (esc ? LUT_GSM7_SS16 : LUT_GSM7_LS16)[esc ? ss : ls][w & 0x7f];
+            if (val == 0x1b) {
+                esc = 1;
+                continue;
+            }
+
+            esc = 0;
+            if (out8) {
+                const unsigned len = utf8_put(val, out8 + x, out_size - x);
+                if (!len) {
+                    return -1;
                 }
+                x += len;
+            } else {
+                out16[x++] = ((val & 0xff) << 8) | (val >> 8);
             }
         }
     }
 
+    if (out8) {
+        out8[x] = '\0';
+    } else if (x >= out_size && in_padding + 7 * septets + 4 <= bits) {
+        /* and when nibbles are left after last septet */
+        return -1;
+    }
+
     return x;
 }
+
+ssize_t gsm7_unpack_decode(const char* in, size_t in_nibbles, uint16_t* out, size_t out_size, unsigned in_padding, uint8_t ls, uint8_t ss)
+{
+    return gsm7_unpack(in, in_nibbles, out, NULL, out_size, in_padding, ls, ss);
+}
+
+ssize_t gsm7_unpack_decode_utf8(const char* in, size_t in_nibbles, char* out, size_t out_size, unsigned in_padding, uint8_t ls, uint8_t ss)
+{
+    return gsm7_unpack(in, in_nibbles, NULL, out, out_size, in_padding, ls, ss);
+}
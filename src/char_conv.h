@@ -9,10 +9,14 @@
 
 ssize_t utf8_to_ucs2(const char* in, size_t in_length, uint16_t* out, size_t out_size);
 ssize_t ucs2_to_utf8(const uint16_t* in, size_t in_length, char* out, size_t out_size);
+/* same as ucs2_to_utf8() for UCS-2 big-endian bytes of any alignment, in_length is in bytes */
+ssize_t ucs2_bytes_to_utf8(const uint8_t* in, size_t in_length, char* out, size_t out_size);
 int unhex(const char* in, uint8_t* out);
 void hexify(const uint8_t* in, size_t in_length, char* out);
 ssize_t gsm7_encode(const uint16_t* in, size_t in_length, uint16_t* out);
 ssize_t gsm7_pack(const uint16_t* in, size_t in_length, char* out, size_t out_size, unsigned out_padding);
 ssize_t gsm7_unpack_decode(const char* in, size_t in_length, uint16_t* out, size_t out_size, unsigned in_padding, uint8_t ls, uint8_t ss);
+/* decode septets straight to UTF-8, out_size is in bytes including terminating zero, returns length of UTF-8 or -1 */
+ssize_t gsm7_unpack_decode_utf8(const char* in, size_t in_length, char* out, size_t out_size, unsigned in_padding, uint8_t ls, uint8_t ss);
 
 #endif /* CHAN_QUECTEL_CHAR_CONV_H_INCLUDED */
@@ -8,6 +8,8 @@
 
    bg <bg_one@mail.ru>
 */
+#include <inttypes.h> /* PRIu64 */
+
 #include "ast_config.h"
 
 #include <asterisk.h>
@@ -17,10 +19,15 @@
 
 #include "cli.h"
 
+#include "audio_sched.h" /* audio_sched_running() audio_sched_syscalls_rate() */
 #include "chan_quectel.h" /* devices */
 #include "error.h"
 #include "helpers.h"    /* ARRAY_LEN() send_ccwa_set() send_reset() send_sms() send_ussd() */
+#include "histogram.h"  /* hist_percentile() */
 #include "pdiscovery.h" /* pdiscovery_list_begin() pdiscovery_list_next() pdiscovery_list_end() */
+#include "pvt_status.h" /* pvt_status_get() */
+#include "smsbulk.h"    /* smsbulk_get_jobs() */
+#include "smsdb.h"      /* smsdb_memory() */
 
 #define CLI_ALIASES(fn, cmdd, usage1, usage2)                                           \
     static char* fn##_quectel(struct ast_cli_entry* e, int cmd, struct ast_cli_args* a) \
@@ -86,11 +93,15 @@ static char* cli_show_devices(struct ast_cli_entry* e, int cmd, struct ast_cli_a
 
     ast_cli(a->fd, FORMAT1, "ID", "Group", "State", "RSSI", "Mode", "Provider Name", "Model", "Firmware", "IMEI", "IMSI", "Number");
 
+    /* devices are not locked, their status snapshots are printed */
     AST_RWLIST_RDLOCK(&gpublic->devices);
     AST_RWLIST_TRAVERSE(&gpublic->devices, pvt, entry) {
-        SCOPED_MUTEX(pvt_lock, &pvt->lock);
-        ast_cli(a->fd, FORMAT2, PVT_ID(pvt), CONF_SHARED(pvt, group), pvt_str_state(pvt), pvt->rssi, pvt->act, pvt->provider_name, pvt->model, pvt->firmware,
-                pvt->imei, pvt->imsi, pvt->subscriber_number);
+        RAII_VAR(struct pvt_status*, status, pvt_status_get(pvt), ao2_cleanup);
+        if (!status) {
+            continue;
+        }
+        ast_cli(a->fd, FORMAT2, PVT_ID(pvt), status->group, status->state, status->rssi, status->act, status->provider_name, status->model, status->firmware,
+                status->imei, status->imsi, status->subscriber_number);
     }
     AST_RWLIST_UNLOCK(&gpublic->devices);
 
@@ -123,6 +134,7 @@ static char* cli_show_device_settings(struct ast_cli_entry* e, int cmd, struct a
         ast_cli(a->fd, "  Device                  : %s\n", PVT_ID(pvt));
         if (CONF_UNIQ(pvt, uac) > TRIBOOL_FALSE) {
             ast_cli(a->fd, "  Audio UAC               : %s\n", CONF_UNIQ(pvt, alsadev));
+            ast_cli(a->fd, "  UAC latency             : %s\n", dc_uac_latency2str(CONF_UNIQ(pvt, uac_latency)));
         } else {
             ast_cli(a->fd, "  Audio                   : %s\n", CONF_UNIQ(pvt, audio_tty));
         }
@@ -136,6 +148,7 @@ static char* cli_show_device_settings(struct ast_cli_entry* e, int cmd, struct a
         ast_cli(a->fd, "  Group                   : %d\n", CONF_SHARED(pvt, group));
         ast_cli(a->fd, "  Used Notifications      : %s\n", S_COR(CONF_SHARED(pvt, dsci), "DSCI", "CCINFO"));
         ast_cli(a->fd, "  16kHz audio             : %s\n", AST_CLI_YESNO(CONF_UNIQ(pvt, slin16)));
+        ast_cli(a->fd, "  Audio frame             : %u ms\n", pvt_get_audio_ptime(pvt));
         ast_cli(a->fd, "  RX gain                 : %d\n", CONF_SHARED(pvt, rxgain));
         ast_cli(a->fd, "  TX gain                 : %d\n", CONF_SHARED(pvt, txgain));
         ast_cli(a->fd, "  Use CallingPres         : %s\n", AST_CLI_YESNO(CONF_SHARED(pvt, usecallingpres)));
@@ -188,6 +201,8 @@ static char* cli_show_device_state(struct ast_cli_entry* e, int cmd, struct ast_
         ast_cli(a->fd, "  State                   : %s\n", ast_str_buffer(state_str));
         if (CONF_UNIQ(pvt, uac) > TRIBOOL_FALSE) {
             ast_cli(a->fd, "  Audio UAC               : %s\n", CONF_UNIQ(pvt, alsadev));
+            ast_cli(a->fd, "  UAC buffer              : %u ms, start %u ms, level %u\n", pvt->uac_tuning.buffer_ms, pvt->uac_tuning.start_ms,
+                    pvt->uac_level);
         } else {
             ast_cli(a->fd, "  Audio                   : %s\n", PVT_STATE(pvt, audio_tty));
         }
@@ -243,7 +258,7 @@ CLI_ALIASES(cli_show_device_state, "show device state", "show device state <devi
 
 #/* */
 
-static int32_t getACD(uint32_t calls, uint32_t duration)
+static int32_t getACD(uint64_t calls, uint64_t duration)
 {
     int32_t acd;
 
@@ -258,7 +273,7 @@ static int32_t getACD(uint32_t calls, uint32_t duration)
 
 #/* */
 
-static int32_t getASR(uint32_t total, uint32_t handled)
+static int32_t getASR(uint64_t total, uint64_t handled)
 {
     int32_t asr;
 
@@ -285,61 +300,94 @@ static char* cli_show_device_statistics(struct ast_cli_entry* e, int cmd, struct
         return CLI_SHOWUSAGE;
     }
 
-    RAII_VAR(struct pvt* const, pvt, pvt_find(a->argv[4]), pvt_unlock);
+    pvt_stat_t stat;
 
-    if (pvt) {
+    /* counters are read without device lock */
+    if (!pvt_get_stat_by_id(a->argv[4], &stat)) {
         ast_cli(a->fd, "-------------- Statistics -------------\n");
-        ast_cli(a->fd, "  Device                      : %s\n", PVT_ID(pvt));
-        ast_cli(a->fd, "  Queue tasks                 : %u\n", PVT_STAT(pvt, at_tasks));
-        ast_cli(a->fd, "  Queue commands              : %u\n", PVT_STAT(pvt, at_cmds));
-        ast_cli(a->fd, "  Responses                   : %u\n", PVT_STAT(pvt, at_responses));
-        ast_cli(a->fd, "  Bytes of read responses     : %u\n", PVT_STAT(pvt, d_read_bytes));
-        ast_cli(a->fd, "  Bytes of written commands   : %u\n", PVT_STAT(pvt, d_write_bytes));
-        ast_cli(a->fd, "  Bytes of read audio         : %llu\n", (unsigned long long int)PVT_STAT(pvt, a_read_bytes));
-        ast_cli(a->fd, "  Bytes of written audio      : %llu\n", (unsigned long long int)PVT_STAT(pvt, a_write_bytes));
-        ast_cli(a->fd, "  Readed frames               : %u\n", PVT_STAT(pvt, read_frames));
-        ast_cli(a->fd, "  Readed short frames         : %u\n", PVT_STAT(pvt, read_sframes));
-        ast_cli(a->fd, "  Wrote frames                : %u\n", PVT_STAT(pvt, write_frames));
-        ast_cli(a->fd, "  Wrote short frames          : %u\n", PVT_STAT(pvt, write_tframes));
-        ast_cli(a->fd, "  Wrote silence frames        : %u\n", PVT_STAT(pvt, write_sframes));
-        ast_cli(a->fd, "  Write buffer overflow bytes : %llu\n", (unsigned long long int)PVT_STAT(pvt, write_rb_overflow_bytes));
-        ast_cli(a->fd, "  Write buffer overflow count : %u\n", PVT_STAT(pvt, write_rb_overflow));
-        ast_cli(a->fd, "  Incoming calls              : %u\n", PVT_STAT(pvt, in_calls));
-        ast_cli(a->fd, "  Waiting calls               : %u\n", PVT_STAT(pvt, cw_calls));
-        ast_cli(a->fd, "  Handled input calls         : %u\n", PVT_STAT(pvt, in_calls_handled));
-        ast_cli(a->fd, "  Fails to PBX run            : %u\n", PVT_STAT(pvt, in_pbx_fails));
-        ast_cli(a->fd, "  Attempts to outgoing calls  : %u\n", PVT_STAT(pvt, out_calls));
-        ast_cli(a->fd, "  Answered outgoing calls     : %u\n", PVT_STAT(pvt, calls_answered[CALL_DIR_OUTGOING]));
-        ast_cli(a->fd, "  Answered incoming calls     : %u\n", PVT_STAT(pvt, calls_answered[CALL_DIR_INCOMING]));
-        ast_cli(a->fd, "  Seconds of outgoing calls   : %u\n", PVT_STAT(pvt, calls_duration[CALL_DIR_OUTGOING]));
-        ast_cli(a->fd, "  Seconds of incoming calls   : %u\n", PVT_STAT(pvt, calls_duration[CALL_DIR_INCOMING]));
+        ast_cli(a->fd, "  Device                      : %s\n", a->argv[4]);
+        ast_cli(a->fd, "  Queue tasks                 : %" PRIu64 "\n", PVT_STAT_T(&stat, at_tasks));
+        ast_cli(a->fd, "  Queue commands              : %" PRIu64 "\n", PVT_STAT_T(&stat, at_cmds));
+        ast_cli(a->fd, "  Pipelined commands          : %" PRIu64 "\n", PVT_STAT_T(&stat, at_pipelined));
+        ast_cli(a->fd, "  Responses                   : %" PRIu64 "\n", PVT_STAT_T(&stat, at_responses));
+        ast_cli(a->fd, "  Response buffers reused     : %" PRIu64 "\n", PVT_STAT_T(&stat, at_respool_hits));
+        ast_cli(a->fd, "  Response buffers allocated  : %" PRIu64 "\n", PVT_STAT_T(&stat, at_respool_misses));
+        ast_cli(a->fd, "  AT tasks reused             : %" PRIu64 "\n", PVT_STAT_T(&stat, at_taskpool_hits));
+        ast_cli(a->fd, "  AT tasks allocated          : %" PRIu64 "\n", PVT_STAT_T(&stat, at_taskpool_misses));
+        ast_cli(a->fd, "  AT tasks preempted          : %" PRIu64 "\n", PVT_STAT_T(&stat, at_preempted));
+        ast_cli(a->fd, "  Periodic polls              : %" PRIu64 "\n", PVT_STAT_T(&stat, polls));
+        ast_cli(a->fd, "  Periodic polls skipped      : %" PRIu64 "\n", PVT_STAT_T(&stat, polls_skipped));
+        ast_cli(a->fd, "  Scratch arena high-water    : %" PRIu64 "\n", PVT_STAT_T(&stat, at_scratch_high_water));
+        ast_cli(a->fd, "  Scratch arena spills        : %" PRIu64 "\n", PVT_STAT_T(&stat, at_scratch_spills));
+        ast_cli(a->fd, "  Receive buffer size         : %" PRIu64 "\n", PVT_STAT_T(&stat, at_rb_size));
+        ast_cli(a->fd, "  Receive buffer high-water   : %" PRIu64 "\n", PVT_STAT_T(&stat, at_rb_high_water));
+        ast_cli(a->fd, "  Receive buffer grows        : %" PRIu64 "\n", PVT_STAT_T(&stat, at_rb_grows));
+        ast_cli(a->fd, "  Receive buffer overflows    : %" PRIu64 "\n", PVT_STAT_T(&stat, at_rb_overflows));
+        ast_cli(a->fd, "  Taskprocessor depth         : %" PRIu64 "\n", PVT_STAT_T(&stat, tps_depth));
+        ast_cli(a->fd, "  Taskprocessor high-water    : %" PRIu64 "\n", PVT_STAT_T(&stat, tps_high_water));
+        ast_cli(a->fd, "  Reading pauses              : %" PRIu64 "\n", PVT_STAT_T(&stat, read_pauses));
+        ast_cli(a->fd, "  Bytes of read responses     : %" PRIu64 "\n", PVT_STAT_T(&stat, d_read_bytes));
+        ast_cli(a->fd, "  Bytes of written commands   : %" PRIu64 "\n", PVT_STAT_T(&stat, d_write_bytes));
+        ast_cli(a->fd, "  Bytes of read audio         : %" PRIu64 "\n", PVT_STAT_T(&stat, a_read_bytes));
+        ast_cli(a->fd, "  Bytes of written audio      : %" PRIu64 "\n", PVT_STAT_T(&stat, a_write_bytes));
+        ast_cli(a->fd, "  Readed frames               : %" PRIu64 "\n", PVT_STAT_T(&stat, read_frames));
+        ast_cli(a->fd, "  Readed short frames         : %" PRIu64 "\n", PVT_STAT_T(&stat, read_sframes));
+        ast_cli(a->fd, "  Wrote frames                : %" PRIu64 "\n", PVT_STAT_T(&stat, write_frames));
+        ast_cli(a->fd, "  Wrote short frames          : %" PRIu64 "\n", PVT_STAT_T(&stat, write_tframes));
+        ast_cli(a->fd, "  Wrote silence frames        : %" PRIu64 "\n", PVT_STAT_T(&stat, write_sframes));
+        ast_cli(a->fd, "  Write buffer overflow bytes : %" PRIu64 "\n", PVT_STAT_T(&stat, write_rb_overflow_bytes));
+        ast_cli(a->fd, "  Write buffer overflow count : %" PRIu64 "\n", PVT_STAT_T(&stat, write_rb_overflow));
+        ast_cli(a->fd, "  Write ring underruns        : %" PRIu64 "\n", PVT_STAT_T(&stat, write_ring_underrun));
+        ast_cli(a->fd, "  Write ring overruns         : %" PRIu64 "\n", PVT_STAT_T(&stat, write_ring_overrun));
+        ast_cli(a->fd, "  Wrote concealed frames      : %" PRIu64 "\n", PVT_STAT_T(&stat, write_plc_frames));
+        ast_cli(a->fd, "  Playout drops               : %" PRIu64 "\n", PVT_STAT_T(&stat, playout_drops));
+        ast_cli(a->fd, "  Playout grows               : %" PRIu64 "\n", PVT_STAT_T(&stat, playout_grows));
+        ast_cli(a->fd, "  Playout shrinks             : %" PRIu64 "\n", PVT_STAT_T(&stat, playout_shrinks));
+        ast_cli(a->fd, "  Audio write syscalls        : %" PRIu64 "\n", PVT_STAT_T(&stat, write_syscalls));
+        ast_cli(a->fd, "  Audio short writes          : %" PRIu64 "\n", PVT_STAT_T(&stat, write_short));
+        ast_cli(a->fd, "  Audio batched writes        : %" PRIu64 "\n", PVT_STAT_T(&stat, write_batched));
+        ast_cli(a->fd, "  ALSA XRUNs                  : %" PRIu64 "\n", PVT_STAT_T(&stat, uac_xruns));
+        ast_cli(a->fd, "  ALSA prepares               : %" PRIu64 "\n", PVT_STAT_T(&stat, uac_prepares));
+        ast_cli(a->fd, "  UAC thread dropped frames   : %" PRIu64 "\n", PVT_STAT_T(&stat, uac_ring_drops));
+        if (audio_sched_running()) {
+            ast_cli(a->fd, "  Scheduler write syscalls/s  : %u\n", audio_sched_syscalls_rate());
+        }
+        ast_cli(a->fd, "  Incoming calls              : %" PRIu64 "\n", PVT_STAT_T(&stat, in_calls));
+        ast_cli(a->fd, "  Waiting calls               : %" PRIu64 "\n", PVT_STAT_T(&stat, cw_calls));
+        ast_cli(a->fd, "  Handled input calls         : %" PRIu64 "\n", PVT_STAT_T(&stat, in_calls_handled));
+        ast_cli(a->fd, "  Fails to PBX run            : %" PRIu64 "\n", PVT_STAT_T(&stat, in_pbx_fails));
+        ast_cli(a->fd, "  Attempts to outgoing calls  : %" PRIu64 "\n", PVT_STAT_T(&stat, out_calls));
+        ast_cli(a->fd, "  Answered outgoing calls     : %" PRIu64 "\n", PVT_STAT_T(&stat, calls_answered[CALL_DIR_OUTGOING]));
+        ast_cli(a->fd, "  Answered incoming calls     : %" PRIu64 "\n", PVT_STAT_T(&stat, calls_answered[CALL_DIR_INCOMING]));
+        ast_cli(a->fd, "  Seconds of outgoing calls   : %" PRIu64 "\n", PVT_STAT_T(&stat, calls_duration[CALL_DIR_OUTGOING]));
+        ast_cli(a->fd, "  Seconds of incoming calls   : %" PRIu64 "\n", PVT_STAT_T(&stat, calls_duration[CALL_DIR_INCOMING]));
         ast_cli(a->fd, "  ACD for incoming calls      : %d\n",
-                getACD(PVT_STAT(pvt, calls_answered[CALL_DIR_INCOMING]), PVT_STAT(pvt, calls_duration[CALL_DIR_INCOMING])));
+                getACD(PVT_STAT_T(&stat, calls_answered[CALL_DIR_INCOMING]), PVT_STAT_T(&stat, calls_duration[CALL_DIR_INCOMING])));
         ast_cli(a->fd, "  ACD for outgoing calls      : %d\n",
-                getACD(PVT_STAT(pvt, calls_answered[CALL_DIR_OUTGOING]), PVT_STAT(pvt, calls_duration[CALL_DIR_OUTGOING])));
+                getACD(PVT_STAT_T(&stat, calls_answered[CALL_DIR_OUTGOING]), PVT_STAT_T(&stat, calls_duration[CALL_DIR_OUTGOING])));
         /*
                 ast_cli (a->fd, "  ACD                         : %d\n",
                     getACD(
-                        PVT_STAT(pvt, calls_answered[CALL_DIR_OUTGOING])
-                        + PVT_STAT(pvt, calls_answered[CALL_DIR_INCOMING]),
+                        PVT_STAT_T(&stat, calls_answered[CALL_DIR_OUTGOING])
+                        + PVT_STAT_T(&stat, calls_answered[CALL_DIR_INCOMING]),
 
-                        PVT_STAT(pvt, calls_duration[CALL_DIR_OUTGOING])
-                        + PVT_STAT(pvt, calls_duration[CALL_DIR_INCOMING])
+                        PVT_STAT_T(&stat, calls_duration[CALL_DIR_OUTGOING])
+                        + PVT_STAT_T(&stat, calls_duration[CALL_DIR_INCOMING])
                         )
                     );
         */
         ast_cli(a->fd, "  ASR for incoming calls      : %d\n",
-                getASR(PVT_STAT(pvt, in_calls) + PVT_STAT(pvt, cw_calls), PVT_STAT(pvt, calls_answered[CALL_DIR_INCOMING])));
-        ast_cli(a->fd, "  ASR for outgoing calls      : %d\n\n", getASR(PVT_STAT(pvt, out_calls), PVT_STAT(pvt, calls_answered[CALL_DIR_OUTGOING])));
+                getASR(PVT_STAT_T(&stat, in_calls) + PVT_STAT_T(&stat, cw_calls), PVT_STAT_T(&stat, calls_answered[CALL_DIR_INCOMING])));
+        ast_cli(a->fd, "  ASR for outgoing calls      : %d\n\n", getASR(PVT_STAT_T(&stat, out_calls), PVT_STAT_T(&stat, calls_answered[CALL_DIR_OUTGOING])));
         /*
                 ast_cli (a->fd, "  ASR                         : %d\n\n",
                     getASR(
-                        PVT_STAT(pvt, out_calls)
-                        + PVT_STAT(pvt, in_calls)
-                        + PVT_STAT(pvt, cw_calls),
+                        PVT_STAT_T(&stat, out_calls)
+                        + PVT_STAT_T(&stat, in_calls)
+                        + PVT_STAT_T(&stat, cw_calls),
 
-                        PVT_STAT(pvt, calls_answered[CALL_DIR_OUTGOING])
-                        + PVT_STAT(pvt, calls_answered[CALL_DIR_INCOMING])
+                        PVT_STAT_T(&stat, calls_answered[CALL_DIR_OUTGOING])
+                        + PVT_STAT_T(&stat, calls_answered[CALL_DIR_INCOMING])
                         )
                     );
         */
@@ -352,6 +400,84 @@ static char* cli_show_device_statistics(struct ast_cli_entry* e, int cmd, struct
 
 CLI_ALIASES(cli_show_device_statistics, "show device statistics", "show device statistics <device>", "Shows the statistics of device")
 
+#/* */
+
+static void cli_show_latency(int fd, const char* name, const struct histogram* hist)
+{
+    ast_cli(fd, "  %-22s %10" PRIu64 " %10" PRIu64 " %10" PRIu64 " %10" PRIu64 " %10" PRIu64 " %10" PRIu64 "\n", name, hist->count, hist_mean(hist),
+            hist_percentile(hist, 50), hist_percentile(hist, 90), hist_percentile(hist, 99), hist->max);
+}
+
+static void cli_show_latency_timeout(int fd, unsigned int timeout, unsigned int tmin, unsigned int tmax)
+{
+    if (timeout) {
+        ast_cli(fd, " %10u\n", MIN(MAX(timeout, tmin), tmax));
+    } else {
+        ast_cli(fd, " %10s\n", "-");
+    }
+}
+
+static char* cli_show_device_latency(struct ast_cli_entry* e, int cmd, struct ast_cli_args* a)
+{
+    switch (cmd) {
+        case CLI_GENERATE:
+            if (a->pos == 4) {
+                return complete_device(a->word, a->n);
+            }
+            return NULL;
+    }
+
+    if (a->argc != 5) {
+        return CLI_SHOWUSAGE;
+    }
+
+    RAII_VAR(struct latency_snapshot*, snapshot, pvt_get_latency_by_id(a->argv[4]), ast_free);
+    if (!snapshot) {
+        ast_cli(a->fd, "Device %s not found\n", a->argv[4]);
+        return CLI_SUCCESS;
+    }
+
+    ast_cli(a->fd, "-------------- Latency, us -------------\n");
+    ast_cli(a->fd, "  Device                      : %s\n", a->argv[4]);
+    ast_cli(a->fd, "  %-22s %10s %10s %10s %10s %10s %10s\n", "", "Count", "Mean", "P50", "P90", "P99", "Max");
+    cli_show_latency(a->fd, "Response queue delay", &snapshot->tps_delay);
+    cli_show_latency(a->fd, "Audio write interval", &snapshot->audio_interval);
+    for (unsigned int i = 0; i < snapshot->at_count; ++i) {
+        cli_show_latency(a->fd, at_cmd2str(snapshot->at[i].cmd), &snapshot->at[i].rtt);
+    }
+    ast_cli(a->fd, "\n");
+
+    ast_cli(a->fd, "-------------- Call setup, us ----------\n");
+    ast_cli(a->fd, "  %-22s %10s %10s %10s %10s %10s %10s\n", "", "Count", "Mean", "P50", "P90", "P99", "Max");
+    for (unsigned int i = 0; i < CALL_TRACE_STAGES; ++i) {
+        /* first stage of direction shows whole setup, others interval from previous stage */
+        if (i == CALL_TRACE_INDICATION) {
+            cli_show_latency(a->fd, "Incoming", &snapshot->call_setup[CALL_DIR_INCOMING]);
+        } else if (i == CALL_TRACE_REQUEST) {
+            cli_show_latency(a->fd, "Outgoing", &snapshot->call_setup[CALL_DIR_OUTGOING]);
+        } else {
+            char name[32];
+            snprintf(name, sizeof(name), "  %s", call_trace2str((call_trace_t)i));
+            cli_show_latency(a->fd, name, &snapshot->call_stage[i]);
+        }
+    }
+    ast_cli(a->fd, "\n");
+
+    ast_cli(a->fd, "-------------- Command timeouts --------\n");
+    ast_cli(a->fd, "  Adaptive                    : %s\n", AST_CLI_YESNO(snapshot->adaptive));
+    ast_cli(a->fd, "  Bounds, ms                  : %u - %u\n", snapshot->timeout_min, snapshot->timeout_max);
+    ast_cli(a->fd, "  %-22s %10s %10s %10s\n", "", "SRTT, us", "RTTVAR, us", "Timeout, ms");
+    for (unsigned int i = 0; i < snapshot->at_count; ++i) {
+        ast_cli(a->fd, "  %-22s %10u %10u", at_cmd2str(snapshot->at[i].cmd), snapshot->at[i].srtt, snapshot->at[i].rttvar);
+        cli_show_latency_timeout(a->fd, snapshot->at[i].timeout, snapshot->timeout_min, snapshot->timeout_max);
+    }
+    ast_cli(a->fd, "\n");
+
+    return CLI_SUCCESS;
+}
+
+CLI_ALIASES(cli_show_device_latency, "show device latency", "show device latency <device>", "Shows latency histograms of device")
+
 static char* cli_show_version(struct ast_cli_entry* e, int cmd, struct ast_cli_args* a)
 {
     switch (cmd) {
@@ -371,6 +497,64 @@ static char* cli_show_version(struct ast_cli_entry* e, int cmd, struct ast_cli_a
 
 CLI_ALIASES(cli_show_version, "show version", "show version", "Shows the version of module")
 
+static char* cli_show_memory(struct ast_cli_entry* e, int cmd, struct ast_cli_args* a)
+{
+    struct pvt* pvt;
+    struct pvt_memory total = {0};
+
+    static const char FORMAT1[] = "%-12.12s %10s %10s %10s %10s %10s %10s %10s\n";
+    static const char FORMAT2[] = "%-12.12s %10zu %10zu %10zu %10zu %10zu %10zu %10zu\n";
+
+    switch (cmd) {
+        case CLI_GENERATE:
+            return NULL;
+    }
+
+    if (a->argc != 3) {
+        return CLI_SHOWUSAGE;
+    }
+
+    ast_cli(a->fd, FORMAT1, "ID", "Device", "AT buffer", "Responses", "AT queue", "Audio", "Channels", "Total");
+
+    AST_RWLIST_RDLOCK(&gpublic->devices);
+    AST_RWLIST_TRAVERSE(&gpublic->devices, pvt, entry) {
+        struct pvt_memory mem;
+        {
+            SCOPED_MUTEX(pvt_lock, &pvt->lock);
+            pvt_get_memory(pvt, &mem);
+        }
+
+        ast_cli(a->fd, FORMAT2, PVT_ID(pvt), mem.pvt, mem.at_rb, mem.respool, mem.at_queue, mem.audio, mem.channels,
+                mem.pvt + mem.at_rb + mem.respool + mem.at_queue + mem.audio + mem.channels);
+
+        total.pvt      += mem.pvt;
+        total.at_rb    += mem.at_rb;
+        total.respool  += mem.respool;
+        total.at_queue += mem.at_queue;
+        total.audio    += mem.audio;
+        total.channels += mem.channels;
+    }
+    AST_RWLIST_UNLOCK(&gpublic->devices);
+
+    ast_cli(a->fd, FORMAT2, "Total", total.pvt, total.at_rb, total.respool, total.at_queue, total.audio, total.channels,
+            total.pvt + total.at_rb + total.respool + total.at_queue + total.audio + total.channels);
+
+    int64_t sqlite_used, sqlite_highwater;
+    smsdb_memory(&sqlite_used, &sqlite_highwater);
+
+    unsigned int items;
+    const size_t discovery = pdiscovery_cache_memory(&items);
+
+    ast_cli(a->fd, "\n");
+    ast_cli(a->fd, "  Memory profile              : %s\n", dc_memory_profile2str(CONF_GLOBAL(memory_profile)));
+    ast_cli(a->fd, "  SMS database                : %" PRIi64 " bytes, highwater %" PRIi64 " bytes\n", sqlite_used, sqlite_highwater);
+    ast_cli(a->fd, "  Discovery cache             : %zu bytes, %u items\n", discovery, items);
+
+    return CLI_SUCCESS;
+}
+
+CLI_ALIASES(cli_show_memory, "show memory", "show memory", "Shows heap memory used by devices")
+
 static char* cli_cmd(struct ast_cli_entry* e, int cmd, struct ast_cli_args* a)
 {
     switch (cmd) {
@@ -451,6 +635,34 @@ static char* cli_sms_send(struct ast_cli_entry* e, int cmd, struct ast_cli_args*
 
 CLI_ALIASES(cli_sms_send, "sms send", "sms send <device> <number> <message>", "Send a SMS to <number> with the <message> from <device>")
 
+static char* cli_show_sms_bulk(struct ast_cli_entry* e, int cmd, struct ast_cli_args* a)
+{
+    switch (cmd) {
+        case CLI_GENERATE:
+            return NULL;
+    }
+
+    if (a->argc != 4) {
+        return CLI_SHOWUSAGE;
+    }
+
+    struct smsbulk_stat stat;
+    struct smsbulk_job_info* jobs = NULL;
+    const int count               = smsbulk_get_jobs(&jobs, &stat);
+
+    ast_cli(a->fd, "%-6s %-6s %-8s %-8s %-8s %-10s\n", "Job", "Group", "Count", "Sent", "Failed", "Rate");
+    for (int i = 0; i < count; ++i) {
+        const double rate = jobs[i].elapsed ? jobs[i].sent * 1000.0 / jobs[i].elapsed : 0.0;
+        ast_cli(a->fd, "%-6u %-6d %-8u %-8u %-8u %-10.2f\n", jobs[i].id, jobs[i].group, jobs[i].count, jobs[i].sent, jobs[i].failed, rate);
+    }
+    ast_free(jobs);
+
+    ast_cli(a->fd, "\nJobs: %u, pending: %u, sent: %lu, failed: %lu, rate: %.2f msg/s\n", stat.jobs, stat.pending, stat.sent, stat.failed, stat.rate);
+    return CLI_SUCCESS;
+}
+
+CLI_ALIASES(cli_show_sms_bulk, "show sms bulk", "show sms bulk", "Shows jobs of bulk SMS engine")
+
 static char* cli_sms_list_received_unread(struct ast_cli_entry* e, int cmd, struct ast_cli_args* a)
 {
     switch (cmd) {
@@ -662,7 +874,11 @@ static char* cli_sms_db_backup(struct ast_cli_entry* e, int cmd, struct ast_cli_
     }
 
     const int res = smsdb_backup();
-    ast_cli(a->fd, "%s\n", res ? "Backup of SMS database created" : "Cannot create backup of SMS database");
+    if (res && CONF_GLOBAL(sms_db_backup_mode) == SMSDB_BACKUP_ONLINE) {
+        ast_cli(a->fd, "Backup of SMS database started\n");
+    } else {
+        ast_cli(a->fd, "%s\n", res ? "Backup of SMS database created" : "Cannot create backup of SMS database");
+    }
 
     return CLI_SUCCESS;
 }
@@ -1152,11 +1368,14 @@ static struct ast_cli_entry cli[] = {
 	CLI_DEF_ENTRIES(cli_show_device_settings,	"Show device settings")
 	CLI_DEF_ENTRIES(cli_show_device_state,	 	"Show device state")
 	CLI_DEF_ENTRIES(cli_show_device_statistics,	"Show device statistics")
+	CLI_DEF_ENTRIES(cli_show_device_latency,	"Show device latency")
 	CLI_DEF_ENTRIES(cli_show_version,			"Show module version")
+	CLI_DEF_ENTRIES(cli_show_memory,			"Show memory usage")
 	CLI_DEF_ENTRIES(cli_cmd,					"Send commands to port for debugging")
 	CLI_DEF_ENTRIES(cli_ussd,					"Send USSD commands")
 
 	CLI_DEF_ENTRIES(cli_sms_send,					"Send message")
+	CLI_DEF_ENTRIES(cli_show_sms_bulk,				"Show bulk SMS jobs")
 	CLI_DEF_ENTRIES(cli_sms_list_received_unread,	"List unread messages")
 	CLI_DEF_ENTRIES(cli_sms_list_received_read,		"List read messages")
 	CLI_DEF_ENTRIES(cli_sms_list_all,				"List messages")
@@ -1,7 +1,9 @@
 /*
    Copyright (C) 2010,2011 bg <bg_one@mail.ru>
 */
-#include <fcntl.h>
+#include <inttypes.h>    /* PRIu64 */
+#include <sys/eventfd.h> /* eventfd() */
+#include <time.h>        /* clock_gettime() */
 #include <unistd.h>
 
 #include "ast_config.h"
@@ -14,7 +16,10 @@
 #include "at_queue.h"     /* struct at_queue_task */
 #include "chan_quectel.h" /* struct pvt */
 #include "channel.h"
-#include "mutils.h" /* ARRAY_LEN() */
+#include "histogram.h"  /* hist_add() */
+#include "mutils.h"     /* ARRAY_LEN() */
+#include "pvt_status.h" /* pvt_status_publish() */
+#include "resample.h"   /* RESAMPLE_MAX_SAMPLES */
 
 const char* attribute_const call_state2str(call_state_t state)
 {
@@ -27,72 +32,87 @@ const char* attribute_const call_state2str(call_state_t state)
     return enum2str(state, states, ARRAY_LEN(states));
 }
 
-// TODO: move to activation time, save resources
-static int init_pipe(int filedes[2])
+const char* attribute_const call_trace2str(call_trace_t stage)
 {
-    int rv = pipe(filedes);
-    if (!rv) {
-        for (int x = 0; x < 2; ++x) {
-            rv              = fcntl(filedes[x], F_GETFL);
-            const int flags = fcntl(filedes[x], F_GETFD);
-            if (rv == -1 || flags == -1 || (rv = fcntl(filedes[x], F_SETFL, O_NONBLOCK | rv)) == -1 ||
-                (rv = fcntl(filedes[x], F_SETFD, flags | FD_CLOEXEC)) == -1) {
-                goto bad;
-            }
-        }
-        return 0;
-bad:
-        close(filedes[0]);
-        close(filedes[1]);
-    }
-    return rv;
+    static const char* const stages[] = {/* incoming */
+                                         "indication", "clcc", "channel", "pbx",
+
+                                         /* outgoing */
+                                         "request", "enqueue", "written", "accepted", "answered"};
+
+    return enum2str(stage, stages, ARRAY_LEN(stages));
+}
+
+uint64_t call_trace_now()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000u + (uint64_t)ts.tv_nsec / 1000u + 1u;
 }
 
 #/* */
 
 struct cpvt* cpvt_alloc(struct pvt* pvt, int call_idx, unsigned dir, call_state_t state, unsigned local_channel)
 {
-    int fd[2] = {-1, -1};
+    int fd = -1;
 
     if (CONF_SHARED(pvt, multiparty)) {
-        if (init_pipe(fd)) {
+        fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (fd < 0) {
             return NULL;
         }
     }
 
     struct cpvt* const cpvt = ast_calloc(1, sizeof(*cpvt));
     if (!cpvt) {
-        if (CONF_SHARED(pvt, multiparty)) {
-            close(fd[0]);
-            close(fd[1]);
+        if (fd >= 0) {
+            close(fd);
         }
         return NULL;
     }
 
     const struct ast_format* const fmt = pvt_get_audio_format(pvt);
-    const size_t buffer_size           = pvt_get_audio_frame_size(PTIME_PLAYBACK, fmt);
+    const size_t buffer_size           = pvt_get_audio_frame_size(pvt_get_audio_ptime(pvt), fmt);
 
-    cpvt->pvt        = pvt;
-    cpvt->call_idx   = call_idx;
-    cpvt->state      = state;
-    cpvt->rd_pipe[0] = fd[0];
-    cpvt->rd_pipe[1] = fd[1];
-    cpvt->read_buf   = ast_calloc(1, buffer_size + AST_FRIENDLY_OFFSET);
+    cpvt->pvt      = pvt;
+    cpvt->call_idx = call_idx;
+    cpvt->state    = state;
+    cpvt->conf_fd  = fd;
+    /* local channels never read audio from device */
+    cpvt->read_buf = local_channel ? NULL : ast_calloc(1, buffer_size + AST_FRIENDLY_OFFSET);
 
     CPVT_SET_DIRECTION(cpvt, dir);
     CPVT_SET_LOCAL(cpvt, local_channel);
 
     AST_LIST_INSERT_TAIL(&pvt->chans, cpvt, entry);
+    pvt_channel_index_update(pvt, call_idx);
     if (PVT_NO_CHANS(pvt)) {
         pvt_on_create_1st_channel(pvt);
     }
     PVT_STATE(pvt, chansno)++;
     PVT_STATE(pvt, chan_count[cpvt->state])++;
+    pvt_load_update(pvt);
+    pvt_status_publish(pvt);
 
     ast_debug(3, "[%s] Create cpvt - idx:%d dir:%d state:%s buffer_len:%u\n", PVT_ID(pvt), call_idx, dir, call_state2str(state), (unsigned int)buffer_size);
     return cpvt;
 }
 
+size_t cpvt_memory(const struct cpvt* cpvt)
+{
+    size_t res = sizeof(*cpvt);
+
+    if (cpvt->read_buf) {
+        res += pvt_get_audio_frame_size(pvt_get_audio_ptime(cpvt->pvt), pvt_get_audio_format(cpvt->pvt)) + AST_FRIENDLY_OFFSET;
+    }
+    if (cpvt->resample_buf) {
+        res += RESAMPLE_MAX_SAMPLES * sizeof(int16_t) + AST_FRIENDLY_OFFSET;
+    }
+
+    return res;
+}
+
 static void decrease_chan_counters(const struct cpvt* const cpvt, struct pvt* const pvt)
 {
     struct cpvt* found;
@@ -102,6 +122,7 @@ static void decrease_chan_counters(const struct cpvt* const cpvt, struct pvt* co
             AST_LIST_REMOVE_CURRENT(entry);
             PVT_STATE(pvt, chan_count[cpvt->state])--;
             PVT_STATE(pvt, chansno)--;
+            pvt_load_update(pvt);
             break;
         }
     AST_LIST_TRAVERSE_SAFE_END;
@@ -132,17 +153,32 @@ void cpvt_free(struct cpvt* cpvt)
     }
 
     decrease_chan_counters(cpvt, pvt);
+    pvt_channel_index_update(pvt, cpvt->call_idx);
     relink_to_sys_chan(cpvt, pvt);
+    pvt_status_publish(pvt);
 
     ast_free(cpvt->read_buf);
-    cpvt->read_buf = NULL;
+    ast_free(cpvt->resample_buf);
+    cpvt->read_buf     = NULL;
+    cpvt->resample_buf = NULL;
 
-    close(cpvt->rd_pipe[1]);
-    close(cpvt->rd_pipe[0]);
+    if (cpvt->conf_fd >= 0) {
+        close(cpvt->conf_fd);
+    }
 
     ast_free(cpvt);
 }
 
+void cpvt_set_call_idx(struct cpvt* cpvt, int call_idx)
+{
+    const int old_idx = cpvt->call_idx;
+
+    cpvt->call_idx  = (short)call_idx;
+    cpvt->clcc_hash = 0;
+    pvt_channel_index_update(cpvt->pvt, old_idx);
+    pvt_channel_index_update(cpvt->pvt, call_idx);
+}
+
 void cpvt_call_disactivate(struct cpvt* const cpvt)
 {
     if (!(cpvt->pvt && CPVT_TEST_FLAG(cpvt, CALL_FLAG_ACTIVATED))) {
@@ -196,8 +232,10 @@ void cpvt_call_activate(struct cpvt* const cpvt)
             continue;
         }
 
-        ast_channel_set_fd(cpvt2->channel, 0, cpvt2->rd_pipe[PIPE_READ]);
-        ast_debug(6, "[%s] Call idx:%d FD:%d still active\n", PVT_ID(pvt), cpvt2->call_idx, cpvt2->rd_pipe[PIPE_READ]);
+        /* only frames read after activation */
+        cpvt2->conf_cursor = rb_frames_head(&pvt->conf_ring);
+        ast_channel_set_fd(cpvt2->channel, 0, cpvt2->conf_fd);
+        ast_debug(6, "[%s] Call idx:%d FD:%d still active\n", PVT_ID(pvt), cpvt2->call_idx, cpvt2->conf_fd);
     }
 
     /* setup call local write possition */
@@ -354,6 +392,20 @@ int cpvt_change_state(struct cpvt* const cpvt, call_state_t newstate, int cause)
 
     pvt_update_state_flags(pvt, oldstate, newstate);
 
+    if (newstate == CALL_STATE_ACTIVE && !cpvt->active_since) {
+        cpvt->active_since = time(NULL);
+        if (CPVT_DIR_OUTGOING(cpvt)) {
+            cpvt_trace(cpvt, CALL_TRACE_ANSWERED);
+        }
+    } else if (newstate == CALL_STATE_RELEASED && cpvt->active_since) {
+#ifndef HANDLE_CEND
+        /* without CEND duration is not reported by device */
+        PVT_STAT_ADD(pvt, calls_duration[CPVT_DIRECTION(cpvt)], (uint32_t)(time(NULL) - cpvt->active_since));
+        pvt_load_update(pvt);
+#endif
+        cpvt->active_since = 0;
+    }
+
     // U+2192 : Rightwards Arrow : 0xE2 0x86 0x92
     if (CONF_SHARED(pvt, multiparty)) {
         ast_debug(1, "[%s] Call - idx:%d channel:%s mpty:%d [%s] \xE2\x86\x92 [%s]\n", PVT_ID(pvt), call_idx, channel ? "attached" : "detached",
@@ -368,6 +420,7 @@ int cpvt_change_state(struct cpvt* const cpvt, call_state_t newstate, int cause)
     } else {
         change_state_no_channel(cpvt, pvt, newstate);
     }
+    pvt_status_publish(pvt);
     return 1;
 }
 
@@ -407,3 +460,88 @@ void cpvt_unlock(struct cpvt* const cpvt)
     }
     pvt_unlock(cpvt->pvt);
 }
+
+#/* */
+
+void cpvt_trace_at(struct cpvt* const cpvt, call_trace_t stage, uint64_t us)
+{
+    struct pvt* const pvt = cpvt->pvt;
+
+    if (!us || cpvt == &pvt->sys_chan || cpvt->trace[stage]) {
+        return;
+    }
+    cpvt->trace[stage] = us;
+
+    /* stages may be skipped, e.g. no indication before CLCC */
+    const call_trace_t first = CALL_TRACE_FIRST(stage);
+    for (int prev = (int)stage - 1; prev >= (int)first; --prev) {
+        if (cpvt->trace[prev]) {
+            hist_add(&pvt->latency.call_stage[stage], us > cpvt->trace[prev] ? us - cpvt->trace[prev] : 0u);
+            break;
+        }
+    }
+
+    if (stage != CALL_TRACE_LAST(stage)) {
+        return;
+    }
+
+    /* whole setup from earliest reached stage */
+    const unsigned int dir = first == CALL_TRACE_INDICATION ? CALL_DIR_INCOMING : CALL_DIR_OUTGOING;
+    for (unsigned int i = first; i < stage; ++i) {
+        if (cpvt->trace[i]) {
+            hist_add(&pvt->latency.call_setup[dir], us > cpvt->trace[i] ? us - cpvt->trace[i] : 0u);
+            break;
+        }
+    }
+}
+
+void cpvt_trace(struct cpvt* const cpvt, call_trace_t stage) { cpvt_trace_at(cpvt, stage, call_trace_now()); }
+
+static uint64_t cpvt_trace_start(const struct cpvt* const cpvt)
+{
+    uint64_t start = 0;
+
+    for (unsigned int i = 0; i < CALL_TRACE_STAGES; ++i) {
+        if (cpvt->trace[i] && (!start || cpvt->trace[i] < start)) {
+            start = cpvt->trace[i];
+        }
+    }
+
+    return start;
+}
+
+int cpvt_trace_str(const struct cpvt* const cpvt, char* buf, size_t len)
+{
+    const uint64_t start = cpvt_trace_start(cpvt);
+    int res              = 0;
+
+    buf[0] = '\000';
+    for (unsigned int i = 0; i < CALL_TRACE_STAGES && (size_t)res < len; ++i) {
+        if (!cpvt->trace[i]) {
+            continue;
+        }
+        const int n = snprintf(buf + res, len - res, "%s%s=%" PRIu64, res ? "," : "", call_trace2str((call_trace_t)i), cpvt->trace[i] - start);
+        if (n < 0) {
+            return -1;
+        }
+        res += n;
+    }
+
+    return start ? 0 : -1;
+}
+
+int cpvt_trace_stage_str(const struct cpvt* const cpvt, const char* name, char* buf, size_t len)
+{
+    for (unsigned int i = 0; i < CALL_TRACE_STAGES; ++i) {
+        if (strcasecmp(name, call_trace2str((call_trace_t)i))) {
+            continue;
+        }
+        if (!cpvt->trace[i]) {
+            return -1;
+        }
+        snprintf(buf, len, "%" PRIu64, cpvt->trace[i] - cpvt_trace_start(cpvt));
+        return 0;
+    }
+
+    return -1;
+}
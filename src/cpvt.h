@@ -13,6 +13,7 @@
 #include <asterisk/utils.h>
 
 #include "mixbuffer.h" /* struct mixstream */
+#include "resample.h"  /* struct resampler */
 
 typedef enum {
     CALL_STATE_MIN = 0,
@@ -55,6 +56,28 @@ call_flag_t;
 #define CALL_DIR_INCOMING 1u
 #define CALL_DIR_OUTGOING 0u
 
+/* stages of call setup, incoming then outgoing */
+typedef enum {
+    CALL_TRACE_INDICATION = 0, /*!< incoming: first RING, ^DSCI or +QIND: "cc" of call */
+    CALL_TRACE_CLCC,           /*!< incoming: call state handled */
+    CALL_TRACE_CHANNEL,        /*!< incoming: channel allocated */
+    CALL_TRACE_PBX,            /*!< incoming: pbx started */
+    CALL_TRACE_REQUEST,        /*!< outgoing: channel requested */
+    CALL_TRACE_ENQUEUE,        /*!< outgoing: dial commands queued */
+    CALL_TRACE_WRITTEN,        /*!< outgoing: ATD written to device */
+    CALL_TRACE_ACCEPTED,       /*!< outgoing: OK to ATD */
+    CALL_TRACE_ANSWERED,       /*!< outgoing: call active */
+    CALL_TRACE_STAGES
+} call_trace_t;
+
+#define CALL_TRACE_FIRST(stage) ((stage) < CALL_TRACE_REQUEST ? CALL_TRACE_INDICATION : CALL_TRACE_REQUEST)
+#define CALL_TRACE_LAST(stage) ((stage) < CALL_TRACE_REQUEST ? CALL_TRACE_PBX : CALL_TRACE_ANSWERED)
+
+const char* attribute_const call_trace2str(call_trace_t stage);
+
+/* monotonic time in microseconds, never 0 */
+uint64_t call_trace_now();
+
 typedef struct cpvt {
     AST_LIST_ENTRY(cpvt) entry; /*!< linked list pointers */
 
@@ -65,17 +88,28 @@ typedef struct cpvt {
 #define MIN_CALL_IDX 0
 #define MAX_CALL_IDX 31
 
-    call_state_t state; /*!< see also call_state_t */
-    unsigned int flags; /*!< see also call_flag_t */
+    call_state_t state;  /*!< see also call_state_t */
+    unsigned int flags;  /*!< see also call_flag_t */
+    time_t active_since; /*!< time when call became active */
 
-    int rd_pipe[2]; /*!< pipe for split read from device */
-#define PIPE_READ 0
-#define PIPE_WRITE 1
+    unsigned int clcc_hash;  /*!< hash of last handled CLCC line of call, 0 if none */
+    call_state_t clcc_state; /*!< state of call after last handled CLCC line */
+
+    int conf_fd;          /*!< eventfd signaled on new frame in conference ring of device */
+    uint64_t conf_cursor; /*!< position of next frame in conference ring */
 
     struct mixstream mixstream; /*!< mix stream */
 
     void* read_buf;              /*!< audio read buffer */
+    size_t read_used;            /*!< bytes of frame collected in read_buf */
     struct ast_frame read_frame; /*!< voice frame */
+    unsigned int timer_ticks;    /*!< audio timer ticks since last frame */
+
+    void* resample_buf;        /*!< read frame converted to rate of channel, allocated on first use */
+    struct resampler read_rs;  /*!< device to channel rate conversion */
+    struct resampler write_rs; /*!< channel to device rate conversion */
+
+    uint64_t trace[CALL_TRACE_STAGES]; /*!< monotonic time of reached setup stages in microseconds, 0 - not reached */
 } cpvt_t;
 
 #define CPVT_SET_FLAG(cpvt, flag) ast_set2_flag(cpvt, 1, flag)
@@ -101,6 +135,10 @@ typedef struct cpvt {
 struct cpvt* cpvt_alloc(struct pvt* pvt, int call_idx, unsigned dir, call_state_t statem, unsigned local_channel);
 void cpvt_free(struct cpvt* cpvt);
 
+/* number of heap bytes of channel and its audio buffers */
+size_t cpvt_memory(const struct cpvt* cpvt);
+void cpvt_set_call_idx(struct cpvt* cpvt, int call_idx);
+
 void cpvt_lock(struct cpvt* const);
 void cpvt_try_lock(struct cpvt* const);
 void cpvt_unlock(struct cpvt* const);
@@ -111,6 +149,15 @@ void cpvt_call_disactivate(struct cpvt* const cpvt);
 int cpvt_control(const struct cpvt* const cpvt, enum ast_control_frame_type control);
 int cpvt_change_state(struct cpvt* const cpvt, call_state_t newstate, int cause);
 
+/* mark setup stage reached at time us once, interval from previous reached stage is added to device histogram */
+void cpvt_trace_at(struct cpvt* const cpvt, call_trace_t stage, uint64_t us);
+void cpvt_trace(struct cpvt* const cpvt, call_trace_t stage);
+
+/* reached stages as 'stage=us,...' relative to earliest one, -1 if nothing reached */
+int cpvt_trace_str(const struct cpvt* const cpvt, char* buf, size_t len);
+/* microseconds of named stage relative to earliest one, -1 if stage unknown or not reached */
+int cpvt_trace_stage_str(const struct cpvt* const cpvt, const char* name, char* buf, size_t len);
+
 #define SCOPED_CPVT(varname, lock) SCOPED_LOCK(varname, lock, cpvt_lock, cpvt_unlock)
 #define SCOPED_CPVT_TL(varname, lock) SCOPED_LOCK(varname, lock, cpvt_try_lock, cpvt_unlock)
 
@@ -1,6 +1,8 @@
 /*
    Copyright (C) 2010 bg <bg_one@mail.ru>
 */
+#include <ptime-config.h>
+
 #include <asterisk/callerid.h> /* ast_parse_caller_presentation() */
 
 #include "dc_config.h"
@@ -12,10 +14,25 @@ static const char DEFAULT_ALSADEV_EXT[]   = "hw:0";
 static const int DEFAULT_DISCOVERY_INT    = 60;
 static const char DEFAULT_SMS_DB[]        = ":memory:";
 static const char DEFAULT_SMS_BACKUP_DB[] = "/var/lib/asterisk/smsdb-backup";
+
+static const unsigned int DEFAULT_DISCOVERY_PARALLEL = 8;
+static const unsigned int DEFAULT_SMS_DB_MMAP_SIZE   = 64;   /* MiB */
+static const unsigned int DEFAULT_SMS_DB_CACHE_SIZE  = 8192; /* KiB */
+static const unsigned int DEFAULT_SMS_BULK_DEPTH     = 2;    /* one +CMGS in flight, one waiting */
+static const unsigned int DEFAULT_THREADPOOL_IDLE    = 300;  /* seconds */
+static const unsigned int DEFAULT_TPS_HIGH_WATER     = 400;
 static const int DEFAULT_CSMS_TTL         = 600;
 
 const static long DEF_DTMF_DURATION = 120;
 
+static const unsigned int DEFAULT_AT_BUFFER = 2 * 1024;
+static const unsigned int MIN_AT_BUFFER     = 256;
+
+static const unsigned int DEFAULT_AT_TIMEOUT_MIN = 1000;  /* ms */
+static const unsigned int DEFAULT_AT_TIMEOUT_MAX = 40000; /* ms, ATQ_CMD_TIMEOUT_LONG */
+static const unsigned int DEFAULT_PLAYOUT_DEPTH  = 20;    /* ms */
+static const unsigned int DEFAULT_PLAYOUT_MAX    = 100;   /* ms */
+
 const char* attribute_const dc_cw_setting2str(call_waiting_t cw)
 {
     static const char* const options[] = {"disabled", "allowed", "auto"};
@@ -125,20 +142,144 @@ message_storage_t attribute_const dc_str2msgstor(const char* stor)
 
 const char* attribute_const dc_msgstor2str(message_storage_t stor) { return enum2str_def(stor, msgstor_strs, ARRAY_LEN(msgstor_strs), "AUTO"); }
 
+static const char* const smsdb_profile_strs[] = {"default", "performance"};
+
+smsdb_profile_t attribute_const dc_str2smsdb_profile(const char* profile)
+{
+    const int res = str2enum(profile, smsdb_profile_strs, ARRAY_LEN(smsdb_profile_strs));
+    if (res < 0) {
+        ast_log(LOG_NOTICE, "Invalid value '%s' for 'smsdb_profile', using default\n", profile);
+        return SMSDB_PROFILE_DEFAULT;
+    }
+    return (smsdb_profile_t)res;
+}
+
+const char* attribute_const dc_smsdb_profile2str(smsdb_profile_t profile)
+{
+    return enum2str_def(profile, smsdb_profile_strs, ARRAY_LEN(smsdb_profile_strs), "default");
+}
+
+static const char* const smsdb_shard_strs[] = {"none", "imsi"};
+
+smsdb_shard_t attribute_const dc_str2smsdb_shard(const char* shard)
+{
+    const int res = str2enum(shard, smsdb_shard_strs, ARRAY_LEN(smsdb_shard_strs));
+    if (res < 0) {
+        ast_log(LOG_NOTICE, "Invalid value '%s' for 'smsdb_shard', using none\n", shard);
+        return SMSDB_SHARD_NONE;
+    }
+    return (smsdb_shard_t)res;
+}
+
+const char* attribute_const dc_smsdb_shard2str(smsdb_shard_t shard) { return enum2str_def(shard, smsdb_shard_strs, ARRAY_LEN(smsdb_shard_strs), "none"); }
+
+static const char* const smsdb_backup_mode_strs[] = {"vacuum", "online"};
+
+smsdb_backup_mode_t attribute_const dc_str2smsdb_backup_mode(const char* mode)
+{
+    const int res = str2enum(mode, smsdb_backup_mode_strs, ARRAY_LEN(smsdb_backup_mode_strs));
+    if (res < 0) {
+        ast_log(LOG_NOTICE, "Invalid value '%s' for 'smsdb_backup_mode', using vacuum\n", mode);
+        return SMSDB_BACKUP_VACUUM;
+    }
+    return (smsdb_backup_mode_t)res;
+}
+
+const char* attribute_const dc_smsdb_backup_mode2str(smsdb_backup_mode_t mode)
+{
+    return enum2str_def(mode, smsdb_backup_mode_strs, ARRAY_LEN(smsdb_backup_mode_strs), "vacuum");
+}
+
+static const char* const load_metric_strs[] = {"calls", "duration"};
+
+load_metric_t attribute_const dc_str2load_metric(const char* metric)
+{
+    const int res = str2enum(metric, load_metric_strs, ARRAY_LEN(load_metric_strs));
+    if (res < 0) {
+        ast_log(LOG_NOTICE, "Invalid value '%s' for 'least_loaded', using default\n", metric);
+        return LOAD_METRIC_CALLS;
+    }
+    return (load_metric_t)res;
+}
+
+const char* attribute_const dc_load_metric2str(load_metric_t metric)
+{
+    return enum2str_def(metric, load_metric_strs, ARRAY_LEN(load_metric_strs), "calls");
+}
+
+static const char* const notify_delivery_strs[] = {"local", "event"};
+
+notify_delivery_t attribute_const dc_str2notify_delivery(const char* delivery)
+{
+    const int res = str2enum(delivery, notify_delivery_strs, ARRAY_LEN(notify_delivery_strs));
+    if (res < 0) {
+        ast_log(LOG_NOTICE, "Invalid value '%s' for 'notify', using default\n", delivery);
+        return NOTIFY_DELIVERY_LOCAL;
+    }
+    return (notify_delivery_t)res;
+}
+
+const char* attribute_const dc_notify_delivery2str(notify_delivery_t delivery)
+{
+    return enum2str_def(delivery, notify_delivery_strs, ARRAY_LEN(notify_delivery_strs), "local");
+}
+
+static const char* const memory_profile_strs[] = {"default", "compact"};
+
+memory_profile_t attribute_const dc_str2memory_profile(const char* profile)
+{
+    const int res = str2enum(profile, memory_profile_strs, ARRAY_LEN(memory_profile_strs));
+    if (res < 0) {
+        ast_log(LOG_NOTICE, "Invalid value '%s' for 'memory_profile', using default\n", profile);
+        return MEMORY_PROFILE_DEFAULT;
+    }
+    return (memory_profile_t)res;
+}
+
+const char* attribute_const dc_memory_profile2str(memory_profile_t profile)
+{
+    return enum2str_def(profile, memory_profile_strs, ARRAY_LEN(memory_profile_strs), "default");
+}
+
+static const char* const uac_latency_strs[] = {"balanced", "low", "robust", "auto"};
+
+uac_latency_t attribute_const dc_str2uac_latency(const char* latency)
+{
+    const int res = str2enum(latency, uac_latency_strs, ARRAY_LEN(uac_latency_strs));
+    if (res < 0) {
+        ast_log(LOG_NOTICE, "Invalid value '%s' for 'uac_latency', using default\n", latency);
+        return UAC_LATENCY_BALANCED;
+    }
+    return (uac_latency_t)res;
+}
+
+const char* attribute_const dc_uac_latency2str(uac_latency_t latency)
+{
+    return enum2str_def(latency, uac_latency_strs, ARRAY_LEN(uac_latency_strs), "balanced");
+}
+
 #/* assume config is zerofill */
 
 static int dc_uconfig_fill(struct ast_config* cfg, const char* cat, struct dc_uconfig* config)
 {
-    tristate_bool_t uac = TRIBOOL_FALSE;
-    int slin16          = 0;
-
-    const char* const audio_tty  = ast_variable_retrieve(cfg, cat, "audio");
-    const char* const data_tty   = ast_variable_retrieve(cfg, cat, "data");
-    const char* const alsadev    = ast_variable_retrieve(cfg, cat, "alsadev");
-    const char* imei             = ast_variable_retrieve(cfg, cat, "imei");
-    const char* imsi             = ast_variable_retrieve(cfg, cat, "imsi");
-    const char* const uac_str    = ast_variable_retrieve(cfg, cat, "uac");
-    const char* const slin16_str = ast_variable_retrieve(cfg, cat, "slin16");
+    tristate_bool_t uac       = TRIBOOL_FALSE;
+    uac_latency_t uac_latency = UAC_LATENCY_BALANCED;
+    int slin16                = 0;
+    int uac_engine            = 0;
+    unsigned int uac_priority = 0;
+    unsigned int ptime        = PTIME_CAPTURE;
+
+    const char* const audio_tty   = ast_variable_retrieve(cfg, cat, "audio");
+    const char* const data_tty    = ast_variable_retrieve(cfg, cat, "data");
+    const char* const alsadev     = ast_variable_retrieve(cfg, cat, "alsadev");
+    const char* imei              = ast_variable_retrieve(cfg, cat, "imei");
+    const char* imsi              = ast_variable_retrieve(cfg, cat, "imsi");
+    const char* const uac_str     = ast_variable_retrieve(cfg, cat, "uac");
+    const char* const latency_str = ast_variable_retrieve(cfg, cat, "uac_latency");
+    const char* const slin16_str  = ast_variable_retrieve(cfg, cat, "slin16");
+    const char* const engine_str  = ast_variable_retrieve(cfg, cat, "uac_engine");
+    const char* const prio_str    = ast_variable_retrieve(cfg, cat, "uac_priority");
+    const char* const ptime_str   = ast_variable_retrieve(cfg, cat, "ptime");
 
     if (imei && strlen(imei) != IMEI_SIZE) {
         ast_log(LOG_WARNING, "[%s] Ignore invalid IMEI value '%s'\n", cat, imei);
@@ -157,10 +298,38 @@ static int dc_uconfig_fill(struct ast_config* cfg, const char* cat, struct dc_uc
         }
     }
 
+    if (latency_str) {
+        uac_latency = dc_str2uac_latency(latency_str);
+    }
+
     if (slin16_str) {
         slin16 = parse_on_off("slin16", slin16_str, 0u);
     }
 
+    if (engine_str) {
+        uac_engine = parse_on_off("uac_engine", engine_str, 0u);
+    }
+
+    if (prio_str) {
+        errno          = 0;
+        const long tmp = strtol(prio_str, (char**)NULL, 10);
+        if ((!tmp && errno == EINVAL) || tmp < 0 || tmp > 99) {
+            ast_log(LOG_NOTICE, "[%s] Error parsing 'uac_priority', using default scheduling\n", cat);
+        } else {
+            uac_priority = (unsigned int)tmp;
+        }
+    }
+
+    if (ptime_str) {
+        errno          = 0;
+        const long tmp = strtol(ptime_str, (char**)NULL, 10);
+        if ((!tmp && errno == EINVAL) || tmp < PTIME_CAPTURE || tmp > 3 * PTIME_CAPTURE || tmp % PTIME_CAPTURE) {
+            ast_log(LOG_NOTICE, "[%s] Error parsing 'ptime', using value %u\n", cat, ptime);
+        } else {
+            ptime = (unsigned int)tmp;
+        }
+    }
+
     if (!data_tty && !imei && !imsi) {
         ast_log(LOG_ERROR, "Skipping device %s. Missing required data_tty setting\n", cat);
         return 1;
@@ -185,7 +354,11 @@ static int dc_uconfig_fill(struct ast_config* cfg, const char* cat, struct dc_uc
             ast_copy_string(config->alsadev, S_OR(alsadev, DEFAULT_ALSADEV), sizeof(config->alsadev));
             break;
     }
-    config->slin16 = (unsigned int)slin16;
+    config->uac_latency  = uac_latency;
+    config->uac_priority = uac_priority;
+    config->ptime        = ptime;
+    config->slin16       = (unsigned int)slin16;
+    config->uac_engine   = (unsigned int)uac_engine;
 
     return 0;
 }
@@ -211,6 +384,12 @@ void dc_sconfig_fill_defaults(struct dc_sconfig* config)
     config->msg_service   = -1;
     config->dtmf_duration = DEF_DTMF_DURATION;
     config->qhup          = 1u;
+    config->at_buffer     = DEFAULT_AT_BUFFER;
+
+    config->at_timeout_min = DEFAULT_AT_TIMEOUT_MIN;
+    config->at_timeout_max = DEFAULT_AT_TIMEOUT_MAX;
+    config->playout_depth  = DEFAULT_PLAYOUT_DEPTH;
+    config->playout_max    = DEFAULT_PLAYOUT_MAX;
 }
 
 #/* */
@@ -283,6 +462,64 @@ void dc_sconfig_fill(struct ast_config* cfg, const char* cat, struct dc_sconfig*
             config->dsci = parse_on_off(v->name, v->value, 0u);
         } else if (!strcasecmp(v->name, "qhup")) {
             config->qhup = parse_on_off(v->name, v->value, 1u);
+        } else if (!strcasecmp(v->name, "at_pipeline")) {
+            errno          = 0;
+            const long tmp = strtol(v->value, (char**)NULL, 10);
+            if ((!tmp && errno == EINVAL) || tmp < 0) {
+                ast_log(LOG_NOTICE, "Error parsing 'at_pipeline' in %s section, using value %u\n", cat, config->at_pipeline);
+            } else {
+                config->at_pipeline = (unsigned int)tmp;
+            }
+        } else if (!strcasecmp(v->name, "at_buffer")) {
+            errno          = 0;
+            const long tmp = strtol(v->value, (char**)NULL, 10);
+            if ((!tmp && errno == EINVAL) || tmp < (long)MIN_AT_BUFFER) {
+                ast_log(LOG_NOTICE, "Error parsing 'at_buffer' in %s section, using value %u\n", cat, config->at_buffer);
+            } else {
+                config->at_buffer = (unsigned int)tmp;
+            }
+        } else if (!strcasecmp(v->name, "at_buffer_max")) {
+            errno          = 0;
+            const long tmp = strtol(v->value, (char**)NULL, 10);
+            if ((!tmp && errno == EINVAL) || tmp < 0) {
+                ast_log(LOG_NOTICE, "Error parsing 'at_buffer_max' in %s section, using value %u\n", cat, config->at_buffer_max);
+            } else {
+                config->at_buffer_max = (unsigned int)tmp;
+            }
+        } else if (!strcasecmp(v->name, "at_timeout_adaptive")) {
+            config->at_timeout_adaptive = parse_on_off(v->name, v->value, 0u);
+        } else if (!strcasecmp(v->name, "at_timeout_min")) {
+            errno          = 0;
+            const long tmp = strtol(v->value, (char**)NULL, 10);
+            if ((!tmp && errno == EINVAL) || tmp <= 0) {
+                ast_log(LOG_NOTICE, "Error parsing 'at_timeout_min' in %s section, using value %u\n", cat, config->at_timeout_min);
+            } else {
+                config->at_timeout_min = (unsigned int)tmp;
+            }
+        } else if (!strcasecmp(v->name, "at_timeout_max")) {
+            errno          = 0;
+            const long tmp = strtol(v->value, (char**)NULL, 10);
+            if ((!tmp && errno == EINVAL) || tmp <= 0) {
+                ast_log(LOG_NOTICE, "Error parsing 'at_timeout_max' in %s section, using value %u\n", cat, config->at_timeout_max);
+            } else {
+                config->at_timeout_max = (unsigned int)tmp;
+            }
+        } else if (!strcasecmp(v->name, "playout_depth")) {
+            errno          = 0;
+            const long tmp = strtol(v->value, (char**)NULL, 10);
+            if ((!tmp && errno == EINVAL) || tmp < 0) {
+                ast_log(LOG_NOTICE, "Error parsing 'playout_depth' in %s section, using value %u\n", cat, config->playout_depth);
+            } else {
+                config->playout_depth = (unsigned int)tmp;
+            }
+        } else if (!strcasecmp(v->name, "playout_max")) {
+            errno          = 0;
+            const long tmp = strtol(v->value, (char**)NULL, 10);
+            if ((!tmp && errno == EINVAL) || tmp <= 0) {
+                ast_log(LOG_NOTICE, "Error parsing 'playout_max' in %s section, using value %u\n", cat, config->playout_max);
+            } else {
+                config->playout_max = (unsigned int)tmp;
+            }
         } else if (!strcasecmp(v->name, "msg_direct")) {
             config->msg_direct = dc_str23stbool(v->value);
         } else if (!strcasecmp(v->name, "msg_storage")) {
@@ -295,12 +532,74 @@ void dc_sconfig_fill(struct ast_config* cfg, const char* cat, struct dc_sconfig*
 
 #/* */
 
+static void gconfig_uint(struct ast_config* cfg, const char* cat, const char* name, unsigned int* val)
+{
+    const char* const str = ast_variable_retrieve(cfg, cat, name);
+    if (!str) {
+        return;
+    }
+
+    errno          = 0;
+    const long tmp = strtol(str, (char**)NULL, 10);
+    if ((!tmp && errno == EINVAL) || tmp < 0) {
+        ast_log(LOG_NOTICE, "Error parsing '%s' in general section, using default value %u\n", name, *val);
+    } else {
+        *val = (unsigned int)tmp;
+    }
+}
+
+static void gconfig_cpus(struct ast_config* cfg, const char* cat, const char* name, char* val)
+{
+    const char* const str = ast_variable_retrieve(cfg, cat, name);
+    if (ast_strlen_zero(str)) {
+        return;
+    }
+
+    if (strlen(str) >= CPULISTLEN || cpu_list_parse(str, NULL)) {
+        ast_log(LOG_NOTICE, "Error parsing '%s' in general section, CPU affinity not set\n", name);
+    } else {
+        ast_copy_string(val, str, CPULISTLEN);
+    }
+}
+
 void dc_gconfig_fill(struct ast_config* cfg, const char* cat, struct dc_gconfig* config)
 {
     config->discovery_interval = DEFAULT_DISCOVERY_INT;
+    config->discovery_events   = 0;
+    config->discovery_parallel = DEFAULT_DISCOVERY_PARALLEL;
+    config->discovery_cache[0] = '\0';
     ast_copy_string(config->sms_db, DEFAULT_SMS_DB, sizeof(config->sms_db));
     ast_copy_string(config->sms_backup_db, DEFAULT_SMS_BACKUP_DB, sizeof(config->sms_backup_db));
-    config->csms_ttl = DEFAULT_CSMS_TTL;
+    config->csms_ttl            = DEFAULT_CSMS_TTL;
+    config->sms_db_profile      = SMSDB_PROFILE_DEFAULT;
+    config->sms_db_mmap_size    = DEFAULT_SMS_DB_MMAP_SIZE;
+    config->sms_db_cache_size   = DEFAULT_SMS_DB_CACHE_SIZE;
+    config->sms_db_group_commit = 0;
+    config->sms_db_csms_cache   = 0;
+    config->sms_db_shard        = SMSDB_SHARD_NONE;
+    config->sms_db_async        = 0;
+    config->sms_db_backup_mode  = SMSDB_BACKUP_VACUUM;
+    config->sms_db_maintenance  = 0;
+    config->reactor         = 0;
+    config->reactor_threads = 0;
+    config->audio_sched     = 0;
+    config->audio_uring     = 0;
+    config->least_loaded      = LOAD_METRIC_CALLS;
+    config->least_loaded_rssi = 0;
+    config->metrics           = 0;
+    config->sms_bulk_rate     = 0;
+    config->sms_bulk_depth    = DEFAULT_SMS_BULK_DEPTH;
+    config->poll_interval     = 0;
+    config->notify            = NOTIFY_DELIVERY_LOCAL;
+    config->notify_batch      = 0;
+    config->threadpool_size         = 0;
+    config->threadpool_max_size     = 0;
+    config->threadpool_idle_timeout = DEFAULT_THREADPOOL_IDLE;
+    config->tps_high_water          = DEFAULT_TPS_HIGH_WATER;
+    config->tps_low_water           = 0;
+    config->monitor_cpus[0]         = '\0';
+    config->audio_cpus[0]           = '\0';
+    config->memory_profile          = MEMORY_PROFILE_DEFAULT;
 
     const char* const stmp = ast_variable_retrieve(cfg, cat, "interval");
     if (stmp) {
@@ -313,6 +612,27 @@ void dc_gconfig_fill(struct ast_config* cfg, const char* cat, struct dc_gconfig*
         }
     }
 
+    const char* const discovery_events = ast_variable_retrieve(cfg, cat, "discovery_events");
+    if (discovery_events) {
+        config->discovery_events = ast_true(discovery_events) ? 1 : 0;
+    }
+
+    const char* const discovery_parallel = ast_variable_retrieve(cfg, cat, "discovery_parallel");
+    if (discovery_parallel) {
+        errno          = 0;
+        const long tmp = strtol(discovery_parallel, (char**)NULL, 10);
+        if ((!tmp && errno == EINVAL) || tmp < 1) {
+            ast_log(LOG_NOTICE, "Error parsing 'discovery_parallel' in general section, using default value %u\n", config->discovery_parallel);
+        } else {
+            config->discovery_parallel = (unsigned int)tmp;
+        }
+    }
+
+    const char* const discovery_cache = ast_variable_retrieve(cfg, cat, "discovery_cache");
+    if (discovery_cache) {
+        ast_copy_string(config->discovery_cache, discovery_cache, sizeof(config->discovery_cache));
+    }
+
     const char* const smsdb = ast_variable_retrieve(cfg, cat, "smsdb");
     if (smsdb) {
         ast_copy_string(config->sms_db, smsdb, sizeof(config->sms_db));
@@ -333,10 +653,154 @@ void dc_gconfig_fill(struct ast_config* cfg, const char* cat, struct dc_gconfig*
             config->csms_ttl = tmp;
         }
     }
+
+    const char* const smsdb_profile = ast_variable_retrieve(cfg, cat, "smsdb_profile");
+    if (smsdb_profile) {
+        config->sms_db_profile = dc_str2smsdb_profile(smsdb_profile);
+    }
+
+    const char* const smsdb_shard = ast_variable_retrieve(cfg, cat, "smsdb_shard");
+    if (smsdb_shard) {
+        config->sms_db_shard = dc_str2smsdb_shard(smsdb_shard);
+    }
+
+    const char* const smsdb_backup_mode = ast_variable_retrieve(cfg, cat, "smsdb_backup_mode");
+    if (smsdb_backup_mode) {
+        config->sms_db_backup_mode = dc_str2smsdb_backup_mode(smsdb_backup_mode);
+    }
+
+    gconfig_uint(cfg, cat, "smsdb_mmap_size", &config->sms_db_mmap_size);
+    gconfig_uint(cfg, cat, "smsdb_cache_size", &config->sms_db_cache_size);
+    gconfig_uint(cfg, cat, "smsdb_group_commit", &config->sms_db_group_commit);
+    gconfig_uint(cfg, cat, "smsdb_csms_cache", &config->sms_db_csms_cache);
+    gconfig_uint(cfg, cat, "smsdb_maintenance", &config->sms_db_maintenance);
+    gconfig_uint(cfg, cat, "sms_bulk_rate", &config->sms_bulk_rate);
+    gconfig_uint(cfg, cat, "sms_bulk_depth", &config->sms_bulk_depth);
+    gconfig_uint(cfg, cat, "poll_interval", &config->poll_interval);
+    gconfig_uint(cfg, cat, "notify_batch", &config->notify_batch);
+    gconfig_uint(cfg, cat, "threadpool_size", &config->threadpool_size);
+    gconfig_uint(cfg, cat, "threadpool_max_size", &config->threadpool_max_size);
+    gconfig_uint(cfg, cat, "threadpool_idle_timeout", &config->threadpool_idle_timeout);
+    gconfig_uint(cfg, cat, "tps_high_water", &config->tps_high_water);
+    gconfig_uint(cfg, cat, "tps_low_water", &config->tps_low_water);
+
+    if (!config->tps_high_water) {
+        config->tps_high_water = DEFAULT_TPS_HIGH_WATER;
+    }
+    /* same default as taskprocessor alert levels */
+    if (!config->tps_low_water || config->tps_low_water >= config->tps_high_water) {
+        config->tps_low_water = config->tps_high_water * 9u / 10u;
+    }
+    if (config->threadpool_max_size && config->threadpool_max_size < config->threadpool_size) {
+        config->threadpool_max_size = config->threadpool_size;
+    }
+
+    gconfig_cpus(cfg, cat, "monitor_cpus", config->monitor_cpus);
+    gconfig_cpus(cfg, cat, "audio_cpus", config->audio_cpus);
+
+    const char* const memory_profile = ast_variable_retrieve(cfg, cat, "memory_profile");
+    if (memory_profile) {
+        config->memory_profile = dc_str2memory_profile(memory_profile);
+    }
+
+    const char* const notify = ast_variable_retrieve(cfg, cat, "notify");
+    if (notify) {
+        config->notify = dc_str2notify_delivery(notify);
+    }
+
+    const char* const smsdb_async = ast_variable_retrieve(cfg, cat, "smsdb_async");
+    if (smsdb_async) {
+        config->sms_db_async = ast_true(smsdb_async) ? 1 : 0;
+    }
+
+    const char* const reactor = ast_variable_retrieve(cfg, cat, "reactor");
+    if (reactor) {
+        config->reactor = ast_true(reactor) ? 1 : 0;
+    }
+
+    const char* const audio_sched = ast_variable_retrieve(cfg, cat, "audio_scheduler");
+    if (audio_sched) {
+        config->audio_sched = ast_true(audio_sched) ? 1 : 0;
+    }
+
+    const char* const audio_uring = ast_variable_retrieve(cfg, cat, "audio_io_uring");
+    if (audio_uring) {
+        config->audio_uring = ast_true(audio_uring) ? 1 : 0;
+    }
+
+    const char* const reactor_threads = ast_variable_retrieve(cfg, cat, "reactor_threads");
+    if (reactor_threads) {
+        errno          = 0;
+        const long tmp = strtol(reactor_threads, (char**)NULL, 10);
+        if ((!tmp && errno == EINVAL) || tmp < 0) {
+            ast_log(LOG_NOTICE, "Error parsing 'reactor_threads' in general section, using default value %u\n", config->reactor_threads);
+        } else {
+            config->reactor_threads = (unsigned int)tmp;
+        }
+    }
+
+    const char* const least_loaded = ast_variable_retrieve(cfg, cat, "least_loaded");
+    if (least_loaded) {
+        config->least_loaded = dc_str2load_metric(least_loaded);
+    }
+
+    const char* const least_loaded_rssi = ast_variable_retrieve(cfg, cat, "least_loaded_rssi");
+    if (least_loaded_rssi) {
+        config->least_loaded_rssi = ast_true(least_loaded_rssi) ? 1 : 0;
+    }
+
+    const char* const metrics = ast_variable_retrieve(cfg, cat, "metrics");
+    if (metrics) {
+        config->metrics = ast_true(metrics) ? 1 : 0;
+    }
 }
 
 #/* */
 
+#define UCONFIG_STR_CHANGED(a, b, name) strcmp(UCONFIG(a, name), UCONFIG(b, name))
+#define UCONFIG_CHANGED(a, b, name) (UCONFIG(a, name) != UCONFIG(b, name))
+#define SCONFIG_CHANGED(a, b, name) (SCONFIG(a, name) != SCONFIG(b, name))
+
+unsigned int dc_config_diff(const struct pvt_config* cur, const struct pvt_config* next)
+{
+    unsigned int changes = 0;
+
+    if (UCONFIG_STR_CHANGED(cur, next, audio_tty) || UCONFIG_STR_CHANGED(cur, next, data_tty) || UCONFIG_STR_CHANGED(cur, next, imei) ||
+        UCONFIG_STR_CHANGED(cur, next, imsi) || UCONFIG_STR_CHANGED(cur, next, alsadev) || UCONFIG_CHANGED(cur, next, uac) ||
+        UCONFIG_CHANGED(cur, next, uac_latency) || UCONFIG_CHANGED(cur, next, uac_priority) || UCONFIG_CHANGED(cur, next, slin16) ||
+        UCONFIG_CHANGED(cur, next, ptime) || UCONFIG_CHANGED(cur, next, uac_engine) || SCONFIG_CHANGED(cur, next, resetquectel) ||
+        SCONFIG_CHANGED(cur, next, dsci) ||
+        SCONFIG_CHANGED(cur, next, msg_service) || SCONFIG_CHANGED(cur, next, msg_storage)) {
+        changes |= CONFIG_CHANGE_RESTART;
+    }
+
+    if (SCONFIG_CHANGED(cur, next, rxgain) || SCONFIG_CHANGED(cur, next, txgain)) {
+        changes |= CONFIG_CHANGE_GAINS;
+    }
+
+    if (SCONFIG_CHANGED(cur, next, callwaiting)) {
+        changes |= CONFIG_CHANGE_CALLWAITING;
+    }
+
+    if (SCONFIG_CHANGED(cur, next, dtmf)) {
+        changes |= CONFIG_CHANGE_DTMF;
+    }
+
+    if (SCONFIG_CHANGED(cur, next, msg_direct)) {
+        changes |= CONFIG_CHANGE_MSG_DIRECT;
+    }
+
+    if (SCONFIG_CHANGED(cur, next, at_buffer) || SCONFIG_CHANGED(cur, next, at_buffer_max)) {
+        changes |= CONFIG_CHANGE_AT_BUFFER;
+    }
+
+    if (!changes && memcmp(cur, next, sizeof(*cur))) {
+        changes |= CONFIG_CHANGE_OTHER;
+    }
+
+    return changes;
+}
+
 int dc_config_fill(struct ast_config* cfg, const char* cat, const struct dc_sconfig* parent, struct pvt_config* config)
 {
     /* try set unique first */
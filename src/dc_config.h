@@ -16,6 +16,7 @@
 #define IMSI_SIZE 15
 #define PATHLEN 256
 #define DEVPATHLEN 256
+#define CPULISTLEN 64
 
 typedef enum { TRIBOOL_NONE = 0, TRIBOOL_FALSE = -1, TRIBOOL_TRUE = 1 } tristate_bool_t;
 
@@ -48,6 +49,41 @@ const char* attribute_const dc_3stbool2str_capitalized(int);
 message_storage_t attribute_const dc_str2msgstor(const char*);
 const char* attribute_const dc_msgstor2str(message_storage_t);
 
+typedef enum { SMSDB_PROFILE_DEFAULT = 0, SMSDB_PROFILE_PERFORMANCE } smsdb_profile_t;
+
+smsdb_profile_t attribute_const dc_str2smsdb_profile(const char*);
+const char* attribute_const dc_smsdb_profile2str(smsdb_profile_t);
+
+typedef enum { SMSDB_SHARD_NONE = 0, SMSDB_SHARD_IMSI } smsdb_shard_t;
+
+smsdb_shard_t attribute_const dc_str2smsdb_shard(const char*);
+const char* attribute_const dc_smsdb_shard2str(smsdb_shard_t);
+
+typedef enum { SMSDB_BACKUP_VACUUM = 0, SMSDB_BACKUP_ONLINE } smsdb_backup_mode_t;
+
+smsdb_backup_mode_t attribute_const dc_str2smsdb_backup_mode(const char*);
+const char* attribute_const dc_smsdb_backup_mode2str(smsdb_backup_mode_t);
+
+typedef enum { LOAD_METRIC_CALLS = 0, LOAD_METRIC_DURATION } load_metric_t;
+
+load_metric_t attribute_const dc_str2load_metric(const char*);
+const char* attribute_const dc_load_metric2str(load_metric_t);
+
+typedef enum { NOTIFY_DELIVERY_LOCAL = 0, NOTIFY_DELIVERY_EVENT } notify_delivery_t;
+
+notify_delivery_t attribute_const dc_str2notify_delivery(const char*);
+const char* attribute_const dc_notify_delivery2str(notify_delivery_t);
+
+typedef enum { MEMORY_PROFILE_DEFAULT = 0, MEMORY_PROFILE_COMPACT } memory_profile_t;
+
+memory_profile_t attribute_const dc_str2memory_profile(const char*);
+const char* attribute_const dc_memory_profile2str(memory_profile_t);
+
+typedef enum { UAC_LATENCY_BALANCED = 0, UAC_LATENCY_LOW, UAC_LATENCY_ROBUST, UAC_LATENCY_AUTO } uac_latency_t;
+
+uac_latency_t attribute_const dc_str2uac_latency(const char*);
+const char* attribute_const dc_uac_latency2str(uac_latency_t);
+
 /*
  Config API
  Operations
@@ -76,15 +112,24 @@ typedef struct dc_sconfig {
     int txgain;      /*!< increase the outgoint volume 0 */
     int callingpres; /*!< calling presentation */
 
-    unsigned int usecallingpres:1; /*! -1 */
-    unsigned int autodeletesms :1; /*! 0 */
-    unsigned int resetquectel  :1; /*! 1 */
-    unsigned int multiparty    :1; /*! 0 */
-    unsigned int dtmf          :1; /*! 0 */
-    unsigned int moh           :1; /*! 0 */
-    unsigned int query_time    :1; /*! 0 */
-    unsigned int dsci          :1; /*!< use ^DSCI call state notifications */
-    unsigned int qhup          :1; /*!< use QHUP command */
+    unsigned int usecallingpres     :1; /*! -1 */
+    unsigned int autodeletesms      :1; /*! 0 */
+    unsigned int resetquectel       :1; /*! 1 */
+    unsigned int multiparty         :1; /*! 0 */
+    unsigned int dtmf               :1; /*! 0 */
+    unsigned int moh                :1; /*! 0 */
+    unsigned int query_time         :1; /*! 0 */
+    unsigned int dsci               :1; /*!< use ^DSCI call state notifications */
+    unsigned int qhup               :1; /*!< use QHUP command */
+    unsigned int at_timeout_adaptive:1; /*!< derive command timeouts from observed response times */
+
+    unsigned int at_pipeline;    /*!< max number of written AT commands waiting for response, 0 - no pipelining */
+    unsigned int at_buffer;      /*!< initial size of AT receive buffer in bytes */
+    unsigned int at_buffer_max;  /*!< AT receive buffer may grow up to this size, 0 - fixed size */
+    unsigned int at_timeout_min; /*!< lower bound of adaptive command timeout in ms */
+    unsigned int at_timeout_max; /*!< upper bound of adaptive command timeout in ms */
+    unsigned int playout_depth;  /*!< initial and minimal depth of multiparty playout buffer in ms, 0 - disabled */
+    unsigned int playout_max;    /*!< playout buffer grows up to this depth in ms */
 
     long dtmf_duration;         /*! duration of DTMF in miliseconds */
     dev_state_t initstate;      /*! DEV_STATE_STARTED */
@@ -97,10 +142,44 @@ typedef struct dc_sconfig {
 
 /* Global settings */
 typedef struct dc_gconfig {
-    int discovery_interval; /*!< The device discovery interval */
+    int discovery_interval;          /*!< The device discovery interval */
+    unsigned int discovery_events:1; /*!< rescan on port hotplug and probe new ports in parallel */
+    unsigned int discovery_parallel; /*!< max number of devices started at once, 1 - one by one */
+    char discovery_cache[PATHLEN];   /*!< file keeping IMEI/IMSI of ports between loads, empty - not kept */
     char sms_db[PATHLEN];
     char sms_backup_db[PATHLEN];
     int csms_ttl;
+    smsdb_profile_t sms_db_profile;         /*!< SQLite tuning of smsdb */
+    unsigned int sms_db_mmap_size;          /*!< SQLite mmap size in MiB, performance profile */
+    unsigned int sms_db_cache_size;         /*!< SQLite page cache size in KiB, performance profile */
+    unsigned int sms_db_group_commit;       /*!< window of commits grouping in ms, 0 - commit every write */
+    unsigned int sms_db_csms_cache;         /*!< seconds to keep incomplete multipart messages in memory, 0 - store every part */
+    smsdb_shard_t sms_db_shard;             /*!< smsdb file of every IMSI */
+    unsigned int sms_db_async:1;            /*!< answer outgoing messages from memory, write them to smsdb by writer thread */
+    smsdb_backup_mode_t sms_db_backup_mode; /*!< backup by VACUUM INTO or online by background thread */
+    unsigned int sms_db_maintenance;        /*!< seconds between pruning of stale parts and incremental vacuum, 0 - disabled */
+    unsigned int reactor:1;       /*!< multiplex all devices in a shared epoll reactor */
+    unsigned int reactor_threads; /*!< number of reactor threads, 0 - one per online CPU */
+    unsigned int audio_sched:1;   /*!< pace audio writes of all devices with one shared timer */
+    unsigned int audio_uring:1;   /*!< submit audio writes of shared timer tick in one io_uring batch */
+
+    load_metric_t least_loaded;       /*!< counter compared by least loaded group dialing */
+    unsigned int least_loaded_rssi:1; /*!< prefer devices with better signal for least loaded group dialing */
+    unsigned int metrics:1;           /*!< export metrics of all devices by HTTP server */
+    unsigned int sms_bulk_rate;       /*!< messages per minute of SIM sent by bulk SMS engine, 0 - unlimited */
+    unsigned int sms_bulk_depth;      /*!< AT queue length of device when bulk SMS engine stops feeding it */
+    unsigned int poll_interval;       /*!< seconds between periodic polls of every device, 0 - ping on read silence only */
+    notify_delivery_t notify;         /*!< how SMS, USSD and reports are delivered */
+    unsigned int notify_batch;        /*!< window of notification events grouping in ms, 0 - send every event at once */
+
+    unsigned int threadpool_size;         /*!< initial number of threads of module threadpool */
+    unsigned int threadpool_max_size;     /*!< max number of threads of module threadpool, 0 - unlimited */
+    unsigned int threadpool_idle_timeout; /*!< seconds before idle thread of threadpool exits, 0 - never */
+    unsigned int tps_high_water;          /*!< reading of device is paused at this number of queued responses */
+    unsigned int tps_low_water;           /*!< paused reading is resumed at this number of queued responses */
+    char monitor_cpus[CPULISTLEN];        /*!< CPU affinity of monitor and reactor threads, empty - inherited */
+    char audio_cpus[CPULISTLEN];          /*!< CPU affinity of audio threads, empty - inherited */
+    memory_profile_t memory_profile;      /*!< sizes of per-device buffers and caches */
 } dc_gconfig_t;
 
 /* Local required (unique) settings */
@@ -113,7 +192,11 @@ typedef struct dc_uconfig {
     char imsi[IMSI_SIZE + 1];   /*!< search device by imsi */
     char alsadev[DEVNAMELEN];   /*!< ALSA audio device name */
     tristate_bool_t uac;        /*!< handle audio by audio device (UAC) */
+    uac_latency_t uac_latency;  /*!< ALSA buffer profile of UAC device */
+    unsigned int uac_priority;  /*!< SCHED_FIFO priority of UAC audio thread, 0 - default scheduling */
+    unsigned int ptime;         /*!< duration of audio frame in ms, multiple of PTIME_CAPTURE up to 60 */
     unsigned int slin16:1;      /*!< SLIN16 audio format */
+    unsigned int uac_engine:1;  /*!< service UAC sound card from dedicated audio thread */
 } dc_uconfig_t;
 
 /* all Config settings join in one place */
@@ -130,5 +213,16 @@ void dc_sconfig_fill(struct ast_config* cfg, const char* cat, struct dc_sconfig*
 void dc_gconfig_fill(struct ast_config* cfg, const char* cat, struct dc_gconfig* config);
 int dc_config_fill(struct ast_config* cfg, const char* cat, const struct dc_sconfig* parent, struct pvt_config* config);
 
+/* groups of settings changed by reload, see dc_config_diff() */
+#define CONFIG_CHANGE_RESTART (1u << 0)     /*!< used by opening or initialization of device, restart required */
+#define CONFIG_CHANGE_GAINS (1u << 1)       /*!< rxgain or txgain */
+#define CONFIG_CHANGE_CALLWAITING (1u << 2) /*!< callwaiting */
+#define CONFIG_CHANGE_DTMF (1u << 3)        /*!< tone detection */
+#define CONFIG_CHANGE_MSG_DIRECT (1u << 4)  /*!< SMS indication mode */
+#define CONFIG_CHANGE_AT_BUFFER (1u << 5)   /*!< size limits of AT receive buffer */
+#define CONFIG_CHANGE_OTHER (1u << 6)       /*!< settings read on every use, no action required */
+
+unsigned int dc_config_diff(const struct pvt_config* cur, const struct pvt_config* next);
+
 
 #endif /* CHAN_QUECTEL_DC_CONFIG_H_INCLUDED */
@@ -0,0 +1,323 @@
+/*
+   devindex.c
+*/
+#include <string.h> /* strcmp() */
+
+#include "ast_config.h"
+
+#include <asterisk/linkedlists.h>
+#include <asterisk/lock.h>
+#include <asterisk/utils.h>
+
+#include "devindex.h"
+
+#include "chan_quectel.h"
+
+#define DEVINDEX_BUCKETS 64u
+
+struct devindex_entry {
+    AST_LIST_ENTRY(devindex_entry) entry;
+    struct pvt* pvt;
+    char key[0];
+};
+
+AST_LIST_HEAD_NOLOCK(devindex_bucket, devindex_entry);
+
+struct devindex_table {
+    struct devindex_bucket buckets[DEVINDEX_BUCKETS];
+};
+
+static struct {
+    struct devindex_table ids;
+    struct devindex_group** groups; /*!< sorted by group number */
+    unsigned int groups_count;
+
+    ast_rwlock_t lock; /*!< protects tables below */
+    struct devindex_table imeis;
+    struct devindex_table imsis;
+} devindex;
+
+#/* FNV-1a */
+
+static unsigned int devindex_hash(const char* key)
+{
+    unsigned int hash = 2166136261u;
+
+    for (; *key; ++key) {
+        hash ^= (unsigned char)*key;
+        hash *= 16777619u;
+    }
+    return hash % DEVINDEX_BUCKETS;
+}
+
+static void table_add(struct devindex_table* table, const char* key, struct pvt* pvt)
+{
+    if (ast_strlen_zero(key)) {
+        return;
+    }
+
+    const size_t len                   = strlen(key);
+    struct devindex_entry* const entry = ast_malloc(sizeof(struct devindex_entry) + len + 1u);
+    if (!entry) {
+        ast_log(LOG_ERROR, "[%s] Unable to index device by %s\n", PVT_ID(pvt), key);
+        return;
+    }
+
+    entry->pvt = pvt;
+    memcpy(entry->key, key, len + 1u);
+    AST_LIST_INSERT_HEAD(&table->buckets[devindex_hash(key)], entry, entry);
+}
+
+static void table_remove(struct devindex_table* table, const char* key, const struct pvt* pvt)
+{
+    struct devindex_entry* entry;
+
+    if (ast_strlen_zero(key)) {
+        return;
+    }
+
+    AST_LIST_TRAVERSE_SAFE_BEGIN(&table->buckets[devindex_hash(key)], entry, entry) {
+        if (entry->pvt == pvt && !strcmp(entry->key, key)) {
+            AST_LIST_REMOVE_CURRENT(entry);
+            ast_free(entry);
+            break;
+        }
+    }
+    AST_LIST_TRAVERSE_SAFE_END;
+}
+
+static struct pvt* table_find(const struct devindex_table* table, const char* key)
+{
+    const struct devindex_entry* entry;
+
+    AST_LIST_TRAVERSE(&table->buckets[devindex_hash(key)], entry, entry) {
+        if (!strcmp(entry->key, key)) {
+            return entry->pvt;
+        }
+    }
+    return NULL;
+}
+
+static void table_clear(struct devindex_table* table)
+{
+    struct devindex_entry* entry;
+
+    for (unsigned int i = 0; i < DEVINDEX_BUCKETS; ++i) {
+        while ((entry = AST_LIST_REMOVE_HEAD(&table->buckets[i], entry))) {
+            ast_free(entry);
+        }
+    }
+}
+
+static void groups_free(struct devindex_group** groups, unsigned int count)
+{
+    for (unsigned int i = 0; i < count; ++i) {
+        ast_free(groups[i]);
+    }
+    ast_free(groups);
+}
+
+#/* */
+
+void devindex_init()
+{
+    memset(&devindex, 0, sizeof(devindex));
+    ast_rwlock_init(&devindex.lock);
+}
+
+void devindex_fini()
+{
+    table_clear(&devindex.ids);
+    groups_free(devindex.groups, devindex.groups_count);
+    devindex.groups       = NULL;
+    devindex.groups_count = 0;
+
+    ast_rwlock_wrlock(&devindex.lock);
+    table_clear(&devindex.imeis);
+    table_clear(&devindex.imsis);
+    ast_rwlock_unlock(&devindex.lock);
+    ast_rwlock_destroy(&devindex.lock);
+}
+
+void devindex_add(struct pvt* pvt) { table_add(&devindex.ids, PVT_ID(pvt), pvt); }
+
+void devindex_remove(struct pvt* pvt)
+{
+    table_remove(&devindex.ids, PVT_ID(pvt), pvt);
+
+    for (unsigned int i = 0; i < devindex.groups_count; ++i) {
+        struct devindex_group* const group = devindex.groups[i];
+
+        for (unsigned int j = 0; j < group->count; ++j) {
+            if (group->members[j] != pvt) {
+                continue;
+            }
+
+            memmove(&group->members[j], &group->members[j + 1], (group->count - j - 1u) * sizeof(group->members[0]));
+            group->count--;
+            if (group->last_used >= j && group->last_used) {
+                group->last_used--;
+            }
+            break;
+        }
+    }
+
+    ast_rwlock_wrlock(&devindex.lock);
+    table_remove(&devindex.imeis, pvt->imei, pvt);
+    table_remove(&devindex.imsis, pvt->imsi, pvt);
+    ast_rwlock_unlock(&devindex.lock);
+}
+
+#/* */
+
+static int group_cmp(const void* a, const void* b)
+{
+    const struct devindex_group* const g1 = *(const struct devindex_group* const*)a;
+    const struct devindex_group* const g2 = *(const struct devindex_group* const*)b;
+
+    return (g1->group > g2->group) - (g1->group < g2->group);
+}
+
+static struct devindex_group* groups_search(struct devindex_group** groups, unsigned int count, int group)
+{
+    const struct devindex_group key         = {.group = group};
+    const struct devindex_group* const pkey = &key;
+
+    if (!count) {
+        return NULL;
+    }
+
+    struct devindex_group** const found = bsearch(&pkey, groups, count, sizeof(groups[0]), group_cmp);
+    return found ? *found : NULL;
+}
+
+int devindex_groups_update(void)
+{
+    struct devindex_group** groups;
+    unsigned int count   = 0;
+    unsigned int devices = 0;
+    struct pvt* pvt;
+
+    AST_RWLIST_TRAVERSE(&gpublic->devices, pvt, entry) {
+        devices++;
+    }
+
+    /* every device may be in own group */
+    groups = ast_calloc(devices ? devices : 1u, sizeof(groups[0]));
+    if (!groups) {
+        return -1;
+    }
+
+    int* const numbers = ast_calloc(devices ? devices : 1u, sizeof(int));
+    if (!numbers) {
+        ast_free(groups);
+        return -1;
+    }
+
+    /* snapshot of groups, count members per group */
+    unsigned int idx = 0;
+    AST_RWLIST_TRAVERSE(&gpublic->devices, pvt, entry) {
+        ast_mutex_lock(&pvt->lock);
+        numbers[idx] = CONF_SHARED(pvt, group);
+        ast_mutex_unlock(&pvt->lock);
+
+        struct devindex_group* group = groups_search(groups, count, numbers[idx]);
+        if (!group) {
+            group = ast_calloc(1, sizeof(struct devindex_group));
+            if (!group) {
+                groups_free(groups, count);
+                ast_free(numbers);
+                return -1;
+            }
+            group->group    = numbers[idx];
+            groups[count++] = group;
+            qsort(groups, count, sizeof(groups[0]), group_cmp);
+        }
+        group->count++;
+        idx++;
+    }
+
+    /* allocate members */
+    for (unsigned int i = 0; i < count; ++i) {
+        struct devindex_group* const group = ast_realloc(groups[i], sizeof(struct devindex_group) + groups[i]->count * sizeof(groups[i]->members[0]));
+        if (!group) {
+            groups_free(groups, count);
+            ast_free(numbers);
+            return -1;
+        }
+        groups[i]        = group;
+        group->count     = 0;
+        group->last_used = 0;
+    }
+
+    idx = 0;
+    AST_RWLIST_TRAVERSE(&gpublic->devices, pvt, entry) {
+        struct devindex_group* const group = groups_search(groups, count, numbers[idx++]);
+        group->members[group->count++]     = pvt;
+    }
+    ast_free(numbers);
+
+    /* keep round robin position */
+    for (unsigned int i = 0; i < count; ++i) {
+        struct devindex_group* const group     = groups[i];
+        const struct devindex_group* const old = groups_search(devindex.groups, devindex.groups_count, group->group);
+        if (!old || !old->count) {
+            continue;
+        }
+
+        const struct pvt* const last = old->members[MIN(old->last_used, old->count - 1u)];
+        for (unsigned int j = 0; j < group->count; ++j) {
+            if (group->members[j] == last) {
+                group->last_used = j;
+                break;
+            }
+        }
+    }
+
+    groups_free(devindex.groups, devindex.groups_count);
+    devindex.groups       = groups;
+    devindex.groups_count = count;
+    return 0;
+}
+
+#/* */
+
+void devindex_set_imei(struct pvt* pvt, const char* imei)
+{
+    ast_rwlock_wrlock(&devindex.lock);
+    table_remove(&devindex.imeis, pvt->imei, pvt);
+    ast_string_field_set(pvt, imei, imei);
+    table_add(&devindex.imeis, pvt->imei, pvt);
+    ast_rwlock_unlock(&devindex.lock);
+}
+
+void devindex_set_imsi(struct pvt* pvt, const char* imsi)
+{
+    ast_rwlock_wrlock(&devindex.lock);
+    table_remove(&devindex.imsis, pvt->imsi, pvt);
+    ast_string_field_set(pvt, imsi, imsi);
+    table_add(&devindex.imsis, pvt->imsi, pvt);
+    ast_rwlock_unlock(&devindex.lock);
+}
+
+#/* */
+
+struct pvt* devindex_find_id(const char* id) { return table_find(&devindex.ids, id); }
+
+struct devindex_group* devindex_find_group(int group) { return groups_search(devindex.groups, devindex.groups_count, group); }
+
+struct pvt* devindex_find_imei(const char* imei)
+{
+    ast_rwlock_rdlock(&devindex.lock);
+    struct pvt* const pvt = table_find(&devindex.imeis, imei);
+    ast_rwlock_unlock(&devindex.lock);
+    return pvt;
+}
+
+struct pvt* devindex_find_imsi(const char* imsi)
+{
+    ast_rwlock_rdlock(&devindex.lock);
+    struct pvt* const pvt = table_find(&devindex.imsis, imsi);
+    ast_rwlock_unlock(&devindex.lock);
+    return pvt;
+}
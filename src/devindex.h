@@ -0,0 +1,45 @@
+/*
+   devindex.h
+*/
+#ifndef CHAN_QUECTEL_DEVINDEX_H_INCLUDED
+#define CHAN_QUECTEL_DEVINDEX_H_INCLUDED
+
+struct pvt;
+
+/*
+    Device lookup indexes
+
+    Id and group indexes are changed with write lock of devices list held and read with read lock,
+    pointers are valid while devices list is locked. IMEI and IMSI are learned from device at runtime,
+    so their indexes have own lock which is never held while other lock is taken.
+    Returned devices are not locked, caller must lock and recheck key.
+*/
+
+struct devindex_group {
+    int group;
+    unsigned int last_used; /*!< round robin cursor, index of last used member */
+    unsigned int count;     /*!< number of members */
+    struct pvt* members[0]; /*!< members in configuration order */
+};
+
+void devindex_init();
+void devindex_fini();
+
+/* devices list locked for writing */
+void devindex_add(struct pvt* pvt);
+/* devices list locked for writing, pvt locked */
+void devindex_remove(struct pvt* pvt);
+/* rebuild group index, devices list locked for writing, pvt not locked */
+int devindex_groups_update(void);
+
+/* pvt locked, replace IMEI or IMSI of device and update index */
+void devindex_set_imei(struct pvt* pvt, const char* imei);
+void devindex_set_imsi(struct pvt* pvt, const char* imsi);
+
+/* devices list locked */
+struct pvt* devindex_find_id(const char* id);
+struct devindex_group* devindex_find_group(int group);
+struct pvt* devindex_find_imei(const char* imei);
+struct pvt* devindex_find_imsi(const char* imsi);
+
+#endif /* CHAN_QUECTEL_DEVINDEX_H_INCLUDED */
@@ -17,6 +17,7 @@
 #include "at_command.h"
 #include "chan_quectel.h" /* devices */
 #include "error.h"
+#include "pvt_status.h" /* pvt_status_publish() */
 #include "smsdb.h"
 
 // #include "pdu.h"				/* pdu_digit2code() */
@@ -160,6 +161,11 @@ int smsdb_backup()
     RAII_VAR(struct ast_str*, backup_file, ast_str_create(FN_DEF_LEN), ast_free);
     ast_str_set(&backup_file, 0, "%s.sqlite3", CONF_GLOBAL(sms_backup_db));
 
+    if (CONF_GLOBAL(sms_db_backup_mode) == SMSDB_BACKUP_ONLINE) {
+        /* copied in background, result is logged */
+        return smsdb_backup_online(ast_str_buffer(backup_file)) ? 0 : 1;
+    }
+
     if (smsdb_vacuum_into(ast_str_buffer(backup_file))) {
         return 0;
     }
@@ -378,6 +384,7 @@ int schedule_restart_event(dev_state_t event, restate_time_t when, const char* d
     pvt->restart_time  = when;
 
     pvt_try_restate(pvt);
+    pvt_status_publish(pvt);
     return 0;
 }
 
@@ -699,3 +706,65 @@ size_t fd_write_all(int fd, const char* buf, size_t count)
 
     return total;
 }
+
+#/* */
+
+int cpu_list_parse(const char* list, cpu_set_t* cpus)
+{
+    cpu_set_t set;
+    const char* s = list;
+
+    CPU_ZERO(&set);
+    while (*s) {
+        char* end;
+        const long first = strtol(s, &end, 10);
+        long last        = first;
+        if (end == s || first < 0 || first >= CPU_SETSIZE) {
+            return -1;
+        }
+
+        s = end;
+        if (*s == '-') {
+            last = strtol(++s, &end, 10);
+            if (end == s || last < first || last >= CPU_SETSIZE) {
+                return -1;
+            }
+            s = end;
+        }
+
+        for (long cpu = first; cpu <= last; ++cpu) {
+            CPU_SET(cpu, &set);
+        }
+
+        if (*s == ',') {
+            s++;
+        } else if (*s) {
+            return -1;
+        }
+    }
+
+    if (!CPU_COUNT(&set)) {
+        return -1;
+    }
+
+    if (cpus) {
+        memcpy(cpus, &set, sizeof(set));
+    }
+    return 0;
+}
+
+void thread_set_cpus(const char* name, const char* list)
+{
+    cpu_set_t cpus;
+
+    if (ast_strlen_zero(list) || cpu_list_parse(list, &cpus)) {
+        return;
+    }
+
+    const int err = pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+    if (err) {
+        ast_log(LOG_WARNING, "[%s] Unable to bind thread to CPUs %s: %s\n", name, list, strerror(err));
+    } else {
+        ast_debug(3, "[%s] Thread bound to CPUs %s\n", name, list);
+    }
+}
@@ -4,6 +4,8 @@
 #ifndef CHAN_QUECTEL_HELPERS_H_INCLUDED
 #define CHAN_QUECTEL_HELPERS_H_INCLUDED
 
+#include <sched.h> /* cpu_set_t */
+
 #include <asterisk/strings.h>
 
 #include "chan_quectel.h" /* restate_time_t */
@@ -69,4 +71,9 @@ struct ast_str* rssi2dBm(int rssi);
 
 size_t fd_write_all(int fd, const char* buf, size_t count);
 
+/* parse list of CPUs like "0-3,6", cpus is optional, return -1 if list is invalid */
+int cpu_list_parse(const char* list, cpu_set_t* cpus);
+/* bind calling thread to listed CPUs, empty list - keep inherited affinity */
+void thread_set_cpus(const char* name, const char* list);
+
 #endif /* CHAN_QUECTEL_HELPERS_H_INCLUDED */
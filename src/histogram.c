@@ -0,0 +1,76 @@
+/*
+   histogram.c
+*/
+#include "histogram.h"
+
+static unsigned int hist_index(uint64_t value)
+{
+    if (value < HIST_SUB_BUCKETS) {
+        return (unsigned int)value;
+    }
+
+    const unsigned int msb   = 63u - (unsigned int)__builtin_clzll(value);
+    const unsigned int sub   = (unsigned int)(value >> (msb - HIST_SUB_BITS)) & (HIST_SUB_BUCKETS - 1u);
+    const unsigned int index = (msb - HIST_SUB_BITS + 1u) * HIST_SUB_BUCKETS + sub;
+
+    return (index < HIST_BUCKETS) ? index : HIST_BUCKETS - 1u;
+}
+
+static uint64_t hist_upper_bound(unsigned int index)
+{
+    if (index < HIST_SUB_BUCKETS) {
+        return index;
+    }
+
+    const unsigned int shift = index / HIST_SUB_BUCKETS - 1u;
+    const uint64_t sub       = index % HIST_SUB_BUCKETS;
+
+    return ((HIST_SUB_BUCKETS + sub + 1u) << shift) - 1u;
+}
+
+void hist_add(struct histogram* hist, uint64_t value)
+{
+    __atomic_fetch_add(&hist->buckets[hist_index(value)], 1u, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&hist->sum, value, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&hist->count, 1u, __ATOMIC_RELAXED);
+
+    uint64_t max = __atomic_load_n(&hist->max, __ATOMIC_RELAXED);
+    while (value > max && !__atomic_compare_exchange_n(&hist->max, &max, value, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+}
+
+void hist_snapshot(const struct histogram* hist, struct histogram* snapshot)
+{
+    uint64_t count = 0;
+
+    for (unsigned int i = 0; i < HIST_BUCKETS; ++i) {
+        snapshot->buckets[i]  = __atomic_load_n(&hist->buckets[i], __ATOMIC_RELAXED);
+        count                += snapshot->buckets[i];
+    }
+
+    /* count is taken from buckets, so percentiles are consistent with them */
+    snapshot->count = count;
+    snapshot->sum   = __atomic_load_n(&hist->sum, __ATOMIC_RELAXED);
+    snapshot->max   = __atomic_load_n(&hist->max, __ATOMIC_RELAXED);
+}
+
+uint64_t hist_percentile(const struct histogram* snapshot, unsigned int percent)
+{
+    const uint64_t rank = (snapshot->count * percent + 99u) / 100u;
+    uint64_t seen       = 0;
+
+    if (!snapshot->count) {
+        return 0;
+    }
+
+    for (unsigned int i = 0; i < HIST_BUCKETS; ++i) {
+        seen += snapshot->buckets[i];
+        if (seen >= rank && seen) {
+            /* last bucket is unbounded */
+            const uint64_t bound = (i < HIST_BUCKETS - 1u) ? hist_upper_bound(i) : snapshot->max;
+            return (bound < snapshot->max) ? bound : snapshot->max;
+        }
+    }
+
+    return snapshot->max;
+}
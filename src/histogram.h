@@ -0,0 +1,37 @@
+/*
+   histogram.h
+*/
+#ifndef CHAN_QUECTEL_HISTOGRAM_H_INCLUDED
+#define CHAN_QUECTEL_HISTOGRAM_H_INCLUDED
+
+#include <stdint.h>
+
+/*
+    Latency histogram
+
+    Fixed log-linear buckets of microseconds, four sub-buckets per power of two
+    like HDR histogram with two significant bits, so any value is known within 25%.
+    Values from 16.7 seconds are counted in the last bucket.
+    Samples are added with relaxed atomics, readers take a snapshot without locking.
+*/
+
+#define HIST_SUB_BITS 2u
+#define HIST_SUB_BUCKETS (1u << HIST_SUB_BITS)
+#define HIST_BUCKETS 92u
+
+struct histogram {
+    uint64_t count;                 /*!< number of samples */
+    uint64_t sum;                   /*!< sum of samples */
+    uint64_t max;                   /*!< largest sample */
+    uint64_t buckets[HIST_BUCKETS]; /*!< number of samples in every bucket */
+};
+
+void hist_add(struct histogram* hist, uint64_t value);
+void hist_snapshot(const struct histogram* hist, struct histogram* snapshot);
+
+/*!< upper bound of bucket where percentile of samples is reached, 0 if empty */
+uint64_t hist_percentile(const struct histogram* snapshot, unsigned int percent);
+
+static inline uint64_t hist_mean(const struct histogram* snapshot) { return snapshot->count ? snapshot->sum / snapshot->count : 0u; }
+
+#endif /* CHAN_QUECTEL_HISTOGRAM_H_INCLUDED */
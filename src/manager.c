@@ -0,0 +1,233 @@
+/*
+   manager.c
+*/
+#include <inttypes.h> /* PRIu64 */
+
+#include "ast_config.h"
+
+#include <asterisk/astobj2.h> /* ao2_cleanup() */
+#include <asterisk/manager.h>
+#include <asterisk/utils.h> /* RAII_VAR() */
+
+#include "manager.h"
+
+#include "chan_quectel.h" /* pvt_get_latency_by_id() */
+#include "error.h"
+#include "histogram.h"  /* hist_percentile() */
+#include "pvt_status.h" /* pvt_status_get() */
+#include "smsbulk.h"    /* smsbulk_submit() */
+
+#define MANAGER_SHOW_DEVICES "QuectelShowDevices"
+#define MANAGER_SHOW_DEVICE_LATENCY "QuectelShowDeviceLatency"
+#define MANAGER_SEND_SMS_BULK "QuectelSendSMSBulk"
+
+#/* */
+
+static void manager_latency_event(struct mansession* s, const char* idtext, const char* device, const char* name, const struct histogram* hist)
+{
+    astman_append(s,
+                  "Event: QuectelDeviceLatency\r\n"
+                  "%s"
+                  "Device: %s\r\n"
+                  "Name: %s\r\n"
+                  "Count: %" PRIu64 "\r\n"
+                  "Mean: %" PRIu64 "\r\n"
+                  "P50: %" PRIu64 "\r\n"
+                  "P90: %" PRIu64 "\r\n"
+                  "P99: %" PRIu64 "\r\n"
+                  "Max: %" PRIu64 "\r\n"
+                  "\r\n",
+                  idtext, device, name, hist->count, hist_mean(hist), hist_percentile(hist, 50), hist_percentile(hist, 90), hist_percentile(hist, 99),
+                  hist->max);
+}
+
+static int manager_show_device_latency(struct mansession* s, const struct message* m)
+{
+    const char* const device = astman_get_header(m, "Device");
+    const char* const id     = astman_get_header(m, "ActionID");
+
+    if (ast_strlen_zero(device)) {
+        astman_send_error(s, m, "Device not specified");
+        return 0;
+    }
+
+    RAII_VAR(struct latency_snapshot*, snapshot, pvt_get_latency_by_id(device), ast_free);
+    if (!snapshot) {
+        astman_send_error(s, m, "Device not found");
+        return 0;
+    }
+
+    char idtext[256] = "";
+    if (!ast_strlen_zero(id)) {
+        snprintf(idtext, sizeof(idtext), "ActionID: %s\r\n", id);
+    }
+
+    astman_send_listack(s, m, "Device latency will follow", "start");
+    manager_latency_event(s, idtext, device, "queue", &snapshot->tps_delay);
+    manager_latency_event(s, idtext, device, "audio", &snapshot->audio_interval);
+    for (unsigned int i = 0; i < snapshot->at_count; ++i) {
+        manager_latency_event(s, idtext, device, at_cmd2str(snapshot->at[i].cmd), &snapshot->at[i].rtt);
+    }
+    manager_latency_event(s, idtext, device, "call_incoming", &snapshot->call_setup[CALL_DIR_INCOMING]);
+    manager_latency_event(s, idtext, device, "call_outgoing", &snapshot->call_setup[CALL_DIR_OUTGOING]);
+
+    unsigned int events = snapshot->at_count + 4u;
+    for (unsigned int i = 0; i < CALL_TRACE_STAGES; ++i) {
+        /* first stage of direction has no previous one */
+        if (i == CALL_TRACE_FIRST(i)) {
+            continue;
+        }
+        char name[32];
+        snprintf(name, sizeof(name), "call_%s", call_trace2str((call_trace_t)i));
+        manager_latency_event(s, idtext, device, name, &snapshot->call_stage[i]);
+        events++;
+    }
+
+    astman_send_list_complete_start(s, m, "QuectelShowDeviceLatencyComplete", (int)events);
+    astman_send_list_complete_end(s);
+    return 0;
+}
+
+struct manager_device {
+    char id[DEVNAMELEN];
+    struct pvt_status* status;
+};
+
+/* devices list is locked only to take references of snapshots, no pvt is locked */
+static struct manager_device* manager_collect_devices(size_t* count)
+{
+    struct manager_device* devices = NULL;
+    struct pvt* pvt;
+    size_t n = 0;
+
+    AST_RWLIST_RDLOCK(&gpublic->devices);
+    AST_RWLIST_TRAVERSE(&gpublic->devices, pvt, entry) {
+        ++n;
+    }
+
+    if (n && (devices = ast_calloc(n, sizeof(*devices)))) {
+        n = 0;
+        AST_RWLIST_TRAVERSE(&gpublic->devices, pvt, entry) {
+            struct pvt_status* const status = pvt_status_get(pvt);
+            if (status) {
+                ast_copy_string(devices[n].id, PVT_ID(pvt), sizeof(devices[n].id));
+                devices[n++].status = status;
+            }
+        }
+    } else {
+        n = 0;
+    }
+    AST_RWLIST_UNLOCK(&gpublic->devices);
+
+    *count = n;
+    return devices;
+}
+
+static int manager_show_devices(struct mansession* s, const struct message* m)
+{
+    const char* const id = astman_get_header(m, "ActionID");
+
+    char idtext[256] = "";
+    if (!ast_strlen_zero(id)) {
+        snprintf(idtext, sizeof(idtext), "ActionID: %s\r\n", id);
+    }
+
+    size_t count;
+    RAII_VAR(struct manager_device*, devices, manager_collect_devices(&count), ast_free);
+
+    astman_send_listack(s, m, "Device status list will follow", "start");
+    for (size_t i = 0; i < count; ++i) {
+        const struct pvt_status* const status = devices[i].status;
+        astman_append(s,
+                      "Event: QuectelDeviceEntry\r\n"
+                      "%s"
+                      "Device: %s\r\n"
+                      "Group: %d\r\n"
+                      "State: %s\r\n"
+                      "RSSI: %d\r\n"
+                      "Mode: %d\r\n"
+                      "ProviderName: %s\r\n"
+                      "Model: %s\r\n"
+                      "Firmware: %s\r\n"
+                      "IMEI: %s\r\n"
+                      "IMSI: %s\r\n"
+                      "Number: %s\r\n"
+                      "\r\n",
+                      idtext, devices[i].id, status->group, status->state_ex, status->rssi, status->act, status->provider_name, status->model,
+                      status->firmware, status->imei, status->imsi, status->subscriber_number);
+        ao2_cleanup(devices[i].status);
+    }
+
+    astman_send_list_complete_start(s, m, "QuectelShowDevicesComplete", (int)count);
+    astman_send_list_complete_end(s);
+    return 0;
+}
+
+static int manager_send_sms_bulk(struct mansession* s, const struct message* m)
+{
+    const char* const group        = astman_get_header(m, "Group");
+    const char* const destinations = astman_get_header(m, "Destinations");
+    const char* const message      = astman_get_header(m, "Message");
+    const char* const validity     = astman_get_header(m, "Validity");
+    const char* const report       = astman_get_header(m, "Report");
+    const char* const id           = astman_get_header(m, "ActionID");
+
+    int group_num;
+    if (ast_strlen_zero(group) || sscanf(group, "%d", &group_num) != 1 || group_num < 0) {
+        astman_send_error(s, m, "Group not specified");
+        return 0;
+    }
+
+    if (ast_strlen_zero(destinations)) {
+        astman_send_error(s, m, "Destinations not specified");
+        return 0;
+    }
+
+    const int job = smsbulk_submit(group_num, destinations, message, ast_strlen_zero(validity) ? 0 : atoi(validity), ast_true(report));
+    if (job < 0) {
+        astman_send_error(s, m, error2str(chan_quectel_err));
+        return 0;
+    }
+
+    astman_append(s, "Response: Success\r\n");
+    if (!ast_strlen_zero(id)) {
+        astman_append(s, "ActionID: %s\r\n", id);
+    }
+    astman_append(s, "Message: SMS bulk job submitted\r\nJobID: %d\r\n\r\n", job);
+    return 0;
+}
+
+#/* */
+
+int manager_register()
+{
+    int res;
+
+    res  = ast_manager_register2(MANAGER_SHOW_DEVICES, EVENT_FLAG_SYSTEM | EVENT_FLAG_REPORTING, manager_show_devices, self_module(), "Show status of devices",
+                                 "Description: Lists state of every device, devices are not locked.\n"
+                                 "Variables:\n"
+                                 "  ActionID: <id>     Action ID for this transaction. Will be returned.\n");
+    res |= ast_manager_register2(MANAGER_SHOW_DEVICE_LATENCY, EVENT_FLAG_SYSTEM | EVENT_FLAG_REPORTING, manager_show_device_latency, self_module(),
+                                 "Show latency histograms of device",
+                                 "Description: Lists AT command round trip, response queue delay and audio write interval of device in microseconds.\n"
+                                 "Variables:\n"
+                                 "  ActionID: <id>     Action ID for this transaction. Will be returned.\n"
+                                 "  Device: <device>   The device name.\n");
+    res |= ast_manager_register2(MANAGER_SEND_SMS_BULK, EVENT_FLAG_CALL, manager_send_sms_bulk, self_module(), "Send SMS to many recipients by devices of group",
+                                 "Description: Spreads messages over devices of group, QuectelSMSBulkComplete event is sent when all messages are enqueued.\n"
+                                 "Variables:\n"
+                                 "  ActionID: <id>              Action ID for this transaction. Will be returned.\n"
+                                 "  Group: <group>              Group of devices.\n"
+                                 "  Destinations: <numbers>     Recipients separated by '&', ',' or spaces.\n"
+                                 "  Message: <message>          Text of the message.\n"
+                                 "  Validity: <minutes>         Validity period in minutes, optional.\n"
+                                 "  Report: <yes|no>            Request delivery report, optional.\n");
+    return res;
+}
+
+void manager_unregister()
+{
+    ast_manager_unregister(MANAGER_SEND_SMS_BULK);
+    ast_manager_unregister(MANAGER_SHOW_DEVICE_LATENCY);
+    ast_manager_unregister(MANAGER_SHOW_DEVICES);
+}
@@ -0,0 +1,10 @@
+/*
+   manager.h
+*/
+#ifndef CHAN_QUECTEL_MANAGER_H_INCLUDED
+#define CHAN_QUECTEL_MANAGER_H_INCLUDED
+
+int manager_register();
+void manager_unregister();
+
+#endif /* CHAN_QUECTEL_MANAGER_H_INCLUDED */
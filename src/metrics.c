@@ -0,0 +1,248 @@
+/*
+   metrics.c
+*/
+#include <inttypes.h> /* PRIu64 */
+
+#include "ast_config.h"
+
+#include <asterisk/http.h>
+#include <asterisk/json.h>
+#include <asterisk/strings.h>
+#include <asterisk/utils.h> /* RAII_VAR() */
+
+#include "metrics.h"
+
+#include "chan_quectel.h" /* gpublic pvt_get_stat() pvt_load_get() */
+#include "helpers.h"      /* gsm_regstate2str_json() */
+
+#define METRICS_PREFIX "quectel_"
+
+/* device sample, taken without pvt locks */
+struct metrics_sample {
+    char id[DEVNAMELEN];
+    dev_state_t state;
+    pvt_load_t load;
+    pvt_stat_t stat;
+};
+
+#/* */
+
+static struct metrics_sample* metrics_collect(size_t* count)
+{
+    struct metrics_sample* samples = NULL;
+    struct pvt* pvt;
+    size_t n = 0;
+
+    AST_RWLIST_RDLOCK(&gpublic->devices);
+    AST_RWLIST_TRAVERSE(&gpublic->devices, pvt, entry) {
+        ++n;
+    }
+
+    if (n && (samples = ast_calloc(n, sizeof(*samples)))) {
+        size_t i = 0;
+        AST_RWLIST_TRAVERSE(&gpublic->devices, pvt, entry) {
+            struct metrics_sample* const sample = &samples[i++];
+
+            ast_copy_string(sample->id, PVT_ID(pvt), sizeof(sample->id));
+            sample->state = pvt->current_state;
+            pvt_load_get(pvt, &sample->load);
+            pvt_get_stat(pvt, &sample->stat);
+        }
+    } else {
+        n = 0;
+    }
+    AST_RWLIST_UNLOCK(&gpublic->devices);
+
+    *count = n;
+    return samples;
+}
+
+#/* */
+
+static void metrics_append_label(struct ast_str** out, const char* value)
+{
+    for (; *value; ++value) {
+        switch (*value) {
+            case '\\':
+                ast_str_append(out, 0, "\\\\");
+                break;
+
+            case '"':
+                ast_str_append(out, 0, "\\\"");
+                break;
+
+            case '\n':
+                ast_str_append(out, 0, "\\n");
+                break;
+
+            default:
+                ast_str_append(out, 0, "%c", *value);
+                break;
+        }
+    }
+}
+
+static void metrics_append_header(struct ast_str** out, const char* name, const char* suffix, const char* type, const char* help)
+{
+    ast_str_append(out, 0, "# HELP " METRICS_PREFIX "%s%s %s\n# TYPE " METRICS_PREFIX "%s%s %s\n", name, suffix, help, name, suffix, type);
+}
+
+static void metrics_append_value(struct ast_str** out, const char* name, const char* suffix, const char* device, int64_t value)
+{
+    ast_str_append(out, 0, METRICS_PREFIX "%s%s{device=\"", name, suffix);
+    metrics_append_label(out, device);
+    ast_str_append(out, 0, "\"} %" PRId64 "\n", value);
+}
+
+static void metrics_prometheus(struct ast_str** out, const struct metrics_sample* samples, size_t count)
+{
+    for (size_t f = 0; f < pvt_stat_fields_count; ++f) {
+        const struct pvt_stat_field* const field = &pvt_stat_fields[f];
+        const char* const suffix                 = field->gauge ? "" : "_total";
+
+        metrics_append_header(out, field->name, suffix, field->gauge ? "gauge" : "counter", field->help);
+        for (size_t i = 0; i < count; ++i) {
+            metrics_append_value(out, field->name, suffix, samples[i].id, (int64_t)pvt_stat_value(&samples[i].stat, field));
+        }
+    }
+
+    metrics_append_header(out, "rssi", "", "gauge", "Signal strength, 0..31, 99 - unknown");
+    for (size_t i = 0; i < count; ++i) {
+        metrics_append_value(out, "rssi", "", samples[i].id, samples[i].load.rssi);
+    }
+
+    metrics_append_header(out, "gsm_registration_status", "", "gauge", "GSM registration status, +CREG <stat>, -1 - unknown");
+    for (size_t i = 0; i < count; ++i) {
+        metrics_append_value(out, "gsm_registration_status", "", samples[i].id, samples[i].load.gsm_reg_status);
+    }
+
+    metrics_append_header(out, "channels", "", "gauge", "Active channels");
+    for (size_t i = 0; i < count; ++i) {
+        metrics_append_value(out, "channels", "", samples[i].id, samples[i].load.calls);
+    }
+
+    metrics_append_header(out, "at_queue_tasks", "", "gauge", "Tasks waiting in AT queue");
+    for (size_t i = 0; i < count; ++i) {
+        metrics_append_value(out, "at_queue_tasks", "", samples[i].id, samples[i].load.at_tasks);
+    }
+
+    metrics_append_header(out, "at_queue_commands", "", "gauge", "Commands waiting in AT queue");
+    for (size_t i = 0; i < count; ++i) {
+        metrics_append_value(out, "at_queue_commands", "", samples[i].id, samples[i].load.at_cmds);
+    }
+
+    metrics_append_header(out, "device_state", "", "gauge", "Current state of device");
+    for (size_t i = 0; i < count; ++i) {
+        ast_str_append(out, 0, METRICS_PREFIX "device_state{device=\"");
+        metrics_append_label(out, samples[i].id);
+        ast_str_append(out, 0, "\",state=\"%s\"} 1\n", dev_state2str(samples[i].state));
+    }
+}
+
+static int metrics_json(struct ast_str** out, const struct metrics_sample* samples, size_t count)
+{
+    RAII_VAR(struct ast_json*, devices, ast_json_array_create(), ast_json_unref);
+    if (!devices) {
+        return -1;
+    }
+
+    for (size_t i = 0; i < count; ++i) {
+        struct ast_json* const device = ast_json_object_create();
+        struct ast_json* const stat   = ast_json_object_create();
+
+        if (!device || !stat) {
+            ast_json_unref(device);
+            ast_json_unref(stat);
+            return -1;
+        }
+
+        ast_json_object_set(device, "name", ast_json_string_create(samples[i].id));
+        ast_json_object_set(device, "state", ast_json_string_create(dev_state2str(samples[i].state)));
+        ast_json_object_set(device, "rssi", ast_json_integer_create(samples[i].load.rssi));
+        ast_json_object_set(device, "gsm", ast_json_string_create(gsm_regstate2str_json(samples[i].load.gsm_reg_status)));
+        ast_json_object_set(device, "channels", ast_json_integer_create(samples[i].load.calls));
+        ast_json_object_set(device, "at_tasks", ast_json_integer_create(samples[i].load.at_tasks));
+        ast_json_object_set(device, "at_cmds", ast_json_integer_create(samples[i].load.at_cmds));
+        pvt_get_stat_json(&samples[i].stat, stat);
+        ast_json_object_set(device, "stat", stat);
+        ast_json_array_append(devices, device);
+    }
+
+    RAII_VAR(struct ast_json*, root, ast_json_pack("{s: o}", "devices", ast_json_ref(devices)), ast_json_unref);
+    if (!root) {
+        return -1;
+    }
+
+    RAII_VAR(char*, str, ast_json_dump_string(root), ast_json_free);
+    if (!str) {
+        return -1;
+    }
+
+    ast_str_set(out, 0, "%s\n", str);
+    return 0;
+}
+
+#/* */
+
+static int metrics_callback(struct ast_tcptls_session_instance* ser, const struct ast_http_uri* urih, const char* uri, enum ast_http_method method,
+                            struct ast_variable* get_params, struct ast_variable* headers)
+{
+    int json = 0;
+
+    if (method != AST_HTTP_GET && method != AST_HTTP_HEAD) {
+        ast_http_error(ser, 501, "Not Implemented", "Method not supported");
+        return 0;
+    }
+
+    for (const struct ast_variable* v = get_params; v; v = v->next) {
+        if (!strcasecmp(v->name, "format")) {
+            json = !strcasecmp(v->value, "json");
+        }
+    }
+
+    struct ast_str* http_header = ast_str_create(64);
+    struct ast_str* out         = ast_str_create(4096);
+    if (!http_header || !out) {
+        ast_free(http_header);
+        ast_free(out);
+        ast_http_error(ser, 500, "Server Error", "Out of memory");
+        return 0;
+    }
+
+    size_t count                   = 0;
+    struct metrics_sample* samples = metrics_collect(&count);
+
+    if (json) {
+        if (metrics_json(&out, samples, count)) {
+            ast_free(samples);
+            ast_free(http_header);
+            ast_free(out);
+            ast_http_error(ser, 500, "Server Error", "Unable to build JSON");
+            return 0;
+        }
+        ast_str_set(&http_header, 0, "Content-Type: application/json\r\n");
+    } else {
+        metrics_prometheus(&out, samples, count);
+        ast_str_set(&http_header, 0, "Content-Type: text/plain; version=0.0.4\r\n");
+    }
+    ast_free(samples);
+
+    /* ast_http_send() takes ownership of header and content */
+    ast_http_send(ser, method, 200, NULL, http_header, out, 0, 0);
+    return 0;
+}
+
+static struct ast_http_uri metrics_uri = {
+    .description = "Quectel devices metrics",
+    .uri         = "quectel/metrics",
+    .callback    = metrics_callback,
+    .has_subtree = 0,
+    .data        = NULL,
+    .key         = __FILE__,
+};
+
+#/* */
+
+int metrics_register() { return ast_http_uri_link(&metrics_uri); }
+
+void metrics_unregister() { ast_http_uri_unlink(&metrics_uri); }
@@ -0,0 +1,11 @@
+/*
+   metrics.h
+*/
+#ifndef CHAN_QUECTEL_METRICS_H_INCLUDED
+#define CHAN_QUECTEL_METRICS_H_INCLUDED
+
+/* metrics of all devices at /<prefix>/quectel/metrics of Asterisk HTTP server */
+int metrics_register();
+void metrics_unregister();
+
+#endif /* CHAN_QUECTEL_METRICS_H_INCLUDED */
@@ -3,6 +3,14 @@
 */
 #include "ast_config.h"
 
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h> /* _mm_adds_epi16() _mm256_adds_epi16() */
+#elif defined(__ARM_NEON) || defined(__aarch64__)
+#include <arm_neon.h> /* vqaddq_s16() */
+#endif
+
+#include <byteswap.h> /* bswap_16() */
+
 #include <asterisk/utils.h> /* ast_slinear_saturated_add() */
 
 #include "mixbuffer.h"
@@ -26,17 +34,93 @@ void mixb_detach(struct mixbuffer* mb, struct mixstream* stream)
     AST_LIST_REMOVE(&mb->streams, stream, entry);
 }
 
-#/* TODO: move up */
+#if __BYTE_ORDER != __LITTLE_ENDIAN
 
-static void* saturated_sum(void* s1, const void* s2, size_t n)
+#/* byte swap fused with summing, buffer holds little endian samples */
+
+static void saturated_sum_le_c(short* s11, const short* s22, size_t n)
 {
-    short* s11 = s1;
-    short* s22 = (short*)s2;
+    for (; n; n--, s11++, s22++) {
+        short s = (short)bswap_16((unsigned short)*s11);
+        ast_slinear_saturated_add(&s, (short*)s22);
+        *s11 = (short)bswap_16((unsigned short)s);
+    }
+}
+
+#else
 
+#/* */
+
+static void saturated_sum_c(short* s11, const short* s22, size_t n)
+{
+    for (; n; n--, s11++, s22++) {
+        ast_slinear_saturated_add(s11, (short*)s22);
+    }
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+
+#/* */
+
+static __attribute__((target("sse2"))) void saturated_sum_sse2(short* s11, const short* s22, size_t n)
+{
+    for (; n >= 8u; n -= 8u, s11 += 8, s22 += 8) {
+        const __m128i a = _mm_loadu_si128((const __m128i*)s11);
+        const __m128i b = _mm_loadu_si128((const __m128i*)s22);
+        _mm_storeu_si128((__m128i*)s11, _mm_adds_epi16(a, b));
+    }
+    saturated_sum_c(s11, s22, n);
+}
+
+#/* */
+
+static __attribute__((target("avx2"))) void saturated_sum_avx2(short* s11, const short* s22, size_t n)
+{
+    for (; n >= 16u; n -= 16u, s11 += 16, s22 += 16) {
+        const __m256i a = _mm256_loadu_si256((const __m256i*)s11);
+        const __m256i b = _mm256_loadu_si256((const __m256i*)s22);
+        _mm256_storeu_si256((__m256i*)s11, _mm256_adds_epi16(a, b));
+    }
+    saturated_sum_sse2(s11, s22, n);
+}
+
+#elif defined(__ARM_NEON) || defined(__aarch64__)
+
+#/* */
+
+static void saturated_sum_neon(short* s11, const short* s22, size_t n)
+{
+    for (; n >= 8u; n -= 8u, s11 += 8, s22 += 8) {
+        vst1q_s16(s11, vqaddq_s16(vld1q_s16(s11), vld1q_s16(s22)));
+    }
+    saturated_sum_c(s11, s22, n);
+}
+
+#endif
+#endif
+
+#/* mix samples of s2 into s1, used as rb_write_f */
+
+static void* saturated_sum(void* s1, const void* s2, size_t n)
+{
     /* FIXME: odd bytes */
-    for (n /= 2; n; n--, s11++, s22++) {
-        ast_slinear_saturated_add(s11, s22);
+    n /= 2;
+
+#if __BYTE_ORDER != __LITTLE_ENDIAN
+    saturated_sum_le_c(s1, s2, n);
+#elif defined(__x86_64__) || defined(__i386__)
+    if (__builtin_cpu_supports("avx2")) {
+        saturated_sum_avx2(s1, s2, n);
+    } else if (__builtin_cpu_supports("sse2")) {
+        saturated_sum_sse2(s1, s2, n);
+    } else {
+        saturated_sum_c(s1, s2, n);
     }
+#elif defined(__ARM_NEON) || defined(__aarch64__)
+    saturated_sum_neon(s1, s2, n);
+#else
+    saturated_sum_c(s1, s2, n);
+#endif
 
     return s1;
 }
@@ -85,7 +169,7 @@ size_t mixb_write(struct mixbuffer* mb, struct mixstream* stream, const char* da
             if (max_mix) {
                 mixb_mix_write(mb, stream, data, max_mix);
             }
-            rb_write(&mb->rb, data + max_mix, len - max_mix);
+            rb_write_core(&mb->rb, data + max_mix, len - max_mix, rb_copy_le);
 
             /* save local state */
             stream->write = mb->rb.write;
@@ -17,6 +17,11 @@ struct mixstream {
     size_t write; /*!< write position */
 };
 
+/*
+    Samples are written in host order and kept in little endian order of audio TTY,
+    on big endian hosts byte swap is done while summing or copying, so mixed frames are passed to TTY as is.
+*/
+
 struct mixbuffer {
     AST_LIST_HEAD_NOLOCK(, mixstream) streams; /*!< list of stream descriptions */
     struct ringbuffer rb;                      /*!< base */
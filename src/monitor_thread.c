@@ -2,11 +2,16 @@
     monitor_thread.c
 */
 
-#include <signal.h>  /* SIGURG */
-#include <termios.h> /* struct termios tcgetattr() tcsetattr()  */
+#include <signal.h>       /* SIGURG */
+#include <sys/epoll.h>    /* epoll_create1() epoll_ctl() epoll_wait() */
+#include <sys/eventfd.h>  /* eventfd() */
+#include <sys/timerfd.h>  /* timerfd_create() timerfd_settime() */
+#include <termios.h>      /* struct termios tcgetattr() tcsetattr()  */
+#include <unistd.h>       /* sysconf() */
 
 #include "ast_config.h"
 
+#include <asterisk/astobj2.h>
 #include <asterisk/lock.h>
 #include <asterisk/strings.h>
 #include <asterisk/taskprocessor.h>
@@ -16,13 +21,35 @@
 
 #include "at_queue.h"
 #include "at_read.h"
+#include "at_respool.h"
+#include "at_response.h"
 #include "chan_quectel.h"
 #include "channel.h"
 #include "helpers.h"
-#include "smsdb.h"
 #include "tty.h"
 
-static const int TASKPROCESSOR_HIGH_WATER = 400;
+static const int RESPONSE_READ_TIMEOUT     = 10000;
+static const int UNHANDLED_COMMAND_TIMEOUT = 500;
+static const int READ_PAUSE_TIMEOUT        = 10; /* ms between checks of saturated taskprocessor */
+static const unsigned int RESPOOL_SIZE     = 32;
+static const unsigned int RESPOOL_COMPACT  = 4;   /* free response buffers kept, compact memory profile */
+static const size_t AT_BUFFER_COMPACT      = 512; /* initial size of AT receive buffer, compact memory profile */
+
+#/* size of AT receive buffer and number of free response buffers of memory profile */
+
+static size_t monitor_rb_size(const struct pvt* const pvt, unsigned int* respool_size)
+{
+    const size_t rb_size = CONF_SHARED(pvt, at_buffer);
+
+    if (CONF_GLOBAL(memory_profile) != MEMORY_PROFILE_COMPACT) {
+        *respool_size = RESPOOL_SIZE;
+        return rb_size;
+    }
+
+    /* buffer grows on demand up to at_rb_max */
+    *respool_size = RESPOOL_COMPACT;
+    return MIN(rb_size, AT_BUFFER_COMPACT);
+}
 
 static struct ast_taskprocessor* threadpool_serializer(struct ast_threadpool* pool, const char* const dev)
 {
@@ -30,7 +57,7 @@ static struct ast_taskprocessor* threadpool_serializer(struct ast_threadpool* po
     ast_taskprocessor_build_name(taskprocessor_name, sizeof(taskprocessor_name), "chan-quectel/%s", dev);
     struct ast_taskprocessor* const res = ast_threadpool_serializer(taskprocessor_name, pool);
     if (res) {
-        ast_taskprocessor_alert_set_levels(res, -1, TASKPROCESSOR_HIGH_WATER);
+        ast_taskprocessor_alert_set_levels(res, (long)CONF_GLOBAL(tps_low_water), (long)CONF_GLOBAL(tps_high_water));
     }
     return res;
 }
@@ -42,35 +69,36 @@ static int check_taskprocessor(struct ast_taskprocessor* tps, const char* dev)
     if (size || suspended) {
         ast_log(LOG_WARNING, "[%s] Taskprocessor - size:%ld suspended:%d\n", dev, size, suspended);
     }
-    return size >= TASKPROCESSOR_HIGH_WATER;
+    return size >= (long)CONF_GLOBAL(tps_high_water);
 }
 
-static void handle_expired_reports(struct pvt* pvt)
-{
-    static const size_t SMSDB_DEF_LEN = 64;
+#/* backpressure: stop reading at high water of taskprocessor until it drains to low water, return non-zero if paused */
 
-    RAII_VAR(struct ast_str*, dst, ast_str_create(SMSDB_DEF_LEN), ast_free);
-    RAII_VAR(struct ast_str*, msg, ast_str_create(SMSDB_DEF_LEN), ast_free);
-
-    int uid;
+static int read_paused(struct pvt* const pvt, struct ast_taskprocessor* tps, const char* dev, unsigned int* paused)
+{
+    const long depth = ast_taskprocessor_size(tps);
+    PVT_STAT_SET(pvt, tps_depth, depth);
+    PVT_STAT_MAX(pvt, tps_high_water, depth);
 
-    const ssize_t res = smsdb_outgoing_purge_one(&uid, &dst, &msg);
-    if (res < 0) {
-        return;
+    if (*paused) {
+        if (depth > (long)CONF_GLOBAL(tps_low_water)) {
+            return 1;
+        }
+        *paused = 0;
+        ast_debug(3, "[%s] Reading resumed, taskprocessor size:%ld\n", dev, depth);
+        return 0;
     }
 
-    ast_verb(3, "[%s][SMS:%d %s] Expired\n", PVT_ID(pvt), uid, ast_str_buffer(dst));
+    if (depth < (long)CONF_GLOBAL(tps_high_water)) {
+        return 0;
+    }
 
-    RAII_VAR(struct ast_json*, report, ast_json_object_create(), ast_json_unref);
-    ast_json_object_set(report, "info", ast_json_string_create("Message expired"));
-    ast_json_object_set(report, "uid", ast_json_integer_create(uid));
-    ast_json_object_set(report, "expired", ast_json_integer_create(1));
-    AST_JSON_OBJECT_SET(report, msg);
-    channel_start_local_report(pvt, "sms", LOCAL_REPORT_DIRECTION_OUTGOING, ast_str_buffer(dst), NULL, NULL, 0, report);
+    *paused = 1;
+    PVT_STAT_INC(pvt, read_pauses);
+    ast_debug(3, "[%s] Reading paused, taskprocessor size:%ld\n", dev, depth);
+    return 1;
 }
 
-static int handle_expired_reports_taskproc(void* tpdata) { return PVT_TASKPROC_TRYLOCK_AND_EXECUTE(tpdata, handle_expired_reports); }
-
 static void restart_monitor(struct pvt* pvt) { pvt->terminate_monitor = 1; }
 
 static int restart_monitor_taskproc(void* tpdata) { return PVT_TASKPROC_TRYLOCK_AND_EXECUTE(tpdata, restart_monitor); }
@@ -120,6 +148,11 @@ static int check_dev_status(struct pvt* const pvt)
         return -1;
     }
 
+    if (CONF_UNIQ(pvt, uac) > TRIBOOL_FALSE && !pvt->icard) {
+        ast_log(LOG_ERROR, "[%s][AUDIO][ALSA] Sound card closed\n", PVT_ID(pvt));
+        return -1;
+    }
+
     switch (CONF_UNIQ(pvt, uac)) {
         case TRIBOOL_FALSE:
             if (tty_status(pvt->audio_fd, &err)) {
@@ -149,21 +182,110 @@ static int check_dev_status(struct pvt* const pvt)
     return 0;
 }
 
-static void monitor_threadproc_pvt(struct pvt* const pvt)
+#/* split read data to responses and pass them to taskprocessor */
+
+static int push_responses(const char* dev, struct pvt* const pvt, struct ast_taskprocessor* tps, struct at_respool* pool, struct ringbuffer* rb,
+                          struct at_read_state* state)
 {
-    static const size_t RINGBUFFER_SIZE = 2 * 1024;
+    struct iovec iov[2];
+    size_t skip = 0u;
+    int iovcnt;
+
+    while ((iovcnt = at_read_result_iov(dev, state, &skip, rb, iov)) > 0) {
+        const size_t len = at_get_iov_size_n(iov, iovcnt);
+        if (!len) {
+            rb_read_upd(rb, skip);
+            skip = 0u;
+            continue;
+        }
+
+        /* single copy: from ringbuffer to pooled response buffer */
+        struct at_response_taskproc_data* const tpdata = at_respool_get(pool, pvt, len);
+        if (tpdata) {
+            at_combine_iov(&tpdata->response, iov, iovcnt);
+        }
+        rb_read_upd(rb, len + skip);
+        skip = 0u;
 
-    static const int RESPONSE_READ_TIMEOUT     = 10000;
-    static const int UNHANDLED_COMMAND_TIMEOUT = 500;
+        if (!tpdata) {
+            continue;
+        }
 
-    struct ringbuffer rb;
-    RAII_VAR(void* const, buf, ast_calloc(1, RINGBUFFER_SIZE), ast_free);
-    rb_init(&rb, buf, RINGBUFFER_SIZE);
+        tpdata->queued = ast_tvnow();
+        if (ast_taskprocessor_push(tps, at_response_taskproc, tpdata)) {
+            ast_log(LOG_ERROR, "[%s] Fail to handle response\n", dev);
+            at_respool_put(tpdata);
+            return -1;
+        }
+    }
 
-    RAII_VAR(struct ast_str* const, result, ast_str_create(RINGBUFFER_SIZE), ast_free);
+    return 0;
+}
+
+#/* make room in full receive buffer: grow it up to size limit or drop unterminated response */
+
+static void make_room(const char* dev, struct pvt* const pvt, struct ringbuffer* rb, void** buf, struct at_read_state* state)
+{
+    /* limit may be changed by reload while device is running */
+    const size_t max_size = __atomic_load_n(&pvt->at_rb_max, __ATOMIC_RELAXED);
+
+    if (rb->size > max_size && !rb_used(rb)) {
+        void* const shrunk = ast_malloc(max_size);
+        if (shrunk) {
+            ast_free(rb_move(rb, shrunk, max_size));
+            *buf = shrunk;
+            ast_debug(1, "[%s] AT receive buffer shrunk to %zu bytes\n", dev, max_size);
+
+            PVT_STAT_SET(pvt, at_rb_size, max_size);
+        }
+    }
+
+    if (rb_free(rb)) {
+        return;
+    }
+
+    if (rb->size < max_size) {
+        const size_t size = MIN(rb->size * 2u, max_size);
+        void* const grown = ast_malloc(size);
+        if (grown) {
+            ast_free(rb_move(rb, grown, size));
+            *buf = grown;
+            ast_debug(1, "[%s] AT receive buffer grown to %zu bytes\n", dev, size);
+
+            PVT_STAT_SET(pvt, at_rb_size, size);
+            PVT_STAT_INC(pvt, at_rb_grows);
+            return;
+        }
+    }
+
+    /* complete responses are already pushed, so whole buffer is one unterminated response */
+    ast_log(LOG_WARNING, "[%s] AT receive buffer overflow, drop %zu bytes of unterminated response\n", dev, rb_used(rb));
+    rb_reset(rb);
+    memset(state, 0, sizeof(*state));
+
+    PVT_STAT_INC(pvt, at_rb_overflows);
+}
+
+static void update_read_stat(struct pvt* const pvt, const struct ringbuffer* rb, size_t n)
+{
+    PVT_STAT_ADD(pvt, d_read_bytes, n);
+    PVT_STAT_MAX(pvt, at_rb_high_water, rb_used(rb));
+}
+
+static void monitor_threadproc_pvt(struct pvt* const pvt)
+{
+    struct ringbuffer rb;
 
     ast_mutex_lock(&pvt->lock);
+    unsigned int respool_size;
+    const size_t rb_size = monitor_rb_size(pvt, &respool_size);
+    RAII_VAR(void*, buf, ast_calloc(1, rb_size), ast_free);
+    rb_init(&rb, buf, rb_size);
+    PVT_STAT_SET(pvt, at_rb_size, rb_size);
+
+    RAII_VAR(struct at_respool*, pool, at_respool_create(rb_size + 1u, respool_size), ao2_cleanup);
     RAII_VAR(char* const, dev, ast_strdup(PVT_ID(pvt)), ast_free);
+    unsigned int paused = 0;
 
     RAII_VAR(struct ast_taskprocessor*, tps, threadpool_serializer(gpublic->threadpool, dev), ast_taskprocessor_unreference);
     if (!tps) {
@@ -171,6 +293,12 @@ static void monitor_threadproc_pvt(struct pvt* const pvt)
         goto e_cleanup;
     }
 
+    if (!buf || !pool) {
+        ast_log(LOG_ERROR, "[%s] Error initializing response buffers\n", dev);
+        goto e_cleanup;
+    }
+    pvt->respool = ao2_bump(pool);
+
     /* 4 reduce locking time make copy of this readonly fields */
     const int fd = pvt->data_fd;
     at_clean_data(dev, fd, &rb);
@@ -183,12 +311,8 @@ static void monitor_threadproc_pvt(struct pvt* const pvt)
 
     ast_mutex_unlock(&pvt->lock);
 
-    int read_result = 0;
+    struct at_read_state state = {0};
     while (1) {
-        if (ast_taskprocessor_push(tps, handle_expired_reports_taskproc, pvt)) {
-            ast_debug(5, "[%s] Unable to handle exprired reports\n", dev);
-        }
-
         if (ast_mutex_trylock(&pvt->lock)) {  // pvt unlocked
             int t = RESPONSE_READ_TIMEOUT;
             if (!at_wait(fd, &t)) {
@@ -215,7 +339,9 @@ static void monitor_threadproc_pvt(struct pvt* const pvt)
 
             ast_mutex_unlock(&pvt->lock);
 
-            if (is_cmd_timeout) {
+            if (paused) {
+                /* responses are not read until taskprocessor drains, command timeout is suspended as in reactor */
+            } else if (is_cmd_timeout) {
                 if (t <= 0) {
                     if (check_taskprocessor(tps, dev)) {
                         if (ast_taskprocessor_push(tps, restart_monitor_taskproc, pvt)) {
@@ -254,36 +380,24 @@ static void monitor_threadproc_pvt(struct pvt* const pvt)
             }
         }
 
+        /* responses are handled slower than received, leave data in tty buffer */
+        if (read_paused(pvt, tps, dev, &paused)) {
+            usleep(READ_PAUSE_TIMEOUT * 1000);
+            continue;
+        }
+
+        make_room(dev, pvt, &rb, &buf, &state);
+
         /* FIXME: access to device not locked */
         int iovcnt = at_read(dev, fd, &rb);
         if (iovcnt < 0) {
             break;
         }
 
-        if (!ast_mutex_trylock(&pvt->lock)) {
-            PVT_STAT(pvt, d_read_bytes) += iovcnt;
-            ast_mutex_unlock(&pvt->lock);
-        }
+        update_read_stat(pvt, &rb, iovcnt);
 
-        struct iovec iov[2];
-        size_t skip = 0u;
-
-        while ((iovcnt = at_read_result_iov(dev, &read_result, &skip, &rb, iov, result)) > 0) {
-            const size_t len = at_combine_iov(result, iov, iovcnt);
-            rb_read_upd(&rb, len + skip);
-            skip = 0u;
-            if (!len) {
-                continue;
-            }
-
-            struct at_response_taskproc_data* const tpdata = at_response_taskproc_data_alloc(pvt, result);
-            if (tpdata) {
-                if (ast_taskprocessor_push(tps, at_response_taskproc, tpdata)) {
-                    ast_log(LOG_ERROR, "[%s] Fail to handle response\n", dev);
-                    ast_free(tpdata);
-                    goto e_restart;
-                }
-            }
+        if (push_responses(dev, pvt, tps, pool, &rb, &state)) {
+            goto e_restart;
         }
     }
 
@@ -306,12 +420,13 @@ e_restart:
 static void* monitor_threadproc(void* _pvt)
 {
     struct pvt* const pvt = _pvt;
+    thread_set_cpus(PVT_ID(pvt), CONF_GLOBAL(monitor_cpus));
     monitor_threadproc_pvt(pvt);
     /* TODO: wakeup discovery thread after some delay */
     return NULL;
 }
 
-int pvt_monitor_start(struct pvt* pvt)
+static int monitor_thread_start(struct pvt* pvt)
 {
     if (ast_pthread_create_background(&pvt->monitor_thread, NULL, monitor_threadproc, pvt) < 0) {
         pvt->monitor_thread = AST_PTHREADT_NULL;
@@ -321,7 +436,7 @@ int pvt_monitor_start(struct pvt* pvt)
     return 1;
 }
 
-void pvt_monitor_stop(struct pvt* pvt)
+static void monitor_thread_stop(struct pvt* pvt)
 {
     if (pvt->monitor_thread == AST_PTHREADT_NULL) {
         return;
@@ -339,3 +454,535 @@ void pvt_monitor_stop(struct pvt* pvt)
     pvt->terminate_monitor = 0;
     pvt->monitor_thread    = AST_PTHREADT_NULL;
 }
+
+/*
+    Reactor mode
+
+    All data descriptors are multiplexed by a small pool of threads.
+    Every device owns a private epoll set holding its data descriptor and a timerfd,
+    the private set is registered in the shared one with EPOLLONESHOT,
+    so a device is handled by exactly one reactor thread at a time.
+*/
+
+typedef enum {
+    MONITOR_TIMEOUT_NONE = 0,    /*!< just re-evaluate state */
+    MONITOR_TIMEOUT_PING,        /*!< no response, ping device */
+    MONITOR_TIMEOUT_PING_CHECK,  /*!< no response, ping device and check taskprocessor */
+    MONITOR_TIMEOUT_CMD,         /*!< command timed out */
+} monitor_timeout_t;
+
+struct monitor_ctx {
+    struct pvt* pvt;
+    struct ast_taskprocessor* tps;
+    int fd;  /*!< copy of pvt->data_fd */
+    int tfd; /*!< timerfd for command and response timeouts */
+    int efd; /*!< private epoll set */
+    monitor_timeout_t on_timeout;
+    struct at_read_state read_state;
+    struct ringbuffer rb;
+    void* buf;           /*!< storage of receive buffer */
+    unsigned int paused; /*!< reading paused by saturated taskprocessor, data descriptor is not polled */
+    struct at_respool* respool;
+
+    ast_mutex_t lock; /*!< protects flags below */
+    ast_cond_t cond;
+    unsigned int stop         :1; /*!< stop requested by pvt_monitor_stop() */
+    unsigned int done         :1; /*!< removed from reactor */
+    unsigned int disconnected :1; /*!< device disconnected by reactor thread */
+
+    char dev[DEVNAMELEN];
+};
+
+struct monitor_reactor {
+    int efd; /*!< shared epoll set */
+    int wfd; /*!< eventfd for threads wakeup on shutdown */
+    unsigned int threadsno;
+    pthread_t threads[0];
+};
+
+static struct monitor_reactor* reactor = NULL;
+
+static int monitor_ctx_arm(struct monitor_ctx* const ctx, int ms, monitor_timeout_t on_timeout)
+{
+    struct itimerspec its = {
+        .it_interval = {0, 0},
+        .it_value    = {ms / 1000, (ms % 1000) * 1000000l},
+    };
+
+    if (ms <= 0) {
+        its.it_value.tv_nsec = 1;  // zero value disarms timer
+    } else if (ctx->paused && ms > READ_PAUSE_TIMEOUT) {
+        /* only data descriptor tells device is alive, check taskprocessor soon instead */
+        its.it_value.tv_sec  = 0;
+        its.it_value.tv_nsec = READ_PAUSE_TIMEOUT * 1000000l;
+        on_timeout           = MONITOR_TIMEOUT_NONE;
+    }
+
+    ctx->on_timeout = on_timeout;
+    return timerfd_settime(ctx->tfd, 0, &its, NULL);
+}
+
+static int monitor_ctx_rearm(struct monitor_ctx* const ctx)
+{
+    struct epoll_event ev = {.events = EPOLLIN | EPOLLONESHOT, .data.ptr = ctx};
+    return epoll_ctl(reactor->efd, EPOLL_CTL_MOD, ctx->efd, &ev);
+}
+
+static void monitor_ctx_free(struct monitor_ctx* const ctx)
+{
+    if (ctx->efd >= 0) {
+        close(ctx->efd);
+    }
+    if (ctx->tfd >= 0) {
+        close(ctx->tfd);
+    }
+    if (ctx->tps) {
+        ast_taskprocessor_unreference(ctx->tps);
+    }
+    ao2_cleanup(ctx->respool);
+    ast_free(ctx->buf);
+    ast_cond_destroy(&ctx->cond);
+    ast_mutex_destroy(&ctx->lock);
+    ast_free(ctx);
+}
+
+static struct monitor_ctx* monitor_ctx_alloc(struct pvt* const pvt)
+{
+    struct monitor_ctx* const ctx = ast_calloc(1, sizeof(*ctx));
+    if (!ctx) {
+        return NULL;
+    }
+
+    ast_mutex_init(&ctx->lock);
+    ast_cond_init(&ctx->cond, NULL);
+    ctx->pvt = pvt;
+    ctx->fd  = pvt->data_fd;
+    ctx->tfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    ctx->efd = epoll_create1(EPOLL_CLOEXEC);
+    ast_copy_string(ctx->dev, PVT_ID(pvt), sizeof(ctx->dev));
+
+    unsigned int respool_size;
+    const size_t rb_size = monitor_rb_size(pvt, &respool_size);
+    ctx->buf             = ast_calloc(1, rb_size);
+    rb_init(&ctx->rb, ctx->buf, rb_size);
+    PVT_STAT_SET(pvt, at_rb_size, rb_size);
+
+    ctx->respool = at_respool_create(rb_size + 1u, respool_size);
+    ctx->tps     = threadpool_serializer(gpublic->threadpool, ctx->dev);
+
+    if (ctx->tfd < 0 || ctx->efd < 0 || !ctx->buf || !ctx->respool || !ctx->tps) {
+        monitor_ctx_free(ctx);
+        return NULL;
+    }
+
+    struct epoll_event ev = {.events = EPOLLIN, .data.fd = ctx->fd};
+    if (epoll_ctl(ctx->efd, EPOLL_CTL_ADD, ctx->fd, &ev)) {
+        monitor_ctx_free(ctx);
+        return NULL;
+    }
+
+    ev.data.fd = ctx->tfd;
+    if (epoll_ctl(ctx->efd, EPOLL_CTL_ADD, ctx->tfd, &ev)) {
+        monitor_ctx_free(ctx);
+        return NULL;
+    }
+
+    return ctx;
+}
+
+#/* called with pvt lock hold, same as monitor_threadproc_pvt() exit path */
+
+static void monitor_ctx_disconnect(struct monitor_ctx* const ctx, int restart)
+{
+    struct pvt* const pvt = ctx->pvt;
+
+    if (!restart) {
+        if (!pvt->initialized) {
+            // TODO: send monitor event
+            ast_verb(3, "[%s] Error initializing channel\n", ctx->dev);
+        }
+        /* it real, unsolicited disconnect */
+        pvt->terminate_monitor = 0;
+    }
+
+    pvt_disconnect(pvt);
+
+    SCOPED_MUTEX(ctx_lock, &ctx->lock);
+    ctx->disconnected = 1;
+}
+
+static int monitor_ctx_stopping(struct monitor_ctx* const ctx)
+{
+    SCOPED_MUTEX(ctx_lock, &ctx->lock);
+    return ctx->stop;
+}
+
+static void monitor_ctx_done(struct monitor_ctx* const ctx)
+{
+    epoll_ctl(reactor->efd, EPOLL_CTL_DEL, ctx->efd, NULL);
+
+    SCOPED_MUTEX(ctx_lock, &ctx->lock);
+    ctx->done = 1;
+    ast_cond_broadcast(&ctx->cond);
+}
+
+#/* handle responses, return non-zero on unrecoverable error */
+
+static int monitor_ctx_read(struct monitor_ctx* const ctx)
+{
+    struct pvt* const pvt = ctx->pvt;
+
+    make_room(ctx->dev, pvt, &ctx->rb, &ctx->buf, &ctx->read_state);
+
+    /* FIXME: access to device not locked */
+    int iovcnt = at_read(ctx->dev, ctx->fd, &ctx->rb);
+    if (iovcnt < 0) {
+        return -1;
+    }
+
+    update_read_stat(pvt, &ctx->rb, iovcnt);
+
+    return push_responses(ctx->dev, pvt, ctx->tps, ctx->respool, &ctx->rb, &ctx->read_state) ? 1 : 0;
+}
+
+#/* stop and resume polling of data descriptor by backpressure, return non-zero if reading is paused */
+
+static int monitor_ctx_throttle(struct monitor_ctx* const ctx)
+{
+    const unsigned int was_paused = ctx->paused;
+    const int paused              = read_paused(ctx->pvt, ctx->tps, ctx->dev, &ctx->paused);
+
+    if (ctx->paused != was_paused) {
+        struct epoll_event ev = {.events = ctx->paused ? 0 : EPOLLIN, .data.fd = ctx->fd};
+        if (epoll_ctl(ctx->efd, EPOLL_CTL_MOD, ctx->fd, &ev)) {
+            ast_log(LOG_WARNING, "[%s] Unable to %s reading: %s\n", ctx->dev, ctx->paused ? "pause" : "resume", strerror(errno));
+        }
+    }
+
+    return paused;
+}
+
+static void monitor_ctx_timeout(struct monitor_ctx* const ctx)
+{
+    switch (ctx->on_timeout) {
+        case MONITOR_TIMEOUT_PING_CHECK:
+            if (check_taskprocessor(ctx->tps, ctx->dev)) {
+                if (ast_taskprocessor_push(ctx->tps, restart_monitor_taskproc, ctx->pvt)) {
+                    ast_debug(5, "[%s] Unable to restart monitor thread\n", ctx->dev);
+                }
+            }
+            /* fall through */
+
+        case MONITOR_TIMEOUT_PING:
+            if (ast_taskprocessor_push(ctx->tps, at_enqueue_ping_taskproc, ctx->pvt)) {
+                ast_debug(5, "[%s] Unable to handle timeout\n", ctx->dev);
+            }
+            break;
+
+        case MONITOR_TIMEOUT_CMD:
+            if (ast_taskprocessor_push(ctx->tps, cmd_timeout_taskproc, ctx->pvt)) {
+                ast_debug(5, "[%s] Unable to handle timeout\n", ctx->dev);
+            }
+            break;
+
+        case MONITOR_TIMEOUT_NONE:
+            break;
+    }
+}
+
+/* stop wake-up armed by monitor_reactor_ctx_stop() must not be replaced by longer timeout */
+static int monitor_ctx_arm_running(struct monitor_ctx* const ctx, int ms, monitor_timeout_t on_timeout)
+{
+    SCOPED_MUTEX(ctx_lock, &ctx->lock);
+    if (ctx->stop) {
+        return monitor_ctx_arm(ctx, 0, MONITOR_TIMEOUT_NONE);
+    }
+    return monitor_ctx_arm(ctx, ms, on_timeout);
+}
+
+#/* one iteration of monitor_threadproc_pvt() loop, return -1 - cleanup, 1 - restart, 0 - continue */
+
+static int monitor_ctx_schedule(struct monitor_ctx* const ctx)
+{
+    struct pvt* const pvt = ctx->pvt;
+
+    if (ast_mutex_trylock(&pvt->lock)) {  // pvt busy
+        return monitor_ctx_arm_running(ctx, RESPONSE_READ_TIMEOUT, MONITOR_TIMEOUT_PING) ? -1 : 0;
+    }
+
+    if (check_dev_status(pvt)) {
+        monitor_ctx_disconnect(ctx, 0);
+        ast_mutex_unlock(&pvt->lock);
+        return -1;
+    }
+
+    if (pvt->terminate_monitor) {
+        ast_log(LOG_NOTICE, "[%s] Stopping by %s request\n", ctx->dev, dev_state2str(pvt->desired_state));
+        monitor_ctx_disconnect(ctx, 1);
+        ast_mutex_unlock(&pvt->lock);
+        return 1;
+    }
+
+    int t;
+    const int is_cmd_timeout = !at_queue_timeout(pvt, &t);
+
+    ast_mutex_unlock(&pvt->lock);
+
+    /* responses are not read until taskprocessor drains, command timeout is suspended */
+    if (ctx->paused) {
+        return monitor_ctx_arm_running(ctx, READ_PAUSE_TIMEOUT, MONITOR_TIMEOUT_NONE) ? -1 : 0;
+    }
+
+    if (!is_cmd_timeout) {
+        return monitor_ctx_arm_running(ctx, RESPONSE_READ_TIMEOUT, MONITOR_TIMEOUT_PING_CHECK) ? -1 : 0;
+    }
+
+    if (t > 0) {
+        return monitor_ctx_arm_running(ctx, t, MONITOR_TIMEOUT_CMD) ? -1 : 0;
+    }
+
+    if (check_taskprocessor(ctx->tps, ctx->dev)) {
+        if (ast_taskprocessor_push(ctx->tps, restart_monitor_taskproc, pvt)) {
+            ast_debug(5, "[%s] Unable to restart monitor thread\n", ctx->dev);
+        }
+    }
+
+    if (ast_taskprocessor_push(ctx->tps, cmd_timeout_taskproc, pvt)) {
+        ast_debug(5, "[%s] Unable to handle timeout\n", ctx->dev);
+    }
+
+    return monitor_ctx_arm_running(ctx, UNHANDLED_COMMAND_TIMEOUT, MONITOR_TIMEOUT_NONE) ? -1 : 0;
+}
+
+static void monitor_ctx_handle(struct monitor_ctx* const ctx)
+{
+    struct epoll_event events[2];
+    int readable = 0;
+    int expired  = 0;
+
+    if (monitor_ctx_stopping(ctx)) {
+        monitor_ctx_done(ctx);
+        return;
+    }
+
+    const int n = epoll_wait(ctx->efd, events, ARRAY_LEN(events), 0);
+    for (int i = 0; i < n; ++i) {
+        if (events[i].data.fd == ctx->tfd) {
+            uint64_t expirations;
+            if (read(ctx->tfd, &expirations, sizeof(expirations)) > 0) {
+                expired = 1;
+            }
+        } else {
+            readable = 1;
+        }
+    }
+
+    if (expired) {
+        monitor_ctx_timeout(ctx);
+    }
+
+    /* while paused data descriptor is not polled, timer checks if taskprocessor drained */
+    if ((readable || ctx->paused) && monitor_ctx_throttle(ctx)) {
+        readable = 0;
+    }
+
+    if (readable) {
+        const int res = monitor_ctx_read(ctx);
+        if (res) {
+            ast_mutex_lock(&ctx->pvt->lock);
+            if (!monitor_ctx_stopping(ctx)) {
+                monitor_ctx_disconnect(ctx, res > 0);
+            }
+            ast_mutex_unlock(&ctx->pvt->lock);
+            monitor_ctx_done(ctx);
+            return;
+        }
+    }
+
+    if (monitor_ctx_schedule(ctx) || monitor_ctx_rearm(ctx)) {
+        monitor_ctx_done(ctx);
+    }
+}
+
+static void* monitor_reactor_threadproc(void* arg)
+{
+    struct monitor_reactor* const r = arg;
+
+    thread_set_cpus("reactor", CONF_GLOBAL(monitor_cpus));
+
+    while (1) {
+        struct epoll_event ev;
+        const int n = epoll_wait(r->efd, &ev, 1, -1);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            ast_log(LOG_ERROR, "Reactor epoll_wait() failed: %s\n", strerror(errno));
+            break;
+        }
+
+        if (!n) {
+            continue;
+        }
+
+        if (!ev.data.ptr) {  // shutdown
+            break;
+        }
+
+        monitor_ctx_handle(ev.data.ptr);
+    }
+
+    return NULL;
+}
+
+static int monitor_reactor_ctx_start(struct pvt* pvt)
+{
+    struct monitor_ctx* const ctx = monitor_ctx_alloc(pvt);
+    if (!ctx) {
+        ast_log(LOG_ERROR, "[%s] Error initializing monitor context\n", PVT_ID(pvt));
+        return 0;
+    }
+
+    at_clean_data(ctx->dev, ctx->fd, &ctx->rb);
+
+    /* schedule initilization  */
+    if (at_enqueue_initialization(&pvt->sys_chan)) {
+        ast_log(LOG_ERROR, "[%s] Error adding initialization commands to queue\n", ctx->dev);
+        monitor_ctx_free(ctx);
+        return 0;
+    }
+
+    if (monitor_ctx_arm(ctx, 0, MONITOR_TIMEOUT_NONE)) {
+        monitor_ctx_free(ctx);
+        return 0;
+    }
+
+    struct epoll_event ev = {.events = EPOLLIN | EPOLLONESHOT, .data.ptr = ctx};
+    if (epoll_ctl(reactor->efd, EPOLL_CTL_ADD, ctx->efd, &ev)) {
+        ast_log(LOG_ERROR, "[%s] Unable to register in reactor: %s\n", ctx->dev, strerror(errno));
+        monitor_ctx_free(ctx);
+        return 0;
+    }
+
+    pvt->monitor_ctx = ctx;
+    pvt->respool     = ao2_bump(ctx->respool);
+    return 1;
+}
+
+static void monitor_reactor_ctx_stop(struct pvt* pvt)
+{
+    struct monitor_ctx* const ctx = pvt->monitor_ctx;
+
+    pvt->terminate_monitor = 1;
+
+    {
+        SCOPED_LOCK(pvt_lock, &pvt->lock, ast_mutex_unlock, ast_mutex_lock);  // scoped UNlock
+        SCOPED_MUTEX(ctx_lock, &ctx->lock);
+        if (!ctx->done) {
+            ctx->stop = 1;
+            /* wake up reactor thread, ctx will be removed from reactor by handler */
+            monitor_ctx_arm(ctx, 0, MONITOR_TIMEOUT_NONE);
+            while (!ctx->done) {
+                ast_cond_wait(&ctx->cond, &ctx->lock);
+            }
+        }
+    }
+
+    if (!ctx->disconnected) {
+        pvt_disconnect(pvt);
+    }
+
+    monitor_ctx_free(ctx);
+    pvt->monitor_ctx       = NULL;
+    pvt->terminate_monitor = 0;
+}
+
+int monitor_reactor_init(unsigned int threads)
+{
+    if (!threads) {
+        const long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        threads         = (cpus > 0) ? (unsigned int)cpus : 1u;
+    }
+
+    struct monitor_reactor* const r = ast_calloc(1, sizeof(*r) + threads * sizeof(pthread_t));
+    if (!r) {
+        return -1;
+    }
+
+    r->efd = epoll_create1(EPOLL_CLOEXEC);
+    r->wfd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (r->efd < 0 || r->wfd < 0) {
+        goto cleanup;
+    }
+
+    struct epoll_event ev = {.events = EPOLLIN, .data.ptr = NULL};
+    if (epoll_ctl(r->efd, EPOLL_CTL_ADD, r->wfd, &ev)) {
+        goto cleanup;
+    }
+
+    for (r->threadsno = 0; r->threadsno < threads; ++r->threadsno) {
+        if (ast_pthread_create_background(&r->threads[r->threadsno], NULL, monitor_reactor_threadproc, r) < 0) {
+            break;
+        }
+    }
+
+    if (!r->threadsno) {
+        goto cleanup;
+    }
+
+    reactor = r;
+    ast_verb(3, "Reactor started with %u thread(s)\n", r->threadsno);
+    return 0;
+
+cleanup:
+    ast_log(LOG_ERROR, "Unable to start reactor: %s\n", strerror(errno));
+    if (r->wfd >= 0) {
+        close(r->wfd);
+    }
+    if (r->efd >= 0) {
+        close(r->efd);
+    }
+    ast_free(r);
+    return -1;
+}
+
+void monitor_reactor_fini()
+{
+    struct monitor_reactor* const r = reactor;
+    if (!r) {
+        return;
+    }
+
+    const uint64_t one = 1;
+    if (write(r->wfd, &one, sizeof(one)) < 0) {
+        ast_log(LOG_WARNING, "Unable to wake up reactor threads: %s\n", strerror(errno));
+    }
+
+    for (unsigned int i = 0; i < r->threadsno; ++i) {
+        pthread_join(r->threads[i], NULL);
+    }
+
+    reactor = NULL;
+    close(r->wfd);
+    close(r->efd);
+    ast_free(r);
+}
+
+int pvt_monitor_start(struct pvt* pvt)
+{
+    if (reactor) {
+        return monitor_reactor_ctx_start(pvt);
+    }
+
+    return monitor_thread_start(pvt);
+}
+
+void pvt_monitor_stop(struct pvt* pvt)
+{
+    if (pvt->monitor_ctx) {
+        monitor_reactor_ctx_stop(pvt);
+        return;
+    }
+
+    monitor_thread_stop(pvt);
+}
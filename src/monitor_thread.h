@@ -10,4 +10,7 @@ struct pvt;
 int pvt_monitor_start(struct pvt* pvt);
 void pvt_monitor_stop(struct pvt* pvt);
 
+int monitor_reactor_init(unsigned int threads);
+void monitor_reactor_fini();
+
 #endif
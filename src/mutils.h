@@ -17,6 +17,10 @@
 #define MIN(a, b) (((a) < (b)) ? (a) : (b))
 #endif
 
+#ifndef MAX
+#define MAX(a, b) (((a) > (b)) ? (a) : (b))
+#endif
+
 static inline const char* attribute_const enum2str_def(const unsigned value, const char* const names[], const unsigned items, const char* const def)
 {
     return S_COR(value < items, names[value], def);
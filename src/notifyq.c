@@ -0,0 +1,175 @@
+/*
+   notifyq.c
+*/
+#include <errno.h> /* ETIMEDOUT */
+
+#include "ast_config.h"
+
+#include <asterisk/linkedlists.h>
+#include <asterisk/lock.h>
+#include <asterisk/manager.h> /* manager_event() */
+#include <asterisk/utils.h>
+
+#include "notifyq.h"
+
+#include "chan_quectel.h" /* CONF_GLOBAL() */
+
+static const unsigned int NOTIFYQ_MAX_PENDING = 1024; /* events waiting for thread */
+
+struct notifyq_event {
+    AST_LIST_ENTRY(notifyq_event) entry;
+    const char* device;
+    const char* type;
+    const char* number;
+    const char* data;
+    char buf[0]; /*!< strings above point here */
+};
+
+AST_LIST_HEAD_NOLOCK(notifyq_list, notifyq_event);
+
+static struct {
+    ast_mutex_t lock;
+    ast_cond_t cond;            /*!< signaled on new event and shutdown */
+    pthread_t thread;           /*!< notification thread */
+    struct notifyq_list events; /*!< pending events, oldest first */
+    unsigned int pending;       /*!< number of pending events */
+    unsigned int dropped;       /*!< events dropped since last warning */
+    unsigned int running:1;     /*!< notification thread is running */
+} notifyq;
+
+#/* */
+
+static char* notifyq_copy(char* dst, const char* src, const char** field)
+{
+    const size_t len = strlen(src) + 1u;
+    memcpy(dst, src, len);
+    *field = dst;
+    return dst + len;
+}
+
+static void notifyq_send(const struct notifyq_event* ev)
+{
+    manager_event(EVENT_FLAG_CALL, "QuectelNotify", "Device: %s\r\nType: %s\r\nNumber: %s\r\nData: %s\r\n", ev->device, ev->type, ev->number,
+                  ev->data);
+}
+
+static void* notifyq_threadproc(attribute_unused void* arg)
+{
+    ast_mutex_lock(&notifyq.lock);
+
+    while (notifyq.running) {
+        if (!notifyq.pending) {
+            ast_cond_wait(&notifyq.cond, &notifyq.lock);
+            continue;
+        }
+
+        /* collect events of window, they are sent in one go */
+        const unsigned int batch = CONF_GLOBAL(notify_batch);
+        if (batch && notifyq.pending < NOTIFYQ_MAX_PENDING) {
+            const struct timeval deadline = ast_tvadd(ast_tvnow(), ast_samp2tv(batch, 1000));
+            const struct timespec ts      = {.tv_sec = deadline.tv_sec, .tv_nsec = deadline.tv_usec * 1000l};
+            while (notifyq.running && notifyq.pending < NOTIFYQ_MAX_PENDING && ast_cond_timedwait(&notifyq.cond, &notifyq.lock, &ts) != ETIMEDOUT) {
+            }
+        }
+
+        struct notifyq_list events = notifyq.events;
+        const unsigned int dropped = notifyq.dropped;
+        AST_LIST_HEAD_INIT_NOLOCK(&notifyq.events);
+        notifyq.pending = 0;
+        notifyq.dropped = 0;
+        ast_mutex_unlock(&notifyq.lock);
+
+        if (dropped) {
+            ast_log(LOG_WARNING, "Notification queue is full, %u events dropped\n", dropped);
+        }
+
+        struct notifyq_event* ev;
+        while ((ev = AST_LIST_REMOVE_HEAD(&events, entry))) {
+            notifyq_send(ev);
+            ast_free(ev);
+        }
+
+        ast_mutex_lock(&notifyq.lock);
+    }
+
+    ast_mutex_unlock(&notifyq.lock);
+    return NULL;
+}
+
+#/* */
+
+int notifyq_push(const char* device, const char* type, const char* number, const char* data)
+{
+    number = S_OR(number, "");
+
+    const size_t len               = strlen(device) + strlen(type) + strlen(number) + strlen(data) + 4u;
+    struct notifyq_event* const ev = ast_malloc(sizeof(*ev) + len);
+    if (!ev) {
+        return -1;
+    }
+
+    char* p = ev->buf;
+    p       = notifyq_copy(p, device, &ev->device);
+    p       = notifyq_copy(p, type, &ev->type);
+    p       = notifyq_copy(p, number, &ev->number);
+    notifyq_copy(p, data, &ev->data);
+
+    ast_mutex_lock(&notifyq.lock);
+    if (!notifyq.running || notifyq.pending >= NOTIFYQ_MAX_PENDING) {
+        ++notifyq.dropped;
+        ast_mutex_unlock(&notifyq.lock);
+        ast_free(ev);
+        return -1;
+    }
+
+    AST_LIST_INSERT_TAIL(&notifyq.events, ev, entry);
+    if (!notifyq.pending++ || notifyq.pending >= NOTIFYQ_MAX_PENDING) {
+        ast_cond_signal(&notifyq.cond);
+    }
+    ast_mutex_unlock(&notifyq.lock);
+
+    return 0;
+}
+
+int notifyq_init()
+{
+    static int initialized = 0;
+
+    if (!initialized) {
+        ast_mutex_init(&notifyq.lock);
+        ast_cond_init(&notifyq.cond, NULL);
+        AST_LIST_HEAD_INIT_NOLOCK(&notifyq.events);
+        initialized = 1;
+    }
+
+    notifyq.running = 1;
+    if (ast_pthread_create_background(&notifyq.thread, NULL, notifyq_threadproc, NULL) < 0) {
+        ast_log(LOG_ERROR, "Unable to create notification thread\n");
+        notifyq.running = 0;
+        return -1;
+    }
+
+    return 0;
+}
+
+void notifyq_fini()
+{
+    ast_mutex_lock(&notifyq.lock);
+    if (!notifyq.running) {
+        ast_mutex_unlock(&notifyq.lock);
+        return;
+    }
+    notifyq.running = 0;
+    ast_cond_signal(&notifyq.cond);
+    ast_mutex_unlock(&notifyq.lock);
+
+    pthread_join(notifyq.thread, NULL);
+
+    /* events queued while thread was stopping */
+    struct notifyq_event* ev;
+    while ((ev = AST_LIST_REMOVE_HEAD(&notifyq.events, entry))) {
+        notifyq_send(ev);
+        ast_free(ev);
+    }
+    notifyq.pending = 0;
+}
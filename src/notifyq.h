@@ -0,0 +1,22 @@
+/*
+   notifyq.h
+*/
+#ifndef CHAN_QUECTEL_NOTIFYQ_H_INCLUDED
+#define CHAN_QUECTEL_NOTIFYQ_H_INCLUDED
+
+/*
+    Delivery of SMS, USSD and reports by manager events
+
+    With notify=event received messages and reports are not passed to dialplan by Local channel,
+    they are queued and QuectelNotify manager event is sent by notification thread.
+    Queuing is just copy of strings, events are sent without locks of devices.
+    With notify_batch thread collects events arriving within window and sends them at once.
+*/
+
+int notifyq_init();
+void notifyq_fini();
+
+/* copy notification to queue, returns 0 on success, -1 if queue is full or on error */
+int notifyq_push(const char* device, const char* type, const char* number, const char* data);
+
+#endif /* CHAN_QUECTEL_NOTIFYQ_H_INCLUDED */
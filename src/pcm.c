@@ -11,6 +11,8 @@
 
 #include "pcm.h"
 
+#include "mutils.h" /* MIN() MAX() */
+
 static const snd_pcm_format_t pcm_format = SND_PCM_FORMAT_S16_LE;
 
 void _pcm_show_state(int attribute_unused lvl, const char* file, int line, const char* function, const char* const pcm_desc, const char* const pvt_id,
@@ -58,21 +60,6 @@ static attribute_const snd_pcm_uframes_t adjust_uframes(snd_pcm_uframes_t ptime,
     return res;
 }
 
-static attribute_const snd_pcm_uframes_t adjust_start_threshold(snd_pcm_uframes_t ptime)
-{
-    static const size_t PTIME_MIN_START_THRESHOLD = 100u;
-    static const size_t PTIME_MAX_START_THRESHOLD = 250u;
-
-    if (ptime < PTIME_MIN_START_THRESHOLD) {
-        return PTIME_MAX_START_THRESHOLD;
-    }
-    if (ptime > PTIME_MIN_START_THRESHOLD) {
-        return PTIME_MAX_START_THRESHOLD;
-    }
-
-    return ptime;
-}
-
 static unsigned int hw_params_get_rate(const snd_pcm_hw_params_t* const params)
 {
     static const unsigned int UNKNOWN_RATE = 0xffff;
@@ -86,7 +73,8 @@ static unsigned int hw_params_get_rate(const snd_pcm_hw_params_t* const params)
     }
 }
 
-int pcm_init(const char* dev, snd_pcm_stream_t stream, const struct ast_format* const fmt, snd_pcm_t** pcm, unsigned int* pcm_channels, int* fd)
+int pcm_init(const char* dev, snd_pcm_stream_t stream, const struct ast_format* const fmt, const struct pcm_tuning* tuning, snd_pcm_t** pcm,
+             unsigned int* pcm_channels, int* fd)
 {
     int res;
     snd_pcm_t* handle             = NULL;
@@ -97,11 +85,11 @@ int pcm_init(const char* dev, snd_pcm_stream_t stream, const struct ast_format*
 #if PTIME_USE_DEFAULT
     const size_t ptime = ast_format_get_default_ms(fmt);
 #else
-    const size_t ptime = (stream == SND_PCM_STREAM_CAPTURE) ? PTIME_CAPTURE : PTIME_PLAYBACK;
+    const size_t ptime = tuning->period_ms;
 #endif
     snd_pcm_uframes_t period_size     = adjust_uframes(ptime, rate);
-    snd_pcm_uframes_t buffer_size     = adjust_uframes(PTIME_BUFFER, rate);
-    snd_pcm_uframes_t start_threshold = adjust_uframes(adjust_start_threshold(ptime * 2), rate);
+    snd_pcm_uframes_t buffer_size     = adjust_uframes(MAX(tuning->buffer_ms, 2u * ptime), rate);
+    snd_pcm_uframes_t start_threshold = adjust_uframes(MIN(tuning->start_ms, tuning->buffer_ms), rate);
     snd_pcm_uframes_t stop_threshold  = buffer_size - period_size;
     snd_pcm_uframes_t boundary        = 0u;
     unsigned int hwrate               = rate;
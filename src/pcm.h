@@ -9,7 +9,14 @@
 
 #include <asterisk/format.h>
 
-int pcm_init(const char* dev, snd_pcm_stream_t stream, const struct ast_format* const fmt, snd_pcm_t** pcm, unsigned int* pcm_channels, int* fd);
+struct pcm_tuning {
+    unsigned int buffer_ms; /*!< ring buffer size */
+    unsigned int start_ms;  /*!< playback start threshold */
+    unsigned int period_ms; /*!< period size, duration of audio frame */
+};
+
+int pcm_init(const char* dev, snd_pcm_stream_t stream, const struct ast_format* const fmt, const struct pcm_tuning* tuning, snd_pcm_t** pcm,
+             unsigned int* pcm_channels, int* fd);
 int pcm_close(const char* dev, snd_pcm_t** ad, snd_pcm_stream_t stream_type);
 
 void _pcm_show_state(int attribute_unused lvl, const char* file, int line, const char* function, const char* const pcm_desc, const char* const pvt_id,
@@ -1,14 +1,21 @@
 /*
    Copyright (C) 2011 bg <bg_one@mail.ru>
 */
-#include <dirent.h>    /* DIR */
-#include <stdio.h>     /* NULL */
-#include <string.h>    /* strlen() */
-#include <sys/stat.h>  /* stat() */
-#include <sys/types.h> /* u_int16_t u_int8_t */
+#include <dirent.h>      /* DIR */
+#include <limits.h>      /* PATH_MAX */
+#include <stdio.h>       /* NULL rename() */
+#include <stdlib.h>      /* realpath() */
+#include <string.h>      /* strlen() */
+#include <sys/inotify.h> /* inotify_init1() inotify_add_watch() */
+#include <sys/stat.h>    /* stat() */
+#include <sys/types.h>   /* u_int16_t u_int8_t */
+#include <unistd.h>      /* read() close() */
 
 #include "ast_config.h"
 
+#include <asterisk/lock.h>
+#include <asterisk/threadpool.h>
+
 #include "pdiscovery.h" /* pdiscovery_lookup()  */
 
 #include "at_queue.h"     /* write_all() */
@@ -23,6 +30,12 @@
 static const char sys_bus_usb_drivers_usb[] = "/sys/bus/usb/drivers/usb";
 */
 static const char sys_bus_usb_devices[] = "/sys/bus/usb/devices";
+static const char dev_dir[]             = "/dev";
+static const char sys_class_tty[]       = "/sys/class/tty";
+static const char boot_id_file[]        = "/proc/sys/kernel/random/boot_id";
+
+/* first line of discovery cache file, followed by boot id */
+static const char store_header[] = "#quectel-discovery 1";
 
 
 /* timeout for port readering milliseconds */
@@ -51,6 +64,40 @@ struct discovery_cache {
     AST_RWLIST_HEAD(, pdiscovery_cache_item) items;
 };
 
+/* USB device of port, numbers of bus and device are changed when device is enumerated again */
+struct pdiscovery_usb {
+    char path[64]; /*!< name in /sys/bus/usb/devices */
+    unsigned int vendor_id;
+    unsigned int product_id;
+    unsigned int busnum;
+    unsigned int devnum;
+};
+
+/* probed device kept in discovery_cache file, does not expire */
+struct pdiscovery_stored {
+    AST_LIST_ENTRY(pdiscovery_stored) entry;
+    struct pdiscovery_usb usb;
+    struct pdiscovery_result res;
+};
+
+struct discovery_store {
+    ast_mutex_t lock;
+    AST_LIST_HEAD_NOLOCK(, pdiscovery_stored) items;
+    unsigned int dirty:1; /*!< changed since file was written */
+};
+
+/* ports probed in parallel by pdiscovery_prefetch() */
+struct pdiscovery_batch {
+    ast_mutex_t lock;
+    ast_cond_t cond;
+    unsigned int pending; /*!< number of probes not completed yet */
+};
+
+struct pdiscovery_probe {
+    struct pdiscovery_batch* batch;
+    struct pdiscovery_result res;
+};
+
 #define BUILD_NAME(d1, d2, d1len, d2len, out) \
     d2len = strlen(d2);                       \
     out   = alloca(d1len + 1 + d2len + 1);    \
@@ -73,6 +120,7 @@ static const struct pdiscovery_device device_ids[] = {
 };
 
 static struct discovery_cache cache;
+static struct discovery_store store;
 
 #/* return non-0 if all ports matched */
 
@@ -195,13 +243,12 @@ static struct pdiscovery_cache_item* cache_item_create(const struct pdiscovery_r
 
 #/* */
 
-static struct pdiscovery_cache_item* cache_search(struct discovery_cache* cache, const struct pdiscovery_result* res)
+static struct pdiscovery_cache_item* cache_search_nolock(struct discovery_cache* cache, const struct pdiscovery_result* res)
 {
     struct pdiscovery_cache_item* found = NULL;
     struct pdiscovery_cache_item* item;
     struct timeval now = ast_tvnow();
 
-    AST_RWLIST_WRLOCK(&cache->items);
     AST_LIST_TRAVERSE_SAFE_BEGIN(&cache->items, item, entry)
         if (ast_tvcmp(now, item->validtill) < 0) {
             if (ports_match(&item->res.ports, &res->ports)) {
@@ -214,7 +261,6 @@ static struct pdiscovery_cache_item* cache_search(struct discovery_cache* cache,
             cache_item_free(item);
         }
     AST_LIST_TRAVERSE_SAFE_END;
-    AST_RWLIST_UNLOCK(&cache->items);
 
     return found;
 }
@@ -223,8 +269,10 @@ static struct pdiscovery_cache_item* cache_search(struct discovery_cache* cache,
 
 static int cache_lookup(struct discovery_cache* cache, const struct pdiscovery_request* req, struct pdiscovery_result* res, int* failed)
 {
-    int found                          = 0;
-    struct pdiscovery_cache_item* item = cache_search(cache, res);
+    int found = 0;
+
+    AST_RWLIST_WRLOCK(&cache->items);
+    struct pdiscovery_cache_item* const item = cache_search_nolock(cache, res);
     if (item) {
         res->imei = item->res.imei ? ast_strdup(item->res.imei) : NULL;
         res->imsi = item->res.imsi ? ast_strdup(item->res.imsi) : NULL;
@@ -233,6 +281,7 @@ static int cache_lookup(struct discovery_cache* cache, const struct pdiscovery_r
             *failed = item->status;
         }
     }
+    AST_RWLIST_UNLOCK(&cache->items);
     return found;
 }
 
@@ -240,13 +289,40 @@ static int cache_lookup(struct discovery_cache* cache, const struct pdiscovery_r
 
 static void cache_update(struct discovery_cache* cache, const struct pdiscovery_result* res, int status)
 {
-    struct pdiscovery_cache_item* item = cache_search(cache, res);
+    AST_RWLIST_WRLOCK(&cache->items);
+    struct pdiscovery_cache_item* item = cache_search_nolock(cache, res);
     if (item) {
         cache_item_update(item, res, status);
     } else {
         item = cache_item_create(res, status);
-        AST_LIST_INSERT_TAIL(&cache->items, item, entry);
+        if (item) {
+            AST_LIST_INSERT_TAIL(&cache->items, item, entry);
+        }
     }
+    AST_RWLIST_UNLOCK(&cache->items);
+}
+
+#/* remove items which use port, return number of removed items */
+
+static int cache_invalidate(struct discovery_cache* cache, const char* port)
+{
+    struct pdiscovery_cache_item* item;
+    int removed = 0;
+
+    AST_RWLIST_WRLOCK(&cache->items);
+    AST_LIST_TRAVERSE_SAFE_BEGIN(&cache->items, item, entry)
+        for (unsigned i = 0; i < ARRAY_LEN(item->res.ports.ports); ++i) {
+            if (item->res.ports.ports[i] && !strcmp(item->res.ports.ports[i], port)) {
+                AST_LIST_REMOVE_CURRENT(entry);
+                cache_item_free(item);
+                removed++;
+                break;
+            }
+        }
+    AST_LIST_TRAVERSE_SAFE_END;
+    AST_RWLIST_UNLOCK(&cache->items);
+
+    return removed;
 }
 
 #/* */
@@ -288,7 +364,7 @@ static void cache_unlock(struct discovery_cache* cache) { AST_RWLIST_UNLOCK(&cac
 
 #/* */
 
-static int pdiscovery_get_id(const char* name, int len, const char* filename, unsigned* integer)
+static int pdiscovery_get_attr(const char* name, int len, const char* filename, const char* format, unsigned* integer)
 {
     int len2;
     char* name2;
@@ -297,13 +373,18 @@ static int pdiscovery_get_id(const char* name, int len, const char* filename, un
     BUILD_NAME(name, filename, len, len2, name2);
     FILE* file = fopen(name2, "r");
     if (file) {
-        assign = fscanf(file, "%x", integer);
+        assign = fscanf(file, format, integer);
         fclose(file);
     }
 
     return assign;
 }
 
+static int pdiscovery_get_id(const char* name, int len, const char* filename, unsigned* integer)
+{
+    return pdiscovery_get_attr(name, len, filename, "%x", integer);
+}
+
 #/* */
 
 static int pdiscovery_is_port(const char* name, int len)
@@ -443,6 +524,142 @@ static const struct pdiscovery_device* pdiscovery_lookup_ids(const char* devname
     return NULL;
 }
 
+#/* find USB device of port by sysfs, return zero on success */
+
+static int pdiscovery_port_usb(const char* port, struct pdiscovery_usb* usb)
+{
+    static const unsigned int USB_DEPTH_MAX = 4;
+
+    int len, len2;
+    char *name, *name2;
+    char path[PATH_MAX];
+
+    const char* const node = strrchr(port, '/');
+    BUILD_NAME(sys_class_tty, node ? node + 1 : port, STRLEN(sys_class_tty), len, name);
+    BUILD_NAME(name, "device", len, len2, name2);
+    if (!realpath(name2, path)) {
+        return -1;
+    }
+
+    /* ttyUSB is child of interface, ttyACM is interface itself */
+    for (unsigned int i = 0; i < USB_DEPTH_MAX; ++i) {
+        char* const slash = strrchr(path, '/');
+        if (!slash || slash == path) {
+            break;
+        }
+        *slash = '\000';
+
+        len = strlen(path);
+        if (pdiscovery_get_id(path, len, "idVendor", &usb->vendor_id) != 1) {
+            continue;
+        }
+
+        ast_copy_string(usb->path, strrchr(path, '/') + 1, sizeof(usb->path));
+        if (pdiscovery_get_id(path, len, "idProduct", &usb->product_id) != 1 || pdiscovery_get_attr(path, len, "busnum", "%u", &usb->busnum) != 1 ||
+            pdiscovery_get_attr(path, len, "devnum", "%u", &usb->devnum) != 1) {
+            return -1;
+        }
+        return 0;
+    }
+
+    return -1;
+}
+
+#/* */
+
+static int usb_match(const struct pdiscovery_usb* u1, const struct pdiscovery_usb* u2)
+{
+    return !strcmp(u1->path, u2->path) && u1->vendor_id == u2->vendor_id && u1->product_id == u2->product_id && u1->busnum == u2->busnum &&
+           u1->devnum == u2->devnum;
+}
+
+#/* */
+
+static void stored_free(struct pdiscovery_stored* item)
+{
+    result_free(&item->res);
+    ast_free(item);
+}
+
+#/* store lock must be held, return removed item */
+
+static struct pdiscovery_stored* store_remove_nolock(const char* port)
+{
+    struct pdiscovery_stored* item;
+    struct pdiscovery_stored* found = NULL;
+
+    AST_LIST_TRAVERSE_SAFE_BEGIN(&store.items, item, entry)
+        for (unsigned i = 0; i < ARRAY_LEN(item->res.ports.ports); ++i) {
+            if (item->res.ports.ports[i] && !strcmp(item->res.ports.ports[i], port)) {
+                AST_LIST_REMOVE_CURRENT(entry);
+                found = item;
+                break;
+            }
+        }
+        if (found) {
+            break;
+        }
+    AST_LIST_TRAVERSE_SAFE_END;
+
+    return found;
+}
+
+#/* keep successfully probed device, replaces previous result of its ports */
+
+static void store_put(const struct pdiscovery_result* res)
+{
+    if (!res->imei || !res->imsi || !res->ports.ports[INTERFACE_TYPE_DATA]) {
+        return;
+    }
+
+    struct pdiscovery_stored* const item = ast_calloc(1, sizeof(*item));
+    if (!item) {
+        return;
+    }
+
+    if (pdiscovery_port_usb(res->ports.ports[INTERFACE_TYPE_DATA], &item->usb) || !ports_copy(&item->res.ports, &res->ports)) {
+        stored_free(item);
+        return;
+    }
+    info_copy(&item->res, res);
+
+    SCOPED_MUTEX(store_lock, &store.lock);
+    struct pdiscovery_stored* const old = store_remove_nolock(res->ports.ports[INTERFACE_TYPE_DATA]);
+    if (old) {
+        stored_free(old);
+    }
+    AST_LIST_INSERT_TAIL(&store.items, item, entry);
+    store.dirty = 1;
+}
+
+#/* */
+
+static void store_remove(const char* port)
+{
+    SCOPED_MUTEX(store_lock, &store.lock);
+
+    struct pdiscovery_stored* const item = store_remove_nolock(port);
+    if (item) {
+        stored_free(item);
+        store.dirty = 1;
+    }
+}
+
+#/* */
+
+static int read_boot_id(char* boot_id, size_t size)
+{
+    FILE* const file = fopen(boot_id_file, "r");
+    if (!file) {
+        return -1;
+    }
+
+    const int res = fgets(boot_id, size, file) ? 0 : -1;
+    fclose(file);
+    ast_strip(boot_id);
+    return res;
+}
+
 #/* 0D 0A IMEI: <15 digits> 0D 0A */
 
 static char* pdiscovery_handle_ati(const char* str)
@@ -554,7 +771,10 @@ static int pdiscovery_do_cmd(const struct pdiscovery_request* req, int fd, const
     return 1;
 }
 
-#/* return non-zero on fail */
+/* port is opened by concurrent probe or device, failure is not cached */
+#define PDISCOVERY_BUSY 2
+
+#/* return non-zero on fail, PDISCOVERY_BUSY if port is locked */
 
 static int pdiscovery_get_info(const char* port, const struct pdiscovery_request* req, struct pdiscovery_result* res)
 {
@@ -583,6 +803,8 @@ static int pdiscovery_get_info(const char* port, const struct pdiscovery_request
         /* clean queue first ? */
         fail = pdiscovery_do_cmd(req, fd, port, cmds[cmd].cmd, cmds[cmd].length, res);
         tty_close(port, fd);
+    } else if (errno == EBUSY || errno == EWOULDBLOCK) {
+        fail = PDISCOVERY_BUSY;
     }
 
     return fail;
@@ -597,7 +819,14 @@ static int pdiscovery_get_info_cached(const char* port, const struct pdiscovery_
     int found = cache_lookup(&cache, req, res, &fail);
     if (!found) {
         fail = pdiscovery_get_info(port, req, res);
-        cache_update(&cache, res, fail);
+        if (fail == PDISCOVERY_BUSY) {
+            ast_debug(4, "[%s discovery] %s is busy, not cached\n", req->name, port);
+        } else {
+            cache_update(&cache, res, fail);
+        }
+        if (!fail) {
+            store_put(res);
+        }
     } else {
         ast_debug(4, "[%s discovery] %s use cached IMEI %s IMSI %s failed %d\n", req->name, port, S_OR(res->imei, ""), S_OR(res->imsi, ""), fail);
     }
@@ -630,30 +859,38 @@ static int pdiscovery_check_req(const struct pdiscovery_request* req, struct pdi
     return match;
 }
 
-#/* */
+#/* find ports of supported device, return non-zero if all mandatory ports found */
 
-static int pdiscovery_check_device(const char* name, int len, const char* subdir, const struct pdiscovery_request* req, struct pdiscovery_result* res)
+static int pdiscovery_device_ports(const char* devname, const char* name, int len, const char* subdir, struct pdiscovery_ports* ports)
 {
     int len2;
     char* name2;
-    const struct pdiscovery_device* device;
-    int found = 0;
 
     BUILD_NAME(name, subdir, len, len2, name2);
 
-    device = pdiscovery_lookup_ids(req->name, name2, len2);
-    if (device) {
-        //		ast_debug(4, "[%s discovery] should ports <-> interfaces map for %04x:%04x modem=%02x voice=%02x
-        // data=%02x\n",
-        ast_debug(4, "[%s discovery] should ports <-> interfaces map for %04x:%04x voice=%02x data=%02x\n", req->name, device->vendor_id, device->product_id,
-                  //			device->interfaces[INTERFACE_TYPE_COM],
-                  device->interfaces[INTERFACE_TYPE_VOICE], device->interfaces[INTERFACE_TYPE_DATA]);
-        pdiscovery_interfaces(req->name, name2, len2, device, &res->ports);
+    const struct pdiscovery_device* const device = pdiscovery_lookup_ids(devname, name2, len2);
+    if (!device) {
+        return 0;
+    }
 
-        /* check mandatory ports */
-        if (res->ports.ports[INTERFACE_TYPE_DATA] && res->ports.ports[INTERFACE_TYPE_VOICE]) {
-            found = pdiscovery_check_req(req, res);
-        }
+    //		ast_debug(4, "[%s discovery] should ports <-> interfaces map for %04x:%04x modem=%02x voice=%02x
+    // data=%02x\n",
+    ast_debug(4, "[%s discovery] should ports <-> interfaces map for %04x:%04x voice=%02x data=%02x\n", devname, device->vendor_id, device->product_id,
+              //			device->interfaces[INTERFACE_TYPE_COM],
+              device->interfaces[INTERFACE_TYPE_VOICE], device->interfaces[INTERFACE_TYPE_DATA]);
+    pdiscovery_interfaces(devname, name2, len2, device, ports);
+    return ports->ports[INTERFACE_TYPE_DATA] && ports->ports[INTERFACE_TYPE_VOICE];
+}
+
+#/* */
+
+static int pdiscovery_check_device(const char* name, int len, const char* subdir, const struct pdiscovery_request* req, struct pdiscovery_result* res)
+{
+    int found = 0;
+
+    /* check mandatory ports */
+    if (pdiscovery_device_ports(req->name, name, len, subdir, &res->ports)) {
+        found = pdiscovery_check_req(req, res);
     }
 
     if (!found) {
@@ -686,11 +923,202 @@ static int pdiscovery_request_do(const char* name, int len, const struct pdiscov
 
 #/* */
 
-void pdiscovery_init() { cache_init(&cache); }
+static const struct pdiscovery_request prefetch_req = {
+    "prefetch",
+    "ANY",
+    "ANY",
+};
+
+static int pdiscovery_probe_task(void* data)
+{
+    struct pdiscovery_probe* const probe = data;
+    struct pdiscovery_batch* const batch = probe->batch;
+
+    pdiscovery_read_info(&prefetch_req, &probe->res);
+    result_free(&probe->res);
+    ast_free(probe);
+
+    SCOPED_MUTEX(batch_lock, &batch->lock);
+    if (!--batch->pending) {
+        ast_cond_signal(&batch->cond);
+    }
+    return 0;
+}
+
+#/* */
+
+void pdiscovery_init()
+{
+    cache_init(&cache);
+
+    ast_mutex_init(&store.lock);
+    AST_LIST_HEAD_INIT_NOLOCK(&store.items);
+    store.dirty = 0;
+}
+
+#/* */
+
+void pdiscovery_fini()
+{
+    cache_fini(&cache);
+
+    struct pdiscovery_stored* item;
+    while ((item = AST_LIST_REMOVE_HEAD(&store.items, entry))) {
+        stored_free(item);
+    }
+    ast_mutex_destroy(&store.lock);
+}
+
+#/* line is USB path, vendor id, product id, bus number, device number, data port, audio port, IMEI, IMSI separated by tabs */
+
+static struct pdiscovery_stored* store_parse(char* line)
+{
+    enum { FIELD_USB = 0, FIELD_VID, FIELD_PID, FIELD_BUS, FIELD_DEV, FIELD_DPORT, FIELD_APORT, FIELD_IMEI, FIELD_IMSI, FIELD_NUMBERS };
+
+    char* fields[FIELD_NUMBERS];
+    for (unsigned int i = 0; i < FIELD_NUMBERS; ++i) {
+        fields[i] = strsep(&line, "\t");
+        if (ast_strlen_zero(fields[i])) {
+            return NULL;
+        }
+    }
+
+    struct pdiscovery_stored* const item = ast_calloc(1, sizeof(*item));
+    if (!item) {
+        return NULL;
+    }
+
+    ast_copy_string(item->usb.path, fields[FIELD_USB], sizeof(item->usb.path));
+    if (sscanf(fields[FIELD_VID], "%x", &item->usb.vendor_id) != 1 || sscanf(fields[FIELD_PID], "%x", &item->usb.product_id) != 1 ||
+        sscanf(fields[FIELD_BUS], "%u", &item->usb.busnum) != 1 || sscanf(fields[FIELD_DEV], "%u", &item->usb.devnum) != 1) {
+        ast_free(item);
+        return NULL;
+    }
+
+    item->res.ports.ports[INTERFACE_TYPE_DATA]  = ast_strdup(fields[FIELD_DPORT]);
+    item->res.ports.ports[INTERFACE_TYPE_VOICE] = ast_strdup(fields[FIELD_APORT]);
+    item->res.imei                              = ast_strdup(ast_strip(fields[FIELD_IMEI]));
+    item->res.imsi                              = ast_strdup(ast_strip(fields[FIELD_IMSI]));
+    return item;
+}
+
+#/* device must be enumerated in the same place since it was probed, both ports must belong to it */
+
+static int store_valid(const struct pdiscovery_stored* item)
+{
+    struct pdiscovery_usb dusb, ausb;
+
+    if (!item->res.ports.ports[INTERFACE_TYPE_DATA] || !item->res.ports.ports[INTERFACE_TYPE_VOICE] || !item->res.imei || !item->res.imsi) {
+        return 0;
+    }
+
+    return !pdiscovery_port_usb(item->res.ports.ports[INTERFACE_TYPE_DATA], &dusb) && usb_match(&dusb, &item->usb) &&
+           !pdiscovery_port_usb(item->res.ports.ports[INTERFACE_TYPE_VOICE], &ausb) && usb_match(&ausb, &item->usb);
+}
 
 #/* */
 
-void pdiscovery_fini() { cache_fini(&cache); }
+unsigned int pdiscovery_cache_load(const char* filename)
+{
+    char boot_id[64];
+    char saved_boot_id[64];
+    char line[PATH_MAX];
+    unsigned int entries = 0;
+    unsigned int loaded  = 0;
+
+    FILE* const file = fopen(filename, "r");
+    if (!file) {
+        if (errno != ENOENT) {
+            ast_log(LOG_WARNING, "[discovery] Unable to read cache %s: %s\n", filename, strerror(errno));
+        }
+        return 0;
+    }
+
+    /* numbers of USB devices are valid only within boot */
+    if (!fgets(line, sizeof(line), file) || strncmp(line, store_header, STRLEN(store_header)) || read_boot_id(boot_id, sizeof(boot_id))) {
+        fclose(file);
+        return 0;
+    }
+    ast_copy_string(saved_boot_id, ast_strip(line + STRLEN(store_header)), sizeof(saved_boot_id));
+    if (strcmp(saved_boot_id, boot_id)) {
+        ast_debug(3, "[discovery] Cache %s was saved before reboot, ignored\n", filename);
+        fclose(file);
+        return 0;
+    }
+
+    while (fgets(line, sizeof(line), file)) {
+        struct pdiscovery_stored* const item = store_parse(line);
+        if (!item) {
+            continue;
+        }
+        entries++;
+
+        if (!store_valid(item)) {
+            ast_debug(4, "[discovery] %s changed since cached IMEI %s IMSI %s\n", item->res.ports.ports[INTERFACE_TYPE_DATA], item->res.imei, item->res.imsi);
+            stored_free(item);
+            continue;
+        }
+
+        cache_update(&cache, &item->res, 0);
+
+        SCOPED_MUTEX(store_lock, &store.lock);
+        struct pdiscovery_stored* const old = store_remove_nolock(item->res.ports.ports[INTERFACE_TYPE_DATA]);
+        if (old) {
+            stored_free(old);
+        }
+        AST_LIST_INSERT_TAIL(&store.items, item, entry);
+        loaded++;
+    }
+    fclose(file);
+
+    ast_verb(3, "[discovery] %u of %u cached devices restored from %s\n", loaded, entries, filename);
+    return loaded;
+}
+
+#/* */
+
+int pdiscovery_cache_save(const char* filename)
+{
+    char boot_id[64];
+
+    SCOPED_MUTEX(store_lock, &store.lock);
+    if (!store.dirty) {
+        return 0;
+    }
+
+    if (read_boot_id(boot_id, sizeof(boot_id))) {
+        return -1;
+    }
+
+    const size_t len     = strlen(filename);
+    char* const tmp_file = alloca(len + sizeof(".tmp"));
+    memcpy(tmp_file, filename, len);
+    memcpy(tmp_file + len, ".tmp", sizeof(".tmp"));
+
+    FILE* const file = fopen(tmp_file, "w");
+    if (!file) {
+        ast_log(LOG_WARNING, "[discovery] Unable to write cache %s: %s\n", tmp_file, strerror(errno));
+        return -1;
+    }
+
+    fprintf(file, "%s %s\n", store_header, boot_id);
+
+    const struct pdiscovery_stored* item;
+    AST_LIST_TRAVERSE(&store.items, item, entry) {
+        fprintf(file, "%s\t%04x\t%04x\t%u\t%u\t%s\t%s\t%s\t%s\n", item->usb.path, item->usb.vendor_id, item->usb.product_id, item->usb.busnum,
+                item->usb.devnum, item->res.ports.ports[INTERFACE_TYPE_DATA], item->res.ports.ports[INTERFACE_TYPE_VOICE], item->res.imei, item->res.imsi);
+    }
+
+    /* previous file is valid until new one is written */
+    if (fclose(file) || rename(tmp_file, filename)) {
+        ast_log(LOG_WARNING, "[discovery] Unable to write cache %s: %s\n", filename, strerror(errno));
+        remove(tmp_file);
+        return -1;
+    }
+
+    store.dirty = 0;
+    return 0;
+}
 
 #/* */
 
@@ -746,3 +1174,151 @@ const struct pdiscovery_result* pdiscovery_list_next(const struct pdiscovery_cac
 #/* */
 
 void pdiscovery_list_end() { cache_unlock(&cache); }
+
+#/* */
+
+static size_t string_memory(const char* str) { return str ? strlen(str) + 1u : 0u; }
+
+size_t pdiscovery_cache_memory(unsigned int* items)
+{
+    size_t res = 0;
+    *items     = 0;
+
+    for (const struct pdiscovery_cache_item* item = cache_first_readlock(&cache); item; item = AST_RWLIST_NEXT(item, entry)) {
+        res += sizeof(*item) + string_memory(item->res.imei) + string_memory(item->res.imsi);
+        for (unsigned int i = 0; i < INTERFACE_TYPE_NUMBERS; ++i) {
+            res += string_memory(item->res.ports.ports[i]);
+        }
+        ++*items;
+    }
+    cache_unlock(&cache);
+
+    SCOPED_MUTEX(store_lock, &store.lock);
+    const struct pdiscovery_stored* stored;
+    AST_LIST_TRAVERSE(&store.items, stored, entry) {
+        res += sizeof(*stored) + string_memory(stored->res.imei) + string_memory(stored->res.imsi);
+        for (unsigned int i = 0; i < INTERFACE_TYPE_NUMBERS; ++i) {
+            res += string_memory(stored->res.ports.ports[i]);
+        }
+    }
+
+    return res;
+}
+
+#/* */
+
+unsigned int pdiscovery_prefetch(struct ast_threadpool* pool)
+{
+    struct pdiscovery_batch batch;
+    struct dirent* dentry;
+    unsigned int probes = 0;
+
+    DIR* const dir = opendir(sys_bus_usb_devices);
+    if (!dir) {
+        return 0;
+    }
+
+    ast_mutex_init(&batch.lock);
+    ast_cond_init(&batch.cond, NULL);
+    batch.pending = 0;
+
+    while ((dentry = readdir(dir)) != NULL) {
+        if (!strcmp(dentry->d_name, ".") || !strcmp(dentry->d_name, "..") || strstr(dentry->d_name, "usb") == dentry->d_name) {
+            continue;
+        }
+
+        struct pdiscovery_probe* const probe = ast_calloc(1, sizeof(*probe));
+        if (!probe) {
+            break;
+        }
+        probe->batch = &batch;
+
+        int fail = 1;
+        if (!pdiscovery_device_ports(prefetch_req.name, sys_bus_usb_devices, STRLEN(sys_bus_usb_devices), dentry->d_name, &probe->res.ports) ||
+            cache_lookup(&cache, &prefetch_req, &probe->res, &fail)) {
+            result_free(&probe->res);
+            ast_free(probe);
+            continue;
+        }
+        info_free(&probe->res);
+
+        ast_debug(4, "[%s discovery] probe %s\n", prefetch_req.name, probe->res.ports.ports[INTERFACE_TYPE_DATA]);
+        ast_mutex_lock(&batch.lock);
+        batch.pending++;
+        ast_mutex_unlock(&batch.lock);
+        probes++;
+
+        if (ast_threadpool_push(pool, pdiscovery_probe_task, probe)) {
+            pdiscovery_probe_task(probe);
+        }
+    }
+    closedir(dir);
+
+    ast_mutex_lock(&batch.lock);
+    while (batch.pending) {
+        ast_cond_wait(&batch.cond, &batch.lock);
+    }
+    ast_mutex_unlock(&batch.lock);
+
+    ast_cond_destroy(&batch.cond);
+    ast_mutex_destroy(&batch.lock);
+    return probes;
+}
+
+#/* */
+
+static int is_port_node(const char* name) { return !strncmp(name, "ttyUSB", STRLEN("ttyUSB")) || !strncmp(name, "ttyACM", STRLEN("ttyACM")); }
+
+int pdiscovery_events_open()
+{
+    const int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (fd < 0) {
+        ast_log(LOG_WARNING, "Unable to watch %s for devices: %s\n", dev_dir, strerror(errno));
+        return -1;
+    }
+
+    /* permissions are set by udev after node creation, so watch attributes too */
+    if (inotify_add_watch(fd, dev_dir, IN_CREATE | IN_DELETE | IN_ATTRIB) < 0) {
+        ast_log(LOG_WARNING, "Unable to watch %s for devices: %s\n", dev_dir, strerror(errno));
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+#/* */
+
+int pdiscovery_events_read(int fd)
+{
+    char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    int changed = 0;
+    ssize_t len;
+
+    while ((len = read(fd, buf, sizeof(buf))) > 0) {
+        for (const char* ptr = buf; ptr < buf + len;) {
+            const struct inotify_event* const event = (const struct inotify_event*)ptr;
+            ptr += sizeof(struct inotify_event) + event->len;
+
+            if (!event->len || !is_port_node(event->name)) {
+                continue;
+            }
+
+            changed++;
+            if (event->mask & IN_DELETE) {
+                int len2;
+                char* port;
+
+                BUILD_NAME(dev_dir, event->name, STRLEN(dev_dir), len2, port);
+                if (cache_invalidate(&cache, port)) {
+                    ast_debug(3, "[discovery] %s removed, cached IMEI/IMSI dropped\n", port);
+                }
+                store_remove(port);
+            } else {
+                ast_debug(4, "[discovery] %s %s\n", dev_dir, event->name);
+            }
+        }
+    }
+
+    return changed;
+}
@@ -4,6 +4,8 @@
 #ifndef CHAN_QUECTEL_PDISCOVERY_H_INCLUDED
 #define CHAN_QUECTEL_PDISCOVERY_H_INCLUDED
 
+#include <stddef.h> /* size_t */
+
 enum INTERFACE_TYPE {
     INTERFACE_TYPE_DATA = 0,
     INTERFACE_TYPE_VOICE,
@@ -22,6 +24,7 @@ struct pdiscovery_result {
 };
 
 struct pdiscovery_cache_item;
+struct ast_threadpool;
 
 void pdiscovery_init();
 void pdiscovery_fini();
@@ -31,4 +34,20 @@ const struct pdiscovery_result* pdiscovery_list_begin(const struct pdiscovery_ca
 const struct pdiscovery_result* pdiscovery_list_next(const struct pdiscovery_cache_item** opaque);
 void pdiscovery_list_end();
 
+/* number of heap bytes of cached results, number of cached items in *items */
+size_t pdiscovery_cache_memory(unsigned int* items);
+
+/* restore probed devices unchanged in sysfs since file was saved, return number of restored devices */
+unsigned int pdiscovery_cache_load(const char* filename);
+/* write probed devices if anything changed since last save, return zero on success */
+int pdiscovery_cache_save(const char* filename);
+
+/* probe IMEI/IMSI of all ports missing in cache in parallel on pool, return number of probed devices */
+unsigned int pdiscovery_prefetch(struct ast_threadpool* pool);
+
+/* watch /dev for modem ports, return inotify descriptor or -1 */
+int pdiscovery_events_open();
+/* drain port events and forget cached info of removed ports, return number of port events */
+int pdiscovery_events_read(int fd);
+
 #endif /* CHAN_QUECTEL_PDISCOVERY_H_INCLUDED */
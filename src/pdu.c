@@ -396,6 +396,43 @@ static int pdu_store_number(uint8_t* buffer, int toa, const char* number, unsign
     return i;
 }
 
+/*!
+ * \brief Store TP-Destination-Address: length, type-of-address and number
+ * \param buffer -- CALLER MUST be provide PDU_ADDRESS_LENGTH bytes of buffer
+ * \param dst -- phone number
+ * \return number of bytes written to buffer or -1 and set chan_quectel_err
+ */
+static int pdu_store_address(uint8_t* buffer, const char* dst)
+{
+    int dst_toa;
+
+    if (dst[0] == '+') {
+        dst_toa = NUMBER_TYPE_INTERNATIONAL;
+        ++dst;
+    } else {
+        if (strlen(dst) < 6) {
+            dst_toa = NUMBER_TYPE_NETWORKSHORT;
+        } else {
+            dst_toa = NUMBER_TYPE_UNKNOWN;
+        }
+    }
+
+    const unsigned dst_len = strlen(dst);
+    if (dst_len > PDU_ADDRESS_DIGITS) {
+        chan_quectel_err = E_BUILD_PHONE_NUMBER;
+        return -1;
+    }
+
+    buffer[0]     = dst_len;
+    const int res = pdu_store_number(buffer + 1, dst_toa, dst, dst_len);
+    if (res < 0) {
+        chan_quectel_err = E_BUILD_PHONE_NUMBER;
+        return -1;
+    }
+
+    return res + 1;
+}
+
 #/* reverse of pdu_store_number() */
 
 static int pdu_parse_number(uint8_t* pdu, size_t pdu_length, unsigned digits, char* number, size_t num_len)
@@ -413,13 +450,11 @@ static int pdu_parse_number(uint8_t* pdu, size_t pdu_length, unsigned digits, ch
     }
 
     if ((toa & TP_A_TON) == TP_A_TON_ALPHANUMERIC) {
-        uint16_t number16tmp[num_len];
-        int res = gsm7_unpack_decode((const char*)(pdu + i), syms, number16tmp, num_len, 0, 0, 0);
+        const int res = gsm7_unpack_decode_utf8((const char*)(pdu + i), syms, number, num_len, 0, 0, 0);
         if (res < 0) {
             return -EINVAL;
         }
 
-        res     = ucs2_to_utf8(number16tmp, res, number, num_len);
         i      += syms / 2;
         number += res;
     } else {
@@ -444,6 +479,18 @@ static int pdu_parse_number(uint8_t* pdu, size_t pdu_length, unsigned digits, ch
 
 #/* */
 
+static int pdu_bcd_valid(uint8_t c)
+{
+    return (c & 15) < 10 && (c >> 4) < 10;
+}
+
+static char* pdu_put_2digits(char* out, int v)
+{
+    out[0] = '0' + v / 10;
+    out[1] = '0' + v % 10;
+    return out + 2;
+}
+
 static int pdu_parse_timestamp(uint8_t* pdu, size_t length, char* out)
 {
     if (length >= 7) {
@@ -456,7 +503,31 @@ static int pdu_parse_timestamp(uint8_t* pdu, size_t length, char* out)
         const int o  = (pdu[6] >> 4) + 10 * (pdu[6] & 7);
         const int os = pdu[6] & 0x8;
 
-        sprintf(out, "%04d-%02d-%02d %02d:%02d:%02d %c%02d:%02d", y, m, d, h, i, s, os ? '-' : '+', o / 4, (o % 4) * 15);
+        if (!pdu_bcd_valid(pdu[0]) || !pdu_bcd_valid(pdu[1]) || !pdu_bcd_valid(pdu[2]) || !pdu_bcd_valid(pdu[3]) || !pdu_bcd_valid(pdu[4]) ||
+            !pdu_bcd_valid(pdu[5])) {
+            sprintf(out, "%04d-%02d-%02d %02d:%02d:%02d %c%02d:%02d", y, m, d, h, i, s, os ? '-' : '+', o / 4, (o % 4) * 15);
+            return 7;
+        }
+
+        /* same as "%04d-%02d-%02d %02d:%02d:%02d %c%02d:%02d" without format engine, called for every message of listing */
+        out    = pdu_put_2digits(out, y / 100);
+        out    = pdu_put_2digits(out, y % 100);
+        *out++ = '-';
+        out    = pdu_put_2digits(out, m);
+        *out++ = '-';
+        out    = pdu_put_2digits(out, d);
+        *out++ = ' ';
+        out    = pdu_put_2digits(out, h);
+        *out++ = ':';
+        out    = pdu_put_2digits(out, i);
+        *out++ = ':';
+        out    = pdu_put_2digits(out, s);
+        *out++ = ' ';
+        *out++ = os ? '-' : '+';
+        out    = pdu_put_2digits(out, o / 4);
+        *out++ = ':';
+        out    = pdu_put_2digits(out, (o % 4) * 15);
+        *out   = '\0';
 
         return 7;
     }
@@ -549,13 +620,59 @@ int pdu_build_mult(pdu_part_t* pdus, const char* sca, const char* dst, const uin
     return i;
 }
 
+void pdu_template_init(pdu_template_part_t* part, const pdu_part_t* pdu, unsigned parts)
+{
+    const size_t sca_len = pdu->buffer[0] + 1u;
+
+    hexify(pdu->buffer, pdu->length, part->hex);
+    part->length      = pdu->length;
+    part->tpdu_length = pdu->tpdu_length;
+    part->da_offset   = sca_len + 2u; /* PDU-type, TP-MR */
+    part->da_length   = 2u + DIV2UP(pdu->buffer[part->da_offset]);
+    /* TP-PID, TP-DCS, TP-VP, TP-UDL, UDHL, IEI, IEDL */
+    part->ref_offset = parts > 1 ? (ssize_t)(part->da_offset + part->da_length + 7u) : -1;
+}
+
+ssize_t pdu_template_fill(const pdu_template_part_t* part, const char* dst, uint8_t csmsref, char* hex, size_t* tpdulen)
+{
+    uint8_t address[PDU_ADDRESS_LENGTH];
+
+    const int address_len = pdu_store_address(address, dst);
+    if (address_len < 0) {
+        return -1;
+    }
+
+    const size_t length = part->length - part->da_length + address_len;
+    *tpdulen            = part->tpdu_length - part->da_length + address_len;
+    if (*tpdulen > TPDU_LENGTH || length > PDU_LENGTH) {
+        chan_quectel_err = E_2BIG;
+        return -1;
+    }
+
+    const size_t head = part->da_offset * 2u;
+    const size_t tail = (part->da_offset + part->da_length) * 2u;
+
+    memcpy(hex, part->hex, head);
+    hexify(address, address_len, hex + head);
+    memcpy(hex + head + address_len * 2u, part->hex + tail, part->length * 2u - tail + 1u);
+
+    if (part->ref_offset >= 0) {
+        static const char digits[] = "0123456789ABCDEF";
+
+        char* const ref = hex + (part->ref_offset - part->da_length + address_len) * 2u;
+        ref[0]          = digits[csmsref >> 4];
+        ref[1]          = digits[csmsref & 0x0f];
+    }
+
+    return (ssize_t)(length * 2u);
+}
+
 ssize_t pdu_build(uint8_t* buffer, size_t length, size_t* tpdulen, const char* sca, const char* dst, int dcs, const uint16_t* msg, unsigned msg_reallen,
                   unsigned msg_len, unsigned valid_minutes, int srr, const pdu_udh_t* udh)
 {
     int len = 0;
 
     int sca_toa = NUMBER_TYPE_INTERNATIONAL;
-    int dst_toa;
     int pdutype =
         PDUTYPE_MTI_SMS_SUBMIT | PDUTYPE_RD_ACCEPT | PDUTYPE_VPF_RELATIVE | PDUTYPE_SRR_NOT_REQUESTED | PDUTYPE_UDHI_NO_HEADER | PDUTYPE_RP_IS_NOT_SET;
     int use_udh = udh->parts > 1;
@@ -564,27 +681,14 @@ ssize_t pdu_build(uint8_t* buffer, size_t length, size_t* tpdulen, const char* s
         pdutype |= PDUTYPE_UDHI_HAS_HEADER;
     }
 
-    unsigned dst_len;
     unsigned sca_len;
 
     if (sca[0] == '+') {
         ++sca;
     }
 
-    if (dst[0] == '+') {
-        dst_toa = NUMBER_TYPE_INTERNATIONAL;
-        ++dst;
-    } else {
-        if (strlen(dst) < 6) {
-            dst_toa = NUMBER_TYPE_NETWORKSHORT;
-        } else {
-            dst_toa = NUMBER_TYPE_UNKNOWN;
-        }
-    }
-
     /* count length of strings */
     sca_len = strlen(sca);
-    dst_len = strlen(dst);
 
     /* SCA Length */
     /* Type-of-address of the SMSC */
@@ -612,12 +716,10 @@ ssize_t pdu_build(uint8_t* buffer, size_t length, size_t* tpdulen, const char* s
     /* Type-of-address of the sender number */
     buffer[len++] = pdutype;
     buffer[len++] = PDU_MESSAGE_REFERENCE;
-    buffer[len++] = dst_len;
 
     /*  Destination address */
-    res = pdu_store_number(buffer + len, dst_toa, dst, dst_len);
+    res = pdu_store_address(buffer + len, dst);
     if (res < 0) {
-        chan_quectel_err = E_BUILD_PHONE_NUMBER;
         return -1;
     }
     len += res;
@@ -723,7 +825,7 @@ int tpdu_parse_status_report(uint8_t* pdu, size_t pdu_length, int* mr, char* ra,
     return 0;
 }
 
-int tpdu_parse_deliver(uint8_t* pdu, size_t pdu_length, int tpdu_type, char* oa, size_t oa_len, char* scts, uint16_t* msg, pdu_udh_t* udh)
+int tpdu_parse_deliver(uint8_t* pdu, size_t pdu_length, int tpdu_type, char* oa, size_t oa_len, char* scts, char* msg, size_t msg_len, pdu_udh_t* udh)
 {
     int i = 0, field_len, oa_digits, pid, dcs, alphabet, udl, udhl, msg_padding = 0;
 
@@ -932,20 +1034,22 @@ int tpdu_parse_deliver(uint8_t* pdu, size_t pdu_length, int tpdu_type, char* oa,
         i += udhl;
     }
 
-    int msg_len = pdu_length - i, out_len;
+    /* user data is decoded straight into UTF-8 */
+    int out_len;
     if (alphabet == PDU_DCS_ALPHABET_7BIT) {
-        out_len = gsm7_unpack_decode((const char*)(pdu + i), udl_nibbles, msg, 1024 /* assume enough memory, as SMS messages are limited in size */,
-                                     msg_padding, udh->ls, udh->ss);
+        out_len = gsm7_unpack_decode_utf8((const char*)(pdu + i), udl_nibbles, msg, msg_len, msg_padding, udh->ls, udh->ss);
         if (out_len < 0) {
             chan_quectel_err = E_DECODE_GSM7;
             return -1;
         }
     } else {
-        out_len = msg_len / 2;
-        memcpy((char*)msg, pdu + i, msg_len);
+        out_len = ucs2_bytes_to_utf8(pdu + i, (pdu_length - i) & ~(size_t)1, msg, msg_len);
+        if (out_len < 0) {
+            chan_quectel_err = E_PARSE_UCS2;
+            return -1;
+        }
         msg[out_len] = '\0';
     }
-    msg[out_len] = '\0';
 
     return out_len;
 }
@@ -23,6 +23,8 @@
 
 #define TPDU_LENGTH 176
 #define PDU_LENGTH 256
+#define PDU_ADDRESS_DIGITS 20
+#define PDU_ADDRESS_LENGTH (2 + PDU_ADDRESS_DIGITS / 2)
 
 typedef struct pdu_udh {
     uint8_t ref;
@@ -35,13 +37,27 @@ typedef struct pdu_part {
     size_t tpdu_length, length;
 } pdu_part_t;
 
+/* SMS-SUBMIT part encoded once for many destinations */
+typedef struct pdu_template_part {
+    char hex[PDU_LENGTH * 2 + 1]; /*!< hex of PDU built for placeholder destination */
+    size_t length;                /*!< length of PDU in octets */
+    size_t tpdu_length;           /*!< length of TPDU in octets */
+    size_t da_offset;             /*!< offset of TP-Destination-Address in octets */
+    size_t da_length;             /*!< length of placeholder TP-Destination-Address in octets */
+    ssize_t ref_offset;           /*!< offset of CSMS reference in octets, -1 for single part message */
+} pdu_template_part_t;
+
 void pdu_udh_init(pdu_udh_t* udh);
 int pdu_build_mult(pdu_part_t* pdus, const char* sca, const char* dst, const uint16_t* msg, size_t msg_len, unsigned valid_minutes, int srr, uint8_t csmsref);
 ssize_t pdu_build(uint8_t* buffer, size_t length, size_t* tpdulen, const char* sca, const char* dst, int dcs, const uint16_t* msg, unsigned msg_len,
                   unsigned msg_bytes, unsigned valid_minutes, int srr, const pdu_udh_t* udh);
+void pdu_template_init(pdu_template_part_t* part, const pdu_part_t* pdu, unsigned parts);
+/* write hex of part for destination and CSMS reference, hex must have PDU_LENGTH * 2 + 1 bytes, returns number of hex digits */
+ssize_t pdu_template_fill(const pdu_template_part_t* part, const char* dst, uint8_t csmsref, char* hex, size_t* tpdulen);
 int pdu_parse_sca(uint8_t* pdu, size_t pdu_length, char* sca, size_t sca_len);
 int tpdu_parse_type(uint8_t* pdu, size_t pdu_length, int* type);
 int tpdu_parse_status_report(uint8_t* pdu, size_t pdu_length, int* mr, char* ra, size_t ra_len, char* scts, char* dt, int* st);
-int tpdu_parse_deliver(uint8_t* pdu, size_t pdu_length, int tpdu_type, char* oa, size_t oa_len, char* scts, uint16_t* msg, pdu_udh_t* udh);
+/* decode SMS-DELIVER, message is written as UTF-8 into msg of msg_len bytes, returns length of message */
+int tpdu_parse_deliver(uint8_t* pdu, size_t pdu_length, int tpdu_type, char* oa, size_t oa_len, char* scts, char* msg, size_t msg_len, pdu_udh_t* udh);
 
 #endif /* CHAN_QUECTEL_PDU_H_INCLUDED */
@@ -0,0 +1,126 @@
+/*
+   pdu_cache.c
+*/
+#include "ast_config.h"
+
+#include <asterisk/astobj2.h>
+#include <asterisk/lock.h>
+#include <asterisk/strings.h> /* ast_str_hash() */
+#include <asterisk/utils.h>
+
+#include "pdu_cache.h"
+
+#include "char_conv.h" /* utf8_to_ucs2() */
+#include "error.h"
+
+#define PDU_CACHE_SIZE 8
+#define PDU_MAX_PARTS 255
+
+/* most recently used first */
+static struct pdu_template* cache[PDU_CACHE_SIZE];
+
+AST_MUTEX_DEFINE_STATIC(cache_lock);
+
+#/* */
+
+static struct pdu_template* pdu_template_create(const char* msg, unsigned int hash, unsigned int validity, int srr)
+{
+    const size_t msg_len          = strlen(msg);
+    const size_t msg_ucs2_buf_len = sizeof(uint16_t) * msg_len * 2;
+    RAII_VAR(uint16_t*, msg_ucs2, ast_calloc(sizeof(uint16_t), msg_len * 2), ast_free);
+    if (!msg_ucs2) {
+        chan_quectel_err = E_MALLOC;
+        return NULL;
+    }
+
+    const ssize_t msg_ucs2_len = utf8_to_ucs2(msg, msg_len, msg_ucs2, msg_ucs2_buf_len);
+    if (msg_ucs2_len <= 0) {
+        chan_quectel_err = E_PARSE_UTF8;
+        return NULL;
+    }
+
+    RAII_VAR(pdu_part_t*, pdus, ast_calloc(sizeof(pdu_part_t), PDU_MAX_PARTS), ast_free);
+    if (!pdus) {
+        chan_quectel_err = E_MALLOC;
+        return NULL;
+    }
+
+    /* destination and reference are replaced by pdu_template_fill() */
+    const int count = pdu_build_mult(pdus, "", "0", msg_ucs2, msg_ucs2_len, validity, srr, 0);
+    if (count <= 0) {
+        return NULL;
+    }
+
+    struct pdu_template* const tmpl =
+        ao2_alloc_options(sizeof(*tmpl) + count * sizeof(tmpl->parts[0]) + msg_len + 1u, NULL, AO2_ALLOC_OPT_LOCK_NOLOCK);
+    if (!tmpl) {
+        chan_quectel_err = E_MALLOC;
+        return NULL;
+    }
+
+    for (int i = 0; i < count; ++i) {
+        pdu_template_init(&tmpl->parts[i], &pdus[i], count);
+    }
+
+    char* const msg_buf = (char*)&tmpl->parts[count];
+    memcpy(msg_buf, msg, msg_len + 1u);
+
+    tmpl->hash     = hash;
+    tmpl->validity = validity;
+    tmpl->srr      = srr;
+    tmpl->msg      = msg_buf;
+    tmpl->count    = count;
+    return tmpl;
+}
+
+static int pdu_template_match(const struct pdu_template* tmpl, const char* msg, unsigned int hash, unsigned int validity, int srr)
+{
+    return tmpl && tmpl->hash == hash && tmpl->validity == validity && tmpl->srr == srr && !strcmp(tmpl->msg, msg);
+}
+
+/* cache locked, move entry to front */
+static void pdu_cache_touch(unsigned int idx, struct pdu_template* tmpl)
+{
+    memmove(&cache[1], &cache[0], idx * sizeof(cache[0]));
+    cache[0] = tmpl;
+}
+
+struct pdu_template* pdu_cache_get(const char* msg, unsigned int validity, int srr)
+{
+    const unsigned int hash = (unsigned int)ast_str_hash(msg);
+
+    ast_mutex_lock(&cache_lock);
+    for (unsigned int i = 0; i < PDU_CACHE_SIZE; ++i) {
+        struct pdu_template* const tmpl = cache[i];
+        if (pdu_template_match(tmpl, msg, hash, validity, srr)) {
+            pdu_cache_touch(i, tmpl);
+            ao2_ref(tmpl, 1);
+            ast_mutex_unlock(&cache_lock);
+            return tmpl;
+        }
+    }
+    ast_mutex_unlock(&cache_lock);
+
+    /* encode without lock, concurrent misses of same body are rare and harmless */
+    struct pdu_template* const tmpl = pdu_template_create(msg, hash, validity, srr);
+    if (!tmpl) {
+        return NULL;
+    }
+
+    ast_mutex_lock(&cache_lock);
+    ao2_cleanup(cache[PDU_CACHE_SIZE - 1]);
+    pdu_cache_touch(PDU_CACHE_SIZE - 1, ao2_bump(tmpl));
+    ast_mutex_unlock(&cache_lock);
+
+    return tmpl;
+}
+
+void pdu_cache_fini()
+{
+    SCOPED_MUTEX(lock, &cache_lock);
+
+    for (unsigned int i = 0; i < PDU_CACHE_SIZE; ++i) {
+        ao2_cleanup(cache[i]);
+        cache[i] = NULL;
+    }
+}
@@ -0,0 +1,30 @@
+/*
+   pdu_cache.h
+*/
+#ifndef CHAN_QUECTEL_PDU_CACHE_H_INCLUDED
+#define CHAN_QUECTEL_PDU_CACHE_H_INCLUDED
+
+#include "pdu.h" /* pdu_template_part_t */
+
+/*
+    Cache of encoded SMS bodies
+
+    Message sent to many destinations is converted to UCS-2, split, encoded and hexified once,
+    only destination address and CSMS reference are patched per destination by pdu_template_fill().
+    Key is body, validity and status report request, data coding scheme follows from body.
+*/
+
+struct pdu_template {
+    unsigned int hash;
+    unsigned int validity;
+    int srr;
+    const char* msg;    /*!< points into template allocation */
+    unsigned int count; /*!< number of parts */
+    pdu_template_part_t parts[0];
+};
+
+/* returns referenced template, must be released by ao2_cleanup(), or NULL and set chan_quectel_err */
+struct pdu_template* pdu_cache_get(const char* msg, unsigned int validity, int srr);
+void pdu_cache_fini();
+
+#endif /* CHAN_QUECTEL_PDU_CACHE_H_INCLUDED */
@@ -0,0 +1,125 @@
+/*
+   playout.c
+*/
+#include <endian.h> /* le16toh() htole16() */
+#include <stdint.h>
+#include <stdlib.h> /* llabs() */
+#include <string.h> /* memset() */
+
+#include "ast_config.h"
+
+#include <asterisk/time.h>
+#include <asterisk/utils.h> /* MIN() MAX() */
+
+#include "playout.h"
+
+#define PLAYOUT_STABLE 5000000u  /*!< us without underrun before depth needed by underruns is reduced */
+#define PLAYOUT_SURPLUS 1000000u /*!< us above target depth before frame is dropped */
+
+void playout_init(struct playout* po, unsigned int ptime_ms, unsigned int min, unsigned int max)
+{
+    memset(po, 0, sizeof(*po));
+
+    po->ptime  = ptime_ms * 1000u;
+    po->min    = min;
+    po->max    = MAX(min, max);
+    po->target = min;
+    po->level  = min;
+}
+
+/* called with pvt lock held, the only producer of write_ring */
+void playout_arrival(struct playout* po, const struct timeval* now, unsigned int frames)
+{
+    if (!ast_tvzero(po->arrival)) {
+        const int64_t interval = ast_tvdiff_us(*now, po->arrival);
+
+        /* pause longer than second is start of new stream, not jitter */
+        if (interval >= 0 && interval < 1000000) {
+            const int64_t d     = llabs(interval - (int64_t)frames * po->ptime);
+            const int64_t j     = __atomic_load_n(&po->jitter, __ATOMIC_RELAXED);
+            const int64_t value = j + (MIN(d, 1000000) - j) / 16;
+            __atomic_store_n(&po->jitter, (unsigned int)value, __ATOMIC_RELAXED);
+        }
+    }
+
+    po->arrival = *now;
+}
+
+static unsigned int playout_want(const struct playout* po)
+{
+    const unsigned int jitter = __atomic_load_n(&po->jitter, __ATOMIC_RELAXED);
+
+    /* twice smoothed jitter covers most of late arrivals */
+    const unsigned int want = MAX((2u * jitter + po->ptime - 1u) / po->ptime, po->level);
+    return MIN(MAX(want, po->min), po->max);
+}
+
+static enum playout_action playout_empty(struct playout* po)
+{
+    if (po->played && po->concealed < PLAYOUT_CONCEAL_MAX) {
+        po->concealed++;
+        return PLAYOUT_CONCEAL;
+    }
+
+    po->played = 0;
+    return PLAYOUT_SILENCE;
+}
+
+/* called on audio timer tick, the only consumer of write_ring */
+enum playout_action playout_tick(struct playout* po, unsigned int frames, int streams)
+{
+    po->target = playout_want(po);
+
+    if (!frames) {
+        if (po->playing && streams > 0) {
+            po->level  = MIN(po->level + 1u, po->max);
+            po->target = playout_want(po);
+            po->stable = 0;
+        }
+        po->playing = 0;
+        po->surplus = 0;
+        return playout_empty(po);
+    }
+
+    if (!po->playing) {
+        if (frames < po->target) {
+            return playout_empty(po);
+        }
+        po->playing = 1;
+    }
+
+    po->concealed = 0;
+    po->played    = 1;
+
+    if (++po->stable * po->ptime >= PLAYOUT_STABLE) {
+        po->stable = 0;
+        if (po->level > po->min) {
+            po->level--;
+        }
+    }
+
+    if (frames <= po->target) {
+        po->surplus = 0;
+        return PLAYOUT_PLAY;
+    }
+
+    if (++po->surplus * po->ptime < PLAYOUT_SURPLUS) {
+        return PLAYOUT_PLAY;
+    }
+
+    po->surplus = 0;
+    return PLAYOUT_DROP;
+}
+
+void playout_conceal(void* dst, const void* last, size_t len, unsigned int n)
+{
+    /* linear fade out to silence after PLAYOUT_CONCEAL_MAX frames */
+    const int gain    = (int)(PLAYOUT_CONCEAL_MAX + 1u - MIN(n, PLAYOUT_CONCEAL_MAX + 1u));
+    const uint16_t* s = last;
+    uint16_t* d       = dst;
+
+    for (size_t i = 0; i < len / sizeof(*s); ++i) {
+        const int sample = (int16_t)le16toh(s[i]);
+        d[i]             = htole16((uint16_t)(int16_t)(sample * gain / (int)(PLAYOUT_CONCEAL_MAX + 1u)));
+    }
+}
@@ -0,0 +1,55 @@
+/*
+   playout.h
+*/
+#ifndef CHAN_QUECTEL_PLAYOUT_H_INCLUDED
+#define CHAN_QUECTEL_PLAYOUT_H_INCLUDED
+
+#include <stddef.h>
+#include <sys/time.h>
+
+/*
+    Adaptive playout of mixed frames on audio TTY
+
+    Producer records arrivals of mixed frames and smooths their deviation
+    from frame period (RFC 3550 interarrival jitter).
+    Consumer is called on every audio timer tick, holds frames back until
+    target depth is buffered, conceals empty ticks by repeating last frame
+    with decreasing gain and drops a frame when depth stays above target.
+    Target depth follows jitter and underruns within configured bounds.
+*/
+
+#define PLAYOUT_CONCEAL_MAX 3u /*!< number of frames concealed before silence */
+
+enum playout_action {
+    PLAYOUT_PLAY = 0, /*!< play next frame */
+    PLAYOUT_DROP,     /*!< drop one frame to shrink depth, then play next one */
+    PLAYOUT_CONCEAL,  /*!< repeat last played frame */
+    PLAYOUT_SILENCE,  /*!< nothing to play or conceal */
+};
+
+struct playout {
+    /* producer, pvt lock held */
+    struct timeval arrival; /*!< last time frames were passed to writer */
+    unsigned int jitter;    /*!< smoothed deviation of arrivals from frame period in us */
+
+    /* consumer, audio timer */
+    unsigned int ptime;     /*!< frame period in us */
+    unsigned int min;       /*!< lower bound of target depth in frames */
+    unsigned int max;       /*!< upper bound of target depth in frames */
+    unsigned int target;    /*!< current target depth in frames */
+    unsigned int level;     /*!< depth needed by underruns in frames */
+    unsigned int stable;    /*!< ticks without underrun */
+    unsigned int surplus;   /*!< consecutive ticks with more frames than target buffered */
+    unsigned int concealed; /*!< consecutive concealed frames */
+    unsigned int played:1;  /*!< last played frame is available for concealment */
+    unsigned int playing:1; /*!< target depth was reached */
+};
+
+void playout_init(struct playout* po, unsigned int ptime_ms, unsigned int min, unsigned int max);
+void playout_arrival(struct playout* po, const struct timeval* now, unsigned int frames);
+enum playout_action playout_tick(struct playout* po, unsigned int frames, int streams);
+
+/* copy of little endian frame with gain of n-th concealed frame */
+void playout_conceal(void* dst, const void* last, size_t len, unsigned int n);
+
+#endif /* CHAN_QUECTEL_PLAYOUT_H_INCLUDED */
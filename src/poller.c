@@ -0,0 +1,157 @@
+/*
+   poller.c
+*/
+#include "ast_config.h"
+
+#include <asterisk/lock.h>
+#include <asterisk/utils.h>
+
+#include "poller.h"
+
+#include "at_command.h"   /* at_enqueue_poll() */
+#include "chan_quectel.h" /* gpublic CONF_GLOBAL() */
+#include "mutils.h"       /* MAX() */
+
+static const unsigned int POLLER_IDLE_MS = 1000; /* wait for devices or enabling by reload */
+static const unsigned int POLLER_STEP_MS = 10;   /* minimal interval between visits of two devices */
+
+static struct {
+    ast_mutex_t lock;
+    ast_cond_t cond;        /*!< signaled on shutdown */
+    pthread_t thread;       /*!< scheduler thread */
+    unsigned int cursor;    /*!< position of next device in devices list */
+    unsigned int running:1; /*!< scheduler thread is running */
+} poller;
+
+#/* */
+
+static int poller_fresh(struct timeval updated, struct timeval now, unsigned int interval_ms)
+{
+    return !ast_tvzero(updated) && ast_tvdiff_ms(now, updated) < (int64_t)interval_ms;
+}
+
+/* devices list read locked, pvt locked */
+static void poller_poll(struct pvt* pvt, struct timeval now, unsigned int interval_ms)
+{
+    if (!pvt->connected || !pvt->initialized) {
+        return;
+    }
+
+    unsigned int what = 0;
+
+    if (!poller_fresh(pvt->rssi_updated, now, interval_ms)) {
+        what |= AT_POLL_SIGNAL;
+    }
+    if (!poller_fresh(pvt->provider_updated, now, interval_ms)) {
+        what |= AT_POLL_PROVIDER;
+    }
+    if (CONF_SHARED(pvt, query_time)) {
+        what |= AT_POLL_TIME;
+    }
+
+    pvt->polled = now;
+
+    if (!what) {
+        PVT_STAT_INC(pvt, polls_skipped);
+        return;
+    }
+
+    if (at_enqueue_poll(&pvt->sys_chan, what)) {
+        ast_log(LOG_WARNING, "[%s] Unable to enqueue periodic poll\n", PVT_ID(pvt));
+        return;
+    }
+
+    PVT_STAT_INC(pvt, polls);
+}
+
+/* poller locked, returns milliseconds to wait */
+static unsigned int poller_step()
+{
+    const unsigned int interval_ms = CONF_GLOBAL(poll_interval) * 1000u;
+    if (!interval_ms) {
+        return POLLER_IDLE_MS;
+    }
+
+    unsigned int count = 0;
+    struct pvt* pvt;
+
+    AST_RWLIST_RDLOCK(&gpublic->devices);
+    AST_RWLIST_TRAVERSE(&gpublic->devices, pvt, entry) {
+        ++count;
+    }
+
+    if (count) {
+        const unsigned int pos = poller.cursor++ % count;
+        unsigned int i         = 0;
+
+        AST_RWLIST_TRAVERSE(&gpublic->devices, pvt, entry) {
+            if (i++ == pos) {
+                ast_mutex_lock(&pvt->lock);
+                poller_poll(pvt, ast_tvnow(), interval_ms);
+                ast_mutex_unlock(&pvt->lock);
+                break;
+            }
+        }
+    }
+    AST_RWLIST_UNLOCK(&gpublic->devices);
+
+    /* every device is visited once per interval */
+    return count ? MAX(interval_ms / count, POLLER_STEP_MS) : POLLER_IDLE_MS;
+}
+
+static void* poller_threadproc(attribute_unused void* arg)
+{
+    SCOPED_MUTEX(poller_lock, &poller.lock);
+
+    while (poller.running) {
+        const struct timeval deadline = ast_tvadd(ast_tvnow(), ast_samp2tv(poller_step(), 1000));
+        const struct timespec ts      = {.tv_sec = deadline.tv_sec, .tv_nsec = deadline.tv_usec * 1000l};
+        ast_cond_timedwait(&poller.cond, &poller.lock, &ts);
+    }
+
+    return NULL;
+}
+
+#/* */
+
+int poller_covers(const struct pvt* pvt)
+{
+    const unsigned int interval_ms = CONF_GLOBAL(poll_interval) * 1000u;
+
+    /* missed visits mean scheduler is stuck, ping again */
+    return interval_ms && poller_fresh(pvt->polled, ast_tvnow(), interval_ms * 2u);
+}
+
+int poller_init()
+{
+    static int initialized = 0;
+
+    if (!initialized) {
+        ast_mutex_init(&poller.lock);
+        ast_cond_init(&poller.cond, NULL);
+        initialized = 1;
+    }
+
+    poller.running = 1;
+    if (ast_pthread_create_background(&poller.thread, NULL, poller_threadproc, NULL) < 0) {
+        ast_log(LOG_ERROR, "Unable to create poll scheduler thread\n");
+        poller.running = 0;
+        return -1;
+    }
+
+    return 0;
+}
+
+void poller_fini()
+{
+    ast_mutex_lock(&poller.lock);
+    if (!poller.running) {
+        ast_mutex_unlock(&poller.lock);
+        return;
+    }
+    poller.running = 0;
+    ast_cond_signal(&poller.cond);
+    ast_mutex_unlock(&poller.lock);
+
+    pthread_join(poller.thread, NULL);
+}
@@ -0,0 +1,25 @@
+/*
+   poller.h
+*/
+#ifndef CHAN_QUECTEL_POLLER_H_INCLUDED
+#define CHAN_QUECTEL_POLLER_H_INCLUDED
+
+/*
+    Periodic poll scheduler
+
+    One thread visits devices one by one, so with poll_interval seconds and N devices
+    next device is polled every poll_interval / N seconds and queries of all devices never cluster.
+    Signal strength, provider and network time queries of device are sent in one command line,
+    signal and provider are skipped while unsolicited +CSQN/+QIND updates are fresher than poll_interval.
+    While device is visited ping on read silence is not sent.
+*/
+
+struct pvt;
+
+int poller_init();
+void poller_fini();
+
+/* pvt locked, non-zero if device is checked by poll scheduler */
+int poller_covers(const struct pvt* pvt);
+
+#endif /* CHAN_QUECTEL_POLLER_H_INCLUDED */
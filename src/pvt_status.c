@@ -0,0 +1,163 @@
+/*
+   pvt_status.c
+*/
+#include <string.h> /* memcmp() memset() */
+
+#include "ast_config.h"
+
+#include <asterisk/astobj2.h>
+#include <asterisk/devicestate.h>
+#include <asterisk/json.h>
+#include <asterisk/lock.h>
+#include <asterisk/strings.h>
+#include <asterisk/utils.h>
+
+#include "pvt_status.h"
+
+#include "chan_quectel.h"
+#include "devindex.h" /* devindex_find_id() */
+#include "helpers.h"  /* gsm_regstate2str_json() */
+
+#/* */
+
+static int pvt_status_devicestate(const struct pvt* pvt)
+{
+    if (!pvt_enabled(pvt)) {
+        return AST_DEVICE_INVALID;
+    }
+
+    if (!pvt->connected) {
+        return AST_DEVICE_UNAVAILABLE;
+    }
+
+    return pvt_is_dial_possible(pvt, CALL_FLAG_NONE) ? AST_DEVICE_NOT_INUSE : AST_DEVICE_INUSE;
+}
+
+/* pvt locked, coalesced: subscribers are notified only when device state really changes */
+static void pvt_status_devicestate_changed(const struct pvt* pvt, const struct pvt_status* old, int devicestate)
+{
+    if (old && old->devicestate == devicestate) {
+        return;
+    }
+
+    ast_devstate_changed(devicestate, AST_DEVSTATE_CACHABLE, "Quectel/%s", PVT_ID(pvt));
+}
+
+static void pvt_status_fill(const struct pvt* pvt, struct pvt_status* status)
+{
+    struct ast_str* state_ex = ast_str_alloca(sizeof(status->state_ex));
+
+    /* whole object is compared, padding and unused tails of strings must be zero */
+    memset(status, 0, sizeof(*status));
+
+    status->group          = CONF_SHARED(pvt, group);
+    status->rssi           = pvt->rssi;
+    status->act            = pvt->act;
+    status->gsm_reg_status = pvt->gsm_reg_status;
+    status->operator       = pvt->operator;
+    status->devicestate    = pvt_status_devicestate(pvt);
+
+    pvt_append_state_ex(pvt, &state_ex);
+    ast_copy_string(status->state, pvt_str_state(pvt), sizeof(status->state));
+    ast_copy_string(status->state_ex, ast_str_buffer(state_ex), sizeof(status->state_ex));
+
+    ast_copy_string(status->provider_name, S_OR(pvt->provider_name, ""), sizeof(status->provider_name));
+    ast_copy_string(status->network_name, S_OR(pvt->network_name, ""), sizeof(status->network_name));
+    ast_copy_string(status->short_network_name, S_OR(pvt->short_network_name, ""), sizeof(status->short_network_name));
+    ast_copy_string(status->model, S_OR(pvt->model, ""), sizeof(status->model));
+    ast_copy_string(status->firmware, S_OR(pvt->firmware, ""), sizeof(status->firmware));
+    ast_copy_string(status->imei, S_OR(pvt->imei, ""), sizeof(status->imei));
+    ast_copy_string(status->imsi, S_OR(pvt->imsi, ""), sizeof(status->imsi));
+    ast_copy_string(status->iccid, S_OR(pvt->iccid, ""), sizeof(status->iccid));
+    ast_copy_string(status->subscriber_number, S_OR(pvt->subscriber_number, ""), sizeof(status->subscriber_number));
+    ast_copy_string(status->location_area_code, S_OR(pvt->location_area_code, ""), sizeof(status->location_area_code));
+    ast_copy_string(status->cell_id, S_OR(pvt->cell_id, ""), sizeof(status->cell_id));
+    ast_copy_string(status->band, S_OR(pvt->band, ""), sizeof(status->band));
+}
+
+void pvt_status_publish(struct pvt* pvt)
+{
+    struct pvt_status current;
+
+    pvt_status_fill(pvt, &current);
+
+    /* only writer of pointer is pvt lock holder, no need of status lock to read it */
+    if (pvt->status && !memcmp(pvt->status, &current, sizeof(current))) {
+        return;
+    }
+
+    struct pvt_status* const status = ao2_alloc_options(sizeof(*status), NULL, AO2_ALLOC_OPT_LOCK_NOLOCK);
+    if (!status) {
+        return;
+    }
+    memcpy(status, &current, sizeof(*status));
+    pvt_status_devicestate_changed(pvt, pvt->status, status->devicestate);
+
+    ast_mutex_lock(&pvt->status_lock);
+    struct pvt_status* const old = pvt->status;
+    pvt->status                  = status;
+    ast_mutex_unlock(&pvt->status_lock);
+
+    ao2_cleanup(old);
+}
+
+void pvt_status_release(struct pvt* pvt)
+{
+    pvt_status_devicestate_changed(pvt, pvt->status, AST_DEVICE_INVALID);
+
+    ast_mutex_lock(&pvt->status_lock);
+    struct pvt_status* const old = pvt->status;
+    pvt->status                  = NULL;
+    ast_mutex_unlock(&pvt->status_lock);
+
+    ao2_cleanup(old);
+}
+
+struct pvt_status* pvt_status_get(struct pvt* pvt)
+{
+    SCOPED_MUTEX(status_lock, &pvt->status_lock);
+    return ao2_bump(pvt->status);
+}
+
+struct pvt_status* pvt_status_find(const char* id)
+{
+    struct pvt_status* status = NULL;
+
+    AST_RWLIST_RDLOCK(&gpublic->devices);
+    struct pvt* const pvt = devindex_find_id(id);
+    if (pvt) {
+        status = pvt_status_get(pvt);
+    }
+    AST_RWLIST_UNLOCK(&gpublic->devices);
+
+    return status;
+}
+
+#define SET_STATUS_STRING_FIELD(j, s, f) \
+    if (!ast_strlen_zero(s->f)) ast_json_object_set(j, #f, ast_json_string_create(s->f))
+
+void pvt_status_json(const char* id, const struct pvt_status* status, struct ast_json* json)
+{
+    ast_json_object_set(json, "name", ast_json_string_create(id));
+    ast_json_object_set(json, "state", ast_json_string_create(status->state_ex));
+    ast_json_object_set(json, "gsm", ast_json_string_create(gsm_regstate2str_json(status->gsm_reg_status)));
+
+    SET_STATUS_STRING_FIELD(json, status, subscriber_number);
+    SET_STATUS_STRING_FIELD(json, status, network_name);
+    SET_STATUS_STRING_FIELD(json, status, short_network_name);
+    SET_STATUS_STRING_FIELD(json, status, provider_name);
+    SET_STATUS_STRING_FIELD(json, status, imei);
+    SET_STATUS_STRING_FIELD(json, status, imsi);
+    SET_STATUS_STRING_FIELD(json, status, iccid);
+    SET_STATUS_STRING_FIELD(json, status, location_area_code);
+    SET_STATUS_STRING_FIELD(json, status, cell_id);
+    SET_STATUS_STRING_FIELD(json, status, band);
+
+    if (status->operator) {
+        struct ast_json* const plmn = ast_json_object_create();
+        ast_json_object_set(plmn, "value", ast_json_integer_create(status->operator));
+        ast_json_object_set(plmn, "mcc", ast_json_integer_create(status->operator/ 100));
+        ast_json_object_set(plmn, "mnc", ast_json_stringf("%02d", status->operator% 100));
+        ast_json_object_set(json, "plmn", plmn);
+    }
+}
@@ -0,0 +1,59 @@
+/*
+   pvt_status.h
+*/
+#ifndef CHAN_QUECTEL_PVT_STATUS_H_INCLUDED
+#define CHAN_QUECTEL_PVT_STATUS_H_INCLUDED
+
+struct pvt;
+struct ast_json;
+
+#define PVT_STATUS_FIELD_LEN 64
+
+/*
+    Device status snapshot
+
+    Snapshot is immutable, it is rebuilt with pvt locked whenever state of device may change
+    and replaces current one only if anything differs. Readers take reference of current
+    snapshot without pvt lock, old snapshot is freed when last reader releases it.
+    Change of device state is pushed to Asterisk as cachable "Quectel/<id>" state,
+    so hints and queues do not poll devicestate callback.
+*/
+
+struct pvt_status {
+    int group;
+    int rssi;
+    int act;
+    int gsm_reg_status;
+    int operator;
+    int devicestate; /*!< AST_DEVICE_* value for device state queries */
+
+    char state[32];     /*!< see pvt_str_state() */
+    char state_ex[128]; /*!< see pvt_str_state_ex() */
+
+    char provider_name[PVT_STATUS_FIELD_LEN];
+    char network_name[PVT_STATUS_FIELD_LEN];
+    char short_network_name[PVT_STATUS_FIELD_LEN];
+    char model[PVT_STATUS_FIELD_LEN];
+    char firmware[PVT_STATUS_FIELD_LEN];
+    char imei[PVT_STATUS_FIELD_LEN];
+    char imsi[PVT_STATUS_FIELD_LEN];
+    char iccid[PVT_STATUS_FIELD_LEN];
+    char subscriber_number[PVT_STATUS_FIELD_LEN];
+    char location_area_code[PVT_STATUS_FIELD_LEN];
+    char cell_id[PVT_STATUS_FIELD_LEN];
+    char band[PVT_STATUS_FIELD_LEN];
+};
+
+/* pvt locked, rebuild snapshot and replace current one if changed */
+void pvt_status_publish(struct pvt* pvt);
+/* pvt locked, drop current snapshot before pvt is freed */
+void pvt_status_release(struct pvt* pvt);
+
+/* pvt not locked, returns referenced snapshot or NULL, release it by ao2_cleanup() */
+struct pvt_status* pvt_status_get(struct pvt* pvt);
+/* devices list not locked, returns referenced snapshot of device or NULL */
+struct pvt_status* pvt_status_find(const char* id);
+
+void pvt_status_json(const char* id, const struct pvt_status* status, struct ast_json* json);
+
+#endif /* CHAN_QUECTEL_PVT_STATUS_H_INCLUDED */
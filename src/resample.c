@@ -0,0 +1,74 @@
+/*
+   resample.c
+*/
+#include <string.h> /* memcpy() */
+
+#include "resample.h"
+
+/* odd taps of halfband lowpass, Kaiser window beta 6.5, Q15, sum is 0.25, center tap is 0.5 */
+static const int32_t halfband[RESAMPLE_HALF_TAPS] = {10310, -3128, 1548, -818, 416, -189, 71, -18};
+
+static inline int16_t saturate(int32_t v)
+{
+    if (v > INT16_MAX) {
+        return INT16_MAX;
+    }
+    if (v < INT16_MIN) {
+        return INT16_MIN;
+    }
+    return (int16_t)v;
+}
+
+size_t resample_down2(struct resampler* rs, const int16_t* in, size_t samples, int16_t* out)
+{
+    static const size_t CENTER = 2u * RESAMPLE_HALF_TAPS - 1u;
+
+    samples &= ~(size_t)1u;
+    if (!samples || samples > RESAMPLE_MAX_SAMPLES) {
+        return 0;
+    }
+
+    int16_t buf[RESAMPLE_HISTORY + RESAMPLE_MAX_SAMPLES];
+    memcpy(buf, rs->hist, sizeof(rs->hist));
+    memcpy(buf + RESAMPLE_HISTORY, in, samples * sizeof(int16_t));
+
+    const size_t count = samples / 2u;
+    for (size_t m = 0; m < count; ++m) {
+        const int16_t* const x = buf + 2u * m + CENTER;
+        int32_t acc            = (int32_t)x[0] * 16384 + 16384;
+        for (size_t j = 0; j < RESAMPLE_HALF_TAPS; ++j) {
+            acc += halfband[j] * ((int32_t)x[2u * j + 1u] + (int32_t)x[-(ptrdiff_t)(2u * j + 1u)]);
+        }
+        out[m] = saturate(acc >> 15);
+    }
+
+    memcpy(rs->hist, buf + samples, sizeof(rs->hist));
+    return count;
+}
+
+size_t resample_up2(struct resampler* rs, const int16_t* in, size_t samples, int16_t* out)
+{
+    /* zero stuffed input has only half of history */
+    static const size_t HISTORY = 2u * RESAMPLE_HALF_TAPS - 1u;
+
+    if (!samples || samples > RESAMPLE_MAX_SAMPLES / 2u) {
+        return 0;
+    }
+
+    int16_t buf[RESAMPLE_HISTORY + RESAMPLE_MAX_SAMPLES / 2u];
+    memcpy(buf, rs->hist, HISTORY * sizeof(int16_t));
+    memcpy(buf + HISTORY, in, samples * sizeof(int16_t));
+
+    for (size_t m = 0; m < samples; ++m) {
+        const int16_t* const x = buf + m + RESAMPLE_HALF_TAPS;
+        int32_t acc            = 8192;
+        for (size_t j = 0; j < RESAMPLE_HALF_TAPS; ++j) {
+            acc += halfband[j] * ((int32_t)x[j] + (int32_t)x[-(ptrdiff_t)j - 1]);
+        }
+        out[2u * m]      = saturate(acc >> 14);
+        out[2u * m + 1u] = x[0];
+    }
+
+    memcpy(rs->hist, buf + samples, HISTORY * sizeof(int16_t));
+    return 2u * samples;
+}
@@ -0,0 +1,42 @@
+/*
+   resample.h
+*/
+#ifndef CHAN_QUECTEL_RESAMPLE_H_INCLUDED
+#define CHAN_QUECTEL_RESAMPLE_H_INCLUDED
+
+#include <stddef.h> /* size_t */
+#include <stdint.h> /* int16_t */
+
+/*
+    Rate conversion between 8 kHz and 16 kHz signed linear audio
+
+    One 31 taps halfband FIR, only eight multiplications per output sample are needed
+    because every second coefficient is zero and filter is symmetric.
+    Passband is flat within 0.6 dB up to 3400 Hz, stopband from 5 kHz is below -58 dB.
+    State keeps input history, so continuous stream is converted frame by frame without clicks.
+*/
+
+#define RESAMPLE_HALF_TAPS 8u
+#define RESAMPLE_HISTORY (4u * RESAMPLE_HALF_TAPS - 2u)
+
+/* largest frame accepted by channel, 60 ms at 16 kHz */
+#define RESAMPLE_MAX_SAMPLES 960u
+
+struct resampler {
+    int16_t hist[RESAMPLE_HISTORY]; /*!< last input samples */
+};
+
+static inline void resample_init(struct resampler* rs)
+{
+    for (size_t i = 0; i < RESAMPLE_HISTORY; ++i) {
+        rs->hist[i] = 0;
+    }
+}
+
+/*!< 16 kHz to 8 kHz, return number of output samples, out must hold samples / 2 */
+size_t resample_down2(struct resampler* rs, const int16_t* in, size_t samples, int16_t* out);
+
+/*!< 8 kHz to 16 kHz, return number of output samples, out must hold samples * 2 */
+size_t resample_up2(struct resampler* rs, const int16_t* in, size_t samples, int16_t* out);
+
+#endif /* CHAN_QUECTEL_RESAMPLE_H_INCLUDED */
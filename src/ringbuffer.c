@@ -6,7 +6,8 @@
 
    Dmitry Vagin <dmitry2004@yandex.ru>
 */
-#include <string.h> /* memchr() */
+#include <byteswap.h> /* bswap_16() */
+#include <string.h>   /* memchr() memcpy() */
 
 #include "ast_config.h"
 
@@ -202,6 +203,49 @@ int rb_read_until_mem_iov(const struct ringbuffer* rb, struct iovec* iov, const
     return 0;
 }
 
+ssize_t rb_find_mem(const struct ringbuffer* rb, size_t from, const void* mem, size_t len)
+{
+    if (!len || rb->used < len || from > rb->used - len) {
+        return -1;
+    }
+
+    const char* const base = rb->buffer;
+    const char* const head = base + rb->read;
+    const size_t seg       = ((rb->read + rb->used) > rb->size) ? rb->size - rb->read : rb->used;
+    const char* p;
+
+    /* in first segment */
+    if (from + len <= seg && (p = memmem(head + from, seg - from, mem, len)) != NULL) {
+        return p - head;
+    }
+
+    if (seg == rb->used) {
+        return -1;
+    }
+
+    /* across end of buffer */
+    size_t start = (seg >= len) ? seg - len + 1u : 0u;
+    if (start < from) {
+        start = from;
+    }
+    for (; start < seg && start + len <= rb->used; ++start) {
+        const size_t tail = seg - start;
+        if (!memcmp(head + start, mem, tail) && !memcmp(base, (const char*)mem + tail, len - tail)) {
+            return start;
+        }
+    }
+
+    /* in second segment */
+    if (start < seg) {
+        start = seg;
+    }
+    if (start + len <= rb->used && (p = memmem(base + (start - seg), rb->used - start, mem, len)) != NULL) {
+        return (p - base) + seg;
+    }
+
+    return -1;
+}
+
 size_t rb_read_upd(struct ringbuffer* rb, size_t len)
 {
     size_t s;
@@ -316,3 +360,153 @@ size_t rb_write_core(struct ringbuffer* rb, const char* buf, size_t len, rb_writ
 
     return len;
 }
+
+#if __BYTE_ORDER != __LITTLE_ENDIAN
+void* rb_copy_le(void* s1, const void* s2, size_t n)
+{
+    uint16_t* dst       = s1;
+    const uint16_t* src = s2;
+
+    for (n /= 2; n; --n) {
+        *dst++ = bswap_16(*src++);
+    }
+    return s1;
+}
+#endif
+
+void* rb_move(struct ringbuffer* rb, void* buf, size_t size)
+{
+    void* const old = rb->buffer;
+    struct iovec iov[2];
+    size_t used = 0;
+
+    if (size < rb->used) {
+        return NULL;
+    }
+
+    const int iovcnt = rb_read_all_iov(rb, iov);
+    for (int i = 0; i < iovcnt; ++i) {
+        memcpy((char*)buf + used, iov[i].iov_base, iov[i].iov_len);
+        used += iov[i].iov_len;
+    }
+
+    rb->buffer = buf;
+    rb->size   = size;
+    rb->read   = 0;
+    rb->write  = (used == size) ? 0 : used;
+    return old;
+}
+
+/* ========================= SPSC RING =========================== */
+
+static int rb_spsc_iov(const struct rb_spsc* rb, struct iovec* iov, size_t pos, size_t len)
+{
+    const size_t offset = pos % rb->size;
+
+    if (offset + len > rb->size) {
+        iov[0].iov_base = rb->buffer + offset;
+        iov[0].iov_len  = rb->size - offset;
+        iov[1].iov_base = rb->buffer;
+        iov[1].iov_len  = len - iov[0].iov_len;
+        return 2;
+    }
+
+    iov[0].iov_base = rb->buffer + offset;
+    iov[0].iov_len  = len;
+    iov[1].iov_len  = 0;
+    return 1;
+}
+
+size_t rb_spsc_write_iov(struct rb_spsc* rb, const struct iovec* iov, int iovcnt)
+{
+    size_t len = 0;
+    for (int i = 0; i < iovcnt; ++i) {
+        len += iov[i].iov_len;
+    }
+
+    if (!len || rb_spsc_free(rb) < len) {
+        return 0;
+    }
+
+    size_t pos = rb->write;
+    for (int i = 0; i < iovcnt; ++i) {
+        const char* data = iov[i].iov_base;
+        size_t n         = iov[i].iov_len;
+
+        while (n) {
+            const size_t offset = pos % rb->size;
+            const size_t chunk  = (offset + n > rb->size) ? rb->size - offset : n;
+            memcpy(rb->buffer + offset, data, chunk);
+            data += chunk;
+            pos  += chunk;
+            n    -= chunk;
+        }
+    }
+
+    __atomic_store_n(&rb->write, pos, __ATOMIC_RELEASE);
+    return len;
+}
+
+int rb_spsc_read_n_iov(const struct rb_spsc* rb, struct iovec iov[2], size_t len)
+{
+    if (!len || rb_spsc_used(rb) < len) {
+        return 0;
+    }
+
+    return rb_spsc_iov(rb, iov, rb->read, len);
+}
+
+/* ========================= FRAMES RING ========================= */
+
+void rb_frames_write(struct rb_frames* rb, const void* data, size_t len)
+{
+    const uint64_t head = rb->head;
+    const size_t slot   = (size_t)(head % RB_FRAMES_SLOTS);
+    const size_t n      = len > rb->slot_size ? rb->slot_size : len;
+
+    /* odd sequence is visible before any byte of new frame */
+    __atomic_store_n(&rb->seqs[slot], head * 2u + 1u, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    memcpy(rb->buffer + slot * rb->slot_size, data, n);
+    __atomic_store_n(&rb->lengths[slot], n, __ATOMIC_RELAXED);
+
+    __atomic_store_n(&rb->seqs[slot], head * 2u + 2u, __ATOMIC_RELEASE);
+    __atomic_store_n(&rb->head, head + 1u, __ATOMIC_RELEASE);
+}
+
+size_t rb_frames_read(const struct rb_frames* rb, uint64_t* cursor, void* data, size_t size)
+{
+    uint64_t head = rb_frames_head(rb);
+
+    while (*cursor < head) {
+        /* lagging consumer drops older frames */
+        if (head - *cursor > RB_FRAMES_SLOTS - 1u) {
+            *cursor = head - (RB_FRAMES_SLOTS - 1u);
+        }
+
+        const size_t slot  = (size_t)(*cursor % RB_FRAMES_SLOTS);
+        const uint64_t seq = *cursor * 2u + 2u;
+
+        if (__atomic_load_n(&rb->seqs[slot], __ATOMIC_ACQUIRE) == seq) {
+            size_t n = __atomic_load_n(&rb->lengths[slot], __ATOMIC_RELAXED);
+            if (n > size) {
+                n = size;
+            }
+            memcpy(data, rb->buffer + slot * rb->slot_size, n);
+
+            /* producer may have started next frame of this slot while it was copied */
+            __atomic_thread_fence(__ATOMIC_ACQUIRE);
+            if (__atomic_load_n(&rb->seqs[slot], __ATOMIC_RELAXED) == seq) {
+                *cursor += 1u;
+                return n;
+            }
+        }
+
+        /* frame is overwritten, skip it */
+        *cursor += 1u;
+        head = rb_frames_head(rb);
+    }
+
+    return 0;
+}
@@ -10,6 +10,9 @@
 #ifndef ____RINGBUFFER_H__
 #define ____RINGBUFFER_H__
 
+#include <endian.h>  /* __BYTE_ORDER */
+#include <stdint.h>  /* uint64_t */
+#include <string.h>  /* memset() */
 #include <sys/uio.h> /* struct iovec */
 
 typedef void* (*rb_write_f)(void* s1, const void* s2, size_t n);
@@ -53,6 +56,9 @@ int rb_read_n_iov(const struct ringbuffer* rb, struct iovec* iov, size_t len);
 int rb_read_until_char_iov(const struct ringbuffer*, struct iovec* iov, char);
 int rb_read_until_mem_iov(const struct ringbuffer*, struct iovec* iov, const void*, size_t);
 
+/*!< search read data in place starting from offset, return offset of found mem or -1 */
+ssize_t rb_find_mem(const struct ringbuffer* rb, size_t from, const void* mem, size_t len);
+
 /*!< advice read position to len bytes */
 size_t rb_read_upd(struct ringbuffer* rb, size_t len);
 
@@ -68,4 +74,86 @@ size_t rb_write_core(struct ringbuffer* rb, const char* buf, size_t len, rb_writ
 
 static inline size_t rb_write(struct ringbuffer* rb, const char* buf, size_t len) { return rb_write_core(rb, buf, len, memmove); }
 
+/*!< copy 16-bit samples converting between host and little endian order, usable as rb_write_f */
+#if __BYTE_ORDER == __LITTLE_ENDIAN
+#define rb_copy_le memcpy
+#else
+void* rb_copy_le(void* s1, const void* s2, size_t n);
+#endif
+
+/*!< move data to new buffer of at least used size, data become contiguous, return old buffer or NULL if new one is too small */
+void* rb_move(struct ringbuffer* rb, void* buf, size_t size);
+
+/*
+    Lock-free ring for exactly one producer and one consumer thread
+
+    Positions are free running byte counters, each one is changed only by its owner
+    and published with release semantic, so the other side never observes data
+    before it is completely written or released.
+*/
+struct rb_spsc {
+    char* buffer; /*!< pointer to data buffer */
+    size_t size;  /*!< size of buffer */
+    size_t read;  /*!< total bytes read, updated by consumer */
+    size_t write; /*!< total bytes written, updated by producer */
+};
+
+static inline void rb_spsc_init(struct rb_spsc* rb, void* buf, size_t size)
+{
+    rb->buffer = buf;
+    rb->size   = size;
+    rb->read   = 0;
+    rb->write  = 0;
+}
+
+static inline size_t rb_spsc_used(const struct rb_spsc* rb) { return __atomic_load_n(&rb->write, __ATOMIC_ACQUIRE) - __atomic_load_n(&rb->read, __ATOMIC_ACQUIRE); }
+
+static inline size_t rb_spsc_free(const struct rb_spsc* rb) { return rb->size - rb_spsc_used(rb); }
+
+/*!< producer: copy and publish data from io vectors, return number of bytes written, 0 if not enough space */
+size_t rb_spsc_write_iov(struct rb_spsc* rb, const struct iovec* iov, int iovcnt);
+
+/*!< consumer: fill io vectors array with first len bytes, return 0 if not enough data */
+int rb_spsc_read_n_iov(const struct rb_spsc* rb, struct iovec iov[2], size_t len);
+
+/*!< consumer: release len bytes */
+static inline void rb_spsc_read_upd(struct rb_spsc* rb, size_t len) { __atomic_store_n(&rb->read, rb->read + len, __ATOMIC_RELEASE); }
+
+/*
+    Lock-free ring of frames for one producer and any number of consumers
+
+    Every consumer keeps own cursor, frame is copied once into slot by producer
+    and published with release semantic. Every slot is guarded by sequence lock:
+    sequence of slot is odd while frame N is copied in (2N+1) and even after (2N+2).
+    Consumer validates its copy by sequence read before and after it,
+    frames overwritten while lagging or copying are skipped.
+*/
+#define RB_FRAMES_SLOTS 4u
+
+struct rb_frames {
+    char* buffer;                    /*!< RB_FRAMES_SLOTS slots of slot_size bytes */
+    size_t slot_size;                /*!< maximal frame size */
+    size_t lengths[RB_FRAMES_SLOTS]; /*!< size of frame in every slot */
+    uint64_t seqs[RB_FRAMES_SLOTS];  /*!< sequence of every slot, odd while producer writes it */
+    uint64_t head;                   /*!< total frames written, updated by producer */
+};
+
+static inline void rb_frames_init(struct rb_frames* rb, void* buf, size_t slot_size)
+{
+    rb->buffer    = buf;
+    rb->slot_size = slot_size;
+    rb->head      = 0;
+    memset(rb->lengths, 0, sizeof(rb->lengths));
+    memset(rb->seqs, 0, sizeof(rb->seqs));
+}
+
+/*!< position of next frame, new consumer starts here */
+static inline uint64_t rb_frames_head(const struct rb_frames* rb) { return __atomic_load_n(&rb->head, __ATOMIC_ACQUIRE); }
+
+/*!< producer: copy and publish frame, truncated to slot size */
+void rb_frames_write(struct rb_frames* rb, const void* data, size_t len);
+
+/*!< consumer: copy oldest frame not older than ring after cursor, advance cursor, return frame size or 0 if nothing to read */
+size_t rb_frames_read(const struct rb_frames* rb, uint64_t* cursor, void* data, size_t size);
+
 #endif /* ____RINGBUFFER_H__ */
@@ -0,0 +1,398 @@
+/*
+   smsbulk.c
+*/
+#include <inttypes.h> /* PRId64 */
+
+#include "ast_config.h"
+
+#include <asterisk/linkedlists.h>
+#include <asterisk/lock.h>
+#include <asterisk/manager.h> /* manager_event() */
+#include <asterisk/strings.h>
+#include <asterisk/utils.h>
+
+#include "smsbulk.h"
+
+#include "at_command.h"   /* at_enqueue_sms() */
+#include "chan_quectel.h" /* gpublic CONF_GLOBAL() */
+#include "devindex.h"     /* devindex_find_group() */
+#include "error.h"
+#include "helpers.h" /* is_valid_phone_number() */
+
+static const unsigned int SMSBULK_POLL_MS  = 50;     /* wait for AT queue of busy device */
+static const unsigned int SMSBULK_IDLE_MS  = 1000;   /* wait for device of group to become ready */
+static const unsigned int SMSBULK_STALL_MS = 300000; /* job is given up when no device of group takes message */
+
+struct smsbulk_job {
+    AST_LIST_ENTRY(smsbulk_job) entry;
+    unsigned int id;
+    int group;
+    int validity;
+    int report;
+    struct timeval started;
+    struct timeval progress; /*!< time of last enqueued message */
+    unsigned int count;  /*!< number of destinations */
+    unsigned int next;   /*!< index of next destination */
+    unsigned int sent;   /*!< number of enqueued messages */
+    unsigned int failed; /*!< number of messages failed to enqueue */
+    const char* message; /*!< points into job allocation */
+    const char* destinations[0];
+};
+
+/* rate limiter of SIM, keyed by IMSI or device id */
+struct smsbulk_sim {
+    AST_LIST_ENTRY(smsbulk_sim) entry;
+    struct timeval next; /*!< time next message is allowed */
+    char key[DEVNAMELEN];
+};
+
+static struct {
+    ast_mutex_t lock;
+    ast_cond_t cond;  /*!< signaled on new job and shutdown */
+    pthread_t thread; /*!< dispatcher thread */
+    AST_LIST_HEAD_NOLOCK(, smsbulk_job) jobs;
+    AST_LIST_HEAD_NOLOCK(, smsbulk_sim) sims;
+    unsigned int last_id;
+    unsigned long sent;        /*!< messages enqueued since module load */
+    unsigned long failed;      /*!< messages failed since module load */
+    struct timeval busy_since; /*!< time first job of current batch was added */
+    unsigned long busy_sent;   /*!< messages enqueued since busy_since */
+    unsigned int running :1;   /*!< dispatcher thread is running */
+} engine;
+
+#/* */
+
+static struct smsbulk_sim* smsbulk_sim_get(const char* key)
+{
+    struct smsbulk_sim* sim;
+
+    AST_LIST_TRAVERSE(&engine.sims, sim, entry) {
+        if (!strcmp(sim->key, key)) {
+            return sim;
+        }
+    }
+
+    sim = ast_calloc(1, sizeof(*sim));
+    if (!sim) {
+        return NULL;
+    }
+
+    ast_copy_string(sim->key, key, sizeof(sim->key));
+    AST_LIST_INSERT_TAIL(&engine.sims, sim, entry);
+    return sim;
+}
+
+/* entries keep rate state between jobs, freed on unload only */
+static void smsbulk_sims_clean()
+{
+    struct smsbulk_sim* sim;
+
+    while ((sim = AST_LIST_REMOVE_HEAD(&engine.sims, entry))) {
+        ast_free(sim);
+    }
+}
+
+/* engine locked, returns non-zero if job must be given up */
+static int smsbulk_job_stalled(struct smsbulk_job* job, struct timeval now)
+{
+    const unsigned int rate = CONF_GLOBAL(sms_bulk_rate);
+    const int64_t interval  = rate ? 60000 / rate : 0;
+
+    if (ast_tvdiff_ms(now, job->progress) <= MAX((int64_t)SMSBULK_STALL_MS, interval * 2)) {
+        return 0;
+    }
+
+    const unsigned int pending = job->count - job->next;
+    ast_log(LOG_WARNING, "SMS bulk job %u to group %d: no device ready, %u messages not sent\n", job->id, job->group, pending);
+    job->failed += pending;
+    engine.failed += pending;
+    job->next = job->count;
+    return 1;
+}
+
+static void smsbulk_job_done(struct smsbulk_job* job)
+{
+    const int64_t elapsed = ast_tvdiff_ms(ast_tvnow(), job->started);
+    const double rate     = elapsed > 0 ? job->sent * 1000.0 / elapsed : 0.0;
+
+    ast_verb(3, "SMS bulk job %u to group %d finished: %u sent, %u failed, %.2f msg/s\n", job->id, job->group, job->sent, job->failed, rate);
+    manager_event(EVENT_FLAG_CALL, "QuectelSMSBulkComplete",
+                  "JobID: %u\r\nGroup: %d\r\nCount: %u\r\nSent: %u\r\nFailed: %u\r\nDuration: %" PRId64 "\r\nRate: %.2f\r\n", job->id, job->group, job->count,
+                  job->sent, job->failed, elapsed, rate);
+}
+
+/* devices list read locked, pvt locked, returns 0 if message is sent, 1 if device must wait, -1 on error */
+static int smsbulk_job_send(struct smsbulk_job* job, struct pvt* pvt, struct timeval now, int64_t* wait)
+{
+    if (!pvt->connected || !pvt->initialized || !pvt->gsm_registered || CONF_SHARED(pvt, group) != job->group) {
+        return 1;
+    }
+
+    if (PVT_STATE(pvt, at_tasks) >= MAX(CONF_GLOBAL(sms_bulk_depth), 1u)) {
+        *wait = MIN(*wait, (int64_t)SMSBULK_POLL_MS);
+        return 1;
+    }
+
+    const unsigned int rate = CONF_GLOBAL(sms_bulk_rate);
+    struct smsbulk_sim* sim = NULL;
+
+    if (rate) {
+        sim = smsbulk_sim_get(ast_strlen_zero(pvt->imsi) ? PVT_ID(pvt) : pvt->imsi);
+        if (!sim) {
+            return 1;
+        }
+
+        const int64_t delay = ast_tvdiff_ms(sim->next, now);
+        if (delay > 0) {
+            *wait = MIN(*wait, delay);
+            return 1;
+        }
+    }
+
+    const char* const destination = job->destinations[job->next++];
+    if (at_enqueue_sms(&pvt->sys_chan, destination, job->message, job->validity, job->report)) {
+        ast_log(LOG_WARNING, "[%s] SMS bulk job %u: message to %s not enqueued: %s\n", PVT_ID(pvt), job->id, destination, error2str(chan_quectel_err));
+        job->failed++;
+        engine.failed++;
+        return -1;
+    }
+
+    job->sent++;
+    engine.sent++;
+    engine.busy_sent++;
+    job->progress = now;
+    if (sim) {
+        sim->next = ast_tvadd(now, ast_samp2tv(60000u / rate, 1000));
+    }
+    *wait = MIN(*wait, (int64_t)SMSBULK_POLL_MS);
+    return 0;
+}
+
+/* engine locked, returns milliseconds to wait */
+static int64_t smsbulk_dispatch()
+{
+    const struct timeval now = ast_tvnow();
+    int64_t wait             = SMSBULK_IDLE_MS;
+    struct smsbulk_job* job;
+
+    AST_RWLIST_RDLOCK(&gpublic->devices);
+    AST_LIST_TRAVERSE(&engine.jobs, job, entry) {
+        const struct devindex_group* const members = devindex_find_group(job->group);
+        if (!members) {
+            continue;
+        }
+
+        for (unsigned int i = 0; i < members->count && job->next < job->count; ++i) {
+            struct pvt* const pvt = members->members[i];
+
+            ast_mutex_lock(&pvt->lock);
+            smsbulk_job_send(job, pvt, now, &wait);
+            ast_mutex_unlock(&pvt->lock);
+        }
+    }
+    AST_RWLIST_UNLOCK(&gpublic->devices);
+
+    AST_LIST_TRAVERSE_SAFE_BEGIN(&engine.jobs, job, entry) {
+        if (job->next >= job->count || smsbulk_job_stalled(job, now)) {
+            AST_LIST_REMOVE_CURRENT(entry);
+            smsbulk_job_done(job);
+            ast_free(job);
+        }
+    }
+    AST_LIST_TRAVERSE_SAFE_END;
+
+    return wait;
+}
+
+static void* smsbulk_threadproc(attribute_unused void* arg)
+{
+    SCOPED_MUTEX(engine_lock, &engine.lock);
+
+    while (engine.running) {
+        if (AST_LIST_EMPTY(&engine.jobs)) {
+            ast_cond_wait(&engine.cond, &engine.lock);
+            continue;
+        }
+
+        const struct timeval deadline = ast_tvadd(ast_tvnow(), ast_samp2tv(smsbulk_dispatch(), 1000));
+        const struct timespec ts      = {.tv_sec = deadline.tv_sec, .tv_nsec = deadline.tv_usec * 1000l};
+        ast_cond_timedwait(&engine.cond, &engine.lock, &ts);
+    }
+
+    return NULL;
+}
+
+#/* */
+
+static unsigned int smsbulk_split(char* buf, const char** destinations)
+{
+    static const char DELIMITERS[] = "&, \t";
+
+    unsigned int count = 0;
+    char* saveptr      = NULL;
+
+    for (char* number = strtok_r(buf, DELIMITERS, &saveptr); number; number = strtok_r(NULL, DELIMITERS, &saveptr)) {
+        if (destinations) {
+            destinations[count] = number;
+        }
+        ++count;
+    }
+
+    return count;
+}
+
+int smsbulk_submit(int group, const char* destinations, const char* message, int validity, int report)
+{
+    if (ast_strlen_zero(destinations)) {
+        chan_quectel_err = E_INVALID_PHONE_NUMBER;
+        return -1;
+    }
+
+    RAII_VAR(char*, tmp, ast_strdup(destinations), ast_free);
+    if (!tmp) {
+        chan_quectel_err = E_MALLOC;
+        return -1;
+    }
+
+    const size_t destinations_len = strlen(destinations) + 1u;
+    const unsigned int count      = smsbulk_split(tmp, NULL);
+    if (!count) {
+        chan_quectel_err = E_INVALID_PHONE_NUMBER;
+        return -1;
+    }
+
+    const size_t message_len = strlen(S_OR(message, "")) + 1u;
+    struct smsbulk_job* job  = ast_calloc(1, sizeof(*job) + count * sizeof(job->destinations[0]) + destinations_len + message_len);
+    if (!job) {
+        chan_quectel_err = E_MALLOC;
+        return -1;
+    }
+
+    char* const destinations_buf = (char*)&job->destinations[count];
+    char* const message_buf      = destinations_buf + destinations_len;
+
+    memcpy(destinations_buf, destinations, destinations_len);
+    memcpy(message_buf, S_OR(message, ""), message_len);
+    smsbulk_split(destinations_buf, job->destinations);
+
+    for (unsigned int i = 0; i < count; ++i) {
+        if (!is_valid_phone_number(job->destinations[i])) {
+            ast_log(LOG_ERROR, "SMS bulk: invalid destination %s\n", job->destinations[i]);
+            ast_free(job);
+            chan_quectel_err = E_INVALID_PHONE_NUMBER;
+            return -1;
+        }
+    }
+
+    job->group    = group;
+    job->validity = validity;
+    job->report   = report;
+    job->count    = count;
+    job->message  = message_buf;
+    job->started  = ast_tvnow();
+    job->progress = job->started;
+
+    SCOPED_MUTEX(engine_lock, &engine.lock);
+    if (!engine.running) {
+        ast_free(job);
+        chan_quectel_err = E_QUEUE;
+        return -1;
+    }
+
+    if (AST_LIST_EMPTY(&engine.jobs)) {
+        engine.busy_since = job->started;
+        engine.busy_sent  = 0;
+    }
+
+    job->id = ++engine.last_id;
+    AST_LIST_INSERT_TAIL(&engine.jobs, job, entry);
+    ast_cond_signal(&engine.cond);
+
+    ast_verb(3, "SMS bulk job %u to group %d: %u messages\n", job->id, group, count);
+    return (int)job->id;
+}
+
+int smsbulk_get_jobs(struct smsbulk_job_info** jobs, struct smsbulk_stat* stat)
+{
+    const struct timeval now = ast_tvnow();
+    const struct smsbulk_job* job;
+    unsigned int count = 0;
+
+    SCOPED_MUTEX(engine_lock, &engine.lock);
+
+    AST_LIST_TRAVERSE(&engine.jobs, job, entry) {
+        ++count;
+    }
+
+    *jobs = count ? ast_calloc(count, sizeof(**jobs)) : NULL;
+    memset(stat, 0, sizeof(*stat));
+
+    unsigned int i = 0;
+    AST_LIST_TRAVERSE(&engine.jobs, job, entry) {
+        stat->pending += job->count - job->next;
+        if (*jobs) {
+            struct smsbulk_job_info* const info = &(*jobs)[i++];
+
+            info->id      = job->id;
+            info->group   = job->group;
+            info->count   = job->count;
+            info->sent    = job->sent;
+            info->failed  = job->failed;
+            info->elapsed = (unsigned int)ast_tvdiff_ms(now, job->started);
+        }
+    }
+
+    stat->jobs   = count;
+    stat->sent   = engine.sent;
+    stat->failed = engine.failed;
+    if (count) {
+        const int64_t elapsed = ast_tvdiff_ms(now, engine.busy_since);
+        stat->rate            = elapsed > 0 ? engine.busy_sent * 1000.0 / elapsed : 0.0;
+    }
+
+    return *jobs ? (int)count : 0;
+}
+
+#/* */
+
+int smsbulk_init()
+{
+    static int initialized = 0;
+
+    if (!initialized) {
+        ast_mutex_init(&engine.lock);
+        ast_cond_init(&engine.cond, NULL);
+        initialized = 1;
+    }
+
+    engine.running = 1;
+    if (ast_pthread_create_background(&engine.thread, NULL, smsbulk_threadproc, NULL) < 0) {
+        ast_log(LOG_ERROR, "Unable to create SMS bulk dispatcher thread\n");
+        engine.running = 0;
+        return -1;
+    }
+
+    return 0;
+}
+
+void smsbulk_fini()
+{
+    struct smsbulk_job* job;
+
+    ast_mutex_lock(&engine.lock);
+    if (!engine.running) {
+        ast_mutex_unlock(&engine.lock);
+        return;
+    }
+    engine.running = 0;
+    ast_cond_signal(&engine.cond);
+    ast_mutex_unlock(&engine.lock);
+
+    pthread_join(engine.thread, NULL);
+
+    while ((job = AST_LIST_REMOVE_HEAD(&engine.jobs, entry))) {
+        ast_log(LOG_WARNING, "SMS bulk job %u to group %d cancelled: %u messages not sent\n", job->id, job->group, job->count - job->next);
+        ast_free(job);
+    }
+    smsbulk_sims_clean();
+}
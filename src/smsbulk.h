@@ -0,0 +1,42 @@
+/*
+   smsbulk.h
+*/
+#ifndef CHAN_QUECTEL_SMSBULK_H_INCLUDED
+#define CHAN_QUECTEL_SMSBULK_H_INCLUDED
+
+/*
+    Bulk SMS engine
+
+    Batch of destinations is spread over devices of group. Every device gets next message only when its
+    AT queue is shorter than sms_bulk_depth, so one +CMGS round trip is hidden behind another, and not
+    faster than sms_bulk_rate messages per minute of SIM. Rate of SIM is kept between jobs.
+    Job is finished when no device of group took its message for five minutes, rest of destinations are failed.
+*/
+
+struct smsbulk_job_info {
+    unsigned int id;      /*!< job number */
+    int group;            /*!< group of devices */
+    unsigned int count;   /*!< number of destinations */
+    unsigned int sent;    /*!< number of enqueued messages */
+    unsigned int failed;  /*!< number of messages failed to enqueue */
+    unsigned int elapsed; /*!< milliseconds since start */
+};
+
+struct smsbulk_stat {
+    unsigned int jobs;    /*!< number of jobs in progress */
+    unsigned int pending; /*!< number of messages waiting for device */
+    unsigned long sent;   /*!< messages enqueued since module load */
+    unsigned long failed; /*!< messages failed since module load */
+    double rate;          /*!< messages per second while engine is busy */
+};
+
+int smsbulk_init();
+void smsbulk_fini();
+
+/* destinations are separated by '&', ',' or spaces, returns job number or -1 and set chan_quectel_err */
+int smsbulk_submit(int group, const char* destinations, const char* message, int validity, int report);
+
+/* returns number of jobs in progress, array must be freed by ast_free() */
+int smsbulk_get_jobs(struct smsbulk_job_info** jobs, struct smsbulk_stat* stat);
+
+#endif /* CHAN_QUECTEL_SMSBULK_H_INCLUDED */
@@ -16,6 +16,8 @@
  */
 
 #include <dirent.h>
+#include <errno.h>
+#include <limits.h> /* PATH_MAX */
 #include <signal.h>
 #include <sqlite3.h>
 #include <sys/stat.h>
@@ -26,56 +28,279 @@
 #include "ast_config.h"
 
 #include <asterisk/app.h>
+#include <asterisk/lock.h>
 #include <asterisk/logger.h>
+#include <asterisk/time.h>
+#include <asterisk/utils.h>
 
 #include "smsdb.h"
 
 #include "chan_quectel.h"
+#include "mutils.h" /* MIN() MAX() */
 
-static const size_t DBKEY_DEF_LEN = 32;
+/* main database and per IMSI databases, UID of message keeps index of its shard above row */
+#define SMSDB_SHARDS_MAX 256
+#define SMSDB_UID_ROW_BITS 32
 
-#define DEFINE_SQL_STATEMENT(s, sql)      \
-    static sqlite3_stmt* s##_stmt = NULL; \
-    static const char s##_sql[]   = sql;
+/* commit grouped transaction early when so many writes joined it */
+static const unsigned int GROUP_COMMIT_MAX_WRITES = 256;
+
+#define CSMS_CACHE_BUCKETS 64u
+#define CSMS_FLUSH_MAX 16u /* incomplete messages stored by one flush, rest by next one */
+#define ASYNC_BUCKETS 256u
+
+/* depth of write queue of asynchronous mode, callers wait when it is full */
+static const unsigned int ASYNC_QUEUE_DEPTH = 4096;
+
+/* throttling of background backup and maintenance, shard lock is released between steps */
+static const int MAINT_BACKUP_PAGES       = 64;
+static const int MAINT_PRUNE_ROWS         = 64;
+static const int MAINT_VACUUM_PAGES       = 32;
+static const unsigned int MAINT_PAUSE_MS  = 20;
+static const unsigned int MAINT_STEPS_MAX = 4096; /*!< steps of every task of one maintenance run */
+
+/* statement is prepared by every shard, see struct smsdb_shard */
+#define DEFINE_SQL_STATEMENT(s, sql) static const char s##_sql[] = sql;
 
 #define DEFINE_INTERNAL_SQL_STATEMENT(s, sql) static const char s##_sql[] = sql;
 
+// OPER: transactions
+DEFINE_SQL_STATEMENT(begin_transaction, "BEGIN TRANSACTION")
+DEFINE_SQL_STATEMENT(commit_transaction, "COMMIT TRANSACTION")
+DEFINE_SQL_STATEMENT(rollback_transaction, "ROLLBACK TRANSACTION")
+DEFINE_SQL_STATEMENT(begin_write, "SAVEPOINT smsdb_write")
+DEFINE_SQL_STATEMENT(end_write, "RELEASE SAVEPOINT smsdb_write")
+DEFINE_SQL_STATEMENT(rollback_write, "ROLLBACK TO SAVEPOINT smsdb_write")
+
 // OPER: incoming_msg
-DEFINE_SQL_STATEMENT(get_incomingmsg, "SELECT message FROM incoming_msg WHERE key = ? ORDER BY seqorder")
-DEFINE_SQL_STATEMENT(get_incomingmsg_cnt, "SELECT COUNT(seqorder) FROM incoming_msg WHERE key = ?")
+DEFINE_SQL_STATEMENT(get_incomingmsg, "SELECT message FROM incoming_msg WHERE dev = ? AND addr = ? AND ref = ? AND parts = ? ORDER BY part")
+DEFINE_SQL_STATEMENT(get_incomingmsg_cnt, "SELECT COUNT(part) FROM incoming_msg WHERE dev = ? AND addr = ? AND ref = ? AND parts = ?")
 DEFINE_SQL_STATEMENT(put_incomingmsg,
-                     "INSERT OR REPLACE INTO incoming_msg (key, seqorder, expiration, message)"
-                     "VALUES (?, ?, unixepoch('now') + ?, ?)")
-DEFINE_SQL_STATEMENT(del_incomingmsg, "DELETE FROM incoming_msg WHERE key = ?")
+                     "INSERT OR REPLACE INTO incoming_msg (dev, addr, ref, parts, part, expiration, message)"
+                     "VALUES (?, ?, ?, ?, ?, unixepoch('now') + ?, ?)")
+DEFINE_SQL_STATEMENT(del_incomingmsg, "DELETE FROM incoming_msg WHERE dev = ? AND addr = ? AND ref = ? AND parts = ?")
+DEFINE_SQL_STATEMENT(get_incomingmsg_keys, "SELECT DISTINCT dev, addr, ref, parts FROM incoming_msg")
 
 // OPER: outgoing_msg
-DEFINE_SQL_STATEMENT(put_outgoingmsg, "INSERT INTO outgoing_msg (dev, dst, message, cnt, expiration, srr) VALUES (?, ?, ?, ?, unixepoch('now') + ?, ?)")
+DEFINE_SQL_STATEMENT(put_outgoingmsg,
+                     "INSERT INTO outgoing_msg (dev, dst, message, cnt, expiration, srr, status) VALUES (?, ?, ?, ?, unixepoch('now') + ?, ?, ?)")
 DEFINE_SQL_STATEMENT(del_outgoingmsg, "DELETE FROM outgoing_msg WHERE uid = ?")
 DEFINE_SQL_STATEMENT(get_outgoingmsg_key, "SELECT dev, dst, srr FROM outgoing_msg WHERE uid = ?")
 DEFINE_SQL_STATEMENT(get_outgoingmsg, "SELECT dst, message FROM outgoing_msg WHERE uid = ?")
-DEFINE_SQL_STATEMENT(get_outgoingmsg_expired, "SELECT uid, dst, message FROM outgoing_msg WHERE expiration < unixepoch('now') LIMIT 1")
+DEFINE_SQL_STATEMENT(get_outgoingmsg_expired,
+                     "SELECT uid, dev, dst, message FROM outgoing_msg WHERE expiration <= unixepoch('now') ORDER BY expiration LIMIT ?")
+DEFINE_SQL_STATEMENT(get_outgoingmsg_next, "SELECT MIN(expiration) FROM outgoing_msg")
+DEFINE_SQL_STATEMENT(put_outgoingmsg_uid,
+                     "INSERT INTO outgoing_msg (uid, dev, dst, message, cnt, expiration, srr, status) VALUES (?, ?, ?, ?, ?, ?, ?, ?)")
 
 // OPER: outgoing_ref
-DEFINE_SQL_STATEMENT(put_outgoingref, "INSERT INTO outgoing_ref (key) VALUES (?)")
-DEFINE_SQL_STATEMENT(set_outgoingref, "UPDATE outgoing_ref SET refid = (refid + 1) % 256 WHERE key = ?")
-DEFINE_SQL_STATEMENT(get_outgoingref, "SELECT refid FROM outgoing_ref WHERE key = ?")
+DEFINE_SQL_STATEMENT(put_outgoingref, "INSERT INTO outgoing_ref (dev, addr) VALUES (?, ?)")
+DEFINE_SQL_STATEMENT(set_outgoingref, "UPDATE outgoing_ref SET refid = (refid + 1) % 256 WHERE dev = ? AND addr = ?")
+DEFINE_SQL_STATEMENT(get_outgoingref, "SELECT refid FROM outgoing_ref WHERE dev = ? AND addr = ?")
+DEFINE_SQL_STATEMENT(put_outgoingref_id, "INSERT OR REPLACE INTO outgoing_ref (dev, addr, refid) VALUES (?, ?, ?)")
 
 // OPER: outgoing_part
-DEFINE_SQL_STATEMENT(put_outgoingpart, "INSERT INTO outgoing_part (key, msg, status) VALUES (?, ?, NULL)")
+/* part is keyed by device and destination of its message */
+DEFINE_SQL_STATEMENT(put_outgoingpart, "INSERT INTO outgoing_part (dev, addr, mr, msg, status) SELECT dev, dst, ?, uid, NULL FROM outgoing_msg WHERE uid = ?")
 DEFINE_SQL_STATEMENT(del_outgoingpart, "DELETE FROM outgoing_part WHERE msg = ?")
-DEFINE_SQL_STATEMENT(set_outgoingpart, "UPDATE outgoing_part SET status = ? WHERE rowid = ?")
-DEFINE_SQL_STATEMENT(get_outgoingpart, "SELECT rowid, msg FROM outgoing_part WHERE key = ?")
-DEFINE_SQL_STATEMENT(get_all_status, "SELECT status FROM outgoing_part WHERE msg = ? ORDER BY rowid")
 
 // OPER: outgoing_msg, outgoing_part
-DEFINE_SQL_STATEMENT(cnt_outgoingpart,
-                     "SELECT m.cnt, (SELECT COUNT(p.rowid) FROM outgoing_part p WHERE p.msg = m.rowid AND (p.status & 64 != 0 OR "
-                     "p.status & 32 = 0)) FROM outgoing_msg m WHERE m.rowid = ?")
+/* status of part is byte of outgoing_msg.status at position of part among parts of message */
+DEFINE_SQL_STATEMENT(set_outgoingmsg_status,
+                     "UPDATE outgoing_msg SET status = CAST(substr(status, 1, p.idx) || ? || substr(status, p.idx + 2) AS BLOB) FROM (SELECT o.msg, "
+                     "(SELECT COUNT(*) FROM outgoing_part q WHERE q.msg = o.msg AND q.rowid < o.rowid) AS idx FROM outgoing_part o "
+                     "WHERE o.dev = ? AND o.addr = ? AND o.mr = ?) AS p WHERE outgoing_msg.uid = p.msg RETURNING uid, cnt, status")
 DEFINE_SQL_STATEMENT(cnt_all_outgoingpart,
                      "SELECT m.cnt, (SELECT COUNT(p.rowid) FROM outgoing_part p WHERE p.msg = m.uid) FROM outgoing_msg "
                      "m WHERE m.uid = ?")
 
-static sqlite3* smsdb;
+/* database file with own connection, statements and lock, main database or one per IMSI */
+struct smsdb_shard {
+    sqlite3* db;
+    ast_mutex_t lock;           /*!< serializes use of connection */
+    unsigned int index;         /*!< position in shards, part of UID of message when sharded */
+    int last_uid;               /*!< row of last added message, asynchronous mode */
+    struct timeval started;     /*!< time of opening grouped transaction */
+    unsigned int writes;        /*!< number of writes joined grouped transaction */
+    uint64_t batch;             /*!< number of grouped transaction, incremented on opening */
+    uint64_t committed;         /*!< number of last finished grouped transaction */
+    uint64_t failed;            /*!< bit per grouped transaction by number modulo 64, set when its commit failed */
+    ast_cond_t commit;          /*!< signaled when grouped transaction is finished, used with lock */
+    unsigned int opened:1;      /*!< grouped transaction is opened */
+    unsigned int incremental:1; /*!< auto_vacuum is incremental, free pages are released by maintenance */
+
+    sqlite3_stmt* begin_transaction_stmt;
+    sqlite3_stmt* commit_transaction_stmt;
+    sqlite3_stmt* rollback_transaction_stmt;
+    sqlite3_stmt* begin_write_stmt;
+    sqlite3_stmt* end_write_stmt;
+    sqlite3_stmt* rollback_write_stmt;
+    sqlite3_stmt* get_incomingmsg_stmt;
+    sqlite3_stmt* get_incomingmsg_cnt_stmt;
+    sqlite3_stmt* put_incomingmsg_stmt;
+    sqlite3_stmt* del_incomingmsg_stmt;
+    sqlite3_stmt* get_incomingmsg_keys_stmt;
+    sqlite3_stmt* put_outgoingmsg_stmt;
+    sqlite3_stmt* put_outgoingmsg_uid_stmt;
+    sqlite3_stmt* del_outgoingmsg_stmt;
+    sqlite3_stmt* get_outgoingmsg_key_stmt;
+    sqlite3_stmt* get_outgoingmsg_stmt;
+    sqlite3_stmt* get_outgoingmsg_expired_stmt;
+    sqlite3_stmt* get_outgoingmsg_next_stmt;
+    sqlite3_stmt* put_outgoingref_stmt;
+    sqlite3_stmt* put_outgoingref_id_stmt;
+    sqlite3_stmt* set_outgoingref_stmt;
+    sqlite3_stmt* get_outgoingref_stmt;
+    sqlite3_stmt* put_outgoingpart_stmt;
+    sqlite3_stmt* del_outgoingpart_stmt;
+    sqlite3_stmt* set_outgoingmsg_status_stmt;
+    sqlite3_stmt* cnt_all_outgoingpart_stmt;
+
+    char name[0]; /*!< IMSI, empty for main database */
+};
+
+/* first shard is main database, shards are only added until unload */
+static struct {
+    struct smsdb_shard* shard[SMSDB_SHARDS_MAX];
+    unsigned int count;
+    unsigned int enabled:1; /*!< database is sharded by IMSI */
+} shards;
+
+AST_MUTEX_DEFINE_STATIC(shards_lock); /*!< protects adding of shards, taken before every other lock */
+
+/* writes of all devices joined into one transaction of every shard committed after short window */
+static struct {
+    ast_cond_t cond;         /*!< signaled on transaction opening and shutdown */
+    pthread_t thread;        /*!< committer thread */
+    unsigned int window;     /*!< window in ms, 0 - commit every write */
+    unsigned int generation; /*!< incremented on transaction opening */
+    unsigned int running :1; /*!< committer thread is running */
+} group;
+
+AST_MUTEX_DEFINE_STATIC(group_lock); /*!< protects group, taken after shard lock */
+
+/* key of incomplete incoming message, its parts are rows of incoming_msg */
+struct smsdb_inkey {
+    const char* dev;  /*!< IMSI */
+    const char* addr; /*!< originating address */
+    int ref;          /*!< CSMS reference */
+    int parts;        /*!< total number of parts */
+};
+
+/* parts of multipart message being reassembled in memory */
+struct csms_entry {
+    AST_LIST_ENTRY(csms_entry) entry;
+    struct timeval created; /*!< time of first part */
+    unsigned int hash;      /*!< hash of key */
+    int parts;              /*!< total number of parts */
+    int cnt;                /*!< number of parts received */
+    unsigned int stored :1; /*!< parts moved to database, entry only marks key */
+    unsigned int busy   :1; /*!< pinned while its parts are written without csms_lock */
+    struct smsdb_shard* shard;
+    struct smsdb_inkey key; /*!< strings follow parts */
+    char* part[0];          /*!< message of every part by order */
+};
+
+AST_LIST_HEAD_NOLOCK(csms_bucket, csms_entry);
+
+/* cache of incomplete multipart messages, saves database roundtrips of every part */
+static struct {
+    struct csms_bucket buckets[CSMS_CACHE_BUCKETS];
+    struct timeval next_flush; /*!< time of next check of aged entries */
+    unsigned int timeout;      /*!< seconds before parts of incomplete message are stored, 0 - cache disabled */
+    unsigned int entries;      /*!< number of entries in cache */
+    ast_cond_t idle;           /*!< signaled when entry is unpinned */
+} csms_cache;
+
+AST_MUTEX_DEFINE_STATIC(csms_lock); /*!< protects csms_cache, never held while database write waits for group commit */
+
+enum async_op_type { ASYNC_OP_ADD, ASYNC_OP_PART, ASYNC_OP_STATUS, ASYNC_OP_CLEAR, ASYNC_OP_REFID };
+
+/* write queued for writer thread */
+struct async_op {
+    AST_LIST_ENTRY(async_op) entry;
+    enum async_op_type type;
+    struct smsdb_shard* shard;
+    int uid;           /*!< row of message in shard */
+    int value;         /*!< status of part or CSMS reference */
+    int mr;            /*!< message reference of part */
+    int cnt;           /*!< number of parts of added message */
+    int srr;           /*!< status report of added message requested */
+    time_t expiration; /*!< expiration of added message */
+    const char* dev;
+    const char* dst;
+    const char* msg;
+    char buf[0]; /*!< strings above point here */
+};
+
+struct async_msg;
+
+/* part of outgoing message, found by IMSI/DST/MR */
+struct async_part {
+    AST_LIST_ENTRY(async_part) entry;
+    struct async_msg* msg;
+    unsigned int hash; /*!< hash of key */
+    int refid;
+    int status; /*!< -1 - no status report yet */
+};
+
+/* outgoing message waiting for parts or status reports */
+struct async_msg {
+    AST_LIST_ENTRY(async_msg) entry;
+    struct smsdb_shard* shard;
+    int64_t uid;
+    time_t expiration;
+    int cnt;  /*!< number of parts */
+    int srr;  /*!< status report requested */
+    int sent; /*!< number of sent parts */
+    const char* dev;
+    const char* dst;
+    const char* msg;
+    struct async_part parts[0]; /*!< followed by strings */
+};
+
+/* last CSMS reference of IMSI/DST */
+struct async_ref {
+    AST_LIST_ENTRY(async_ref) entry;
+    unsigned int hash;
+    int refid;
+    const char* dev;
+    const char* dst;
+    char buf[0]; /*!< strings above point here */
+};
+
+AST_LIST_HEAD_NOLOCK(async_ops, async_op);
+AST_LIST_HEAD_NOLOCK(async_msgs, async_msg);
+AST_LIST_HEAD_NOLOCK(async_parts, async_part);
+AST_LIST_HEAD_NOLOCK(async_refs, async_ref);
+
+/* outgoing messages answered from memory, changes are written by writer thread */
+static struct {
+    ast_cond_t cond;                         /*!< signaled on first queued write and shutdown */
+    ast_cond_t idle;                         /*!< signaled when queue is taken by writer and written */
+    pthread_t thread;                        /*!< writer thread */
+    struct async_ops ops;                    /*!< queued writes, oldest first */
+    struct async_msgs msgs[ASYNC_BUCKETS];   /*!< messages by UID */
+    struct async_parts parts[ASYNC_BUCKETS]; /*!< parts by IMSI/DST/MR */
+    struct async_refs refs[ASYNC_BUCKETS];   /*!< references by IMSI/DST */
+    unsigned int pending;                    /*!< number of queued writes */
+    unsigned int busy    :1;                 /*!< writer executes taken writes */
+    unsigned int enabled :1;                 /*!< asynchronous mode is active */
+    unsigned int running :1;                 /*!< writer thread is running */
+} async;
+
+AST_MUTEX_DEFINE_STATIC(async_lock); /*!< protects async, taken before shard lock */
+
+/* online backup and periodic maintenance done by background thread in small steps */
+static struct {
+    ast_cond_t cond;         /*!< signaled on backup request and shutdown */
+    pthread_t thread;        /*!< maintenance thread */
+    unsigned int interval;   /*!< seconds between maintenance runs, 0 - backups only */
+    char backup[PATH_MAX];   /*!< requested or running backup, empty - none */
+    unsigned int running :1; /*!< maintenance thread is running */
+} maint;
+
+AST_MUTEX_DEFINE_STATIC(maint_lock); /*!< protects maint, taken before shard lock */
 
 static int set_ast_str(sqlite3_stmt* stmt, int colno, struct ast_str** str)
 {
@@ -95,30 +320,60 @@ static int append_ast_str(sqlite3_stmt* stmt, int colno, struct ast_str** str)
     return ast_str_append(str, 0, "%.*s", sqlite3_column_bytes(stmt, colno), sqlite3_column_text(stmt, colno));
 }
 
-static int bind_ast_str(sqlite3_stmt* stmt, int colno, const struct ast_str* const str)
+/* IMSI and address of key, strings must outlive step of statement */
+static int bind_dev_addr(sqlite3_stmt* stmt, int colno, const char* dev, const char* addr)
+{
+    const int res = sqlite3_bind_text(stmt, colno, dev, -1, SQLITE_STATIC);
+    return res != SQLITE_OK ? res : sqlite3_bind_text(stmt, colno + 1, addr, -1, SQLITE_STATIC);
+}
+
+/* binds four columns of key starting at colno */
+static int bind_inkey(sqlite3_stmt* stmt, int colno, const struct smsdb_inkey* const key)
 {
-    return sqlite3_bind_text(stmt, colno, ast_str_buffer(str), ast_str_strlen(str), SQLITE_TRANSIENT);
+    int res = bind_dev_addr(stmt, colno, key->dev, key->addr);
+    if (res == SQLITE_OK) {
+        res = sqlite3_bind_int(stmt, colno + 2, key->ref);
+    }
+    return res != SQLITE_OK ? res : sqlite3_bind_int(stmt, colno + 3, key->parts);
+}
+
+/* reserved TP-ST value, marks part without status report, not final */
+#define PART_STATUS_NONE 0xA0u
+
+/* failed or final status report */
+static int attribute_const part_status_final(int status) { return status >= 0 && ((status & 64) || !(status & 32)); }
+
+static int part_status_get(const uint8_t* status, int len, int idx) { return idx < len && status[idx] != PART_STATUS_NONE ? status[idx] : -1; }
+
+/* status of cnt parts without reports */
+static int bind_part_status(sqlite3_stmt* stmt, int colno, int cnt)
+{
+    uint8_t status[SMSDB_PARTS_MAX];
+    const int len = MIN(MAX(cnt, 0), SMSDB_PARTS_MAX);
+
+    memset(status, PART_STATUS_NONE, (size_t)len);
+    return sqlite3_bind_blob(stmt, colno, status, len, SQLITE_TRANSIENT);
 }
 
-static int init_stmt(sqlite3_stmt** stmt, const char* sql, size_t len)
+static int init_stmt(struct smsdb_shard* shard, sqlite3_stmt** stmt, const char* sql, size_t len)
 {
-    if (sqlite3_prepare_v3(smsdb, sql, len, SQLITE_PREPARE_PERSISTENT, stmt, NULL) != SQLITE_OK) {
-        ast_log(LOG_WARNING, "Couldn't prepare statement '%s': %s\n", sql, sqlite3_errmsg(smsdb));
+    if (sqlite3_prepare_v3(shard->db, sql, len, SQLITE_PREPARE_PERSISTENT, stmt, NULL) != SQLITE_OK) {
+        ast_log(LOG_WARNING, "Couldn't prepare statement '%s': %s\n", sql, sqlite3_errmsg(shard->db));
         return -1;
     }
 
     return 0;
 }
 
-#define INIT_STMT(s) init_stmt(&s##_stmt, s##_sql, sizeof(s##_sql))
+#define INIT_STMT(s) init_stmt(shard, &shard->s##_stmt, s##_sql, sizeof(s##_sql))
 
 /* We purposely don't lock around the sqlite3 call because the transaction
  * calls will be called with the database lock held. For any other use, make
- * sure to take the dblock yourself. */
-static int execute_sql(const char* sql, int (*callback)(void*, int, char**, char**), void* arg)
+ * sure to take the shard lock yourself. */
+static int execute_sql(struct smsdb_shard* shard, const char* sql, int (*callback)(void*, int, char**, char**), void* arg)
 {
     char* errmsg  = NULL;
-    const int res = sqlite3_exec(smsdb, sql, callback, arg, &errmsg);
+    const int res = sqlite3_exec(shard->db, sql, callback, arg, &errmsg);
 
     if (res != SQLITE_OK) {
         ast_log(LOG_WARNING, "Error executing SQL (%s): %s\n", sql, errmsg);
@@ -128,18 +383,39 @@ static int execute_sql(const char* sql, int (*callback)(void*, int, char**, char
     return res;
 }
 
-static int execute_ast_str(const struct ast_str* const str) { return execute_sql(ast_str_buffer(str), NULL, NULL); }
+static int execute_ast_str(struct smsdb_shard* shard, const struct ast_str* const str) { return execute_sql(shard, ast_str_buffer(str), NULL, NULL); }
 
-#define EXECUTE_STMT(s) execute_sql(s##_sql, NULL, NULL)
+#define EXECUTE_STMT(s) execute_sql(shard, s##_sql, NULL, NULL)
+
+/* execute prepared statement without result rows */
+static int step_stmt(sqlite3_stmt* stmt, const char* sql)
+{
+    int res = sqlite3_step(stmt);
+
+    if (res == SQLITE_DONE) {
+        res = SQLITE_OK;
+    } else {
+        ast_log(LOG_WARNING, "Error executing SQL (%s): %s\n", sql, sqlite3_errmsg(sqlite3_db_handle(stmt)));
+    }
+
+    sqlite3_reset(stmt);
+    return res;
+}
+
+#define STEP_STMT(s) step_stmt(shard->s##_stmt, s##_sql)
 
 /*! \internal
  * \brief Clean up the prepared SQLite3 statement
- * \note dblock should already be locked prior to calling this method
+ * \note shard lock should already be locked prior to calling this method
  */
 static int clean_stmt(sqlite3_stmt** stmt, const char* sql)
 {
+    if (!*stmt) {
+        return 0;
+    }
+
     if (sqlite3_finalize(*stmt) != SQLITE_OK) {
-        ast_log(LOG_WARNING, "Couldn't finalize statement '%s': %s\n", sql, sqlite3_errmsg(smsdb));
+        ast_log(LOG_WARNING, "Couldn't finalize statement '%s'\n", sql);
         *stmt = NULL;
         return -1;
     }
@@ -147,29 +423,248 @@ static int clean_stmt(sqlite3_stmt** stmt, const char* sql)
     return 0;
 }
 
-#define CLEAN_STMT(s) clean_stmt(&s##_stmt, s##_sql)
+#define CLEAN_STMT(s) clean_stmt(&shard->s##_stmt, s##_sql)
+
+/* shard lock must be held, writes joined transaction fail together when commit fails */
+static void group_commit_nolock(struct smsdb_shard* shard)
+{
+    if (!shard->opened) {
+        return;
+    }
+
+    const uint64_t bit = UINT64_C(1) << (shard->batch % 64u);
+    if (STEP_STMT(commit_transaction) != SQLITE_OK) {
+        ast_log(LOG_ERROR, "Unable to commit %u grouped writes, rolled back\n", shard->writes);
+        if (!sqlite3_get_autocommit(shard->db)) {
+            STEP_STMT(rollback_transaction);
+        }
+        shard->failed |= bit;
+    } else {
+        shard->failed &= ~bit;
+    }
+
+    shard->committed = shard->batch;
+    shard->opened    = 0;
+    shard->writes    = 0;
+    ast_cond_broadcast(&shard->commit);
+}
+
+/* shard lock must be held, opens transaction or joins grouped one, every write has own savepoint */
+static int begin_write_nolock(struct smsdb_shard* shard, int grouped)
+{
+    if (shard->opened && sqlite3_get_autocommit(shard->db)) {
+        /* grouped transaction was rolled back by SQLite on error, finish it as failed */
+        group_commit_nolock(shard);
+    }
+
+    if (!grouped) {
+        group_commit_nolock(shard);
+        if (STEP_STMT(begin_transaction) != SQLITE_OK) {
+            return -1;
+        }
+    } else if (!shard->opened) {
+        if (STEP_STMT(begin_transaction) != SQLITE_OK) {
+            return -1;
+        }
+
+        shard->opened  = 1;
+        shard->writes  = 0;
+        shard->started = ast_tvnow();
+        shard->batch++;
+
+        ast_mutex_lock(&group_lock);
+        group.generation++;
+        ast_cond_signal(&group.cond);
+        ast_mutex_unlock(&group_lock);
+    }
+
+    if (STEP_STMT(begin_write) != SQLITE_OK) {
+        if (!grouped) {
+            STEP_STMT(rollback_transaction);
+        }
+        return -1;
+    }
+
+    return 0;
+}
 
-static int begin_transaction()
+/* shard lock must be held, failed write is rolled back alone, returns -1 if write is not kept */
+static int end_write_nolock(struct smsdb_shard* shard, int grouped, int failed)
 {
-    DEFINE_INTERNAL_SQL_STATEMENT(begin_transaction, "BEGIN TRANSACTION");
+    if (failed) {
+        STEP_STMT(rollback_write);
+    }
+    if (STEP_STMT(end_write) != SQLITE_OK) {
+        failed = 1;
+    }
 
-    return EXECUTE_STMT(begin_transaction);
+    if (!grouped) {
+        if (failed || STEP_STMT(commit_transaction) != SQLITE_OK) {
+            if (!sqlite3_get_autocommit(shard->db)) {
+                STEP_STMT(rollback_transaction);
+            }
+            return -1;
+        }
+        return 0;
+    }
+
+    shard->writes++;
+    if (sqlite3_get_autocommit(shard->db) || shard->writes >= GROUP_COMMIT_MAX_WRITES) {
+        group_commit_nolock(shard);
+    }
+    return failed ? -1 : 0;
 }
 
-static void commit_transaction(int res)
+/* write of one caller in transaction, see SCOPED_TRANSACTION */
+struct smsdb_trans {
+    struct smsdb_shard* shard; /*!< locked shard, NULL - transaction is not started */
+    int* res;                  /*!< result of write, -1 rolls write back, set to -1 when write is not committed */
+    unsigned int grouped:1;    /*!< write joined grouped transaction */
+};
+
+/* takes shard lock, released by end_transaction() */
+static struct smsdb_trans begin_transaction(struct smsdb_shard* shard, int* res, int grouped)
 {
-    DEFINE_INTERNAL_SQL_STATEMENT(commit_transaction, "COMMIT TRANSACTION");
+    struct smsdb_trans trans = {.shard = NULL, .res = res, .grouped = grouped && group.window};
 
-    if (res != SQLITE_OK) {
+    ast_mutex_lock(&shard->lock);
+    if (begin_write_nolock(shard, trans.grouped)) {
+        ast_mutex_unlock(&shard->lock);
+        return trans;
+    }
+
+    trans.shard = shard;
+    return trans;
+}
+
+/* write of grouped transaction is reported as successful only after commit */
+static void end_transaction(struct smsdb_trans* trans)
+{
+    struct smsdb_shard* const shard = trans->shard;
+    if (!shard) {
+        return;
+    }
+
+    const uint64_t batch = shard->batch;
+    if (end_write_nolock(shard, trans->grouped, *trans->res == -1)) {
+        *trans->res = -1;
+    } else if (trans->grouped) {
+        if (!group.window) {
+            /* committer thread is stopped */
+            group_commit_nolock(shard);
+        }
+        while (shard->committed < batch) {
+            ast_cond_wait(&shard->commit, &shard->lock);
+        }
+        if (shard->failed & (UINT64_C(1) << (batch % 64u))) {
+            *trans->res = -1;
+        }
+    }
+
+    ast_mutex_unlock(&shard->lock);
+}
+
+static unsigned int shards_count()
+{
+    SCOPED_MUTEX(shards_lock_scope, &shards_lock);
+    return shards.count;
+}
+
+/* commit transactions of shards opened longer than window, returns ms to wait for next one, -1 - none is opened */
+static int64_t group_commit_shards(int all)
+{
+    const unsigned int count = shards_count();
+    int64_t wait             = -1;
+
+    for (unsigned int i = 0; i < count; ++i) {
+        struct smsdb_shard* const shard = shards.shard[i];
+
+        SCOPED_MUTEX(shard_lock, &shard->lock);
+        if (!shard->opened) {
+            continue;
+        }
+
+        const int64_t left = group.window - ast_tvdiff_ms(ast_tvnow(), shard->started);
+        if (all || left <= 0) {
+            group_commit_nolock(shard);
+        } else if (wait < 0 || left < wait) {
+            wait = left;
+        }
+    }
+
+    return wait;
+}
+
+static void* group_commit_threadproc(attribute_unused void* arg)
+{
+    SCOPED_MUTEX(group_lock_scope, &group_lock);
+
+    while (group.running) {
+        const unsigned int generation = group.generation;
+        ast_mutex_unlock(&group_lock);
+        const int64_t wait = group_commit_shards(0);
+        ast_mutex_lock(&group_lock);
+
+        if (!group.running || generation != group.generation) {
+            continue;
+        }
+
+        if (wait < 0) {
+            ast_cond_wait(&group.cond, &group_lock);
+        } else {
+            const struct timeval deadline = ast_tvadd(ast_tvnow(), ast_samp2tv(wait, 1000));
+            const struct timespec ts      = {.tv_sec = deadline.tv_sec, .tv_nsec = deadline.tv_usec * 1000l};
+            ast_cond_timedwait(&group.cond, &group_lock, &ts);
+        }
+    }
+
+    ast_mutex_unlock(&group_lock);
+    group_commit_shards(1);
+    ast_mutex_lock(&group_lock);
+    return NULL;
+}
+
+static int group_commit_start(unsigned int window)
+{
+    if (!window) {
+        return 0;
+    }
+
+    group.window  = window;
+    group.running = 1;
+    if (ast_pthread_create_background(&group.thread, NULL, group_commit_threadproc, NULL) < 0) {
+        ast_log(LOG_ERROR, "Unable to create smsdb committer thread, commit every write\n");
+        group.window  = 0;
+        group.running = 0;
+        return -1;
+    }
+
+    ast_verb(3, "SMSdb group commit window %u ms\n", window);
+    return 0;
+}
+
+static void group_commit_stop()
+{
+    if (!group.running) {
         return;
     }
 
-    EXECUTE_STMT(commit_transaction);
+    /* later writes are committed at once, grouped ones are committed by thread on exit */
+    ast_mutex_lock(&group_lock);
+    group.running = 0;
+    group.window  = 0;
+    ast_cond_signal(&group.cond);
+    ast_mutex_unlock(&group_lock);
+
+    pthread_join(group.thread, NULL);
 }
 
-#define SCOPED_TRANSACTION(varname)                                  \
-    RAII_VAR(int, varname, begin_transaction(), commit_transaction); \
-    if (varname != SQLITE_OK) return -1;
+/* write till end of scope, -1 in res rolls it back, res is set to -1 when write is not committed */
+#define SCOPED_TRANSACTION_MODE(varname, res, grouped)                                                                   \
+    struct smsdb_trans varname __attribute__((cleanup(end_transaction))) = begin_transaction(shard, &(res), grouped); \
+    if (!varname.shard) return -1;
+
+#define SCOPED_TRANSACTION(varname, res) SCOPED_TRANSACTION_MODE(varname, res, 1)
 
 static void stmt_begin(sqlite3_stmt* stmt)
 {
@@ -195,48 +690,224 @@ static void stmt_end(sqlite3_stmt* stmt)
     }
 }
 
-#define SCOPED_STMT(s) SCOPED_LOCK(s, s##_stmt, stmt_begin, stmt_end)
+#define SCOPED_STMT(s) SCOPED_LOCK(s, shard->s##_stmt, stmt_begin, stmt_end)
+
+/* add columns missing in database created by older version */
+static int db_migrate(struct smsdb_shard* shard)
+{
+    DEFINE_INTERNAL_SQL_STATEMENT(get_outgoingmsg_status, "SELECT status FROM outgoing_msg LIMIT 0")
+    DEFINE_INTERNAL_SQL_STATEMENT(alter_outgoingmsg_status, "ALTER TABLE outgoing_msg ADD COLUMN status BLOB")
+
+    sqlite3_stmt* stmt = NULL;
+    if (sqlite3_prepare_v2(shard->db, get_outgoingmsg_status_sql, -1, &stmt, NULL) == SQLITE_OK) {
+        sqlite3_finalize(stmt);
+        return 0;
+    }
+
+    /* messages sent before upgrade get no status report, they expire */
+    ast_log(LOG_NOTICE, "Adding part status column to SMSdb\n");
+    return EXECUTE_STMT(alter_outgoingmsg_status);
+}
+
+/* table of older version keyed by text IMSI/ADDR followed by numbers, renamed and moved to integer columns on open */
+struct db_text_table {
+    const char* name;
+    const char* columns; /*!< copied after numbers of key */
+    const char* insert;  /*!< IMSI, ADDR, numbers of key and copied columns */
+    const char* indexes; /*!< indexes of old table, their names are reused */
+    int nums;            /*!< numbers at end of key */
+};
+
+static const struct db_text_table db_text_tables[] = {
+    {"incoming_msg", "seqorder, expiration, message",
+     "INSERT OR REPLACE INTO incoming_msg (dev, addr, ref, parts, part, expiration, message) VALUES (?, ?, ?, ?, ?, ?, ?)",
+     "DROP INDEX IF EXISTS incoming_key; DROP INDEX IF EXISTS incoming_expiration", 2},
+    {"outgoing_ref", "refid", "INSERT OR REPLACE INTO outgoing_ref (dev, addr, refid) VALUES (?, ?, ?)", NULL, 0},
+    /* order of rows is order of parts of message */
+    {"outgoing_part", "rowid, msg, status", "INSERT OR REPLACE INTO outgoing_part (dev, addr, mr, rowid, msg, status) VALUES (?, ?, ?, ?, ?, ?)",
+     "DROP INDEX IF EXISTS outgoing_part_msg", 1},
+};
+
+/* splits text key in place, address may contain slash */
+static int db_split_text_key(char* key, const char** addr, int* nums, int cnt)
+{
+    char* const sep = strchr(key, '/');
+    if (!sep) {
+        return -1;
+    }
+    *sep = '\0';
+
+    for (int i = cnt - 1; i >= 0; --i) {
+        char* const num = strrchr(sep + 1, '/');
+        if (!num) {
+            return -1;
+        }
+        *num    = '\0';
+        nums[i] = atoi(num + 1);
+    }
+
+    *addr = sep + 1;
+    return 0;
+}
+
+/* rename tables keyed by text before integer keyed ones are created, bit of every renamed table is set */
+static int db_rename_text_tables(struct smsdb_shard* shard, unsigned int* renamed)
+{
+    static const size_t SQLSTMT_DEF_LEN = 96;
+
+    RAII_VAR(struct ast_str*, sqlstmt, ast_str_create(SQLSTMT_DEF_LEN), ast_free);
+
+    for (unsigned int i = 0; i < ARRAY_LEN(db_text_tables); ++i) {
+        const struct db_text_table* const t = &db_text_tables[i];
+        sqlite3_stmt* stmt                  = NULL;
+
+        ast_str_set(&sqlstmt, 0, "SELECT key FROM %s LIMIT 0", t->name);
+        if (sqlite3_prepare_v2(shard->db, ast_str_buffer(sqlstmt), -1, &stmt, NULL) != SQLITE_OK) {
+            /* new database or table already migrated */
+            continue;
+        }
+        sqlite3_finalize(stmt);
+
+        ast_str_set(&sqlstmt, 0, "ALTER TABLE %s RENAME TO %s_text", t->name, t->name);
+        if (execute_ast_str(shard, sqlstmt) || (t->indexes && execute_sql(shard, t->indexes, NULL, NULL))) {
+            return -1;
+        }
+        *renamed |= 1u << i;
+    }
+
+    return 0;
+}
+
+static int db_move_text_table(struct smsdb_shard* shard, const struct db_text_table* t)
+{
+    static const size_t SQLSTMT_DEF_LEN = 96;
+
+    RAII_VAR(struct ast_str*, sqlstmt, ast_str_create(SQLSTMT_DEF_LEN), ast_free);
+    RAII_VAR(struct ast_str*, key, ast_str_create(SQLSTMT_DEF_LEN), ast_free);
+    sqlite3_stmt* get  = NULL;
+    sqlite3_stmt* put  = NULL;
+    unsigned int moved = 0, skipped = 0;
+    int res            = 0;
+
+    ast_str_set(&sqlstmt, 0, "SELECT key, %s FROM %s_text", t->columns, t->name);
+    if (sqlite3_prepare_v2(shard->db, ast_str_buffer(sqlstmt), -1, &get, NULL) != SQLITE_OK ||
+        sqlite3_prepare_v2(shard->db, t->insert, -1, &put, NULL) != SQLITE_OK) {
+        ast_log(LOG_WARNING, "Couldn't prepare migration of %s: %s\n", t->name, sqlite3_errmsg(shard->db));
+        sqlite3_finalize(get);
+        return -1;
+    }
+
+    int step;
+    while ((step = sqlite3_step(get)) == SQLITE_ROW) {
+        const char* const text = (const char*)sqlite3_column_text(get, 0);
+        const char* addr       = NULL;
+        int nums[2]            = {0, 0};
+
+        if (!text || ast_str_set(&key, 0, "%s", text) < 0 || db_split_text_key(ast_str_buffer(key), &addr, nums, t->nums)) {
+            skipped++;
+            continue;
+        }
+
+        sqlite3_reset(put);
+        sqlite3_clear_bindings(put);
+        int bind = bind_dev_addr(put, 1, ast_str_buffer(key), addr);
+        for (int i = 0; bind == SQLITE_OK && i < t->nums; ++i) {
+            bind = sqlite3_bind_int(put, 3 + i, nums[i]);
+        }
+        for (int i = 1; bind == SQLITE_OK && i < sqlite3_column_count(get); ++i) {
+            bind = sqlite3_bind_value(put, 2 + t->nums + i, sqlite3_column_value(get, i));
+        }
+        if (bind != SQLITE_OK || sqlite3_step(put) != SQLITE_DONE) {
+            ast_log(LOG_WARNING, "Couldn't move row '%s' of %s: %s\n", text, t->name, sqlite3_errmsg(shard->db));
+            res = -1;
+            break;
+        }
+        moved++;
+    }
+    if (!res && step != SQLITE_DONE) {
+        ast_log(LOG_WARNING, "Couldn't read rows of %s: %s\n", t->name, sqlite3_errmsg(shard->db));
+        res = -1;
+    }
+
+    sqlite3_finalize(put);
+    sqlite3_finalize(get);
+    if (res) {
+        return res;
+    }
+
+    ast_log(LOG_NOTICE, "SMSdb%s%s moved %u rows of %s to integer keys, %u malformed rows dropped\n", shard->name[0] ? " " : "", shard->name, moved,
+            t->name, skipped);
+    ast_str_set(&sqlstmt, 0, "DROP TABLE %s_text", t->name);
+    return execute_ast_str(shard, sqlstmt);
+}
 
-static int db_create(void)
+static int db_create(struct smsdb_shard* shard)
 {
-    // TABLE: incoming_msg
+    // TABLE: incoming_msg(KEY: IMSI, ADDR, REF, PARTS, PART)
     DEFINE_INTERNAL_SQL_STATEMENT(create_incomingmsg,
-                                  "CREATE TABLE IF NOT EXISTS incoming_msg (key VARCHAR(256), seqorder INTEGER,"
-                                  "expiration TIMESTAMP DEFAULT (unixepoch('now')), message VARCHAR(256), PRIMARY KEY(key, seqorder))")
-    DEFINE_INTERNAL_SQL_STATEMENT(create_incomingmsg_index, "CREATE INDEX IF NOT EXISTS incoming_key ON incoming_msg(key)")
+                                  "CREATE TABLE IF NOT EXISTS incoming_msg (dev VARCHAR(256), addr VARCHAR(256), ref INTEGER, parts INTEGER, part INTEGER,"
+                                  "expiration TIMESTAMP DEFAULT (unixepoch('now')), message VARCHAR(256), PRIMARY KEY(dev, addr, ref, parts, part))")
+    DEFINE_INTERNAL_SQL_STATEMENT(create_incomingmsg_expiration_index, "CREATE INDEX IF NOT EXISTS incoming_expiration ON incoming_msg(expiration)")
 
-    // TABLE: outgoing_msg(KEY: IMSI/DEST_ADDR)
+    // TABLE: outgoing_msg
     DEFINE_INTERNAL_SQL_STATEMENT(create_outgoingmsg,
                                   "CREATE TABLE IF NOT EXISTS outgoing_msg (uid INTEGER PRIMARY KEY AUTOINCREMENT,"
-                                  "dev VARCHAR(256), dst VARCHAR(256), message VARCHAR(256), cnt INTEGER, expiration TIMESTAMP, srr BOOLEAN)")
+                                  "dev VARCHAR(256), dst VARCHAR(256), message VARCHAR(256), cnt INTEGER, expiration TIMESTAMP, srr BOOLEAN, status BLOB)")
+    DEFINE_INTERNAL_SQL_STATEMENT(create_outgoingmsg_index, "CREATE INDEX IF NOT EXISTS outgoing_msg_expiration ON outgoing_msg(expiration)")
 
-    // TABLE: outgoing_ref
-    DEFINE_INTERNAL_SQL_STATEMENT(create_outgoingref, "CREATE TABLE IF NOT EXISTS outgoing_ref (key VARCHAR(256), refid INTEGER DEFAULT 0, PRIMARY KEY(key))")
+    // TABLE: outgoing_ref(KEY: IMSI, DEST_ADDR)
+    DEFINE_INTERNAL_SQL_STATEMENT(create_outgoingref,
+                                  "CREATE TABLE IF NOT EXISTS outgoing_ref (dev VARCHAR(256), addr VARCHAR(256), refid INTEGER DEFAULT 0,"
+                                  "PRIMARY KEY(dev, addr))")
 
-    // TABLE: outgoing_part(KEY: IMSI/DEST_ADDR/MR)
+    // TABLE: outgoing_part(KEY: IMSI, DEST_ADDR, MR)
     DEFINE_INTERNAL_SQL_STATEMENT(create_outgoingpart,
-                                  "CREATE TABLE IF NOT EXISTS outgoing_part (key VARCHAR(256), msg INTEGER, status INTEGER, PRIMARY KEY(key))")
+                                  "CREATE TABLE IF NOT EXISTS outgoing_part (dev VARCHAR(256), addr VARCHAR(256), mr INTEGER, msg INTEGER, status INTEGER,"
+                                  "PRIMARY KEY(dev, addr, mr))")
     DEFINE_INTERNAL_SQL_STATEMENT(create_outgoingpart_index, "CREATE INDEX IF NOT EXISTS outgoing_part_msg ON outgoing_part(msg)")
 
-    SCOPED_TRANSACTION(dbtrans);
+    int res              = 0;
+    unsigned int renamed = 0;
+
+    {
+        /* shard is not known to committer thread yet, text keyed rows are moved once in same transaction */
+        SCOPED_TRANSACTION_MODE(dbtrans, res, 0);
+
+        if (db_rename_text_tables(shard, &renamed) || EXECUTE_STMT(create_incomingmsg) || EXECUTE_STMT(create_incomingmsg_expiration_index) ||
+            EXECUTE_STMT(create_outgoingmsg) || EXECUTE_STMT(create_outgoingmsg_index) || EXECUTE_STMT(create_outgoingref) ||
+            EXECUTE_STMT(create_outgoingpart) || EXECUTE_STMT(create_outgoingpart_index) || db_migrate(shard)) {
+            res = -1;
+        }
+
+        for (unsigned int i = 0; !res && i < ARRAY_LEN(db_text_tables); ++i) {
+            if ((renamed & (1u << i)) && db_move_text_table(shard, &db_text_tables[i])) {
+                res = -1;
+            }
+        }
+    }
 
-    return EXECUTE_STMT(create_incomingmsg) || EXECUTE_STMT(create_incomingmsg_index) || EXECUTE_STMT(create_outgoingmsg) || EXECUTE_STMT(create_outgoingref) ||
-           EXECUTE_STMT(create_outgoingpart) || EXECUTE_STMT(create_outgoingpart_index);
+    return res;
 }
 
-static int db_init_statements(void)
+static int db_init_statements(struct smsdb_shard* shard)
 {
     /* Don't initialize create_smsdb_statement here as the smsdb table needs to exist
      * brefore these statements can be initialized */
     return INIT_STMT(get_incomingmsg) || INIT_STMT(put_incomingmsg) || INIT_STMT(del_incomingmsg) || INIT_STMT(get_incomingmsg_cnt) ||
            INIT_STMT(put_outgoingref) || INIT_STMT(set_outgoingref) || INIT_STMT(get_outgoingref) || INIT_STMT(put_outgoingmsg) ||
            INIT_STMT(put_outgoingpart) || INIT_STMT(del_outgoingmsg) || INIT_STMT(del_outgoingpart) || INIT_STMT(get_outgoingmsg_key) ||
-           INIT_STMT(get_outgoingpart) || INIT_STMT(set_outgoingpart) || INIT_STMT(cnt_outgoingpart) || INIT_STMT(cnt_all_outgoingpart) ||
-           INIT_STMT(get_outgoingmsg) || INIT_STMT(get_all_status) || INIT_STMT(get_outgoingmsg_expired);
+           INIT_STMT(set_outgoingmsg_status) || INIT_STMT(cnt_all_outgoingpart) || INIT_STMT(get_outgoingmsg) || INIT_STMT(get_outgoingmsg_expired) ||
+           INIT_STMT(get_outgoingmsg_next) || INIT_STMT(put_outgoingmsg_uid) || INIT_STMT(put_outgoingref_id) || INIT_STMT(get_incomingmsg_keys);
 }
 
-static void db_clean_statements(void)
+static void db_clean_statements(struct smsdb_shard* shard)
 {
+    CLEAN_STMT(begin_transaction);
+    CLEAN_STMT(commit_transaction);
+    CLEAN_STMT(rollback_transaction);
+    CLEAN_STMT(begin_write);
+    CLEAN_STMT(end_write);
+    CLEAN_STMT(rollback_write);
     CLEAN_STMT(get_incomingmsg);
     CLEAN_STMT(get_incomingmsg_cnt);
     CLEAN_STMT(put_incomingmsg);
@@ -249,13 +920,14 @@ static void db_clean_statements(void)
     CLEAN_STMT(del_outgoingmsg);
     CLEAN_STMT(del_outgoingpart);
     CLEAN_STMT(get_outgoingmsg_key);
-    CLEAN_STMT(set_outgoingpart);
-    CLEAN_STMT(get_outgoingpart);
-    CLEAN_STMT(cnt_outgoingpart);
+    CLEAN_STMT(set_outgoingmsg_status);
     CLEAN_STMT(cnt_all_outgoingpart);
     CLEAN_STMT(get_outgoingmsg);
-    CLEAN_STMT(get_all_status);
     CLEAN_STMT(get_outgoingmsg_expired);
+    CLEAN_STMT(get_outgoingmsg_next);
+    CLEAN_STMT(put_outgoingmsg_uid);
+    CLEAN_STMT(put_outgoingref_id);
+    CLEAN_STMT(get_incomingmsg_keys);
 }
 
 static int db_name_in_memory(const char* db)
@@ -278,459 +950,2046 @@ static int db_name_temporary(const char* db)
     return !strncmp(db, SQLITE_TMP_SPECIAL_NAME, STRLEN(SQLITE_TMP_SPECIAL_NAME));
 }
 
-static int db_open_url(const char* url)
+static int db_open_url(struct smsdb_shard* shard, const char* url)
 {
-    if (sqlite3_open(url, &smsdb) != SQLITE_OK) {
-        ast_log(LOG_WARNING, "Unable to open Asterisk database '%s': %s\n", url, sqlite3_errmsg(smsdb));
-        sqlite3_close(smsdb);
+    if (sqlite3_open(url, &shard->db) != SQLITE_OK) {
+        ast_log(LOG_WARNING, "Unable to open Asterisk database '%s': %s\n", url, sqlite3_errmsg(shard->db));
+        sqlite3_close(shard->db);
+        shard->db = NULL;
         return -1;
     }
 
     return 0;
 }
 
-static int db_open(void)
+static int journal_mode_cb(attribute_unused void* arg, int argc, char** argv, attribute_unused char** col)
 {
-    static const size_t DBNAME_DEF_LEN = 32;
-
-    if (db_name_in_memory(CONF_GLOBAL(sms_db))) {
-        return db_open_url(CONF_GLOBAL(sms_db));
-    } else if (db_name_temporary(CONF_GLOBAL(sms_db))) {
-        return db_open_url("");
-    } else {
-        RAII_VAR(struct ast_str*, dbname, ast_str_create(DBNAME_DEF_LEN), ast_free);
-        ast_str_set(&dbname, 0, "%s.sqlite3", CONF_GLOBAL(sms_db));
-        return db_open_url(ast_str_buffer(dbname));
+    if (argc > 0 && argv[0]) {
+        ast_verb(3, "SMSdb journal mode: %s\n", argv[0]);
     }
+    return 0;
 }
 
-static int db_init()
+static int db_tune(struct smsdb_shard* shard)
 {
-    if (smsdb) {
-        return 0;
+    static const size_t PRAGMA_DEF_LEN = 64;
+
+    DEFINE_INTERNAL_SQL_STATEMENT(journal_mode_wal, "PRAGMA journal_mode=WAL")
+    DEFINE_INTERNAL_SQL_STATEMENT(synchronous_normal, "PRAGMA synchronous=NORMAL")
+    DEFINE_INTERNAL_SQL_STATEMENT(cache_size_compact, "PRAGMA cache_size=-256")
+
+    if (CONF_GLOBAL(sms_db_profile) != SMSDB_PROFILE_PERFORMANCE) {
+        /* page cache of every shard is limited to 256 KiB instead of default 2 MiB */
+        return CONF_GLOBAL(memory_profile) == MEMORY_PROFILE_COMPACT ? EXECUTE_STMT(cache_size_compact) : 0;
     }
 
-    if (db_open() || db_create() || db_init_statements()) {
+    /* in-memory database keeps its own journal mode */
+    if (execute_sql(shard, journal_mode_wal_sql, journal_mode_cb, NULL) || EXECUTE_STMT(synchronous_normal)) {
+        return -1;
+    }
+
+    RAII_VAR(struct ast_str*, pragma, ast_str_create(PRAGMA_DEF_LEN), ast_free);
+
+    ast_str_set(&pragma, 0, "PRAGMA mmap_size=%llu", (unsigned long long)CONF_GLOBAL(sms_db_mmap_size) * 1024ull * 1024ull);
+    if (execute_ast_str(shard, pragma)) {
         return -1;
     }
 
+    /* negative value is size in KiB */
+    ast_str_set(&pragma, 0, "PRAGMA cache_size=-%u", CONF_GLOBAL(sms_db_cache_size));
+    return execute_ast_str(shard, pragma);
+}
+
+static int auto_vacuum_cb(void* arg, int argc, char** argv, attribute_unused char** col)
+{
+    if (argc > 0 && argv[0]) {
+        *(int*)arg = atoi(argv[0]);
+    }
     return 0;
 }
 
-/*!
- * \brief Adds a message part into the DB and returns the whole message into 'out' when the message is complete.
- * \param id -- Some ID for the device or so, e.g. the IMSI
- * \param addr -- The sender address
- * \param ref -- The reference ID
- * \param parts -- The total number of messages
- * \param order -- The current message number
- * \param msg -- The current message part
- * \param out -- Output: Only written if parts == cnt
- * \retval <=0 Error
- * \retval >0 Current number of messages in the DB
- */
-int smsdb_put(const char* id, const char* addr, int ref, int parts, int order, const char* msg, struct ast_str** out)
+/* takes effect only before first table is created, existing files keep their mode */
+static int db_auto_vacuum(struct smsdb_shard* shard)
 {
-    int res = 0;
-    int ttl = CONF_GLOBAL(csms_ttl);
+    static const int AUTO_VACUUM_INCREMENTAL = 2;
 
-    RAII_VAR(struct ast_str*, fullkey, ast_str_create(DBKEY_DEF_LEN), ast_free);
-    const int fullkey_len = ast_str_set(&fullkey, 0, "%s/%s/%d/%d", id, addr, ref, parts);
-    if (fullkey_len < 0) {
-        ast_log(LOG_ERROR, "Fail to create key\n");
-        return -1;
-    }
+    DEFINE_INTERNAL_SQL_STATEMENT(auto_vacuum_incremental, "PRAGMA auto_vacuum=INCREMENTAL")
+    DEFINE_INTERNAL_SQL_STATEMENT(get_auto_vacuum, "PRAGMA auto_vacuum")
 
-    SCOPED_TRANSACTION(dbtrans);
+    if (!CONF_GLOBAL(sms_db_maintenance)) {
+        return 0;
+    }
 
-    {
-        SCOPED_STMT(put_incomingmsg);
-        if (bind_ast_str(put_incomingmsg, 1, fullkey) != SQLITE_OK) {
-            ast_log(LOG_WARNING, "Couldn't bind key to stmt: %s\n", sqlite3_errmsg(smsdb));
-            res = -1;
-        } else if (sqlite3_bind_int(put_incomingmsg, 2, order) != SQLITE_OK) {
-            ast_log(LOG_WARNING, "Couldn't bind order to stmt: %s\n", sqlite3_errmsg(smsdb));
-            res = -1;
-        } else if (sqlite3_bind_int(put_incomingmsg, 3, ttl) != SQLITE_OK) {
-            ast_log(LOG_WARNING, "Couldn't bind TTL to stmt: %s\n", sqlite3_errmsg(smsdb));
-            res = -1;
-        } else if (sqlite3_bind_text(put_incomingmsg, 4, msg, -1, SQLITE_TRANSIENT) != SQLITE_OK) {
-            ast_log(LOG_WARNING, "Couldn't bind msg to stmt: %s\n", sqlite3_errmsg(smsdb));
-            res = -1;
-        } else if (sqlite3_step(put_incomingmsg) != SQLITE_DONE) {
-            ast_log(LOG_WARNING, "Couldn't execute statement: %s\n", sqlite3_errmsg(smsdb));
-            res = -1;
-        }
+    int mode = 0;
+    if (EXECUTE_STMT(auto_vacuum_incremental) || execute_sql(shard, get_auto_vacuum_sql, auto_vacuum_cb, &mode)) {
+        return -1;
     }
 
-    {
-        SCOPED_STMT(get_incomingmsg_cnt);
-        if (bind_ast_str(get_incomingmsg_cnt, 1, fullkey) != SQLITE_OK) {
-            ast_log(LOG_WARNING, "Couldn't bind key to stmt: %s\n", sqlite3_errmsg(smsdb));
-            res = -1;
-        } else if (sqlite3_step(get_incomingmsg_cnt) != SQLITE_ROW) {
-            ast_debug(1, "Unable to find key '%s'\n", ast_str_buffer(fullkey));
-            res = -1;
-        }
-        res = sqlite3_column_int(get_incomingmsg_cnt, 0);
+    shard->incremental = mode == AUTO_VACUUM_INCREMENTAL;
+    if (!shard->incremental) {
+        ast_verb(3, "SMSdb%s%s free pages are not released, database was created without incremental vacuum\n", shard->name[0] ? " " : "", shard->name);
     }
+    return 0;
+}
 
-    if (res == parts) {
-        {
-            SCOPED_STMT(get_incomingmsg);
-            if (bind_ast_str(get_incomingmsg, 1, fullkey) != SQLITE_OK) {
-                ast_log(LOG_WARNING, "Couldn't bind key to stmt: %s\n", sqlite3_errmsg(smsdb));
-                res = -1;
-            } else {
-                while (sqlite3_step(get_incomingmsg) == SQLITE_ROW) {
-                    append_ast_str(get_incomingmsg, 0, out);
-                }
-            }
-        }
+/* file of shard is name of main database followed by IMSI */
+static int db_open(struct smsdb_shard* shard)
+{
+    static const size_t DBNAME_DEF_LEN = 32;
 
-        if (res >= 0) {
-            SCOPED_STMT(del_incomingmsg);
-            if (bind_ast_str(del_incomingmsg, 1, fullkey) != SQLITE_OK) {
-                ast_log(LOG_WARNING, "Couldn't bind key to stmt: %s\n", sqlite3_errmsg(smsdb));
-                res = -1;
-            } else if (sqlite3_step(del_incomingmsg) != SQLITE_DONE) {
-                ast_debug(1, "Unable to find key '%s'; Ignoring\n", ast_str_buffer(fullkey));
-            }
+    if (db_name_in_memory(CONF_GLOBAL(sms_db))) {
+        return db_open_url(shard, CONF_GLOBAL(sms_db));
+    } else if (db_name_temporary(CONF_GLOBAL(sms_db))) {
+        return db_open_url(shard, "");
+    } else {
+        RAII_VAR(struct ast_str*, dbname, ast_str_create(DBNAME_DEF_LEN), ast_free);
+        if (ast_strlen_zero(shard->name)) {
+            ast_str_set(&dbname, 0, "%s.sqlite3", CONF_GLOBAL(sms_db));
+        } else {
+            ast_str_set(&dbname, 0, "%s-%s.sqlite3", CONF_GLOBAL(sms_db), shard->name);
         }
+        return db_open_url(shard, ast_str_buffer(dbname));
     }
-
-    return res;
 }
 
-int smsdb_get_refid(const char* id, const char* addr)
+static void db_close(struct smsdb_shard* shard)
 {
-    int res = -1;
+    db_clean_statements(shard);
+    if (shard->db && sqlite3_close(shard->db) == SQLITE_OK) {
+        shard->db = NULL;
+    }
+    ast_cond_destroy(&shard->commit);
+    ast_mutex_destroy(&shard->lock);
+    ast_free(shard);
+}
 
-    SCOPED_TRANSACTION(dbtrans);
-    RAII_VAR(struct ast_str*, fullkey, ast_str_create(DBKEY_DEF_LEN), ast_free);
+static void csms_load_keys(struct smsdb_shard* shard);
+static int async_load(struct smsdb_shard* shard);
 
-    const int fullkey_len = ast_str_set(&fullkey, 0, "%s/%s", id, addr);
-    if (fullkey_len < 0) {
-        ast_log(LOG_ERROR, "Fail to create key\n");
-        return -1;
+/* shards_lock must be held */
+static struct smsdb_shard* db_init(const char* name)
+{
+    if (shards.count >= SMSDB_SHARDS_MAX) {
+        return NULL;
     }
 
-    int use_insert = 0;
-
-    {
-        SCOPED_STMT(get_outgoingref);
-        if (bind_ast_str(get_outgoingref, 1, fullkey) != SQLITE_OK) {
-            ast_log(LOG_WARNING, "Couldn't bind key to stmt: %s\n", sqlite3_errmsg(smsdb));
-        } else if (sqlite3_step(get_outgoingref) != SQLITE_ROW) {
-            res        = 0;
-            use_insert = 1;
-        } else {
-            res = sqlite3_column_int(get_outgoingref, 0) + 1;
-        }
+    const size_t len                = strlen(name);
+    struct smsdb_shard* const shard = ast_calloc(1, sizeof(*shard) + len + 1u);
+    if (!shard) {
+        return NULL;
     }
 
-    if (res >= 0) {
-        sqlite3_stmt* const outgoingref_stmt = use_insert ? put_outgoingref_stmt : set_outgoingref_stmt;
-        SCOPED_STMT(outgoingref);
-        if (bind_ast_str(outgoingref, 1, fullkey) != SQLITE_OK) {
-            ast_log(LOG_WARNING, "Couldn't bind key to stmt: %s\n", sqlite3_errmsg(smsdb));
+    ast_mutex_init(&shard->lock);
+    ast_cond_init(&shard->commit, NULL);
+    shard->index = shards.count;
+    memcpy(shard->name, name, len + 1u);
+
+    if (db_open(shard) || INIT_STMT(begin_transaction) || INIT_STMT(commit_transaction) || INIT_STMT(rollback_transaction) ||
+        INIT_STMT(begin_write) || INIT_STMT(end_write) || INIT_STMT(rollback_write) || db_tune(shard) || db_auto_vacuum(shard) || db_create(shard) ||
+        db_init_statements(shard)) {
+        db_close(shard);
+        return NULL;
+    }
+
+    shards.shard[shards.count++] = shard;
+
+    if (CONF_GLOBAL(sms_db_csms_cache)) {
+        csms_load_keys(shard);
+    }
+    if (CONF_GLOBAL(sms_db_async)) {
+        async_load(shard);
+    }
+
+    if (shard->index) {
+        ast_verb(3, "SMSdb shard of IMSI %s opened\n", shard->name);
+    }
+    return shard;
+}
+
+/* shard of device, opened on first use */
+static struct smsdb_shard* db_shard(const char* id)
+{
+    SCOPED_MUTEX(shards_lock_scope, &shards_lock);
+
+    if (!shards.enabled || ast_strlen_zero(id)) {
+        return shards.shard[0];
+    }
+
+    for (unsigned int i = 1; i < shards.count; ++i) {
+        if (!strcmp(shards.shard[i]->name, id)) {
+            return shards.shard[i];
+        }
+    }
+
+    struct smsdb_shard* const shard = db_init(id);
+    if (!shard) {
+        ast_log(LOG_WARNING, "Unable to open SMSdb shard of IMSI %s, using main database\n", id);
+        return shards.shard[0];
+    }
+    return shard;
+}
+
+/* UID of message in main database is its row, so UIDs issued before sharding was enabled stay valid */
+static int64_t db_uid(const struct smsdb_shard* shard, int row) { return ((int64_t)shard->index << SMSDB_UID_ROW_BITS) | (uint32_t)row; }
+
+static int db_uid_row(int64_t uid) { return (int)(uid & UINT32_MAX); }
+
+/* shard of message, NULL if UID does not belong to any */
+static struct smsdb_shard* db_uid_shard(int64_t uid)
+{
+    const uint64_t index = uid >= 0 ? (uint64_t)uid >> SMSDB_UID_ROW_BITS : 0u;
+
+    SCOPED_MUTEX(shards_lock_scope, &shards_lock);
+    return index < shards.count ? shards.shard[index] : NULL;
+}
+
+/* name of shard file is IMSI, other files like backups are not shards */
+static int db_name_imsi(const char* name, size_t len)
+{
+    if (len < 5u || len > 15u) {
+        return 0;
+    }
+
+    for (size_t i = 0; i < len; ++i) {
+        if (name[i] < '0' || name[i] > '9') {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/* open shards stored on previous run */
+static void db_load_shards()
+{
+    static const char SHARD_SUFFIX[] = ".sqlite3";
+
+    const char* const path = CONF_GLOBAL(sms_db);
+    if (db_name_in_memory(path) || db_name_temporary(path)) {
+        return;
+    }
+
+    const char* const slash = strrchr(path, '/');
+    const char* const base  = slash ? slash + 1 : path;
+    const size_t base_len   = strlen(base);
+    RAII_VAR(char*, dir, slash ? ast_strndup(path, (size_t)(slash - path) + 1u) : ast_strdup("."), ast_free);
+    if (!dir) {
+        return;
+    }
+
+    DIR* const d = opendir(dir);
+    if (!d) {
+        return;
+    }
+
+    struct dirent* de;
+    while ((de = readdir(d))) {
+        const size_t len = strlen(de->d_name);
+        if (len <= base_len + 1u + STRLEN(SHARD_SUFFIX) || strncmp(de->d_name, base, base_len) || de->d_name[base_len] != '-' ||
+            strcmp(de->d_name + len - STRLEN(SHARD_SUFFIX), SHARD_SUFFIX) ||
+            !db_name_imsi(de->d_name + base_len + 1u, len - base_len - 1u - STRLEN(SHARD_SUFFIX))) {
+            continue;
+        }
+
+        RAII_VAR(char*, name, ast_strndup(de->d_name + base_len + 1u, len - base_len - 1u - STRLEN(SHARD_SUFFIX)), ast_free);
+        if (name && !db_init(name)) {
+            ast_log(LOG_WARNING, "Unable to open SMSdb shard '%s'\n", de->d_name);
+        }
+    }
+
+    closedir(d);
+}
+
+static int db_incoming_insert(struct smsdb_shard* shard, const struct smsdb_inkey* const key, int order, const char* msg)
+{
+    const int ttl = CONF_GLOBAL(csms_ttl);
+
+    SCOPED_STMT(put_incomingmsg);
+    if (bind_inkey(put_incomingmsg, 1, key) != SQLITE_OK) {
+        ast_log(LOG_WARNING, "Couldn't bind key to stmt: %s\n", sqlite3_errmsg(shard->db));
+        return -1;
+    } else if (sqlite3_bind_int(put_incomingmsg, 5, order) != SQLITE_OK) {
+        ast_log(LOG_WARNING, "Couldn't bind order to stmt: %s\n", sqlite3_errmsg(shard->db));
+        return -1;
+    } else if (sqlite3_bind_int(put_incomingmsg, 6, ttl) != SQLITE_OK) {
+        ast_log(LOG_WARNING, "Couldn't bind TTL to stmt: %s\n", sqlite3_errmsg(shard->db));
+        return -1;
+    } else if (sqlite3_bind_text(put_incomingmsg, 7, msg, -1, SQLITE_TRANSIENT) != SQLITE_OK) {
+        ast_log(LOG_WARNING, "Couldn't bind msg to stmt: %s\n", sqlite3_errmsg(shard->db));
+        return -1;
+    } else if (sqlite3_step(put_incomingmsg) != SQLITE_DONE) {
+        ast_log(LOG_WARNING, "Couldn't execute statement: %s\n", sqlite3_errmsg(shard->db));
+        return -1;
+    }
+
+    return 0;
+}
+
+static int db_incoming_put(struct smsdb_shard* shard, const struct smsdb_inkey* const key, int order, const char* msg, struct ast_str** out)
+{
+    int res = 0;
+
+    {
+        SCOPED_TRANSACTION(dbtrans, res);
+
+        if (db_incoming_insert(shard, key, order, msg)) {
+            res = -1;
+        }
+
+        if (res >= 0) {
+            SCOPED_STMT(get_incomingmsg_cnt);
+            if (bind_inkey(get_incomingmsg_cnt, 1, key) != SQLITE_OK) {
+                ast_log(LOG_WARNING, "Couldn't bind key to stmt: %s\n", sqlite3_errmsg(shard->db));
+                res = -1;
+            } else if (sqlite3_step(get_incomingmsg_cnt) != SQLITE_ROW) {
+                ast_debug(1, "Unable to find key '%s/%s/%d/%d'\n", key->dev, key->addr, key->ref, key->parts);
+                res = -1;
+            } else {
+                res = sqlite3_column_int(get_incomingmsg_cnt, 0);
+            }
+        }
+
+        if (res == key->parts) {
+            {
+                SCOPED_STMT(get_incomingmsg);
+                if (bind_inkey(get_incomingmsg, 1, key) != SQLITE_OK) {
+                    ast_log(LOG_WARNING, "Couldn't bind key to stmt: %s\n", sqlite3_errmsg(shard->db));
+                    res = -1;
+                } else {
+                    while (sqlite3_step(get_incomingmsg) == SQLITE_ROW) {
+                        append_ast_str(get_incomingmsg, 0, out);
+                    }
+                }
+            }
+
+            if (res >= 0) {
+                SCOPED_STMT(del_incomingmsg);
+                if (bind_inkey(del_incomingmsg, 1, key) != SQLITE_OK) {
+                    ast_log(LOG_WARNING, "Couldn't bind key to stmt: %s\n", sqlite3_errmsg(shard->db));
+                    res = -1;
+                } else if (sqlite3_step(del_incomingmsg) != SQLITE_DONE) {
+                    ast_debug(1, "Unable to find key '%s/%s/%d/%d'; Ignoring\n", key->dev, key->addr, key->ref, key->parts);
+                }
+            }
+        }
+    }
+
+    return res;
+}
+
+static int db_incoming_cnt(struct smsdb_shard* shard, const struct smsdb_inkey* const key)
+{
+    SCOPED_MUTEX(shard_lock, &shard->lock);
+    SCOPED_STMT(get_incomingmsg_cnt);
+
+    if (bind_inkey(get_incomingmsg_cnt, 1, key) != SQLITE_OK) {
+        ast_log(LOG_WARNING, "Couldn't bind key to stmt: %s\n", sqlite3_errmsg(shard->db));
+        return -1;
+    }
+    return sqlite3_step(get_incomingmsg_cnt) == SQLITE_ROW ? sqlite3_column_int(get_incomingmsg_cnt, 0) : -1;
+}
+
+/* parts received before sharding was enabled stay in main database */
+static struct smsdb_shard* db_incoming_shard(struct smsdb_shard* shard, const struct smsdb_inkey* const key)
+{
+    if (shard->index && db_incoming_cnt(shards.shard[0], key) > 0) {
+        return shards.shard[0];
+    }
+    return shard;
+}
+
+#/* csms_lock must be held by callers of csms_* functions, except csms_write() of pinned entry */
+
+/* FNV-1a of IMSI, address and numbers of key, also used by asynchronous mode */
+static unsigned int attribute_pure key_hash(const char* dev, const char* addr, const int* nums, unsigned int cnt)
+{
+    const char* const strs[] = {dev, addr};
+    unsigned int hash        = 2166136261u;
+
+    for (unsigned int i = 0; i < ARRAY_LEN(strs); ++i) {
+        const char* str = strs[i];
+        do {
+            hash = (hash ^ (unsigned char)*str) * 16777619u;
+        } while (*str++);
+    }
+    for (unsigned int i = 0; i < cnt; ++i) {
+        for (unsigned int j = 0; j < sizeof(int); ++j) {
+            hash = (hash ^ (((unsigned int)nums[i] >> (j * 8u)) & 0xFFu)) * 16777619u;
+        }
+    }
+    return hash;
+}
+
+static unsigned int attribute_pure csms_hash(const struct smsdb_inkey* const key)
+{
+    const int nums[] = {key->ref, key->parts};
+    return key_hash(key->dev, key->addr, nums, ARRAY_LEN(nums));
+}
+
+static struct csms_entry* csms_find(const struct smsdb_inkey* const key, unsigned int hash)
+{
+    struct csms_entry* e;
+
+    AST_LIST_TRAVERSE(&csms_cache.buckets[hash % CSMS_CACHE_BUCKETS], e, entry) {
+        if (e->hash == hash && e->key.ref == key->ref && e->key.parts == key->parts && !strcmp(e->key.dev, key->dev) &&
+            !strcmp(e->key.addr, key->addr)) {
+            return e;
+        }
+    }
+    return NULL;
+}
+
+static struct csms_entry* csms_add(struct smsdb_shard* shard, const struct smsdb_inkey* const key, unsigned int hash, int parts, int stored)
+{
+    const size_t dev_len       = strlen(key->dev) + 1u;
+    const size_t addr_len      = strlen(key->addr) + 1u;
+    struct csms_entry* const e = ast_calloc(1, sizeof(*e) + parts * sizeof(char*) + dev_len + addr_len);
+    if (!e) {
+        return NULL;
+    }
+
+    char* const dev = (char*)&e->part[parts];
+    memcpy(dev, key->dev, dev_len);
+    memcpy(dev + dev_len, key->addr, addr_len);
+
+    e->created  = ast_tvnow();
+    e->hash     = hash;
+    e->parts    = parts;
+    e->stored   = stored ? 1 : 0;
+    e->shard    = shard;
+    e->key      = *key;
+    e->key.dev  = dev;
+    e->key.addr = dev + dev_len;
+
+    AST_LIST_INSERT_HEAD(&csms_cache.buckets[hash % CSMS_CACHE_BUCKETS], e, entry);
+    csms_cache.entries++;
+    return e;
+}
+
+static void csms_drop_parts(struct csms_entry* const e)
+{
+    for (int i = 0; i < e->parts; ++i) {
+        ast_free(e->part[i]);
+        e->part[i] = NULL;
+    }
+    e->cnt = 0;
+}
+
+static void csms_free(struct csms_entry* const e)
+{
+    csms_drop_parts(e);
+    ast_free(e);
+    csms_cache.entries--;
+}
+
+static void csms_remove(struct csms_entry* const e)
+{
+    AST_LIST_REMOVE(&csms_cache.buckets[e->hash % CSMS_CACHE_BUCKETS], e, entry);
+    csms_free(e);
+}
+
+/* pinned entry is not changed or freed by others, csms_lock is released meanwhile */
+static void csms_pin(struct csms_entry* const e)
+{
+    e->busy = 1;
+    ast_mutex_unlock(&csms_lock);
+}
+
+static void csms_unpin(struct csms_entry* const e)
+{
+    ast_mutex_lock(&csms_lock);
+    e->busy = 0;
+    ast_cond_broadcast(&csms_cache.idle);
+}
+
+/* entry of key when no other thread has it pinned */
+static struct csms_entry* csms_find_idle(const struct smsdb_inkey* const key, unsigned int hash)
+{
+    struct csms_entry* e;
+
+    while ((e = csms_find(key, hash)) && e->busy) {
+        ast_cond_wait(&csms_cache.idle, &csms_lock);
+    }
+    return e;
+}
+
+/* entry is pinned, csms_lock is not held */
+static int csms_write(struct csms_entry* const e)
+{
+    struct smsdb_shard* const shard = e->shard;
+    int res                         = 0;
+
+    {
+        SCOPED_TRANSACTION(dbtrans, res);
+
+        for (int i = 0; i < e->parts; ++i) {
+            if (e->part[i] && db_incoming_insert(shard, &e->key, i + 1, e->part[i])) {
+                res = -1;
+                break;
+            }
+        }
+    }
+
+    return res;
+}
+
+/* entry is pinned, result of csms_write() applied with csms_lock held */
+static int csms_stored(struct csms_entry* const e, int res)
+{
+    if (res) {
+        /* parts are kept in memory, stored by next flush */
+        ast_log(LOG_ERROR, "Unable to store incomplete message '%s/%s/%d/%d' with %d/%d parts, retry on next flush\n", e->key.dev, e->key.addr,
+                e->key.ref, e->key.parts, e->cnt, e->parts);
+        return res;
+    }
+
+    ast_debug(1, "Incomplete message '%s/%s/%d/%d' with %d/%d parts stored\n", e->key.dev, e->key.addr, e->key.ref, e->key.parts, e->cnt, e->parts);
+    csms_drop_parts(e);
+    e->stored = 1;
+    return res;
+}
+
+/* move received parts to database, entry stays as marker of key, csms_lock is released while parts are written */
+static int csms_store(struct csms_entry* const e)
+{
+    if (e->stored) {
+        return 0;
+    }
+
+    csms_pin(e);
+    const int res = csms_write(e);
+    csms_unpin(e);
+
+    return csms_stored(e, res);
+}
+
+/* load keys of incomplete messages stored on previous run, takes csms_lock */
+static void csms_load_keys(struct smsdb_shard* shard)
+{
+    SCOPED_MUTEX(csms_cache_lock, &csms_lock);
+    SCOPED_MUTEX(shard_lock, &shard->lock);
+    SCOPED_STMT(get_incomingmsg_keys);
+
+    while (sqlite3_step(get_incomingmsg_keys) == SQLITE_ROW) {
+        const struct smsdb_inkey key = {
+            .dev   = (const char*)sqlite3_column_text(get_incomingmsg_keys, 0),
+            .addr  = (const char*)sqlite3_column_text(get_incomingmsg_keys, 1),
+            .ref   = sqlite3_column_int(get_incomingmsg_keys, 2),
+            .parts = sqlite3_column_int(get_incomingmsg_keys, 3),
+        };
+        if (!key.dev || !key.addr || key.parts <= 0) {
+            continue;
+        }
+
+        const unsigned int hash = csms_hash(&key);
+        if (!csms_find(&key, hash)) {
+            csms_add(shard, &key, hash, 0, 1);
+        }
+    }
+}
+
+static void csms_cache_clean(int store)
+{
+    unsigned int dropped = 0;
+
+    SCOPED_MUTEX(csms_cache_lock, &csms_lock);
+
+    for (unsigned int i = 0; i < CSMS_CACHE_BUCKETS; ++i) {
+        struct csms_entry* e;
+        while ((e = AST_LIST_FIRST(&csms_cache.buckets[i]))) {
+            if (e->busy) {
+                ast_cond_wait(&csms_cache.idle, &csms_lock);
+                continue;
+            }
+            AST_LIST_REMOVE_HEAD(&csms_cache.buckets[i], entry);
+
+            /* there is no next flush, parts failed to store are lost */
+            if (!store || csms_store(e)) {
+                dropped += (unsigned int)e->cnt;
+            }
+            csms_free(e);
+        }
+    }
+    csms_cache.timeout = 0;
+
+    if (dropped) {
+        ast_log(LOG_ERROR, "%u parts of incomplete messages dropped from memory\n", dropped);
+    }
+}
+
+static int smsdb_outgoing_clear_nolock(struct smsdb_shard* shard, int uid)
+{
+    int res = 0;
+
+    {
+        SCOPED_STMT(del_outgoingmsg);
+        if (sqlite3_bind_int(del_outgoingmsg, 1, uid) != SQLITE_OK) {
+            ast_log(LOG_WARNING, "Couldn't bind UID to stmt: %s\n", sqlite3_errmsg(shard->db));
+            res = -1;
+        } else if (sqlite3_step(del_outgoingmsg) != SQLITE_DONE) {
+            res = -1;
+        }
+    }
+
+    {
+        SCOPED_STMT(del_outgoingpart);
+        if (sqlite3_bind_int(del_outgoingpart, 1, uid) != SQLITE_OK) {
+            ast_log(LOG_WARNING, "Couldn't bind UID to stmt: %s\n", sqlite3_errmsg(shard->db));
+            res = -1;
+        } else if (sqlite3_step(del_outgoingpart) != SQLITE_DONE) {
+            res = -1;
+        }
+    }
+
+    return res;
+}
+
+/* last CSMS reference of key stored in shard, -1 if there is none */
+static int db_get_refid(struct smsdb_shard* shard, const char* id, const char* addr)
+{
+    SCOPED_MUTEX(shard_lock, &shard->lock);
+    SCOPED_STMT(get_outgoingref);
+
+    if (bind_dev_addr(get_outgoingref, 1, id, addr) != SQLITE_OK) {
+        ast_log(LOG_WARNING, "Couldn't bind key to stmt: %s\n", sqlite3_errmsg(shard->db));
+        return -1;
+    }
+    return sqlite3_step(get_outgoingref) == SQLITE_ROW ? sqlite3_column_int(get_outgoingref, 0) : -1;
+}
+
+#/* asynchronous mode, async_lock must be held by callers of async_* functions */
+
+static const char* async_copy(char** buf, const char* src)
+{
+    const size_t len = strlen(src) + 1u;
+    char* const dst  = *buf;
+    memcpy(dst, src, len);
+    *buf += len;
+    return dst;
+}
+
+static struct async_ref* async_ref_find(const char* dev, const char* dst, unsigned int hash)
+{
+    struct async_ref* r;
+
+    AST_LIST_TRAVERSE(&async.refs[hash % ASYNC_BUCKETS], r, entry) {
+        if (r->hash == hash && !strcmp(r->dev, dev) && !strcmp(r->dst, dst)) {
+            return r;
+        }
+    }
+    return NULL;
+}
+
+static struct async_msg* async_msg_find(int64_t uid)
+{
+    struct async_msg* m;
+
+    AST_LIST_TRAVERSE(&async.msgs[(uint64_t)uid % ASYNC_BUCKETS], m, entry) {
+        if (m->uid == uid) {
+            return m;
+        }
+    }
+    return NULL;
+}
+
+static struct async_msg* async_msg_add(struct smsdb_shard* shard, int64_t uid, const char* dev, const char* dst, const char* msg, int cnt, time_t expiration, int srr)
+{
+    if (cnt <= 0) {
+        return NULL;
+    }
+
+    struct async_msg* const m = ast_calloc(1, sizeof(*m) + cnt * sizeof(m->parts[0]) + strlen(dev) + strlen(dst) + strlen(msg) + 3u);
+    if (!m) {
+        return NULL;
+    }
+
+    char* buf     = (char*)&m->parts[cnt];
+    m->shard      = shard;
+    m->uid        = uid;
+    m->expiration = expiration;
+    m->cnt        = cnt;
+    m->srr        = srr;
+    m->dev        = async_copy(&buf, dev);
+    m->dst        = async_copy(&buf, dst);
+    m->msg        = async_copy(&buf, msg);
+
+    AST_LIST_INSERT_HEAD(&async.msgs[(uint64_t)uid % ASYNC_BUCKETS], m, entry);
+    return m;
+}
+
+/* message is already removed from its bucket */
+static void async_msg_free(struct async_msg* const m)
+{
+    for (int i = 0; i < m->sent; ++i) {
+        AST_LIST_REMOVE(&async.parts[m->parts[i].hash % ASYNC_BUCKETS], &m->parts[i], entry);
+    }
+    ast_free(m);
+}
+
+static void async_msg_remove(struct async_msg* const m)
+{
+    AST_LIST_REMOVE(&async.msgs[(uint64_t)m->uid % ASYNC_BUCKETS], m, entry);
+    async_msg_free(m);
+}
+
+static struct async_part* async_part_find(const char* dev, const char* dst, int refid, unsigned int hash)
+{
+    struct async_part* p;
+
+    AST_LIST_TRAVERSE(&async.parts[hash % ASYNC_BUCKETS], p, entry) {
+        if (p->hash == hash && p->refid == refid && !strcmp(p->msg->dev, dev) && !strcmp(p->msg->dst, dst)) {
+            return p;
+        }
+    }
+    return NULL;
+}
+
+static struct async_part* async_part_add(struct async_msg* const m, int refid, unsigned int hash, int status)
+{
+    if (m->sent >= m->cnt) {
+        return NULL;
+    }
+
+    struct async_part* const p = &m->parts[m->sent++];
+    p->msg                     = m;
+    p->hash                    = hash;
+    p->refid                   = refid;
+    p->status                  = status;
+
+    AST_LIST_INSERT_TAIL(&async.parts[hash % ASYNC_BUCKETS], p, entry);
+    return p;
+}
+
+static int async_msg_fill(const struct async_msg* const m, struct ast_str** dst, struct ast_str** msg)
+{
+    if (dst && *dst) {
+        ast_str_set(dst, 0, "%s", m->dst);
+    }
+    if (msg && *msg) {
+        ast_str_set(msg, 0, "%s", m->msg);
+    }
+    return 0;
+}
+
+/* hash of IMSI/DST/MR, primary key of outgoing_part row */
+static unsigned int attribute_pure async_part_hash(const char* dev, const char* dst, int refid) { return key_hash(dev, dst, &refid, 1u); }
+
+/* wait for room of count writes before cache is changed, async_lock is released while waiting */
+static void async_reserve(unsigned int count)
+{
+    while (async.running && async.pending + count > ASYNC_QUEUE_DEPTH) {
+        ast_cond_wait(&async.idle, &async_lock);
+    }
+}
+
+/* queue write, room must be reserved, IMSI/DST of part or reference are taken from message when it is given */
+static int async_queue(enum async_op_type type, struct smsdb_shard* shard, int64_t uid, const char* dev, const char* dst, int mr,
+                       const struct async_msg* const m, int value)
+{
+    if (m) {
+        dev = m->dev;
+        dst = m->dst;
+    }
+
+    const size_t len = (dev ? strlen(dev) + strlen(dst) + 2u : 0u) + (m ? strlen(m->msg) + 1u : 0u);
+
+    struct async_op* const op = ast_calloc(1, sizeof(*op) + len);
+    if (!op) {
+        return -1;
+    }
+
+    char* buf = op->buf;
+    op->type  = type;
+    op->shard = shard;
+    op->uid   = db_uid_row(uid);
+    op->value = value;
+    op->mr    = mr;
+    if (dev) {
+        op->dev = async_copy(&buf, dev);
+        op->dst = async_copy(&buf, dst);
+    }
+    if (m) {
+        op->msg        = async_copy(&buf, m->msg);
+        op->cnt        = m->cnt;
+        op->srr        = m->srr;
+        op->expiration = m->expiration;
+    }
+
+    AST_LIST_INSERT_TAIL(&async.ops, op, entry);
+    if (!async.pending++) {
+        ast_cond_signal(&async.cond);
+    }
+    return 0;
+}
+
+/* shard lock must be held */
+static int async_op_execute(struct smsdb_shard* shard, const struct async_op* const op)
+{
+    int res = SQLITE_OK;
+
+    switch (op->type) {
+        case ASYNC_OP_ADD: {
+            SCOPED_STMT(put_outgoingmsg_uid);
+            if (sqlite3_bind_int(put_outgoingmsg_uid, 1, op->uid) != SQLITE_OK || sqlite3_bind_text(put_outgoingmsg_uid, 2, op->dev, -1, SQLITE_STATIC) != SQLITE_OK ||
+                sqlite3_bind_text(put_outgoingmsg_uid, 3, op->dst, -1, SQLITE_STATIC) != SQLITE_OK ||
+                sqlite3_bind_text(put_outgoingmsg_uid, 4, op->msg, -1, SQLITE_STATIC) != SQLITE_OK || sqlite3_bind_int(put_outgoingmsg_uid, 5, op->cnt) != SQLITE_OK ||
+                sqlite3_bind_int64(put_outgoingmsg_uid, 6, (sqlite3_int64)op->expiration) != SQLITE_OK ||
+                sqlite3_bind_int(put_outgoingmsg_uid, 7, op->srr) != SQLITE_OK || bind_part_status(put_outgoingmsg_uid, 8, op->cnt) != SQLITE_OK ||
+                sqlite3_step(put_outgoingmsg_uid) != SQLITE_DONE) {
+                res = -1;
+            }
+            break;
+        }
+
+        case ASYNC_OP_PART: {
+            SCOPED_STMT(put_outgoingpart);
+            if (sqlite3_bind_int(put_outgoingpart, 1, op->mr) != SQLITE_OK || sqlite3_bind_int(put_outgoingpart, 2, op->uid) != SQLITE_OK ||
+                sqlite3_step(put_outgoingpart) != SQLITE_DONE) {
+                res = -1;
+            }
+            break;
+        }
+
+        case ASYNC_OP_STATUS: {
+            const uint8_t status = (uint8_t)op->value;
+            SCOPED_STMT(set_outgoingmsg_status);
+            if (sqlite3_bind_blob(set_outgoingmsg_status, 1, &status, 1, SQLITE_STATIC) != SQLITE_OK ||
+                bind_dev_addr(set_outgoingmsg_status, 2, op->dev, op->dst) != SQLITE_OK || sqlite3_bind_int(set_outgoingmsg_status, 4, op->mr) != SQLITE_OK) {
+                res = -1;
+            } else {
+                /* part without message row returns nothing */
+                const int step = sqlite3_step(set_outgoingmsg_status);
+                res            = (step == SQLITE_ROW || step == SQLITE_DONE) ? 0 : -1;
+            }
+            break;
+        }
+
+        case ASYNC_OP_CLEAR:
+            res = smsdb_outgoing_clear_nolock(shard, op->uid);
+            break;
+
+        case ASYNC_OP_REFID: {
+            SCOPED_STMT(put_outgoingref_id);
+            if (bind_dev_addr(put_outgoingref_id, 1, op->dev, op->dst) != SQLITE_OK || sqlite3_bind_int(put_outgoingref_id, 3, op->value) != SQLITE_OK ||
+                sqlite3_step(put_outgoingref_id) != SQLITE_DONE) {
+                res = -1;
+            }
+            break;
+        }
+    }
+
+    if (res) {
+        ast_log(LOG_WARNING, "Unable to write queued change of message %d: %s\n", op->uid, sqlite3_errmsg(shard->db));
+    }
+    return res;
+}
+
+/* async_lock must not be held, writes of batch to shard are committed together and failed one is rolled back alone,
+ * returns next write to other shard */
+static const struct async_op* async_execute(const struct async_op* op)
+{
+    struct smsdb_shard* const shard = op->shard;
+
+    SCOPED_MUTEX(shard_lock, &shard->lock);
+
+    for (; op && op->shard == shard; op = AST_LIST_NEXT(op, entry)) {
+        if (!begin_write_nolock(shard, 1)) {
+            end_write_nolock(shard, 1, async_op_execute(shard, op) != 0);
+        }
+    }
+
+    if (!group.window) {
+        group_commit_nolock(shard);
+    }
+    return op;
+}
+
+static void* async_threadproc(attribute_unused void* arg)
+{
+    ast_mutex_lock(&async_lock);
+
+    while (async.pending || async.running) {
+        if (!async.pending) {
+            ast_cond_wait(&async.cond, &async_lock);
+            continue;
+        }
+
+        struct async_ops ops = async.ops;
+        AST_LIST_HEAD_INIT_NOLOCK(&async.ops);
+        async.pending = 0;
+        async.busy    = 1;
+        ast_cond_broadcast(&async.idle);
+        ast_mutex_unlock(&async_lock);
+
+        for (const struct async_op* op = AST_LIST_FIRST(&ops); op;) {
+            op = async_execute(op);
+        }
+
+        struct async_op* op;
+        while ((op = AST_LIST_REMOVE_HEAD(&ops, entry))) {
+            ast_free(op);
+        }
+
+        ast_mutex_lock(&async_lock);
+        async.busy = 0;
+        ast_cond_broadcast(&async.idle);
+    }
+
+    ast_mutex_unlock(&async_lock);
+    return NULL;
+}
+
+/* wait until queued writes are in database, async_lock must not be held */
+static void async_drain()
+{
+    SCOPED_MUTEX(async_lock_scope, &async_lock);
+
+    while (async.pending || async.busy) {
+        ast_cond_wait(&async.idle, &async_lock);
+    }
+}
+
+/* load outgoing messages of shard waiting for parts or reports, takes async_lock */
+static int async_load(struct smsdb_shard* shard)
+{
+    DEFINE_INTERNAL_SQL_STATEMENT(get_outgoingmsg_seq, "SELECT seq FROM sqlite_sequence WHERE name = 'outgoing_msg'")
+    DEFINE_INTERNAL_SQL_STATEMENT(get_outgoingmsg_all, "SELECT uid, dev, dst, message, cnt, expiration, srr FROM outgoing_msg")
+    DEFINE_INTERNAL_SQL_STATEMENT(get_outgoingpart_all,
+                                  "SELECT p.mr, p.msg, m.status FROM outgoing_part p JOIN outgoing_msg m ON m.uid = p.msg ORDER BY p.rowid")
+
+    sqlite3_stmt* stmt = NULL;
+
+    SCOPED_MUTEX(async_lock_scope, &async_lock);
+    SCOPED_MUTEX(shard_lock, &shard->lock);
+
+    if (sqlite3_prepare_v2(shard->db, get_outgoingmsg_seq_sql, -1, &stmt, NULL) != SQLITE_OK) {
+        ast_log(LOG_WARNING, "Couldn't prepare statement '%s': %s\n", get_outgoingmsg_seq_sql, sqlite3_errmsg(shard->db));
+        return -1;
+    }
+    if (sqlite3_step(stmt) == SQLITE_ROW) {
+        shard->last_uid = sqlite3_column_int(stmt, 0);
+    }
+    sqlite3_finalize(stmt);
+
+    if (sqlite3_prepare_v2(shard->db, get_outgoingmsg_all_sql, -1, &stmt, NULL) != SQLITE_OK) {
+        ast_log(LOG_WARNING, "Couldn't prepare statement '%s': %s\n", get_outgoingmsg_all_sql, sqlite3_errmsg(shard->db));
+        return -1;
+    }
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        const int uid = sqlite3_column_int(stmt, 0);
+        async_msg_add(shard, db_uid(shard, uid), S_OR((const char*)sqlite3_column_text(stmt, 1), ""), S_OR((const char*)sqlite3_column_text(stmt, 2), ""),
+                      S_OR((const char*)sqlite3_column_text(stmt, 3), ""), sqlite3_column_int(stmt, 4), (time_t)sqlite3_column_int64(stmt, 5),
+                      sqlite3_column_int(stmt, 6));
+        shard->last_uid = MAX(shard->last_uid, uid);
+    }
+    sqlite3_finalize(stmt);
+
+    if (sqlite3_prepare_v2(shard->db, get_outgoingpart_all_sql, -1, &stmt, NULL) != SQLITE_OK) {
+        ast_log(LOG_WARNING, "Couldn't prepare statement '%s': %s\n", get_outgoingpart_all_sql, sqlite3_errmsg(shard->db));
+        return -1;
+    }
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        const int refid           = sqlite3_column_int(stmt, 0);
+        struct async_msg* const m = async_msg_find(db_uid(shard, sqlite3_column_int(stmt, 1)));
+        if (!m) {
+            continue;
+        }
+        /* parts are added in order of their status bytes */
+        const int status = part_status_get(sqlite3_column_blob(stmt, 2), sqlite3_column_bytes(stmt, 2), m->sent);
+        async_part_add(m, refid, async_part_hash(m->dev, m->dst, refid), status);
+    }
+    sqlite3_finalize(stmt);
+
+    return 0;
+}
+
+/* messages of shards are loaded when they are opened */
+static int async_start()
+{
+    async.running = 1;
+    if (ast_pthread_create_background(&async.thread, NULL, async_threadproc, NULL) < 0) {
+        ast_log(LOG_ERROR, "Unable to create smsdb writer thread, write synchronously\n");
+        async.running = 0;
+        return -1;
+    }
+
+    async.enabled = 1;
+    ast_verb(3, "SMSdb writes outgoing messages asynchronously\n");
+    return 0;
+}
+
+static void async_stop()
+{
+    if (!async.running) {
+        return;
+    }
+
+    /* pending writes are done by thread before it exits */
+    ast_mutex_lock(&async_lock);
+    async.running = 0;
+    ast_cond_signal(&async.cond);
+    ast_cond_broadcast(&async.idle);
+    ast_mutex_unlock(&async_lock);
+
+    pthread_join(async.thread, NULL);
+    async.enabled = 0;
+
+    SCOPED_MUTEX(async_lock_scope, &async_lock);
+    for (unsigned int i = 0; i < ASYNC_BUCKETS; ++i) {
+        struct async_msg* m;
+        while ((m = AST_LIST_REMOVE_HEAD(&async.msgs[i], entry))) {
+            async_msg_free(m);
+        }
+
+        struct async_ref* r;
+        while ((r = AST_LIST_REMOVE_HEAD(&async.refs[i], entry))) {
+            ast_free(r);
+        }
+    }
+}
+
+static int async_get_refid(struct smsdb_shard* shard, const char* id, const char* addr)
+{
+    const unsigned int hash = key_hash(id, addr, NULL, 0u);
+
+    SCOPED_MUTEX(async_lock_scope, &async_lock);
+    async_reserve(1);
+
+    struct async_ref* r = async_ref_find(id, addr, hash);
+    if (r) {
+        r->refid = (r->refid + 1) % 256;
+    } else {
+        /* first message to destination since load, writes of this key can not be queued,
+           references used before sharding was enabled continue from main database */
+        int refid = db_get_refid(shard, id, addr);
+        if (refid < 0 && shard->index) {
+            refid = db_get_refid(shards.shard[0], id, addr);
+        }
+        refid = (refid + 1) % 256;
+
+        r = ast_calloc(1, sizeof(*r) + strlen(id) + strlen(addr) + 2u);
+        if (!r) {
+            return -1;
+        }
+        char* buf = r->buf;
+        r->hash   = hash;
+        r->refid  = refid;
+        r->dev    = async_copy(&buf, id);
+        r->dst    = async_copy(&buf, addr);
+        AST_LIST_INSERT_HEAD(&async.refs[hash % ASYNC_BUCKETS], r, entry);
+    }
+
+    if (async_queue(ASYNC_OP_REFID, shard, 0, id, addr, 0, NULL, r->refid)) {
+        return -1;
+    }
+    return r->refid;
+}
+
+static int64_t async_outgoing_add(struct smsdb_shard* shard, const char* id, const char* addr, const char* msg, int cnt, int ttl, int srr)
+{
+    SCOPED_MUTEX(async_lock_scope, &async_lock);
+    async_reserve(1);
+
+    const int64_t uid                   = db_uid(shard, shard->last_uid + 1);
+    const struct async_msg* const m = async_msg_add(shard, uid, id, addr, msg, cnt, time(NULL) + ttl, srr);
+    if (!m) {
+        return -1;
+    }
+
+    shard->last_uid++;
+    if (async_queue(ASYNC_OP_ADD, shard, uid, NULL, NULL, 0, m, 0)) {
+        return -1;
+    }
+    return uid;
+}
+
+static ssize_t async_outgoing_clear(int64_t uid, struct ast_str** dst, struct ast_str** msg)
+{
+    SCOPED_MUTEX(async_lock_scope, &async_lock);
+    async_reserve(1);
+
+    struct async_msg* const m = async_msg_find(uid);
+    if (!m) {
+        return -1;
+    }
+
+    struct smsdb_shard* const shard = m->shard;
+    async_msg_fill(m, dst, msg);
+    async_msg_remove(m);
+    return async_queue(ASYNC_OP_CLEAR, shard, uid, NULL, NULL, 0, NULL, 0);
+}
+
+static ssize_t async_outgoing_part_put(int64_t uid, int refid, struct ast_str** dst, struct ast_str** msg)
+{
+    SCOPED_MUTEX(async_lock_scope, &async_lock);
+    async_reserve(2);
+
+    struct async_msg* const m = async_msg_find(uid);
+    if (!m) {
+        return -2;
+    }
+
+    /* key of part is unique like primary key of outgoing_part */
+    const unsigned int hash = async_part_hash(m->dev, m->dst, refid);
+    if (async_part_find(m->dev, m->dst, refid, hash) || !async_part_add(m, refid, hash, -1)) {
+        return -1;
+    }
+
+    if (async_queue(ASYNC_OP_PART, m->shard, uid, NULL, NULL, refid, NULL, 0)) {
+        return -1;
+    }
+
+    if (!m->srr || m->sent != m->cnt) {
+        return -2;
+    }
+
+    struct smsdb_shard* const shard = m->shard;
+    async_msg_fill(m, dst, msg);
+    async_msg_remove(m);
+    return async_queue(ASYNC_OP_CLEAR, shard, uid, NULL, NULL, 0, NULL, 0);
+}
+
+static ssize_t async_outgoing_part_status(const char* id, const char* addr, int mr, int st, uint8_t* status_all)
+{
+    SCOPED_MUTEX(async_lock_scope, &async_lock);
+    async_reserve(2);
+
+    struct async_part* const p = async_part_find(id, addr, mr, async_part_hash(id, addr, mr));
+    if (!p) {
+        return -1;
+    }
+
+    p->status = st;
+    if (async_queue(ASYNC_OP_STATUS, p->msg->shard, p->msg->uid, id, addr, mr, NULL, st)) {
+        return -1;
+    }
+
+    struct async_msg* const m = p->msg;
+    int done                  = 0;
+    for (int i = 0; i < m->sent; ++i) {
+        done += part_status_final(m->parts[i].status);
+    }
+    if (done != m->cnt) {
+        return -2;
+    }
+
+    const int cnt = m->sent;
+    for (int i = 0; i < cnt; ++i) {
+        status_all[i] = (uint8_t)m->parts[i].status;
+    }
+
+    struct smsdb_shard* const shard = m->shard;
+    const int64_t uid               = m->uid;
+    async_msg_remove(m);
+    return async_queue(ASYNC_OP_CLEAR, shard, uid, NULL, NULL, 0, NULL, 0) ? -1 : cnt;
+}
+
+static ssize_t async_outgoing_purge(struct smsdb_expired* expired, size_t count)
+{
+    const time_t now = time(NULL);
+    ssize_t res      = 0;
+
+    SCOPED_MUTEX(async_lock_scope, &async_lock);
+    async_reserve((unsigned int)count);
+
+    for (unsigned int i = 0; i < ASYNC_BUCKETS && (size_t)res < count; ++i) {
+        struct async_msg* m;
+        AST_LIST_TRAVERSE_SAFE_BEGIN(&async.msgs[i], m, entry) {
+            if ((size_t)res >= count) {
+                break;
+            }
+            if (m->expiration > now) {
+                continue;
+            }
+
+            struct smsdb_expired* const e   = &expired[res++];
+            struct smsdb_shard* const shard = m->shard;
+            e->uid                          = m->uid;
+            ast_str_set(&e->dev, 0, "%s", m->dev);
+            async_msg_fill(m, &e->dst, &e->msg);
+            AST_LIST_REMOVE_CURRENT(entry);
+            async_msg_free(m);
+            async_queue(ASYNC_OP_CLEAR, shard, e->uid, NULL, NULL, 0, NULL, 0);
+        }
+        AST_LIST_TRAVERSE_SAFE_END;
+    }
+
+    return res;
+}
+
+static int async_outgoing_next_expiration(time_t* expiration)
+{
+    int res = 1;
+
+    SCOPED_MUTEX(async_lock_scope, &async_lock);
+
+    for (unsigned int i = 0; i < ASYNC_BUCKETS; ++i) {
+        const struct async_msg* m;
+        AST_LIST_TRAVERSE(&async.msgs[i], m, entry) {
+            if (res || m->expiration < *expiration) {
+                *expiration = m->expiration;
+                res         = 0;
+            }
+        }
+    }
+
+    return res;
+}
+
+/*!
+ * \brief Adds a message part into the DB and returns the whole message into 'out' when the message is complete.
+ * \param id -- Some ID for the device or so, e.g. the IMSI
+ * \param addr -- The sender address
+ * \param ref -- The reference ID
+ * \param parts -- The total number of messages
+ * \param order -- The current message number
+ * \param msg -- The current message part
+ * \param out -- Output: Only written if parts == cnt
+ * \param durable -- Part is committed to DB with parts kept in memory, its copy on device is deleted
+ * \retval <=0 Error
+ * \retval >0 Current number of messages in the DB
+ * \note Parts are kept in memory while message may be completed soon and moved to DB by smsdb_csms_flush().
+ */
+int smsdb_put(const char* id, const char* addr, int ref, int parts, int order, const char* msg, struct ast_str** out, int durable)
+{
+    struct smsdb_shard* const shard = db_shard(id);
+    const struct smsdb_inkey key    = {.dev = id, .addr = addr, .ref = ref, .parts = parts};
+
+    if (!csms_cache.timeout || order < 1 || order > parts) {
+        return db_incoming_put(db_incoming_shard(shard, &key), &key, order, msg, out);
+    }
+
+    const unsigned int hash = csms_hash(&key);
+
+    ast_mutex_lock(&csms_lock);
+    struct csms_entry* e = csms_find_idle(&key, hash);
+
+    if (!e) {
+        e = durable ? csms_add(shard, &key, hash, 0, 1) : csms_add(shard, &key, hash, parts, 0);
+        if (!e) {
+            ast_mutex_unlock(&csms_lock);
+            return db_incoming_put(shard, &key, order, msg, out);
+        }
+    }
+
+    if (durable || e->stored) {
+        /* other devices use cache while this part waits for group commit */
+        const int store = !e->stored;
+
+        csms_pin(e);
+        const int written = store ? csms_write(e) : 0;
+        const int res     = written ? -1 : db_incoming_put(e->shard, &key, order, msg, out);
+        csms_unpin(e);
+
+        if (store) {
+            csms_stored(e, written);
+        }
+        if (res == parts) {
+            csms_remove(e);
+        }
+        ast_mutex_unlock(&csms_lock);
+        return res;
+    }
+
+    char* const part = ast_strdup(msg);
+    if (!part) {
+        ast_mutex_unlock(&csms_lock);
+        return -1;
+    }
+
+    if (e->part[order - 1]) {
+        ast_free(e->part[order - 1]);
+    } else {
+        e->cnt++;
+    }
+    e->part[order - 1] = part;
+
+    const int res = e->cnt;
+    if (res == parts) {
+        for (int i = 0; i < parts; ++i) {
+            ast_str_append(out, 0, "%s", e->part[i]);
+        }
+        csms_remove(e);
+    }
+
+    ast_mutex_unlock(&csms_lock);
+    return res;
+}
+
+void smsdb_csms_flush()
+{
+    if (!csms_cache.timeout) {
+        return;
+    }
+
+    if (ast_mutex_trylock(&csms_lock)) {
+        return;
+    }
+
+    const struct timeval now = ast_tvnow();
+    if (ast_tvdiff_ms(csms_cache.next_flush, now) > 0 || !csms_cache.entries) {
+        ast_mutex_unlock(&csms_lock);
+        return;
+    }
+    csms_cache.next_flush = ast_tvadd(now, ast_samp2tv(1, 1));
+
+    const int64_t timeout = (int64_t)csms_cache.timeout * 1000;
+    const int64_t ttl     = (int64_t)CONF_GLOBAL(csms_ttl) * 1000;
+
+    struct csms_entry* due[CSMS_FLUSH_MAX];
+    unsigned int cnt = 0;
+
+    for (unsigned int i = 0; i < CSMS_CACHE_BUCKETS; ++i) {
+        struct csms_entry* e;
+        AST_LIST_TRAVERSE_SAFE_BEGIN(&csms_cache.buckets[i], e, entry) {
+            const int64_t age = ast_tvdiff_ms(now, e->created);
+            if (e->busy) {
+                continue;
+            } else if (e->stored) {
+                if (age >= ttl) {
+                    AST_LIST_REMOVE_CURRENT(entry);
+                    csms_free(e);
+                }
+            } else if (age >= timeout && cnt < CSMS_FLUSH_MAX) {
+                e->busy    = 1;
+                due[cnt++] = e;
+            }
+        }
+        AST_LIST_TRAVERSE_SAFE_END;
+    }
+
+    /* pinned entries are written without csms_lock, devices keep using cache */
+    if (cnt) {
+        int written[CSMS_FLUSH_MAX];
+
+        ast_mutex_unlock(&csms_lock);
+        for (unsigned int i = 0; i < cnt; ++i) {
+            written[i] = csms_write(due[i]);
+        }
+        ast_mutex_lock(&csms_lock);
+
+        for (unsigned int i = 0; i < cnt; ++i) {
+            due[i]->busy = 0;
+            csms_stored(due[i], written[i]);
+        }
+        ast_cond_broadcast(&csms_cache.idle);
+    }
+
+    ast_mutex_unlock(&csms_lock);
+}
+
+int smsdb_get_refid(const char* id, const char* addr)
+{
+    struct smsdb_shard* const shard = db_shard(id);
+
+    if (async.enabled) {
+        return async_get_refid(shard, id, addr);
+    }
+
+    /* references used before sharding was enabled continue from main database */
+    const int legacy = shard->index ? db_get_refid(shards.shard[0], id, addr) : -1;
+    int res          = -1;
+
+    {
+        SCOPED_TRANSACTION(dbtrans, res);
+
+        int use_insert = 0;
+
+        {
+            SCOPED_STMT(get_outgoingref);
+            if (bind_dev_addr(get_outgoingref, 1, id, addr) != SQLITE_OK) {
+                ast_log(LOG_WARNING, "Couldn't bind key to stmt: %s\n", sqlite3_errmsg(shard->db));
+            } else if (sqlite3_step(get_outgoingref) != SQLITE_ROW) {
+                res        = legacy + 1;
+                use_insert = 1;
+            } else {
+                res = sqlite3_column_int(get_outgoingref, 0) + 1;
+            }
+        }
+
+        if (res >= 0 && use_insert && legacy >= 0) {
+            SCOPED_STMT(put_outgoingref_id);
+            if (bind_dev_addr(put_outgoingref_id, 1, id, addr) != SQLITE_OK || sqlite3_bind_int(put_outgoingref_id, 3, res % 256) != SQLITE_OK) {
+                ast_log(LOG_WARNING, "Couldn't bind key to stmt: %s\n", sqlite3_errmsg(shard->db));
+                res = -1;
+            } else if (sqlite3_step(put_outgoingref_id) != SQLITE_DONE) {
+                res = -1;
+            }
+        } else if (res >= 0) {
+            sqlite3_stmt* const outgoingref_stmt = use_insert ? shard->put_outgoingref_stmt : shard->set_outgoingref_stmt;
+            SCOPED_LOCK(outgoingref, outgoingref_stmt, stmt_begin, stmt_end);
+            if (bind_dev_addr(outgoingref, 1, id, addr) != SQLITE_OK) {
+                ast_log(LOG_WARNING, "Couldn't bind key to stmt: %s\n", sqlite3_errmsg(shard->db));
+                res = -1;
+            } else if (sqlite3_step(outgoingref) != SQLITE_DONE) {
+                res = -1;
+            }
+        }
+    }
+
+    return (res >= 0) ? res % 256 : res;
+}
+
+int64_t smsdb_outgoing_add(const char* id, const char* addr, const char* msg, int cnt, int ttl, int srr)
+{
+    struct smsdb_shard* const shard = db_shard(id);
+
+    if (async.enabled) {
+        return async_outgoing_add(shard, id, addr, msg, cnt, ttl, srr);
+    }
+
+    int res     = 0;
+    int64_t uid = -1;
+
+    {
+        SCOPED_TRANSACTION(dbtrans, res);
+        SCOPED_STMT(put_outgoingmsg);
+
+        if (sqlite3_bind_text(put_outgoingmsg, 1, id, strlen(id), SQLITE_TRANSIENT) != SQLITE_OK) {
+            ast_log(LOG_WARNING, "Couldn't bind dev to stmt: %s\n", sqlite3_errmsg(shard->db));
+            res = -1;
+        } else if (sqlite3_bind_text(put_outgoingmsg, 2, addr, strlen(addr), SQLITE_TRANSIENT) != SQLITE_OK) {
+            ast_log(LOG_WARNING, "Couldn't bind destination address to stmt: %s\n", sqlite3_errmsg(shard->db));
+            res = -1;
+        } else if (sqlite3_bind_text(put_outgoingmsg, 3, msg, strlen(msg), SQLITE_TRANSIENT) != SQLITE_OK) {
+            ast_log(LOG_WARNING, "Couldn't bind message to stmt: %s\n", sqlite3_errmsg(shard->db));
+            res = -1;
+        } else if (sqlite3_bind_int(put_outgoingmsg, 4, cnt) != SQLITE_OK) {
+            ast_log(LOG_WARNING, "Couldn't bind count to stmt: %s\n", sqlite3_errmsg(shard->db));
+            res = -1;
+        } else if (sqlite3_bind_int(put_outgoingmsg, 5, ttl) != SQLITE_OK) {
+            ast_log(LOG_WARNING, "Couldn't bind TTL to stmt: %s\n", sqlite3_errmsg(shard->db));
+            res = -1;
+        } else if (sqlite3_bind_int(put_outgoingmsg, 6, srr) != SQLITE_OK) {
+            ast_log(LOG_WARNING, "Couldn't bind SRR to stmt: %s\n", sqlite3_errmsg(shard->db));
+            res = -1;
+        } else if (bind_part_status(put_outgoingmsg, 7, cnt) != SQLITE_OK) {
+            ast_log(LOG_WARNING, "Couldn't bind status to stmt: %s\n", sqlite3_errmsg(shard->db));
+            res = -1;
+        } else if (sqlite3_step(put_outgoingmsg) != SQLITE_DONE) {
+            res = -1;
+        } else {
+            uid = db_uid(shard, (int)sqlite3_last_insert_rowid(shard->db));
+        }
+    }
+
+    return res < 0 ? -1 : uid;
+}
+
+ssize_t smsdb_outgoing_clear(int64_t uid, struct ast_str** dst, struct ast_str** msg)
+{
+    if (async.enabled) {
+        return async_outgoing_clear(uid, dst, msg);
+    }
+
+    struct smsdb_shard* const shard = db_uid_shard(uid);
+    if (!shard) {
+        return -1;
+    }
+
+    const int row = db_uid_row(uid);
+    int res       = 0;
+
+    {
+        SCOPED_TRANSACTION(dbtrans, res);
+
+        {
+            SCOPED_STMT(get_outgoingmsg);
+            if (sqlite3_bind_int(get_outgoingmsg, 1, row) != SQLITE_OK) {
+                ast_log(LOG_WARNING, "Couldn't bind key to stmt: %s\n", sqlite3_errmsg(shard->db));
+                res = -1;
+            } else if (sqlite3_step(get_outgoingmsg) != SQLITE_ROW) {
+                res = -1;
+            } else {
+                set_ast_str(get_outgoingmsg, 0, dst);
+                set_ast_str(get_outgoingmsg, 1, msg);
+            }
+        }
+
+        if (res >= 0 && smsdb_outgoing_clear_nolock(shard, row) < 0) {
+            res = -1;
+        }
+    }
+
+    return res;
+}
+
+ssize_t smsdb_outgoing_part_put(int64_t uid, int refid, struct ast_str** dst, struct ast_str** msg)
+{
+    if (async.enabled) {
+        return async_outgoing_part_put(uid, refid, dst, msg);
+    }
+
+    struct smsdb_shard* const shard = db_uid_shard(uid);
+    if (!shard) {
+        return -2;
+    }
+
+    const int row = db_uid_row(uid);
+    int res       = 0;
+    int srr       = 0;
+
+    {
+        SCOPED_TRANSACTION(dbtrans, res);
+
+        {
+            SCOPED_STMT(get_outgoingmsg_key);
+            if (sqlite3_bind_int(get_outgoingmsg_key, 1, row) != SQLITE_OK) {
+                ast_log(LOG_WARNING, "Couldn't bind UID to stmt: %s\n", sqlite3_errmsg(shard->db));
+                res = -1;
+            } else if (sqlite3_step(get_outgoingmsg_key) != SQLITE_ROW) {
+                res = -2;
+            } else {
+                srr = sqlite3_column_int(get_outgoingmsg_key, 2);
+            }
+        }
+
+        /* IMSI and destination of part are copied from message row */
+        if (res >= 0) {
+            SCOPED_STMT(put_outgoingpart);
+            if (sqlite3_bind_int(put_outgoingpart, 1, refid) != SQLITE_OK) {
+                ast_log(LOG_WARNING, "Couldn't bind reference to stmt: %s\n", sqlite3_errmsg(shard->db));
+                res = -1;
+            } else if (sqlite3_bind_int(put_outgoingpart, 2, row) != SQLITE_OK) {
+                ast_log(LOG_WARNING, "Couldn't bind UID to stmt: %s\n", sqlite3_errmsg(shard->db));
+                res = -1;
+            } else if (sqlite3_step(put_outgoingpart) != SQLITE_DONE) {
+                res = -1;
+            }
+        }
+
+        if (!srr) {
+            res = -2;
+        }
+
+        // if no status report is requested, just count successfully inserted parts
+        // reached the number of parts
+        if (res >= 0) {
+            SCOPED_STMT(cnt_all_outgoingpart);
+            if (sqlite3_bind_int(cnt_all_outgoingpart, 1, row) != SQLITE_OK) {
+                ast_log(LOG_WARNING, "Couldn't bind key to stmt: %s\n", sqlite3_errmsg(shard->db));
+                res = -1;
+            } else if (sqlite3_step(cnt_all_outgoingpart) != SQLITE_ROW) {
+                res = -1;
+            } else {
+                const int cur = sqlite3_column_int(cnt_all_outgoingpart, 0);
+                const int cnt = sqlite3_column_int(cnt_all_outgoingpart, 1);
+                if (cur != cnt) {
+                    res = -2;
+                }
+            }
+        }
+
+        // get dst
+        if (res >= 0) {
+            SCOPED_STMT(get_outgoingmsg);
+            if (sqlite3_bind_int(get_outgoingmsg, 1, row) != SQLITE_OK) {
+                ast_log(LOG_WARNING, "Couldn't bind key to stmt: %s\n", sqlite3_errmsg(shard->db));
+                res = -1;
+            } else if (sqlite3_step(get_outgoingmsg) != SQLITE_ROW) {
+                res = -1;
+            } else {
+                set_ast_str(get_outgoingmsg, 0, dst);
+                set_ast_str(get_outgoingmsg, 1, msg);
+            }
+        }
+
+        // clear if everything is finished
+        if (res >= 0 && smsdb_outgoing_clear_nolock(shard, row) < 0) {
             res = -1;
-        } else if (sqlite3_step(outgoingref) != SQLITE_DONE) {
+        }
+    }
+
+    return res;
+}
+
+/* returns -3 if shard has no such part */
+static ssize_t db_outgoing_part_status(struct smsdb_shard* shard, const char* id, const char* addr, int mr, uint8_t status, uint8_t* status_all)
+{
+    int res = 0, row = 0, cnt = 0;
+
+    {
+        SCOPED_TRANSACTION(dbtrans, res);
+
+        // set status and get status of all parts
+        {
+            SCOPED_STMT(set_outgoingmsg_status);
+            int step = SQLITE_OK;
+            if (sqlite3_bind_blob(set_outgoingmsg_status, 1, &status, 1, SQLITE_STATIC) != SQLITE_OK) {
+                ast_log(LOG_WARNING, "Couldn't bind status to stmt: %s\n", sqlite3_errmsg(shard->db));
+                res = -1;
+            } else if (bind_dev_addr(set_outgoingmsg_status, 2, id, addr) != SQLITE_OK || sqlite3_bind_int(set_outgoingmsg_status, 4, mr) != SQLITE_OK) {
+                ast_log(LOG_WARNING, "Couldn't bind key to stmt: %s\n", sqlite3_errmsg(shard->db));
+                res = -1;
+            } else if ((step = sqlite3_step(set_outgoingmsg_status)) != SQLITE_ROW) {
+                res = step == SQLITE_DONE ? -3 : -1;
+            } else {
+                const uint8_t* const status_msg = sqlite3_column_blob(set_outgoingmsg_status, 2);
+                const int len                   = sqlite3_column_bytes(set_outgoingmsg_status, 2);
+                int done                        = 0;
+
+                row = sqlite3_column_int(set_outgoingmsg_status, 0);
+                cnt = MIN(sqlite3_column_int(set_outgoingmsg_status, 1), SMSDB_PARTS_MAX);
+                for (int i = 0; i < cnt; ++i) {
+                    done += part_status_final(part_status_get(status_msg, len, i));
+                }
+
+                if (done != cnt) {
+                    res = -2;
+                } else {
+                    memcpy(status_all, status_msg, (size_t)cnt);
+                }
+            }
+        }
+
+        // clear if everything is finished
+        if (res >= 0 && smsdb_outgoing_clear_nolock(shard, row) < 0) {
             res = -1;
         }
     }
 
-    return (res >= 0) ? res % 256 : res;
+    return res < 0 ? res : cnt;
 }
 
-int smsdb_outgoing_add(const char* id, const char* addr, const char* msg, int cnt, int ttl, int srr)
+ssize_t smsdb_outgoing_part_status(const char* id, const char* addr, int mr, int st, uint8_t* status_all)
 {
-    int res = 0;
+    if (async.enabled) {
+        return async_outgoing_part_status(id, addr, mr, st, status_all);
+    }
 
-    SCOPED_TRANSACTION(dbtrans);
-    SCOPED_STMT(put_outgoingmsg);
+    struct smsdb_shard* const shard = db_shard(id);
 
-    if (sqlite3_bind_text(put_outgoingmsg, 1, id, strlen(id), SQLITE_TRANSIENT) != SQLITE_OK) {
-        ast_log(LOG_WARNING, "Couldn't bind dev to stmt: %s\n", sqlite3_errmsg(smsdb));
-        res = -1;
-    } else if (sqlite3_bind_text(put_outgoingmsg, 2, addr, strlen(addr), SQLITE_TRANSIENT) != SQLITE_OK) {
-        ast_log(LOG_WARNING, "Couldn't bind destination address to stmt: %s\n", sqlite3_errmsg(smsdb));
-        res = -1;
-    } else if (sqlite3_bind_text(put_outgoingmsg, 3, msg, strlen(msg), SQLITE_TRANSIENT) != SQLITE_OK) {
-        ast_log(LOG_WARNING, "Couldn't bind message to stmt: %s\n", sqlite3_errmsg(smsdb));
-        res = -1;
-    } else if (sqlite3_bind_int(put_outgoingmsg, 4, cnt) != SQLITE_OK) {
-        ast_log(LOG_WARNING, "Couldn't bind count to stmt: %s\n", sqlite3_errmsg(smsdb));
-        res = -1;
-    } else if (sqlite3_bind_int(put_outgoingmsg, 5, ttl) != SQLITE_OK) {
-        ast_log(LOG_WARNING, "Couldn't bind TTL to stmt: %s\n", sqlite3_errmsg(smsdb));
-        res = -1;
-    } else if (sqlite3_bind_int(put_outgoingmsg, 6, srr) != SQLITE_OK) {
-        ast_log(LOG_WARNING, "Couldn't bind SRR to stmt: %s\n", sqlite3_errmsg(smsdb));
-        res = -1;
-    } else if (sqlite3_step(put_outgoingmsg) != SQLITE_DONE) {
-        res = -1;
-    } else {
-        res = sqlite3_last_insert_rowid(smsdb);
+    ssize_t res = db_outgoing_part_status(shard, id, addr, mr, (uint8_t)st, status_all);
+    if (res == -3 && shard->index) {
+        /* message sent before sharding was enabled */
+        res = db_outgoing_part_status(shards.shard[0], id, addr, mr, (uint8_t)st, status_all);
     }
 
-    return res;
+    return res == -3 ? -1 : res;
 }
 
-static int smsdb_outgoing_clear_nolock(int uid)
+static ssize_t db_outgoing_purge(struct smsdb_shard* shard, struct smsdb_expired* expired, size_t count)
 {
-    int res = 0;
+    ssize_t cnt = 0;
+    int res     = 0;
 
     {
-        SCOPED_STMT(del_outgoingmsg);
-        if (sqlite3_bind_int(del_outgoingmsg, 1, uid) != SQLITE_OK) {
-            ast_log(LOG_WARNING, "Couldn't bind UID to stmt: %s\n", sqlite3_errmsg(smsdb));
-            res = -1;
-        } else if (sqlite3_step(del_outgoingmsg) != SQLITE_DONE) {
-            res = -1;
+        SCOPED_TRANSACTION(dbtrans, res);
+
+        {
+            SCOPED_STMT(get_outgoingmsg_expired);
+            if (sqlite3_bind_int(get_outgoingmsg_expired, 1, (int)count) != SQLITE_OK) {
+                ast_log(LOG_WARNING, "Couldn't bind limit to stmt: %s\n", sqlite3_errmsg(shard->db));
+                res = -1;
+            }
+
+            while (res >= 0 && (size_t)cnt < count && sqlite3_step(get_outgoingmsg_expired) == SQLITE_ROW) {
+                struct smsdb_expired* const e = &expired[cnt++];
+                e->uid                        = sqlite3_column_int(get_outgoingmsg_expired, 0);
+                set_ast_str(get_outgoingmsg_expired, 1, &e->dev);
+                set_ast_str(get_outgoingmsg_expired, 2, &e->dst);
+                set_ast_str(get_outgoingmsg_expired, 3, &e->msg);
+            }
         }
-    }
 
-    {
-        SCOPED_STMT(del_outgoingpart);
-        if (sqlite3_bind_int(del_outgoingpart, 1, uid) != SQLITE_OK) {
-            ast_log(LOG_WARNING, "Couldn't bind UID to stmt: %s\n", sqlite3_errmsg(smsdb));
-            res = -1;
-        } else if (sqlite3_step(del_outgoingpart) != SQLITE_DONE) {
-            res = -1;
+        for (ssize_t i = 0; i < cnt; ++i) {
+            const int row = (int)expired[i].uid;
+            if (smsdb_outgoing_clear_nolock(shard, row) < 0) {
+                res = -1;
+                break;
+            }
+            expired[i].uid = db_uid(shard, row);
         }
     }
 
-    return res;
+    return res < 0 ? res : cnt;
 }
 
-ssize_t smsdb_outgoing_clear(int uid, struct ast_str** dst, struct ast_str** msg)
+ssize_t smsdb_outgoing_purge(struct smsdb_expired* expired, size_t count)
 {
-    int res = 0;
+    if (async.enabled) {
+        return async_outgoing_purge(expired, count);
+    }
 
-    SCOPED_TRANSACTION(dbtrans);
+    const unsigned int shards_cnt = shards_count();
+    ssize_t res                   = 0;
 
-    {
-        SCOPED_STMT(get_outgoingmsg);
-        if (sqlite3_bind_int(get_outgoingmsg, 1, uid) != SQLITE_OK) {
-            ast_log(LOG_WARNING, "Couldn't bind key to stmt: %s\n", sqlite3_errmsg(smsdb));
-            res = -1;
-        } else if (sqlite3_step(get_outgoingmsg) != SQLITE_ROW) {
-            res = -1;
-        } else {
-            set_ast_str(get_outgoingmsg, 0, dst);
-            set_ast_str(get_outgoingmsg, 1, msg);
+    for (unsigned int i = 0; i < shards_cnt && (size_t)res < count; ++i) {
+        const ssize_t purged = db_outgoing_purge(shards.shard[i], expired + res, count - (size_t)res);
+        if (purged < 0) {
+            return res ? res : -1;
         }
+        res += purged;
     }
 
-    if (res >= 0 && smsdb_outgoing_clear_nolock(uid) < 0) {
-        res = -1;
+    return res;
+}
+
+int smsdb_outgoing_next_expiration(time_t* expiration)
+{
+    if (async.enabled) {
+        return async_outgoing_next_expiration(expiration);
+    }
+
+    const unsigned int shards_cnt = shards_count();
+    int res                       = 1;
+
+    for (unsigned int i = 0; i < shards_cnt; ++i) {
+        struct smsdb_shard* const shard = shards.shard[i];
+
+        SCOPED_MUTEX(shard_lock, &shard->lock);
+        SCOPED_STMT(get_outgoingmsg_next);
+        if (sqlite3_step(get_outgoingmsg_next) != SQLITE_ROW) {
+            return -1;
+        } else if (sqlite3_column_type(get_outgoingmsg_next, 0) != SQLITE_NULL) {
+            const time_t next = (time_t)sqlite3_column_int64(get_outgoingmsg_next, 0);
+            if (res || next < *expiration) {
+                *expiration = next;
+                res         = 0;
+            }
+        }
     }
 
     return res;
 }
 
-ssize_t smsdb_outgoing_part_put(int uid, int refid, struct ast_str** dst, struct ast_str** msg)
+/* VACUUM is not allowed within transaction */
+static int db_vacuum_into(struct smsdb_shard* shard, const char* backup_file)
 {
-    int res = 0;
-    int srr = 0;
+    static const size_t SQLSTMT_DEF_LEN = 64;
+
+    if (ast_file_is_readable(backup_file)) {
+        remove(backup_file);
+    }
 
-    SCOPED_TRANSACTION(dbtrans);
+    RAII_VAR(struct ast_str*, sqlstmt, ast_str_create(SQLSTMT_DEF_LEN), ast_free);
+    ast_str_set(&sqlstmt, 0, "VACUUM INTO \"%s\"", backup_file);
 
-    RAII_VAR(struct ast_str*, fullkey, ast_str_create(DBKEY_DEF_LEN), ast_free);
+    SCOPED_MUTEX(shard_lock, &shard->lock);
+    group_commit_nolock(shard);
+    return execute_ast_str(shard, sqlstmt);
+}
 
-    {
-        SCOPED_STMT(get_outgoingmsg_key);
-        if (sqlite3_bind_int(get_outgoingmsg_key, 1, uid) != SQLITE_OK) {
-            ast_log(LOG_WARNING, "Couldn't bind UID to stmt: %s\n", sqlite3_errmsg(smsdb));
-            res = -1;
-        } else if (sqlite3_step(get_outgoingmsg_key) != SQLITE_ROW) {
-            res = -2;
+/* shards are copied next to backup of main database, file name is followed by IMSI */
+int smsdb_vacuum_into(const char* backup_file)
+{
+    static const size_t BACKUP_DEF_LEN = 64;
+
+    /* backup has writes queued before it */
+    if (async.enabled) {
+        async_drain();
+    }
+
+    RAII_VAR(struct ast_str*, shard_file, ast_str_create(BACKUP_DEF_LEN), ast_free);
+    const unsigned int shards_cnt = shards_count();
+    int res                       = 0;
+
+    for (unsigned int i = 0; i < shards_cnt; ++i) {
+        struct smsdb_shard* const shard = shards.shard[i];
+        if (!i) {
+            res |= db_vacuum_into(shard, backup_file);
         } else {
-            const char* dev       = (const char*)sqlite3_column_text(get_outgoingmsg_key, 0);
-            const char* dst       = (const char*)sqlite3_column_text(get_outgoingmsg_key, 1);
-            srr                   = sqlite3_column_int(get_outgoingmsg_key, 2);
-            const int fullkey_len = ast_str_set(&fullkey, 0, "%s/%s/%d", dev, dst, refid);
-            if (fullkey_len < 0) {
-                ast_log(LOG_ERROR, "Unable to create key\n");
-                res = -3;
-            }
+            ast_str_set(&shard_file, 0, "%s-%s", backup_file, shard->name);
+            res |= db_vacuum_into(shard, ast_str_buffer(shard_file));
         }
     }
 
-    if (res >= 0) {
-        SCOPED_STMT(put_outgoingpart);
-        if (bind_ast_str(put_outgoingpart, 1, fullkey) != SQLITE_OK) {
-            ast_log(LOG_WARNING, "Couldn't bind key to stmt: %s\n", sqlite3_errmsg(smsdb));
-            res = -1;
-        } else if (sqlite3_bind_int(put_outgoingpart, 2, uid) != SQLITE_OK) {
-            ast_log(LOG_WARNING, "Couldn't bind UID to stmt: %s\n", sqlite3_errmsg(smsdb));
-            res = -1;
-        } else if (sqlite3_step(put_outgoingpart) != SQLITE_DONE) {
-            res = -1;
-        }
+    return res ? -1 : 0;
+}
+
+#/* */
+
+/* waits between steps of maintenance, returns non-zero when thread is stopping */
+static int maint_pause(unsigned int ms)
+{
+    SCOPED_MUTEX(maint_lock_scope, &maint_lock);
+
+    if (maint.running) {
+        const struct timeval deadline = ast_tvadd(ast_tvnow(), ast_samp2tv(ms, 1000));
+        const struct timespec ts      = {.tv_sec = deadline.tv_sec, .tv_nsec = deadline.tv_usec * 1000l};
+        ast_cond_timedwait(&maint.cond, &maint_lock, &ts);
     }
+    return !maint.running;
+}
+
+/* pages are copied by connection of shard, writes done meanwhile are copied too, no restart is needed */
+static int db_backup_online(struct smsdb_shard* shard, const char* backup_file)
+{
+    static const size_t TMPFILE_DEF_LEN = 64;
+
+    RAII_VAR(struct ast_str*, tmp_file, ast_str_create(TMPFILE_DEF_LEN), ast_free);
+    ast_str_set(&tmp_file, 0, "%s.tmp", backup_file);
+    remove(ast_str_buffer(tmp_file));
 
-    if (!srr) {
-        res = -2;
+    sqlite3* dst = NULL;
+    if (sqlite3_open(ast_str_buffer(tmp_file), &dst) != SQLITE_OK) {
+        ast_log(LOG_WARNING, "Unable to open SMSdb backup '%s': %s\n", ast_str_buffer(tmp_file), sqlite3_errmsg(dst));
+        sqlite3_close(dst);
+        return -1;
     }
 
-    // if no status report is requested, just count successfully inserted parts
-    // reached the number of parts
-    if (res >= 0) {
-        SCOPED_STMT(cnt_all_outgoingpart);
-        if (sqlite3_bind_int(cnt_all_outgoingpart, 1, uid) != SQLITE_OK) {
-            ast_log(LOG_WARNING, "Couldn't bind key to stmt: %s\n", sqlite3_errmsg(smsdb));
-            res = -1;
-        } else if (sqlite3_step(cnt_all_outgoingpart) != SQLITE_ROW) {
-            res = -1;
-        } else {
-            const int cur = sqlite3_column_int(cnt_all_outgoingpart, 0);
-            const int cnt = sqlite3_column_int(cnt_all_outgoingpart, 1);
-            if (cur != cnt) {
-                res = -2;
-            }
-        }
+    sqlite3_backup* backup;
+    {
+        SCOPED_MUTEX(shard_lock, &shard->lock);
+        backup = sqlite3_backup_init(dst, "main", shard->db, "main");
+    }
+    if (!backup) {
+        ast_log(LOG_WARNING, "Unable to start SMSdb backup '%s': %s\n", backup_file, sqlite3_errmsg(dst));
+        sqlite3_close(dst);
+        remove(ast_str_buffer(tmp_file));
+        return -1;
     }
 
-    // get dst
-    if (res >= 0) {
-        SCOPED_STMT(get_outgoingmsg);
-        if (sqlite3_bind_int(get_outgoingmsg, 1, uid) != SQLITE_OK) {
-            ast_log(LOG_WARNING, "Couldn't bind key to stmt: %s\n", sqlite3_errmsg(smsdb));
-            res = -1;
-        } else if (sqlite3_step(get_outgoingmsg) != SQLITE_ROW) {
-            res = -1;
+    int res;
+    do {
+        /* source must not be written by connection while step reads it */
+        ast_mutex_lock(&shard->lock);
+        group_commit_nolock(shard);
+        res = sqlite3_backup_step(backup, MAINT_BACKUP_PAGES);
+        ast_mutex_unlock(&shard->lock);
+    } while ((res == SQLITE_OK || res == SQLITE_BUSY || res == SQLITE_LOCKED) && !maint_pause(MAINT_PAUSE_MS));
+
+    {
+        SCOPED_MUTEX(shard_lock, &shard->lock);
+        sqlite3_backup_finish(backup);
+    }
+
+    if (res != SQLITE_DONE) {
+        ast_log(LOG_WARNING, "SMSdb backup '%s' not completed: %s\n", backup_file, res == SQLITE_OK ? "interrupted" : sqlite3_errstr(res));
+        sqlite3_close(dst);
+        remove(ast_str_buffer(tmp_file));
+        return -1;
+    }
+
+    sqlite3_close(dst);
+    /* previous backup is valid until new one is complete */
+    if (rename(ast_str_buffer(tmp_file), backup_file)) {
+        ast_log(LOG_WARNING, "Unable to rename SMSdb backup '%s': %s\n", ast_str_buffer(tmp_file), strerror(errno));
+        remove(ast_str_buffer(tmp_file));
+        return -1;
+    }
+    return 0;
+}
+
+static void maint_backup(const char* backup_file)
+{
+    static const size_t BACKUP_DEF_LEN = 64;
+
+    /* backup has writes queued before it, caller does not wait for them */
+    if (async.enabled) {
+        async_drain();
+    }
+
+    RAII_VAR(struct ast_str*, shard_file, ast_str_create(BACKUP_DEF_LEN), ast_free);
+    const struct timeval started  = ast_tvnow();
+    const unsigned int shards_cnt = shards_count();
+    int res                       = 0;
+
+    for (unsigned int i = 0; i < shards_cnt; ++i) {
+        struct smsdb_shard* const shard = shards.shard[i];
+        if (!i) {
+            res |= db_backup_online(shard, backup_file);
         } else {
-            set_ast_str(get_outgoingmsg, 0, dst);
-            set_ast_str(get_outgoingmsg, 1, msg);
+            ast_str_set(&shard_file, 0, "%s-%s", backup_file, shard->name);
+            res |= db_backup_online(shard, ast_str_buffer(shard_file));
         }
     }
 
-    // clear if everything is finished
-    if (res >= 0 && smsdb_outgoing_clear_nolock(uid) < 0) {
-        res = -1;
+    if (res) {
+        ast_log(LOG_ERROR, "Unable to create backup of SMS database '%s'\n", backup_file);
+    } else {
+        ast_verb(3, "Backup of SMS database '%s' created in %lld ms\n", backup_file, (long long)ast_tvdiff_ms(ast_tvnow(), started));
+    }
+}
+
+/* one throttled step of maintenance, returns number of removed rows or -1 */
+static int db_maint_delete(struct smsdb_shard* shard, const char* sql)
+{
+    SCOPED_MUTEX(shard_lock, &shard->lock);
+    /* rows of grouped transaction are committed first, deletion is committed at once */
+    group_commit_nolock(shard);
+
+    sqlite3_stmt* stmt = NULL;
+    if (sqlite3_prepare_v2(shard->db, sql, -1, &stmt, NULL) != SQLITE_OK) {
+        ast_log(LOG_WARNING, "Couldn't prepare statement '%s': %s\n", sql, sqlite3_errmsg(shard->db));
+        return -1;
+    }
+
+    int res = -1;
+    if (sqlite3_bind_int(stmt, 1, MAINT_PRUNE_ROWS) != SQLITE_OK) {
+        ast_log(LOG_WARNING, "Couldn't bind limit to stmt: %s\n", sqlite3_errmsg(shard->db));
+    } else if (sqlite3_step(stmt) != SQLITE_DONE) {
+        ast_log(LOG_WARNING, "Error executing SQL (%s): %s\n", sql, sqlite3_errmsg(shard->db));
+    } else {
+        res = sqlite3_changes(shard->db);
     }
 
+    sqlite3_finalize(stmt);
     return res;
 }
 
-ssize_t smsdb_outgoing_part_status(const char* id, const char* addr, int mr, int st, int* status_all)
+static int freelist_count_cb(void* arg, int argc, char** argv, attribute_unused char** col)
+{
+    if (argc > 0 && argv[0]) {
+        *(int*)arg = atoi(argv[0]);
+    }
+    return 0;
+}
+
+/* one throttled step of incremental vacuum, returns number of released pages or -1 */
+static int db_maint_vacuum(struct smsdb_shard* shard, attribute_unused const char* sql)
 {
-    int res = 0, partid, uid;
+    static const size_t PRAGMA_DEF_LEN = 48;
+
+    DEFINE_INTERNAL_SQL_STATEMENT(freelist_count, "PRAGMA freelist_count")
+
+    SCOPED_MUTEX(shard_lock, &shard->lock);
+    group_commit_nolock(shard);
+
+    int pages = 0;
+    if (execute_sql(shard, freelist_count_sql, freelist_count_cb, &pages)) {
+        return -1;
+    }
+    if (pages <= 0) {
+        return 0;
+    }
 
-    RAII_VAR(struct ast_str*, fullkey, ast_str_create(DBKEY_DEF_LEN), ast_free);
-    const int fullkey_len = ast_str_set(&fullkey, 0, "%s/%s/%d", id, addr, mr);
-    if (fullkey_len < 0) {
-        ast_log(LOG_ERROR, "Key length must be less than %zu bytes\n", sizeof(fullkey));
+    RAII_VAR(struct ast_str*, pragma, ast_str_create(PRAGMA_DEF_LEN), ast_free);
+    ast_str_set(&pragma, 0, "PRAGMA incremental_vacuum(%d)", MAINT_VACUUM_PAGES);
+    if (execute_ast_str(shard, pragma)) {
         return -1;
     }
+    return MIN(pages, MAINT_VACUUM_PAGES);
+}
 
-    SCOPED_TRANSACTION(dbtrans);
+/* repeats step while it does full amount of work, returns sum of its results */
+static int maint_steps(struct smsdb_shard* shard, int (*step)(struct smsdb_shard*, const char*), const char* sql, int amount)
+{
+    int total = 0;
 
-    {
-        SCOPED_STMT(get_outgoingpart);
-        if (bind_ast_str(get_outgoingpart, 1, fullkey) != SQLITE_OK) {
-            ast_log(LOG_WARNING, "Couldn't bind key to stmt: %s\n", sqlite3_errmsg(smsdb));
-            res = -1;
-        } else if (sqlite3_step(get_outgoingpart) != SQLITE_ROW) {
-            res = -1;
-        } else {
-            partid = sqlite3_column_int(get_outgoingpart, 0);
-            uid    = sqlite3_column_int(get_outgoingpart, 1);
+    for (unsigned int i = 0; i < MAINT_STEPS_MAX; ++i) {
+        const int res = step(shard, sql);
+        if (res < 0) {
+            break;
+        }
+        total += res;
+        if (res < amount || maint_pause(MAINT_PAUSE_MS)) {
+            break;
         }
     }
+    return total;
+}
 
-    // set status
-    if (res >= 0) {
-        SCOPED_STMT(set_outgoingpart);
-        if (sqlite3_bind_int(set_outgoingpart, 1, st) != SQLITE_OK) {
-            ast_log(LOG_WARNING, "Couldn't bind status to stmt: %s\n", sqlite3_errmsg(smsdb));
-            res = -1;
-        } else if (sqlite3_bind_int(set_outgoingpart, 2, partid) != SQLITE_OK) {
-            ast_log(LOG_WARNING, "Couldn't bind ID to stmt: %s\n", sqlite3_errmsg(smsdb));
-            res = -1;
-        } else if (sqlite3_step(set_outgoingpart) != SQLITE_DONE) {
-            res = -1;
+static void maint_run()
+{
+    /* parts of incomplete messages older than csmsttl are never completed */
+    DEFINE_INTERNAL_SQL_STATEMENT(prune_incomingmsg,
+                                  "DELETE FROM incoming_msg WHERE rowid IN (SELECT rowid FROM incoming_msg WHERE expiration <= unixepoch('now') LIMIT ?)")
+    /* references of messages removed without their parts */
+    DEFINE_INTERNAL_SQL_STATEMENT(prune_outgoingpart,
+                                  "DELETE FROM outgoing_part WHERE rowid IN (SELECT p.rowid FROM outgoing_part p LEFT JOIN outgoing_msg m ON m.uid = p.msg "
+                                  "WHERE m.uid IS NULL LIMIT ?)")
+
+    const unsigned int shards_cnt = shards_count();
+
+    for (unsigned int i = 0; i < shards_cnt; ++i) {
+        struct smsdb_shard* const shard = shards.shard[i];
+
+        const int incoming = maint_steps(shard, db_maint_delete, prune_incomingmsg_sql, MAINT_PRUNE_ROWS);
+        const int parts    = maint_steps(shard, db_maint_delete, prune_outgoingpart_sql, MAINT_PRUNE_ROWS);
+        const int pages    = shard->incremental ? maint_steps(shard, db_maint_vacuum, NULL, MAINT_VACUUM_PAGES) : 0;
+
+        if (incoming || parts || pages) {
+            ast_verb(4, "SMSdb%s%s maintenance: %d stale incoming parts, %d orphaned outgoing parts removed, %d pages released\n", shard->name[0] ? " " : "",
+                     shard->name, incoming, parts, pages);
         }
     }
+}
 
-    // get count
-    if (res >= 0) {
-        SCOPED_STMT(cnt_outgoingpart);
-        if (sqlite3_bind_int(cnt_outgoingpart, 1, uid) != SQLITE_OK) {
-            ast_log(LOG_WARNING, "Couldn't bind key to stmt: %s\n", sqlite3_errmsg(smsdb));
-            res = -1;
-        } else if (sqlite3_step(cnt_outgoingpart) != SQLITE_ROW) {
-            res = -1;
-        } else {
-            const int cur = sqlite3_column_int(cnt_outgoingpart, 0);
-            const int cnt = sqlite3_column_int(cnt_outgoingpart, 1);
-            if (cur != cnt) {
-                res = -2;
-            }
+static void* maint_threadproc(attribute_unused void* arg)
+{
+    char backup_file[PATH_MAX];
+    struct timeval next = ast_tvadd(ast_tvnow(), ast_samp2tv(maint.interval, 1));
+
+    SCOPED_MUTEX(maint_lock_scope, &maint_lock);
+
+    while (maint.running) {
+        if (!ast_strlen_zero(maint.backup)) {
+            ast_copy_string(backup_file, maint.backup, sizeof(backup_file));
+            ast_mutex_unlock(&maint_lock);
+            maint_backup(backup_file);
+            ast_mutex_lock(&maint_lock);
+            maint.backup[0] = '\000';
+            continue;
         }
-    }
 
-    // get status array
-    if (res >= 0) {
-        int i = 0;
-        SCOPED_STMT(get_all_status);
-        if (sqlite3_bind_int(get_all_status, 1, uid) != SQLITE_OK) {
-            ast_log(LOG_WARNING, "Couldn't bind key to stmt: %s\n", sqlite3_errmsg(smsdb));
-            res = -1;
-        } else {
-            while (sqlite3_step(get_all_status) == SQLITE_ROW) {
-                status_all[i++] = sqlite3_column_int(get_all_status, 0);
-            }
+        if (!maint.interval) {
+            ast_cond_wait(&maint.cond, &maint_lock);
+            continue;
         }
-        status_all[i] = -1;
-    }
 
-    // clear if everything is finished
-    if (res >= 0 && smsdb_outgoing_clear_nolock(uid) < 0) {
-        res = -1;
+        if (ast_tvdiff_ms(next, ast_tvnow()) <= 0) {
+            ast_mutex_unlock(&maint_lock);
+            maint_run();
+            ast_mutex_lock(&maint_lock);
+            next = ast_tvadd(ast_tvnow(), ast_samp2tv(maint.interval, 1));
+            continue;
+        }
+
+        const struct timespec ts = {.tv_sec = next.tv_sec, .tv_nsec = next.tv_usec * 1000l};
+        ast_cond_timedwait(&maint.cond, &maint_lock, &ts);
     }
 
-    return res;
+    return NULL;
 }
 
-ssize_t smsdb_outgoing_purge_one(int* uid, struct ast_str** dst, struct ast_str** msg)
+static int maint_start(unsigned int interval)
 {
-    int res = -1;
-
-    SCOPED_TRANSACTION(dbtrans);
+    maint.interval = interval;
+    maint.running  = 1;
+    if (ast_pthread_create_background(&maint.thread, NULL, maint_threadproc, NULL) < 0) {
+        ast_log(LOG_ERROR, "Unable to create smsdb maintenance thread\n");
+        maint.running = 0;
+        return -1;
+    }
 
-    {
-        SCOPED_STMT(get_outgoingmsg_expired);
-        if (sqlite3_step(get_outgoingmsg_expired) != SQLITE_ROW) {
-            res = -1;
-        } else {
-            *uid = sqlite3_column_int(get_outgoingmsg_expired, 0);
-            set_ast_str(get_outgoingmsg_expired, 1, dst);
-            set_ast_str(get_outgoingmsg_expired, 2, msg);
-        }
+    if (interval) {
+        ast_verb(3, "SMSdb maintenance every %u s\n", interval);
     }
+    return 0;
+}
 
-    if (res >= 0 && smsdb_outgoing_clear_nolock(*uid) < 0) {
-        res = -1;
+static void maint_stop()
+{
+    if (!maint.running) {
+        return;
     }
 
-    return res;
+    /* running backup is interrupted, its temporary file is removed */
+    ast_mutex_lock(&maint_lock);
+    maint.running = 0;
+    ast_cond_signal(&maint.cond);
+    ast_mutex_unlock(&maint_lock);
+
+    pthread_join(maint.thread, NULL);
+    maint.backup[0] = '\000';
 }
 
-int smsdb_vacuum_into(const char* backup_file)
+/* backup is done by maintenance thread, shards are copied next to backup of main database */
+int smsdb_backup_online(const char* backup_file)
 {
-    static const size_t SQLSTMT_DEF_LEN = 64;
+    SCOPED_MUTEX(maint_lock_scope, &maint_lock);
 
-    if (ast_file_is_readable(backup_file)) {
-        remove(backup_file);
+    if (!maint.running) {
+        return -1;
+    }
+    if (!ast_strlen_zero(maint.backup)) {
+        ast_log(LOG_NOTICE, "Backup of SMS database '%s' is already in progress\n", maint.backup);
+        return -1;
     }
 
-    RAII_VAR(struct ast_str*, sqlstmt, ast_str_create(SQLSTMT_DEF_LEN), ast_free);
-    ast_str_set(&sqlstmt, 0, "VACUUM INTO \"%s\"", backup_file);
-
-    return execute_ast_str(sqlstmt);
+    ast_copy_string(maint.backup, backup_file, sizeof(maint.backup));
+    ast_cond_signal(&maint.cond);
+    return 0;
 }
 
 /*!
@@ -739,16 +2998,73 @@ int smsdb_vacuum_into(const char* backup_file)
  */
 void smsdb_atexit()
 {
-    db_clean_statements();
-    if (sqlite3_close(smsdb) == SQLITE_OK) {
-        smsdb = NULL;
+    maint_stop();
+    csms_cache_clean(1);
+    async_stop();
+    group_commit_stop();
+
+    SCOPED_MUTEX(shards_lock_scope, &shards_lock);
+    for (unsigned int i = 0; i < shards.count; ++i) {
+        db_close(shards.shard[i]);
+        shards.shard[i] = NULL;
     }
+    shards.count   = 0;
+    shards.enabled = 0;
+
+    ast_cond_destroy(&maint.cond);
+    ast_cond_destroy(&async.idle);
+    ast_cond_destroy(&async.cond);
+    ast_cond_destroy(&group.cond);
+    ast_cond_destroy(&csms_cache.idle);
+}
+
+void smsdb_memory(int64_t* used, int64_t* highwater)
+{
+    *used      = (int64_t)sqlite3_memory_used();
+    *highwater = (int64_t)sqlite3_memory_highwater(0);
 }
 
 int smsdb_init()
 {
-    if (db_init()) {
-        return -1;
+    /* destroyed by smsdb_atexit() */
+    ast_cond_init(&group.cond, NULL);
+    ast_cond_init(&async.cond, NULL);
+    ast_cond_init(&async.idle, NULL);
+    ast_cond_init(&maint.cond, NULL);
+    ast_cond_init(&csms_cache.idle, NULL);
+
+    {
+        SCOPED_MUTEX(shards_lock_scope, &shards_lock);
+        if (shards.count) {
+            return 0;
+        }
+        /* UIDs loaded by shards depend on it */
+        shards.enabled = CONF_GLOBAL(sms_db_shard) == SMSDB_SHARD_IMSI;
+        if (!db_init("")) {
+            shards.enabled = 0;
+            return -1;
+        }
+
+        if (shards.enabled) {
+            db_load_shards();
+            ast_verb(3, "SMSdb keeps messages of every IMSI in own database, %u shards opened\n", shards.count - 1u);
+        }
+    }
+
+    group_commit_start(CONF_GLOBAL(sms_db_group_commit));
+
+    if (CONF_GLOBAL(sms_db_async) && !async.enabled) {
+        async_start();
+    }
+
+    if ((CONF_GLOBAL(sms_db_backup_mode) == SMSDB_BACKUP_ONLINE || CONF_GLOBAL(sms_db_maintenance)) && !maint.running) {
+        maint_start(CONF_GLOBAL(sms_db_maintenance));
+    }
+
+    if (CONF_GLOBAL(sms_db_csms_cache)) {
+        SCOPED_MUTEX(csms_cache_lock, &csms_lock);
+        csms_cache.timeout = CONF_GLOBAL(sms_db_csms_cache);
+        ast_verb(3, "SMSdb keeps incomplete messages in memory for %u s\n", csms_cache.timeout);
     }
 
     return 0;
@@ -5,15 +5,38 @@
 #ifndef CHAN_QUECTEL_SMSDB_H_INCLUDED
 #define CHAN_QUECTEL_SMSDB_H_INCLUDED
 
+#include <stdint.h> /* uint8_t */
+#include <time.h>   /* time_t */
+
+#define SMSDB_PARTS_MAX 255
+
+struct smsdb_expired {
+    int64_t uid;
+    struct ast_str* dev; /*!< IMSI of sending device */
+    struct ast_str* dst;
+    struct ast_str* msg;
+};
+
 int smsdb_init();
 void smsdb_atexit();
-int smsdb_put(const char* id, const char* addr, int ref, int parts, int order, const char* msg, struct ast_str** out);
+int smsdb_put(const char* id, const char* addr, int ref, int parts, int order, const char* msg, struct ast_str** out, int durable);
+void smsdb_csms_flush();
 int smsdb_get_refid(const char* id, const char* addr);
-int smsdb_outgoing_add(const char* id, const char* addr, const char* msg, int cnt, int ttl, int srr);
-ssize_t smsdb_outgoing_clear(int uid, struct ast_str** dst, struct ast_str** msg);
-ssize_t smsdb_outgoing_part_put(int uid, int refid, struct ast_str** dst, struct ast_str** msg);
-ssize_t smsdb_outgoing_part_status(const char* id, const char* addr, int mr, int st, int* status_all);
-ssize_t smsdb_outgoing_purge_one(int* uid, struct ast_str** dst, struct ast_str** msg);
+/* returns UID of message or -1 on error */
+int64_t smsdb_outgoing_add(const char* id, const char* addr, const char* msg, int cnt, int ttl, int srr);
+ssize_t smsdb_outgoing_clear(int64_t uid, struct ast_str** dst, struct ast_str** msg);
+ssize_t smsdb_outgoing_part_put(int64_t uid, int refid, struct ast_str** dst, struct ast_str** msg);
+/* returns number of parts and their TP-ST into status_all (SMSDB_PARTS_MAX bytes) when every part is reported, -2 if not yet or -1 on error */
+ssize_t smsdb_outgoing_part_status(const char* id, const char* addr, int mr, int st, uint8_t* status_all);
+/* remove up to count expired messages, earliest first, strings of entries must be allocated, returns number of removed messages or -1 */
+ssize_t smsdb_outgoing_purge(struct smsdb_expired* expired, size_t count);
+/* returns 0 and earliest expiration (unix time) of outgoing messages, 1 if there are none or -1 on error */
+int smsdb_outgoing_next_expiration(time_t* expiration);
 int smsdb_vacuum_into(const char* backup_file);
+/* queue backup to maintenance thread and return, -1 if thread is not running or backup is in progress */
+int smsdb_backup_online(const char* backup_file);
+
+/* heap bytes used by SQLite now and at most since start */
+void smsdb_memory(int64_t* used, int64_t* highwater);
 
 #endif
@@ -0,0 +1,192 @@
+/*
+   smsexpiry.c
+*/
+#include <inttypes.h> /* PRIi64 */
+
+#include "ast_config.h"
+
+#include <asterisk/json.h>
+#include <asterisk/lock.h>
+#include <asterisk/strings.h>
+#include <asterisk/utils.h>
+
+#include "smsexpiry.h"
+
+#include "chan_quectel.h" /* gpublic CONF_GLOBAL() */
+#include "channel.h"      /* channel_start_local_report() */
+#include "helpers.h"      /* AST_JSON_OBJECT_SET() */
+#include "smsdb.h"
+
+#define SMSEXPIRY_BATCH 32
+
+static const time_t SMSEXPIRY_IDLE      = 60; /* wait without pending messages, seconds */
+static const time_t SMSEXPIRY_CSMS_IDLE = 1;  /* wait while CSMS cache is enabled, seconds */
+
+static struct {
+    ast_mutex_t lock;
+    ast_cond_t cond;                             /*!< signaled on earlier expiration and shutdown */
+    pthread_t thread;                            /*!< expiry thread */
+    time_t next;                                 /*!< earliest known expiration, 0 - none */
+    struct smsdb_expired batch[SMSEXPIRY_BATCH]; /*!< buffers reused by every purge */
+    unsigned int running:1;                      /*!< expiry thread is running */
+} expiry;
+
+#/* */
+
+static void smsexpiry_report(const struct smsdb_expired* e)
+{
+    const char* const imsi = ast_str_buffer(e->dev);
+    struct pvt* pvt;
+
+    AST_RWLIST_RDLOCK(&gpublic->devices);
+    AST_RWLIST_TRAVERSE(&gpublic->devices, pvt, entry) {
+        ast_mutex_lock(&pvt->lock);
+        if (!strcmp(pvt->imsi, imsi)) {
+            break;
+        }
+        ast_mutex_unlock(&pvt->lock);
+    }
+
+    if (!pvt) {
+        AST_RWLIST_UNLOCK(&gpublic->devices);
+        ast_verb(3, "[IMSI:%s][SMS:%" PRIi64 " %s] Expired\n", imsi, e->uid, ast_str_buffer(e->dst));
+        return;
+    }
+
+    ast_verb(3, "[%s][SMS:%" PRIi64 " %s] Expired\n", PVT_ID(pvt), e->uid, ast_str_buffer(e->dst));
+
+    RAII_VAR(struct ast_json*, report, ast_json_object_create(), ast_json_unref);
+    struct ast_str* const msg = e->msg;
+    ast_json_object_set(report, "info", ast_json_string_create("Message expired"));
+    ast_json_object_set(report, "uid", ast_json_integer_create(e->uid));
+    ast_json_object_set(report, "expired", ast_json_integer_create(1));
+    AST_JSON_OBJECT_SET(report, msg);
+    channel_start_local_report(pvt, "sms", LOCAL_REPORT_DIRECTION_OUTGOING, ast_str_buffer(e->dst), NULL, NULL, 0, report);
+
+    ast_mutex_unlock(&pvt->lock);
+    AST_RWLIST_UNLOCK(&gpublic->devices);
+}
+
+/* expiry unlocked */
+static void smsexpiry_purge()
+{
+    ssize_t count;
+
+    do {
+        count = smsdb_outgoing_purge(expiry.batch, SMSEXPIRY_BATCH);
+        for (ssize_t i = 0; i < count; ++i) {
+            smsexpiry_report(&expiry.batch[i]);
+        }
+    } while (count == SMSEXPIRY_BATCH);
+}
+
+static void* smsexpiry_threadproc(attribute_unused void* arg)
+{
+    SCOPED_MUTEX(expiry_lock, &expiry.lock);
+
+    while (expiry.running) {
+        const time_t now = time(NULL);
+        if (expiry.next && expiry.next <= now) {
+            ast_mutex_unlock(&expiry.lock);
+            smsexpiry_purge();
+
+            time_t next = 0;
+            if (smsdb_outgoing_next_expiration(&next)) {
+                next = 0;
+            } else if (next <= now) {
+                next = now + 1; /* purge failed, retry later */
+            }
+            ast_mutex_lock(&expiry.lock);
+
+            /* keep earlier expiration notified while lock was released */
+            if (!expiry.next || expiry.next <= now || (next && next < expiry.next)) {
+                expiry.next = next;
+            }
+            continue;
+        }
+
+        smsdb_csms_flush();
+
+        time_t wakeup = now + (CONF_GLOBAL(sms_db_csms_cache) ? SMSEXPIRY_CSMS_IDLE : SMSEXPIRY_IDLE);
+        if (expiry.next && expiry.next < wakeup) {
+            wakeup = expiry.next;
+        }
+
+        const struct timespec ts = {.tv_sec = wakeup, .tv_nsec = 0};
+        ast_cond_timedwait(&expiry.cond, &expiry.lock, &ts);
+    }
+
+    return NULL;
+}
+
+#/* */
+
+void smsexpiry_notify(int ttl)
+{
+    const time_t expiration = time(NULL) + ttl;
+
+    SCOPED_MUTEX(expiry_lock, &expiry.lock);
+    if (!expiry.next || expiration < expiry.next) {
+        expiry.next = expiration;
+        ast_cond_signal(&expiry.cond);
+    }
+}
+
+int smsexpiry_init()
+{
+    static int initialized = 0;
+
+    if (!initialized) {
+        ast_mutex_init(&expiry.lock);
+        ast_cond_init(&expiry.cond, NULL);
+        initialized = 1;
+    }
+
+    for (unsigned int i = 0; i < SMSEXPIRY_BATCH; ++i) {
+        struct smsdb_expired* const e = &expiry.batch[i];
+        e->dev                        = ast_str_create(32);
+        e->dst                        = ast_str_create(32);
+        e->msg                        = ast_str_create(256);
+        if (!e->dev || !e->dst || !e->msg) {
+            ast_log(LOG_ERROR, "Unable to allocate SMS expiry buffers\n");
+            smsexpiry_fini();
+            return -1;
+        }
+    }
+
+    /* messages stored before restart */
+    if (smsdb_outgoing_next_expiration(&expiry.next)) {
+        expiry.next = 0;
+    }
+
+    expiry.running = 1;
+    if (ast_pthread_create_background(&expiry.thread, NULL, smsexpiry_threadproc, NULL) < 0) {
+        ast_log(LOG_ERROR, "Unable to create SMS expiry thread\n");
+        expiry.running = 0;
+        smsexpiry_fini();
+        return -1;
+    }
+
+    return 0;
+}
+
+void smsexpiry_fini()
+{
+    ast_mutex_lock(&expiry.lock);
+    const int running = expiry.running;
+    expiry.running    = 0;
+    ast_cond_signal(&expiry.cond);
+    ast_mutex_unlock(&expiry.lock);
+
+    if (running) {
+        pthread_join(expiry.thread, NULL);
+    }
+
+    for (unsigned int i = 0; i < SMSEXPIRY_BATCH; ++i) {
+        struct smsdb_expired* const e = &expiry.batch[i];
+        ast_free(e->dev);
+        ast_free(e->dst);
+        ast_free(e->msg);
+        e->dev = e->dst = e->msg = NULL;
+    }
+}
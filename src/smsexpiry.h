@@ -0,0 +1,22 @@
+/*
+   smsexpiry.h
+*/
+#ifndef CHAN_QUECTEL_SMSEXPIRY_H_INCLUDED
+#define CHAN_QUECTEL_SMSEXPIRY_H_INCLUDED
+
+/*
+    Expiry of outgoing SMS
+
+    One thread for all devices sleeps until earliest expiration in SMS database,
+    removes expired messages in batches and starts 'Message expired' report on device
+    the message was sent from. New messages wake thread only when they expire earlier.
+    Thread also flushes incomplete incoming messages of CSMS cache.
+*/
+
+int smsexpiry_init();
+void smsexpiry_fini();
+
+/* message with ttl seconds to live was added to SMS database */
+void smsexpiry_notify(int ttl);
+
+#endif /* CHAN_QUECTEL_SMSEXPIRY_H_INCLUDED */
@@ -4,55 +4,92 @@
 
 SET(SOURCES
     app.c
+    arena.c
     at_command.c
     at_parse.c
     at_queue.c
     at_read.c
+    at_respool.c
+    at_restrie.c
     at_response.c
+    audio_sched.c
+    audio_uring.c
     chan_quectel.c
     channel.c
     char_conv.c
     cli.c
     helpers.c
+    histogram.c
+    manager.c
+    metrics.c
     memmem.c
     ringbuffer.c
     cpvt.c
     dc_config.c
+    devindex.c
     pdu.c
+    pdu_cache.c
+    resample.c
     mixbuffer.c
+    notifyq.c
     pdiscovery.c
+    playout.c
+    poller.c
+    pvt_status.c
     error.c
+    smsbulk.c
     smsdb.c
+    smsexpiry.c
     monitor_thread.c
     tty.c
     pcm.c
+    uac_engine.c
 )
 
 SET(HEADERS
     app.h
+    arena.h
     at_command.h
     at_parse.h
     at_queue.h
     at_read.h
+    at_respool.h
+    at_restrie.h
+    at_tok.h
     at_response.h
+    audio_sched.h
+    audio_uring.h
     chan_quectel.h
     channel.h
     char_conv.h
     cli.h
     helpers.h
+    histogram.h
+    manager.h
+    metrics.h
     memmem.h
     ringbuffer.h
     cpvt.h
     dc_config.h
+    devindex.h
     pdu.h
+    pdu_cache.h
+    resample.h
     mixbuffer.h
+    notifyq.h
     pdiscovery.h
+    playout.h
+    poller.h
+    pvt_status.h
     error.h
+    smsbulk.h
     smsdb.h
+    smsexpiry.h
     mutils.h
     gsm7_luts.h
     ast_config.h
     monitor_thread.h
     tty.h
     pcm.h
+    uac_engine.h
 )
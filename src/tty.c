@@ -53,6 +53,7 @@ int tty_open(const char* dev, int typ)
         const int errno_save = errno;
         tty_close_lck(dev, fd, 0, 0);
         ast_log(LOG_WARNING, "[TTY] Unable to open %s: %s\n", dev, strerror(errno_save));
+        errno = errno_save;
         return -1;
     }
 
@@ -67,6 +68,7 @@ int tty_open(const char* dev, int typ)
     if (locking_status) {
         tty_close_lck(dev, fd, 0, 0);
         ast_verb(1, "Device %s locked.\n", dev);
+        errno = EBUSY;
         return -1;
     }
 
@@ -81,6 +83,7 @@ int tty_open(const char* dev, int typ)
         const int errno_save = errno;
         tty_close_lck(dev, fd, 1, 0);
         ast_log(LOG_WARNING, "[TTY] Unable to flock %s: %s\n", dev, strerror(errno_save));
+        errno = errno_save;
         return -1;
     }
 
@@ -0,0 +1,377 @@
+/*
+   uac_engine.c
+*/
+#include <errno.h>       /* errno */
+#include <poll.h>        /* poll() */
+#include <pthread.h>     /* pthread_setschedparam() */
+#include <sched.h>       /* SCHED_FIFO */
+#include <sys/eventfd.h> /* eventfd() eventfd_read() eventfd_write() */
+
+#include "ast_config.h"
+
+#include <asterisk/logger.h>
+#include <asterisk/utils.h>
+
+#include "uac_engine.h"
+
+#include "chan_quectel.h"
+#include "helpers.h"    /* thread_set_cpus() */
+#include "mutils.h"     /* MIN() */
+#include "ringbuffer.h" /* struct rb_spsc */
+
+/* frames in each ring */
+#define UAC_ENGINE_FRAMES 8u
+
+/* queued playback frames above that are dropped to keep latency bounded */
+#define UAC_ENGINE_DEPTH 3u
+
+struct uac_engine {
+    struct pvt* pvt;           /*!< owner, used for statistics and logs only */
+    snd_pcm_t* icard;          /*!< capture stream */
+    snd_pcm_t* ocard;          /*!< playback stream */
+    unsigned int ochannels;    /*!< channels of playback stream */
+    snd_pcm_uframes_t period;  /*!< samples per frame */
+    snd_pcm_uframes_t prefill; /*!< silence written to playback before start */
+    unsigned int priority;     /*!< SCHED_FIFO priority, 0 - default scheduling */
+
+    int efd; /*!< semaphore eventfd, one count per queued captured frame */
+    int wfd; /*!< eventfd for thread wakeup on shutdown */
+    pthread_t thread;
+
+    struct rb_spsc capture;  /*!< written by engine, read by channel */
+    struct rb_spsc playback; /*!< written by channel, read by engine */
+
+    int16_t* ibuf; /*!< one captured frame */
+    int16_t* obuf; /*!< one interleaved playback frame */
+
+    size_t memory; /*!< size of engine allocation */
+};
+
+static int uac_engine_start(struct uac_engine* const e)
+{
+    const char* const id = PVT_ID(e->pvt);
+
+    snd_pcm_drop(e->icard);
+
+    int res = snd_pcm_prepare(e->icard);
+    PVT_STAT_INC(e->pvt, uac_prepares);
+    if (res < 0) {
+        ast_log(LOG_ERROR, "[%s][ALSA][CAPTURE] Prepare failed - err:'%s'\n", id, snd_strerror(res));
+        return res;
+    }
+
+    if (snd_pcm_state(e->ocard) != SND_PCM_STATE_PREPARED) {
+        res = snd_pcm_prepare(e->ocard);
+        PVT_STAT_INC(e->pvt, uac_prepares);
+        if (res < 0) {
+            ast_log(LOG_ERROR, "[%s][ALSA][PLAYBACK] Prepare failed - err:'%s'\n", id, snd_strerror(res));
+            return res;
+        }
+    }
+
+    memset(e->obuf, 0, e->period * e->ochannels * sizeof(int16_t));
+    for (snd_pcm_uframes_t written = 0; written < e->prefill; written += e->period) {
+        res = snd_pcm_mmap_writei(e->ocard, e->obuf, e->period);
+        if (res < 0) {
+            ast_log(LOG_WARNING, "[%s][ALSA][PLAYBACK] Prefill failed - err:'%s'\n", id, snd_strerror(res));
+            break;
+        }
+    }
+
+    /* streams are linked, playback starts together with capture */
+    if (snd_pcm_state(e->icard) == SND_PCM_STATE_PREPARED) {
+        res = snd_pcm_start(e->icard);
+        if (res < 0) {
+            ast_log(LOG_ERROR, "[%s][ALSA][CAPTURE] Start failed - err:'%s'\n", id, snd_strerror(res));
+            return res;
+        }
+    }
+
+    return 0;
+}
+
+static void uac_engine_recover(struct uac_engine* const e, snd_pcm_t* pcm, int err)
+{
+    if (err == -EPIPE || snd_pcm_state(pcm) == SND_PCM_STATE_XRUN) {
+        PVT_STAT_INC(e->pvt, uac_xruns);
+        ast_debug(4, "[%s][ALSA][%s] XRUN\n", PVT_ID(e->pvt), (pcm == e->icard) ? "CAPTURE" : "PLAYBACK");
+    } else {
+        ast_log(LOG_WARNING, "[%s][ALSA][%s] Restart stream - err:'%s'\n", PVT_ID(e->pvt), (pcm == e->icard) ? "CAPTURE" : "PLAYBACK", snd_strerror(err));
+    }
+
+    uac_engine_start(e);
+}
+
+static int uac_engine_playback(struct uac_engine* const e, snd_pcm_uframes_t samples)
+{
+    const size_t bytes = samples * sizeof(int16_t);
+
+    while (rb_spsc_used(&e->playback) > UAC_ENGINE_DEPTH * e->period * sizeof(int16_t)) {
+        rb_spsc_read_upd(&e->playback, e->period * sizeof(int16_t));
+        PVT_STAT_INC(e->pvt, uac_ring_drops);
+    }
+
+    struct iovec iov[2];
+    const int iovcnt = rb_spsc_read_n_iov(&e->playback, iov, bytes);
+    if (iovcnt) {
+        int16_t* const mono = (e->ochannels == 1u) ? e->obuf : e->ibuf;
+        size_t offset       = 0;
+        for (int i = 0; i < iovcnt; ++i) {
+            memcpy((char*)mono + offset, iov[i].iov_base, iov[i].iov_len);
+            offset += iov[i].iov_len;
+        }
+        rb_spsc_read_upd(&e->playback, bytes);
+
+        /* captured frame is already queued, its buffer is reused for mono samples */
+        if (e->ochannels > 1u) {
+            for (size_t i = 0; i < samples; ++i) {
+                for (unsigned int c = 0; c < e->ochannels; ++c) {
+                    e->obuf[i * e->ochannels + c] = mono[i];
+                }
+            }
+        }
+    } else {
+        memset(e->obuf, 0, samples * e->ochannels * sizeof(int16_t));
+    }
+
+    const snd_pcm_sframes_t res = snd_pcm_mmap_writei(e->ocard, e->obuf, samples);
+    if (res < 0) {
+        if (res != -EAGAIN) {
+            uac_engine_recover(e, e->ocard, (int)res);
+        }
+        return -1;
+    }
+
+    if (iovcnt) {
+        PVT_STAT_ADD(e->pvt, a_write_bytes, res * sizeof(int16_t));
+    } else {
+        PVT_STAT_INC(e->pvt, write_sframes);
+    }
+    return 0;
+}
+
+static void uac_engine_capture(struct uac_engine* const e)
+{
+    while (1) {
+        const snd_pcm_sframes_t avail = snd_pcm_avail_update(e->icard);
+        if (avail < 0) {
+            uac_engine_recover(e, e->icard, (int)avail);
+            return;
+        }
+        if ((snd_pcm_uframes_t)avail < e->period) {
+            return;
+        }
+
+        const snd_pcm_sframes_t res = snd_pcm_mmap_readi(e->icard, e->ibuf, e->period);
+        if (res < 0) {
+            if (res != -EAGAIN) {
+                uac_engine_recover(e, e->icard, (int)res);
+            }
+            return;
+        }
+
+        const struct iovec iov = {.iov_base = e->ibuf, .iov_len = res * sizeof(int16_t)};
+        if (rb_spsc_write_iov(&e->capture, &iov, 1)) {
+            eventfd_write(e->efd, 1);
+        } else {
+            PVT_STAT_INC(e->pvt, uac_ring_drops);
+        }
+
+        if (uac_engine_playback(e, (snd_pcm_uframes_t)res)) {
+            return;
+        }
+    }
+}
+
+static void uac_engine_set_priority(const struct uac_engine* const e)
+{
+    if (!e->priority) {
+        return;
+    }
+
+    const struct sched_param param = {.sched_priority = (int)MIN(e->priority, (unsigned int)sched_get_priority_max(SCHED_FIFO))};
+    const int err                  = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+    if (err) {
+        ast_log(LOG_WARNING, "[%s][ALSA] Unable to set real-time priority %d: %s\n", PVT_ID(e->pvt), param.sched_priority, strerror(err));
+    } else {
+        ast_debug(1, "[%s][ALSA] Audio thread runs with real-time priority %d\n", PVT_ID(e->pvt), param.sched_priority);
+    }
+}
+
+static void* uac_engine_threadproc(void* arg)
+{
+    struct uac_engine* const e = arg;
+
+    uac_engine_set_priority(e);
+    thread_set_cpus(PVT_ID(e->pvt), CONF_GLOBAL(audio_cpus));
+
+    const int count = snd_pcm_poll_descriptors_count(e->icard);
+    if (count <= 0) {
+        ast_log(LOG_ERROR, "[%s][ALSA][CAPTURE] Unable to get a poll descriptors count: %s\n", PVT_ID(e->pvt), snd_strerror(count));
+        return NULL;
+    }
+
+    struct pollfd fds[count + 1];
+    fds[0].fd     = e->wfd;
+    fds[0].events = POLLIN;
+
+    const int res = snd_pcm_poll_descriptors(e->icard, &fds[1], count);
+    if (res < 0) {
+        ast_log(LOG_ERROR, "[%s][ALSA][CAPTURE] Unable to get a poll descriptor(s): %s\n", PVT_ID(e->pvt), snd_strerror(res));
+        return NULL;
+    }
+
+    uac_engine_start(e);
+
+    while (1) {
+        const int n = poll(fds, count + 1, 1000);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            ast_log(LOG_ERROR, "[%s][ALSA] Audio thread poll error: %s\n", PVT_ID(e->pvt), strerror(errno));
+            break;
+        }
+
+        if (fds[0].revents) {
+            break;
+        }
+
+        if (!n) {
+            /* stream stalled */
+            if (snd_pcm_state(e->icard) != SND_PCM_STATE_RUNNING) {
+                uac_engine_recover(e, e->icard, -EIO);
+            }
+            continue;
+        }
+
+        unsigned short revents = 0;
+        if (snd_pcm_poll_descriptors_revents(e->icard, &fds[1], count, &revents) < 0) {
+            continue;
+        }
+
+        if (revents & POLLERR) {
+            uac_engine_recover(e, e->icard, -EPIPE);
+        } else if (revents & POLLIN) {
+            uac_engine_capture(e);
+        }
+    }
+
+    snd_pcm_drop(e->icard);
+    return NULL;
+}
+
+struct uac_engine* uac_engine_create(struct pvt* pvt, unsigned int prefill_ms)
+{
+    const struct ast_format* const fmt = pvt_get_audio_format(pvt);
+    const size_t frame_size            = pvt_get_audio_frame_size(pvt_get_audio_ptime(pvt), fmt);
+    const size_t ring_size             = UAC_ENGINE_FRAMES * frame_size;
+    const unsigned int ochannels       = pvt->ocard_channels ? pvt->ocard_channels : 1u;
+
+    const size_t memory        = sizeof(struct uac_engine) + 2u * ring_size + (1u + ochannels) * frame_size;
+    struct uac_engine* const e = ast_calloc(1, memory);
+    if (!e) {
+        return NULL;
+    }
+    e->memory = memory;
+
+    char* const mem = (char*)(e + 1);
+    rb_spsc_init(&e->capture, mem, ring_size);
+    rb_spsc_init(&e->playback, mem + ring_size, ring_size);
+    e->ibuf = (int16_t*)(mem + 2u * ring_size);
+    e->obuf = (int16_t*)(mem + 2u * ring_size + frame_size);
+
+    e->pvt       = pvt;
+    e->icard     = pvt->icard;
+    e->ocard     = pvt->ocard;
+    e->ochannels = ochannels;
+    e->period    = frame_size / sizeof(int16_t);
+    e->prefill   = (snd_pcm_uframes_t)prefill_ms * ast_format_get_sample_rate(fmt) / 1000u;
+    e->priority  = CONF_UNIQ(pvt, uac_priority);
+
+    e->efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC | EFD_SEMAPHORE);
+    e->wfd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (e->efd < 0 || e->wfd < 0) {
+        goto cleanup;
+    }
+
+    if (ast_pthread_create_background(&e->thread, NULL, uac_engine_threadproc, e) < 0) {
+        goto cleanup;
+    }
+
+    ast_debug(1, "[%s][ALSA] Audio thread started - period:%lu prefill:%lu\n", PVT_ID(pvt), e->period, e->prefill);
+    return e;
+
+cleanup:
+    ast_log(LOG_ERROR, "[%s][ALSA] Unable to start audio thread: %s\n", PVT_ID(pvt), strerror(errno));
+    if (e->wfd >= 0) {
+        close(e->wfd);
+    }
+    if (e->efd >= 0) {
+        close(e->efd);
+    }
+    ast_free(e);
+    return NULL;
+}
+
+/* sound card must be closed after engine */
+void uac_engine_destroy(struct uac_engine* e)
+{
+    if (!e) {
+        return;
+    }
+
+    if (eventfd_write(e->wfd, 1)) {
+        ast_log(LOG_WARNING, "[%s][ALSA] Unable to wake up audio thread: %s\n", PVT_ID(e->pvt), strerror(errno));
+    }
+    pthread_join(e->thread, NULL);
+
+    close(e->wfd);
+    close(e->efd);
+    ast_free(e);
+}
+
+int uac_engine_fd(const struct uac_engine* e) { return e->efd; }
+
+size_t uac_engine_memory(const struct uac_engine* e) { return e->memory; }
+
+void uac_engine_flush(struct uac_engine* e)
+{
+    eventfd_t value;
+    while (!eventfd_read(e->efd, &value)) {
+    }
+    rb_spsc_read_upd(&e->capture, rb_spsc_used(&e->capture));
+}
+
+int uac_engine_read(struct uac_engine* e, void* buf, size_t samples)
+{
+    eventfd_t value;
+    eventfd_read(e->efd, &value);
+
+    const size_t bytes = samples * sizeof(int16_t);
+    struct iovec iov[2];
+    const int iovcnt = rb_spsc_read_n_iov(&e->capture, iov, bytes);
+    if (!iovcnt) {
+        return 0;
+    }
+
+    /* captured samples are little endian, converted to host order while copied */
+    size_t offset = 0;
+    for (int i = 0; i < iovcnt; ++i) {
+        rb_copy_le((char*)buf + offset, iov[i].iov_base, iov[i].iov_len);
+        offset += iov[i].iov_len;
+    }
+    rb_spsc_read_upd(&e->capture, bytes);
+
+    return (int)samples;
+}
+
+int uac_engine_write(struct uac_engine* e, const void* buf, size_t samples)
+{
+    const struct iovec iov = {.iov_base = (void*)buf, .iov_len = samples * sizeof(int16_t)};
+    if (!rb_spsc_write_iov(&e->playback, &iov, 1)) {
+        PVT_STAT_INC(e->pvt, uac_ring_drops);
+        return 0;
+    }
+    return (int)samples;
+}
@@ -0,0 +1,41 @@
+/*
+   uac_engine.h
+*/
+#ifndef CHAN_QUECTEL_UAC_ENGINE_H_INCLUDED
+#define CHAN_QUECTEL_UAC_ENGINE_H_INCLUDED
+
+#include <stddef.h> /* size_t */
+
+struct pvt;
+struct uac_engine;
+
+/*
+    Audio thread of UAC sound card
+
+    Thread sleeps on poll descriptors of capture stream, reads every period and
+    queues it for channel, then writes one period of queued playback audio or silence.
+    Both streams are linked and run from one clock, so playback is paced by capture.
+    Frames are exchanged with channel through lock-free rings, channel thread never
+    calls ALSA and does not need to be scheduled in time of every period.
+*/
+
+/* called with pvt lock held after sound card is opened, returns NULL on error */
+struct uac_engine* uac_engine_create(struct pvt* pvt, unsigned int prefill_ms);
+void uac_engine_destroy(struct uac_engine* e);
+
+/*!< descriptor readable while captured frames are waiting */
+int uac_engine_fd(const struct uac_engine* e);
+
+/*!< number of heap bytes of rings and frames */
+size_t uac_engine_memory(const struct uac_engine* e);
+
+/*!< discard captured frames queued while there was no channel */
+void uac_engine_flush(struct uac_engine* e);
+
+/*!< channel: copy one captured frame, return number of samples or 0 if nothing captured yet */
+int uac_engine_read(struct uac_engine* e, void* buf, size_t samples);
+
+/*!< channel: queue mono frame for playback, return number of samples or 0 if queue is full */
+int uac_engine_write(struct uac_engine* e, const void* buf, size_t samples);
+
+#endif /* CHAN_QUECTEL_UAC_ENGINE_H_INCLUDED */
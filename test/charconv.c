@@ -0,0 +1,421 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+#include <iconv.h>
+#include <ctype.h>
+
+#include "char_conv.h"			/* utf8_to_ucs2() ucs2_to_utf8() hexify() unhex() gsm7_*() */
+#include "gsm7_luts.h"			/* LUT_GSM7_LS16 LUT_GSM7_SS16 */
+#include "mutils.h"			/* ARRAY_LEN() */
+
+
+int ok = 0;
+int faults = 0;
+
+static const char * const texts[] = {
+	"",
+	"A",
+	"Hello, world!",
+	"0123456789ABCDEF",
+	"0123456789ABCDEF0123456789ABCDEF0",
+	"Your balance is 100.50 USD. Thank you for using our services, have a nice day and see you soon!",
+	"\xd0\x9f\xd1\x80\xd0\xb8\xd0\xb2\xd0\xb5\xd1\x82, \xd0\xbc\xd0\xb8\xd1\x80!",
+	"Balance: 100 \xd1\x80\xd1\x83\xd0\xb1. Abcdefghijklmnopqrstuvwxyz \xe2\x82\xac",
+	"\xe4\xbd\xa0\xe5\xa5\xbd\xe4\xb8\x96\xe7\x95\x8c",
+	"smile \xf0\x9f\x98\x80 and \xf0\x9f\x91\x8d end",
+	"\xf4\x8f\xbf\xbf\xef\xbf\xbf\xc2\x80\x7f",
+};
+
+static const char * const bad_utf8[] = {
+	"\xc0\x80",			/* overlong */
+	"\xe0\x80\x80",			/* overlong */
+	"\xed\xa0\x80",			/* surrogate */
+	"\xf4\x90\x80\x80",		/* above U+10FFFF */
+	"\xe2\x82",			/* truncated */
+	"abc\x80",			/* stray continuation */
+	"\xff",
+};
+
+static const uint8_t bad_utf16[][4] = {
+	{ 0xD8, 0x3D, 0x00, 0x41 },	/* high surrogate followed by letter */
+	{ 0xDE, 0x00, 0x00, 0x41 },	/* lone low surrogate */
+	{ 0x00, 0x41, 0xD8, 0x3D },	/* high surrogate at end */
+};
+
+#/* reference implementation, as module did before */
+static ssize_t iconv_ref(const char * in, size_t in_length, char * out, size_t out_size, const char * from, const char * to)
+{
+	char * in_ptr = (char *)in;
+	size_t in_left = in_length;
+	char * out_ptr = out;
+	size_t out_left = out_size - 1;
+	iconv_t cd = iconv_open(to, from);
+	ssize_t res;
+
+	if (cd == (iconv_t)-1) {
+		return -1;
+	}
+	res = iconv(cd, &in_ptr, &in_left, &out_ptr, &out_left);
+	iconv_close(cd);
+	if (res < 0) {
+		return -1;
+	}
+	return out_ptr - out;
+}
+
+#/* */
+static void check(int cond, const char * fmt, const char * arg, ssize_t res, ssize_t expected)
+{
+	fprintf(stderr, fmt, arg);
+	if (cond) {
+		ok++;
+		fprintf(stderr, " = %zd\tOK\n", res);
+	} else {
+		faults++;
+		fprintf(stderr, " = %zd (%zd)\tFAIL\n", res, expected);
+	}
+}
+
+#/* */
+static void check_utf8(const char * text, size_t len, size_t out_size)
+{
+	uint16_t ucs2[256], ref16[256];
+	char utf8[512];
+	ssize_t res, ref;
+
+	res = utf8_to_ucs2(text, len, ucs2, out_size);
+	ref = iconv_ref(text, len, (char *)ref16, out_size * 2, "UTF-8", "UTF-16BE");
+	if (ref >= 0) {
+		ref /= 2;
+	}
+	check(res == ref && (res < 0 || !memcmp(ucs2, ref16, res * 2)), "utf8_to_ucs2(\"%.24s\")", text, res, ref);
+	if (res < 0) {
+		return;
+	}
+
+	ref = iconv_ref((const char *)ucs2, res * 2, utf8, sizeof(utf8), "UTF-16BE", "UTF-8");
+	res = ucs2_to_utf8(ucs2, res, utf8, sizeof(utf8));
+	check(res == (ssize_t)len && res == ref && !memcmp(utf8, text, len), "ucs2_to_utf8(\"%.24s\")", text, res, ref);
+}
+
+#/* */
+void test_utf8_ucs2()
+{
+	unsigned idx;
+	char buf[256];
+
+	for (idx = 0; idx < ARRAY_LEN(texts); ++idx) {
+		check_utf8(texts[idx], strlen(texts[idx]), 256);
+	}
+
+	/* embedded NUL */
+	check_utf8("a\0b", 3, 256);
+
+	/* every length around SIMD block */
+	for (idx = 0; idx < 80; ++idx) {
+		memset(buf, 'a' + idx % 26, idx);
+		buf[idx] = '\0';
+		check_utf8(buf, idx, 256);
+		if (idx > 2) {
+			memcpy(buf + idx - 2, "\xd1\x8f", 2);
+			check_utf8(buf, idx, 256);
+		}
+	}
+
+	/* output limits */
+	for (idx = 1; idx < 40; ++idx) {
+		check_utf8(texts[5], strlen(texts[5]), idx);
+		check_utf8(texts[9], strlen(texts[9]), idx);
+	}
+
+	for (idx = 0; idx < ARRAY_LEN(bad_utf8); ++idx) {
+		uint16_t ucs2[16];
+		const ssize_t res = utf8_to_ucs2(bad_utf8[idx], strlen(bad_utf8[idx]), ucs2, ARRAY_LEN(ucs2));
+		check(res < 0, "utf8_to_ucs2(invalid \"%s\")", bad_utf8[idx], res, -1);
+	}
+
+	for (idx = 0; idx < ARRAY_LEN(bad_utf16); ++idx) {
+		char utf8[16];
+		const ssize_t res = ucs2_to_utf8((const uint16_t *)bad_utf16[idx], 2, utf8, sizeof(utf8));
+		check(res < 0, "ucs2_to_utf8(invalid %s)", "surrogate", res, -1);
+	}
+
+	fprintf(stderr, "\n");
+}
+
+#/* reference hex and septet codecs, as module did before, one nibble or septet at a time */
+static void ref_hexify(const uint8_t * in, size_t in_length, char * out)
+{
+	static const char hex[] = "0123456789ABCDEF";
+	size_t i;
+
+	for (i = 0; i < in_length; ++i) {
+		out[i * 2] = hex[in[i] >> 4];
+		out[i * 2 + 1] = hex[in[i] & 15];
+	}
+	out[in_length * 2] = '\0';
+}
+
+static int ref_hexval(char c)
+{
+	if (c >= '0' && c <= '9') {
+		return c - '0';
+	}
+	if ((c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F')) {
+		return (c | 0x20) - 'a' + 10;
+	}
+	return -1;
+}
+
+static int ref_unhex(const char * in, uint8_t * out)
+{
+	int len = 0, nibbles = 0;
+
+	while (in[0]) {
+		int p0, p1;
+
+		nibbles += 1 + !!in[1];
+		p0 = ref_hexval(*in++);
+		p1 = *in ? ref_hexval(*in++) : 0;
+		if (p0 < 0 || p1 < 0) {
+			return -1;
+		}
+		out[len++] = p0 << 4 | p1;
+	}
+	return nibbles;
+}
+
+static ssize_t ref_gsm7_pack(const uint16_t * in, size_t in_length, char * out, size_t out_size, unsigned out_padding)
+{
+	size_t i, x = ((out_padding + (7 * in_length) + 7) / 8) + 1;
+	unsigned value = 0;
+	int j;
+
+	if (x > out_size) {
+		return -1;
+	}
+	for (x = i = 0; i != in_length; ++i) {
+		const char c[] = { in[i] >> 8, in[i] & 255 };
+
+		for (j = c[0] == 0; j < 2; ++j) {
+			value |= (c[j] & 0x7F) << out_padding;
+			out_padding += 7;
+			if (out_padding < 8) {
+				continue;
+			}
+			out[x++] = value & 0xff;
+			value >>= 8;
+			out_padding -= 8;
+		}
+	}
+	if (out_padding != 0) {
+		out[x++] = value & 0xff;
+	}
+	return x * 2 - (out_padding == 1 || out_padding == 2 || out_padding == 3 ? 1 : 0);
+}
+
+static ssize_t ref_gsm7_unpack_decode(const char * in, size_t in_nibbles, uint16_t * out, size_t out_size, unsigned in_padding, uint8_t ls, uint8_t ss)
+{
+	size_t i, x;
+	unsigned value = 0, c;
+	int esc = 0;
+
+	if (ls > 13) {
+		ls = 0;
+	}
+	if (ss > 13) {
+		ss = 0;
+	}
+	if (!out_size) {
+		return -1;
+	}
+	if (in_nibbles < 2) {
+		out[0] = '\0';
+		return 0;
+	}
+	in_padding = 7 - in_padding;
+	for (x = i = 0; i < in_nibbles; ++i) {
+		if (x >= out_size) {
+			return -1;
+		}
+		c = in[i / 2];
+		if (i & 1) {
+			c >>= 4;
+		}
+		value |= (c & 0xf) << in_padding;
+		in_padding += 4;
+		while (in_padding >= 7 * 2) {
+			uint16_t val;
+
+			in_padding -= 7;
+			value >>= 7;
+			val = (esc ? LUT_GSM7_SS16 : LUT_GSM7_LS16)[esc ? ss : ls][value & 0x7f];
+			if (val == 0x1b) {
+				esc = 1;
+			} else {
+				esc = 0;
+				out[x++] = ((val & 0xff) << 8) | (val >> 8);
+			}
+		}
+	}
+	return x;
+}
+
+#/* golden tests, random data of every length around blocks of kernels */
+void test_hex_gsm7(unsigned rounds)
+{
+	uint8_t bytes[300], out[300], ref_out[300];
+	char hex[608], ref_hex[608];
+	uint16_t septets[300], ucs2[400], ref_ucs2[400];
+	int hex_faults = 0, gsm7_faults = 0;
+	unsigned r, i;
+
+	srand(1);
+	for (r = 0; r < rounds; ++r) {
+		const size_t len = r % 290;
+		const size_t nibbles = rand() % (len * 2 + 1);
+		const unsigned padding = rand() % 7;
+		const size_t out_size = rand() % 2 ? ARRAY_LEN(ucs2) : (size_t)(rand() % 200 + 1);
+		ssize_t res, ref;
+
+		for (i = 0; i < len; ++i) {
+			bytes[i] = rand();
+			septets[i] = rand() % 16 ? (rand() & 0x7F) : (0x1B00 | (rand() & 0x7F));
+		}
+
+		ref_hexify(bytes, len, ref_hex);
+		hexify(bytes, len, hex);
+		hex_faults += strcmp(hex, ref_hex) != 0;
+
+		/* in place, odd length, lower case and bad digits */
+		memcpy(hex, bytes, len);
+		hexify((const uint8_t *)hex, len, hex);
+		hex_faults += strcmp(hex, ref_hex) != 0;
+		ref_hex[nibbles] = hex[nibbles] = '\0';
+		for (i = 0; i < nibbles; ++i) {
+			if (rand() % 3 == 0) {
+				ref_hex[i] = hex[i] = tolower(hex[i]);
+			}
+			if (rand() % 400 == 0) {
+				ref_hex[i] = hex[i] = "g:/ @"[rand() % 5];
+			}
+		}
+		ref = ref_unhex(ref_hex, ref_out);
+		res = unhex(hex, out);
+		hex_faults += res != ref || (res > 0 && memcmp(out, ref_out, (res + 1) / 2));
+		res = unhex(hex, (uint8_t *)hex);
+		hex_faults += res != ref || (res > 0 && memcmp(hex, ref_out, (res + 1) / 2));
+
+		ref = ref_gsm7_pack(septets, len, (char *)ref_out, sizeof(ref_out), padding);
+		res = gsm7_pack(septets, len, (char *)out, sizeof(out), padding);
+		gsm7_faults += res != ref || (res > 0 && memcmp(out, ref_out, (res + 1) / 2));
+
+		ref = ref_gsm7_unpack_decode((const char *)bytes, nibbles, ref_ucs2, out_size, padding, r % 16, r % 15);
+		res = gsm7_unpack_decode((const char *)bytes, nibbles, ucs2, out_size, padding, r % 16, r % 15);
+		gsm7_faults += res != ref || (res > 0 && memcmp(ucs2, ref_ucs2, res * sizeof(ucs2[0])));
+	}
+
+	check(!hex_faults, "hexify()/unhex() against reference %s", "", hex_faults, 0);
+	check(!gsm7_faults, "gsm7_pack()/gsm7_unpack_decode() against reference %s", "", gsm7_faults, 0);
+	fprintf(stderr, "\n");
+}
+
+#/* */
+static double elapsed_s(const struct timespec * start, const struct timespec * end)
+{
+	return (end->tv_sec - start->tv_sec) + (end->tv_nsec - start->tv_nsec) / 1e9;
+}
+
+#/* */
+void bench_utf8_ucs2(unsigned rounds)
+{
+	struct timespec start, end;
+	uint16_t ucs2[256];
+	char utf8[512];
+	unsigned r, idx;
+	unsigned long sum = 0;
+	const unsigned count = 5;
+	double native, ref;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (r = 0; r < rounds; ++r) {
+		for (idx = 5; idx < 5 + count; ++idx) {
+			const ssize_t len = utf8_to_ucs2(texts[idx], strlen(texts[idx]), ucs2, ARRAY_LEN(ucs2));
+			sum += ucs2_to_utf8(ucs2, len, utf8, sizeof(utf8));
+		}
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	native = rounds * count / elapsed_s(&start, &end);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (r = 0; r < rounds; ++r) {
+		for (idx = 5; idx < 5 + count; ++idx) {
+			const ssize_t len = iconv_ref(texts[idx], strlen(texts[idx]), (char *)ucs2, sizeof(ucs2), "UTF-8", "UTF-16BE");
+			sum -= iconv_ref((const char *)ucs2, len, utf8, sizeof(utf8), "UTF-16BE", "UTF-8");
+		}
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	ref = rounds * count / elapsed_s(&start, &end);
+
+	fprintf(stderr, "convert %u messages there and back: iconv_open() per call %.0f msg/s, native %.0f msg/s (%lu)\n\n",
+		rounds * count, ref, native, sum);
+}
+
+#/* */
+void bench_hex_gsm7(unsigned rounds)
+{
+	struct timespec start, end;
+	uint8_t bytes[140];
+	char hex[281], packed[170];
+	uint16_t septets[160], ucs2[170];
+	unsigned r, i;
+	unsigned long sum = 0;
+	double native, ref;
+
+	for (i = 0; i < ARRAY_LEN(bytes); ++i) {
+		bytes[i] = i * 7;
+	}
+	for (i = 0; i < ARRAY_LEN(septets); ++i) {
+		septets[i] = (i * 5) & 0x7F;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (r = 0; r < rounds; ++r) {
+		hexify(bytes, sizeof(bytes), hex);
+		sum += unhex(hex, bytes);
+		sum += gsm7_pack(septets, ARRAY_LEN(septets), packed, sizeof(packed), 0);
+		sum += gsm7_unpack_decode(packed, 280, ucs2, ARRAY_LEN(ucs2), 0, 0, 0);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	native = rounds / elapsed_s(&start, &end);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (r = 0; r < rounds; ++r) {
+		ref_hexify(bytes, sizeof(bytes), hex);
+		sum -= ref_unhex(hex, bytes);
+		sum -= ref_gsm7_pack(septets, ARRAY_LEN(septets), packed, sizeof(packed), 0);
+		sum -= ref_gsm7_unpack_decode(packed, 280, ucs2, ARRAY_LEN(ucs2), 0, 0, 0);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	ref = rounds / elapsed_s(&start, &end);
+
+	fprintf(stderr, "code %u full PDUs to hex and septets there and back: reference %.0f PDU/s, kernels %.0f PDU/s (%lu)\n\n",
+		rounds, ref, native, sum);
+}
+
+#/* */
+int main()
+{
+	test_utf8_ucs2();
+	bench_utf8_ucs2(100000);
+	test_hex_gsm7(20000);
+	bench_hex_gsm7(1000000);
+
+	fprintf(stderr, "done %d tests: %d OK %d FAILS\n", ok + faults, ok, faults);
+
+	if (faults) {
+		return 1;
+	}
+	return 0;
+}
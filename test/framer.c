@@ -0,0 +1,305 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+#include <sys/uio.h>
+
+#include "mutils.h"			/* ARRAY_LEN() STRLEN() */
+#include "at_read.h"			/* at_read_result_iov() at_get_iov_size_n() */
+#include "ringbuffer.h"			/* rb_init() rb_write() rb_read_upd() rb_move() */
+#include "helpers.h"			/* get_esc_str_buffer_size() escape_nstr_ex() */
+
+#define RINGBUFFER_SIZE	(2 * 1024)
+#define MESSAGES	200
+
+int ok = 0;
+int faults = 0;
+
+/* at_read.c is linked without rest of module, so we'll fake what it calls here */
+void ast_log(int level, const char* file, int line, const char* function, const char* fmt, ...)
+{
+	(void)level;
+	(void)file;
+	(void)line;
+	(void)function;
+	(void)fmt;
+}
+
+int ast_waitfor_n_fd(int* fds, int n, int* ms, int* exception)
+{
+	(void)fds;
+	(void)n;
+	(void)ms;
+	(void)exception;
+	return -1;
+}
+
+size_t get_esc_str_buffer_size(size_t len)
+{
+	return len * 2 + 1;
+}
+
+const char* escape_nstr_ex(struct ast_str* buf, const char* str, size_t len)
+{
+	(void)buf;
+	(void)len;
+	return str;
+}
+
+static const char PDU[] = "07919730071111F1040B919701119905F80000211062320150610CC8329BFD065DDF72363904";
+
+struct responses {
+	unsigned count;
+	char * items[2 * MESSAGES + 16];
+};
+
+#/* */
+static void responses_free(struct responses * r)
+{
+	unsigned idx;
+
+	for (idx = 0; idx < r->count; ++idx) {
+		free(r->items[idx]);
+	}
+	r->count = 0;
+}
+
+#/* same as push_responses() of monitor_thread.c */
+static void split(struct ringbuffer * rb, struct at_read_state * state, struct responses * r)
+{
+	struct iovec iov[2];
+	size_t skip = 0;
+	int iovcnt;
+
+	while ((iovcnt = at_read_result_iov("test", state, &skip, rb, iov)) > 0) {
+		const size_t len = at_get_iov_size_n(iov, iovcnt);
+		if (len && r->count < ARRAY_LEN(r->items)) {
+			char * const item = malloc(len + 1);
+			memcpy(item, iov[0].iov_base, iov[0].iov_len);
+			if (iovcnt > 1) {
+				memcpy(item + iov[0].iov_len, iov[1].iov_base, iov[1].iov_len);
+			}
+			item[len] = '\0';
+			r->items[r->count++] = item;
+		}
+		rb_read_upd(rb, len + skip);
+		skip = 0;
+	}
+}
+
+#/* feed input by chunks of given size, return time spent in framer */
+static double feed(const char * input, size_t len, size_t chunk, struct responses * r)
+{
+	static char buf[RINGBUFFER_SIZE];
+	struct ringbuffer rb;
+	struct at_read_state state;
+	struct timespec start, end;
+	size_t pos;
+
+	memset(&state, 0, sizeof(state));
+	rb_init(&rb, buf, sizeof(buf));
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (pos = 0; pos < len; pos += chunk) {
+		const size_t n = (len - pos < chunk) ? len - pos : chunk;
+		if (rb_write(&rb, input + pos, n) != n) {
+			fprintf(stderr, "ring buffer overflow at %zu\n", pos);
+			break;
+		}
+		split(&rb, &state, r);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	return (end.tv_sec - start.tv_sec) * 1e6 + (end.tv_nsec - start.tv_nsec) / 1e3;
+}
+
+#/* */
+static void check(int cond, const char * what, size_t chunk, const char * got, const char * expected)
+{
+	if (cond) {
+		ok++;
+	} else {
+		faults++;
+		fprintf(stderr, "%s chunk %zu: [%s] != [%s]\tFAIL\n", what, chunk, got ? got : "(null)", expected);
+	}
+}
+
+#/* */
+void test_cmgl()
+{
+	static const size_t chunks[] = { 1, 2, 3, 7, 64, 500 };
+	const size_t size = MESSAGES * (STRLEN(PDU) + 32) + 64;
+	char * const input = malloc(size);
+	char expected[256];
+	size_t len = 0;
+	unsigned idx, c;
+
+	len += sprintf(input + len, "\r\n");
+	for (idx = 1; idx <= MESSAGES; ++idx) {
+		len += sprintf(input + len, "+CMGL: %u,1,,%u\r\n%s\r\n", idx, (unsigned)(STRLEN(PDU) / 2 - 8), PDU);
+	}
+	len += sprintf(input + len, "\r\nOK\r\n");
+	/* unsolicited messages after listing */
+	len += sprintf(input + len, "\r\n+CMTI: \"ME\",3\r\n\r\n+CMT: ,24\r\n%s\r\n\r\nRING\r\n", PDU);
+
+	for (c = 0; c < ARRAY_LEN(chunks); ++c) {
+		struct responses r = { 0 };
+		const double us = feed(input, len, chunks[c], &r);
+
+		check(r.count == MESSAGES + 4, "count", chunks[c], r.count == MESSAGES + 4 ? "" : "wrong", "");
+		for (idx = 0; idx < MESSAGES && idx < r.count; ++idx) {
+			sprintf(expected, "+CMGL: %u,1,,%u\r\n%s", idx + 1, (unsigned)(STRLEN(PDU) / 2 - 8), PDU);
+			check(!strcmp(r.items[idx], expected), "+CMGL", chunks[c], r.items[idx], expected);
+		}
+		if (r.count == MESSAGES + 4) {
+			check(!strcmp(r.items[MESSAGES], "OK"), "OK", chunks[c], r.items[MESSAGES], "OK");
+			check(!strcmp(r.items[MESSAGES + 1], "+CMTI: \"ME\",3"), "+CMTI", chunks[c], r.items[MESSAGES + 1], "+CMTI: \"ME\",3");
+			sprintf(expected, "+CMT: ,24\r\n%s", PDU);
+			check(!strcmp(r.items[MESSAGES + 2], expected), "+CMT", chunks[c], r.items[MESSAGES + 2], expected);
+			check(!strcmp(r.items[MESSAGES + 3], "RING"), "RING", chunks[c], r.items[MESSAGES + 3], "RING");
+		}
+
+		fprintf(stderr, "%u messages, %zu bytes by %zu: %u responses in %.0f us\n", MESSAGES, len, chunks[c], r.count, us);
+		responses_free(&r);
+	}
+	fprintf(stderr, "\n");
+	free(input);
+}
+
+#/* */
+void test_cmgr_wrap()
+{
+	char input[256];
+	char expected[128];
+	size_t len, shift;
+
+	/* terminator crossing end of ring buffer at every offset */
+	len = sprintf(input, "\r\n+CMGR: 0,,24\r\n%.40s\r\n\r\nOK\r\n", PDU);
+	sprintf(expected, "+CMGR: 0,,24\r\n%.40s", PDU);
+
+	for (shift = 0; shift < len; ++shift) {
+		static char buf[128];
+		struct ringbuffer rb;
+		struct at_read_state state;
+		struct responses r = { 0 };
+		size_t pos;
+
+		memset(&state, 0, sizeof(state));
+		rb_init(&rb, buf, sizeof(buf));
+		rb.read = rb.write = sizeof(buf) - len + shift;
+
+		for (pos = 0; pos < len; ++pos) {
+			rb_write(&rb, input + pos, 1);
+			split(&rb, &state, &r);
+		}
+
+		check(r.count == 2 && !strcmp(r.items[0], expected) && !strcmp(r.items[1], "OK"), "+CMGR wrapped", shift,
+			r.count ? r.items[0] : NULL, expected);
+		responses_free(&r);
+	}
+}
+
+#/* */
+void test_grow()
+{
+	char input[256];
+	char expected[128];
+	size_t len, shift;
+
+	/* response does not fit, buffer grown in middle of it, as make_room() of monitor_thread.c */
+	len = sprintf(input, "\r\n+CMGR: 0,,24\r\n%s\r\n\r\nOK\r\n", PDU);
+	sprintf(expected, "+CMGR: 0,,24\r\n%s", PDU);
+
+	for (shift = 0; shift < 32; ++shift) {
+		static char small[32];
+		struct ringbuffer rb;
+		struct at_read_state state;
+		struct responses r = { 0 };
+		char * buf = small;
+		size_t pos;
+
+		memset(&state, 0, sizeof(state));
+		rb_init(&rb, small, sizeof(small));
+		rb.read = rb.write = shift;
+
+		for (pos = 0; pos < len; ++pos) {
+			if (!rb_free(&rb)) {
+				char * const grown = malloc(rb.size * 2);
+				if (rb_move(&rb, grown, rb.size * 2) != buf) {
+					check(0, "rb_move", shift, "wrong buffer", "old one");
+				}
+				if (buf != small) {
+					free(buf);
+				}
+				buf = grown;
+			}
+			rb_write(&rb, input + pos, 1);
+			split(&rb, &state, &r);
+		}
+
+		check(r.count == 2 && !strcmp(r.items[0], expected) && !strcmp(r.items[1], "OK"), "+CMGR grown", shift,
+			r.count ? r.items[0] : NULL, expected);
+		check(rb_move(&rb, small, 0) == NULL, "rb_move too small", shift, "moved", "NULL");
+		responses_free(&r);
+		if (buf != small) {
+			free(buf);
+		}
+	}
+}
+
+#/* */
+void test_frames()
+{
+	char slots[RB_FRAMES_SLOTS * 8];
+	char out[9] = {0};
+	struct rb_frames rb;
+	uint64_t first = 0;
+	uint64_t second;
+	char frame[8];
+
+	rb_frames_init(&rb, slots, sizeof(frame));
+
+	check(rb_frames_read(&rb, &first, out, sizeof(frame)) == 0, "rb_frames empty", 0, "frame", "nothing");
+
+	for (unsigned i = 0; i < 3; ++i) {
+		memset(frame, 'a' + i, sizeof(frame));
+		rb_frames_write(&rb, frame, sizeof(frame));
+	}
+
+	second = rb_frames_head(&rb);
+	for (unsigned i = 0; i < 3; ++i) {
+		check(rb_frames_read(&rb, &first, out, sizeof(frame)) == sizeof(frame) && out[0] == 'a' + (char)i, "rb_frames in order", i, out, "frame");
+	}
+	check(rb_frames_read(&rb, &first, out, sizeof(frame)) == 0, "rb_frames drained", 3, "frame", "nothing");
+
+	/* lagging consumer gets only frames still in ring */
+	for (unsigned i = 0; i < 10; ++i) {
+		memset(frame, 'k' + i, sizeof(frame));
+		rb_frames_write(&rb, frame, i & 1 ? sizeof(frame) : sizeof(frame) / 2);
+	}
+
+	check(rb_frames_read(&rb, &second, out, sizeof(frame)) == sizeof(frame) && out[0] == 'k' + 10 - (RB_FRAMES_SLOTS - 1), "rb_frames lagging", 0, out, "frame");
+	check(rb_frames_read(&rb, &second, out, sizeof(frame)) == sizeof(frame) / 2 && out[0] == 'k' + 11 - (RB_FRAMES_SLOTS - 1), "rb_frames length", 1, out, "half frame");
+	check(rb_frames_read(&rb, &first, out, 2) == 2, "rb_frames truncated", 0, out, "two bytes");
+
+	/* slot being overwritten by producer is skipped */
+	second = rb_frames_head(&rb) - 2u;
+	rb.seqs[second % RB_FRAMES_SLOTS] |= 1u;
+	check(rb_frames_read(&rb, &second, out, sizeof(frame)) == sizeof(frame) && out[0] == 'k' + 9, "rb_frames torn", 0, out, "next frame");
+}
+
+#/* */
+int main()
+{
+	test_cmgl();
+	test_cmgr_wrap();
+	test_grow();
+	test_frames();
+
+	fprintf(stderr, "done %d tests: %d OK %d FAILS\n", ok + faults, ok, faults);
+
+	if (faults) {
+		return 1;
+	}
+	return 0;
+}
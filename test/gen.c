@@ -84,11 +84,62 @@ void test_pdu_build()
 	}
 }
 
+#/* */
+void test_pdu_template()
+{
+	static const char *dsts[] = { "+46708251358", "+4970812", "12345", "0701234567", "+123456789012345678" };
+	static const char *msgs[] = {
+		"{",
+		"Hello. This is a really long SMS. It contains more than 160 characters and thus cannot be encoded using a single SMS. It must be split up into multiplé SMS that are concatenated when they are received. Nevertheless, this SMS contains only GSM7 characters!",
+		"hello world😋",
+		"1234567890123456789012345678901234567890123456789012345678901234567890hello😋",
+	};
+
+	uint16_t ucs2[256];
+	pdu_part_t tmpl_pdus[255];
+	pdu_part_t pdus[255];
+	pdu_template_part_t parts[8];
+	char expected[PDU_LENGTH * 2 + 1];
+	char hexbuf[PDU_LENGTH * 2 + 1];
+	for (int i = 0; i < sizeof(msgs) / sizeof(msgs[0]); ++i) {
+		int ret = utf8_to_ucs2(msgs[i], strlen(msgs[i]), ucs2, sizeof(ucs2));
+		int cnt = pdu_build_mult(tmpl_pdus, "", "0", ucs2, ret, 60, 1, 0);
+		if (cnt <= 0 || cnt > 8) {
+			fprintf(stderr, "Template %d unsuccessful: PDU-Build returns %d\n", i, cnt);
+			++faults;
+			continue;
+		}
+		for (int j = 0; j < cnt; ++j) {
+			pdu_template_init(&parts[j], &tmpl_pdus[j], cnt);
+		}
+
+		for (int d = 0; d < sizeof(dsts) / sizeof(dsts[0]); ++d) {
+			const uint8_t ref = 0xA5 + d;
+			if (pdu_build_mult(pdus, "", dsts[d], ucs2, ret, 60, 1, ref) != cnt) {
+				fprintf(stderr, "Template %d/%d unsuccessful: parts mismatch\n", i, d);
+				++faults;
+				continue;
+			}
+			for (int j = 0; j < cnt; ++j) {
+				size_t tpdulen;
+				hexify(pdus[j].buffer, pdus[j].length, expected);
+				ssize_t len = pdu_template_fill(&parts[j], dsts[d], ref, hexbuf, &tpdulen);
+				if (len == (ssize_t)strlen(expected) && tpdulen == pdus[j].tpdu_length && strcmp(expected, hexbuf) == 0) {
+					++ok;
+				} else {
+					++faults;
+					fprintf(stderr, "Template %d/%d/%d unsuccessful: Expected %s; Got %s\n", i, d, j, expected, hexbuf);
+				}
+			}
+		}
+	}
+}
 
 #/* */
 int main()
 {
 	test_pdu_build();
+	test_pdu_template();
 	
 	fprintf(stderr, "done %d tests: %d OK %d FAILS\n", ok + faults, ok, faults);
 
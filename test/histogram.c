@@ -0,0 +1,79 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "histogram.h"			/* hist_add() hist_snapshot() hist_percentile() */
+
+int ok = 0;
+int faults = 0;
+
+#/* */
+static void check(int cond, const char * what, uint64_t value, uint64_t res, uint64_t expected)
+{
+	if (cond) {
+		ok++;
+	} else {
+		faults++;
+		fprintf(stderr, "%s(%llu) = %llu (%llu)\tFAIL\n", what, (unsigned long long)value, (unsigned long long)res, (unsigned long long)expected);
+	}
+}
+
+#/* */
+void test_single()
+{
+	uint64_t value;
+
+	/* single sample reported within 25% above */
+	for (value = 0; value < 40000000; value = value * 5 / 4 + 1) {
+		struct histogram hist, snapshot;
+		uint64_t p;
+
+		memset(&hist, 0, sizeof(hist));
+		hist_add(&hist, value);
+		hist_snapshot(&hist, &snapshot);
+
+		p = hist_percentile(&snapshot, 50);
+		check(p == value, "p50 of single", value, p, value);
+		check(snapshot.count == 1 && snapshot.max == value && hist_mean(&snapshot) == value, "count/max/mean", value, snapshot.max, value);
+	}
+}
+
+#/* */
+void test_uniform()
+{
+	static const unsigned percents[] = { 1, 50, 90, 99, 100 };
+	struct histogram hist, snapshot;
+	unsigned idx;
+	uint64_t value;
+
+	memset(&hist, 0, sizeof(hist));
+	for (value = 1; value <= 10000; ++value) {
+		hist_add(&hist, value);
+	}
+	hist_snapshot(&hist, &snapshot);
+
+	check(snapshot.count == 10000, "count", 10000, snapshot.count, 10000);
+	check(hist_mean(&snapshot) == 5000, "mean", 10000, hist_mean(&snapshot), 5000);
+	for (idx = 0; idx < sizeof(percents) / sizeof(percents[0]); ++idx) {
+		const uint64_t expected = 100 * percents[idx];
+		const uint64_t p = hist_percentile(&snapshot, percents[idx]);
+		check(p >= expected && p <= expected + expected / 4, "percentile", percents[idx], p, expected);
+	}
+
+	memset(&snapshot, 0, sizeof(snapshot));
+	check(hist_percentile(&snapshot, 99) == 0, "empty", 99, hist_percentile(&snapshot, 99), 0);
+}
+
+#/* */
+int main()
+{
+	test_single();
+	test_uniform();
+
+	fprintf(stderr, "done %d tests: %d OK %d FAILS\n", ok + faults, ok, faults);
+
+	if (faults) {
+		return 1;
+	}
+	return 0;
+}
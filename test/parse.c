@@ -1,8 +1,10 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <time.h>
 
 #include "at_parse.h"			/* at_parse_*() */
+#include "at_tok.h"			/* struct at_fields */
 #include "mutils.h"			/* ITEMS_OF() */
 
 
@@ -95,30 +97,38 @@ void test_parse_creg()
 		int	res;
 		int	gsm_reg;
 		int	gsm_reg_status;
-		char 	* lac;
-		char	* ci;
+		const char	* lac;
+		const char	* ci;
+		int	act;
 	};
 	static const struct test_case {
 		const char	* input;
 		struct result 	result;
 	} cases[] = {
-		{ "+CREG: 2,1,9110,7E6", { 0, 1, 1, "9110", "7E6"} },
-		{ "+CREG: 2,1,XXXX,AAAA", { 0, 1, 1, "XXXX", "AAAA"} },
+		{ "+CREG: 2,1,9110,7E6", { 0, 1, 1, "9110", "7E6", -1} },
+		{ "+CREG: 2,1,XXXX,AAAA", { 0, 1, 1, "XXXX", "AAAA", -1} },
+		{ "+CREG: 2,1,\"9110\",\"07E6\",7", { 0, 1, 1, "9110", "07E6", 7} },
+		{ "+CREG: 5,\"9110\",\"07E6\",7", { 0, 1, 5, "9110", "07E6", 7} },
+		{ "+CEREG: 1,\"2F1A\",\"0A1B2C3\"", { 0, 1, 1, "2F1A", "0A1B2C3", -1} },
+		{ "+CREG: 2,0", { 0, 0, 0, "", "", -1} },
+		{ "+CREG: 3\r\n", { 0, 3, 3, "", "", -1} },
+		{ "+CREG: x", { -1, 0, -1, "", "", -1} },
 	};
 	unsigned idx = 0;
-	char * input;
+	char lac[16], ci[16];
 	struct result result;
 	const char * msg;
 	
 	for(; idx < ITEMS_OF(cases); ++idx) {
-		input = strdup(cases[idx].input);
+		const char * const input = cases[idx].input;
 		fprintf(stderr, "%s(\"%s\")...", "at_parse_creg", input);
-		result.res = at_parse_creg(input, strlen(input), &result.gsm_reg, &result.gsm_reg_status, &result.lac, &result.ci);
+		result.res = at_parse_creg(input, strlen(input), &result.gsm_reg, &result.gsm_reg_status, lac, sizeof(lac), ci, sizeof(ci), &result.act);
 		if(result.res == cases[idx].result.res
 			&& result.gsm_reg == cases[idx].result.gsm_reg
 			&& result.gsm_reg_status == cases[idx].result.gsm_reg_status
-			&& strcmp(result.lac, cases[idx].result.lac) == 0
-			&& strcmp(result.ci, cases[idx].result.ci) == 0)
+			&& strcmp(lac, cases[idx].result.lac) == 0
+			&& strcmp(ci, cases[idx].result.ci) == 0
+			&& result.act == cases[idx].result.act)
 		{
 			msg = "OK";
 			ok++;
@@ -126,12 +136,198 @@ void test_parse_creg()
 			msg = "FAIL";
 			faults++;
 		}
-		fprintf(stderr, " = %d (%d,%d,\"%s\",\"%s\")\t%s\n", result.res, result.gsm_reg, result.gsm_reg_status, result.lac, result.ci, msg);
-		free(input);
+		fprintf(stderr, " = %d (%d,%d,\"%s\",\"%s\",%d)\t%s\n", result.res, result.gsm_reg, result.gsm_reg_status, lac, ci, result.act, msg);
+	}
+	fprintf(stderr, "\n");
+}
+
+#/* */
+void test_parse_csqn()
+{
+	static const struct test_case {
+		const char	* input;
+		int		res;
+		int		rssi;
+		int		ber;
+	} cases[] = {
+		{ "+CSQN: 25,0", 0, 25, 0 },
+		{ "+CSQN: 99,99\r\n", 0, 99, 99 },
+		{ "+CSQN: 25", -1, 0, 0 },
+		{ "+CSQN 25,0", -1, 0, 0 },
+	};
+	unsigned idx = 0;
+	int res, rssi, ber;
+	const char * msg;
+
+	for(; idx < ITEMS_OF(cases); ++idx) {
+		const char * const input = cases[idx].input;
+		rssi = ber = 0;
+		fprintf(stderr, "%s(\"%s\")...", "at_parse_csqn", input);
+		res = at_parse_csqn(input, strlen(input), &rssi, &ber);
+		if(res == cases[idx].res && (res || (rssi == cases[idx].rssi && ber == cases[idx].ber))) {
+			msg = "OK";
+			ok++;
+		} else {
+			msg = "FAIL";
+			faults++;
+		}
+		fprintf(stderr, " = %d (%d,%d)\t%s\n", res, rssi, ber, msg);
+	}
+	fprintf(stderr, "\n");
+}
+
+#/* */
+void test_parse_qind()
+{
+	static const struct test_case {
+		const char	* input;
+		int		res;
+		qind_t		qind;
+		int		value;		/* rssi, act or state of call */
+		const char	* number;
+	} cases[] = {
+		{ "+QIND: \"csq\",25,99", 0, QIND_CSQ, 25, "" },
+		{ "+QIND: \"act\",\"LTE\"", 0, QIND_ACT, 8, "" },
+		{ "+QIND: \"act\",\"HSPA+\"", 0, QIND_ACT, 7, "" },
+		{ "+QIND: \"ccinfo\",2,0,3,0,0,\"+79139131234\",145", 0, QIND_CCINFO, 3, "+79139131234" },
+		{ "+QIND: \"ccinfo\",2,0,-1,0,0,\"+7913,9131234\",145,\"alpha\"", 0, QIND_CCINFO, 6, "+7913,9131234" },
+		{ "+QIND: \"ccinfo\",2,0,3,0,0,\"+79139131234\"", -1, QIND_CCINFO, 0, "" },
+		{ "+QIND: \"other\",1", 0, QIND_NONE, 0, "" },
+		{ "+QIND: SMS DONE", -1, QIND_NONE, 0, "" },
+	};
+	unsigned idx = 0;
+	unsigned call_idx, dir, state, mode, mpty, toa;
+	char number[64];
+	struct at_fields params;
+	qind_t qind;
+	int res, value;
+	const char * msg;
+
+	for(; idx < ITEMS_OF(cases); ++idx) {
+		const char * const input = cases[idx].input;
+		number[0] = '\0';
+		value = 0;
+		fprintf(stderr, "%s(\"%s\")...", "at_parse_qind", input);
+		res = at_parse_qind(input, strlen(input), &qind, &params);
+		if (!res) {
+			switch (qind) {
+				case QIND_CSQ:
+					res = at_parse_qind_csq(&params, &value);
+					break;
+				case QIND_ACT:
+					res = at_parse_qind_act(&params, &value);
+					break;
+				case QIND_CCINFO:
+					res = at_parse_qind_cc(&params, &call_idx, &dir, &state, &mode, &mpty, number, sizeof(number), &toa);
+					value = res ? 0 : (int)state;
+					break;
+				default:
+					break;
+			}
+		}
+		if(res == cases[idx].res && (res || (qind == cases[idx].qind && value == cases[idx].value && strcmp(number, cases[idx].number) == 0))) {
+			msg = "OK";
+			ok++;
+		} else {
+			msg = "FAIL";
+			faults++;
+		}
+		fprintf(stderr, " = %d (%s,%d,\"%s\")\t%s\n", res, at_qind2str(qind), value, number, msg);
 	}
 	fprintf(stderr, "\n");
 }
 
+#/* */
+void test_parse_dsci()
+{
+	static const struct test_case {
+		const char	* input;
+		int		res;
+		unsigned	index;
+		unsigned	dir;
+		unsigned	stat;
+		unsigned	type;
+		const char	* number;
+		unsigned	toa;
+	} cases[] = {
+		{ "^DSCI: 2,1,4,0,+48XXXXXXXXX,145", 0, 2, 1, 4, 0, "+48XXXXXXXXX", 145 },
+		{ "^DSCI: 2,1,6,0,+48XXXXXXXXX,145,0\r\n", 0, 2, 1, 6, 0, "+48XXXXXXXXX", 145 },
+		{ "^DSCI: 1,0,3,0,\"+79139131234\",145", 0, 1, 0, 3, 0, "+79139131234", 145 },
+		{ "^DSCI: 2,1,6,0,+48XXXXXXXXX", -1, 0, 0, 0, 0, "", 0 },
+	};
+	unsigned idx = 0;
+	unsigned index, dir, stat, type, toa;
+	char number[64];
+	int res;
+	const char * msg;
+
+	for(; idx < ITEMS_OF(cases); ++idx) {
+		const char * const input = cases[idx].input;
+		fprintf(stderr, "%s(\"%s\")...", "at_parse_dsci", input);
+		index = dir = stat = type = toa = 0;
+		number[0] = '\0';
+		res = at_parse_dsci(input, strlen(input), &index, &dir, &stat, &type, number, sizeof(number), &toa);
+		if(res == cases[idx].res && (res || (index == cases[idx].index && dir == cases[idx].dir && stat == cases[idx].stat
+			&& type == cases[idx].type && strcmp(number, cases[idx].number) == 0 && toa == cases[idx].toa)))
+		{
+			msg = "OK";
+			ok++;
+		} else {
+			msg = "FAIL";
+			faults++;
+		}
+		fprintf(stderr, " = %d (%u,%u,%u,%u,\"%s\",%u)\t%s\n", res, index, dir, stat, type, number, toa, msg);
+	}
+	fprintf(stderr, "\n");
+}
+
+#/* */
+void bench_parse_urc(unsigned rounds)
+{
+	/* unsolicited notifications of busy device */
+	static const char * const urcs[] = {
+		"+QIND: \"csq\",25,99",
+		"+QIND: \"ccinfo\",2,0,3,0,0,\"+79139131234\",145",
+		"+CSQN: 25,0",
+		"+CREG: 1,\"9110\",\"07E6A1B\",7",
+		"+CLCC: 1,1,4,0,0,\"+79139131234\",145",
+		"^DSCI: 2,1,4,0,+48XXXXXXXXX,145",
+	};
+	size_t lens[ITEMS_OF(urcs)];
+	unsigned call_idx, dir, state, mode, mpty, toa;
+	int rssi, ber, gsm_reg, gsm_reg_status, act;
+	char number[64], lac[16], ci[16];
+	struct at_fields params;
+	qind_t qind;
+	struct timespec start, end;
+	unsigned i, idx;
+	int res = 0;
+
+	for (idx = 0; idx < ITEMS_OF(urcs); ++idx) {
+		lens[idx] = strlen(urcs[idx]);
+	}
+
+	/* parsers do not modify input, no copy is needed */
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < rounds; ++i) {
+		res |= at_parse_qind(urcs[0], lens[0], &qind, &params) || at_parse_qind_csq(&params, &rssi);
+		res |= at_parse_qind(urcs[1], lens[1], &qind, &params) || at_parse_qind_cc(&params, &call_idx, &dir, &state, &mode, &mpty, number, sizeof(number), &toa);
+		res |= at_parse_csqn(urcs[2], lens[2], &rssi, &ber);
+		res |= at_parse_creg(urcs[3], lens[3], &gsm_reg, &gsm_reg_status, lac, sizeof(lac), ci, sizeof(ci), &act);
+		res |= at_parse_clcc(urcs[4], lens[4], &call_idx, &dir, &state, &mode, &mpty, number, sizeof(number), &toa);
+		res |= at_parse_dsci(urcs[5], lens[5], &call_idx, &dir, &state, &mode, number, sizeof(number), &toa);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	if (res) {
+		faults++;
+	}
+
+	const double elapsed = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+	fprintf(stderr, "bench_parse_urc: %u x %zu notifications in %.3f s, %.0f ns per notification\n\n",
+		rounds, ITEMS_OF(urcs), elapsed, elapsed * 1e9 / ((double)rounds * ITEMS_OF(urcs)));
+}
+
 #/* */
 void test_parse_cmti()
 {
@@ -151,7 +347,9 @@ void test_parse_cmti()
 	for(; idx < ITEMS_OF(cases); ++idx) {
 		input = strdup(cases[idx].input);
 		fprintf(stderr, "%s(\"%s\")...", "at_parse_cmti", input);
-		result = at_parse_cmti(input);
+		if (at_parse_cmti(input, &result)) {
+			result = -1;
+		}
 		if(result == cases[idx].result) {
 			msg = "OK";
 			ok++;
@@ -305,6 +503,7 @@ void test_parse_cmgr()
 		int failidx = 0;
 		result.str = input = strdup(cases[idx].input);
 		result.msg_utf8 = buf;
+		result.msg_len = sizeof(buf);
 
 		fprintf(stderr, "/* %u */ %s(\"%s\")...", idx, "at_parse_cmgr", input);
 		result.res = at_parse_cmgr(
@@ -330,6 +529,55 @@ void test_parse_cmgr()
 	fprintf(stderr, "\n");
 }
 
+#/* */
+void bench_parse_cmgl(unsigned rounds)
+{
+	/* +CMGL listing of 200 stored messages: GSM7 concatenated, UCS-2 and alphanumeric sender */
+	static const char * const pdus[] = {
+		"+CMGR: 0,,159\r\n07913306000000F0440B913306000000F0000061011012939280A0050003CA020182E170380C0A86C3E13028180E87C3A060381C0E8382E170380C0A86C3E13028180E87C3A060381C0E8382E170380C0A86C3E13028180E87C3A060381C0E8382E170380C0A86C3E13028180E87C3A060381C0E8382E170380C0A86C3E13028180E87C3A060381C0E8382E170380C0A86C3E13028180E87C3A060381C0E8382E170380C0A86C3",
+		"+CMGR: 0,,159\r\n07919740430900F3440B912222222220F20008012180004390218C0500030003010031003100310031003100310031003100310031003200320032003200320032003200320032003200330033003300330033003300330033003300330034003400340034003400340034003400340034003500350035003500350035003500350035003500360036003600360036003600360036003600360037003700370037003700370037",
+		"+CMGR: 0,,55\r\n07912933035011804409D055F3DB5D060000411120712071022A080701030003990202A09976D7E9E5390B640FB3D364103DCD668364B3562CD692C1623417",
+	};
+	static const unsigned messages = 200;
+	char * dump[ITEMS_OF(pdus)];
+	size_t lens[ITEMS_OF(pdus)];
+	char oa[200], sca[200], scts[256], dt[256], buf[4096];
+	int tpdu_type, mr, st;
+	pdu_udh_t udh;
+	struct timespec start, end;
+	unsigned i, j, idx;
+	size_t total = 0;
+
+	for (idx = 0; idx < ITEMS_OF(pdus); ++idx) {
+		lens[idx] = strlen(pdus[idx]);
+		dump[idx] = malloc(lens[idx] + 1);
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < rounds; ++i) {
+		for (j = 0; j < messages; ++j) {
+			idx = j % ITEMS_OF(pdus);
+			/* parser works in place */
+			memcpy(dump[idx], pdus[idx], lens[idx] + 1);
+			size_t msg_len = sizeof(buf);
+			if (at_parse_cmgr(dump[idx], lens[idx], &tpdu_type, sca, sizeof(sca), oa, sizeof(oa), scts, &mr, &st, dt, buf, &msg_len, &udh)) {
+				faults++;
+				break;
+			}
+			total += msg_len;
+		}
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	const double elapsed = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+	fprintf(stderr, "bench_parse_cmgl: %u x %u messages in %.3f s, %.0f msg/s (%zu bytes of text)\n\n",
+		rounds, messages, elapsed, rounds * messages / elapsed, total);
+
+	for (idx = 0; idx < ITEMS_OF(pdus); ++idx) {
+		free(dump[idx]);
+	}
+}
+
 #/* */
 void test_parse_cusd()
 {
@@ -409,7 +657,7 @@ void test_parse_clcc()
 		unsigned	stat;
 		unsigned	mode;
 		unsigned	mpty;
-		char		* number;
+		const char	* number;
 		unsigned	toa;
 	};
 	static const struct test_case {
@@ -420,26 +668,31 @@ void test_parse_clcc()
 		{ "+CLCC: 1,1,4,0,0,\"+79139131234\",145", { 0, 1, 1, 4, 0, 0, "+79139131234", 145} },
 		{ "+CLCC: 1,1,4,0,0,\"+7913913ABCA\",145", { 0, 1, 1, 4, 0, 0, "+7913913ABCA", 145} },
 		{ "+CLCC: 1,1,4,0,0,\"+7913913ABCA\"", { -1, 0, 0, 0, 0, 0, "", 0} },
+		{ "+CLCC: 2,0,0,0,1,\"+79139131234\",145,\"Name, Surname\",1\r\n", { 0, 2, 0, 0, 0, 1, "+79139131234", 145} },
 	};
 	unsigned idx = 0;
-	char * input;
+	const char * input;
+	char number[64];
 	struct result result;
 	const char * msg;
 	
 	for(; idx < ITEMS_OF(cases); ++idx) {
-		input = strdup(cases[idx].input);
+		input = cases[idx].input;
+		memset(&result, 0, sizeof(result));
+		number[0] = '\0';
+		result.number = number;
 		fprintf(stderr, "%s(\"%s\")...", "at_parse_clcc", input);
 		result.res = at_parse_clcc(
-			input, &result.index, &result.dir, &result.stat, &result.mode,
-			&result.mpty, &result.number, &result.toa);
+			input, strlen(input), &result.index, &result.dir, &result.stat, &result.mode,
+			&result.mpty, number, sizeof(number), &result.toa);
 		if(result.res == cases[idx].result.res
-			&& result.index == cases[idx].result.index
+			&& (result.res || (result.index == cases[idx].result.index
 			&& result.dir == cases[idx].result.dir
 			&& result.stat == cases[idx].result.stat
 			&& result.mode == cases[idx].result.mode
 			&& result.mpty == cases[idx].result.mpty
 			&& strcmp(result.number, cases[idx].result.number) == 0
-			&& result.toa == cases[idx].result.toa)
+			&& result.toa == cases[idx].result.toa)))
 		{
 			msg = "OK";
 			ok++;
@@ -450,7 +703,6 @@ void test_parse_clcc()
 		fprintf(stderr, " = %d (%d,%d,%d,%d,%d,\"%s\",%d)\t%s\n",
 			result.res, result.index, result.dir, result.stat, result.mode,
 			result.mpty, result.number, result.toa, msg);
-		free(input);
 	}
 	fprintf(stderr, "\n");
 }
@@ -466,6 +718,9 @@ int main()
 	test_parse_cnum();
 	test_parse_cops();
 	test_parse_creg();
+	test_parse_csqn();
+	test_parse_qind();
+	test_parse_dsci();
 	test_parse_cmti();
 	test_parse_cmgr();
 	test_parse_cusd();
@@ -477,6 +732,8 @@ int main()
 	test_parse_clcc();
 	test_parse_ccwa();
 	test_gsm7();
+	bench_parse_cmgl(1000);
+	bench_parse_urc(1000000);
 	
 	fprintf(stderr, "done %d tests: %d OK %d FAILS\n", ok + faults, ok, faults);
 
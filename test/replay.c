@@ -0,0 +1,445 @@
+/*
+   Replay of captured modem output through framing, classification and parsing of responses
+
+   Input is raw bytes as read from data tty, for example captured by
+	cat /dev/ttyUSB2 > trace.raw
+   every file given in command line is replayed, without arguments built-in traces are used:
+   +CMGL dump, bursts of +QIND and registration reports and flows of incoming calls.
+
+   Responses are split by at_read_result_iov() as push_responses() of monitor_thread.c does,
+   classified by prefix tree as at_str2res() and passed to parsers called by at_response().
+   Reported are lines per second, heap allocations per line and latency percentiles of line.
+*/
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+#include <sys/uio.h>
+
+#include "mutils.h"			/* ARRAY_LEN() STRLEN() */
+#include "at_parse.h"			/* at_parse_*() */
+#include "at_tok.h"			/* struct at_fields */
+#include "at_read.h"			/* at_read_result_iov() at_get_iov_size_n() */
+#include "at_response.h"		/* AT_RESPONSES_TABLE() */
+#include "at_restrie.h"			/* at_restrie_init() at_restrie_lookup() */
+#include "ringbuffer.h"			/* rb_init() rb_write() rb_read_upd() */
+#include "helpers.h"			/* get_esc_str_buffer_size() escape_nstr_ex() */
+
+#define RINGBUFFER_SIZE	(8 * 1024)
+#define RESPONSE_SIZE	(16 * 1024)
+#define CHUNK_SIZE	64
+#define MAX_LINES	(1024 * 1024)
+
+int ok = 0;
+int faults = 0;
+
+/* parts of module are linked without rest of it, so we'll fake what they call here */
+void ast_log(int level, const char* file, int line, const char* function, const char* fmt, ...)
+{
+	(void)level;
+	(void)file;
+	(void)line;
+	(void)function;
+	(void)fmt;
+}
+
+int ast_waitfor_n_fd(int* fds, int n, int* ms, int* exception)
+{
+	(void)fds;
+	(void)n;
+	(void)ms;
+	(void)exception;
+	return -1;
+}
+
+size_t get_esc_str_buffer_size(size_t len)
+{
+	return len * 2 + 1;
+}
+
+const char* escape_nstr_ex(struct ast_str* buf, const char* str, size_t len)
+{
+	(void)buf;
+	(void)len;
+	return str;
+}
+
+/* count heap allocations while replaying, glibc only */
+extern void* __libc_malloc(size_t size);
+extern void* __libc_calloc(size_t nmemb, size_t size);
+extern void* __libc_realloc(void* ptr, size_t size);
+
+static int counting = 0;
+static unsigned long allocations = 0;
+
+void* malloc(size_t size)
+{
+	allocations += counting;
+	return __libc_malloc(size);
+}
+
+void* calloc(size_t nmemb, size_t size)
+{
+	allocations += counting;
+	return __libc_calloc(nmemb, size);
+}
+
+void* realloc(void* ptr, size_t size)
+{
+	allocations += counting;
+	return __libc_realloc(ptr, size);
+}
+
+/* same table as in at_response.c */
+static const at_response_t at_responses_list[] = {
+	AT_RESPONSES_TABLE(AT_RES_AS_STRUCTLIST)
+#define DEF_STR(str) str, STRLEN(str)
+	{ RES_CNUM, "+CNUM", DEF_STR("ERROR+CNUM:") },
+	{ RES_ERROR, "ERROR", DEF_STR("COMMAND NOT SUPPORT\r") },
+#undef DEF_STR
+};
+
+const at_responses_t at_responses = { at_responses_list, 3, ARRAY_LEN(at_responses_list), RES_MIN, RES_MAX };
+
+static struct at_restrie trie;
+
+static const char PDU[] = "07919730071111F1040B919701119905F80000211062320150610CC8329BFD065DDF72363904";
+
+struct replay {
+	const char * name;
+	unsigned lines;
+	unsigned parsed;
+	unsigned failed;
+	unsigned long allocations;
+	double total_ns;
+	double pending_ns;		/*!< time spent in incomplete response, accounted to next line */
+	float * latency;		/*!< ns per line */
+};
+
+#/* */
+static double elapsed_ns(const struct timespec * start, const struct timespec * end)
+{
+	return (end->tv_sec - start->tv_sec) * 1e9 + (end->tv_nsec - start->tv_nsec);
+}
+
+#/* same parsers as at_response() calls, state of device is not updated */
+static int dispatch(at_res_t res, char * str, size_t len)
+{
+	static char sca[512], oa[512], msg[4096];
+	char scts[64], dt[64];
+	int tpdu_type, idx, mr, st, rssi, act, gsm_reg, gsm_reg_status;
+	unsigned call_idx, dir, state, mode, mpty, toa;
+	char number[64], lac[16], ci[16];
+	struct at_fields params;
+	size_t msg_len = sizeof(msg);
+	pdu_udh_t udh;
+	qind_t qind;
+
+	switch (res) {
+		case RES_CMGL:
+			pdu_udh_init(&udh);
+			return at_parse_cmgl(str, len, &idx, &tpdu_type, sca, sizeof(sca), oa, sizeof(oa), scts, &mr, &st, dt, msg, &msg_len, &udh);
+
+		case RES_CMGR:
+		case RES_CLASS0:
+			pdu_udh_init(&udh);
+			return at_parse_cmgr(str, len, &tpdu_type, sca, sizeof(sca), oa, sizeof(oa), scts, &mr, &st, dt, msg, &msg_len, &udh);
+
+		case RES_CMT:
+			pdu_udh_init(&udh);
+			return at_parse_cmt(str, len, &tpdu_type, sca, sizeof(sca), oa, sizeof(oa), scts, &mr, &st, dt, msg, &msg_len, &udh);
+
+		case RES_QIND:
+			if (at_parse_qind(str, len, &qind, &params) < 0) {
+				return -1;
+			}
+			switch (qind) {
+				case QIND_CSQ:
+					return at_parse_qind_csq(&params, &rssi);
+				case QIND_ACT:
+					return at_parse_qind_act(&params, &act);
+				case QIND_CCINFO:
+					return at_parse_qind_cc(&params, &call_idx, &dir, &state, &mode, &mpty, number, sizeof(number), &toa);
+				default:
+					return 0;
+			}
+
+		case RES_CLCC:
+			return at_parse_clcc(str, len, &call_idx, &dir, &state, &mode, &mpty, number, sizeof(number), &toa);
+
+		case RES_DSCI:
+			return at_parse_dsci(str, len, &call_idx, &dir, &state, &mode, number, sizeof(number), &toa);
+
+		case RES_CSQ:
+			return at_parse_csq(str, &rssi);
+
+		case RES_CREG:
+		case RES_CEREG:
+			return at_parse_creg(str, len, &gsm_reg, &gsm_reg_status, lac, sizeof(lac), ci, sizeof(ci), &act);
+
+		case RES_CMTI:
+			return at_parse_cmti(str, &idx);
+
+		default:
+			return 0;
+	}
+}
+
+#/* same as push_responses() of monitor_thread.c */
+static void split(struct ringbuffer * rb, struct at_read_state * rstate, struct replay * r)
+{
+	static char response[RESPONSE_SIZE + 1];
+	struct timespec start, end;
+	struct iovec iov[2];
+	size_t skip = 0;
+	int iovcnt;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	while ((iovcnt = at_read_result_iov("replay", rstate, &skip, rb, iov)) > 0) {
+		size_t len = at_get_iov_size_n(iov, iovcnt);
+		if (len) {
+			if (len > RESPONSE_SIZE) {
+				len = RESPONSE_SIZE;
+			}
+			memcpy(response, iov[0].iov_base, MIN(len, iov[0].iov_len));
+			if (iovcnt > 1 && len > iov[0].iov_len) {
+				memcpy(response + iov[0].iov_len, iov[1].iov_base, len - iov[0].iov_len);
+			}
+			response[len] = '\0';
+
+			const at_res_t res = at_restrie_lookup(&trie, response, len);
+			if (dispatch(res, response, len) < 0) {
+				r->failed++;
+			} else if (res != RES_UNKNOWN) {
+				r->parsed++;
+			}
+
+			clock_gettime(CLOCK_MONOTONIC, &end);
+			if (r->lines < MAX_LINES) {
+				r->latency[r->lines] = (float)(r->pending_ns + elapsed_ns(&start, &end));
+			}
+			r->lines++;
+			r->pending_ns = 0;
+			start = end;
+		}
+		rb_read_upd(rb, at_get_iov_size_n(iov, iovcnt) + skip);
+		skip = 0;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	r->pending_ns += elapsed_ns(&start, &end);
+}
+
+#/* */
+static int cmp_float(const void * a, const void * b)
+{
+	const float x = *(const float *)a;
+	const float y = *(const float *)b;
+
+	return (x > y) - (x < y);
+}
+
+#/* */
+static void replay(const char * name, const char * input, size_t len)
+{
+	static char buf[RINGBUFFER_SIZE];
+	struct ringbuffer rb;
+	struct at_read_state rstate;
+	struct timespec start, end;
+	struct replay r = { 0 };
+	size_t pos;
+
+	r.name = name;
+	r.latency = malloc(MAX_LINES * sizeof(*r.latency));
+	if (!r.latency) {
+		faults++;
+		return;
+	}
+
+	memset(&rstate, 0, sizeof(rstate));
+	rb_init(&rb, buf, sizeof(buf));
+
+	allocations = 0;
+	counting = 1;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (pos = 0; pos < len; pos += CHUNK_SIZE) {
+		const size_t n = MIN(len - pos, CHUNK_SIZE);
+		if (rb_write(&rb, input + pos, n) != n) {
+			fprintf(stderr, "%s: ring buffer overflow at %zu\n", name, pos);
+			break;
+		}
+		split(&rb, &rstate, &r);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	counting = 0;
+	r.allocations = allocations;
+	r.total_ns = elapsed_ns(&start, &end);
+
+	if (r.lines && !r.failed) {
+		const unsigned n = MIN(r.lines, MAX_LINES);
+
+		qsort(r.latency, n, sizeof(*r.latency), cmp_float);
+		fprintf(stderr, "%-10s %7u lines %8zu bytes: %10.0f lines/s, %lu allocs (%.3f/line), p50 %.0f ns, p99 %.0f ns, max %.0f ns\n",
+			name, r.lines, len, r.lines / (r.total_ns / 1e9), r.allocations, (double)r.allocations / r.lines,
+			r.latency[n / 2], r.latency[n * 99 / 100], r.latency[n - 1]);
+		ok++;
+	} else {
+		fprintf(stderr, "%-10s %u lines, %u parsed, %u failed\tFAIL\n", name, r.lines, r.parsed, r.failed);
+		faults++;
+	}
+
+	free(r.latency);
+}
+
+#/* */
+static char * append(char * input, size_t * len, size_t * size, const char * fmt, ...) __attribute__((format(printf, 4, 5)));
+static char * append(char * input, size_t * len, size_t * size, const char * fmt, ...)
+{
+	va_list ap;
+	int n;
+
+	while (1) {
+		va_start(ap, fmt);
+		n = vsnprintf(input + *len, *size - *len, fmt, ap);
+		va_end(ap);
+		if (n >= 0 && (size_t)n < *size - *len) {
+			break;
+		}
+		*size *= 2;
+		input = realloc(input, *size);
+	}
+	*len += n;
+	return input;
+}
+
+#/* listing of storage after start */
+static char * trace_cmgl(size_t * len)
+{
+	size_t size = 64 * 1024;
+	char * input = malloc(size);
+	unsigned idx;
+
+	*len = 0;
+	input = append(input, len, &size, "\r\n");
+	for (idx = 1; idx <= 255; ++idx) {
+		input = append(input, len, &size, "+CMGL: %u,1,,%u\r\n%s\r\n", idx, (unsigned)(STRLEN(PDU) / 2 - 8), PDU);
+	}
+	input = append(input, len, &size, "\r\nOK\r\n");
+	return input;
+}
+
+#/* signal and registration reports of moving device */
+static char * trace_qind(size_t * len)
+{
+	size_t size = 64 * 1024;
+	char * input = malloc(size);
+	unsigned idx;
+
+	*len = 0;
+	for (idx = 0; idx < 5000; ++idx) {
+		input = append(input, len, &size, "\r\n+QIND: \"csq\",%u,99\r\n", 10 + idx % 21);
+		if (idx % 10 == 0) {
+			input = append(input, len, &size, "\r\n+QIND: \"act\",\"%s\"\r\n", idx % 20 ? "LTE" : "WCDMA");
+			input = append(input, len, &size, "\r\n+CREG: 1,\"2B5C\",\"01A2D%03X\",7\r\n", idx % 4096);
+			input = append(input, len, &size, "\r\n+CEREG: 1,\"2B5C\",\"01A2D%03X\",7\r\n", idx % 4096);
+		}
+		if (idx % 50 == 0) {
+			input = append(input, len, &size, "\r\n+CSQ: %u,99\r\n\r\nOK\r\n", 10 + idx % 21);
+		}
+	}
+	return input;
+}
+
+#/* incoming calls answered and hung up by remote side, waiting call, SMS in the middle */
+static char * trace_call(size_t * len)
+{
+	size_t size = 64 * 1024;
+	char * input = malloc(size);
+	unsigned idx;
+
+	*len = 0;
+	for (idx = 0; idx < 1000; ++idx) {
+		const unsigned long number = 79139131000ul + idx;
+
+		input = append(input, len, &size, "\r\n+QIND: \"ccinfo\",1,1,4,0,0,\"+%lu\",145\r\n", number);
+		input = append(input, len, &size, "\r\nRING\r\n\r\n+CLIP: \"+%lu\",145,,,,0\r\n", number);
+		input = append(input, len, &size, "\r\n+CLCC: 1,1,4,0,0,\"+%lu\",145\r\n\r\nOK\r\n", number);
+		input = append(input, len, &size, "\r\nOK\r\n");
+		input = append(input, len, &size, "\r\n+QIND: \"ccinfo\",1,1,0,0,0,\"+%lu\",145\r\n", number);
+		input = append(input, len, &size, "\r\n+CLCC: 1,1,0,0,0,\"+%lu\",145\r\n\r\nOK\r\n", number);
+		if (idx % 10 == 0) {
+			input = append(input, len, &size, "\r\n+CCWA: \"+%lu\",145,1\r\n", number + 1);
+			input = append(input, len, &size, "\r\n+CLCC: 1,1,0,0,0,\"+%lu\",145\r\n+CLCC: 2,1,5,0,0,\"+%lu\",145\r\n\r\nOK\r\n", number, number + 1);
+			input = append(input, len, &size, "\r\n+CMTI: \"ME\",%u\r\n", idx % 255);
+		}
+		input = append(input, len, &size, "\r\n+QIND: \"ccinfo\",1,1,-1,0,0,\"+%lu\",145\r\n", number);
+		input = append(input, len, &size, "\r\nNO CARRIER\r\n\r\nOK\r\n");
+	}
+	return input;
+}
+
+#/* */
+static char * load(const char * fname, size_t * len)
+{
+	FILE * f = fopen(fname, "rb");
+	size_t size = 64 * 1024;
+	char * input;
+	size_t n;
+
+	if (!f) {
+		perror(fname);
+		return NULL;
+	}
+
+	input = malloc(size);
+	*len = 0;
+	while ((n = fread(input + *len, 1, size - *len, f)) > 0) {
+		*len += n;
+		if (*len == size) {
+			size *= 2;
+			input = realloc(input, size);
+		}
+	}
+	fclose(f);
+	return input;
+}
+
+#/* */
+int main(int argc, char ** argv)
+{
+	static char * (* const traces[])(size_t *) = { trace_cmgl, trace_qind, trace_call };
+	static const char * const names[] = { "cmgl", "qind", "call" };
+	char * input;
+	size_t len;
+	int idx;
+
+	if (at_restrie_init(&trie, &at_responses)) {
+		fprintf(stderr, "at_restrie_init() failed\n");
+		return 1;
+	}
+
+	if (argc > 1) {
+		for (idx = 1; idx < argc; ++idx) {
+			input = load(argv[idx], &len);
+			if (!input) {
+				faults++;
+				continue;
+			}
+			replay(argv[idx], input, len);
+			free(input);
+		}
+	} else {
+		for (idx = 0; idx < (int)ARRAY_LEN(traces); ++idx) {
+			input = traces[idx](&len);
+			replay(names[idx], input, len);
+			free(input);
+		}
+	}
+
+	fprintf(stderr, "done %d tests: %d OK %d FAILS\n", ok + faults, ok, faults);
+
+	if (faults) {
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,170 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <time.h>
+
+#include "resample.h"			/* resample_init() resample_down2() resample_up2() */
+
+#define FRAME_8K	160
+#define FRAME_16K	320
+
+int ok = 0;
+int faults = 0;
+
+#/* */
+static void check(int cond, const char * what, double res, double expected)
+{
+	if (cond) {
+		ok++;
+	} else {
+		faults++;
+		fprintf(stderr, "%s = %g (%g)\tFAIL\n", what, res, expected);
+	}
+}
+
+#/* */
+static void tone(int16_t * buf, size_t samples, size_t offset, double freq, double rate, double amplitude)
+{
+	size_t i;
+	for (i = 0; i < samples; ++i) {
+		buf[i] = (int16_t)lrint(amplitude * sin(2.0 * M_PI * freq * (double)(offset + i) / rate));
+	}
+}
+
+#/* */
+/* amplitude of tone with integer number of periods in buffer */
+static double amplitude(const int16_t * buf, size_t samples)
+{
+	double sum = 0;
+	size_t i;
+	for (i = 0; i < samples; ++i) {
+		sum += (double)buf[i] * (double)buf[i];
+	}
+	return sqrt(2.0 * sum / (double)samples);
+}
+
+#/* */
+void test_dc()
+{
+	struct resampler rs;
+	int16_t in[FRAME_16K], out[FRAME_16K * 2];
+	size_t i, n;
+
+	for (i = 0; i < FRAME_16K; ++i) {
+		in[i] = 10000;
+	}
+
+	resample_init(&rs);
+	resample_down2(&rs, in, FRAME_16K, out);
+	n = resample_down2(&rs, in, FRAME_16K, out);
+	check(n == FRAME_8K, "down2 samples", n, FRAME_8K);
+	check(abs(out[n - 1] - 10000) <= 1, "down2 dc", out[n - 1], 10000);
+
+	resample_init(&rs);
+	resample_up2(&rs, in, FRAME_8K, out);
+	n = resample_up2(&rs, in, FRAME_8K, out);
+	check(n == FRAME_16K, "up2 samples", n, FRAME_16K);
+	check(abs(out[n - 1] - 10000) <= 1 && abs(out[n - 2] - 10000) <= 1, "up2 dc", out[n - 2], 10000);
+}
+
+#/* */
+void test_tone(double freq, double min_gain, double max_gain)
+{
+	struct resampler down, up;
+	int16_t in[FRAME_16K], mid[FRAME_8K], out[FRAME_16K];
+	double gain_down = 0, gain_round = 0;
+	char what[64];
+	int frame;
+
+	resample_init(&down);
+	resample_init(&up);
+	for (frame = 0; frame < 10; ++frame) {
+		tone(in, FRAME_16K, frame * FRAME_16K, freq, 16000, 16000);
+		resample_down2(&down, in, FRAME_16K, mid);
+		resample_up2(&up, mid, FRAME_8K, out);
+		/* skip filter warm up */
+		if (frame > 1) {
+			gain_down = amplitude(mid, FRAME_8K) / 16000;
+			gain_round = amplitude(out, FRAME_16K) / 16000;
+		}
+	}
+
+	snprintf(what, sizeof(what), "down2 gain at %g Hz", freq);
+	check(gain_down >= min_gain && gain_down <= max_gain, what, gain_down, max_gain);
+	if (freq < 4000) {
+		snprintf(what, sizeof(what), "round trip gain at %g Hz", freq);
+		check(gain_round >= min_gain * min_gain && gain_round <= max_gain * max_gain + 0.01, what, gain_round, max_gain);
+	}
+}
+
+#/* */
+void test_saturation()
+{
+	struct resampler rs;
+	int16_t in[FRAME_8K], out[FRAME_16K];
+	size_t i;
+
+	/* square wave overshoots, output must be clipped, not wrapped */
+	for (i = 0; i < FRAME_8K; ++i) {
+		in[i] = (i / 8) & 1 ? INT16_MIN : INT16_MAX;
+	}
+	resample_init(&rs);
+	resample_up2(&rs, in, FRAME_8K, out);
+	resample_up2(&rs, in, FRAME_8K, out);
+	for (i = 1; i < FRAME_16K; ++i) {
+		if (out[i - 1] > 30000 && out[i] < -30000 && (i & 15) != 0 && (i & 15) != 1) {
+			break;
+		}
+	}
+	check(i == FRAME_16K, "up2 saturation", i, FRAME_16K);
+}
+
+#/* CPU per call: both directions of one call for 20 ms frames */
+void bench()
+{
+	static const int FRAMES = 200000;
+	struct resampler down, up;
+	int16_t in16[FRAME_16K], in8[FRAME_8K], out16[FRAME_16K], out8[FRAME_8K];
+	struct timespec start, end;
+	double ns;
+	int frame;
+
+	tone(in16, FRAME_16K, 0, 1000, 16000, 16000);
+	tone(in8, FRAME_8K, 0, 1000, 8000, 16000);
+	resample_init(&down);
+	resample_init(&up);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (frame = 0; frame < FRAMES; ++frame) {
+		resample_down2(&down, in16, FRAME_16K, out8);
+		resample_up2(&up, in8, FRAME_8K, out16);
+		in16[frame % FRAME_16K] ^= out8[frame % FRAME_8K] & 1;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	ns = (double)(end.tv_sec - start.tv_sec) * 1e9 + (double)(end.tv_nsec - start.tv_nsec);
+	fprintf(stderr, "resample: %.0f ns per 20 ms frame both directions, %.3f%% of one CPU per call\n", ns / FRAMES, ns / FRAMES / 20e6 * 100.0);
+}
+
+#/* */
+int main()
+{
+	test_dc();
+	test_tone(300, 0.98, 1.01);
+	test_tone(1000, 0.98, 1.01);
+	test_tone(3000, 0.98, 1.01);
+	test_tone(3400, 0.90, 1.01);
+	test_tone(5000, 0.0, 0.002);
+	test_tone(6000, 0.0, 0.002);
+	test_saturation();
+	bench();
+
+	fprintf(stderr, "done %d tests: %d OK %d FAILS\n", ok + faults, ok, faults);
+
+	if (faults) {
+		return 1;
+	}
+	return 0;
+}
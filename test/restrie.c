@@ -0,0 +1,250 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "at_response.h"		/* AT_RESPONSES_TABLE() */
+#include "at_restrie.h"			/* at_restrie_init() at_restrie_lookup() */
+#include "mutils.h"			/* ARRAY_LEN() STRLEN() */
+
+
+int ok = 0;
+int faults = 0;
+
+/* same table as in at_response.c */
+static const at_response_t at_responses_list[] = {
+	AT_RESPONSES_TABLE(AT_RES_AS_STRUCTLIST)
+#define DEF_STR(str) str, STRLEN(str)
+	{ RES_CNUM, "+CNUM", DEF_STR("ERROR+CNUM:") },
+	{ RES_ERROR, "ERROR", DEF_STR("COMMAND NOT SUPPORT\r") },
+#undef DEF_STR
+};
+
+const at_responses_t at_responses = { at_responses_list, 3, ARRAY_LEN(at_responses_list), RES_MIN, RES_MAX };
+
+static struct at_restrie trie;
+
+/* recorded from EC25 */
+static const char * const trace[] = {
+	"OK",
+	"\r",
+	"+CSQ: 23,99",
+	"+QIND: \"csq\",23,99",
+	"+CREG: 1,\"2B5C\",\"01A2D3F4\",7",
+	"+CEREG: 1,\"2B5C\",\"01A2D3F4\",7",
+	"+COPS: 0,0,\"T-Mobile\",7",
+	"RING",
+	"+CLIP: \"+79139131234\",145,,,,0",
+	"+CLCC: 1,1,4,0,0,\"+79139131234\",145",
+	"+CLCC: 2,0,0,0,0,\"+79139131235\",145",
+	"NO CARRIER",
+	"BUSY",
+	"BUSY\r",
+	"NO DIALTONE",
+	"+CMTI: \"ME\",3",
+	"+CMGR: 0,,24",
+	"+CMGL: 1,1,,24",
+	"+CMS ERROR: 321",
+	"+CME ERROR: 10",
+	"ERROR",
+	"ERROR+CNUM:",
+	"COMMAND NOT SUPPORT",
+	"COMMAND NOT SUPPORT\r",
+	"+CNUM: \"\",\"+79139131234\",145",
+	"+CPIN: READY",
+	"+CUSD: 0,\"0031003200330034\",72",
+	"+CSCA: \"+79139131234\",145",
+	"+QAUDLOOP: 0",
+	"+QPCMV: 1,2",
+	"+QTONEDET: 49",
+	"> ",
+	"^BOOT:12345,0,0,0,6",
+	"+CPMS: \"ME\",3,255,\"ME\",3,255,\"ME\",3,255",
+	"Quectel",
+	"EC25",
+	"Revision: EC25EFAR06A06M4G",
+	"0791448720003023240DD0E474D81C0EBB010000111011315214000BE474D81C0EBB5DE3771B",
+	"",
+};
+
+#/* */
+static at_res_t str2res_linear(const char * buf, size_t len)
+{
+	unsigned i;
+
+	if (!len) {
+		return RES_UNKNOWN;
+	}
+
+	for (i = at_responses.ids_first; i < at_responses.ids; ++i) {
+		const at_response_t * const resp = &at_responses.responses[i];
+		if (resp->idlen) {
+			const size_t idlen1 = resp->idlen - 1;
+			if (resp->id[idlen1] == '\r' && buf[len - 1] != '\r') {
+				if (idlen1 != len || memcmp(buf, resp->id, idlen1)) {
+					continue;
+				}
+				return resp->res;
+			}
+		}
+
+		if (len < resp->idlen || memcmp(buf, resp->id, resp->idlen)) {
+			continue;
+		}
+		return resp->res;
+	}
+	return RES_UNKNOWN;
+}
+
+#/* */
+static double elapsed_ns(const struct timespec * start, const struct timespec * end)
+{
+	return (end->tv_sec - start->tv_sec) * 1e9 + (end->tv_nsec - start->tv_nsec);
+}
+
+#/* */
+static void check_line(const char * line)
+{
+	const size_t len = strlen(line);
+	const at_res_t expected = str2res_linear(line, len);
+	const at_res_t res = at_restrie_lookup(&trie, line, len);
+	const char * msg;
+
+	fprintf(stderr, "%s(\"%.40s\")...", "at_restrie_lookup", line);
+	if (res == expected) {
+		msg = "OK";
+		ok++;
+	} else {
+		msg = "FAIL";
+		faults++;
+	}
+	fprintf(stderr, " = %d (%d)\t%s\n", res, expected, msg);
+}
+
+#/* */
+void test_restrie()
+{
+	unsigned idx;
+
+	for (idx = 0; idx < ARRAY_LEN(trace); ++idx) {
+		check_line(trace[idx]);
+	}
+
+	/* every id by itself, with and without trailing CR */
+	for (idx = at_responses.ids_first; idx < at_responses.ids; ++idx) {
+		char line[64];
+		const at_response_t * const resp = &at_responses.responses[idx];
+
+		snprintf(line, sizeof(line), "%s", resp->id);
+		check_line(line);
+		if (resp->idlen && resp->id[resp->idlen - 1] == '\r') {
+			line[resp->idlen - 1] = '\0';
+			check_line(line);
+		}
+	}
+	fprintf(stderr, "\n");
+}
+
+#/* */
+void bench_restrie(char ** lines, size_t * lens, unsigned count, unsigned rounds)
+{
+	struct timespec start, end;
+	unsigned long sum = 0;
+	unsigned r, idx;
+	double linear, tree;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (r = 0; r < rounds; ++r) {
+		for (idx = 0; idx < count; ++idx) {
+			sum += str2res_linear(lines[idx], lens[idx]);
+		}
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	linear = elapsed_ns(&start, &end) / ((double)rounds * count);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (r = 0; r < rounds; ++r) {
+		for (idx = 0; idx < count; ++idx) {
+			sum -= at_restrie_lookup(&trie, lines[idx], lens[idx]);
+		}
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	tree = elapsed_ns(&start, &end) / ((double)rounds * count);
+
+	fprintf(stderr, "classify %u lines x %u: linear %.1f ns/line, trie %.1f ns/line (%lu)\n\n",
+		count, rounds, linear, tree, sum);
+}
+
+#/* */
+static unsigned load_trace(const char * fname, char *** lines, size_t ** lens)
+{
+	char buf[1024];
+	unsigned count = 0, alloc = 0;
+	FILE * f = fopen(fname, "r");
+
+	if (!f) {
+		perror(fname);
+		return 0;
+	}
+
+	while (fgets(buf, sizeof(buf), f)) {
+		size_t len = strlen(buf);
+		if (len && buf[len - 1] == '\n') {
+			buf[--len] = '\0';
+		}
+		if (count == alloc) {
+			alloc = alloc ? alloc * 2 : 256;
+			*lines = realloc(*lines, alloc * sizeof(**lines));
+			*lens = realloc(*lens, alloc * sizeof(**lens));
+		}
+		(*lines)[count] = strdup(buf);
+		(*lens)[count] = len;
+		check_line(buf);
+		count++;
+	}
+	fclose(f);
+	return count;
+}
+
+#/* */
+int main(int argc, char ** argv)
+{
+	char ** lines = NULL;
+	size_t * lens = NULL;
+	unsigned count = 0, idx;
+
+	if (at_restrie_init(&trie, &at_responses)) {
+		fprintf(stderr, "at_restrie_init() failed\n");
+		return 1;
+	}
+	fprintf(stderr, "prefix tree: %u nodes\n\n", trie.nodesno);
+
+	test_restrie();
+
+	if (argc > 1) {
+		/* one response line per line, e.g. extracted from debug log */
+		count = load_trace(argv[1], &lines, &lens);
+	}
+	if (!count) {
+		lines = malloc(ARRAY_LEN(trace) * sizeof(*lines));
+		lens = malloc(ARRAY_LEN(trace) * sizeof(*lens));
+		for (; count < ARRAY_LEN(trace); ++count) {
+			lines[count] = strdup(trace[count]);
+			lens[count] = strlen(trace[count]);
+		}
+	}
+	bench_restrie(lines, lens, count, 100000);
+
+	for (idx = 0; idx < count; ++idx) {
+		free(lines[idx]);
+	}
+	free(lines);
+	free(lens);
+
+	fprintf(stderr, "done %d tests: %d OK %d FAILS\n", ok + faults, ok, faults);
+
+	if (faults) {
+		return 1;
+	}
+	return 0;
+}
@@ -1,7 +1,13 @@
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
 #include "mixbuffer.h"
 #include "helpers.h"
 
+int ok = 0;
+int faults = 0;
+
 void hex_encode(unsigned char * bytes, unsigned length)
 {
 	for(; length; --length)
@@ -20,7 +26,7 @@ void check_result1(unsigned st, int lbuf, const struct mixbuffer * mixb, struct
 	};
 	struct state states[50];
 
-	if(st < ITEMS_OF(states))
+	if(st < ARRAY_LEN(states))
 	{
 //		struct state * state = states + st;
 /*
@@ -71,7 +77,7 @@ void test_suite1()
 	memset(buffer, 0, sizeof(buffer));
 
 	mixb_init(&mb, buffer, sizeof(buffer));
-	for(i = 0; i < ITEMS_OF(locals); i++)
+	for(i = 0; i < ARRAY_LEN(locals); i++)
 		mixb_attach(&mb, &locals[i]);
 
 	fprintf(stderr, "Testing rb_overwrite()");
@@ -79,9 +85,9 @@ void test_suite1()
 	
 	fprintf(stderr, "Data                                                      size used read write write1 used1 idx\n");
 	for(i = 0; i < 50; i++) {
-		int idx = i % ITEMS_OF(strings);
+		int idx = i % ARRAY_LEN(strings);
 		unsigned length = strlen(strings[idx]);
-		int lbuf = i % ITEMS_OF(locals);
+		int lbuf = i % ARRAY_LEN(locals);
 
 		if(mixb_free(&mb, &locals[lbuf]) < length)
 			mixb_read_upd(&mb, length - mixb_free(&mb, &locals[lbuf]));
@@ -90,14 +96,143 @@ void test_suite1()
 		check_result1(i, lbuf, &mb, &locals[lbuf]);
 	}
 
-	for(i = 0; i < ITEMS_OF(locals); i++)
+	for(i = 0; i < ARRAY_LEN(locals); i++)
 		mixb_detach(&mb, &locals[i]);
 	
 }
 
+#/* */
+static short sum_ref(int a, int b)
+{
+	a += b;
+	if (a > 32767)
+		return 32767;
+	if (a < -32768)
+		return -32768;
+	return (short)a;
+}
+
+#/* */
+static void fill_random(short * samples, unsigned count, int amplitude)
+{
+	unsigned i;
+	for(i = 0; i < count; i++)
+		samples[i] = (short)((rand() % (2 * amplitude + 1)) - amplitude);
+}
+
+#/* */
+void test_mix()
+{
+	/* odd sample counts check scalar tails after SIMD blocks */
+	static const unsigned lengths[] = { 1, 7, 8, 15, 16, 17, 31, 160, 161, 320, 333 };
+	static const int amplitudes[] = { 100, 12000, 32767 };
+	enum { STREAMS = 4, MAX_SAMPLES = 333 };
+
+	short buffer[MAX_SAMPLES * 3];
+	short data[STREAMS][MAX_SAMPLES];
+	short expected[MAX_SAMPLES];
+	struct mixbuffer mb;
+	struct mixstream streams[STREAMS];
+	unsigned l, a, i, k, round;
+
+	for(l = 0; l < ARRAY_LEN(lengths); l++) {
+		for(a = 0; a < ARRAY_LEN(amplitudes); a++) {
+			const unsigned len = lengths[l];
+			int match = 1;
+
+			mixb_init(&mb, buffer, sizeof(buffer));
+			for(k = 0; k < STREAMS; k++)
+				mixb_attach(&mb, &streams[k]);
+
+			/* several rounds to mix across ring buffer wrap */
+			for(round = 0; round < 5; round++) {
+				memset(expected, 0, sizeof(expected));
+				for(k = 0; k < STREAMS; k++) {
+					fill_random(data[k], len, amplitudes[a]);
+					for(i = 0; i < len; i++)
+						expected[i] = k ? sum_ref(expected[i], data[k][i]) : data[k][i];
+					mixb_write(&mb, &streams[k], (const char *)data[k], len * sizeof(short));
+				}
+
+				for(i = 0; i < len; i++) {
+					const size_t pos = (mb.rb.read + i * sizeof(short)) % mb.rb.size;
+					short got;
+					if (pos + sizeof(short) <= mb.rb.size) {
+						memcpy(&got, (const char *)buffer + pos, sizeof(short));
+					} else {
+						((char *)&got)[0] = ((const char *)buffer)[pos];
+						((char *)&got)[1] = ((const char *)buffer)[0];
+					}
+					if (got != expected[i])
+						match = 0;
+				}
+				mixb_read_upd(&mb, len * sizeof(short));
+			}
+
+			for(k = 0; k < STREAMS; k++)
+				mixb_detach(&mb, &streams[k]);
+
+			fprintf(stderr, "mixb_write(%u samples, amplitude %d, %d streams)...\t%s\n", len, amplitudes[a], STREAMS, match ? "OK" : "FAIL");
+			if (match)
+				ok++;
+			else
+				faults++;
+		}
+	}
+	fprintf(stderr, "\n");
+}
+
+#/* */
+void bench_mix(unsigned samples, unsigned nstreams, unsigned rounds)
+{
+	short buffer[640 * 5];
+	short data[640];
+	struct mixbuffer mb;
+	struct mixstream streams[8];
+	struct timespec start, end;
+	unsigned round, k;
+	double ns;
+
+	if (samples > ARRAY_LEN(data) || nstreams > ARRAY_LEN(streams))
+		return;
+
+	fill_random(data, samples, 12000);
+	mixb_init(&mb, buffer, samples * sizeof(short) * 5);
+	for(k = 0; k < nstreams; k++)
+		mixb_attach(&mb, &streams[k]);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for(round = 0; round < rounds; round++) {
+		for(k = 0; k < nstreams; k++)
+			mixb_write(&mb, &streams[k], (const char *)data, samples * sizeof(short));
+		mixb_read_upd(&mb, samples * sizeof(short));
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	for(k = 0; k < nstreams; k++)
+		mixb_detach(&mb, &streams[k]);
+
+	ns = (end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec);
+	fprintf(stderr, "mixb_write(%u samples x %u streams): %.1f ns/frame, %.1f Msamples/s\n",
+		samples, nstreams, ns / rounds, (double)samples * nstreams * rounds * 1e3 / ns);
+}
+
 #/* */
 int main()
 {
 	test_suite1();
+	test_mix();
+
+	/* 20 ms frames of SLIN and SLIN16 */
+	bench_mix(160, 2, 200000);
+	bench_mix(160, 4, 200000);
+	bench_mix(320, 4, 200000);
+	bench_mix(320, 8, 200000);
+
+	fprintf(stderr, "\ndone %d tests: %d OK %d FAILS\n", ok + faults, ok, faults);
+
+	if (faults) {
+		return 1;
+	}
 	return 0;
 }
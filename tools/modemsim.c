@@ -0,0 +1,913 @@
+/*
+   PTY based simulator of Quectel and SimCOM modules for load testing of chan_quectel
+
+	cc -O2 -o modemsim modemsim.c -lm
+	./modemsim -n 100 -d /tmp/modemsim -r 1 -c 2 -q 6 > quectel-sim.conf
+
+   Every simulated device has data and audio TTY, slave sides are linked as
+   <dir>/simN-data and <dir>/simN-audio and device sections are printed to stdout.
+
+   Data TTY answers initialization sequence of at_enqueue_initialization()
+   and at_enqueue_initialization_quectel() or _simcom(), unknown commands are answered by OK.
+   Incoming calls (RING, +CLIP and call status), incoming SMS (+CMTI), signal reports and
+   unsolicited call status are generated at given rates per device per minute.
+   Outgoing calls are alerted and answered by remote side, calls are hung up by remote side after given time.
+   During active call audio TTY sends 20 ms frames of tone and reads whatever driver sends.
+
+   SIGUSR1 prints statistics, SIGINT or SIGTERM prints them and exits.
+*/
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>			/* strncasecmp() */
+#include <ctype.h>			/* toupper() */
+#include <errno.h>			/* errno */
+#include <fcntl.h>			/* O_RDWR O_NOCTTY O_NONBLOCK */
+#include <limits.h>			/* PATH_MAX */
+#include <math.h>			/* sin() */
+#include <poll.h>			/* poll() */
+#include <signal.h>			/* sigaction() */
+#include <termios.h>			/* cfmakeraw() tcsetattr() */
+#include <time.h>			/* clock_gettime() */
+#include <unistd.h>			/* read() write() symlink() */
+#include <sys/stat.h>			/* mkdir() */
+
+#define ITEMS_OF(x)	(sizeof(x) / sizeof((x)[0]))
+
+#define FRAME_MS	20
+#define MAX_BURST	5			/* frames written at once after stall */
+#define RING_PERIOD	3000			/* ms between RINGs */
+#define DIAL_ALERT	500			/* ms from dialing to alerting of outgoing call */
+#define SMS_SLOTS	255
+
+static const char PDU[] = "07919730071111F1040B919701119905F80000211062320150610CC8329BFD065DDF72363904";
+#define PDU_TPDU_LEN	((unsigned)((sizeof(PDU) - 1) / 2 - 8))	/* without SMSC address */
+
+enum vendor {
+	VENDOR_QUECTEL,
+	VENDOR_SIMCOM,
+};
+
+/* same values as +CLCC <stat> */
+enum call_state {
+	CALL_ACTIVE = 0,
+	CALL_HELD,
+	CALL_DIALING,
+	CALL_ALERTING,
+	CALL_INCOMING,
+	CALL_WAITING,
+	CALL_RELEASED,
+	CALL_NONE,
+};
+
+struct options {
+	unsigned	devices;
+	const char	* dir;
+	enum vendor	vendor;
+	unsigned	rate;		/* sample rate of audio */
+	double		ring_rate;	/* incoming calls per device per minute */
+	double		clcc_rate;	/* unsolicited call status per call per minute */
+	double		cmti_rate;	/* incoming SMS per device per minute */
+	double		qind_rate;	/* signal reports per device per minute */
+	unsigned	duration;	/* s of call before remote hangup */
+	unsigned	rings;		/* RINGs of incoming call before it is missed */
+	unsigned	answer;		/* ms of alerting before remote side answers outgoing call */
+};
+
+struct stats {
+	unsigned long	commands;
+	unsigned long	errors;
+	unsigned long	calls_in;
+	unsigned long	calls_out;
+	unsigned long	answered;
+	unsigned long	missed;
+	unsigned long	sms_in;
+	unsigned long	sms_out;
+	unsigned long	signal;
+	unsigned long	status;
+	unsigned long	audio_in;	/* bytes */
+	unsigned long	audio_out;	/* bytes */
+	unsigned long	dropped;	/* bytes not written to full TTY */
+};
+
+struct pty {
+	int		master;
+	int		slave;		/* kept open, master would report hangup while driver does not hold device */
+	char		link[PATH_MAX];
+};
+
+struct out {
+	size_t		len;
+	char		buf[16 * 1024];
+};
+
+struct device {
+	unsigned	id;
+	struct pty	data;
+	struct pty	audio;
+
+	char		line[4096];
+	size_t		len;
+	int		prompt;		/* reading PDU of AT+CMGS */
+	int		dsci;		/* ^DSCI=1 instead of +QIND: "ccinfo" */
+	int		clcc;		/* +CLCC=1, unsolicited call status of SimCOM */
+	unsigned char	sms[SMS_SLOTS];
+	unsigned	mr;
+
+	enum call_state	state;
+	unsigned	dir;		/* 0 - outgoing, 1 - incoming */
+	char		number[32];
+	unsigned	rings;
+	int64_t		call_next;	/* next step of call: RING, alerting, answer or remote hangup */
+
+	int64_t		audio_start;
+	uint64_t	frames;
+	unsigned	phase;
+
+	int64_t		next_ring;
+	int64_t		next_status;
+	int64_t		next_sms;
+	int64_t		next_signal;
+};
+
+static struct options opts = {
+	.devices	= 1,
+	.dir		= "/tmp/modemsim",
+	.vendor		= VENDOR_QUECTEL,
+	.rate		= 8000,
+	.ring_rate	= 0,
+	.clcc_rate	= 0,
+	.cmti_rate	= 0,
+	.qind_rate	= 1,
+	.duration	= 30,
+	.rings		= 5,
+	.answer		= 2000,
+};
+
+static struct stats stats;
+static volatile sig_atomic_t stop = 0;
+static volatile sig_atomic_t report = 0;
+
+#/* */
+static int64_t now_ms()
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+#/* time of next random event of given rate per minute, exponential gaps as of independent events */
+static int64_t next_event(int64_t now, double rate)
+{
+	if (rate <= 0) {
+		return INT64_MAX;
+	}
+	return now + (int64_t)(-log(1.0 - drand48()) * 60000.0 / rate) + 1;
+}
+
+#/* */
+static void out_printf(struct out * o, const char * fmt, ...) __attribute__((format(printf, 2, 3)));
+static void out_printf(struct out * o, const char * fmt, ...)
+{
+	va_list ap;
+	int n;
+
+	if (o->len + 4 >= sizeof(o->buf)) {
+		return;
+	}
+
+	o->buf[o->len++] = '\r';
+	o->buf[o->len++] = '\n';
+
+	va_start(ap, fmt);
+	n = vsnprintf(o->buf + o->len, sizeof(o->buf) - o->len - 2, fmt, ap);
+	va_end(ap);
+
+	if (n < 0) {
+		n = 0;
+	} else if ((size_t)n > sizeof(o->buf) - o->len - 3) {
+		n = sizeof(o->buf) - o->len - 3;
+	}
+	o->len += n;
+	o->buf[o->len++] = '\r';
+	o->buf[o->len++] = '\n';
+}
+
+#/* TTYs are not blocking, output is dropped when driver does not read it */
+static void tty_write(int fd, const char * buf, size_t count)
+{
+	while (count > 0) {
+		const ssize_t n = write(fd, buf, count);
+		if (n < 0 && errno == EINTR) {
+			continue;
+		}
+		if (n <= 0) {
+			stats.dropped += count;
+			return;
+		}
+		buf += n;
+		count -= n;
+	}
+}
+
+#/* */
+static void out_flush(struct device * dev, struct out * o)
+{
+	tty_write(dev->data.master, o->buf, o->len);
+	o->len = 0;
+}
+
+#/* */
+static int pty_open(struct pty * pty, const char * dir, unsigned id, const char * kind)
+{
+	struct termios attr;
+	const char * name;
+
+	pty->master = posix_openpt(O_RDWR | O_NOCTTY | O_NONBLOCK);
+	if (pty->master < 0) {
+		perror("posix_openpt");
+		return -1;
+	}
+	if (grantpt(pty->master) || unlockpt(pty->master) || (name = ptsname(pty->master)) == NULL) {
+		perror("grantpt");
+		goto e_close;
+	}
+
+	pty->slave = open(name, O_RDWR | O_NOCTTY);
+	if (pty->slave < 0) {
+		perror(name);
+		goto e_close;
+	}
+
+	/* no echo and line editing until driver sets attributes itself */
+	if (tcgetattr(pty->slave, &attr) == 0) {
+		cfmakeraw(&attr);
+		tcsetattr(pty->slave, TCSANOW, &attr);
+	}
+
+	snprintf(pty->link, sizeof(pty->link), "%s/sim%u-%s", dir, id, kind);
+	unlink(pty->link);
+	if (symlink(name, pty->link)) {
+		perror(pty->link);
+		close(pty->slave);
+		goto e_close;
+	}
+	return 0;
+
+e_close:
+	close(pty->master);
+	pty->master = -1;
+	return -1;
+}
+
+#/* */
+static void pty_close(struct pty * pty)
+{
+	if (pty->master >= 0) {
+		unlink(pty->link);
+		close(pty->slave);
+		close(pty->master);
+		pty->master = -1;
+	}
+}
+
+#/* call status in format enabled by driver */
+static void call_status(struct device * dev, struct out * o)
+{
+	const enum call_state state = dev->state == CALL_NONE ? CALL_RELEASED : dev->state;
+
+	if (opts.vendor == VENDOR_SIMCOM) {
+		if (dev->clcc) {
+			out_printf(o, "+CLCC: 1,%u,%d,0,0,\"%s\",145", dev->dir, state, dev->number);
+		}
+	} else if (dev->dsci) {
+		out_printf(o, "^DSCI: 1,%u,%d,0,%s,145", dev->dir, state, dev->number);
+	} else {
+		out_printf(o, "+QIND: \"ccinfo\",1,%u,%d,0,0,\"%s\",145", dev->dir, state == CALL_RELEASED ? -1 : (int)state, dev->number);
+	}
+	stats.status++;
+}
+
+#/* */
+static void call_set_state(struct device * dev, enum call_state state, int64_t now, struct out * o)
+{
+	dev->state = state;
+	call_status(dev, o);
+
+	switch (state) {
+		case CALL_ACTIVE:
+			dev->call_next = now + opts.duration * 1000;
+			dev->audio_start = now;
+			dev->frames = 0;
+			break;
+
+		case CALL_ALERTING:
+			dev->call_next = now + opts.answer;
+			break;
+
+		case CALL_RELEASED:
+			dev->state = CALL_NONE;
+			dev->call_next = INT64_MAX;
+			dev->next_status = INT64_MAX;
+			break;
+
+		default:
+			break;
+	}
+}
+
+#/* remote side starts incoming call */
+static void call_incoming(struct device * dev, int64_t now, struct out * o)
+{
+	snprintf(dev->number, sizeof(dev->number), "+7913%07u", (unsigned)(lrand48() % 10000000));
+	dev->dir = 1;
+	dev->rings = 0;
+	dev->call_next = now;
+	dev->next_status = next_event(now, opts.clcc_rate);
+	call_set_state(dev, CALL_INCOMING, now, o);
+	stats.calls_in++;
+}
+
+#/* remote side hangs up or incoming call is missed */
+static void call_remote_end(struct device * dev, int64_t now, struct out * o)
+{
+	call_set_state(dev, CALL_RELEASED, now, o);
+	out_printf(o, "NO CARRIER");
+}
+
+#/* */
+static void call_timer(struct device * dev, int64_t now, struct out * o)
+{
+	switch (dev->state) {
+		case CALL_INCOMING:
+			if (dev->rings >= opts.rings) {
+				stats.missed++;
+				call_remote_end(dev, now, o);
+				break;
+			}
+			out_printf(o, "RING");
+			out_printf(o, "+CLIP: \"%s\",145,,,,0", dev->number);
+			dev->rings++;
+			dev->call_next = now + RING_PERIOD;
+			break;
+
+		case CALL_DIALING:
+			call_set_state(dev, CALL_ALERTING, now, o);
+			break;
+
+		case CALL_ALERTING:
+			stats.answered++;
+			call_set_state(dev, CALL_ACTIVE, now, o);
+			break;
+
+		case CALL_ACTIVE:
+		case CALL_HELD:
+			call_remote_end(dev, now, o);
+			break;
+
+		default:
+			dev->call_next = INT64_MAX;
+			break;
+	}
+}
+
+#/* */
+static int sms_store(struct device * dev)
+{
+	unsigned idx;
+
+	for (idx = 0; idx < SMS_SLOTS; ++idx) {
+		if (!dev->sms[idx]) {
+			dev->sms[idx] = 1;
+			return idx;
+		}
+	}
+	return -1;
+}
+
+#/* */
+static void sms_list(struct device * dev, struct out * o)
+{
+	unsigned idx;
+
+	for (idx = 0; idx < SMS_SLOTS; ++idx) {
+		if (dev->sms[idx]) {
+			out_printf(o, "+CMGL: %u,1,,%u\r\n%s", idx, PDU_TPDU_LEN, PDU);
+		}
+	}
+}
+
+#/* */
+static void signal_report(struct device * dev, struct out * o)
+{
+	const unsigned rssi = 10 + (unsigned)(lrand48() % 21);
+
+	if (opts.vendor == VENDOR_SIMCOM) {
+		out_printf(o, "+CSQ: %u,99", rssi);
+	} else {
+		out_printf(o, "+QIND: \"csq\",%u,99", rssi);
+	}
+	(void)dev;
+	stats.signal++;
+}
+
+/* static information answers, NULL - command not supported by module */
+static const struct answer {
+	const char	* cmd;		/* prefix of command after AT */
+	const char	* quectel;
+	const char	* simcom;
+} answers[] = {
+	{ "+CGMI",	"Quectel",					"SIMCOM INCORPORATED" },
+	{ "+CGMM",	"EC25",						"SIMCOM_SIM7600E-H" },
+	{ "+CGMR",	"Revision: EC25EFAR06A06M4G",			"+CGMR: LE20B04SIM7600M22" },
+	{ "+CPIN?",	"+CPIN: READY",					"+CPIN: READY" },
+	{ "+CSCA?",	"+CSCA: \"+79139131000\",145",			"+CSCA: \"+79139131000\",145" },
+	{ "+COPS?",	"+COPS: 0,0,\"Simulator\",7",			"+COPS: 0,0,\"Simulator\",7" },
+	{ "+CSPN?",	"+CSPN: \"Simulator\",0",			"+CSPN: \"Simulator\",0" },
+	{ "+CSMS=",	"+CSMS: 1,1,1",					"+CSMS: 1,1,1" },
+	{ "+CPMS=",	"+CPMS: 0,255,0,255,0,255",			"+CPMS: 0,255,0,255,0,255" },
+	{ "+CCLK?",	"+CCLK: \"24/01/01,00:00:00+00\"",		"+CCLK: \"24/01/01,00:00:00+00\"" },
+	{ "+QSPN",	"+QSPN: \"Simulator\",\"Sim\",\"\",0,\"00101\"",	NULL },
+	{ "+QNWINFO",	"+QNWINFO: \"FDD LTE\",\"00101\",\"LTE BAND 3\",1300", NULL },
+	{ "+QPCMV?",	"+QPCMV: 0,0",					NULL },
+	{ "+QLTS",	"+QLTS: \"2024/01/01,00:00:00+00,0\"",		NULL },
+	{ "+QAUDMOD?",	"+QAUDMOD: 0",					NULL },
+	{ "+QAUDLOOP?",	"+QAUDLOOP: 0",					NULL },
+	{ "+QMIC?",	"+QMIC: 20000,20000",				NULL },
+	{ "+QRXGAIN?",	"+QRXGAIN: 20000",				NULL },
+	{ "+CPCMREG?",	NULL,						"+CPCMREG: 0" },
+	{ "+CMICGAIN?",	NULL,						"+CMICGAIN: 4" },
+	{ "+COUTGAIN?",	NULL,						"+COUTGAIN: 4" },
+};
+
+#/* handle one command of line, return 0 - OK, -1 - ERROR, 1 - final result already sent */
+static int command(struct device * dev, const char * cmd, int64_t now, struct out * o, struct out * post)
+{
+	unsigned idx;
+
+	if (!strcasecmp(cmd, "+CGSN")) {
+		out_printf(o, "8600000%08u", dev->id);
+	} else if (!strcasecmp(cmd, "+CIMI")) {
+		out_printf(o, "00101%010u", dev->id);
+	} else if (!strcasecmp(cmd, "+QCCID")) {
+		out_printf(o, "+QCCID: 890000000000%07u", dev->id);
+	} else if (!strcasecmp(cmd, "+CICCID")) {
+		out_printf(o, "+ICCID: 890000000000%07u", dev->id);
+	} else if (!strcasecmp(cmd, "+CCID")) {
+		out_printf(o, "890000000000%07u", dev->id);
+	} else if (!strcasecmp(cmd, "+CNUM")) {
+		out_printf(o, "+CNUM: \"\",\"+7900%07u\",145", dev->id);
+	} else if (!strcasecmp(cmd, "+CREG?")) {
+		out_printf(o, "+CREG: 2,1,\"2B5C\",\"%08X\",7", 0x01A20000u + dev->id);
+	} else if (!strcasecmp(cmd, "+CSQ")) {
+		out_printf(o, "+CSQ: %u,99", 10 + (unsigned)(lrand48() % 21));
+	} else if (!strcasecmp(cmd, "+CLCC")) {
+		if (dev->state != CALL_NONE) {
+			out_printf(o, "+CLCC: 1,%u,%d,0,0,\"%s\",145", dev->dir, dev->state, dev->number);
+		}
+	} else if (!strcasecmp(cmd, "+CLCC=1")) {
+		dev->clcc = 1;
+	} else if (!strcasecmp(cmd, "^DSCI=1") || !strcasecmp(cmd, "^DSCI=0")) {
+		if (opts.vendor != VENDOR_QUECTEL) {
+			return -1;
+		}
+		dev->dsci = cmd[6] == '1';
+	} else if (!strcasecmp(cmd, "A")) {
+		if (dev->state != CALL_INCOMING) {
+			return -1;
+		}
+		stats.answered++;
+		call_set_state(dev, CALL_ACTIVE, now, post);
+	} else if (toupper(cmd[0]) == 'D') {
+		if (dev->state != CALL_NONE) {
+			return -1;
+		}
+		snprintf(dev->number, sizeof(dev->number), "%.*s", (int)strcspn(cmd + 1, ";"), cmd + 1);
+		dev->dir = 0;
+		dev->call_next = now + DIAL_ALERT;
+		dev->next_status = next_event(now, opts.clcc_rate);
+		call_set_state(dev, CALL_DIALING, now, post);
+		stats.calls_out++;
+	} else if (!strcasecmp(cmd, "H") || !strcasecmp(cmd, "+CHUP") || !strncasecmp(cmd, "+QHUP", 5) || !strncasecmp(cmd, "+CHLD=1", 7)) {
+		if (dev->state != CALL_NONE) {
+			call_set_state(dev, CALL_RELEASED, now, post);
+		}
+	} else if (!strncasecmp(cmd, "+CFUN=1,1", 9)) {
+		if (dev->state != CALL_NONE) {
+			call_set_state(dev, CALL_RELEASED, now, post);
+		}
+		dev->clcc = dev->dsci = 0;
+	} else if (!strncasecmp(cmd, "+CMGS=", 6)) {
+		dev->prompt = 1;
+		tty_write(dev->data.master, "\r\n> ", 4);
+		return 1;
+	} else if (!strncasecmp(cmd, "+CMGR=", 6)) {
+		idx = (unsigned)atoi(cmd + 6);
+		if (idx >= SMS_SLOTS || !dev->sms[idx]) {
+			out_printf(o, "+CMS ERROR: 321");
+			return 1;
+		}
+		out_printf(o, "+CMGR: 1,,%u\r\n%s", PDU_TPDU_LEN, PDU);
+	} else if (!strncasecmp(cmd, "+CMGL=", 6)) {
+		sms_list(dev, o);
+	} else if (!strncasecmp(cmd, "+CMGD=", 6)) {
+		const char * const flag = strchr(cmd, ',');
+		idx = (unsigned)atoi(cmd + 6);
+		if (flag && atoi(flag + 1) == 4) {
+			memset(dev->sms, 0, sizeof(dev->sms));
+		} else if (idx < SMS_SLOTS) {
+			dev->sms[idx] = 0;
+		}
+	} else {
+		for (idx = 0; idx < ITEMS_OF(answers); ++idx) {
+			const char * answer;
+
+			if (strncasecmp(cmd, answers[idx].cmd, strlen(answers[idx].cmd))) {
+				continue;
+			}
+			answer = opts.vendor == VENDOR_SIMCOM ? answers[idx].simcom : answers[idx].quectel;
+			if (!answer) {
+				return -1;
+			}
+			out_printf(o, "%s", answer);
+			break;
+		}
+	}
+	return 0;
+}
+
+#/* handle command line, AT+A;+B is answered by responses of both and one final result */
+static void command_line(struct device * dev, char * line, int64_t now)
+{
+	static struct out o, post;
+	char * cmd;
+	int res = 0;
+
+	while (*line == '\n' || *line == ' ') {
+		line++;
+	}
+	if (strncasecmp(line, "AT", 2)) {
+		return;
+	}
+	cmd = line + 2;
+	stats.commands++;
+
+	if (toupper(cmd[0]) == 'D') {
+		/* dial string ends with ; */
+		res = command(dev, cmd, now, &o, &post);
+	} else {
+		while (*cmd && !res) {
+			char * end = cmd;
+			int quoted = 0;
+
+			for (; *end && (quoted || *end != ';'); ++end) {
+				if (*end == '"') {
+					quoted = !quoted;
+				}
+			}
+			if (*end) {
+				*end++ = '\0';
+			}
+			res = command(dev, cmd, now, &o, &post);
+			cmd = end;
+		}
+	}
+
+	if (res < 0) {
+		stats.errors++;
+		out_printf(&o, "ERROR");
+	} else if (res == 0) {
+		out_printf(&o, "OK");
+	}
+	out_flush(dev, &o);
+	out_flush(dev, &post);
+}
+
+#/* PDU of AT+CMGS ends by Ctrl-Z, ESC cancels sending */
+static void sms_submit(struct device * dev, char c)
+{
+	struct out o = { 0 };
+
+	dev->prompt = 0;
+	dev->len = 0;
+	if (c == 0x1A) {
+		out_printf(&o, "+CMGS: %u", ++dev->mr & 0xFF);
+		stats.sms_out++;
+	}
+	out_printf(&o, "OK");
+	out_flush(dev, &o);
+}
+
+#/* */
+static void data_read(struct device * dev, int64_t now)
+{
+	char buf[1024];
+	ssize_t n, i;
+
+	while ((n = read(dev->data.master, buf, sizeof(buf))) > 0) {
+		for (i = 0; i < n; ++i) {
+			const char c = buf[i];
+
+			if (dev->prompt) {
+				if (c == 0x1A || c == 0x1B) {
+					sms_submit(dev, c);
+				}
+				continue;
+			}
+
+			if (c == '\r') {
+				dev->line[dev->len] = '\0';
+				command_line(dev, dev->line, now);
+				dev->len = 0;
+			} else if (dev->len < sizeof(dev->line) - 1) {
+				dev->line[dev->len++] = c;
+			}
+		}
+	}
+}
+
+#/* sink of driver audio */
+static void audio_read(struct device * dev)
+{
+	char buf[4096];
+	ssize_t n;
+
+	while ((n = read(dev->audio.master, buf, sizeof(buf))) > 0) {
+		stats.audio_in += n;
+	}
+}
+
+#/* source of call audio, 1 kHz tone paced by call time */
+static void audio_write(struct device * dev, int64_t now)
+{
+	const unsigned samples = opts.rate * FRAME_MS / 1000;
+	int16_t frame[16000 * FRAME_MS / 1000];
+	uint64_t due = (uint64_t)(now - dev->audio_start) / FRAME_MS;
+	unsigned burst = 0;
+	unsigned i;
+
+	if (due > dev->frames + MAX_BURST) {
+		dev->frames = due - MAX_BURST;
+	}
+
+	for (; dev->frames < due && burst < MAX_BURST; ++dev->frames, ++burst) {
+		for (i = 0; i < samples; ++i, ++dev->phase) {
+			frame[i] = (int16_t)(8000.0 * sin(2.0 * M_PI * 1000.0 * dev->phase / opts.rate));
+		}
+		dev->phase %= opts.rate;
+		tty_write(dev->audio.master, (const char *)frame, samples * sizeof(frame[0]));
+		stats.audio_out += samples * sizeof(frame[0]);
+	}
+}
+
+#/* run due events of device, return time of next one */
+static int64_t device_timers(struct device * dev, int64_t now)
+{
+	struct out o = { 0 };
+	int64_t next;
+
+	if (now >= dev->call_next) {
+		call_timer(dev, now, &o);
+	}
+
+	if (now >= dev->next_ring) {
+		if (dev->state == CALL_NONE) {
+			call_incoming(dev, now, &o);
+		}
+		dev->next_ring = next_event(now, opts.ring_rate);
+	}
+
+	if (now >= dev->next_status) {
+		if (dev->state != CALL_NONE) {
+			call_status(dev, &o);
+		}
+		dev->next_status = next_event(now, opts.clcc_rate);
+	}
+
+	if (now >= dev->next_sms) {
+		const int idx = sms_store(dev);
+		if (idx >= 0) {
+			out_printf(&o, "+CMTI: \"ME\",%d", idx);
+			stats.sms_in++;
+		}
+		dev->next_sms = next_event(now, opts.cmti_rate);
+	}
+
+	if (now >= dev->next_signal) {
+		signal_report(dev, &o);
+		dev->next_signal = next_event(now, opts.qind_rate);
+	}
+
+	if (o.len) {
+		out_flush(dev, &o);
+	}
+
+	next = dev->call_next;
+	if (dev->next_ring < next) {
+		next = dev->next_ring;
+	}
+	if (dev->next_status < next) {
+		next = dev->next_status;
+	}
+	if (dev->next_sms < next) {
+		next = dev->next_sms;
+	}
+	if (dev->next_signal < next) {
+		next = dev->next_signal;
+	}
+	if (dev->state == CALL_ACTIVE || dev->state == CALL_HELD) {
+		audio_write(dev, now);
+		if (dev->audio_start + (int64_t)(dev->frames + 1) * FRAME_MS < next) {
+			next = dev->audio_start + (int64_t)(dev->frames + 1) * FRAME_MS;
+		}
+	}
+	return next;
+}
+
+#/* */
+static void print_stats()
+{
+	fprintf(stderr, "commands %lu (errors %lu), calls in %lu out %lu answered %lu missed %lu, SMS in %lu out %lu, "
+		"signal %lu, call status %lu, audio in %lu out %lu bytes, dropped %lu bytes\n",
+		stats.commands, stats.errors, stats.calls_in, stats.calls_out, stats.answered, stats.missed,
+		stats.sms_in, stats.sms_out, stats.signal, stats.status, stats.audio_in, stats.audio_out, stats.dropped);
+}
+
+#/* */
+static void on_signal(int sig)
+{
+	if (sig == SIGUSR1) {
+		report = 1;
+	} else {
+		stop = 1;
+	}
+}
+
+#/* */
+static void usage(const char * prog)
+{
+	fprintf(stderr,
+		"Usage: %s [options] > quectel-sim.conf\n"
+		"  -n devices   number of simulated devices (%u)\n"
+		"  -d dir       directory of TTY links (%s)\n"
+		"  -m model     quectel or simcom (quectel)\n"
+		"  -s rate      8000 or 16000 Hz audio (%u)\n"
+		"  -r rate      incoming calls per device per minute (%g)\n"
+		"  -l rate      unsolicited call status per call per minute (%g)\n"
+		"  -c rate      incoming SMS (+CMTI) per device per minute (%g)\n"
+		"  -q rate      signal reports (+QIND/+CSQ) per device per minute (%g)\n"
+		"  -t seconds   duration of call before remote hangup (%u)\n"
+		"  -k rings     RINGs before incoming call is missed (%u)\n"
+		"  -a ms        alerting of outgoing call before remote answer (%u)\n",
+		prog, opts.devices, opts.dir, opts.rate, opts.ring_rate, opts.clcc_rate, opts.cmti_rate, opts.qind_rate,
+		opts.duration, opts.rings, opts.answer);
+}
+
+#/* */
+int main(int argc, char ** argv)
+{
+	struct device * devs;
+	struct pollfd * fds;
+	struct sigaction sa;
+	unsigned idx, opened = 0;
+	int64_t now;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "n:d:m:s:r:l:c:q:t:k:a:h")) != -1) {
+		switch (opt) {
+			case 'n': opts.devices = (unsigned)atoi(optarg); break;
+			case 'd': opts.dir = optarg; break;
+			case 'm':
+				if (!strcasecmp(optarg, "simcom")) {
+					opts.vendor = VENDOR_SIMCOM;
+				} else if (!strcasecmp(optarg, "quectel")) {
+					opts.vendor = VENDOR_QUECTEL;
+				} else {
+					usage(argv[0]);
+					return 1;
+				}
+				break;
+			case 's': opts.rate = (unsigned)atoi(optarg); break;
+			case 'r': opts.ring_rate = atof(optarg); break;
+			case 'l': opts.clcc_rate = atof(optarg); break;
+			case 'c': opts.cmti_rate = atof(optarg); break;
+			case 'q': opts.qind_rate = atof(optarg); break;
+			case 't': opts.duration = (unsigned)atoi(optarg); break;
+			case 'k': opts.rings = (unsigned)atoi(optarg); break;
+			case 'a': opts.answer = (unsigned)atoi(optarg); break;
+			default:
+				usage(argv[0]);
+				return 1;
+		}
+	}
+
+	if (!opts.devices || (opts.rate != 8000 && opts.rate != 16000)) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	if (mkdir(opts.dir, 0755) && errno != EEXIST) {
+		perror(opts.dir);
+		return 1;
+	}
+
+	devs = calloc(opts.devices, sizeof(*devs));
+	fds = calloc(opts.devices * 2, sizeof(*fds));
+	if (!devs || !fds) {
+		perror("calloc");
+		return 1;
+	}
+
+	srand48(getpid());
+	now = now_ms();
+	for (idx = 0; idx < opts.devices; ++idx) {
+		struct device * const dev = &devs[idx];
+
+		dev->id = idx;
+		dev->state = CALL_NONE;
+		dev->call_next = INT64_MAX;
+		dev->next_status = INT64_MAX;
+		dev->next_ring = next_event(now, opts.ring_rate);
+		dev->next_sms = next_event(now, opts.cmti_rate);
+		dev->next_signal = next_event(now, opts.qind_rate);
+		dev->data.master = dev->audio.master = -1;
+
+		if (pty_open(&dev->data, opts.dir, idx, "data") || pty_open(&dev->audio, opts.dir, idx, "audio")) {
+			pty_close(&dev->data);
+			break;
+		}
+		opened++;
+
+		fds[idx * 2].fd = dev->data.master;
+		fds[idx * 2].events = POLLIN;
+		fds[idx * 2 + 1].fd = dev->audio.master;
+		fds[idx * 2 + 1].events = POLLIN;
+
+		printf("[sim%u]\ndata=%s\naudio=%s\n", idx, dev->data.link, dev->audio.link);
+		if (opts.vendor == VENDOR_SIMCOM) {
+			printf("uac=no\n");
+		}
+		if (opts.rate == 16000) {
+			printf("slin16=yes\n");
+		}
+		printf("\n");
+	}
+	fflush(stdout);
+
+	if (!opened) {
+		return 1;
+	}
+	fprintf(stderr, "%u %s devices in %s\n", opened, opts.vendor == VENDOR_SIMCOM ? "SimCOM" : "Quectel", opts.dir);
+
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = on_signal;
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+	sigaction(SIGUSR1, &sa, NULL);
+
+	while (!stop) {
+		int64_t next = INT64_MAX;
+		int timeout;
+
+		now = now_ms();
+		for (idx = 0; idx < opened; ++idx) {
+			const int64_t dev_next = device_timers(&devs[idx], now);
+			if (dev_next < next) {
+				next = dev_next;
+			}
+		}
+
+		if (report) {
+			report = 0;
+			print_stats();
+		}
+
+		timeout = next == INT64_MAX ? -1 : (int)(next > now_ms() ? next - now_ms() : 0);
+		if (poll(fds, opened * 2, timeout) <= 0) {
+			continue;
+		}
+
+		now = now_ms();
+		for (idx = 0; idx < opened; ++idx) {
+			if (fds[idx * 2].revents & POLLIN) {
+				data_read(&devs[idx], now);
+			}
+			if (fds[idx * 2 + 1].revents & POLLIN) {
+				audio_read(&devs[idx]);
+			}
+		}
+	}
+
+	print_stats();
+	for (idx = 0; idx < opened; ++idx) {
+		pty_close(&devs[idx].data);
+		pty_close(&devs[idx].audio);
+	}
+	free(fds);
+	free(devs);
+	return 0;
+}